@@ -418,6 +418,349 @@ kvs_result kvs_close_key_space(kvs_key_space_handle ks_hd);
 */
 kvs_result kvs_get_key_space_info(kvs_key_space_handle ks_hd, kvs_key_space *ks);
 
+/*
+* \ingroup key_space_interfaces
+*
+  This API enables or disables the write-back buffer of a Key Space.
+  With the buffer enabled, stores with the KVS_STORE_POST option are copied into a host
+  buffer and written to the device in batches: once batch_size dirty key value pairs have
+  accumulated, once a pair has waited flush_interval_us, when the buffer is full or when
+  kvs_flush_key_space is called. A store of a key that is still waiting in the buffer
+  replaces the buffered value. Retrieves of buffered keys are served from the buffer.
+  Deletes, existence checks, iterators and stores with other options or a time to live
+  first flush the buffer and then go to the device.
+  With KVS_WRITEBACK_ACK_BUFFERED, a store completes (and its post process function is
+  called from the calling thread) once its value is buffered. Errors of the later device
+  write are then returned by the next kvs_flush_key_space. With KVS_WRITEBACK_ACK_DEVICE,
+  it completes when its value has been written to the device.
+  This API should not be called while I/O to the Key Space is in progress. Closing the
+  Key Space flushes the buffer.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN opt write-back options, NULL flushes and disables the buffer
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID buffer_size or batch_size is 0
+  KVS_ERR_SYS_IO flushing the buffer failed
+  KVS_ERR_OPTION_INVALID checksums or encryption of the Key Space are enabled
+*/
+kvs_result kvs_set_writeback(kvs_key_space_handle ks_hd, kvs_option_writeback *opt);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API writes all key value pairs buffered in the write-back buffer of a Key Space
+  to the device and waits for them to complete. It does nothing when the buffer is not enabled.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+
+  RETURNS
+  KVS_SUCCESS to indicate success or the first error of a device write since the last flush.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_SYS_IO Communication with device failed
+*/
+kvs_result kvs_flush_key_space(kvs_key_space_handle ks_hd);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API returns the counters of the write-back buffer of a Key Space.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  OUT stats write-back counters, all zero when the buffer is not enabled
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID stats is NULL
+*/
+kvs_result kvs_get_writeback_stats(kvs_key_space_handle ks_hd, kvs_writeback_stats *stats);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API enables or disables end-to-end value checksums of a Key Space.
+  With checksums enabled, every 4092 byte chunk of a stored value is followed on the device
+  by the CRC32C of the chunk, computed with the SSE4.2 or ARMv8 CRC instructions when
+  available. Retrieves read the chunks that cover the requested range (value offset and
+  length), verify them and return the value bytes only; value lengths and offsets seen by
+  the caller are those of the value without checksums. A value that does not match its
+  checksums is reported with KVS_ERR_CHECKSUM_MISMATCH.
+  The setting is not stored on the device: it has to be enabled every time the Key Space
+  is opened, and values stored without it cannot be read with it and vice versa.
+  The largest value that can be stored is 2048 bytes smaller than KVS_MAX_VALUE_LENGTH.
+  Stores with KVS_STORE_APPEND are not supported, nor is the write-back buffer.
+  This API should not be called while I/O to the Key Space is in progress.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN enable true to enable checksums, false to disable them
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_OPTION_INVALID the write-back buffer, read-ahead or encryption of the Key Space is enabled
+*/
+kvs_result kvs_set_checksum(kvs_key_space_handle ks_hd, bool enable);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API enables or disables encryption of the values of a Key Space with AES-GCM, using
+  the AES-NI and PCLMULQDQ instructions when available. Every 4072 byte chunk of a stored value
+  is encrypted on its own and followed on the device by its 8 byte nonce and 16 byte
+  authentication tag, so a retrieve at a value offset only decrypts the chunks that cover the
+  requested range. The tag also covers the key, the value length and the chunk position: a
+  value that was modified, moved to another key or read with the wrong encryption key is
+  reported with KVS_ERR_CHECKSUM_MISMATCH. Keys are not encrypted.
+  The encryption key is not stored anywhere: it has to be set every time the Key Space is
+  opened, and is wiped from memory when encryption is disabled or the Key Space is closed.
+  The largest value that can be stored is 12288 bytes smaller than KVS_MAX_VALUE_LENGTH.
+  Encryption cannot be combined with kvs_set_checksum, KVS_STORE_APPEND or the write-back buffer.
+  This API should not be called while I/O to the Key Space is in progress.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN opt AES-128 or AES-256 key, NULL to disable encryption
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID the key length is neither 16 nor 32 bytes
+  KVS_ERR_OPTION_INVALID checksums, the write-back buffer or read-ahead of the Key Space are enabled
+*/
+kvs_result kvs_set_encryption(kvs_key_space_handle ks_hd, kvs_option_encryption *opt);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API enables or disables long keys in a Key Space. With long keys enabled, keys of
+  KVS_MAX_KEY_LENGTH up to KVS_MAX_LONG_KEY_LENGTH bytes are stored on the device under a
+  digest key of KVS_MAX_KEY_LENGTH bytes: the first 223 bytes of the key followed by its
+  SHA-256. The original key is stored in front of the value, so a retrieve needs a single read
+  and detects a digest collision; it is reported with KVS_ERR_KEY_NOT_EXIST. Stores, deletes
+  and existence checks do not read the device and so do not detect collisions.
+  Keys shorter than KVS_MAX_KEY_LENGTH are stored as they are, keys of exactly
+  KVS_MAX_KEY_LENGTH bytes are always treated as long keys.
+  The largest value that can be stored with a long key is 8 bytes plus the key length
+  smaller than the largest value of the Key Space.
+  Iterators return the original keys; a key only iterator reads the value of every long key
+  it finds to get its key. An entry larger than the iterator buffer is skipped and fails
+  kvs_iterate_next with KVS_ERR_BUFFER_SMALL; the next call continues after it.
+  Key value iterators cannot be combined with kvs_set_checksum or kvs_set_encryption.
+  Stores with KVS_STORE_APPEND are not supported for long keys.
+  The setting is not stored on the device: it has to be enabled every time the Key Space
+  is opened. This API should not be called while I/O to the Key Space is in progress.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN enable true to enable long keys, false to disable them
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+*/
+kvs_result kvs_set_long_keys(kvs_key_space_handle ks_hd, bool enable);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API turns hot key tracking of a Key Space on or off. Every store, retrieve and delete
+  sent to the Key Space (and every operation of a write batch) is counted in a count-min
+  sketch by key; on average one of sample_rate requests to the Key Space is counted. The keys
+  with the highest estimated reads, writes and value bytes are kept in three lists of top_k
+  keys that kvs_get_hot_keys returns. Estimates are never below the sampled counts, a key that
+  shares all its sketch counters with hotter keys is overestimated. Value bytes are the value
+  length of stores and the returned value size of retrieves. Requests that fail validation
+  are not counted. Enabling tracking again starts over with empty counts.
+  This API should not be called while I/O to the Key Space is in progress.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN opt tracking options, NULL turns tracking off
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID top_k is 0 or larger than 256, or depth is larger than 8
+*/
+kvs_result kvs_set_hot_keys(kvs_key_space_handle ks_hd, kvs_option_hot_keys *opt);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API returns the hottest keys of a Key Space by reads, writes or value bytes, hottest
+  first, with the estimated reads, writes and value bytes of each.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN order ranking to return
+  OUT keys buffer for up to *count keys
+  INOUT count capacity of keys in, number of keys returned out; 0 when tracking is off
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID keys or count is NULL, or order is not supported
+*/
+kvs_result kvs_get_hot_keys(kvs_key_space_handle ks_hd, kvs_hot_keys_order order,
+  kvs_hot_key *keys, uint32_t *count);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API turns speculative read-ahead of a Key Space on or off. Retrieves of keys that end
+  in a number are grouped into streams: the number is the last run of decimal digits of the key,
+  which may be followed by NUL bytes only, or else the last eight bytes of the key read as a
+  big-endian integer; keys with the same bytes around the number belong to the same kind. A
+  stream is recognized once three retrieves of a kind step by the same distance (the stride, at
+  most max_stride in either direction), so several threads scanning different ranges, or one
+  thread scanning several, each get a stream. Up to depth keys ahead of a stream are then
+  retrieved asynchronously into buffers of value_size bytes, and retrieves of those keys are
+  served from the buffers, or wait for the speculative retrieve in flight. A stream reads ahead
+  one key more for every key that is used, and half as many when fewer than min_accuracy
+  percent of its speculative retrieves were used; it stops reading ahead until it has been
+  followed for a while longer when that reaches none. Speculative retrieves that are no longer
+  wanted are canceled while they are still queued (emulator only, see kvs_cancel_io).
+  A store, delete, write batch or retrieve with delete sent to the Key Space invalidates the
+  values read ahead before it completed, so a retrieve never returns a value older than a write
+  that completed before it was sent. A pair that expires (kvs_option_store.ttl_ms) after it was
+  read ahead is still returned. Retrieves with a value offset, and values larger than
+  value_size or than the caller's buffer, go to the device.
+  Read-ahead cannot be combined with checksums or encryption of the Key Space. Enabling it again
+  starts over with no streams. This API should not be called while I/O to the Key Space is in
+  progress.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN opt read-ahead options, NULL turns read-ahead off
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID streams or depth is larger than 64, min_accuracy is larger than 100,
+                        or value_size is not a multiple of KVS_VALUE_LENGTH_ALIGNMENT_UNIT
+  KVS_ERR_OPTION_INVALID checksums or encryption of the Key Space are enabled
+*/
+kvs_result kvs_set_read_ahead(kvs_key_space_handle ks_hd, kvs_option_read_ahead *opt);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API returns the counters of speculative read-ahead of a Key Space. The share of
+  speculative retrieves that were of no use is wasted / issued.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  OUT stats read-ahead counters, all zero when read-ahead is not enabled
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID stats is NULL
+*/
+kvs_result kvs_get_read_ahead_stats(kvs_key_space_handle ks_hd, kvs_read_ahead_stats *stats);
+
+/*
+* \ingroup device_interfaces
+*
+  This API returns the expiration counters of key value pairs stored with a time to live
+  (kvs_option_store.ttl_ms). Expired pairs are dropped by the first retrieve, exist, delete,
+  store or iteration that finds them, and by a background reaper limited to ttl_reaper_rate
+  pairs per second (emulator configuration file).
+
+  PARAMETERS
+  IN dev_hd device handle
+  OUT stats expiration counters
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_DEV_NOT_OPENED device is not open
+  KVS_ERR_PARAM_INVALID stats is NULL
+  KVS_ERR_OPTION_INVALID the device does not support time to live
+*/
+kvs_result kvs_get_ttl_stats(kvs_device_handle dev_hd, kvs_ttl_stats *stats);
+
+/*
+* \ingroup device_interfaces
+*
+  This API returns the counters of the DRAM cache model of an emulated device (cache_size in
+  the emulator configuration file). Retrieves that hit the cache and stores absorbed by its
+  write buffer complete at the cache latencies, the others at the IOPS model latency, so the
+  hit rate is read_hits / (read_hits + read_misses). All counters are zero if the cache model
+  is off.
+
+  PARAMETERS
+  IN dev_hd device handle
+  OUT stats cache counters
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_DEV_NOT_OPENED device is not open
+  KVS_ERR_PARAM_INVALID stats is NULL
+  KVS_ERR_OPTION_INVALID the device does not report its cache
+*/
+kvs_result kvs_get_cache_stats(kvs_device_handle dev_hd, kvs_cache_stats *stats);
+
+/*
+* \ingroup device_interfaces
+*
+  This API selects where the post process functions of asynchronous requests to a device run.
+  By default (KVS_DISPATCH_INLINE) they are called by the driver thread that receives the
+  completions, so a slow post process function holds back the completions of every request
+  behind it. With KVS_DISPATCH_POOL they are queued to a pool of dispatch threads, by default
+  one bound to each CPU the caller may run on, and may run concurrently. With ordered set, the
+  completions of requests sent by the same thread go to the same dispatch thread and run one
+  at a time in the order they completed. With KVS_DISPATCH_EXECUTOR every completion is handed
+  to the executor of the caller, which has to call run(task) exactly once from any thread;
+  submitter identifies the thread that sent the request, for executors that keep their own
+  order. A Key Space is not closed before the post process functions of its requests have
+  returned. Post process functions of requests that fail before they reach the device, and
+  stores acknowledged by the write-back buffer, are still called by the calling thread.
+  This API should not be called while asynchronous I/O to the device is in progress.
+
+  PARAMETERS
+  IN dev_hd device handle
+  IN opt dispatch options, NULL selects KVS_DISPATCH_INLINE
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_DEV_NOT_OPENED device is not open
+  KVS_ERR_PARAM_INVALID mode is not supported or no executor is given for KVS_DISPATCH_EXECUTOR
+*/
+kvs_result kvs_set_completion_dispatch(kvs_device_handle dev_hd, kvs_option_dispatch *opt);
+
 /*
 * \ingroup key_space_interfaces
 *
@@ -472,6 +815,7 @@ kvs_result kvs_get_kvp_info(kvs_key_space_handle ks_hd, kvs_key *key, kvs_kvp_in
   KVS_ERR_OFFSET_INVALID kvs_value.offset is invalid
   KVS_ERR_OPTION_INVALID the option is not supported
   KVS_ERR_KEY_NOT_EXIST Key does not exist
+  KVS_ERR_CHECKSUM_MISMATCH the value does not match its checksums (see kvs_set_checksum)
 */
 kvs_result kvs_retrieve_kvp(kvs_key_space_handle ks_hd, kvs_key *key, kvs_option_retrieve *opt, kvs_value *value);
 
@@ -491,6 +835,8 @@ kvs_result kvs_retrieve_kvp(kvs_key_space_handle ks_hd, kvs_key *key, kvs_option
   IN ks_hd Key Space handle
   IN key Key of the key value pair to get value
   IN opt retrieval option. It may be NULL. In that case, the default retrieval option is used.
+         A non zero deadline_us drops the request if it is still queued that many microseconds after
+         it was submitted (emulator only, see kvs_cancel_io).
   IN private1 Structure passed that may be returned in the kvs_postprocess_context 
     after the async IO is completed
   IN private2 Structure passed that may be returned in the kvs_postprocess_context 
@@ -511,6 +857,10 @@ kvs_result kvs_retrieve_kvp(kvs_key_space_handle ks_hd, kvs_key *key, kvs_option
   KVS_ERR_OFFSET_INVALID kvs_value.offset is invalid
   KVS_ERR_OPTION_INVALID the option is not supported
   KVS_ERR_KEY_NOT_EXIST Key does not exist
+  KVS_ERR_CHECKSUM_MISMATCH the value does not match its checksums (see kvs_set_checksum),
+                            passed to post_fn
+  KVS_ERR_DEADLINE_EXCEEDED the request was not dispatched before its deadline
+  KVS_ERR_CANCELED the request was canceled with kvs_cancel_io, passed to post_fn
 */
 kvs_result kvs_retrieve_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key, 
   kvs_option_retrieve *opt, void *private1, void *private2, kvs_value *value, kvs_postprocess_function post_fn);
@@ -527,6 +877,7 @@ kvs_result kvs_retrieve_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key,
   IN key Key of the key value pair to store into Key Space
   IN value Value of the key value pair to store into Key Space
   IN opt Store option. It may be NULL. In that case, the kvs_store_type of KVS_STORE_POST is used.
+         A non zero ttl_ms makes the pair expire that many milliseconds after it is stored (emulator only).
 
   RETURNS
   KVS_SUCCESS to indicate that store is successful or an error code for error.
@@ -558,6 +909,9 @@ kvs_result kvs_store_kvp(kvs_key_space_handle ks_hd, kvs_key *key, kvs_value *va
   IN key Key of the key value pair to store into Key Space
   IN value Value of the key value pair to store into Key Space
   IN opt Store option. It may be NULL. In that case, the kvs_store_type of KVS_STORE_POST is used.
+         A non zero ttl_ms makes the pair expire that many milliseconds after it is stored (emulator only).
+         A non zero deadline_us drops the request if it is still queued that many microseconds after
+         it was submitted (emulator only, see kvs_cancel_io).
   IN private1 Structure passed that may be returned in the kvs_postprocess_context 
     after the async IO is completed
   IN private2 Structure passed that may be returned in the kvs_postprocess_context 
@@ -578,6 +932,8 @@ kvs_result kvs_store_kvp(kvs_key_space_handle ks_hd, kvs_key *key, kvs_value *va
   KVS_ERR_KS_CAPACITY Key Space or device does not have enough space to store this key value pair
   KVS_ERR_VALUE_UPDATE_NOT_ALLOWED a key exists but overwrite is not permitted
   KVS_ERR_VALUE_LENGTH_INVALID given value is not supported (e.g., length)
+  KVS_ERR_DEADLINE_EXCEEDED the request was not dispatched before its deadline
+  KVS_ERR_CANCELED the request was canceled with kvs_cancel_io, passed to post_fn
 */
 kvs_result kvs_store_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key, kvs_value *value, 
   kvs_option_store *opt, void *private1, void *private2, kvs_postprocess_function post_fn);
@@ -614,6 +970,8 @@ kvs_result kvs_delete_kvp(kvs_key_space_handle ks_hd, kvs_key* key, kvs_option_d
   IN ks_hd Key Space handle
   IN key Key of the key value pair(s) to delete
   IN opt delete option
+         A non zero deadline_us drops the request if it is still queued that many microseconds after
+         it was submitted (emulator only, see kvs_cancel_io).
   IN private1 Structure passed that may be returned in the kvs_postprocess_context 
     after the async IO is completed
   IN private2 Structure passed that may be returned in the kvs_postprocess_context 
@@ -629,10 +987,104 @@ kvs_result kvs_delete_kvp(kvs_key_space_handle ks_hd, kvs_key* key, kvs_option_d
   KVS_ERR_SYS_IO Communication with device failed
   KVS_ERR_KEY_LENGTH_INVALID given key is not supported (e.g., length)
   KVS_ERR_KEY_NOT_EXIST key does not exist
+  KVS_ERR_DEADLINE_EXCEEDED the request was not dispatched before its deadline
+  KVS_ERR_CANCELED the request was canceled with kvs_cancel_io, passed to post_fn
 */
 kvs_result kvs_delete_kvp_async(kvs_key_space_handle ks_hd, kvs_key* key, 
   kvs_option_delete *opt, void *private1, void *private2, kvs_postprocess_function post_fn);
 
+/*
+* \ingroup key_space_interfaces
+*
+  This API cancels asynchronous requests of a Key Space that have not been dispatched to the device yet.
+  A canceled request completes through its post process function with KVS_ERR_CANCELED; requests the
+  device already works on complete normally. With a NULL private1 all queued asynchronous requests of the
+  Key Space are canceled, otherwise those that were submitted with that private1.
+
+  Requests can also be given a deadline with the deadline_us field of kvs_option_store, kvs_option_retrieve
+  and kvs_option_delete. A request that is still queued when its deadline passes is dropped without going to
+  the device and completes with KVS_ERR_DEADLINE_EXCEEDED; if it passes while the submitting call still
+  waits for a free request context, the call itself returns KVS_ERR_DEADLINE_EXCEEDED. Synchronous requests
+  honour the deadline too but cannot be canceled.
+
+  Stores acknowledged by the write-back buffer (kvs_set_writeback) are not queued requests and are neither
+  canceled nor dropped.
+
+  [SAMSUNG]
+  Only the emulator supports deadlines and cancellation; other drivers ignore deadline_us.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN private1 private1 of the requests to cancel, or NULL for all requests of the Key Space
+  OUT canceled number of requests canceled. It may be NULL.
+
+  RETURNS
+  KVS_SUCCESS to indicate that the queued requests were canceled or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_EXIST Key Space with a given ks_hd does not exist
+  KVS_ERR_OPTION_INVALID the driver does not support cancellation
+*/
+kvs_result kvs_cancel_io(kvs_key_space_handle ks_hd, void *private1, uint32_t *canceled);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API applies a list of stores and deletes to a Key Space atomically: either all of them take effect
+  or none does, and no other command observes a partially applied batch. Operations are applied in order,
+  so a later operation on the same key wins. Stores overwrite existing values (KVS_STORE_POST) and deletes
+  of missing keys succeed. A batch is sent to the device as one command, which amortizes the per command
+  cost over its operations.
+
+  A batch fails with KVS_ERR_ITERATOR_OPEN if one of its keys matches the filter of an open iterator that
+  has not reached its end in the Key Space, since the iterator could otherwise return part of the batch.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN ops operations in the order they are applied
+  IN op_cnt number of operations, 1 to KVS_MAX_BATCH_OPS
+
+  RETURNS
+  KVS_SUCCESS to indicate that all operations were applied or an error code, in which case none was.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN Key space is not open
+  KVS_ERR_PARAM_INVALID ops is NULL, op_cnt is out of range or a store has no value
+  KVS_ERR_KEY_LENGTH_INVALID given key is not supported (e.g., length)
+  KVS_ERR_VALUE_LENGTH_INVALID given value is not supported (e.g., length)
+  KVS_ERR_KS_CAPACITY Key Space does not have enough space for the batch
+  KVS_ERR_ITERATOR_OPEN a key of the batch is in the group of an open iterator
+  KVS_ERR_OPTION_INVALID the device does not support write batches (emulator only)
+  KVS_ERR_SYS_IO the batch failed on the device and was rolled back
+*/
+kvs_result kvs_write_batch(kvs_key_space_handle ks_hd, kvs_batch_op *ops, uint32_t op_cnt);
+
+/*
+* \ingroup key_space_interfaces
+*
+  This API asynchronously applies a list of stores and deletes to a Key Space atomically, \see kvs_write_batch.
+  The final execution results are returned to post process function through kvs_postprocess_context,
+  whose context is KVS_CMD_WRITE_BATCH. The operations, keys and values must stay valid until then.
+
+  PARAMETERS
+  IN ks_hd Key Space handle
+  IN ops operations in the order they are applied
+  IN op_cnt number of operations, 1 to KVS_MAX_BATCH_OPS
+  IN private1 Structure passed that may be returned in the kvs_postprocess_context 
+    after the async IO is completed
+  IN private2 Structure passed that may be returned in the kvs_postprocess_context 
+    after the async IO is completed
+  IN post_fn post process function pointer
+
+  RETURNS
+  KVS_SUCCESS to indicate that the batch was submitted or an error code for error.
+
+  ERROR CODE
+  same as kvs_write_batch
+*/
+kvs_result kvs_write_batch_async(kvs_key_space_handle ks_hd, kvs_batch_op *ops, uint32_t op_cnt,
+  void *private1, void *private2, kvs_postprocess_function post_fn);
+
 /*
 * \ingroup key_space_interfaces
 *
@@ -850,6 +1302,303 @@ kvs_result kvs_iterate_next(kvs_key_space_handle ks_hd, kvs_iterator_handle iter
 kvs_result kvs_iterate_next_async(kvs_key_space_handle ks_hd, kvs_iterator_handle iter_hd , 
   kvs_iterator_list *iter_list, void *private1, void *private2, kvs_postprocess_function post_fn);
 
+/*
+* \ingroup replica_set_interfaces
+*
+  This API groups Key Spaces, normally opened on different devices, into a replica set.
+  Stores and deletes through the replica set go to every Key Space and return once
+  write_quorum of them have completed; the others complete in the background, in order
+  with later writes to the same Key Space. A retrieve is sent to one replica, chosen round
+  robin. With hedge_reads, a backup read goes to the next replica when the first one has
+  not completed after the hedge_percentile read latency of the replica set (at least
+  hedge_min_us), and the first answer wins. A replica that fails a read is replaced by the
+  next one right away.
+  The replica set does not own the Key Spaces, they must stay open until it is closed.
+
+  PARAMETERS
+  IN ks_hds Key Space handles of the replicas
+  IN ks_cnt number of replicas, 1 to KVS_MAX_REPLICAS
+  IN opt replication options
+  OUT rs_hd replica set handle
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN a Key space is not open
+  KVS_ERR_PARAM_INVALID ks_hds, opt or rs_hd is NULL, ks_cnt or write_quorum is out of range,
+    hedge_percentile is not between 0 and 100
+  KVS_ERR_SYS_IO too many replica sets are open
+*/
+kvs_result kvs_open_replica_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt,
+  kvs_option_replica *opt, kvs_replica_set_handle *rs_hd);
+
+/*
+* \ingroup replica_set_interfaces
+*
+  This API waits for the background replica writes of a replica set and closes it.
+  The Key Spaces stay open.
+
+  PARAMETERS
+  IN rs_hd replica set handle
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID replica set is not open
+*/
+kvs_result kvs_close_replica_set(kvs_replica_set_handle rs_hd);
+
+/*
+* \ingroup replica_set_interfaces
+*
+  This API stores a key value pair on the replicas of a replica set, \see kvs_open_replica_set.
+  The key and value may be reused once it returns.
+
+  PARAMETERS
+  IN rs_hd replica set handle
+  IN key key to store
+  IN value value to store
+  IN opt store options
+
+  RETURNS
+  KVS_SUCCESS when write_quorum replicas have stored the pair or the error of a failed
+  replica otherwise.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID replica set is not open, or key, value or opt is NULL
+  KVS_ERR_KEY_LENGTH_INVALID given key is not supported (e.g., length)
+  KVS_ERR_VALUE_LENGTH_INVALID given value is not supported (e.g., length)
+  any error of kvs_store_kvp_async returned by a replica
+*/
+kvs_result kvs_replica_store_kvp(kvs_replica_set_handle rs_hd, kvs_key *key, kvs_value *value,
+  kvs_option_store *opt);
+
+/*
+* \ingroup replica_set_interfaces
+*
+  This API retrieves a key value pair from a replica of a replica set, \see kvs_open_replica_set.
+
+  PARAMETERS
+  IN rs_hd replica set handle
+  IN key key to retrieve
+  IN opt retrieve options, kvs_retrieve_delete is not supported
+  OUT value value to receive the key's value
+
+  RETURNS
+  KVS_SUCCESS to indicate success or the answer of the replica that answered first.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID replica set is not open, or key, value or opt is NULL
+  KVS_ERR_OPTION_INVALID kvs_retrieve_delete is set
+  KVS_ERR_KEY_NOT_EXIST key does not exist
+  KVS_ERR_BUFFER_SMALL buffer space of value is not allocated or not enough
+  KVS_ERR_SYS_IO every replica failed
+*/
+kvs_result kvs_replica_retrieve_kvp(kvs_replica_set_handle rs_hd, kvs_key *key,
+  kvs_option_retrieve *opt, kvs_value *value);
+
+/*
+* \ingroup replica_set_interfaces
+*
+  This API deletes a key value pair from the replicas of a replica set, \see kvs_open_replica_set.
+  A replica that does not have the key counts towards the write quorum.
+
+  PARAMETERS
+  IN rs_hd replica set handle
+  IN key key to delete
+  IN opt delete options
+
+  RETURNS
+  KVS_SUCCESS when write_quorum replicas have deleted the pair or did not have it,
+  KVS_ERR_KEY_NOT_EXIST when kvs_delete_error is set and none of them had it, the error of
+  a failed replica otherwise.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID replica set is not open, or key or opt is NULL
+  KVS_ERR_KEY_LENGTH_INVALID given key is not supported (e.g., length)
+  any error of kvs_delete_kvp_async returned by a replica
+*/
+kvs_result kvs_replica_delete_kvp(kvs_replica_set_handle rs_hd, kvs_key *key,
+  kvs_option_delete *opt);
+
+/*
+* \ingroup replica_set_interfaces
+*
+  This API returns the counters of a replica set.
+
+  PARAMETERS
+  IN rs_hd replica set handle
+  OUT stats replication counters
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID replica set is not open or stats is NULL
+*/
+kvs_result kvs_get_replica_stats(kvs_replica_set_handle rs_hd, kvs_replica_stats *stats);
+
+/*
+* \ingroup ec_set_interfaces
+*
+  This API groups Key Spaces, normally opened on different devices, into an erasure coded set.
+  A value of at least min_value_size bytes is split into data_fragments fragments and
+  parity_fragments Reed-Solomon parity fragments are computed from them. Every fragment is
+  stored under the key followed by one byte holding the fragment number, each on a different
+  Key Space, so the value can be read back as long as data_fragments of them are available.
+  Smaller values are stored as parity_fragments + 1 full copies instead.
+  Fragments carry a 16 byte header. The set does not own the Key Spaces, they must stay open
+  until it is closed.
+
+  PARAMETERS
+  IN ks_hds Key Space handles
+  IN ks_cnt number of Key Spaces, data_fragments + parity_fragments to KVS_MAX_EC_FRAGMENTS
+  IN opt erasure coding options
+  OUT ec_hd erasure coded set handle
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_KS_NOT_OPEN a Key space is not open
+  KVS_ERR_PARAM_INVALID ks_hds, opt or ec_hd is NULL, data_fragments or parity_fragments is 0,
+    or ks_cnt is out of range
+  KVS_ERR_SYS_IO too many erasure coded sets are open
+*/
+kvs_result kvs_open_ec_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt, kvs_option_ec *opt,
+  kvs_ec_set_handle *ec_hd);
+
+/*
+* \ingroup ec_set_interfaces
+*
+  This API closes an erasure coded set. The Key Spaces stay open.
+
+  PARAMETERS
+  IN ec_hd erasure coded set handle
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID erasure coded set is not open
+*/
+kvs_result kvs_close_ec_set(kvs_ec_set_handle ec_hd);
+
+/*
+* \ingroup ec_set_interfaces
+*
+  This API encodes a value and stores its fragments, \see kvs_open_ec_set. Fragments are
+  written in parallel and not to Key Spaces marked failed. The store succeeds when enough
+  fragments to read the value back have been written; degraded_writes counts the stores
+  that missed some.
+
+  PARAMETERS
+  IN ec_hd erasure coded set handle
+  IN key key to store, at most KVS_MAX_KEY_LENGTH - 1 bytes
+  IN value value to store
+  IN opt store options, only KVS_STORE_POST is supported
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID erasure coded set is not open, or key, value or opt is NULL
+  KVS_ERR_OPTION_INVALID store type is not KVS_STORE_POST
+  KVS_ERR_KEY_LENGTH_INVALID given key is not supported (e.g., length)
+  KVS_ERR_VALUE_LENGTH_INVALID given value is not supported (e.g., length)
+  KVS_ERR_SYS_IO too few fragments could be written
+*/
+kvs_result kvs_ec_store_kvp(kvs_ec_set_handle ec_hd, kvs_key *key, kvs_value *value,
+  kvs_option_store *opt);
+
+/*
+* \ingroup ec_set_interfaces
+*
+  This API retrieves a value from an erasure coded set, \see kvs_open_ec_set. The data
+  fragments are read in parallel. When some of them are missing, because their Key Space
+  is marked failed or the read failed, the parity fragments are read in parallel too and
+  the missing data fragments are rebuilt.
+
+  PARAMETERS
+  IN ec_hd erasure coded set handle
+  IN key key to retrieve
+  IN opt retrieve options, kvs_retrieve_delete is not supported
+  OUT value value to receive the key's value, offset must be 0
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID erasure coded set is not open, or key, value or opt is NULL
+  KVS_ERR_OPTION_INVALID kvs_retrieve_delete is set
+  KVS_ERR_VALUE_OFFSET_INVALID value offset is not 0
+  KVS_ERR_KEY_NOT_EXIST key does not exist
+  KVS_ERR_BUFFER_SMALL buffer space of value is not enough, actual_value_size holds the value size
+  KVS_ERR_SYS_IO too few fragments could be read
+*/
+kvs_result kvs_ec_retrieve_kvp(kvs_ec_set_handle ec_hd, kvs_key *key, kvs_option_retrieve *opt,
+  kvs_value *value);
+
+/*
+* \ingroup ec_set_interfaces
+*
+  This API deletes the fragments of a value from an erasure coded set, \see kvs_open_ec_set.
+
+  PARAMETERS
+  IN ec_hd erasure coded set handle
+  IN key key to delete
+  IN opt delete options
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID erasure coded set is not open, or key or opt is NULL
+  KVS_ERR_KEY_LENGTH_INVALID given key is not supported (e.g., length)
+  KVS_ERR_KEY_NOT_EXIST kvs_delete_error is set and no fragment of the key exists
+  KVS_ERR_SYS_IO deleting a fragment failed
+*/
+kvs_result kvs_ec_delete_kvp(kvs_ec_set_handle ec_hd, kvs_key *key, kvs_option_delete *opt);
+
+/*
+* \ingroup ec_set_interfaces
+*
+  This API marks a Key Space of an erasure coded set failed or available again. Fragments on
+  a failed Key Space are neither read nor written, as if its device had been lost. A Key Space
+  that becomes available again is not repaired.
+
+  PARAMETERS
+  IN ec_hd erasure coded set handle
+  IN ks_idx index of the Key Space in the ks_hds list of kvs_open_ec_set
+  IN failed true to mark it failed
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID erasure coded set is not open or ks_idx is out of range
+*/
+kvs_result kvs_ec_set_failed(kvs_ec_set_handle ec_hd, uint8_t ks_idx, bool failed);
+
+/*
+* \ingroup ec_set_interfaces
+*
+  This API returns the counters of an erasure coded set.
+
+  PARAMETERS
+  IN ec_hd erasure coded set handle
+  OUT stats erasure coding counters
+
+  RETURNS
+  KVS_SUCCESS to indicate success or an error code for error.
+
+  ERROR CODE
+  KVS_ERR_PARAM_INVALID erasure coded set is not open or stats is NULL
+*/
+kvs_result kvs_get_ec_stats(kvs_ec_set_handle ec_hd, kvs_ec_stats *stats);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -41,6 +41,7 @@ extern "C" {
 
 #define KVS_MIN_KEY_LENGTH 4
 #define KVS_MAX_KEY_LENGTH 255
+#define KVS_MAX_LONG_KEY_LENGTH 4096 /*key spaces with long keys enabled, see kvs_set_long_keys */
 #define KVS_MIN_VALUE_LENGTH 0
 #define KVS_MAX_VALUE_LENGTH (2*1024*1024)
 #define KVS_OPTIMAL_VALUE_LENGTH 4096
@@ -50,6 +51,9 @@ extern "C" {
 #define G_ITER_KEY_SIZE_FIXED 16
 #define KVS_MAX_KEY_GROUP_BYTES 4
 #define KVS_ITERATOR_BUFFER_SIZE (32*1024)
+#define KVS_MAX_BATCH_OPS 1024
+#define KVS_MAX_REPLICAS 8
+#define KVS_MAX_EC_FRAGMENTS 16
 #define MAX_CONT_PATH_LEN 255
 #define MAX_KEYSPACE_NAME_LEN MAX_CONT_PATH_LEN
 
@@ -66,6 +66,9 @@ typedef enum {
   KVS_ERR_VALUE_OFFSET_MISALIGNED = 0x016,    // offset of value is required to be aligned to KVS_ALIGNMENT_UNIT
   KVS_ERR_VALUE_UPDATE_NOT_ALLOWED = 0x017,   // key exists but value update is not allowed
   KVS_ERR_DEV_NOT_OPENED          = 0x018,    // device was not opened yet
+  KVS_ERR_CHECKSUM_MISMATCH       = 0x019,    // value read from the device does not match its checksum
+  KVS_ERR_DEADLINE_EXCEEDED       = 0x01A,    // request was not dispatched before its deadline and was dropped
+  KVS_ERR_CANCELED                = 0x01B,    // request was canceled before it was dispatched
 } kvs_result;
 
 #ifdef __cplusplus
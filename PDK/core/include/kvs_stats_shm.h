@@ -0,0 +1,251 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef KVS_STATS_SHM_H
+#define KVS_STATS_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Layout of the statistics segment the library exports when the
+ * KVSSD_STATS_SHM environment variable or shm_name of [stats] in
+ * env_init.conf names a POSIX shared memory object (see shm_open).
+ *
+ * The process using the library creates the segment and writes to it with
+ * plain stores, no system call and no lock is taken in the I/O path. Other
+ * processes map it read only; kvs_stats_reader in sample_code prints it.
+ *
+ * Devices count the commands their driver completed, key spaces the share
+ * of them issued on the key space (after the write-back buffer and the long
+ * key layer). The counters of a device or key space are split into shards,
+ * one per writing thread (threads share shards beyond KVS_STATS_SHARDS), and
+ * a total is the sum over the shards. The emulator also exports the queues
+ * of a device.
+ *
+ * Every shard and queue is guarded by a sequence number that is odd while
+ * a writer updates it. A reader copies the record and retries when it saw
+ * an odd or changed number (kvs_stats_read_shard, kvs_stats_read_queue).
+ * Slots are reused: a reader that sees another generation must not
+ * subtract the counters it read before.
+ *
+ * The layout changes with version; check magic, version and size first.
+ */
+
+#define KVS_STATS_SHM_MAGIC      0x5453564b   // "KVST"
+#define KVS_STATS_SHM_VERSION    1
+#define KVS_STATS_MAX_DEVICES    16
+#define KVS_STATS_MAX_KEY_SPACES 64
+#define KVS_STATS_MAX_QUEUES     4            // per device
+#define KVS_STATS_SHARDS         16
+#define KVS_STATS_LAT_BUCKETS    32           // bucket i counts [2^i, 2^(i+1)) ns
+#define KVS_STATS_DEPTH_BUCKETS  16           // bucket i counts [2^i, 2^(i+1)) commands, 0 holds 0 and 1
+#define KVS_STATS_NAME_LEN       64
+
+typedef enum {
+  KVS_STATS_STORE = 0,
+  KVS_STATS_RETRIEVE,
+  KVS_STATS_DELETE,
+  KVS_STATS_EXIST,
+  KVS_STATS_ITERATE,
+  KVS_STATS_BATCH,
+  KVS_STATS_NR_OPS
+} kvs_stats_op_type;
+
+typedef enum {
+  KVS_STATS_SLOT_FREE = 0,
+  KVS_STATS_SLOT_OPEN = 1,
+} kvs_stats_slot_state;
+
+typedef struct {
+  uint64_t ops;        // completed commands
+  uint64_t errors;     // failed ones, a missing key is not a failure
+  uint64_t bytes;      // value bytes stored or retrieved
+  uint64_t lat_sum_ns; // submission to completion
+  uint64_t lat_hist[KVS_STATS_LAT_BUCKETS];
+} kvs_stats_op;
+
+typedef struct kvs_stats_shard {
+  uint32_t seq;
+  uint32_t reserved;
+  kvs_stats_op op[KVS_STATS_NR_OPS];
+} __attribute__((aligned(64))) kvs_stats_shard;
+
+typedef struct kvs_stats_queue {
+  uint32_t seq;
+  uint16_t queue_id;
+  uint16_t queue_type; // SUBMISSION_Q_TYPE or COMPLETION_Q_TYPE of the ADI
+  uint64_t enqueued;
+  uint64_t dequeued;
+  uint64_t depth;      // after the last enqueue or dequeue
+  uint64_t max_depth;
+  uint64_t depth_hist[KVS_STATS_DEPTH_BUCKETS]; // depth each command found on enqueue
+} __attribute__((aligned(64))) kvs_stats_queue;
+
+typedef struct kvs_stats_device {
+  uint32_t state;      // kvs_stats_slot_state
+  uint32_t generation; // incremented whenever the slot is taken
+  uint32_t nqueues;    // valid entries of queue
+  uint32_t reserved;
+  char name[KVS_STATS_NAME_LEN]; // device path
+  kvs_stats_shard shard[KVS_STATS_SHARDS];
+  kvs_stats_queue queue[KVS_STATS_MAX_QUEUES];
+} __attribute__((aligned(64))) kvs_stats_device;
+
+typedef struct kvs_stats_key_space {
+  uint32_t state;
+  uint32_t generation;
+  int32_t device;      // index of the device slot
+  uint32_t reserved;
+  char name[KVS_STATS_NAME_LEN]; // key space name, cut to fit
+  kvs_stats_shard shard[KVS_STATS_SHARDS];
+} __attribute__((aligned(64))) kvs_stats_key_space;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;       // of the segment in bytes
+  int32_t pid;         // of the writing process
+  uint32_t reserved;
+  uint64_t created;    // seconds since the epoch
+  kvs_stats_device device[KVS_STATS_MAX_DEVICES];
+  kvs_stats_key_space key_space[KVS_STATS_MAX_KEY_SPACES];
+} __attribute__((aligned(64))) kvs_stats_segment;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KVS_STATS_PAUSE() __builtin_ia32_pause()
+#else
+#define KVS_STATS_PAUSE() do {} while (0)
+#endif
+
+static inline int kvs_stats_log2(uint64_t v, int buckets) {
+  int b = v < 2 ? 0 : 63 - __builtin_clzll(v);
+  return b < buckets ? b : buckets - 1;
+}
+
+// begins an update of the record guarded by seq, concurrent writers of the
+// same record wait for each other here
+static inline uint32_t kvs_stats_write_begin(uint32_t *seq) {
+  uint32_t s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+  while ((s & 1) || !__atomic_compare_exchange_n(seq, &s, s + 1, 1,
+                                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    KVS_STATS_PAUSE();
+    s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+  }
+  // the odd number is visible before any of the counters change
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return s + 1;
+}
+
+static inline void kvs_stats_write_end(uint32_t *seq, uint32_t s) {
+  __atomic_store_n(seq, s + 1, __ATOMIC_RELEASE);
+}
+
+// counters only change between write_begin and write_end
+static inline void kvs_stats_add(uint64_t *c, uint64_t v) {
+  __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static inline void kvs_stats_set(uint64_t *c, uint64_t v) {
+  __atomic_store_n(c, v, __ATOMIC_RELAXED);
+}
+
+static inline void kvs_stats_record(kvs_stats_shard *sh, int op, int failed,
+                                    uint64_t bytes, uint64_t lat_ns) {
+  kvs_stats_op *o = &sh->op[op];
+  uint32_t s = kvs_stats_write_begin(&sh->seq);
+  kvs_stats_add(&o->ops, 1);
+  if (failed) kvs_stats_add(&o->errors, 1);
+  kvs_stats_add(&o->bytes, bytes);
+  kvs_stats_add(&o->lat_sum_ns, lat_ns);
+  kvs_stats_add(&o->lat_hist[kvs_stats_log2(lat_ns, KVS_STATS_LAT_BUCKETS)], 1);
+  kvs_stats_write_end(&sh->seq, s);
+}
+
+// copies a record of 64 bit words whose first word holds the sequence
+// number, returns the number of retries
+static inline uint32_t kvs_stats_read_words(const void *src, void *dst, uint32_t nwords) {
+  const uint32_t *seq = (const uint32_t *)src;
+  const uint64_t *w = (const uint64_t *)src;
+  uint32_t retries = 0;
+  for (;;) {
+    uint32_t s1 = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+    if (!(s1 & 1)) {
+      uint32_t i;
+      for (i = 0; i < nwords; i++) {
+        uint64_t v = __atomic_load_n(&w[i], __ATOMIC_RELAXED);
+        memcpy((char *)dst + i * sizeof(v), &v, sizeof(v));
+      }
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(seq, __ATOMIC_RELAXED) == s1) return retries;
+    }
+    retries++;
+    KVS_STATS_PAUSE();
+  }
+}
+
+static inline uint32_t kvs_stats_read_shard(const kvs_stats_shard *src, kvs_stats_shard *dst) {
+  return kvs_stats_read_words(src, dst, sizeof(kvs_stats_shard) / sizeof(uint64_t));
+}
+
+static inline uint32_t kvs_stats_read_queue(const kvs_stats_queue *src, kvs_stats_queue *dst) {
+  return kvs_stats_read_words(src, dst, sizeof(kvs_stats_queue) / sizeof(uint64_t));
+}
+
+// sums the shards into one, each shard is a consistent copy
+static inline void kvs_stats_read_total(const kvs_stats_shard *shards, kvs_stats_shard *total) {
+  uint32_t i, o, b;
+  memset(total, 0, sizeof(*total));
+  for (i = 0; i < KVS_STATS_SHARDS; i++) {
+    kvs_stats_shard sh;
+    kvs_stats_read_shard(&shards[i], &sh);
+    for (o = 0; o < KVS_STATS_NR_OPS; o++) {
+      kvs_stats_op *t = &total->op[o];
+      t->ops += sh.op[o].ops;
+      t->errors += sh.op[o].errors;
+      t->bytes += sh.op[o].bytes;
+      t->lat_sum_ns += sh.op[o].lat_sum_ns;
+      for (b = 0; b < KVS_STATS_LAT_BUCKETS; b++) t->lat_hist[b] += sh.op[o].lat_hist[b];
+    }
+  }
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+#endif
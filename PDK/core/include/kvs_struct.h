@@ -58,6 +58,7 @@ typedef enum {
   KVS_CMD_ITER_NEXT       =0x06,
   KVS_CMD_RETRIEVE        =0x07,
   KVS_CMD_STORE           =0x08,
+  KVS_CMD_WRITE_BATCH     =0x09,
 } kvs_context;
 
 typedef enum {
@@ -72,6 +73,7 @@ typedef struct {
 
 typedef struct {
   bool kvs_delete_error;      //[OPTION] return error when the key does not exist
+  uint32_t deadline_us;       //[OPTION] drop the request if it is not dispatched this many microseconds after submission, 0 for no deadline
 } kvs_option_delete;
 
 typedef enum {
@@ -85,6 +87,7 @@ typedef struct {
 
 typedef struct {
   bool kvs_retrieve_delete;       // [OPTION] retrieve the value of the key value pair and delete the key value pair
+  uint32_t deadline_us;           // [OPTION] drop the request if it is not dispatched this many microseconds after submission, 0 for no deadline
 } kvs_option_retrieve;
 
 typedef enum {
@@ -119,12 +122,18 @@ typedef struct {
 typedef struct {
   kvs_store_type st_type;         // store operation type
   kvs_association *assoc;         // association
+  uint32_t ttl_ms;                // [OPTION] time to live in milliseconds, 0 if the pair never expires
+  uint32_t deadline_us;           // [OPTION] drop the request if it is not dispatched this many microseconds after submission, 0 for no deadline
 } kvs_option_store;
 
 struct _kvs_device_handle;
 struct _kvs_key_space_handle;
+struct _kvs_replica_set_handle;
+struct _kvs_ec_set_handle;
 typedef struct _kvs_device_handle* kvs_device_handle;    // type definition of kvs_device_handle
 typedef struct _kvs_key_space_handle* kvs_key_space_handle; // type definition of kvs_key_space_handle
+typedef struct _kvs_replica_set_handle* kvs_replica_set_handle; // type definition of kvs_replica_set_handle
+typedef struct _kvs_ec_set_handle* kvs_ec_set_handle;   // type definition of kvs_ec_set_handle
 typedef uint8_t kvs_iterator_handle;  // type definition of kvs_iterator_handle
 
 typedef struct {
@@ -193,6 +202,162 @@ typedef struct {
   uint32_t value_len; // value length in bytes
 } kvs_kvp_info;
 
+typedef enum {
+  KVS_WRITEBACK_ACK_BUFFERED = 0,   // a store completes once its value has been copied into the buffer
+  KVS_WRITEBACK_ACK_DEVICE   = 1,   // a store completes once the batch holding its value has been written to the device
+} kvs_writeback_durability;
+
+typedef struct {
+  uint32_t buffer_size;                 // buffer capacity in bytes (keys and values), stores wait for space when it is full
+  uint32_t batch_size;                  // flush once this many dirty key value pairs are buffered
+  uint32_t flush_interval_us;           // flush dirty key value pairs that have been buffered this long, 0 flushes only on size or request
+  kvs_writeback_durability durability;  // when store completions are reported
+} kvs_option_writeback;
+
+typedef struct {
+  uint64_t stores;        // stores absorbed by the buffer
+  uint64_t merged;        // stores that overwrote a key still waiting in the buffer
+  uint64_t read_hits;     // retrieves served from the buffer
+  uint64_t flushes;       // batches written to the device
+  uint64_t device_writes; // store commands sent to the device
+  uint64_t bypassed;      // stores passed straight to the device (non-default options, too large)
+  uint64_t errors;        // failed device writes
+} kvs_writeback_stats;
+
+typedef struct {
+  uint64_t expiring;       // stored pairs that have a time to live
+  uint64_t expired_lazy;   // expired pairs dropped by the command that found them
+  uint64_t reaped;         // expired pairs deleted by the background reaper
+  uint64_t reaped_bytes;   // key and value bytes reclaimed by the reaper
+  uint64_t reaper_busy_ns; // time the reaper held the device key value store
+} kvs_ttl_stats;
+
+typedef struct {
+  uint64_t capacity;       // modelled cache size in bytes, 0 without a cache model
+  uint64_t used;           // key and value bytes of the cached pairs
+  uint64_t dirty;          // bytes in the write buffer, not flushed yet
+  uint64_t pairs;          // cached pairs
+  uint64_t read_hits;      // retrieves served from the cache
+  uint64_t read_misses;    // retrieves that went to the media
+  uint64_t write_absorbed; // stores completed by the write buffer
+  uint64_t write_through;  // stores with values larger than cache_max_value
+  uint64_t flushes;        // write buffer flushes
+  uint64_t flushed_bytes;  // bytes written back by flushes and evictions
+  uint64_t evictions;      // pairs evicted to make room
+} kvs_cache_stats;
+
+typedef enum {
+  KVS_BATCH_STORE  = 0,   // store a key value pair, overwriting an existing value
+  KVS_BATCH_DELETE = 1,   // delete a key value pair, a missing key is not an error
+} kvs_batch_op_type;
+
+typedef struct {
+  kvs_batch_op_type type; // store or delete
+  kvs_key *key;           // key of the pair
+  kvs_value *value;       // value to store, ignored by a delete
+} kvs_batch_op;
+
+typedef struct {
+  uint8_t write_quorum;       // replicas that must complete a store or delete before it returns, 0 for all of them
+  bool hedge_reads;           // send a backup read to another replica when the first one is slow
+  double hedge_percentile;    // read latency percentile (e.g. 95) after which the backup read is sent
+  uint32_t hedge_min_us;      // lower bound of the backup read delay in microseconds
+} kvs_option_replica;
+
+typedef struct {
+  uint64_t stores;            // stores and deletes sent to the replicas
+  uint64_t retrieves;         // retrieves served
+  uint64_t write_errors;      // replica writes that failed
+  uint64_t quorum_failures;   // stores and deletes that did not reach the write quorum
+  uint64_t hedged;            // backup reads sent because the first read was slow
+  uint64_t hedge_wins;        // reads answered by a backup read
+  uint64_t failovers;         // reads sent to another replica because one failed
+  uint32_t hedge_delay_us;    // current backup read delay
+} kvs_replica_stats;
+
+typedef struct {
+  uint8_t data_fragments;     // fragments a value is split into
+  uint8_t parity_fragments;   // parity fragments added, the number of lost Key Spaces a value survives
+  uint32_t min_value_size;    // smaller values are stored as parity_fragments + 1 full copies
+} kvs_option_ec;
+
+typedef struct {
+  uint64_t stores;            // values stored
+  uint64_t copied;            // values stored as full copies because they are small
+  uint64_t retrieves;         // values retrieved
+  uint64_t degraded_reads;    // retrieves that rebuilt data fragments from parity fragments
+  uint64_t degraded_writes;   // stores that could not write every fragment
+  uint64_t fragment_errors;   // fragment reads and writes that failed on a Key Space
+  uint64_t encode_bytes;      // value bytes encoded
+  uint64_t encode_ns;         // time spent computing parity fragments
+  uint64_t decode_bytes;      // data fragment bytes rebuilt
+  uint64_t decode_ns;         // time spent rebuilding data fragments
+} kvs_ec_stats;
+
+typedef struct {
+  uint8_t key[32];            // AES key, the first key_len bytes are used
+  uint8_t key_len;            // 16 for AES-128, 32 for AES-256
+} kvs_option_encryption;
+
+typedef enum {
+  KVS_DISPATCH_INLINE   = 0,  // post process functions run on the thread that received the completion
+  KVS_DISPATCH_POOL     = 1,  // post process functions run on a pool of dispatch threads
+  KVS_DISPATCH_EXECUTOR = 2,  // post process functions are handed to an executor of the caller
+} kvs_dispatch_mode;
+
+typedef void(*kvs_dispatch_task)(void *task);   // runs a completion handed to an executor, exactly once
+typedef void(*kvs_dispatch_executor)(kvs_dispatch_task run, void *task, uint64_t submitter, void *private_data);
+
+typedef struct {
+  kvs_dispatch_mode mode;           // where post process functions run
+  uint32_t threads;                 // pool threads, 0 for one per CPU the caller may run on, each bound to its CPU
+  bool ordered;                     // pool: completions of requests sent by one thread run one at a time, in completion order
+  kvs_dispatch_executor executor;   // executor called with every completion (KVS_DISPATCH_EXECUTOR)
+  void *executor_private;           // passed to the executor as private_data
+} kvs_option_dispatch;
+
+typedef struct {
+  uint32_t top_k;         // keys kept per ranking, at most 256
+  uint32_t sample_rate;   // on average one of this many requests is counted, 0 or 1 counts all
+  uint32_t width;         // counters per sketch row, rounded up to a power of two, 0 for 4096
+  uint32_t depth;         // sketch rows, at most 8, 0 for 4
+  uint32_t decay_ms;      // counts are halved every decay_ms, 0 keeps them until tracking is turned off
+} kvs_option_hot_keys;
+
+typedef enum {
+  KVS_HOT_KEYS_READS  = 0,   // retrieves
+  KVS_HOT_KEYS_WRITES = 1,   // stores and deletes
+  KVS_HOT_KEYS_BYTES  = 2,   // value bytes stored and retrieved
+} kvs_hot_keys_order;
+
+typedef struct {
+  uint16_t key_len;                  // length of the key, only the first KVS_MAX_KEY_LENGTH bytes are in key
+  uint8_t key[KVS_MAX_KEY_LENGTH];
+  uint64_t reads;                    // estimated counts, scaled by the sample rate
+  uint64_t writes;
+  uint64_t bytes;
+} kvs_hot_key;
+
+typedef struct {
+  uint32_t streams;        // access streams tracked at once, at most 64, 0 for 16
+  uint32_t depth;          // speculative retrieves of a stream in flight or buffered, at most 64, 0 for 8
+  uint32_t value_size;     // buffer of a speculative retrieve, larger values are retrieved on demand, 0 for 4096
+  uint32_t max_stride;     // largest key distance taken for a stride, 0 for 64
+  uint32_t min_accuracy;   // percent of the speculative retrieves of a stream that have to be used, below it the stream reads ahead less, 0 for 50
+} kvs_option_read_ahead;
+
+typedef struct {
+  uint64_t retrieves;      // retrieves of keys that end in a number
+  uint64_t hits;           // served from a completed speculative retrieve
+  uint64_t late_hits;      // served from a speculative retrieve in flight, after waiting for it
+  uint64_t issued;         // speculative retrieves sent to the device
+  uint64_t wasted;         // speculative retrieves dropped without being used, including the ones below
+  uint64_t invalidated;    // dropped because their key was written after they were sent
+  uint64_t canceled;       // removed from the submission queue before reaching the device
+  uint64_t throttled;      // predicted keys not read ahead because their stream was not accurate enough
+  uint32_t streams;        // streams reading ahead now
+} kvs_read_ahead_stats;
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
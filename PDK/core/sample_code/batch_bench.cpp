@@ -0,0 +1,598 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Atomic write batch benchmark and checker.
+ *
+ * Every writer thread owns a number of record sets. A transaction moves one
+ * set to its next version: it rewrites the set's records with the new
+ * version and stores or deletes its marker key (present on even versions).
+ * Two ways of writing a transaction are compared:
+ *
+ *  single  one kvs_store_kvp() or kvs_delete_kvp() per key
+ *  batch   one kvs_write_batch() per transaction
+ *
+ * While the writers run, reader threads read the records of random sets in
+ * the order they are written. Versions may only grow along that order, a
+ * drop means a reader saw part of a transaction. With -I an iterator thread
+ * also scans the key space and checks that every set it returns is whole.
+ *
+ * With batch_failure_rate set in the emulator configuration file, some
+ * batches fail midway; the writer then checks that the set is still exactly
+ * at its previous version.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define BATCH_KEYSPACE_NAME "batch_bench"
+#define BATCH_KEY_PREFIX "btch"
+#define BATCH_KEY_LEN 16
+#define BATCH_MARKER 99
+
+enum batch_mode { MODE_SINGLE = 0, MODE_BATCH, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "single", "batch" };
+
+struct batch_config {
+  const char *dev_path;
+  int threads;
+  uint32_t txns;       // transactions per writer thread
+  uint32_t ops;        // keys per transaction, the last one is the marker
+  uint32_t sets;       // record sets per writer thread
+  uint32_t vlen;
+  int readers;
+  bool iterate;
+  std::vector<int> modes;
+};
+
+struct batch_writer {
+  int id;
+  const batch_config *cfg;
+  kvs_key_space_handle ks;
+  int mode;
+  std::vector<uint64_t> version;   // last committed version per set
+  uint64_t txns;
+  uint64_t failed;                 // batches rolled back by the device
+  uint64_t partial;                // failed batches that left a trace
+  uint64_t conflicts;              // batches refused by an open iterator
+  uint64_t errors;
+};
+
+struct batch_checker {
+  const batch_config *cfg;
+  kvs_key_space_handle ks;
+  std::atomic<bool> *stop;
+  unsigned int seed;
+  uint64_t checks;
+  uint64_t torn;
+  uint64_t errors;
+};
+
+static uint64_t _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-n txns] [-k ops] [-s sets] [-v vlen] "
+         "[-r readers] [-I] [-m modes]\n", program);
+  printf("-d      device_path  :  device path (default /dev/kvemul)\n");
+  printf("-t      threads      :  number of writer threads (default 2)\n");
+  printf("-n      txns         :  transactions per writer thread (default 2000)\n");
+  printf("-k      ops          :  keys per transaction, 2 to %d (default 8)\n", KVS_MAX_BATCH_OPS);
+  printf("-s      sets         :  record sets per writer thread (default 16)\n");
+  printf("-v      vlen         :  value length (default 512)\n");
+  printf("-r      readers      :  number of reader threads (default 1)\n");
+  printf("-I                   :  also check sets returned by an iterator\n");
+  printf("-m      modes        :  comma separated list of single,batch (default both)\n");
+  printf("==============\n");
+}
+
+// record keys of one set are adjacent: prefix, thread, set, record
+static void _make_key(char *key, int thread, uint32_t set, uint32_t rec) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%02d%06u%02u--", BATCH_KEY_PREFIX, thread % 100,
+           set % 1000000, rec % 100);
+  memcpy(key, buf, BATCH_KEY_LEN);
+}
+
+static bool _parse_key(const char *key, int *thread, uint32_t *set, uint32_t *rec) {
+  char buf[BATCH_KEY_LEN + 1];
+  memcpy(buf, key, BATCH_KEY_LEN);
+  buf[BATCH_KEY_LEN] = 0;
+  return sscanf(buf + 4, "%2d%6u%2u", thread, set, rec) == 3;
+}
+
+// keys and values of one transaction
+struct batch_txn {
+  std::vector<char *> keys;
+  std::vector<char *> values;
+  std::vector<kvs_key> kvskeys;
+  std::vector<kvs_value> kvsvalues;
+  std::vector<kvs_batch_op> ops;
+
+  batch_txn(uint32_t nops, uint32_t vlen)
+    : keys(nops), values(nops), kvskeys(nops), kvsvalues(nops), ops(nops) {
+    for (uint32_t i = 0; i < nops; i++) {
+      keys[i] = (char *)kvs_malloc(BATCH_KEY_LEN, 4096);
+      values[i] = (char *)kvs_malloc(vlen, 4096);
+      memset(values[i], 'v', vlen);
+      kvskeys[i] = { keys[i], BATCH_KEY_LEN };
+      kvsvalues[i] = { values[i], vlen, 0, 0 };
+      ops[i] = { KVS_BATCH_STORE, &kvskeys[i], &kvsvalues[i] };
+    }
+  }
+  ~batch_txn() {
+    for (size_t i = 0; i < keys.size(); i++) {
+      kvs_free(keys[i]);
+      kvs_free(values[i]);
+    }
+  }
+
+  void prepare(int thread, uint32_t set, uint64_t version) {
+    uint32_t last = ops.size() - 1;
+    for (uint32_t i = 0; i < ops.size(); i++) {
+      _make_key(keys[i], thread, set, i == last ? BATCH_MARKER : i);
+      memcpy(values[i], &version, sizeof(version));
+      ops[i].type = KVS_BATCH_STORE;
+    }
+    if (version % 2) ops[last].type = KVS_BATCH_DELETE;
+  }
+};
+
+static kvs_result _write_single(kvs_key_space_handle ks, batch_txn &txn) {
+  kvs_option_store st_opt = { KVS_STORE_POST, 0 };
+  kvs_option_delete del_opt = { false };
+  for (auto &op : txn.ops) {
+    kvs_result ret = (op.type == KVS_BATCH_STORE)
+      ? kvs_store_kvp(ks, op.key, op.value, &st_opt)
+      : kvs_delete_kvp(ks, op.key, &del_opt);
+    if (ret != KVS_SUCCESS) return ret;
+  }
+  return KVS_SUCCESS;
+}
+
+// true if every key of a set is exactly at the given version
+static bool _verify_set(kvs_key_space_handle ks, const batch_config *cfg, int thread,
+                        uint32_t set, uint64_t version, char *key, char *value) {
+  kvs_option_retrieve rt_opt = { false };
+  for (uint32_t i = 0; i < cfg->ops; i++) {
+    bool marker = (i == cfg->ops - 1);
+    _make_key(key, thread, set, marker ? BATCH_MARKER : i);
+    kvs_key kvskey = { key, BATCH_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    kvs_result ret = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &kvsvalue);
+    if (marker && version % 2) {
+      if (ret != KVS_ERR_KEY_NOT_EXIST) return false;
+      continue;
+    }
+    uint64_t v;
+    memcpy(&v, value, sizeof(v));
+    if (ret != KVS_SUCCESS || v != version) return false;
+  }
+  return true;
+}
+
+static void _run_writer(batch_writer *w) {
+  const batch_config *cfg = w->cfg;
+  batch_txn txn(cfg->ops, cfg->vlen);
+  char *key = (char *)kvs_malloc(BATCH_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+
+  for (uint32_t n = 0; n < cfg->txns; n++) {
+    uint32_t set = n % cfg->sets;
+    uint64_t version = w->version[set] + 1;
+    txn.prepare(w->id, set, version);
+
+    kvs_result ret;
+    if (w->mode == MODE_SINGLE) {
+      ret = _write_single(w->ks, txn);
+    } else {
+      while ((ret = kvs_write_batch(w->ks, txn.ops.data(), cfg->ops)) == KVS_ERR_ITERATOR_OPEN) {
+        w->conflicts++;
+        usleep(100);
+      }
+    }
+
+    if (ret == KVS_SUCCESS) {
+      w->version[set] = version;
+      w->txns++;
+    } else if (ret == KVS_ERR_SYS_IO && w->mode == MODE_BATCH) {
+      // an injected failure, nothing of the batch may be left
+      w->failed++;
+      if (!_verify_set(w->ks, cfg, w->id, set, w->version[set], key, value)) w->partial++;
+    } else {
+      fprintf(stderr, "transaction failed with err 0x%x\n", ret);
+      w->errors++;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+// reads the records of random sets in write order, versions must not drop
+static void _run_reader(batch_checker *c, std::vector<batch_writer *> *writers) {
+  const batch_config *cfg = c->cfg;
+  char *key = (char *)kvs_malloc(BATCH_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  kvs_option_retrieve rt_opt = { false };
+
+  while (!*c->stop) {
+    int thread = rand_r(&c->seed) % cfg->threads;
+    uint32_t set = rand_r(&c->seed) % cfg->sets;
+    uint64_t prev = 0;
+    bool torn = false;
+    for (uint32_t i = 0; i < cfg->ops - 1; i++) {
+      _make_key(key, (*writers)[thread]->id, set, i);
+      kvs_key kvskey = { key, BATCH_KEY_LEN };
+      kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+      kvs_result ret = kvs_retrieve_kvp(c->ks, &kvskey, &rt_opt, &kvsvalue);
+      if (ret != KVS_SUCCESS) {
+        c->errors++;
+        break;
+      }
+      uint64_t v;
+      memcpy(&v, value, sizeof(v));
+      if (v < prev) torn = true;
+      prev = v;
+    }
+    c->checks++;
+    if (torn) c->torn++;
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+struct set_view {
+  uint64_t version;
+  uint32_t records;
+  bool marker;
+  bool mixed;
+};
+
+// scans the key space with an iterator, every set must be at one version
+// with its marker matching that version
+static void _run_iterator(batch_checker *c) {
+  const batch_config *cfg = c->cfg;
+  kvs_iterator_list iter_list;
+  iter_list.it_list = (uint8_t *)kvs_malloc(KVS_ITERATOR_BUFFER_SIZE, 4096);
+  kvs_option_iterator iter_op = { KVS_ITERATOR_KEY_VALUE };
+  kvs_key_group_filter iter_fltr;
+  for (int i = 0; i < 4; i++) {
+    iter_fltr.bitmask[i] = 0xff;
+    iter_fltr.bit_pattern[i] = BATCH_KEY_PREFIX[i];
+  }
+
+  while (!*c->stop) {
+    kvs_iterator_handle iter_hd;
+    kvs_result ret = kvs_create_iterator(c->ks, &iter_op, &iter_fltr, &iter_hd);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "open iterator failed with err 0x%x\n", ret);
+      c->errors++;
+      break;
+    }
+
+    std::map<std::pair<int, uint32_t>, set_view> sets;
+    do {
+      iter_list.size = KVS_ITERATOR_BUFFER_SIZE;
+      iter_list.num_entries = 0;
+      iter_list.end = false;
+      ret = kvs_iterate_next(c->ks, iter_hd, &iter_list);
+      if (ret != KVS_SUCCESS) {
+        fprintf(stderr, "iterator next failed with err 0x%x\n", ret);
+        c->errors++;
+        break;
+      }
+
+      // key value iterator output: [u32 key_len][key][u32 value_len][value]
+      uint8_t *it_buffer = iter_list.it_list;
+      for (uint32_t i = 0; i < iter_list.num_entries; i++) {
+        uint32_t key_size = *((uint32_t *)it_buffer);
+        it_buffer += sizeof(uint32_t);
+        const char *k = (const char *)it_buffer;
+        it_buffer += key_size;
+        uint32_t value_size = *((uint32_t *)it_buffer);
+        it_buffer += sizeof(uint32_t);
+        uint64_t v;
+        memcpy(&v, it_buffer, sizeof(v));
+        it_buffer += value_size;
+
+        int thread;
+        uint32_t set, rec;
+        if (key_size != BATCH_KEY_LEN || !_parse_key(k, &thread, &set, &rec)) continue;
+        auto ins = sets.insert(std::make_pair(std::make_pair(thread, set),
+                                              set_view{ v, 0, false, false }));
+        set_view &s = ins.first->second;
+        if (s.version != v) s.mixed = true;
+        if (rec == BATCH_MARKER) s.marker = true;
+        else s.records++;
+      }
+    } while (!iter_list.end && !*c->stop);
+    kvs_delete_iterator(c->ks, iter_hd);
+
+    if (!iter_list.end) break;
+    for (auto &s : sets) {
+      const set_view &sv = s.second;
+      c->checks++;
+      if (sv.mixed || sv.records != cfg->ops - 1 || sv.marker != (sv.version % 2 == 0))
+        c->torn++;
+    }
+    // give the writers time between scans
+    usleep(20000);
+  }
+  kvs_free(iter_list.it_list);
+}
+
+static int _open_key_space(kvs_device_handle dev, kvs_key_space_handle *ks) {
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)BATCH_KEYSPACE_NAME;
+  ks_name.name_len = strlen(BATCH_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_result ret = kvs_open_key_space(dev, (char *)BATCH_KEYSPACE_NAME, ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+static void _drop_key_space(kvs_device_handle dev, kvs_key_space_handle ks) {
+  kvs_key_space_name ks_name;
+  ks_name.name = (char *)BATCH_KEYSPACE_NAME;
+  ks_name.name_len = strlen(BATCH_KEYSPACE_NAME);
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+}
+
+// writes version 0 of every set, retrying batches the device fails on purpose
+static int _load_sets(kvs_key_space_handle ks, const batch_config &cfg, int mode) {
+  batch_txn txn(cfg.ops, cfg.vlen);
+  for (int t = 0; t < cfg.threads; t++) {
+    for (uint32_t set = 0; set < cfg.sets; set++) {
+      txn.prepare(t, set, 0);
+      kvs_result ret;
+      if (mode == MODE_SINGLE) {
+        ret = _write_single(ks, txn);
+      } else {
+        while ((ret = kvs_write_batch(ks, txn.ops.data(), cfg.ops)) == KVS_ERR_SYS_IO);
+      }
+      if (ret != KVS_SUCCESS) {
+        fprintf(stderr, "loading set %u failed with err 0x%x\n", set, ret);
+        return FAILED;
+      }
+    }
+  }
+  return SUCCESS;
+}
+
+static int _run_mode(kvs_device_handle dev, const batch_config &cfg, int mode) {
+  kvs_key_space_handle ks;
+  if (_open_key_space(dev, &ks) != SUCCESS) return FAILED;
+  if (_load_sets(ks, cfg, mode) != SUCCESS) {
+    _drop_key_space(dev, ks);
+    return FAILED;
+  }
+
+  std::vector<batch_writer *> writers;
+  for (int i = 0; i < cfg.threads; i++) {
+    batch_writer *w = new batch_writer();
+    w->id = i;
+    w->cfg = &cfg;
+    w->ks = ks;
+    w->mode = mode;
+    w->version.assign(cfg.sets, 0);
+    writers.push_back(w);
+  }
+  std::atomic<bool> stop(false);
+  std::vector<batch_checker *> checkers;
+  for (int i = 0; i < cfg.readers + (cfg.iterate ? 1 : 0); i++) {
+    batch_checker *c = new batch_checker();
+    c->cfg = &cfg;
+    c->ks = ks;
+    c->stop = &stop;
+    c->seed = i + 1;
+    checkers.push_back(c);
+  }
+
+  uint64_t start = _now_us();
+  std::vector<std::thread> threads;
+  for (auto w : writers) threads.push_back(std::thread(_run_writer, w));
+  std::vector<std::thread> checker_threads;
+  for (int i = 0; i < cfg.readers; i++)
+    checker_threads.push_back(std::thread(_run_reader, checkers[i], &writers));
+  if (cfg.iterate)
+    checker_threads.push_back(std::thread(_run_iterator, checkers[cfg.readers]));
+  for (auto &t : threads) t.join();
+  double secs = (_now_us() - start) / 1e6;
+  stop = true;
+  for (auto &t : checker_threads) t.join();
+
+  uint64_t txns = 0, failed = 0, partial = 0, conflicts = 0, errors = 0;
+  for (auto w : writers) {
+    txns += w->txns;
+    failed += w->failed;
+    partial += w->partial;
+    conflicts += w->conflicts;
+    errors += w->errors;
+  }
+  uint64_t reads = 0, torn_reads = 0, scans = 0, torn_scans = 0;
+  for (int i = 0; i < (int)checkers.size(); i++) {
+    if (i < cfg.readers) {
+      reads += checkers[i]->checks;
+      torn_reads += checkers[i]->torn;
+    } else {
+      scans += checkers[i]->checks;
+      torn_scans += checkers[i]->torn;
+    }
+    errors += checkers[i]->errors;
+  }
+
+  // every set has to end up exactly at its last committed version
+  char *key = (char *)kvs_malloc(BATCH_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg.vlen, 4096);
+  uint64_t bad_sets = 0;
+  for (auto w : writers) {
+    for (uint32_t set = 0; set < cfg.sets; set++) {
+      if (!_verify_set(ks, &cfg, w->id, set, w->version[set], key, value)) bad_sets++;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+
+  printf("%-6s %9.0f %9.0f %8lu %8lu %9lu %10lu/%-8lu %10lu/%-8lu %6lu %6lu\n",
+         mode_names[mode], txns / secs, txns * cfg.ops / secs, failed, partial, conflicts,
+         torn_reads, reads, torn_scans, scans, bad_sets, errors);
+
+  for (auto w : writers) delete w;
+  for (auto c : checkers) delete c;
+  _drop_key_space(dev, ks);
+  // separate stores are expected to be seen half done, a batch never
+  if (errors || bad_sets) return FAILED;
+  if (mode == MODE_BATCH && (partial || torn_reads || torn_scans)) return FAILED;
+  return SUCCESS;
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+    int m;
+    for (m = 0; m < MODE_MAX; m++) {
+      if (strcmp(tok, mode_names[m]) == 0) break;
+    }
+    if (m == MODE_MAX) {
+      free(copy);
+      return false;
+    }
+    out->push_back(m);
+  }
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  batch_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 2;
+  cfg.txns = 2000;
+  cfg.ops = 8;
+  cfg.sets = 16;
+  cfg.vlen = 512;
+  cfg.readers = 1;
+  cfg.iterate = false;
+  cfg.modes = { MODE_SINGLE, MODE_BATCH };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:n:k:s:v:r:Im:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.txns = atoi(optarg);
+      break;
+    case 'k':
+      cfg.ops = atoi(optarg);
+      break;
+    case 's':
+      cfg.sets = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'r':
+      cfg.readers = atoi(optarg);
+      break;
+    case 'I':
+      cfg.iterate = true;
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  // record numbers are two digits and 99 is the marker
+  if (cfg.threads <= 0 || cfg.threads > 99 || cfg.txns == 0 || cfg.ops < 2 ||
+      cfg.ops > 99 || cfg.sets == 0 || cfg.sets > 999999 || cfg.readers < 0 ||
+      cfg.vlen < 64 || cfg.vlen % 4) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  printf("%d writers x %u transactions of %u keys over %u sets, %u byte values, "
+         "%d readers%s\n", cfg.threads, cfg.txns, cfg.ops, cfg.sets, cfg.vlen,
+         cfg.readers, cfg.iterate ? ", iterator" : "");
+  printf("%-6s %9s %9s %8s %8s %9s %19s %19s %6s %6s\n", "mode", "txn/s", "keys/s",
+         "failed", "partial", "conflicts", "torn reads", "torn scans", "bad", "errors");
+  int result = SUCCESS;
+  for (int mode : cfg.modes)
+    result |= _run_mode(dev, cfg, mode);
+
+  kvs_close_device(dev);
+  return result;
+}
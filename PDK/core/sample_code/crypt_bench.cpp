@@ -0,0 +1,511 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Value encryption benchmark.
+ *
+ * Measures AES-GCM with AES-NI and with the portable code on their own and
+ * then the cost of kvs_set_encryption on a Key Space: for every value size,
+ * threads store and read back values in plaintext and encrypted, and read 4KB
+ * ranges at random offsets. Every read is checked against what was stored.
+ * Last, reads with the wrong key, of a modified value and of a value copied
+ * to another key have to report KVS_ERR_CHECKSUM_MISMATCH.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+#include "kvs_aes.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define CRYPT_KEYSPACE_NAME "crypt_bench"
+#define CRYPT_KEY_LEN 16
+#define CRYPT_RANGE_LEN 4096
+#define CRYPT_CHUNK 4096
+#define CRYPT_PAYLOAD (CRYPT_CHUNK - 24)
+
+// largest value that still fits on the device with its nonces and tags
+#define CRYPT_MAX_VALUE_LEN (KVS_MAX_VALUE_LENGTH / CRYPT_CHUNK * CRYPT_PAYLOAD)
+
+enum crypt_mode { MODE_PLAIN = 0, MODE_GCM, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "plain", "aes-gcm" };
+
+struct crypt_config {
+  const char *dev_path;
+  int threads;
+  uint32_t ops;          // per thread, size and phase
+  uint32_t keys;         // per thread
+  uint32_t aes_ms;
+  int aes_key_len;
+  std::vector<int> vlens;
+};
+
+struct crypt_worker {
+  int id;
+  const crypt_config *cfg;
+  kvs_key_space_handle ks;
+  uint32_t vlen;
+  std::vector<uint32_t> lat;
+  uint64_t errors;
+};
+
+struct crypt_result {
+  double store_mbps;
+  uint32_t store_p50;
+  double read_mbps;
+  uint32_t read_p50;
+  double range_ops;
+  uint32_t range_p50;
+};
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-n ops] [-k keys] [-v vlens] "
+         "[-a aes_ms] [-b key_bits]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-t      threads      :  number of threads (default 2)\n");
+  printf("-n      ops          :  stores, reads and range reads per thread and size "
+         "(default 200)\n");
+  printf("-k      keys         :  keys per thread (default 8)\n");
+  printf("-v      vlens        :  comma separated value sizes, sizes above %u are cut to it\n"
+         "                       (default 4096,16384,65536,262144,1048576,%u)\n",
+         CRYPT_MAX_VALUE_LEN, CRYPT_MAX_VALUE_LEN);
+  printf("-a      aes_ms       :  run time of each AES-GCM measurement in ms (default 200)\n");
+  printf("-b      key_bits     :  AES key size, 128 or 256 (default 256)\n");
+  printf("==============\n");
+}
+
+static int _parse_int_list(const char *arg, std::vector<int> &out) {
+  out.clear();
+  std::string s(arg);
+  size_t pos = 0;
+  while (pos <= s.size()) {
+    size_t next = s.find(',', pos);
+    if (next == std::string::npos) next = s.size();
+    std::string item = s.substr(pos, next - pos);
+    char *end = NULL;
+    long v = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || v <= 0) {
+      fprintf(stderr, "invalid list entry '%s'\n", item.c_str());
+      return FAILED;
+    }
+    out.push_back((int)v);
+    pos = next + 1;
+  }
+  return SUCCESS;
+}
+
+static void _make_key(char *key, int thread, uint32_t idx) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "aes%02d%011u", thread, idx);
+  memcpy(key, buf, CRYPT_KEY_LEN);
+}
+
+// the value of a key is a function of the key and the version stored
+static void _fill_value(char *value, uint32_t vlen, uint32_t seed) {
+  uint32_t x = seed * 2654435761u + 1;
+  for (uint32_t i = 0; i + 4 <= vlen; i += 4) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    memcpy(value + i, &x, 4);
+  }
+}
+
+static void _make_aes_key(kvs_option_encryption *opt, int key_len, uint8_t seed) {
+  memset(opt, 0, sizeof(*opt));
+  opt->key_len = key_len;
+  for (int i = 0; i < key_len; i++) opt->key[i] = (uint8_t)(seed + i * 37);
+}
+
+static double _mbps(uint64_t bytes, uint64_t ns) {
+  return ns ? (double)bytes / (1 << 20) / (ns / 1e9) : 0.0;
+}
+
+// encrypts and decrypts chunk sized buffers for aes_ms each, returns MB/s
+static void _time_gcm(const kvs_aes_gcm &gcm, uint32_t ms, double *enc, double *dec,
+                      bool *ok) {
+  std::vector<uint8_t> in(CRYPT_PAYLOAD), out(CRYPT_PAYLOAD), back(CRYPT_PAYLOAD);
+  _fill_value((char *)in.data(), CRYPT_PAYLOAD, 11);
+  uint8_t iv[12] = { 0 }, aad[24] = { 0 }, tag[16];
+  uint64_t limit = (uint64_t)ms * 1000000, n = 0, start = _now_ns(), ns;
+  do {
+    memcpy(iv, &n, sizeof(n));
+    gcm.encrypt(iv, aad, sizeof(aad), in.data(), CRYPT_PAYLOAD, out.data(), tag);
+    n++;
+  } while ((ns = _now_ns() - start) < limit);
+  *enc = _mbps(n * CRYPT_PAYLOAD, ns);
+  n = 0;
+  start = _now_ns();
+  do {
+    *ok = gcm.decrypt(iv, aad, sizeof(aad), out.data(), CRYPT_PAYLOAD, tag, 0,
+                      CRYPT_PAYLOAD, back.data());
+    n++;
+  } while ((ns = _now_ns() - start) < limit);
+  *dec = _mbps(n * CRYPT_PAYLOAD, ns);
+  *ok = *ok && memcmp(in.data(), back.data(), CRYPT_PAYLOAD) == 0;
+}
+
+static void _run_gcm(const crypt_config &cfg) {
+  kvs_option_encryption key;
+  _make_aes_key(&key, cfg.aes_key_len, 1);
+  printf("AES-%d-GCM over %d byte chunks\n", cfg.aes_key_len * 8, CRYPT_PAYLOAD);
+  printf("%-10s %14s %14s\n", "impl", "encrypt MB/s", "decrypt MB/s");
+  for (int hw = 0; hw < 2; hw++) {
+    kvs_aes_gcm gcm(key.key, key.key_len, hw == 1);
+    double enc, dec;
+    bool ok;
+    _time_gcm(gcm, cfg.aes_ms, &enc, &dec, &ok);
+    printf("%-10s %14.1f %14.1f%s\n", gcm.impl(), enc, dec, ok ? "" : "  MISMATCH");
+  }
+}
+
+static void _run_store(crypt_worker *w) {
+  char *key = (char *)kvs_malloc(CRYPT_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(w->vlen, 4096);
+  kvs_option_store st_opt = { KVS_STORE_POST, 0 };
+  for (uint32_t n = 0; n < w->cfg->ops; n++) {
+    uint32_t idx = n % w->cfg->keys;
+    _make_key(key, w->id, idx);
+    _fill_value(value, w->vlen, w->id * 1000003 + idx);
+    kvs_key kvskey = { key, CRYPT_KEY_LEN };
+    kvs_value kvsvalue = { value, w->vlen, 0, 0 };
+    uint64_t start = _now_ns();
+    kvs_result ret = kvs_store_kvp(w->ks, &kvskey, &kvsvalue, &st_opt);
+    w->lat.push_back((_now_ns() - start) / 1000);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      w->errors++;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+// reads whole values or, with range set, CRYPT_RANGE_LEN bytes at a random
+// aligned offset
+static void _run_read(crypt_worker *w, bool range) {
+  char *key = (char *)kvs_malloc(CRYPT_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(w->vlen, 4096);
+  char *expect = (char *)malloc(w->vlen);
+  kvs_option_retrieve rt_opt = { false };
+  unsigned int seed = w->id + 1;
+  for (uint32_t n = 0; n < w->cfg->ops; n++) {
+    uint32_t idx = rand_r(&seed) % w->cfg->keys;
+    uint32_t offset = 0, len = w->vlen;
+    if (range) {
+      uint32_t slots = (w->vlen - CRYPT_RANGE_LEN) / KVS_ALIGNMENT_UNIT + 1;
+      offset = rand_r(&seed) % slots * KVS_ALIGNMENT_UNIT;
+      len = CRYPT_RANGE_LEN;
+    }
+    _make_key(key, w->id, idx);
+    kvs_key kvskey = { key, CRYPT_KEY_LEN };
+    kvs_value kvsvalue = { value, len, 0, offset };
+    uint64_t start = _now_ns();
+    kvs_result ret = kvs_retrieve_kvp(w->ks, &kvskey, &rt_opt, &kvsvalue);
+    w->lat.push_back((_now_ns() - start) / 1000);
+    _fill_value(expect, w->vlen, w->id * 1000003 + idx);
+    // a range that ends before the value does reports a small buffer
+    if (ret == KVS_ERR_BUFFER_SMALL && offset + len < w->vlen) ret = KVS_SUCCESS;
+    if (ret != KVS_SUCCESS || kvsvalue.length != len ||
+        kvsvalue.actual_value_size != w->vlen - offset ||
+        memcmp(value, expect + offset, len) != 0) {
+      fprintf(stderr, "read of key %u at %u failed with err 0x%x\n", idx, offset, ret);
+      w->errors++;
+    }
+  }
+  free(expect);
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static void _run_full_read(crypt_worker *w) { _run_read(w, false); }
+static void _run_range_read(crypt_worker *w) { _run_read(w, true); }
+
+// runs fn on every worker, returns the wall time and the median latency
+static double _run_phase(std::vector<crypt_worker> &workers, void (*fn)(crypt_worker *),
+                         uint32_t *p50, uint64_t *errors) {
+  std::vector<std::thread> threads;
+  for (auto &w : workers) w.lat.clear();
+  uint64_t start = _now_ns();
+  for (auto &w : workers) threads.push_back(std::thread(fn, &w));
+  for (auto &t : threads) t.join();
+  double secs = (_now_ns() - start) / 1e9;
+  std::vector<uint32_t> lat;
+  for (auto &w : workers) {
+    lat.insert(lat.end(), w.lat.begin(), w.lat.end());
+    *errors += w.errors;
+    w.errors = 0;
+  }
+  std::sort(lat.begin(), lat.end());
+  *p50 = lat.empty() ? 0 : lat[lat.size() / 2];
+  return secs;
+}
+
+static void _run_size(kvs_key_space_handle ks, const crypt_config &cfg, uint32_t vlen,
+                      crypt_result *res, uint64_t *errors) {
+  std::vector<crypt_worker> workers(cfg.threads);
+  for (int i = 0; i < cfg.threads; i++) {
+    workers[i].id = i;
+    workers[i].cfg = &cfg;
+    workers[i].ks = ks;
+    workers[i].vlen = vlen;
+    workers[i].errors = 0;
+  }
+  uint64_t bytes = (uint64_t)cfg.threads * cfg.ops * vlen;
+  double secs = _run_phase(workers, _run_store, &res->store_p50, errors);
+  res->store_mbps = _mbps(bytes, secs * 1e9);
+  secs = _run_phase(workers, _run_full_read, &res->read_p50, errors);
+  res->read_mbps = _mbps(bytes, secs * 1e9);
+  res->range_ops = 0;
+  res->range_p50 = 0;
+  if (vlen >= CRYPT_RANGE_LEN) {
+    secs = _run_phase(workers, _run_range_read, &res->range_p50, errors);
+    res->range_ops = cfg.threads * cfg.ops / secs;
+  }
+
+  char key[CRYPT_KEY_LEN];
+  kvs_option_delete del_opt = { false };
+  for (int t = 0; t < cfg.threads; t++) {
+    for (uint32_t i = 0; i < std::min(cfg.ops, cfg.keys); i++) {
+      _make_key(key, t, i);
+      kvs_key kvskey = { key, CRYPT_KEY_LEN };
+      kvs_delete_kvp(ks, &kvskey, &del_opt);
+    }
+  }
+}
+
+static double _overhead(double plain, double gcm) {
+  return plain > 0 ? 100.0 * (plain - gcm) / plain : 0.0;
+}
+
+// stores an encrypted value and reads it back with the wrong key, after
+// changing one ciphertext bit and after copying it to another key; all of
+// them have to fail. The stored bytes must not contain the plaintext.
+static int _check_tampering(kvs_key_space_handle ks, int key_len) {
+  const uint32_t vlen = 3 * 4096;
+  char *key = (char *)kvs_malloc(CRYPT_KEY_LEN, 4096);
+  char *key2 = (char *)kvs_malloc(CRYPT_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(2 * vlen, 4096);
+  char *plain = (char *)malloc(vlen);
+  _make_key(key, 99, 0);
+  _make_key(key2, 99, 1);
+  _fill_value(plain, vlen, 7);
+  memcpy(value, plain, vlen);
+  kvs_key kvskey = { key, CRYPT_KEY_LEN };
+  kvs_key kvskey2 = { key2, CRYPT_KEY_LEN };
+  kvs_value kvsvalue = { value, vlen, 0, 0 };
+  kvs_option_store st_opt = { KVS_STORE_POST, 0 };
+  kvs_option_retrieve rt_opt = { false };
+  kvs_option_encryption right, wrong;
+  _make_aes_key(&right, key_len, 1);
+  _make_aes_key(&wrong, key_len, 2);
+  int result = FAILED;
+
+  kvs_set_encryption(ks, &right);
+  kvs_result ret = kvs_store_kvp(ks, &kvskey, &kvsvalue, &st_opt);
+  kvs_set_encryption(ks, NULL);
+  kvsvalue.length = 2 * vlen;
+  if (ret == KVS_SUCCESS) ret = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &kvsvalue);
+  bool leaked = ret == KVS_SUCCESS &&
+    std::search(value, value + kvsvalue.length, plain, plain + 64) != value + kvsvalue.length;
+  if (ret == KVS_SUCCESS) ret = kvs_store_kvp(ks, &kvskey2, &kvsvalue, &st_opt);
+  if (ret == KVS_SUCCESS) {
+    value[5000] ^= 0x10;   // second chunk
+    ret = kvs_store_kvp(ks, &kvskey, &kvsvalue, &st_opt);
+  }
+  if (ret == KVS_SUCCESS) {
+    kvs_value first = { value, 2048, 0, 0 };      // first chunk only
+    kvs_value range = { value, 1024, 0, 4096 };   // second chunk
+    kvs_value moved = { value, vlen, 0, 0 };
+    kvs_value other = { value, vlen, 0, 0 };
+    kvs_set_encryption(ks, &right);
+    kvs_result r1 = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &first);
+    bool first_ok = memcmp(value, plain, 2048) == 0;
+    kvs_result r2 = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &range);
+    kvs_result r3 = kvs_retrieve_kvp(ks, &kvskey2, &rt_opt, &moved);
+    kvs_set_encryption(ks, &wrong);
+    kvs_result r4 = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &other);
+    kvs_set_encryption(ks, NULL);
+    printf("plaintext on device: %s, untouched chunk 0x%x, modified chunk 0x%x, "
+           "copied value 0x%x, wrong key 0x%x\n", leaked ? "yes" : "no", r1, r2, r3, r4);
+    if (!leaked && r1 == KVS_ERR_BUFFER_SMALL && first_ok &&
+        r2 == KVS_ERR_CHECKSUM_MISMATCH && r3 == KVS_ERR_CHECKSUM_MISMATCH &&
+        r4 == KVS_ERR_CHECKSUM_MISMATCH)
+      result = SUCCESS;
+  } else {
+    fprintf(stderr, "tampering setup failed with err 0x%x\n", ret);
+  }
+  kvs_option_delete del_opt = { false };
+  kvs_delete_kvp(ks, &kvskey, &del_opt);
+  kvs_delete_kvp(ks, &kvskey2, &del_opt);
+  free(plain);
+  kvs_free(key);
+  kvs_free(key2);
+  kvs_free(value);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  crypt_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 2;
+  cfg.ops = 200;
+  cfg.keys = 8;
+  cfg.aes_ms = 200;
+  cfg.aes_key_len = 32;
+  cfg.vlens = { 4096, 16384, 65536, 262144, 1048576, CRYPT_MAX_VALUE_LEN };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:n:k:v:a:b:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.ops = atoi(optarg);
+      break;
+    case 'k':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'v':
+      if (_parse_int_list(optarg, cfg.vlens) != SUCCESS) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'a':
+      cfg.aes_ms = atoi(optarg);
+      break;
+    case 'b':
+      cfg.aes_key_len = atoi(optarg) / 8;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.threads <= 0 || cfg.threads > 98 || cfg.ops == 0 || cfg.keys == 0 ||
+      cfg.aes_ms == 0 || (cfg.aes_key_len != 16 && cfg.aes_key_len != 32)) {
+    usage(argv[0]);
+    return FAILED;
+  }
+  for (auto &v : cfg.vlens) {
+    v = std::min(v, (int)CRYPT_MAX_VALUE_LEN) & ~(KVS_VALUE_LENGTH_ALIGNMENT_UNIT - 1);
+    if (v == 0) {
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+
+  _run_gcm(cfg);
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)CRYPT_KEYSPACE_NAME;
+  ks_name.name_len = strlen(CRYPT_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_key_space_handle ks;
+  ret = kvs_open_key_space(dev, (char *)CRYPT_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  kvs_option_encryption aes_key;
+  _make_aes_key(&aes_key, cfg.aes_key_len, 1);
+  printf("\n%d threads, %u ops per thread, %u keys per thread, %d byte ranges\n",
+         cfg.threads, cfg.ops, cfg.keys, CRYPT_RANGE_LEN);
+  printf("%-8s %-7s %10s %7s %10s %7s %10s %7s %9s %9s %9s\n", "size", "mode",
+         "store MB/s", "p50 us", "read MB/s", "p50 us", "ranges/s", "p50 us",
+         "store ovh", "read ovh", "range ovh");
+  uint64_t errors = 0;
+  for (int vlen : cfg.vlens) {
+    crypt_result res[MODE_MAX];
+    for (int mode = 0; mode < MODE_MAX; mode++) {
+      kvs_set_encryption(ks, mode == MODE_GCM ? &aes_key : NULL);
+      _run_size(ks, cfg, vlen, &res[mode], &errors);
+      printf("%-8d %-7s %10.1f %7u %10.1f %7u %10.0f %7u", vlen, mode_names[mode],
+             res[mode].store_mbps, res[mode].store_p50, res[mode].read_mbps,
+             res[mode].read_p50, res[mode].range_ops, res[mode].range_p50);
+      if (mode == MODE_GCM) {
+        printf(" %8.1f%% %8.1f%% %8.1f%%",
+               _overhead(res[MODE_PLAIN].store_mbps, res[MODE_GCM].store_mbps),
+               _overhead(res[MODE_PLAIN].read_mbps, res[MODE_GCM].read_mbps),
+               _overhead(res[MODE_PLAIN].range_ops, res[MODE_GCM].range_ops));
+      }
+      printf("\n");
+    }
+  }
+  kvs_set_encryption(ks, NULL);
+
+  int result = errors ? FAILED : SUCCESS;
+  if (_check_tampering(ks, cfg.aes_key_len) != SUCCESS) {
+    fprintf(stderr, "tampering was not detected\n");
+    result = FAILED;
+  }
+  if (errors) fprintf(stderr, "%lu errors\n", errors);
+
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+  return result;
+}
@@ -0,0 +1,405 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Request deadline benchmark.
+ *
+ * Sends asynchronous retrieves to a Key Space at a fixed rate (open loop)
+ * and counts a read as good when it returns the right value within the
+ * deadline of the caller, measured from the time the schedule sent it.
+ * Three ways to treat an overloaded device are compared:
+ *
+ *  none      every read goes to the device, however long it waited
+ *  deadline  reads carry deadline_us and are dropped before dispatch once
+ *            it has passed, reads already late when they are due are not
+ *            sent at all
+ *  cancel    reads have no deadline, a second thread cancels the ones
+ *            that are still queued close to the deadline with kvs_cancel_io
+ *
+ * A read that is dispatched right at its deadline still misses it, so the
+ * deadline given to the device (or used to cancel) is the caller's minus a
+ * slack for the time a read takes once dispatched.
+ *
+ * The emulator has to be slower than the offered rate for the modes to
+ * differ, e.g. slow_io_rate = 1 and slow_io_us = 100 in kvssd_emul.conf
+ * (the file can also be given with KVSSD_EMU_CONFIGFILE).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define DEADLINE_KEYSPACE_NAME "deadline_bench"
+#define DEADLINE_KEY_LEN 16
+#define DEADLINE_SLOTS 1024
+
+enum deadline_mode { MODE_NONE = 0, MODE_DEADLINE, MODE_CANCEL, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "none", "deadline", "cancel" };
+
+struct deadline_config {
+  const char *dev_path;
+  uint32_t keys;
+  uint32_t vlen;
+  uint32_t rate;         // reads per second
+  uint32_t seconds;
+  uint32_t deadline_us;
+  uint32_t slack_us;     // taken off the deadline given to the device
+  std::vector<int> modes;
+};
+
+// one read in flight, slots are reused round robin
+struct deadline_req {
+  std::atomic<bool> busy;
+  std::atomic<uint64_t> sent_us;   // when the schedule sent it
+  uint32_t idx;
+  char *key;
+  char *value;
+  kvs_key kvskey;
+  kvs_value kvsvalue;
+};
+
+struct deadline_run {
+  const deadline_config *cfg;
+  std::atomic<uint64_t> completed;
+  std::atomic<uint64_t> good;
+  std::atomic<uint64_t> late;
+  std::atomic<uint64_t> dropped;
+  std::atomic<uint64_t> canceled;
+  std::atomic<uint64_t> errors;
+  std::mutex lock;
+  std::vector<uint32_t> lat;       // of the reads that returned a value
+};
+
+static uint64_t _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-n keys] [-v vlen] [-r rate] [-s seconds] "
+         "[-D deadline_us] [-S slack_us] [-m modes]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-n      keys         :  number of keys (default 2000)\n");
+  printf("-v      vlen         :  value length (default 4096)\n");
+  printf("-r      rate         :  reads per second sent (default 20000)\n");
+  printf("-s      seconds      :  length of the schedule (default 3)\n");
+  printf("-D      deadline_us  :  deadline of a read in microseconds (default 5000)\n");
+  printf("-S      slack_us     :  time a read needs once dispatched (default 500)\n");
+  printf("-m      modes        :  comma separated list of none,deadline,cancel (default all)\n");
+  printf("==============\n");
+}
+
+static void _make_key(char *key, uint32_t idx) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "ddl%013u", idx);
+  memcpy(key, buf, DEADLINE_KEY_LEN);
+}
+
+static void _on_read(kvs_postprocess_context *ctx) {
+  deadline_req *req = (deadline_req *)ctx->private1;
+  deadline_run *run = (deadline_run *)ctx->private2;
+  uint64_t lat = _now_us() - req->sent_us.load();
+
+  switch (ctx->result) {
+  case KVS_SUCCESS: {
+    uint32_t got;
+    memcpy(&got, req->value, sizeof(got));
+    if (got != req->idx) {
+      run->errors++;
+    } else if (lat <= run->cfg->deadline_us) {
+      run->good++;
+    } else {
+      run->late++;
+    }
+    std::unique_lock<std::mutex> lock(run->lock);
+    run->lat.push_back((uint32_t)lat);
+    break;
+  }
+  case KVS_ERR_DEADLINE_EXCEEDED:
+    run->dropped++;
+    break;
+  case KVS_ERR_CANCELED:
+    run->canceled++;
+    break;
+  default:
+    fprintf(stderr, "read of key %u failed with err 0x%x\n", req->idx, ctx->result);
+    run->errors++;
+  }
+  req->busy.store(false);
+  run->completed++;
+}
+
+// cancels reads that are past the deadline and have not been dispatched
+static void _run_canceler(kvs_key_space_handle ks, std::vector<deadline_req> *slots,
+                          deadline_run *run, std::atomic<bool> *stop) {
+  const uint64_t limit = run->cfg->deadline_us - run->cfg->slack_us;
+  while (!stop->load()) {
+    uint64_t now = _now_us();
+    for (auto &req : *slots) {
+      if (req.busy.load() && now - req.sent_us.load() > limit)
+        kvs_cancel_io(ks, &req, NULL);
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+static int _load_keys(kvs_key_space_handle ks, const deadline_config &cfg) {
+  char *key = (char *)kvs_malloc(DEADLINE_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg.vlen, 4096);
+  memset(value, 'd', cfg.vlen);
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  int result = SUCCESS;
+  for (uint32_t i = 0; i < cfg.keys; i++) {
+    _make_key(key, i);
+    memcpy(value, &i, sizeof(i));
+    kvs_key kvskey = { key, DEADLINE_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg.vlen, 0, 0 };
+    kvs_result ret = kvs_store_kvp(ks, &kvskey, &kvsvalue, &st_opt);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      result = FAILED;
+      break;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+  return result;
+}
+
+static uint32_t _percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[(size_t)(p / 100.0 * (sorted.size() - 1))];
+}
+
+static int _run_mode(kvs_key_space_handle ks, const deadline_config &cfg, int mode) {
+  std::vector<deadline_req> slots(DEADLINE_SLOTS);
+  for (auto &req : slots) {
+    req.busy.store(false);
+    req.sent_us.store(0);
+    req.key = (char *)kvs_malloc(DEADLINE_KEY_LEN, 4096);
+    req.value = (char *)kvs_malloc(cfg.vlen, 4096);
+  }
+
+  deadline_run run;
+  run.cfg = &cfg;
+  run.completed = run.good = run.late = run.dropped = run.canceled = run.errors = 0;
+
+  std::atomic<bool> stop(false);
+  std::thread canceler;
+  if (mode == MODE_CANCEL)
+    canceler = std::thread(_run_canceler, ks, &slots, &run, &stop);
+
+  const uint64_t total = (uint64_t)cfg.rate * cfg.seconds;
+  uint64_t submitted = 0;
+  unsigned int seed = 1;
+  const uint64_t start = _now_us();
+  for (uint64_t n = 0; n < total; n++) {
+    uint64_t due = start + n * 1000000ULL / cfg.rate;
+    uint64_t now = _now_us();
+    if (due > now) std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+
+    deadline_req &req = slots[n % DEADLINE_SLOTS];
+    while (req.busy.load()) std::this_thread::yield();
+
+    kvs_option_retrieve rt_opt = { false };
+    if (mode == MODE_DEADLINE) {
+      const uint64_t expiry = due + cfg.deadline_us - cfg.slack_us;
+      now = _now_us();
+      if (now >= expiry) {
+        run.dropped++;
+        continue;
+      }
+      rt_opt.deadline_us = (uint32_t)(expiry - now);
+    }
+
+    req.idx = rand_r(&seed) % cfg.keys;
+    _make_key(req.key, req.idx);
+    req.kvskey = { req.key, DEADLINE_KEY_LEN };
+    req.kvsvalue = { req.value, cfg.vlen, 0, 0 };
+    req.sent_us.store(due);
+    req.busy.store(true);
+    kvs_result ret = kvs_retrieve_kvp_async(ks, &req.kvskey, &rt_opt, &req, &run,
+                                            &req.kvsvalue, _on_read);
+    if (ret != KVS_SUCCESS) {
+      req.busy.store(false);
+      if (ret == KVS_ERR_DEADLINE_EXCEEDED) {
+        run.dropped++;
+      } else {
+        fprintf(stderr, "retrieve failed with err 0x%x\n", ret);
+        run.errors++;
+      }
+      continue;
+    }
+    submitted++;
+  }
+  while (run.completed.load() < submitted) std::this_thread::yield();
+  double secs = (_now_us() - start) / 1e6;
+
+  stop.store(true);
+  if (canceler.joinable()) canceler.join();
+  for (auto &req : slots) {
+    kvs_free(req.key);
+    kvs_free(req.value);
+  }
+
+  std::sort(run.lat.begin(), run.lat.end());
+  printf("%-8s %9lu %9lu %9lu %9lu %9lu %5lu %10.0f %7u %7u %7u\n", mode_names[mode],
+         total, run.good.load(), run.late.load(), run.dropped.load(), run.canceled.load(),
+         run.errors.load(), run.good.load() / secs, _percentile(run.lat, 50),
+         _percentile(run.lat, 99), run.lat.empty() ? 0 : run.lat.back());
+  return run.errors.load() ? FAILED : SUCCESS;
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+    int m;
+    for (m = 0; m < MODE_MAX; m++) {
+      if (strcmp(tok, mode_names[m]) == 0) break;
+    }
+    if (m == MODE_MAX) {
+      free(copy);
+      return false;
+    }
+    out->push_back(m);
+  }
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  deadline_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.keys = 2000;
+  cfg.vlen = 4096;
+  cfg.rate = 20000;
+  cfg.seconds = 3;
+  cfg.deadline_us = 5000;
+  cfg.slack_us = 500;
+  cfg.modes = { MODE_NONE, MODE_DEADLINE, MODE_CANCEL };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:n:v:r:s:D:S:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 'n':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'r':
+      cfg.rate = atoi(optarg);
+      break;
+    case 's':
+      cfg.seconds = atoi(optarg);
+      break;
+    case 'D':
+      cfg.deadline_us = atoi(optarg);
+      break;
+    case 'S':
+      cfg.slack_us = atoi(optarg);
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.keys == 0 || cfg.vlen < 64 || cfg.vlen % 4 || cfg.rate == 0 ||
+      cfg.seconds == 0 || cfg.deadline_us <= cfg.slack_us) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)DEADLINE_KEYSPACE_NAME;
+  ks_name.name_len = strlen(DEADLINE_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_key_space_handle ks;
+  ret = kvs_open_key_space(dev, (char *)DEADLINE_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  int result = _load_keys(ks, cfg);
+  if (result == SUCCESS) {
+    printf("%u reads/s for %u s over %u keys, %u byte values, deadline %u us, slack %u us\n",
+           cfg.rate, cfg.seconds, cfg.keys, cfg.vlen, cfg.deadline_us, cfg.slack_us);
+    printf("%-8s %9s %9s %9s %9s %9s %5s %10s %7s %7s %7s\n", "mode", "sent", "good",
+           "late", "dropped", "canceled", "errs", "goodput/s", "p50", "p99", "max");
+    for (int mode : cfg.modes)
+      result |= _run_mode(ks, cfg, mode);
+  }
+
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+  return result;
+}
@@ -0,0 +1,460 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Completion dispatch benchmark.
+ *
+ * Submitter threads keep a fixed number of asynchronous stores in flight.
+ * Every p-th post process function is slow: it sleeps as if it did its own
+ * I/O or waited for a lock. The same workload is run with each dispatch mode
+ * of kvs_set_completion_dispatch:
+ *
+ *  inline    post process functions run on the driver completion thread
+ *  pool      on the dispatch pool, in any order
+ *  ordered   on the dispatch pool, one at a time per submitter
+ *  executor  on a small executor of this program that keeps one queue per
+ *            submitter
+ *
+ * Latency is measured from submission to the start of the post process
+ * function, for the fast ones only, so it shows how long a completion
+ * waited behind slow ones. Modes that promise per submitter order fail
+ * when two post process functions of one submitter ran at the same time.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define DISPATCH_KEYSPACE_NAME "dispatch_bench"
+#define DISPATCH_KEY_LEN 16
+
+enum dispatch_bench_mode { MODE_INLINE = 0, MODE_POOL, MODE_ORDERED, MODE_EXECUTOR, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "inline", "pool", "ordered", "executor" };
+
+struct dispatch_config {
+  const char *dev_path;
+  int threads;          // submitters
+  uint32_t count;       // stores per submitter
+  uint32_t qdepth;      // stores in flight per submitter
+  uint32_t vlen;
+  uint32_t slow_us;     // time a slow post process function takes
+  uint32_t slow_every;  // every slow_every-th post process function is slow, 0 for none
+  uint32_t pool;        // dispatch threads, 0 for one per CPU
+  std::vector<int> modes;
+};
+
+struct dispatch_req;
+
+// one submitter thread and its requests
+struct dispatch_submitter {
+  const dispatch_config *cfg;
+  int id;
+  std::mutex lock;
+  std::condition_variable cond;
+  std::vector<dispatch_req*> free_reqs;
+  std::vector<uint32_t> lat;           // of the fast post process functions
+  std::atomic<uint64_t> completed;
+  std::atomic<uint32_t> running;       // post process functions running now
+  std::atomic<uint64_t> overlapped;    // ... that started while another one ran
+  std::atomic<uint64_t> reordered;     // ... of a store sent before the last one seen
+  std::atomic<uint32_t> last_seq;
+  std::atomic<uint64_t> errors;
+};
+
+struct dispatch_req {
+  dispatch_submitter *sub;
+  uint32_t seq;
+  uint64_t sent_us;
+  char *key;
+  char *value;
+  kvs_key kvskey;
+  kvs_value kvsvalue;
+};
+
+static uint64_t _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-n count] [-q qdepth] [-v vlen] "
+         "[-s slow_us] [-p every] [-T pool] [-m modes]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-t      threads      :  submitter threads (default 2)\n");
+  printf("-n      count        :  stores per thread (default 20000)\n");
+  printf("-q      qdepth       :  stores in flight per thread (default 32)\n");
+  printf("-v      vlen         :  value length (default 4096)\n");
+  printf("-s      slow_us      :  time a slow post process function takes (default 1000)\n");
+  printf("-p      every        :  every n-th post process function is slow, 0 for none (default 50)\n");
+  printf("-T      pool         :  dispatch threads of pool, ordered and executor, 0 for one per CPU (default 0)\n");
+  printf("-m      modes        :  comma separated list of inline,pool,ordered,executor (default all)\n");
+  printf("==============\n");
+}
+
+// executor of the caller: one queue and thread per submitter slot
+class bench_executor {
+public:
+  explicit bench_executor(uint32_t threads) : stop_(false), queues_(threads) {
+    for (uint32_t i = 0; i < threads; i++)
+      threads_.push_back(std::thread(&bench_executor::_work, this, &queues_[i]));
+  }
+
+  ~bench_executor() {
+    for (auto &q : queues_) {
+      std::unique_lock<std::mutex> lock(q.lock);
+      stop_ = true;
+      q.cond.notify_one();
+    }
+    for (auto &t : threads_) t.join();
+  }
+
+  static void execute(kvs_dispatch_task run, void *task, uint64_t submitter,
+                      void *private_data) {
+    bench_executor *ex = (bench_executor *)private_data;
+    queue &q = ex->queues_[submitter % ex->queues_.size()];
+    std::unique_lock<std::mutex> lock(q.lock);
+    q.tasks.push_back(std::make_pair(run, task));
+    q.cond.notify_one();
+  }
+
+private:
+  struct queue {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<std::pair<kvs_dispatch_task, void *> > tasks;
+  };
+
+  void _work(queue *q) {
+    std::unique_lock<std::mutex> lock(q->lock);
+    while (true) {
+      while (q->tasks.empty() && !stop_) q->cond.wait(lock);
+      if (q->tasks.empty()) break;
+      auto t = q->tasks.front();
+      q->tasks.pop_front();
+      lock.unlock();
+      t.first(t.second);
+      lock.lock();
+    }
+  }
+
+  bool stop_;
+  std::vector<queue> queues_;
+  std::vector<std::thread> threads_;
+};
+
+static void _on_store(kvs_postprocess_context *ctx) {
+  dispatch_req *req = (dispatch_req *)ctx->private1;
+  dispatch_submitter *sub = req->sub;
+  const uint64_t lat = _now_us() - req->sent_us;
+
+  if (sub->running.fetch_add(1) != 0) sub->overlapped++;
+  uint32_t last = sub->last_seq.load();
+  while (req->seq > last && !sub->last_seq.compare_exchange_weak(last, req->seq)) {}
+  if (req->seq < last) sub->reordered++;
+
+  if (ctx->result != KVS_SUCCESS) {
+    fprintf(stderr, "store failed with err 0x%x\n", ctx->result);
+    sub->errors++;
+  }
+  const bool slow = sub->cfg->slow_every && req->seq % sub->cfg->slow_every == 0;
+  if (slow) {
+    usleep(sub->cfg->slow_us);
+  } else {
+    sub->lat[req->seq] = (uint32_t)lat;
+  }
+  sub->running--;
+
+  std::unique_lock<std::mutex> lock(sub->lock);
+  sub->free_reqs.push_back(req);
+  sub->completed++;
+  sub->cond.notify_one();
+}
+
+static void _submit(kvs_key_space_handle ks, dispatch_submitter *sub) {
+  const dispatch_config &cfg = *sub->cfg;
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  for (uint32_t seq = 1; seq <= cfg.count; seq++) {
+    dispatch_req *req;
+    {
+      std::unique_lock<std::mutex> lock(sub->lock);
+      while (sub->free_reqs.empty()) sub->cond.wait(lock);
+      req = sub->free_reqs.back();
+      sub->free_reqs.pop_back();
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "dsp%03d%010u", sub->id, seq % 100000);
+    memcpy(req->key, buf, DISPATCH_KEY_LEN);
+    memcpy(req->value, &seq, sizeof(seq));
+    req->seq = seq;
+    req->kvskey = { req->key, DISPATCH_KEY_LEN };
+    req->kvsvalue = { req->value, cfg.vlen, 0, 0 };
+    req->sent_us = _now_us();
+    kvs_result ret = kvs_store_kvp_async(ks, &req->kvskey, &req->kvsvalue, &st_opt,
+                                         req, NULL, _on_store);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      sub->errors++;
+      std::unique_lock<std::mutex> lock(sub->lock);
+      sub->free_reqs.push_back(req);
+      sub->completed++;
+    }
+  }
+  std::unique_lock<std::mutex> lock(sub->lock);
+  while (sub->completed.load() < cfg.count) sub->cond.wait(lock);
+}
+
+static uint32_t _percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[(size_t)(p / 100.0 * (sorted.size() - 1))];
+}
+
+static int _run_mode(kvs_device_handle dev, kvs_key_space_handle ks,
+                     const dispatch_config &cfg, int mode) {
+  bench_executor *executor = NULL;
+  kvs_option_dispatch opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.threads = cfg.pool;
+  switch (mode) {
+  case MODE_INLINE:
+    opt.mode = KVS_DISPATCH_INLINE;
+    break;
+  case MODE_POOL:
+  case MODE_ORDERED:
+    opt.mode = KVS_DISPATCH_POOL;
+    opt.ordered = mode == MODE_ORDERED;
+    break;
+  case MODE_EXECUTOR:
+    executor = new bench_executor(cfg.pool ? cfg.pool : std::thread::hardware_concurrency());
+    opt.mode = KVS_DISPATCH_EXECUTOR;
+    opt.executor = bench_executor::execute;
+    opt.executor_private = executor;
+    break;
+  }
+  kvs_result ret = kvs_set_completion_dispatch(dev, &opt);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "kvs_set_completion_dispatch failed 0x%x\n", ret);
+    delete executor;
+    return FAILED;
+  }
+
+  std::vector<dispatch_submitter*> subs;
+  for (int i = 0; i < cfg.threads; i++) {
+    dispatch_submitter *sub = new dispatch_submitter();
+    sub->cfg = &cfg;
+    sub->id = i;
+    sub->lat.assign(cfg.count + 1, UINT32_MAX);
+    sub->completed = 0;
+    sub->running = 0;
+    sub->overlapped = sub->reordered = sub->errors = 0;
+    sub->last_seq = 0;
+    for (uint32_t q = 0; q < cfg.qdepth; q++) {
+      dispatch_req *req = new dispatch_req();
+      req->sub = sub;
+      req->key = (char *)kvs_malloc(DISPATCH_KEY_LEN, 4096);
+      req->value = (char *)kvs_malloc(cfg.vlen, 4096);
+      memset(req->value, 'd', cfg.vlen);
+      sub->free_reqs.push_back(req);
+    }
+    subs.push_back(sub);
+  }
+
+  const uint64_t start = _now_us();
+  std::vector<std::thread> threads;
+  for (auto sub : subs) threads.push_back(std::thread(_submit, ks, sub));
+  for (auto &t : threads) t.join();
+  const double secs = (_now_us() - start) / 1e6;
+
+  //back to inline before the executor goes away
+  kvs_set_completion_dispatch(dev, NULL);
+  delete executor;
+
+  std::vector<uint32_t> lat;
+  uint64_t overlapped = 0, reordered = 0, errors = 0;
+  for (auto sub : subs) {
+    for (uint32_t l : sub->lat) {
+      if (l != UINT32_MAX) lat.push_back(l);
+    }
+    overlapped += sub->overlapped;
+    reordered += sub->reordered;
+    errors += sub->errors;
+    for (auto req : sub->free_reqs) {
+      kvs_free(req->key);
+      kvs_free(req->value);
+      delete req;
+    }
+    delete sub;
+  }
+  std::sort(lat.begin(), lat.end());
+
+  const uint64_t total = (uint64_t)cfg.threads * cfg.count;
+  printf("%-9s %10.0f %8u %8u %8u %10lu %10lu %5lu\n", mode_names[mode], total / secs,
+         _percentile(lat, 50), _percentile(lat, 99), lat.empty() ? 0 : lat.back(),
+         reordered, overlapped, errors);
+
+  const bool ordered = mode != MODE_POOL;
+  if (ordered && overlapped) {
+    fprintf(stderr, "%s: post process functions of one submitter overlapped\n",
+            mode_names[mode]);
+    return FAILED;
+  }
+  return errors ? FAILED : SUCCESS;
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+    int m;
+    for (m = 0; m < MODE_MAX; m++) {
+      if (strcmp(tok, mode_names[m]) == 0) break;
+    }
+    if (m == MODE_MAX) {
+      free(copy);
+      return false;
+    }
+    out->push_back(m);
+  }
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  dispatch_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 2;
+  cfg.count = 20000;
+  cfg.qdepth = 32;
+  cfg.vlen = 4096;
+  cfg.slow_us = 1000;
+  cfg.slow_every = 50;
+  cfg.pool = 0;
+  cfg.modes = { MODE_INLINE, MODE_POOL, MODE_ORDERED, MODE_EXECUTOR };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:n:q:v:s:p:T:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.count = atoi(optarg);
+      break;
+    case 'q':
+      cfg.qdepth = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 's':
+      cfg.slow_us = atoi(optarg);
+      break;
+    case 'p':
+      cfg.slow_every = atoi(optarg);
+      break;
+    case 'T':
+      cfg.pool = atoi(optarg);
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.threads <= 0 || cfg.count == 0 || cfg.qdepth == 0 || cfg.vlen < 64 ||
+      cfg.vlen % 4) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)DISPATCH_KEYSPACE_NAME;
+  ks_name.name_len = strlen(DISPATCH_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_key_space_handle ks;
+  ret = kvs_open_key_space(dev, (char *)DISPATCH_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  printf("%d threads x %u stores, %u in flight each, %u byte values, "
+         "every %u-th post process function takes %u us\n", cfg.threads, cfg.count,
+         cfg.qdepth, cfg.vlen, cfg.slow_every, cfg.slow_us);
+  printf("%-9s %10s %8s %8s %8s %10s %10s %5s\n", "mode", "ops/s", "p50", "p99", "max",
+         "reordered", "overlapped", "errs");
+  int result = SUCCESS;
+  for (int mode : cfg.modes)
+    result |= _run_mode(dev, ks, cfg, mode);
+
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+  return result;
+}
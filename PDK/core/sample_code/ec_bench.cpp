@@ -0,0 +1,450 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Erasure coded set benchmark.
+ *
+ * First measures the Reed-Solomon codec on its own: encode throughput and
+ * the throughput of rebuilding one and two lost data fragments, with the
+ * SIMD region multiply and with the scalar one.
+ *
+ * Then opens k + m emulated devices (device path prefix plus an index),
+ * stores a key set through an erasure coded set over one key space on each
+ * of them and reads it back with 0, 1, ... devices marked failed, checking
+ * every value. Failed devices are simulated with kvs_ec_set_failed, so reads
+ * on them are degraded and rebuilt from the parity fragments.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+#include "kvs_rs.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define EC_KEYSPACE_NAME "ec_bench"
+#define EC_KEY_LEN 16
+
+struct ec_config {
+  const char *dev_prefix;
+  int k;
+  int m;
+  int threads;
+  uint32_t reads;        // per thread
+  uint32_t keys;
+  uint32_t vlen;
+  uint32_t min_value_size;
+  uint32_t codec_mb;
+  int max_failed;
+};
+
+struct ec_worker {
+  int id;
+  const ec_config *cfg;
+  kvs_ec_set_handle ec;
+  std::vector<uint32_t> lat;
+  uint64_t errors;
+};
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_prefix] [-k data] [-m parity] [-t threads] [-n reads] "
+         "[-K keys] [-v vlen] [-s min_value_size] [-c codec_mb] [-f max_failed]\n", program);
+  printf("-d      device_prefix  :  devices are prefix0, prefix1, ... (default /dev/kvemul)\n");
+  printf("-k      data           :  data fragments (default 4)\n");
+  printf("-m      parity         :  parity fragments (default 2), k + m <= %d\n",
+         KVS_MAX_EC_FRAGMENTS);
+  printf("-t      threads        :  number of threads (default 4)\n");
+  printf("-n      reads          :  reads per thread and failure count (default 2000)\n");
+  printf("-K      keys           :  number of keys (default 1000)\n");
+  printf("-v      vlen           :  value length (default 65536)\n");
+  printf("-s      min_value_size :  smaller values are replicated (default 4096)\n");
+  printf("-c      codec_mb       :  data encoded per codec measurement in MB (default 256)\n");
+  printf("-f      max_failed     :  read with up to this many failed devices (default m)\n");
+  printf("==============\n");
+}
+
+static void _make_key(char *key, uint32_t idx) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "ec%014u", idx);
+  memcpy(key, buf, EC_KEY_LEN);
+}
+
+static void _fill_value(char *value, uint32_t vlen, uint32_t idx) {
+  uint32_t x = idx * 2654435761u + 1;
+  for (uint32_t i = 0; i + 4 <= vlen; i += 4) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    memcpy(value + i, &x, 4);
+  }
+}
+
+static double _mbps(uint64_t bytes, uint64_t ns) {
+  return ns ? (double)bytes / (1 << 20) / (ns / 1e9) : 0.0;
+}
+
+static void _run_codec(const ec_config &cfg, bool simd) {
+  kvs_rs_codec codec(cfg.k, cfg.m, simd);
+  int n = cfg.k + cfg.m;
+  size_t len = ((cfg.vlen + cfg.k - 1) / cfg.k + 31) & ~31u;
+  std::vector<std::vector<uint8_t> > frags(n, std::vector<uint8_t>(len));
+  std::vector<std::vector<uint8_t> > orig(cfg.k);
+  std::vector<uint8_t*> p(n);
+  for (int i = 0; i < n; i++) p[i] = frags[i].data();
+  for (int i = 0; i < cfg.k; i++) {
+    _fill_value((char *)p[i], len, i);
+    orig[i] = frags[i];
+  }
+  uint64_t iters = std::max<uint64_t>(1, ((uint64_t)cfg.codec_mb << 20) / (len * cfg.k));
+
+  uint64_t start = _now_ns();
+  for (uint64_t it = 0; it < iters; it++) codec.encode(p.data(), p.data() + cfg.k, len);
+  uint64_t enc_ns = _now_ns() - start;
+  printf("%-6s encode      %9.1f MB/s\n", codec.simd_name(),
+         _mbps(iters * len * cfg.k, enc_ns));
+
+  // rebuild the first e data fragments; throughput is per rebuilt byte
+  for (int e = 1; e <= std::min(cfg.m, 2); e++) {
+    std::vector<char> present(n, 1);
+    for (int i = 0; i < e; i++) present[i] = 0;
+    bool ok = true;
+    start = _now_ns();
+    for (uint64_t it = 0; it < iters; it++) {
+      ok &= codec.decode(p.data(), (const bool *)present.data(), len);
+    }
+    uint64_t dec_ns = _now_ns() - start;
+    for (int i = 0; i < e; i++) ok &= (frags[i] == orig[i]);
+    printf("%-6s decode %d lost %9.1f MB/s (rebuilt) %9.1f MB/s (value)%s\n",
+           codec.simd_name(), e, _mbps(iters * len * e, dec_ns),
+           _mbps(iters * len * cfg.k, dec_ns), ok ? "" : "  MISMATCH");
+  }
+}
+
+// stores this worker's share of the keys
+static void _run_loader(ec_worker *w, int nworkers) {
+  const ec_config *cfg = w->cfg;
+  char *key = (char *)kvs_malloc(EC_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  kvs_option_store st_opt = { KVS_STORE_POST, 0 };
+  for (uint32_t i = w->id; i < cfg->keys; i += nworkers) {
+    _make_key(key, i);
+    _fill_value(value, cfg->vlen, i);
+    kvs_key kvskey = { key, EC_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    uint64_t start = _now_ns();
+    kvs_result ret = kvs_ec_store_kvp(w->ec, &kvskey, &kvsvalue, &st_opt);
+    w->lat.push_back((_now_ns() - start) / 1000);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      w->errors++;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static void _run_reader(ec_worker *w) {
+  const ec_config *cfg = w->cfg;
+  char *key = (char *)kvs_malloc(EC_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  char *expect = (char *)malloc(cfg->vlen);
+  kvs_option_retrieve rt_opt = { false };
+  unsigned int seed = w->id + 1;
+  for (uint32_t n = 0; n < cfg->reads; n++) {
+    uint32_t idx = rand_r(&seed) % cfg->keys;
+    _make_key(key, idx);
+    kvs_key kvskey = { key, EC_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    uint64_t start = _now_ns();
+    kvs_result ret = kvs_ec_retrieve_kvp(w->ec, &kvskey, &rt_opt, &kvsvalue);
+    w->lat.push_back((_now_ns() - start) / 1000);
+    _fill_value(expect, cfg->vlen, idx);
+    if (ret != KVS_SUCCESS || kvsvalue.actual_value_size != cfg->vlen ||
+        memcmp(value, expect, cfg->vlen) != 0) {
+      fprintf(stderr, "read of key %u failed with err 0x%x\n", idx, ret);
+      w->errors++;
+    }
+  }
+  free(expect);
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static uint32_t _percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[(size_t)(p / 100.0 * (sorted.size() - 1))];
+}
+
+// runs fn on every worker, returns the sorted latencies and the wall time
+static double _run_workers(std::vector<ec_worker *> &workers, void (*fn)(ec_worker *, int),
+                           std::vector<uint32_t> *lat, uint64_t *errors) {
+  std::vector<std::thread> threads;
+  for (auto w : workers) {
+    w->lat.clear();
+    w->errors = 0;
+  }
+  uint64_t start = _now_ns();
+  for (auto w : workers) threads.push_back(std::thread(fn, w, (int)workers.size()));
+  for (auto &t : threads) t.join();
+  double secs = (_now_ns() - start) / 1e9;
+  lat->clear();
+  *errors = 0;
+  for (auto w : workers) {
+    lat->insert(lat->end(), w->lat.begin(), w->lat.end());
+    *errors += w->errors;
+  }
+  std::sort(lat->begin(), lat->end());
+  return secs;
+}
+
+static void _read_all(ec_worker *w, int) { _run_reader(w); }
+
+static void _print_row(const char *phase, const std::vector<uint32_t> &lat, double secs,
+                       uint32_t vlen, uint64_t degraded, uint64_t errors) {
+  printf("%-10s %9.0f %9.1f %7u %7u %7u %7u %9lu %5lu\n", phase, lat.size() / secs,
+         _mbps((uint64_t)lat.size() * vlen, (uint64_t)(secs * 1e9)), _percentile(lat, 50),
+         _percentile(lat, 99), _percentile(lat, 99.9), lat.empty() ? 0 : lat.back(),
+         degraded, errors);
+}
+
+static int _open_key_space(kvs_device_handle dev, kvs_key_space_handle *ks) {
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)EC_KEYSPACE_NAME;
+  ks_name.name_len = strlen(EC_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_result ret = kvs_open_key_space(dev, (char *)EC_KEYSPACE_NAME, ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+static void _drop_key_space(kvs_device_handle dev, kvs_key_space_handle ks) {
+  kvs_key_space_name ks_name;
+  ks_name.name = (char *)EC_KEYSPACE_NAME;
+  ks_name.name_len = strlen(EC_KEYSPACE_NAME);
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+}
+
+static int _run_set(std::vector<kvs_device_handle> &devs, const ec_config &cfg) {
+  int n = devs.size();
+  std::vector<kvs_key_space_handle> ks(n);
+  for (int i = 0; i < n; i++) {
+    if (_open_key_space(devs[i], &ks[i]) != SUCCESS) {
+      for (int j = 0; j < i; j++) _drop_key_space(devs[j], ks[j]);
+      return FAILED;
+    }
+  }
+
+  kvs_option_ec opt;
+  opt.data_fragments = cfg.k;
+  opt.parity_fragments = cfg.m;
+  opt.min_value_size = cfg.min_value_size;
+  kvs_ec_set_handle ec;
+  kvs_result ret = kvs_open_ec_set(ks.data(), n, &opt, &ec);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "open erasure coded set failed with err 0x%x\n", ret);
+    for (int i = 0; i < n; i++) _drop_key_space(devs[i], ks[i]);
+    return FAILED;
+  }
+
+  std::vector<ec_worker *> workers;
+  for (int i = 0; i < cfg.threads; i++) {
+    ec_worker *w = new ec_worker();
+    w->id = i;
+    w->cfg = &cfg;
+    w->ec = ec;
+    workers.push_back(w);
+  }
+
+  printf("%-10s %9s %9s %31s %9s %5s\n", "", "", "", "latency (us)", "", "");
+  printf("%-10s %9s %9s %7s %7s %7s %7s %9s %5s\n", "phase", "ops/s", "MB/s", "p50", "p99",
+         "p99.9", "max", "degraded", "errs");
+  std::vector<uint32_t> lat;
+  uint64_t errors, total_errors = 0;
+  kvs_ec_stats before, after;
+  kvs_get_ec_stats(ec, &before);
+  double secs = _run_workers(workers, _run_loader, &lat, &errors);
+  kvs_get_ec_stats(ec, &after);
+  _print_row("store", lat, secs, cfg.vlen, after.degraded_writes - before.degraded_writes,
+             errors);
+  total_errors += errors;
+  uint64_t enc_bytes = after.encode_bytes, enc_ns = after.encode_ns;
+
+  // fail devices from the last one down, so the data fragments of most keys
+  // are lost too
+  for (int f = 0; f <= cfg.max_failed; f++) {
+    if (f > 0) kvs_ec_set_failed(ec, n - f, true);
+    char phase[32];
+    snprintf(phase, sizeof(phase), "read f=%d", f);
+    kvs_get_ec_stats(ec, &before);
+    secs = _run_workers(workers, _read_all, &lat, &errors);
+    kvs_get_ec_stats(ec, &after);
+    _print_row(phase, lat, secs, cfg.vlen, after.degraded_reads - before.degraded_reads,
+               errors);
+    total_errors += errors;
+  }
+  for (int f = 1; f <= cfg.max_failed; f++) kvs_ec_set_failed(ec, n - f, false);
+
+  // clean up through the set
+  char *key = (char *)kvs_malloc(EC_KEY_LEN, 4096);
+  kvs_option_delete del_opt = { true };
+  for (uint32_t i = 0; i < cfg.keys; i++) {
+    _make_key(key, i);
+    kvs_key kvskey = { key, EC_KEY_LEN };
+    ret = kvs_ec_delete_kvp(ec, &kvskey, &del_opt);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "delete failed with err 0x%x\n", ret);
+      total_errors++;
+    }
+  }
+  kvs_free(key);
+
+  kvs_get_ec_stats(ec, &after);
+  printf("in-line codec: encode %.1f MB/s, decode %.1f MB/s (rebuilt bytes), "
+         "%lu fragment errors\n", _mbps(enc_bytes, enc_ns),
+         _mbps(after.decode_bytes, after.decode_ns), after.fragment_errors);
+
+  for (auto w : workers) delete w;
+  kvs_close_ec_set(ec);
+  for (int i = 0; i < n; i++) _drop_key_space(devs[i], ks[i]);
+  return total_errors ? FAILED : SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+  ec_config cfg;
+  cfg.dev_prefix = "/dev/kvemul";
+  cfg.k = 4;
+  cfg.m = 2;
+  cfg.threads = 4;
+  cfg.reads = 2000;
+  cfg.keys = 1000;
+  cfg.vlen = 65536;
+  cfg.min_value_size = 4096;
+  cfg.codec_mb = 256;
+  cfg.max_failed = -1;
+
+  int c;
+  while ((c = getopt(argc, argv, "d:k:m:t:n:K:v:s:c:f:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_prefix = optarg;
+      break;
+    case 'k':
+      cfg.k = atoi(optarg);
+      break;
+    case 'm':
+      cfg.m = atoi(optarg);
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.reads = atoi(optarg);
+      break;
+    case 'K':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 's':
+      cfg.min_value_size = atoi(optarg);
+      break;
+    case 'c':
+      cfg.codec_mb = atoi(optarg);
+      break;
+    case 'f':
+      cfg.max_failed = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.max_failed < 0) cfg.max_failed = cfg.m;
+  if (cfg.k <= 0 || cfg.m <= 0 || cfg.k + cfg.m > KVS_MAX_EC_FRAGMENTS ||
+      cfg.threads <= 0 || cfg.reads == 0 || cfg.keys == 0 || cfg.vlen < 64 ||
+      cfg.vlen % 4 || cfg.codec_mb == 0 || cfg.max_failed > cfg.m) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  uint32_t frag = ((cfg.vlen + cfg.k - 1) / cfg.k + 31) & ~31u;
+  printf("k = %d, m = %d, %u byte values, %u byte fragments\n", cfg.k, cfg.m, cfg.vlen, frag);
+  printf("storage per value: %.2fx (3-way replication 3.00x)\n",
+         cfg.vlen >= cfg.min_value_size ? (double)frag * (cfg.k + cfg.m) / cfg.vlen :
+         (double)(cfg.m + 1));
+  _run_codec(cfg, true);
+  _run_codec(cfg, false);
+
+  std::vector<kvs_device_handle> devs;
+  for (int i = 0; i < cfg.k + cfg.m; i++) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s%d", cfg.dev_prefix, i);
+    kvs_device_handle dev;
+    kvs_result ret = kvs_open_device(path, &dev);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Device open of %s failed 0x%x\n", path, ret);
+      for (auto d : devs) kvs_close_device(d);
+      return FAILED;
+    }
+    devs.push_back(dev);
+  }
+
+  printf("%d threads, %u keys, %u reads per thread\n", cfg.threads, cfg.keys, cfg.reads);
+  int result = _run_set(devs, cfg);
+
+  for (auto d : devs) kvs_close_device(d);
+  return result;
+}
@@ -0,0 +1,500 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Stress test for key space and device handle lifetime in the KVS API.
+ *
+ * I/O threads keep issuing synchronous and asynchronous requests on the
+ * current key space handle while a churn thread keeps closing and reopening
+ * the key space, and every few cycles the whole device, underneath them.
+ * Requests on a handle that has been closed have to fail cleanly, and no
+ * completion function may run after the close call of its key space has
+ * returned. A run with any such completion, any unexpected error or any I/O
+ * still in flight after the final close fails.
+ *
+ * The second part compares the cost of handle validation on the I/O path:
+ * the linear search over the lists of open key spaces and devices that the
+ * API used to do against an acquire/release on the handle table.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+#include "private_types.h"
+#include "kvs_handle_table.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define STRESS_KEYSPACE_NAME "handle_stress"
+#define STRESS_KEY_LEN 16
+#define STRESS_VALUE_LEN 4096
+#define STRESS_NUM_KEYS 1024
+
+struct stress_config {
+  const char *dev_path;
+  int threads;
+  int seconds;
+  int qdepth;
+  int close_period_ms;
+  int device_period;
+  uint64_t validations;
+  std::vector<int> list_sizes;
+};
+
+// handle published to the I/O threads, epochs start at 1
+struct published_ks {
+  kvs_key_space_handle ks;
+  uint64_t epoch;
+};
+
+struct io_context {
+  std::atomic<bool> busy;
+  uint64_t epoch;
+  char *key;
+  char *value;
+  kvs_key kvskey;
+  kvs_value kvsvalue;
+};
+
+struct stress_counters {
+  std::atomic<uint64_t> ok;
+  std::atomic<uint64_t> not_found;
+  std::atomic<uint64_t> rejected;
+  std::atomic<uint64_t> errors;
+  std::atomic<uint64_t> completions;
+  std::atomic<uint64_t> late_completions;
+};
+
+static std::atomic<published_ks*> g_current(NULL);
+static std::atomic<uint64_t> g_closed_epoch(0);
+static std::atomic<bool> g_stop(false);
+static stress_counters g_cnt;
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-s seconds] [-q queue_depth] [-c close_period] "
+         "[-D device_period] [-n validations] [-l list_sizes]\n", program);
+  printf("-d      device_path   :  device path (default /dev/kvemul)\n");
+  printf("-t      threads       :  I/O and validation threads (default 4)\n");
+  printf("-s      seconds       :  duration of the stress run, 0 skips it (default 5)\n");
+  printf("-q      queue_depth   :  asynchronous requests in flight per thread (default 16)\n");
+  printf("-c      close_period  :  milliseconds between key space close and reopen (default 5)\n");
+  printf("-D      device_period :  close and reopen the device every N key space cycles, 0 never (default 20)\n");
+  printf("-n      validations   :  handle validations per thread in the comparison, 0 skips it (default 10000000)\n");
+  printf("-l      list_sizes    :  comma separated numbers of open key spaces to compare with (default 1,16,256)\n");
+  printf("==============\n");
+}
+
+static void _count_result(kvs_result ret) {
+  switch (ret) {
+  case KVS_SUCCESS:
+    g_cnt.ok++;
+    break;
+  case KVS_ERR_KEY_NOT_EXIST:
+    g_cnt.not_found++;
+    break;
+  case KVS_ERR_KS_NOT_OPEN:
+  case KVS_ERR_DEV_NOT_OPENED:
+    g_cnt.rejected++;
+    break;
+  default:
+    if (g_cnt.errors++ < 10)
+      fprintf(stderr, "unexpected result 0x%x\n", ret);
+    break;
+  }
+}
+
+static void _complete(kvs_postprocess_context *ioctx) {
+  io_context *ctx = (io_context *)ioctx->private1;
+  if (ctx->epoch <= g_closed_epoch.load(std::memory_order_acquire))
+    g_cnt.late_completions++;
+  _count_result(ioctx->result);
+  g_cnt.completions++;
+  ctx->busy.store(false, std::memory_order_release);
+}
+
+static void _fill_key(char *key, uint32_t idx) {
+  snprintf(key, STRESS_KEY_LEN + 1, "key%013u", idx);
+}
+
+static void _io_thread(int id, const stress_config *cfg, std::vector<io_context> *ctxs) {
+  unsigned int seed = id + 1;
+  char *key = (char *)kvs_malloc(STRESS_KEY_LEN + 1, 4096);
+  char *value = (char *)kvs_malloc(STRESS_VALUE_LEN, 4096);
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  kvs_option_retrieve rt_opt = { false };
+
+  while (!g_stop.load(std::memory_order_relaxed)) {
+    published_ks *cur = g_current.load(std::memory_order_acquire);
+    uint32_t idx = rand_r(&seed) % STRESS_NUM_KEYS;
+
+    // async store on a free context, sync retrieve otherwise
+    io_context *ctx = NULL;
+    for (auto &c : *ctxs) {
+      if (!c.busy.load(std::memory_order_acquire)) {
+        ctx = &c;
+        break;
+      }
+    }
+    if (ctx && (rand_r(&seed) & 1)) {
+      ctx->busy.store(true, std::memory_order_relaxed);
+      ctx->epoch = cur->epoch;
+      _fill_key(ctx->key, idx);
+      ctx->kvskey = { ctx->key, STRESS_KEY_LEN };
+      ctx->kvsvalue = { ctx->value, STRESS_VALUE_LEN, 0, 0 };
+      kvs_result ret = kvs_store_kvp_async(cur->ks, &ctx->kvskey, &ctx->kvsvalue,
+                                           &st_opt, ctx, NULL, _complete);
+      if (ret != KVS_SUCCESS) {
+        _count_result(ret);
+        ctx->busy.store(false, std::memory_order_release);
+      }
+    } else {
+      _fill_key(key, idx);
+      kvs_key kvskey = { key, STRESS_KEY_LEN };
+      kvs_value kvsvalue = { value, STRESS_VALUE_LEN, 0, 0 };
+      _count_result(kvs_retrieve_kvp(cur->ks, &kvskey, &rt_opt, &kvsvalue));
+    }
+  }
+
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static kvs_result _open_ks(kvs_device_handle dev, kvs_key_space_handle *ks) {
+  kvs_result ret = kvs_open_key_space(dev, (char *)STRESS_KEYSPACE_NAME, ks);
+  if (ret == KVS_ERR_KS_NOT_EXIST) {
+    kvs_key_space_name ks_name;
+    kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+    ks_name.name = (char *)STRESS_KEYSPACE_NAME;
+    ks_name.name_len = strlen(STRESS_KEYSPACE_NAME);
+    ret = kvs_create_key_space(dev, &ks_name, 0, option);
+    if (ret == KVS_SUCCESS)
+      ret = kvs_open_key_space(dev, (char *)STRESS_KEYSPACE_NAME, ks);
+  }
+  return ret;
+}
+
+static void _delete_ks(kvs_device_handle dev) {
+  kvs_key_space_name ks_name;
+  ks_name.name = (char *)STRESS_KEYSPACE_NAME;
+  ks_name.name_len = strlen(STRESS_KEYSPACE_NAME);
+  kvs_delete_key_space(dev, &ks_name);
+}
+
+static int _stress(const stress_config &cfg) {
+  kvs_device_handle dev;
+  kvs_key_space_handle ks;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+  ret = _open_ks(dev, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  // every published handle is kept until the I/O threads are gone
+  std::vector<published_ks*> history;
+  history.push_back(new published_ks{ks, 1});
+  g_current.store(history.back(), std::memory_order_release);
+
+  std::vector<std::vector<io_context>> ctxs(cfg.threads);
+  for (auto &v : ctxs) {
+    v = std::vector<io_context>(cfg.qdepth);
+    for (auto &c : v) {
+      c.busy.store(false);
+      c.key = (char *)kvs_malloc(STRESS_KEY_LEN + 1, 4096);
+      c.value = (char *)kvs_malloc(STRESS_VALUE_LEN, 4096);
+      memset(c.value, 'v', STRESS_VALUE_LEN);
+    }
+  }
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < cfg.threads; i++)
+    workers.push_back(std::thread(_io_thread, i, &cfg, &ctxs[i]));
+
+  uint64_t ks_cycles = 0, dev_cycles = 0;
+  uint64_t close_ns = 0, close_max_ns = 0;
+  uint64_t start = _now_ns();
+  uint64_t end = start + (uint64_t)cfg.seconds * 1000000000ULL;
+  int result = SUCCESS;
+  while (_now_ns() < end) {
+    usleep(cfg.close_period_ms * 1000);
+    published_ks *cur = history.back();
+    bool dev_cycle = cfg.device_period > 0 && (ks_cycles + 1) % cfg.device_period == 0;
+
+    uint64_t t0 = _now_ns();
+    ret = dev_cycle ? kvs_close_device(dev) : kvs_close_key_space(cur->ks);
+    uint64_t t = _now_ns() - t0;
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Close failed 0x%x\n", ret);
+      result = FAILED;
+      break;
+    }
+    g_closed_epoch.store(cur->epoch, std::memory_order_release);
+    close_ns += t;
+    close_max_ns = std::max(close_max_ns, t);
+    ks_cycles++;
+
+    if (dev_cycle) {
+      dev_cycles++;
+      ret = kvs_open_device((char *)cfg.dev_path, &dev);
+      if (ret != KVS_SUCCESS) {
+        fprintf(stderr, "Device reopen failed 0x%x\n", ret);
+        result = FAILED;
+        break;
+      }
+    }
+    ret = _open_ks(dev, &ks);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Keyspace reopen failed 0x%x\n", ret);
+      result = FAILED;
+      break;
+    }
+    history.push_back(new published_ks{ks, cur->epoch + 1});
+    g_current.store(history.back(), std::memory_order_release);
+  }
+
+  g_stop.store(true);
+  for (auto &w : workers) w.join();
+  double secs = (_now_ns() - start) / 1e9;
+
+  if (result == SUCCESS) {
+    ret = kvs_close_key_space(history.back()->ks);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Final close failed 0x%x\n", ret);
+      result = FAILED;
+    }
+    g_closed_epoch.store(history.back()->epoch, std::memory_order_release);
+    _delete_ks(dev);
+    kvs_close_device(dev);
+  }
+
+  uint64_t inflight = 0;
+  for (auto &v : ctxs) {
+    for (auto &c : v) {
+      if (c.busy.load()) inflight++;
+      else {
+        kvs_free(c.key);
+        kvs_free(c.value);
+      }
+    }
+  }
+  for (auto p : history) delete p;
+
+  uint64_t ops = g_cnt.ok + g_cnt.not_found;
+  printf("stress: %d threads, qd %d, %.1f s\n", cfg.threads, cfg.qdepth, secs);
+  printf("  key space cycles      %lu (%lu with device close)\n", ks_cycles, dev_cycles);
+  printf("  close latency         avg %.1f us, max %.1f us\n",
+         ks_cycles ? close_ns / 1e3 / ks_cycles : 0.0, close_max_ns / 1e3);
+  printf("  completed requests    %lu (%.0f ops/s)\n", ops, ops / secs);
+  printf("  rejected stale handle %lu\n", g_cnt.rejected.load());
+  printf("  async completions     %lu\n", g_cnt.completions.load());
+  printf("  completions too late  %lu\n", g_cnt.late_completions.load());
+  printf("  unexpected errors     %lu\n", g_cnt.errors.load());
+  printf("  in flight after close %lu\n", inflight);
+
+  if (g_cnt.late_completions || g_cnt.errors || inflight) result = FAILED;
+  printf("stress: %s\n", result == SUCCESS ? "passed" : "FAILED");
+  return result;
+}
+
+// what _check_key_space_handle used to do on every call
+struct list_registry {
+  std::list<kvs_key_space_handle> list_open_ks;
+  std::list<kvs_device_handle> open_devices;
+
+  bool validate(kvs_key_space_handle ks) {
+    if (std::find(list_open_ks.begin(), list_open_ks.end(), ks) == list_open_ks.end())
+      return false;
+    return std::find(open_devices.begin(), open_devices.end(), ks->dev) != open_devices.end();
+  }
+};
+
+typedef kvs_handle_table<_kvs_key_space_handle, MAX_OPEN_KEY_SPACES> key_space_table;
+static key_space_table g_table;
+
+static double _run_validation(int threads, uint64_t n,
+                              const std::vector<kvs_key_space_handle> &hds,
+                              list_registry *reg) {
+  std::atomic<uint64_t> failed(0);
+  std::vector<std::thread> workers;
+  uint64_t start = _now_ns();
+  for (int i = 0; i < threads; i++) {
+    workers.push_back(std::thread([&, i]() {
+      unsigned int seed = i + 1;
+      uint64_t bad = 0;
+      for (uint64_t j = 0; j < n; j++) {
+        kvs_key_space_handle ks = hds[rand_r(&seed) % hds.size()];
+        if (reg) {
+          if (!reg->validate(ks)) bad++;
+        } else {
+          if (g_table.acquire(ks)) g_table.release(ks);
+          else bad++;
+        }
+      }
+      failed += bad;
+    }));
+  }
+  for (auto &w : workers) w.join();
+  uint64_t elapsed = _now_ns() - start;
+  if (failed) fprintf(stderr, "%lu validations failed\n", failed.load());
+  return (double)elapsed / (n * threads);
+}
+
+static int _compare(const stress_config &cfg) {
+  _kvs_device_handle *dev = new _kvs_device_handle();
+
+  printf("validation: %d threads, %lu per thread\n", cfg.threads, cfg.validations);
+  printf("  %-10s %14s %14s %9s\n", "open ks", "list ns/op", "table ns/op", "speedup");
+  for (int size : cfg.list_sizes) {
+    if (size <= 0 || size > MAX_OPEN_KEY_SPACES) {
+      fprintf(stderr, "list size %d out of range\n", size);
+      return FAILED;
+    }
+    list_registry reg;
+    reg.open_devices.push_back(dev);
+    std::vector<kvs_key_space_handle> hds;
+    for (int i = 0; i < size; i++) {
+      kvs_key_space_handle ks = g_table.alloc();
+      ks->dev = dev;
+      hds.push_back(ks);
+      reg.list_open_ks.push_back(ks);
+    }
+
+    double list_ns = _run_validation(cfg.threads, cfg.validations, hds, &reg);
+    double table_ns = _run_validation(cfg.threads, cfg.validations, hds, NULL);
+    printf("  %-10d %14.2f %14.2f %8.1fx\n", size, list_ns, table_ns, list_ns / table_ns);
+
+    for (auto ks : hds) {
+      g_table.close(ks);
+      g_table.free(ks);
+    }
+  }
+  delete dev;
+  return SUCCESS;
+}
+
+static bool _parse_list(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ","))
+    out->push_back(atoi(tok));
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  stress_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 4;
+  cfg.seconds = 5;
+  cfg.qdepth = 16;
+  cfg.close_period_ms = 5;
+  cfg.device_period = 20;
+  cfg.validations = 10000000;
+  cfg.list_sizes = {1, 16, 256};
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:s:q:c:D:n:l:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 's':
+      cfg.seconds = atoi(optarg);
+      break;
+    case 'q':
+      cfg.qdepth = atoi(optarg);
+      break;
+    case 'c':
+      cfg.close_period_ms = atoi(optarg);
+      break;
+    case 'D':
+      cfg.device_period = atoi(optarg);
+      break;
+    case 'n':
+      cfg.validations = strtoull(optarg, NULL, 10);
+      break;
+    case 'l':
+      if (!_parse_list(optarg, &cfg.list_sizes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.threads <= 0 || cfg.qdepth <= 0 || cfg.close_period_ms < 0) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  int ret = SUCCESS;
+  if (cfg.seconds > 0)
+    ret |= _stress(cfg);
+  if (cfg.validations > 0)
+    ret |= _compare(cfg);
+  return ret;
+}
@@ -0,0 +1,386 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Hot key tracking benchmark.
+ *
+ * Threads send synchronous retrieves and stores as fast as the device takes
+ * them. A share of the requests goes to a few hot keys spread over the key
+ * range, the rest is uniform. The workload runs with hot key tracking off,
+ * with sampled tracking and with every request counted, and the throughput
+ * of each is compared with tracking off.
+ *
+ * With tracking on, the hot keys have to be the top keys by reads, writes
+ * and bytes; the benchmark fails if one of them is missing.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define HOT_KEYSPACE_NAME "hot_keys_bench"
+#define HOT_KEY_LEN 16
+
+enum hot_bench_mode { MODE_OFF = 0, MODE_SAMPLED, MODE_ALL, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "off", "sampled", "all" };
+
+struct hot_config {
+  const char *dev_path;
+  int threads;
+  uint32_t count;       // requests per thread
+  uint32_t keys;
+  uint32_t hot;         // hot keys
+  uint32_t hot_pct;     // share of requests to the hot keys
+  uint32_t read_pct;
+  uint32_t vlen;
+  uint32_t sample_rate;
+  uint32_t top_k;
+  int rounds;           // each mode runs this often, the best round counts
+  std::vector<int> modes;
+};
+
+static uint64_t _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-n count] [-k keys] [-H hot] "
+         "[-p hot_pct] [-r read_pct] [-v vlen] [-s sample_rate] [-K top_k] [-R rounds] "
+         "[-m modes]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-t      threads      :  threads (default 4)\n");
+  printf("-n      count        :  requests per thread (default 200000)\n");
+  printf("-k      keys         :  keys (default 20000)\n");
+  printf("-H      hot          :  hot keys (default 8)\n");
+  printf("-p      hot_pct      :  percentage of requests to the hot keys (default 20)\n");
+  printf("-r      read_pct     :  percentage of retrieves, the rest are stores (default 80)\n");
+  printf("-v      vlen         :  value length (default 512)\n");
+  printf("-s      sample_rate  :  sample rate of the sampled mode (default 16)\n");
+  printf("-K      top_k        :  keys kept per ranking (default 32)\n");
+  printf("-R      rounds       :  rounds per mode, the best counts (default 3)\n");
+  printf("-m      modes        :  comma separated list of off,sampled,all (default all three)\n");
+  printf("==============\n");
+}
+
+// hot keys are spread over the key range
+static uint32_t _hot_key(const hot_config &cfg, uint32_t i) {
+  return i * (cfg.keys / cfg.hot);
+}
+
+static void _make_key(char *buf, uint32_t idx) {
+  char tmp[32];
+  snprintf(tmp, sizeof(tmp), "hot%013u", idx);
+  memcpy(buf, tmp, HOT_KEY_LEN);
+}
+
+static void _worker(kvs_key_space_handle ks, const hot_config *cfg, int id,
+                    std::atomic<uint64_t> *errors) {
+  char *key = (char *)kvs_malloc(HOT_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  memset(value, 'h', cfg->vlen);
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  kvs_option_retrieve rt_opt;
+  memset(&rt_opt, 0, sizeof(rt_opt));
+  unsigned int seed = 1234 + id;
+
+  for (uint32_t i = 0; i < cfg->count; i++) {
+    uint32_t idx;
+    if ((uint32_t)rand_r(&seed) % 100 < cfg->hot_pct)
+      idx = _hot_key(*cfg, rand_r(&seed) % cfg->hot);
+    else
+      idx = rand_r(&seed) % cfg->keys;
+    _make_key(key, idx);
+    kvs_key kvskey = { key, HOT_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    kvs_result ret;
+    if ((uint32_t)rand_r(&seed) % 100 < cfg->read_pct)
+      ret = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &kvsvalue);
+    else
+      ret = kvs_store_kvp(ks, &kvskey, &kvsvalue, &st_opt);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "request failed with err 0x%x\n", ret);
+      (*errors)++;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static int _load(kvs_key_space_handle ks, const hot_config &cfg) {
+  char *key = (char *)kvs_malloc(HOT_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg.vlen, 4096);
+  memset(value, 'h', cfg.vlen);
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  int result = SUCCESS;
+  for (uint32_t i = 0; i < cfg.keys; i++) {
+    _make_key(key, i);
+    kvs_key kvskey = { key, HOT_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg.vlen, 0, 0 };
+    kvs_result ret = kvs_store_kvp(ks, &kvskey, &kvsvalue, &st_opt);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      result = FAILED;
+      break;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+  return result;
+}
+
+// every hot key has to be among the first hot keys of the ranking
+static int _check_ranking(kvs_key_space_handle ks, const hot_config &cfg,
+                          kvs_hot_keys_order order, const char *name) {
+  std::vector<kvs_hot_key> top(cfg.top_k);
+  uint32_t count = cfg.top_k;
+  kvs_result ret = kvs_get_hot_keys(ks, order, top.data(), &count);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "kvs_get_hot_keys failed 0x%x\n", ret);
+    return FAILED;
+  }
+  uint32_t found = 0;
+  for (uint32_t h = 0; h < cfg.hot; h++) {
+    char key[HOT_KEY_LEN];
+    _make_key(key, _hot_key(cfg, h));
+    for (uint32_t i = 0; i < count && i < cfg.hot; i++) {
+      if (top[i].key_len == HOT_KEY_LEN && memcmp(top[i].key, key, HOT_KEY_LEN) == 0) {
+        found++;
+        break;
+      }
+    }
+  }
+
+  const uint64_t total = (uint64_t)cfg.threads * cfg.count;
+  const double share = cfg.hot_pct / 100.0 / cfg.hot +
+                       (100 - cfg.hot_pct) / 100.0 / cfg.keys;
+  const double pct = order == KVS_HOT_KEYS_READS ? cfg.read_pct : 100 - cfg.read_pct;
+  uint64_t expected = (uint64_t)(total * share * pct / 100);
+  uint64_t first = 0;
+  if (order == KVS_HOT_KEYS_READS) {
+    first = count ? top[0].reads : 0;
+  } else if (order == KVS_HOT_KEYS_WRITES) {
+    first = count ? top[0].writes : 0;
+  } else {
+    first = count ? top[0].bytes : 0;
+    expected = (uint64_t)(total * share) * cfg.vlen;
+  }
+  printf("  %-7s %u of %u hot keys ranked first, top estimate %lu, expected about %lu\n",
+         name, found, cfg.hot, first, expected);
+  return found == cfg.hot ? SUCCESS : FAILED;
+}
+
+static int _run_mode(kvs_key_space_handle ks, const hot_config &cfg, int mode,
+                     double *ops) {
+  double best = 0;
+  int result = SUCCESS;
+  for (int round = 0; round < cfg.rounds; round++) {
+    kvs_option_hot_keys opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.top_k = cfg.top_k;
+    opt.sample_rate = mode == MODE_SAMPLED ? cfg.sample_rate : 1;
+    kvs_result ret = kvs_set_hot_keys(ks, mode == MODE_OFF ? NULL : &opt);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "kvs_set_hot_keys failed 0x%x\n", ret);
+      return FAILED;
+    }
+
+    std::atomic<uint64_t> errors(0);
+    const uint64_t start = _now_us();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < cfg.threads; i++)
+      threads.push_back(std::thread(_worker, ks, &cfg, i, &errors));
+    for (auto &t : threads) t.join();
+    const double secs = (_now_us() - start) / 1e6;
+    if (errors) result = FAILED;
+    best = std::max(best, (double)cfg.threads * cfg.count / secs);
+  }
+  *ops = best;
+  return result;
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+    int m;
+    for (m = 0; m < MODE_MAX; m++) {
+      if (strcmp(tok, mode_names[m]) == 0) break;
+    }
+    if (m == MODE_MAX) {
+      free(copy);
+      return false;
+    }
+    out->push_back(m);
+  }
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  hot_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 4;
+  cfg.count = 200000;
+  cfg.keys = 20000;
+  cfg.hot = 8;
+  cfg.hot_pct = 20;
+  cfg.read_pct = 80;
+  cfg.vlen = 512;
+  cfg.sample_rate = 16;
+  cfg.top_k = 32;
+  cfg.rounds = 3;
+  cfg.modes = { MODE_OFF, MODE_SAMPLED, MODE_ALL };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:n:k:H:p:r:v:s:K:R:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.count = atoi(optarg);
+      break;
+    case 'k':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'H':
+      cfg.hot = atoi(optarg);
+      break;
+    case 'p':
+      cfg.hot_pct = atoi(optarg);
+      break;
+    case 'r':
+      cfg.read_pct = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 's':
+      cfg.sample_rate = atoi(optarg);
+      break;
+    case 'K':
+      cfg.top_k = atoi(optarg);
+      break;
+    case 'R':
+      cfg.rounds = atoi(optarg);
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.threads <= 0 || cfg.count == 0 || cfg.hot == 0 || cfg.keys < cfg.hot ||
+      cfg.hot_pct > 100 || cfg.read_pct > 100 || cfg.vlen < 64 || cfg.vlen % 4 ||
+      cfg.top_k < cfg.hot || cfg.top_k > 256 || cfg.rounds <= 0) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)HOT_KEYSPACE_NAME;
+  ks_name.name_len = strlen(HOT_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_key_space_handle ks;
+  ret = kvs_open_key_space(dev, (char *)HOT_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  int result = _load(ks, cfg);
+  if (result == SUCCESS) {
+    printf("%d threads x %u requests, %u%% retrieves, %u keys, %u hot keys get %u%% "
+           "of the requests, %u byte values\n", cfg.threads, cfg.count, cfg.read_pct,
+           cfg.keys, cfg.hot, cfg.hot_pct, cfg.vlen);
+    double base = 0;
+    for (int mode : cfg.modes) {
+      double ops = 0;
+      result |= _run_mode(ks, cfg, mode, &ops);
+      if (mode == MODE_OFF) base = ops;
+      if (mode == MODE_SAMPLED)
+        printf("%-8s (1 of %u) %10.0f ops/s", mode_names[mode], cfg.sample_rate, ops);
+      else
+        printf("%-17s %10.0f ops/s", mode_names[mode], ops);
+      if (base > 0 && mode != MODE_OFF)
+        printf(", %+.1f%% against off", (ops / base - 1) * 100);
+      printf("\n");
+      if (mode == MODE_OFF) continue;
+      //the counts of the last round
+      result |= _check_ranking(ks, cfg, KVS_HOT_KEYS_READS, "reads");
+      result |= _check_ranking(ks, cfg, KVS_HOT_KEYS_WRITES, "writes");
+      result |= _check_ranking(ks, cfg, KVS_HOT_KEYS_BYTES, "bytes");
+    }
+  }
+
+  kvs_set_hot_keys(ks, NULL);
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+  return result;
+}
@@ -0,0 +1,427 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Batched submission benchmark for the kernel driver adapter.
+ *
+ * KADI runs against a mock of the driver's ioctl interface instead of a
+ * device: every submission system call costs a fixed time plus a time per
+ * command, and commands complete as soon as they are submitted, so the
+ * submission path is the bottleneck. Threads keep a window of asynchronous
+ * stores in flight, once with one NVME_IOCTL_AIO_CMD per command and once
+ * per batch size with NVME_IOCTL_AIO_MULTI_CMD, and the throughput, system
+ * calls per command and completion latency of each are compared.
+ *
+ * The mock can refuse every n-th command; those have to come back failed,
+ * through the return code or the post process function, and everything
+ * else has to complete exactly once.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <getopt.h>
+#include <time.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "kadi.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+struct batch_config {
+  int threads;
+  uint32_t count;       // stores per thread
+  uint32_t window;      // stores in flight per thread
+  uint32_t delay_us;    // latency trigger
+  uint32_t syscall_ns;  // mock cost of a system call
+  uint32_t cmd_ns;      // mock cost of a command in the driver
+  uint32_t fail_every;  // mock refuses every n-th command, 0 for none
+  std::vector<int> batches;
+};
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void _spin_ns(uint64_t ns) {
+  uint64_t end = _now_ns() + ns;
+  while (_now_ns() < end) ;
+}
+
+// the ioctl interface of the kernel driver, see linux_nvme_ioctl.h
+namespace mock {
+
+static batch_config *cfg;
+static std::mutex lock;
+static std::deque<struct nvme_aioevent> events;
+static int efd = -1;
+static uint32_t ctxid;
+static std::atomic<uint64_t> syscalls(0);
+static std::atomic<uint64_t> cmds(0);
+static std::atomic<uint64_t> refused(0);
+
+static void reset() {
+  syscalls = 0;
+  cmds = 0;
+  refused = 0;
+}
+
+// false if the command is refused
+static bool accept(const struct nvme_passthru_kv_cmd *cmd) {
+  uint64_t n = ++cmds;
+  if (cfg->fail_every && n % cfg->fail_every == 0) {
+    refused++;
+    return false;
+  }
+  struct nvme_aioevent ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.reqid = cmd->reqid;
+  ev.ctxid = cmd->ctxid;
+  ev.result = cmd->opcode == nvme_cmd_kv_retrieve ? cmd->data_length : 0;
+  ev.status = 0;
+  std::lock_guard<std::mutex> guard(lock);
+  events.push_back(ev);
+  return true;
+}
+
+static void notify(uint64_t n) {
+  if (n && write(efd, &n, sizeof(n)) != sizeof(n)) {
+    fprintf(stderr, "mock: eventfd write failed\n");
+  }
+}
+
+static int sys_open(const char *path, int flags) {
+  return ::open("/dev/null", flags);
+}
+
+static int sys_close(int fd) {
+  return ::close(fd);
+}
+
+static int sys_ioctl(int fd, unsigned long request, void *arg) {
+  switch (request) {
+  case NVME_IOCTL_ID:
+    return 1;
+  case NVME_IOCTL_SET_AIOCTX: {
+    struct nvme_aioctx *ctx = (struct nvme_aioctx *)arg;
+    efd = ctx->eventfd;
+    ctxid = ctx->ctxid;
+    return 0;
+  }
+  case NVME_IOCTL_DEL_AIOCTX: {
+    std::lock_guard<std::mutex> guard(lock);
+    events.clear();
+    efd = -1;
+    return 0;
+  }
+  case NVME_IOCTL_AIO_CMD: {
+    syscalls++;
+    _spin_ns(cfg->syscall_ns + cfg->cmd_ns);
+    if (!accept((struct nvme_passthru_kv_cmd *)arg)) {
+      errno = EIO;
+      return -1;
+    }
+    notify(1);
+    return 0;
+  }
+  case NVME_IOCTL_AIO_MULTI_CMD: {
+    struct nvme_passthru_kv_multi_cmd *m = (struct nvme_passthru_kv_multi_cmd *)arg;
+    struct nvme_passthru_kv_cmd *c = (struct nvme_passthru_kv_cmd *)m->cmds;
+    uint32_t i;
+    if (m->nr > NVME_AIO_MULTI_MAX) {
+      errno = EINVAL;
+      return -1;
+    }
+    if (m->nr == 0) return 0;
+    syscalls++;
+    _spin_ns(cfg->syscall_ns + (uint64_t)cfg->cmd_ns * m->nr);
+    for (i = 0; i < m->nr; i++) {
+      if (!accept(&c[i])) break;
+    }
+    m->nr_submitted = i;
+    notify(i);
+    if (i < m->nr) {
+      errno = EIO;
+      return -1;
+    }
+    return 0;
+  }
+  case NVME_IOCTL_GET_AIOEVENT: {
+    struct nvme_aioevents *evs = (struct nvme_aioevents *)arg;
+    uint16_t n = 0;
+    std::lock_guard<std::mutex> guard(lock);
+    while (n < evs->nr && n < MAX_AIO_EVENTS && !events.empty()) {
+      evs->events[n++] = events.front();
+      events.pop_front();
+    }
+    evs->nr = n;
+    return 0;
+  }
+  case NVME_IOCTL_ADMIN_CMD:
+  case NVME_IOCTL_IO_KV_CMD:
+    return 0;
+  }
+  errno = ENOTTY;
+  return -1;
+}
+
+static const kadi_sys_ops ops = { sys_open, sys_ioctl, sys_close };
+
+} // namespace mock
+
+struct thread_state {
+  std::atomic<uint32_t> inflight;
+  std::atomic<uint64_t> completed;
+  std::atomic<uint64_t> failed;
+  std::atomic<uint64_t> lat_ns;
+  std::vector<uint64_t> start_ns;   // by store
+  std::vector<std::atomic<uint8_t> > calls;   // post process calls by store
+  thread_state(uint32_t count): inflight(0), completed(0), failed(0), lat_ns(0),
+    start_ns(count), calls(count) {}
+};
+
+struct store_ref {
+  thread_state *ts;
+  uint32_t idx;
+};
+
+static void complete(kv_io_context *ctx) {
+  store_ref *ref = (store_ref *)ctx->private_data;
+  thread_state *ts = ref->ts;
+  ts->calls[ref->idx]++;
+  if (ctx->retcode == 0) {
+    ts->lat_ns += _now_ns() - ts->start_ns[ref->idx];
+    ts->completed++;
+  } else {
+    ts->failed++;
+  }
+  ts->inflight--;
+}
+
+static void _submitter(KADI *dev, batch_config *cfg, thread_state *ts, int tid) {
+  char keybuf[16];
+  char valbuf[512];
+  kv_key key = { keybuf, sizeof(keybuf) };
+  kv_value value;
+  std::vector<store_ref> refs(cfg->count);
+
+  memset(keybuf, 'a' + tid, sizeof(keybuf));
+  memset(valbuf, 'v', sizeof(valbuf));
+  memset(&value, 0, sizeof(value));
+  value.value = valbuf;
+  value.length = sizeof(valbuf);
+
+  for (uint32_t i = 0; i < cfg->count; i++) {
+    while (ts->inflight >= cfg->window) std::this_thread::yield();
+    refs[i].ts = ts;
+    refs[i].idx = i;
+    kv_postprocess_function cb = { complete, &refs[i], 0 };
+    ts->start_ns[i] = _now_ns();
+    ts->inflight++;
+    if (dev->kv_store(0, &key, &value, STORE_OPTION_NOTHING, &cb) != 0) {
+      ts->calls[i]++;
+      ts->failed++;
+      ts->inflight--;
+    }
+  }
+  // the last partial batch goes out with the latency trigger
+  while (ts->inflight > 0) std::this_thread::yield();
+}
+
+static int run(batch_config &cfg, int batch, double *base_ops) {
+  KADI dev(cfg.threads * cfg.window);
+  std::string path("mock");
+  std::vector<thread_state *> states;
+  std::vector<std::thread> threads;
+  uint64_t completed = 0, failed = 0, lat_ns = 0;
+  int ret = SUCCESS;
+
+  dev.sys = &mock::ops;
+  dev.set_batching(batch, cfg.delay_us);
+  if (dev.open(path) != 0) {
+    fprintf(stderr, "can't open the mock device\n");
+    return FAILED;
+  }
+  dev.start_cbthread();
+  mock::reset();
+
+  for (int t = 0; t < cfg.threads; t++) states.push_back(new thread_state(cfg.count));
+  uint64_t start = _now_ns();
+  for (int t = 0; t < cfg.threads; t++)
+    threads.push_back(std::thread(_submitter, &dev, &cfg, states[t], t));
+  for (auto &th : threads) th.join();
+  double sec = (_now_ns() - start) / 1e9;
+
+  for (thread_state *ts : states) {
+    completed += ts->completed;
+    failed += ts->failed;
+    lat_ns += ts->lat_ns;
+    for (uint32_t i = 0; i < cfg.count; i++) {
+      if (ts->calls[i] != 1) {
+        fprintf(stderr, "batch %d: a store completed %u times\n", batch, (unsigned)ts->calls[i]);
+        ret = FAILED;
+        break;
+      }
+    }
+    delete ts;
+  }
+
+  uint64_t total = (uint64_t)cfg.threads * cfg.count;
+  double ops = completed / sec;
+  if (batch <= 1) *base_ops = ops;
+  char ratio[32] = "-";
+  if (*base_ops > 0) snprintf(ratio, sizeof(ratio), "%.2fx", ops / *base_ops);
+  printf("%-8d %12.0f %10s %12lu %10.2f %10.1f %8lu\n", batch, ops, ratio,
+         (unsigned long)mock::syscalls.load(),
+         (double)mock::cmds.load() / (mock::syscalls.load() ? mock::syscalls.load() : 1),
+         completed ? lat_ns / 1000.0 / completed : 0, (unsigned long)failed);
+
+  if (completed + failed != total) {
+    fprintf(stderr, "batch %d: %lu of %lu stores did not complete\n", batch,
+            (unsigned long)(total - completed - failed), (unsigned long)total);
+    ret = FAILED;
+  }
+  if (failed < mock::refused) {
+    fprintf(stderr, "batch %d: %lu stores refused but only %lu failed\n", batch,
+            (unsigned long)mock::refused.load(), (unsigned long)failed);
+    ret = FAILED;
+  }
+  if (cfg.fail_every == 0 && failed) {
+    fprintf(stderr, "batch %d: %lu stores failed\n", batch, (unsigned long)failed);
+    ret = FAILED;
+  }
+  return ret;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-t threads] [-n count] [-q window] [-b batches] [-u delay_us] "
+         "[-s syscall_ns] [-c cmd_ns] [-e fail_every]\n", program);
+  printf("-t      threads      :  submitting threads (default 4)\n");
+  printf("-n      count        :  stores per thread (default 100000)\n");
+  printf("-q      window       :  stores in flight per thread (default 64)\n");
+  printf("-b      batches      :  comma separated commands per system call, 1 for one ioctl each\n");
+  printf("                        (default 1,4,16,64)\n");
+  printf("-u      delay_us     :  longest wait of a command for its batch (default 50)\n");
+  printf("-s      syscall_ns   :  mock cost of a system call (default 2000)\n");
+  printf("-c      cmd_ns       :  mock cost of a command in the driver (default 200)\n");
+  printf("-e      fail_every   :  the mock refuses every n-th command (default 0, none)\n");
+  printf("==============\n");
+}
+
+int main(int argc, char *argv[]) {
+  batch_config cfg;
+  cfg.threads = 4;
+  cfg.count = 100000;
+  cfg.window = 64;
+  cfg.delay_us = 50;
+  cfg.syscall_ns = 2000;
+  cfg.cmd_ns = 200;
+  cfg.fail_every = 0;
+  const char *batches = "1,4,16,64";
+  int c;
+
+  while ((c = getopt(argc, argv, "t:n:q:b:u:s:c:e:h")) != -1) {
+    switch (c) {
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.count = strtoul(optarg, NULL, 10);
+      break;
+    case 'q':
+      cfg.window = strtoul(optarg, NULL, 10);
+      break;
+    case 'b':
+      batches = optarg;
+      break;
+    case 'u':
+      cfg.delay_us = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      cfg.syscall_ns = strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      cfg.cmd_ns = strtoul(optarg, NULL, 10);
+      break;
+    case 'e':
+      cfg.fail_every = strtoul(optarg, NULL, 10);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+
+  std::string list(batches);
+  size_t pos = 0;
+  while (pos <= list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) end = list.size();
+    if (end > pos) cfg.batches.push_back(atoi(list.substr(pos, end - pos).c_str()));
+    pos = end + 1;
+  }
+  if (cfg.threads <= 0 || cfg.count == 0 || cfg.window == 0 || cfg.batches.empty()) {
+    usage(argv[0]);
+    return FAILED;
+  }
+  mock::cfg = &cfg;
+
+  printf("threads %d, stores %u per thread, window %u, delay %u us, syscall %u ns, command %u ns\n",
+         cfg.threads, cfg.count, cfg.window, cfg.delay_us, cfg.syscall_ns, cfg.cmd_ns);
+  printf("%-8s %12s %10s %12s %10s %10s %8s\n", "batch", "ops/s", "vs 1", "syscalls",
+         "cmds/call", "lat(us)", "failed");
+
+  double base_ops = 0;
+  int ret = SUCCESS;
+  for (int batch : cfg.batches) {
+    if (run(cfg, batch, &base_ops) != SUCCESS) ret = FAILED;
+  }
+  printf("%s\n", ret == SUCCESS ? "PASSED" : "FAILED");
+  return ret;
+}
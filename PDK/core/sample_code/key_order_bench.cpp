@@ -0,0 +1,385 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Emulator key order test and benchmark.
+ *
+ * Checks that the comparator of the emulator index (kvadi::CmpEmulKey)
+ * orders keys byte by byte as unsigned values with a prefix first, both on
+ * pairs of generated keys and through a group iterator of a Key Space, and
+ * then measures map lookups with the previous comparator (leading 4 bytes,
+ * then length, then content) and with the byte order comparator.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "kvs_api.h"
+#include "kv_key_order.hpp"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define ORDER_KEYSPACE_NAME "key_order_bench"
+#define ORDER_GROUP "ko"
+
+using kvadi::CmpEmulKey;
+
+// the emulator index order before byte order was used
+struct CmpLegacy {
+  bool operator()(const kv_key *a, const kv_key *b) const {
+    const char *strA = (const char *)a->key;
+    const char *strB = (const char *)b->key;
+    uint32_t intA = 0;
+    memcpy(&intA, strA, 4);
+    intA = be32toh(intA);
+    uint32_t intB = 0;
+    memcpy(&intB, strB, 4);
+    intB = be32toh(intB);
+    if (intA != intB) return intA < intB;
+    if (a->length != b->length) return a->length < b->length;
+    return memcmp(strA + 4, strB + 4, b->length - 4) < 0;
+  }
+};
+
+struct order_config {
+  const char *dev_path;
+  uint32_t pairs_keys;
+  uint32_t iter_keys;
+  uint32_t lookup_keys;
+  uint32_t lookup_ms;
+  std::vector<int> klens;
+};
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-p pair_keys] [-i iter_keys] [-n lookup_keys] "
+         "[-k klens] [-m lookup_ms]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-p      pair_keys    :  keys compared pairwise with the byte order (default 600)\n");
+  printf("-i      iter_keys    :  keys stored and iterated in a Key Space (default 5000)\n");
+  printf("-n      lookup_keys  :  keys in each map for the lookup benchmark (default 100000)\n");
+  printf("-k      klens        :  comma separated key lengths of the lookup benchmark\n"
+         "                       (default 8,16,32,64)\n");
+  printf("-m      lookup_ms    :  run time of each lookup measurement in ms (default 500)\n");
+  printf("==============\n");
+}
+
+static int _parse_int_list(const char *arg, std::vector<int> &out) {
+  out.clear();
+  std::string s(arg);
+  size_t pos = 0;
+  while (pos <= s.size()) {
+    size_t next = s.find(',', pos);
+    if (next == std::string::npos) next = s.size();
+    std::string item = s.substr(pos, next - pos);
+    char *end = NULL;
+    long v = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || v <= 0) {
+      fprintf(stderr, "invalid list entry '%s'\n", item.c_str());
+      return FAILED;
+    }
+    out.push_back((int)v);
+    pos = next + 1;
+  }
+  return SUCCESS;
+}
+
+// keys close to each other: bytes from a small set that includes 0x00, 0x7f,
+// 0x80 and 0xff, and most keys derived from an earlier one by changing its
+// length or a single byte
+static std::vector<std::string> _make_keys(std::mt19937 &rng, uint32_t count) {
+  static const uint8_t bytes[] = { 0x00, 0x01, 0x41, 0x7f, 0x80, 0xfe, 0xff };
+  static const int lens[] = { 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 64 };
+  std::vector<std::string> keys;
+  while (keys.size() < count) {
+    std::string k;
+    int len = lens[rng() % (sizeof(lens) / sizeof(lens[0]))];
+    if (!keys.empty() && rng() % 4 != 0) {
+      k = keys[rng() % keys.size()];
+      if (rng() % 2) k.resize(len, (char)bytes[rng() % sizeof(bytes)]);
+      else k[rng() % k.size()] = (char)bytes[rng() % sizeof(bytes)];
+    } else {
+      for (int i = 0; i < len; i++) k.push_back((char)bytes[rng() % sizeof(bytes)]);
+    }
+    keys.push_back(k);
+  }
+  return keys;
+}
+
+// std::string compares with memcmp, which is the byte order of the device
+static int _check_pairs(uint32_t count) {
+  std::mt19937 rng(42);
+  std::vector<std::string> keys = _make_keys(rng, count);
+  CmpEmulKey less;
+  uint64_t pairs = 0, mismatches = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    kv_key a = { (void *)keys[i].data(), (kv_key_t)keys[i].size() };
+    for (size_t j = 0; j < keys.size(); j++) {
+      kv_key b = { (void *)keys[j].data(), (kv_key_t)keys[j].size() };
+      if (less(&a, &b) != (keys[i] < keys[j])) {
+        if (mismatches++ < 5)
+          fprintf(stderr, "wrong order of keys %zu and %zu (lengths %zu, %zu)\n", i, j,
+                  keys[i].size(), keys[j].size());
+      }
+      pairs++;
+    }
+  }
+  printf("pairwise order: %lu pairs, %lu mismatches\n", pairs, mismatches);
+  return mismatches ? FAILED : SUCCESS;
+}
+
+// stores keys inside and outside a group, the group iterator has to return
+// exactly the keys of the group in byte order
+static int _check_iterator(kvs_key_space_handle ks, uint32_t count) {
+  std::mt19937 rng(7);
+  std::vector<std::string> keys = _make_keys(rng, count);
+  std::set<std::string> group;
+  char value[8] = "value";
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::string k = (i % 4 == 0 ? "kp" : ORDER_GROUP) + keys[i];
+    if (k.size() > KVS_MAX_KEY_LENGTH) k.resize(KVS_MAX_KEY_LENGTH);
+    kvs_key key = { (void *)k.data(), (uint16_t)k.size() };
+    kvs_value val = { value, sizeof(value), 0, 0 };
+    kvs_option_store opt = { KVS_STORE_POST, NULL };
+    kvs_result ret = kvs_store_kvp(ks, &key, &val, &opt);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with error 0x%x\n", ret);
+      return FAILED;
+    }
+    if (i % 4 != 0) group.insert(k);
+  }
+
+  kvs_option_iterator iter_op = { KVS_ITERATOR_KEY };
+  kvs_key_group_filter iter_fltr;
+  memset(&iter_fltr, 0, sizeof(iter_fltr));
+  iter_fltr.bitmask[0] = iter_fltr.bitmask[1] = 0xff;
+  iter_fltr.bit_pattern[0] = ORDER_GROUP[0];
+  iter_fltr.bit_pattern[1] = ORDER_GROUP[1];
+  kvs_iterator_handle iter_hd;
+  kvs_result ret = kvs_create_iterator(ks, &iter_op, &iter_fltr, &iter_hd);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "open iterator failed with error 0x%x\n", ret);
+    return FAILED;
+  }
+
+  kvs_iterator_list iter_list;
+  iter_list.it_list = (uint8_t *)kvs_malloc(KVS_ITERATOR_BUFFER_SIZE, 4096);
+  std::vector<std::string> seen;
+  do {
+    iter_list.size = KVS_ITERATOR_BUFFER_SIZE;
+    iter_list.num_entries = 0;
+    iter_list.end = false;
+    ret = kvs_iterate_next(ks, iter_hd, &iter_list);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "iterator next failed with error 0x%x\n", ret);
+      break;
+    }
+    // key iterator output: [u32 key_len][key]
+    uint8_t *it_buffer = iter_list.it_list;
+    for (uint32_t i = 0; i < iter_list.num_entries; i++) {
+      uint32_t key_size;
+      memcpy(&key_size, it_buffer, sizeof(key_size));
+      it_buffer += sizeof(uint32_t);
+      seen.push_back(std::string((const char *)it_buffer, key_size));
+      it_buffer += key_size;
+    }
+  } while (!iter_list.end);
+  kvs_delete_iterator(ks, iter_hd);
+  kvs_free(iter_list.it_list);
+  if (ret != KVS_SUCCESS) return FAILED;
+
+  uint64_t out_of_order = 0;
+  for (size_t i = 1; i < seen.size(); i++)
+    if (!(seen[i - 1] < seen[i])) out_of_order++;
+  std::set<std::string> seen_set(seen.begin(), seen.end());
+  bool same = seen_set == group && seen.size() == group.size();
+  printf("group iterator: %zu of %zu keys returned, %lu out of order, %s\n",
+         seen.size(), group.size(), out_of_order, same ? "same keys" : "different keys");
+  return (same && out_of_order == 0) ? SUCCESS : FAILED;
+}
+
+// keys of one group that only differ in a decimal sequence number at the
+// end, like the keys of the sample programs, looked up in random order
+template <typename Cmp>
+static double _run_lookup(const std::vector<std::string> &keys,
+                          const std::vector<uint32_t> &order, uint32_t ms,
+                          uint64_t *found) {
+  std::map<kv_key *, uint32_t, Cmp> index;
+  std::vector<kv_key> kv(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    kv[i].key = (void *)keys[i].data();
+    kv[i].length = keys[i].size();
+    index.emplace(&kv[i], i);
+  }
+  uint64_t ops = 0, hits = 0;
+  const uint64_t start = _now_ns(), deadline = start + (uint64_t)ms * 1000000;
+  uint64_t now = start;
+  while (now < deadline) {
+    for (int i = 0; i < 1024; i++) {
+      auto it = index.find(&kv[order[ops % order.size()]]);
+      if (it != index.end()) hits++;
+      ops++;
+    }
+    now = _now_ns();
+  }
+  *found += hits == ops ? 0 : ops - hits;
+  return (double)(now - start) / ops;
+}
+
+static int _run_lookups(const order_config &cfg) {
+  printf("\n%u keys per map, random lookups\n", cfg.lookup_keys);
+  printf("%-6s %12s %12s %9s\n", "klen", "legacy ns", "byte ns", "speedup");
+  uint64_t missing = 0;
+  std::mt19937 rng(1);
+  for (int klen : cfg.klens) {
+    // the group followed by the zero padded sequence number, short keys
+    // keep its last digits
+    std::vector<std::string> keys(cfg.lookup_keys);
+    for (uint32_t i = 0; i < cfg.lookup_keys; i++) {
+      std::string &k = keys[i];
+      k.assign(klen, '0');
+      memcpy(&k[0], ORDER_GROUP, 2);
+      uint32_t seq = i;
+      for (int pos = klen - 1; pos >= 2 && seq; pos--, seq /= 10) k[pos] = '0' + seq % 10;
+    }
+    std::vector<uint32_t> order(cfg.lookup_keys);
+    for (uint32_t i = 0; i < cfg.lookup_keys; i++) order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    double legacy = _run_lookup<CmpLegacy>(keys, order, cfg.lookup_ms, &missing);
+    double bytes = _run_lookup<CmpEmulKey>(keys, order, cfg.lookup_ms, &missing);
+    printf("%-6d %12.1f %12.1f %8.2fx\n", klen, legacy, bytes, legacy / bytes);
+  }
+  if (missing) fprintf(stderr, "%lu lookups did not find their key\n", missing);
+  return missing ? FAILED : SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+  order_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.pairs_keys = 600;
+  cfg.iter_keys = 5000;
+  cfg.lookup_keys = 100000;
+  cfg.lookup_ms = 500;
+  cfg.klens = { 8, 16, 32, 64 };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:p:i:n:k:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 'p':
+      cfg.pairs_keys = atoi(optarg);
+      break;
+    case 'i':
+      cfg.iter_keys = atoi(optarg);
+      break;
+    case 'n':
+      cfg.lookup_keys = atoi(optarg);
+      break;
+    case 'k':
+      if (_parse_int_list(optarg, cfg.klens) != SUCCESS) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'm':
+      cfg.lookup_ms = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.pairs_keys == 0 || cfg.iter_keys == 0 || cfg.lookup_keys == 0 ||
+      cfg.lookup_ms == 0) {
+    usage(argv[0]);
+    return FAILED;
+  }
+  for (int klen : cfg.klens) {
+    if (klen < KVS_MIN_KEY_LENGTH || klen > KVS_MAX_KEY_LENGTH) {
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+
+  int result = _check_pairs(cfg.pairs_keys);
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)ORDER_KEYSPACE_NAME;
+  ks_name.name_len = strlen(ORDER_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_key_space_handle ks;
+  ret = kvs_open_key_space(dev, (char *)ORDER_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+  if (_check_iterator(ks, cfg.iter_keys) != SUCCESS) result = FAILED;
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+
+  if (_run_lookups(cfg) != SUCCESS) result = FAILED;
+  return result;
+}
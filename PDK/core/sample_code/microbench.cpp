@@ -0,0 +1,887 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Per-layer microbenchmark for the emulator build.
+ *
+ * The same put/get workload is driven through each layer of the stack:
+ *
+ *   map     kvadi::kv_emulator called directly (no queue, no ADI)
+ *   noop    kvs_adi + emul_ioqueue with the namespace bypassed
+ *   adi     kvs_adi + emul_ioqueue + kv_emulator
+ *   driver  KvEmulator adapter on top of adi
+ *   api     cfrontend (kvs_store_kvp etc.) on top of driver
+ *
+ * Every run starts on a freshly initialized device. The summary subtracts
+ * adjacent layers to attribute the per-op cost to each of them, and results
+ * can be written to or compared against a baseline file.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <map>
+
+#include <kvs_api.h>
+#include "kvemul.hpp"
+#include "kv_emulator.hpp"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define MB_KEYSPACE_ID USER_DATA_KEYSPACE_START_ID
+#define MB_KEYSPACE_NAME "microbench"
+#define MB_BASELINE_HEADER "# kvs_microbench baseline v1"
+
+enum mb_layer { LAYER_MAP = 0, LAYER_NOOP, LAYER_ADI, LAYER_DRIVER, LAYER_API, LAYER_MAX };
+enum mb_op { OP_PUT = 0, OP_GET };
+
+static const char *layer_names[LAYER_MAX] = { "map", "noop", "adi", "driver", "api" };
+static const char *op_names[] = { "put", "get" };
+
+struct mb_config {
+  const char *dev_path;
+  const char *config_file;
+  std::vector<int> layers;
+  std::vector<int> modes;     // 0: sync, 1: async
+  std::vector<int> klens;
+  std::vector<int> vlens;
+  std::vector<int> threads;
+  int qdepth;
+  uint64_t count;
+  int repeat;
+  double threshold;
+};
+
+struct mb_result {
+  int layer;
+  int async;
+  int op;
+  int klen;
+  int vlen;
+  int threads;
+  int qdepth;
+  double ns_per_op;
+  double kops;
+  uint64_t errors;
+};
+
+struct mb_thread;
+
+// one in-flight request; the key and value structs are laid out like the
+// ADI kv_key/kv_value, so the same slot can be handed to every layer
+struct mb_slot {
+  kvs_key key;
+  kvs_value value;
+  char *valbuf;
+  mb_thread *owner;
+};
+
+struct mb_thread {
+  int id;
+  int klen;
+  int vlen;
+  int qdepth;
+  uint64_t count;
+  char *keys;
+  char *putbuf;
+  mb_slot *slots;
+  std::vector<mb_slot *> free_slots;
+  std::mutex lock;
+  std::condition_variable cond;
+  std::atomic<uint64_t> errors;
+  uint64_t elapsed_ns;
+};
+
+// handles of the layer under test
+struct mb_target {
+  int layer;
+  kvadi::kv_emulator *map;
+  kv_device_handle devH;
+  kv_namespace_handle nsH;
+  kv_queue_handle sqH;
+  kv_queue_handle cqH;
+  kv_interrupt_handler int_handler;
+  kv_device_priv *priv;
+  KvEmulator *driver;
+  _kvs_key_space_handle driver_ks;
+  kvs_device_handle api_dev;
+  kvs_key_space_handle api_ks;
+};
+
+struct mb_run {
+  mb_target *target;
+  mb_thread *thread;
+  int op;
+  int async;
+  pthread_barrier_t *barrier;
+};
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-f emul_config] [-l layers] [-m modes] [-k klens] [-v vlens] [-t threads] "
+         "[-q queue_depth] [-n num_ios] [-r repeat] [-o baseline_out] [-c baseline_in] [-T threshold]\n", program);
+  printf("-d      device_path  :  emulator device path (default /dev/kvemul)\n");
+  printf("-f      emul_config  :  emulator configuration file (default ../kvssd_emul.conf)\n");
+  printf("-l      layers       :  comma separated list of map,noop,adi,driver,api (default all)\n");
+  printf("-m      modes        :  comma separated list of sync,async (default sync,async)\n");
+  printf("-k      klens        :  comma separated key lengths (default 16)\n");
+  printf("-v      vlens        :  comma separated value lengths (default 4096)\n");
+  printf("-t      threads      :  comma separated thread counts (default 1)\n");
+  printf("-q      queue_depth  :  in-flight requests per thread for async runs (default 64)\n");
+  printf("-n      num_ios      :  number of puts and gets per thread (default 100000)\n");
+  printf("-r      repeat       :  runs per configuration, the fastest one is reported (default 3)\n");
+  printf("-o      baseline_out :  write the results to a baseline file\n");
+  printf("-c      baseline_in  :  compare the results against a baseline file\n");
+  printf("-T      threshold    :  slowdown in percent reported as a regression (default 10)\n");
+  printf("==============\n");
+}
+
+static int _parse_int_list(const char *arg, std::vector<int> &out) {
+  out.clear();
+  std::string s(arg);
+  size_t pos = 0;
+  while (pos <= s.size()) {
+    size_t next = s.find(',', pos);
+    if (next == std::string::npos) next = s.size();
+    std::string item = s.substr(pos, next - pos);
+    char *end = NULL;
+    long v = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || v <= 0) {
+      fprintf(stderr, "invalid list entry '%s'\n", item.c_str());
+      return FAILED;
+    }
+    out.push_back((int)v);
+    pos = next + 1;
+  }
+  return SUCCESS;
+}
+
+static int _parse_name_list(const char *arg, const char **names, int nnames,
+                            std::vector<int> &out) {
+  out.clear();
+  std::string s(arg);
+  size_t pos = 0;
+  while (pos <= s.size()) {
+    size_t next = s.find(',', pos);
+    if (next == std::string::npos) next = s.size();
+    std::string item = s.substr(pos, next - pos);
+    int found = -1;
+    for (int i = 0; i < nnames; i++) {
+      if (item == names[i]) found = i;
+    }
+    if (found < 0) {
+      fprintf(stderr, "unknown list entry '%s'\n", item.c_str());
+      return FAILED;
+    }
+    out.push_back(found);
+    pos = next + 1;
+  }
+  return SUCCESS;
+}
+
+/* keys are 2 bytes of thread id and 6 bytes of sequence number, big-endian,
+ * padded on the right to the requested length */
+static void _make_key(char *buf, int klen, int tid, uint64_t seq) {
+  memset(buf, 'k', klen);
+  buf[0] = (char)(tid >> 8);
+  buf[1] = (char)tid;
+  for (int i = 0; i < 6; i++)
+    buf[2 + i] = (char)(seq >> (8 * (5 - i)));
+}
+
+static void _put_slot(mb_slot *slot) {
+  mb_thread *t = slot->owner;
+  std::unique_lock<std::mutex> lock(t->lock);
+  t->free_slots.push_back(slot);
+  t->cond.notify_one();
+}
+
+static mb_slot *_get_slot(mb_thread *t) {
+  std::unique_lock<std::mutex> lock(t->lock);
+  while (t->free_slots.empty())
+    t->cond.wait(lock);
+  mb_slot *slot = t->free_slots.back();
+  t->free_slots.pop_back();
+  return slot;
+}
+
+static void _drain(mb_thread *t) {
+  std::unique_lock<std::mutex> lock(t->lock);
+  while ((int)t->free_slots.size() < t->qdepth)
+    t->cond.wait(lock);
+}
+
+static void _adi_complete(kv_io_context *ctx) {
+  mb_slot *slot = (mb_slot *)ctx->private_data;
+  if (ctx->retcode != KV_SUCCESS)
+    slot->owner->errors++;
+  _put_slot(slot);
+}
+
+static void _kvs_complete(kvs_postprocess_context *ctx) {
+  mb_slot *slot = (mb_slot *)ctx->private1;
+  if (ctx->result != KVS_SUCCESS)
+    slot->owner->errors++;
+  _put_slot(slot);
+}
+
+static void _interrupt_noop(void *data, int number) {
+  (void) data;
+  (void) number;
+}
+
+/*
+ * Layer setup. The ADI layers follow the queue setup of KvEmulator::init
+ * (one completion queue in interrupt mode and one submission queue).
+ */
+static int _adi_open(const mb_config &cfg, mb_target *tg, int qsize) {
+  kv_device_init_t dev_init;
+  memset(&dev_init, 0, sizeof(dev_init));
+  dev_init.devpath = cfg.dev_path;
+  dev_init.configfile = cfg.config_file;
+  dev_init.need_persistency = FALSE;
+  dev_init.is_polling = FALSE;
+
+  kv_result ret = kv_initialize_device(&dev_init, &tg->devH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_initialize_device failed 0x%x\n", ret);
+    return FAILED;
+  }
+  ret = get_namespace_default(tg->devH, &tg->nsH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "get_namespace_default failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  kv_queue qinfo;
+  qinfo.queue_id = 0;
+  qinfo.queue_size = qsize;
+  qinfo.completion_queue_id = 0;
+  qinfo.queue_type = COMPLETION_Q_TYPE;
+  qinfo.extended_info = NULL;
+  ret = kv_create_queue(tg->devH, &qinfo, &tg->cqH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_create_queue failed 0x%x\n", ret);
+    return FAILED;
+  }
+  tg->int_handler = (kv_interrupt_handler)malloc(sizeof(_kv_interrupt_handler));
+  tg->int_handler->handler = _interrupt_noop;
+  tg->int_handler->private_data = 0;
+  tg->int_handler->number = 0;
+  kv_set_interrupt_handler(tg->cqH, tg->int_handler);
+
+  qinfo.queue_id = 1;
+  qinfo.queue_type = SUBMISSION_Q_TYPE;
+  ret = kv_create_queue(tg->devH, &qinfo, &tg->sqH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_create_queue failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  if (tg->layer == LAYER_NOOP)
+    _kv_bypass_namespace(tg->devH, tg->nsH, TRUE);
+  return SUCCESS;
+}
+
+static void _adi_close(mb_target *tg) {
+  if (tg->devH == NULL) return;
+  if (tg->sqH) kv_delete_queue(tg->devH, tg->sqH);
+  if (tg->cqH) kv_delete_queue(tg->devH, tg->cqH);
+  if (tg->nsH) kv_delete_namespace(tg->devH, tg->nsH);
+  kv_cleanup_device(tg->devH);
+  if (tg->int_handler) free(tg->int_handler);
+}
+
+static int _target_open(const mb_config &cfg, int layer, int qsize, mb_target *tg) {
+  memset(tg, 0, sizeof(*tg));
+  tg->layer = layer;
+
+  switch (layer) {
+  case LAYER_MAP:
+    // same capacity the device gives an emulator namespace by default
+    tg->map = new kvadi::kv_emulator(512ULL * 1024 * 1024 * 1024, std::vector<double>(), FALSE, 0);
+    return SUCCESS;
+  case LAYER_NOOP:
+  case LAYER_ADI:
+    return _adi_open(cfg, tg, qsize);
+  case LAYER_DRIVER: {
+    tg->priv = new kv_device_priv();
+    snprintf(tg->priv->node, sizeof(tg->priv->node), "%s", cfg.dev_path);
+    tg->priv->isemul = true;
+    tg->driver = new KvEmulator(tg->priv, 0);
+    if (tg->driver->init(cfg.dev_path, cfg.config_file, qsize, 0) != KVS_SUCCESS)
+      return FAILED;
+    tg->driver_ks.keyspace_id = MB_KEYSPACE_ID;
+    snprintf(tg->driver_ks.name, sizeof(tg->driver_ks.name), "%s", MB_KEYSPACE_NAME);
+    return SUCCESS;
+  }
+  case LAYER_API: {
+    kvs_result ret = kvs_open_device((char *)cfg.dev_path, &tg->api_dev);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Device open failed 0x%x\n", ret);
+      return FAILED;
+    }
+    kvs_key_space_name ks_name;
+    kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+    ks_name.name = (char *)MB_KEYSPACE_NAME;
+    ks_name.name_len = strlen(MB_KEYSPACE_NAME);
+    ret = kvs_create_key_space(tg->api_dev, &ks_name, 0, option);
+    if (ret == KVS_SUCCESS)
+      ret = kvs_open_key_space(tg->api_dev, (char *)MB_KEYSPACE_NAME, &tg->api_ks);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+      return FAILED;
+    }
+    return SUCCESS;
+  }
+  }
+  return FAILED;
+}
+
+static void _target_close(mb_target *tg) {
+  switch (tg->layer) {
+  case LAYER_MAP:
+    delete tg->map;
+    break;
+  case LAYER_NOOP:
+  case LAYER_ADI:
+    _adi_close(tg);
+    break;
+  case LAYER_DRIVER:
+    if (tg->driver) delete tg->driver;
+    if (tg->priv) delete tg->priv;
+    break;
+  case LAYER_API:
+    if (tg->api_ks) kvs_close_key_space(tg->api_ks);
+    if (tg->api_dev) {
+      kvs_key_space_name ks_name;
+      ks_name.name = (char *)MB_KEYSPACE_NAME;
+      ks_name.name_len = strlen(MB_KEYSPACE_NAME);
+      kvs_delete_key_space(tg->api_dev, &ks_name);
+      kvs_close_device(tg->api_dev);
+    }
+    break;
+  }
+}
+
+/*
+ * Submits one request. Requests completed inline (map, and the synchronous
+ * driver and api calls) give the slot back before returning. The ADI has no
+ * synchronous call, so a sync ADI run is a submit followed by a wait on the
+ * completion, which is what KvEmulator does for its own sync path.
+ */
+static void _submit(mb_target *tg, mb_slot *slot, int op, int async) {
+  mb_thread *t = slot->owner;
+  int ret = 0;
+
+  if (op == OP_GET) {
+    slot->value.value = slot->valbuf;
+    slot->value.length = t->vlen;
+    slot->value.actual_value_size = 0;
+    slot->value.offset = 0;
+  } else {
+    slot->value.value = t->putbuf;
+    slot->value.length = t->vlen;
+  }
+
+  switch (tg->layer) {
+  case LAYER_MAP: {
+    uint32_t consumed = 0;
+    if (op == OP_PUT)
+      ret = tg->map->kv_store(MB_KEYSPACE_ID, (kv_key *)&slot->key, (kv_value *)&slot->value,
+                              KV_STORE_OPT_DEFAULT, 0, &consumed, NULL);
+    else
+      ret = tg->map->kv_retrieve(MB_KEYSPACE_ID, (kv_key *)&slot->key, KV_RETRIEVE_OPT_DEFAULT,
+                                 (kv_value *)&slot->value, NULL);
+    if (ret != KV_SUCCESS) t->errors++;
+    _put_slot(slot);
+    return;
+  }
+  case LAYER_NOOP:
+  case LAYER_ADI: {
+    kv_postprocess_function f = { _adi_complete, (void *)slot };
+    if (op == OP_PUT)
+      ret = kv_store(tg->sqH, tg->nsH, MB_KEYSPACE_ID, (kv_key *)&slot->key,
+                     (kv_value *)&slot->value, KV_STORE_OPT_DEFAULT, &f);
+    else
+      ret = kv_retrieve(tg->sqH, tg->nsH, MB_KEYSPACE_ID, (kv_key *)&slot->key,
+                        KV_RETRIEVE_OPT_DEFAULT, (kv_value *)&slot->value, &f);
+    if (ret != KV_SUCCESS) {
+      t->errors++;
+      _put_slot(slot);
+    }
+    if (!async) _drain(t);
+    return;
+  }
+  case LAYER_DRIVER: {
+    if (op == OP_PUT) {
+      kvs_option_store option = { KVS_STORE_POST, NULL };
+      ret = tg->driver->store_tuple(&tg->driver_ks, &slot->key, &slot->value, option,
+                                    slot, NULL, !async, async ? _kvs_complete : NULL);
+    } else {
+      kvs_option_retrieve option = { false };
+      ret = tg->driver->retrieve_tuple(&tg->driver_ks, &slot->key, &slot->value, option,
+                                       slot, NULL, !async, async ? _kvs_complete : NULL);
+    }
+    break;
+  }
+  case LAYER_API: {
+    if (op == OP_PUT) {
+      kvs_option_store option = { KVS_STORE_POST, NULL };
+      if (async)
+        ret = kvs_store_kvp_async(tg->api_ks, &slot->key, &slot->value, &option, slot, NULL,
+                                  _kvs_complete);
+      else
+        ret = kvs_store_kvp(tg->api_ks, &slot->key, &slot->value, &option);
+    } else {
+      kvs_option_retrieve option = { false };
+      if (async)
+        ret = kvs_retrieve_kvp_async(tg->api_ks, &slot->key, &option, slot, NULL, &slot->value,
+                                     _kvs_complete);
+      else
+        ret = kvs_retrieve_kvp(tg->api_ks, &slot->key, &option, &slot->value);
+    }
+    break;
+  }
+  }
+
+  if (ret != KVS_SUCCESS) t->errors++;
+  if (!async || ret != KVS_SUCCESS) _put_slot(slot);
+}
+
+static void *_bench_thread(void *arg) {
+  mb_run *run = (mb_run *)arg;
+  mb_thread *t = run->thread;
+
+  pthread_barrier_wait(run->barrier);
+  uint64_t start = _now_ns();
+  for (uint64_t i = 0; i < t->count; i++) {
+    mb_slot *slot = _get_slot(t);
+    slot->key.key = t->keys + i * t->klen;
+    slot->key.length = t->klen;
+    _submit(run->target, slot, run->op, run->async);
+  }
+  _drain(t);
+  t->elapsed_ns = _now_ns() - start;
+  return NULL;
+}
+
+static int _alloc_thread(mb_thread *t, int id, int klen, int vlen, int qdepth, uint64_t count) {
+  t->id = id;
+  t->klen = klen;
+  t->vlen = vlen;
+  t->qdepth = qdepth;
+  t->count = count;
+  t->errors = 0;
+  t->elapsed_ns = 0;
+  t->keys = (char *)malloc((size_t)count * klen);
+  t->putbuf = (char *)kvs_malloc(vlen, PAGE_ALIGN);
+  t->slots = (mb_slot *)calloc(qdepth, sizeof(mb_slot));
+  if (t->keys == NULL || t->putbuf == NULL || t->slots == NULL) {
+    fprintf(stderr, "failed to allocate\n");
+    return FAILED;
+  }
+  for (uint64_t i = 0; i < count; i++)
+    _make_key(t->keys + i * klen, klen, id, i);
+  memset(t->putbuf, 'v', vlen);
+  for (int i = 0; i < qdepth; i++) {
+    t->slots[i].owner = t;
+    t->slots[i].valbuf = (char *)kvs_malloc(vlen, PAGE_ALIGN);
+    if (t->slots[i].valbuf == NULL) {
+      fprintf(stderr, "failed to allocate\n");
+      return FAILED;
+    }
+    t->free_slots.push_back(&t->slots[i]);
+  }
+  return SUCCESS;
+}
+
+static void _free_thread(mb_thread *t) {
+  if (t->slots) {
+    for (int i = 0; i < t->qdepth; i++)
+      if (t->slots[i].valbuf) kvs_free(t->slots[i].valbuf);
+    free(t->slots);
+  }
+  if (t->putbuf) kvs_free(t->putbuf);
+  if (t->keys) free(t->keys);
+}
+
+/*
+ * Runs the put phase and then the get phase of one configuration on a fresh
+ * device and fills in one result per phase.
+ */
+static int _run_once(const mb_config &cfg, int layer, int async, int klen, int vlen,
+                     int nthreads, mb_result *res) {
+  int qdepth = async ? cfg.qdepth : 1;
+  int qsize = nthreads * qdepth + 1;
+  if (qsize > 64 * 1024 - 1) qsize = 64 * 1024 - 1;
+
+  mb_target tg;
+  if (_target_open(cfg, layer, qsize, &tg) != SUCCESS) {
+    _target_close(&tg);
+    return FAILED;
+  }
+
+  std::vector<mb_thread *> threads(nthreads);
+  int ret = SUCCESS;
+  for (int i = 0; i < nthreads; i++) {
+    threads[i] = new mb_thread();
+    if (_alloc_thread(threads[i], i, klen, vlen, qdepth, cfg.count) != SUCCESS)
+      ret = FAILED;
+  }
+
+  for (int op = OP_PUT; op <= OP_GET && ret == SUCCESS; op++) {
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, nthreads + 1);
+    std::vector<pthread_t> tids(nthreads);
+    std::vector<mb_run> runs(nthreads);
+    for (int i = 0; i < nthreads; i++) {
+      threads[i]->errors = 0;
+      runs[i].target = &tg;
+      runs[i].thread = threads[i];
+      runs[i].op = op;
+      runs[i].async = async;
+      runs[i].barrier = &barrier;
+      pthread_create(&tids[i], NULL, _bench_thread, &runs[i]);
+    }
+    pthread_barrier_wait(&barrier);
+    uint64_t start = _now_ns();
+    for (int i = 0; i < nthreads; i++)
+      pthread_join(tids[i], NULL);
+    uint64_t wall = _now_ns() - start;
+    pthread_barrier_destroy(&barrier);
+
+    uint64_t thread_ns = 0, errors = 0;
+    for (int i = 0; i < nthreads; i++) {
+      thread_ns += threads[i]->elapsed_ns;
+      errors += threads[i]->errors;
+    }
+    uint64_t ops = cfg.count * nthreads;
+    mb_result *r = &res[op];
+    r->layer = layer;
+    r->async = async;
+    r->op = op;
+    r->klen = klen;
+    r->vlen = vlen;
+    r->threads = nthreads;
+    r->qdepth = qdepth;
+    r->ns_per_op = (double)thread_ns / ops;
+    r->kops = (double)ops * 1000000.0 / (wall ? wall : 1);
+    r->errors = errors;
+  }
+
+  for (int i = 0; i < nthreads; i++) {
+    _free_thread(threads[i]);
+    delete threads[i];
+  }
+  _target_close(&tg);
+  return ret;
+}
+
+static std::string _result_key(int layer, int async, int op, int klen, int vlen,
+                               int threads, int qdepth) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s,%s,%s,%d,%d,%d,%d", layer_names[layer],
+           async ? "async" : "sync", op_names[op], klen, vlen, threads, qdepth);
+  return std::string(buf);
+}
+
+static int _write_baseline(const char *path, const std::vector<mb_result> &results) {
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return FAILED;
+  }
+  fprintf(fp, "%s\n", MB_BASELINE_HEADER);
+  fprintf(fp, "# layer,mode,op,klen,vlen,threads,qdepth,ns_per_op,kops\n");
+  for (const mb_result &r : results) {
+    fprintf(fp, "%s,%.1f,%.1f\n", _result_key(r.layer, r.async, r.op, r.klen, r.vlen,
+            r.threads, r.qdepth).c_str(), r.ns_per_op, r.kops);
+  }
+  fclose(fp);
+  return SUCCESS;
+}
+
+static int _read_baseline(const char *path, std::map<std::string, double> &baseline) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return FAILED;
+  }
+  char line[512];
+  if (fgets(line, sizeof(line), fp) == NULL ||
+      strncmp(line, MB_BASELINE_HEADER, strlen(MB_BASELINE_HEADER)) != 0) {
+    fprintf(stderr, "%s is not a baseline file\n", path);
+    fclose(fp);
+    return FAILED;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    // the key is everything before the last two fields
+    char *kops = strrchr(line, ',');
+    if (kops == NULL) continue;
+    *kops = '\0';
+    char *ns = strrchr(line, ',');
+    if (ns == NULL) continue;
+    *ns = '\0';
+    baseline[std::string(line)] = strtod(ns + 1, NULL);
+  }
+  fclose(fp);
+  return SUCCESS;
+}
+
+static const mb_result *_find_result(const std::vector<mb_result> &results, int layer,
+                                     const mb_result &like) {
+  for (const mb_result &r : results) {
+    if (r.layer != layer || r.op != like.op || r.klen != like.klen || r.vlen != like.vlen ||
+        r.threads != like.threads)
+      continue;
+    // the map only has a sync row, it is the bottom of the async stack too
+    if (layer == LAYER_MAP || (r.async == like.async && r.qdepth == like.qdepth))
+      return &r;
+  }
+  return NULL;
+}
+
+/*
+ * Per-op cost attributed to each layer: the layer alone for map and noop,
+ * and the difference to the layer below for the stacked ones.
+ */
+static void _print_breakdown(const std::vector<mb_result> &results) {
+  static const struct { const char *name; int upper; int lower; } parts[] = {
+    { "kv_emulator map", LAYER_MAP, -1 },
+    { "adi+ioqueue (noop ns)", LAYER_NOOP, -1 },
+    { "adi+ioqueue (stacked)", LAYER_ADI, LAYER_MAP },
+    { "KvsDriver adapter", LAYER_DRIVER, LAYER_ADI },
+    { "cfrontend", LAYER_API, LAYER_DRIVER },
+  };
+
+  fprintf(stdout, "\nPer-layer cost (ns/op)\n");
+  std::map<std::string, int> seen;
+  for (const mb_result &base : results) {
+    std::string conf = _result_key(LAYER_MAP, base.async, base.op, base.klen, base.vlen,
+                                   base.threads, base.qdepth);
+    conf = conf.substr(conf.find(',') + 1);
+    if (seen.count(conf)) continue;
+    seen[conf] = 1;
+
+    fprintf(stdout, "  %s\n", conf.c_str());
+    for (const auto &p : parts) {
+      const mb_result *up = _find_result(results, p.upper, base);
+      const mb_result *lo = p.lower >= 0 ? _find_result(results, p.lower, base) : NULL;
+      if (up == NULL || (p.lower >= 0 && lo == NULL)) continue;
+      double cost = up->ns_per_op - (lo ? lo->ns_per_op : 0.0);
+      fprintf(stdout, "    %-24s %10.1f\n", p.name, cost);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  mb_config cfg;
+  const char *baseline_out = NULL;
+  const char *baseline_in = NULL;
+  int c;
+
+  cfg.dev_path = "/dev/kvemul";
+  cfg.config_file = "../kvssd_emul.conf";
+  for (int i = 0; i < LAYER_MAX; i++) cfg.layers.push_back(i);
+  cfg.modes.push_back(0);
+  cfg.modes.push_back(1);
+  cfg.klens.push_back(16);
+  cfg.vlens.push_back(4096);
+  cfg.threads.push_back(1);
+  cfg.qdepth = 64;
+  cfg.count = 100000;
+  cfg.repeat = 3;
+  cfg.threshold = 10.0;
+
+  static const char *mode_names[] = { "sync", "async" };
+  while ((c = getopt(argc, argv, "d:f:l:m:k:v:t:q:n:r:o:c:T:h")) != -1) {
+    int err = SUCCESS;
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 'f':
+      cfg.config_file = optarg;
+      break;
+    case 'l':
+      err = _parse_name_list(optarg, layer_names, LAYER_MAX, cfg.layers);
+      break;
+    case 'm':
+      err = _parse_name_list(optarg, mode_names, 2, cfg.modes);
+      break;
+    case 'k':
+      err = _parse_int_list(optarg, cfg.klens);
+      break;
+    case 'v':
+      err = _parse_int_list(optarg, cfg.vlens);
+      break;
+    case 't':
+      err = _parse_int_list(optarg, cfg.threads);
+      break;
+    case 'q':
+      cfg.qdepth = atoi(optarg);
+      break;
+    case 'n':
+      cfg.count = strtoull(optarg, NULL, 10);
+      break;
+    case 'r':
+      cfg.repeat = atoi(optarg);
+      break;
+    case 'o':
+      baseline_out = optarg;
+      break;
+    case 'c':
+      baseline_in = optarg;
+      break;
+    case 'T':
+      cfg.threshold = atof(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+    if (err != SUCCESS) {
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+
+  if (cfg.qdepth <= 0 || cfg.count == 0 || cfg.repeat <= 0) {
+    usage(argv[0]);
+    return FAILED;
+  }
+  for (int klen : cfg.klens) {
+    if (klen < 8 || klen > KVS_MAX_KEY_LENGTH) {
+      fprintf(stderr, "key length must be between 8 and %d\n", KVS_MAX_KEY_LENGTH);
+      return FAILED;
+    }
+  }
+  for (int vlen : cfg.vlens) {
+    if (vlen > KVS_MAX_VALUE_LENGTH) {
+      fprintf(stderr, "value length must not exceed %d\n", KVS_MAX_VALUE_LENGTH);
+      return FAILED;
+    }
+  }
+  for (int n : cfg.threads) {
+    if (n > 0xffff) {
+      fprintf(stderr, "too many threads\n");
+      return FAILED;
+    }
+  }
+
+  std::map<std::string, double> baseline;
+  if (baseline_in && _read_baseline(baseline_in, baseline) != SUCCESS)
+    return FAILED;
+
+  fprintf(stdout, "%-7s %-5s %-3s %5s %7s %7s %5s %12s %12s %s\n", "layer", "mode", "op",
+          "klen", "vlen", "threads", "qd", "ns/op", "kops/s", baseline_in ? "vs baseline" : "");
+
+  std::vector<mb_result> results;
+  int regressions = 0;
+  for (int layer : cfg.layers) {
+    for (int async : cfg.modes) {
+      // the map has no submission path, it is only measured synchronously
+      if (layer == LAYER_MAP && async) continue;
+      for (int klen : cfg.klens) {
+        for (int vlen : cfg.vlens) {
+          for (int nthreads : cfg.threads) {
+            mb_result best[2];
+            for (int r = 0; r < cfg.repeat; r++) {
+              mb_result cur[2];
+              if (_run_once(cfg, layer, async, klen, vlen, nthreads, cur) != SUCCESS) {
+                fprintf(stderr, "%s layer failed\n", layer_names[layer]);
+                return FAILED;
+              }
+              for (int op = OP_PUT; op <= OP_GET; op++) {
+                if (r == 0 || cur[op].ns_per_op < best[op].ns_per_op) best[op] = cur[op];
+              }
+            }
+            for (int op = OP_PUT; op <= OP_GET; op++) {
+              const mb_result &r = best[op];
+              char cmp[64] = "";
+              std::string key = _result_key(r.layer, r.async, r.op, r.klen, r.vlen,
+                                            r.threads, r.qdepth);
+              if (baseline.count(key) && baseline[key] > 0) {
+                double delta = (r.ns_per_op - baseline[key]) * 100.0 / baseline[key];
+                bool regressed = delta > cfg.threshold;
+                if (regressed) regressions++;
+                snprintf(cmp, sizeof(cmp), "%+7.1f%%%s", delta, regressed ? " REGRESSION" : "");
+              } else if (baseline_in) {
+                snprintf(cmp, sizeof(cmp), "    new");
+              }
+              fprintf(stdout, "%-7s %-5s %-3s %5d %7d %7d %5d %12.1f %12.1f %s\n",
+                      layer_names[r.layer], r.async ? "async" : "sync", op_names[r.op],
+                      r.klen, r.vlen, r.threads, r.qdepth, r.ns_per_op, r.kops, cmp);
+              if (r.errors)
+                fprintf(stderr, "WARN: %llu failed requests in the run above\n",
+                        (unsigned long long)r.errors);
+              results.push_back(r);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  _print_breakdown(results);
+
+  if (baseline_out && _write_baseline(baseline_out, results) != SUCCESS)
+    return FAILED;
+  if (baseline_in) {
+    fprintf(stdout, "\n%d regression(s) above %.1f%%\n", regressions, cfg.threshold);
+    if (regressions) return FAILED;
+  }
+  return SUCCESS;
+}
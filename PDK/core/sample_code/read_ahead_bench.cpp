@@ -0,0 +1,433 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Read-ahead benchmark.
+ *
+ * Every thread retrieves the keys of its own range in one of three orders:
+ * sequential, strided or random. The workload runs with read-ahead off and
+ * on, and the mean retrieve latency, the throughput and the read-ahead
+ * counters are compared: the hits, the speculative retrieves sent and the
+ * share of them that was wasted.
+ *
+ * A writer thread can store new versions of random keys at the same time.
+ * Each value holds its key and version, and a retrieve has to return at
+ * least the version whose store completed before the retrieve was sent;
+ * the benchmark fails if one returns an older one.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define RA_KEYSPACE_NAME "read_ahead_bench"
+#define RA_KEY_LEN 16
+
+enum ra_pattern { PATTERN_SEQUENTIAL = 0, PATTERN_STRIDED, PATTERN_RANDOM, PATTERN_MAX };
+static const char *pattern_names[PATTERN_MAX] = { "sequential", "strided", "random" };
+
+struct ra_config {
+  const char *dev_path;
+  int threads;
+  uint32_t keys;        // per thread
+  uint32_t count;       // retrieves per thread
+  uint32_t stride;
+  uint32_t qdepth;      // 1 for synchronous retrieves
+  uint32_t vlen;
+  uint32_t depth;
+  uint32_t write_pct;   // stores of the writer against all retrieves
+};
+
+// updated by completions as well as by the thread
+struct ra_result {
+  std::atomic<uint64_t> retrieves;
+  std::atomic<uint64_t> latency_us;
+  std::atomic<uint64_t> errors;      // failed requests and stale values
+  ra_result() : retrieves(0), latency_us(0), errors(0) {}
+};
+
+// version of the value whose store completed last, per key
+static std::vector<std::atomic<uint32_t> > g_versions;
+static std::atomic<bool> g_stop;
+
+static uint64_t _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-k keys] [-n count] [-s stride] "
+         "[-q qdepth] [-v vlen] [-D depth] [-w write_pct]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-t      threads      :  threads (default 4)\n");
+  printf("-k      keys         :  keys per thread (default 20000)\n");
+  printf("-n      count        :  retrieves per thread and pattern (default 20000)\n");
+  printf("-s      stride       :  key distance of the strided pattern (default 4)\n");
+  printf("-q      qdepth       :  asynchronous retrieves in flight per thread, 1 for synchronous (default 1)\n");
+  printf("-v      vlen         :  value length (default 1024)\n");
+  printf("-D      depth        :  read-ahead depth (default 8)\n");
+  printf("-w      write_pct    :  stores by a writer thread per 100 retrieves (default 0)\n");
+  printf("==============\n");
+}
+
+static void _make_key(char *buf, uint32_t idx) {
+  char tmp[32];
+  snprintf(tmp, sizeof(tmp), "ra%014u", idx);
+  memcpy(buf, tmp, RA_KEY_LEN);
+}
+
+static kvs_result _store(kvs_key_space_handle ks, char *key, char *value,
+                         uint32_t vlen, uint32_t idx, uint32_t version) {
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  _make_key(key, idx);
+  memcpy(value, &idx, sizeof(idx));
+  memcpy(value + sizeof(idx), &version, sizeof(version));
+  kvs_key kvskey = { key, RA_KEY_LEN };
+  kvs_value kvsvalue = { value, vlen, 0, 0 };
+  return kvs_store_kvp(ks, &kvskey, &kvsvalue, &st_opt);
+}
+
+// n-th key a thread retrieves
+static uint32_t _next(const ra_config &cfg, int pattern, int id, uint32_t n,
+                      unsigned int *seed) {
+  uint32_t off;
+  if (pattern == PATTERN_SEQUENTIAL)
+    off = n % cfg.keys;
+  else if (pattern == PATTERN_STRIDED)
+    off = (uint64_t)n * cfg.stride % cfg.keys;
+  else
+    off = rand_r(seed) % cfg.keys;
+  return id * cfg.keys + off;
+}
+
+// the value has to be of the key and at least as new as expected
+static bool _check(const char *value, uint32_t idx, uint32_t expected) {
+  uint32_t got_idx, got_version;
+  memcpy(&got_idx, value, sizeof(got_idx));
+  memcpy(&got_version, value + sizeof(got_idx), sizeof(got_version));
+  if (got_idx == idx && got_version >= expected) return true;
+  fprintf(stderr, "key %u: value of key %u version %u, expected version %u or later\n",
+          idx, got_idx, got_version, expected);
+  return false;
+}
+
+struct ra_request {
+  char *key;
+  char *value;
+  kvs_key kvskey;
+  kvs_value kvsvalue;
+  uint32_t idx;
+  uint32_t expected;
+  uint64_t start_us;
+  std::atomic<bool> done;
+  ra_result *result;
+};
+
+static void _complete(kvs_postprocess_context *ctx) {
+  ra_request *req = (ra_request *)ctx->private1;
+  if (ctx->result != KVS_SUCCESS) {
+    fprintf(stderr, "retrieve failed with err 0x%x\n", ctx->result);
+    req->result->errors++;
+  } else if (!_check(req->value, req->idx, req->expected)) {
+    req->result->errors++;
+  }
+  req->result->latency_us += _now_us() - req->start_us;
+  req->result->retrieves++;
+  req->done.store(true, std::memory_order_release);
+}
+
+static void _reader(kvs_key_space_handle ks, const ra_config *cfg, int pattern,
+                    int id, ra_result *result) {
+  kvs_option_retrieve rt_opt;
+  memset(&rt_opt, 0, sizeof(rt_opt));
+  unsigned int seed = 1234 + id;
+  std::vector<ra_request> reqs(cfg->qdepth);
+  for (auto &req : reqs) {
+    req.key = (char *)kvs_malloc(RA_KEY_LEN, 4096);
+    req.value = (char *)kvs_malloc(cfg->vlen, 4096);
+    req.done = true;
+    req.result = result;
+  }
+
+  uint32_t n = 0;
+  while (n < cfg->count) {
+    const uint32_t sent = n;
+    for (auto &req : reqs) {
+      if (n == cfg->count) break;
+      if (!req.done.load(std::memory_order_acquire)) continue;
+      req.idx = _next(*cfg, pattern, id, n++, &seed);
+      req.expected = g_versions[req.idx].load();
+      _make_key(req.key, req.idx);
+      req.kvskey = { req.key, RA_KEY_LEN };
+      req.kvsvalue = { req.value, cfg->vlen, 0, 0 };
+      req.start_us = _now_us();
+      if (cfg->qdepth == 1) {
+        kvs_postprocess_context ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.private1 = &req;
+        ctx.result = kvs_retrieve_kvp(ks, &req.kvskey, &rt_opt, &req.kvsvalue);
+        _complete(&ctx);
+        continue;
+      }
+      req.done = false;
+      kvs_result ret = kvs_retrieve_kvp_async(ks, &req.kvskey, &rt_opt, &req, NULL,
+                                              &req.kvsvalue, _complete);
+      if (ret != KVS_SUCCESS) {
+        fprintf(stderr, "retrieve failed with err 0x%x\n", ret);
+        result->errors++;
+        req.done = true;
+      }
+    }
+    //leaves the CPU to the completions while all requests are in flight
+    if (n == sent) usleep(10);
+  }
+  for (auto &req : reqs) {
+    while (!req.done.load(std::memory_order_acquire)) usleep(10);
+    kvs_free(req.key);
+    kvs_free(req.value);
+  }
+}
+
+// stores new versions of random keys, write_pct per 100 retrieves
+static void _writer(kvs_key_space_handle ks, const ra_config *cfg,
+                    std::atomic<uint64_t> *retrieved, ra_result *result) {
+  char *key = (char *)kvs_malloc(RA_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  memset(value, 'r', cfg->vlen);
+  unsigned int seed = 4321;
+  uint64_t stores = 0;
+  const uint32_t keys = cfg->threads * cfg->keys;
+  while (!g_stop) {
+    if (stores * 100 >= retrieved->load() * cfg->write_pct) {
+      usleep(10);
+      continue;
+    }
+    const uint32_t idx = rand_r(&seed) % keys;
+    const uint32_t version = g_versions[idx].load() + 1;
+    kvs_result ret = _store(ks, key, value, cfg->vlen, idx, version);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      result->errors++;
+      break;
+    }
+    g_versions[idx] = version;
+    stores++;
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static int _run(kvs_key_space_handle ks, const ra_config &cfg, int pattern, bool on) {
+  kvs_option_read_ahead opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.depth = cfg.depth;
+  opt.value_size = (cfg.vlen + 4095) / 4096 * 4096;
+  opt.streams = cfg.threads * 2 > 64 ? 64 : cfg.threads * 2;
+  opt.max_stride = cfg.stride > 64 ? cfg.stride : 64;
+  kvs_result ret = kvs_set_read_ahead(ks, on ? &opt : NULL);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "kvs_set_read_ahead failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  std::vector<ra_result> results(cfg.threads + 1);
+  std::atomic<uint64_t> retrieved(0);
+  g_stop = false;
+  const uint64_t start = _now_us();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < cfg.threads; i++)
+    threads.push_back(std::thread(_reader, ks, &cfg, pattern, i, &results[i]));
+  std::thread writer;
+  if (cfg.write_pct) {
+    writer = std::thread(_writer, ks, &cfg, &retrieved, &results[cfg.threads]);
+  }
+  //paces the writer with the readers
+  while (cfg.write_pct) {
+    uint64_t sum = 0;
+    for (int i = 0; i < cfg.threads; i++) sum += results[i].retrieves;
+    retrieved = sum;
+    if (sum == (uint64_t)cfg.threads * cfg.count) break;
+    usleep(100);
+  }
+  for (auto &t : threads) t.join();
+  g_stop = true;
+  if (writer.joinable()) writer.join();
+  const double secs = (_now_us() - start) / 1e6;
+
+  ra_result total;
+  for (auto &r : results) {
+    total.retrieves += r.retrieves;
+    total.latency_us += r.latency_us;
+    total.errors += r.errors;
+  }
+  kvs_read_ahead_stats stats;
+  kvs_get_read_ahead_stats(ks, &stats);
+  printf("%-10s %-3s %8.1f us %10.0f ops/s", pattern_names[pattern], on ? "on" : "off",
+         total.retrieves ? (double)total.latency_us / total.retrieves : 0,
+         (double)total.retrieves / secs);
+  if (on) {
+    printf(", %5.1f%% hits (%lu late), %lu issued, %5.1f%% wasted, %lu invalidated, "
+           "%lu canceled", stats.retrieves ? 100.0 * (stats.hits + stats.late_hits) /
+           stats.retrieves : 0, stats.late_hits, stats.issued,
+           stats.issued ? 100.0 * stats.wasted / stats.issued : 0, stats.invalidated,
+           stats.canceled);
+  }
+  printf("\n");
+  if (total.errors) fprintf(stderr, "%lu errors\n", total.errors.load());
+  kvs_set_read_ahead(ks, NULL);
+  return total.errors ? FAILED : SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+  ra_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 4;
+  cfg.keys = 20000;
+  cfg.count = 20000;
+  cfg.stride = 4;
+  cfg.qdepth = 1;
+  cfg.vlen = 1024;
+  cfg.depth = 8;
+  cfg.write_pct = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:k:n:s:q:v:D:w:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'k':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'n':
+      cfg.count = atoi(optarg);
+      break;
+    case 's':
+      cfg.stride = atoi(optarg);
+      break;
+    case 'q':
+      cfg.qdepth = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'D':
+      cfg.depth = atoi(optarg);
+      break;
+    case 'w':
+      cfg.write_pct = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.threads <= 0 || cfg.keys == 0 || cfg.count == 0 || cfg.stride == 0 ||
+      cfg.qdepth == 0 || cfg.vlen < 64 || cfg.vlen % 4 || cfg.depth == 0 ||
+      cfg.depth > 64) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)RA_KEYSPACE_NAME;
+  ks_name.name_len = strlen(RA_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_key_space_handle ks;
+  ret = kvs_open_key_space(dev, (char *)RA_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  int result = SUCCESS;
+  const uint32_t keys = cfg.threads * cfg.keys;
+  g_versions = std::vector<std::atomic<uint32_t> >(keys);
+  char *key = (char *)kvs_malloc(RA_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg.vlen, 4096);
+  memset(value, 'r', cfg.vlen);
+  for (uint32_t i = 0; i < keys && result == SUCCESS; i++) {
+    g_versions[i] = 0;
+    ret = _store(ks, key, value, cfg.vlen, i, 0);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      result = FAILED;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+
+  if (result == SUCCESS) {
+    printf("%d threads x %u retrieves of %u keys each, stride %u, %s, %u byte values, "
+           "depth %u, %u stores per 100 retrieves\n", cfg.threads, cfg.count, cfg.keys,
+           cfg.stride, cfg.qdepth == 1 ? "synchronous" : "asynchronous", cfg.vlen,
+           cfg.depth, cfg.write_pct);
+    for (int pattern = 0; pattern < PATTERN_MAX; pattern++) {
+      result |= _run(ks, cfg, pattern, false);
+      result |= _run(ks, cfg, pattern, true);
+    }
+  }
+
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+  return result;
+}
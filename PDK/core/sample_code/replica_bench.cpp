@@ -0,0 +1,393 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replica set benchmark.
+ *
+ * Opens several emulated devices (device path prefix plus an index) and
+ * writes and reads a key set through a replica set over one key space on
+ * each of them. Three configurations are compared:
+ *
+ *  single   one device, no replication
+ *  replica  all devices, stores wait for the write quorum, reads go to one
+ *           replica
+ *  hedged   as replica, plus a backup read to another replica when the
+ *           first one is slower than the hedging percentile
+ *
+ * Latency outliers are injected with slow_io_rate and slow_io_us in the
+ * emulator configuration file; without them all three behave alike.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define REPLICA_KEYSPACE_NAME "replica_bench"
+#define REPLICA_KEY_LEN 16
+
+enum replica_mode { MODE_SINGLE = 0, MODE_REPLICA, MODE_HEDGED, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "single", "replica", "hedged" };
+
+struct replica_config {
+  const char *dev_prefix;
+  int replicas;
+  int quorum;
+  int threads;
+  uint32_t reads;        // per thread
+  uint32_t keys;
+  uint32_t vlen;
+  double percentile;
+  uint32_t hedge_min_us;
+  std::vector<int> modes;
+};
+
+struct replica_worker {
+  int id;
+  const replica_config *cfg;
+  kvs_replica_set_handle rs;
+  std::vector<uint32_t> store_lat;
+  std::vector<uint32_t> read_lat;
+  uint64_t errors;
+};
+
+static uint64_t _now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_prefix] [-r replicas] [-w quorum] [-t threads] [-n reads] "
+         "[-k keys] [-v vlen] [-p percentile] [-H min_us] [-m modes]\n", program);
+  printf("-d      device_prefix :  devices are prefix0, prefix1, ... (default /dev/kvemul)\n");
+  printf("-r      replicas      :  number of devices, 2 to %d (default 3)\n", KVS_MAX_REPLICAS);
+  printf("-w      quorum        :  replicas a store waits for, 0 for all (default 2)\n");
+  printf("-t      threads       :  number of threads (default 4)\n");
+  printf("-n      reads         :  reads per thread (default 5000)\n");
+  printf("-k      keys          :  number of keys (default 2000)\n");
+  printf("-v      vlen          :  value length (default 4096)\n");
+  printf("-p      percentile    :  read latency percentile after which to hedge (default 95)\n");
+  printf("-H      min_us        :  lower bound of the hedging delay (default 0)\n");
+  printf("-m      modes         :  comma separated list of single,replica,hedged (default all)\n");
+  printf("==============\n");
+}
+
+static void _make_key(char *key, uint32_t idx) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "rpl%013u", idx);
+  memcpy(key, buf, REPLICA_KEY_LEN);
+}
+
+// stores this worker's share of the keys
+static void _run_loader(replica_worker *w, int nworkers) {
+  const replica_config *cfg = w->cfg;
+  char *key = (char *)kvs_malloc(REPLICA_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  memset(value, 'r', cfg->vlen);
+  kvs_option_store st_opt = { KVS_STORE_POST, 0 };
+  for (uint32_t i = w->id; i < cfg->keys; i += nworkers) {
+    _make_key(key, i);
+    memcpy(value, &i, sizeof(i));
+    kvs_key kvskey = { key, REPLICA_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    uint64_t start = _now_us();
+    kvs_result ret = kvs_replica_store_kvp(w->rs, &kvskey, &kvsvalue, &st_opt);
+    w->store_lat.push_back(_now_us() - start);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store failed with err 0x%x\n", ret);
+      w->errors++;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static void _run_reader(replica_worker *w) {
+  const replica_config *cfg = w->cfg;
+  char *key = (char *)kvs_malloc(REPLICA_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  kvs_option_retrieve rt_opt = { false };
+  unsigned int seed = w->id + 1;
+  for (uint32_t n = 0; n < cfg->reads; n++) {
+    uint32_t idx = rand_r(&seed) % cfg->keys;
+    _make_key(key, idx);
+    kvs_key kvskey = { key, REPLICA_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    uint64_t start = _now_us();
+    kvs_result ret = kvs_replica_retrieve_kvp(w->rs, &kvskey, &rt_opt, &kvsvalue);
+    w->read_lat.push_back(_now_us() - start);
+    uint32_t got;
+    memcpy(&got, value, sizeof(got));
+    if (ret != KVS_SUCCESS || got != idx) {
+      fprintf(stderr, "read of key %u failed with err 0x%x\n", idx, ret);
+      w->errors++;
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static uint32_t _percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[(size_t)(p / 100.0 * (sorted.size() - 1))];
+}
+
+static int _open_key_space(kvs_device_handle dev, kvs_key_space_handle *ks) {
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)REPLICA_KEYSPACE_NAME;
+  ks_name.name_len = strlen(REPLICA_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_result ret = kvs_open_key_space(dev, (char *)REPLICA_KEYSPACE_NAME, ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+static void _drop_key_space(kvs_device_handle dev, kvs_key_space_handle ks) {
+  kvs_key_space_name ks_name;
+  ks_name.name = (char *)REPLICA_KEYSPACE_NAME;
+  ks_name.name_len = strlen(REPLICA_KEYSPACE_NAME);
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+}
+
+static int _run_mode(std::vector<kvs_device_handle> &devs, const replica_config &cfg,
+                     int mode) {
+  int nrep = (mode == MODE_SINGLE) ? 1 : cfg.replicas;
+  std::vector<kvs_key_space_handle> ks(nrep);
+  for (int i = 0; i < nrep; i++) {
+    if (_open_key_space(devs[i], &ks[i]) != SUCCESS) {
+      for (int j = 0; j < i; j++) _drop_key_space(devs[j], ks[j]);
+      return FAILED;
+    }
+  }
+
+  kvs_option_replica opt;
+  opt.write_quorum = (mode == MODE_SINGLE) ? 0 : cfg.quorum;
+  opt.hedge_reads = (mode == MODE_HEDGED);
+  opt.hedge_percentile = cfg.percentile;
+  opt.hedge_min_us = cfg.hedge_min_us;
+  kvs_replica_set_handle rs;
+  kvs_result ret = kvs_open_replica_set(ks.data(), nrep, &opt, &rs);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "open replica set failed with err 0x%x\n", ret);
+    for (int i = 0; i < nrep; i++) _drop_key_space(devs[i], ks[i]);
+    return FAILED;
+  }
+
+  std::vector<replica_worker *> workers;
+  for (int i = 0; i < cfg.threads; i++) {
+    replica_worker *w = new replica_worker();
+    w->id = i;
+    w->cfg = &cfg;
+    w->rs = rs;
+    w->errors = 0;
+    workers.push_back(w);
+  }
+
+  std::vector<std::thread> threads;
+  for (auto w : workers) threads.push_back(std::thread(_run_loader, w, cfg.threads));
+  for (auto &t : threads) t.join();
+  threads.clear();
+
+  uint64_t start = _now_us();
+  for (auto w : workers) threads.push_back(std::thread(_run_reader, w));
+  for (auto &t : threads) t.join();
+  double secs = (_now_us() - start) / 1e6;
+
+  std::vector<uint32_t> store_lat, read_lat;
+  uint64_t errors = 0;
+  for (auto w : workers) {
+    store_lat.insert(store_lat.end(), w->store_lat.begin(), w->store_lat.end());
+    read_lat.insert(read_lat.end(), w->read_lat.begin(), w->read_lat.end());
+    errors += w->errors;
+    delete w;
+  }
+  std::sort(store_lat.begin(), store_lat.end());
+  std::sort(read_lat.begin(), read_lat.end());
+
+  // clean up through the replica set, deletes take the same quorum path
+  char *key = (char *)kvs_malloc(REPLICA_KEY_LEN, 4096);
+  kvs_option_delete del_opt = { true };
+  for (uint32_t i = 0; i < cfg.keys; i++) {
+    _make_key(key, i);
+    kvs_key kvskey = { key, REPLICA_KEY_LEN };
+    ret = kvs_replica_delete_kvp(rs, &kvskey, &del_opt);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "delete failed with err 0x%x\n", ret);
+      errors++;
+    }
+  }
+  kvs_free(key);
+
+  kvs_replica_stats stats;
+  kvs_get_replica_stats(rs, &stats);
+  kvs_close_replica_set(rs);
+  for (int i = 0; i < nrep; i++) _drop_key_space(devs[i], ks[i]);
+  errors += stats.quorum_failures;
+
+  printf("%-8s %7u %7u %7u %9.0f %7u %7u %7u %7u %8.2f%% %7lu %7lu %5lu\n",
+         mode_names[mode], _percentile(store_lat, 50), _percentile(store_lat, 99),
+         _percentile(store_lat, 99.9), read_lat.size() / secs, _percentile(read_lat, 50),
+         _percentile(read_lat, 99), _percentile(read_lat, 99.9), read_lat.back(),
+         stats.retrieves ? 100.0 * stats.hedged / stats.retrieves : 0.0, stats.hedge_wins,
+         stats.failovers, errors);
+  return errors ? FAILED : SUCCESS;
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+    int m;
+    for (m = 0; m < MODE_MAX; m++) {
+      if (strcmp(tok, mode_names[m]) == 0) break;
+    }
+    if (m == MODE_MAX) {
+      free(copy);
+      return false;
+    }
+    out->push_back(m);
+  }
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  replica_config cfg;
+  cfg.dev_prefix = "/dev/kvemul";
+  cfg.replicas = 3;
+  cfg.quorum = 2;
+  cfg.threads = 4;
+  cfg.reads = 5000;
+  cfg.keys = 2000;
+  cfg.vlen = 4096;
+  cfg.percentile = 95;
+  cfg.hedge_min_us = 0;
+  cfg.modes = { MODE_SINGLE, MODE_REPLICA, MODE_HEDGED };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:r:w:t:n:k:v:p:H:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_prefix = optarg;
+      break;
+    case 'r':
+      cfg.replicas = atoi(optarg);
+      break;
+    case 'w':
+      cfg.quorum = atoi(optarg);
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.reads = atoi(optarg);
+      break;
+    case 'k':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'p':
+      cfg.percentile = atof(optarg);
+      break;
+    case 'H':
+      cfg.hedge_min_us = atoi(optarg);
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.replicas < 2 || cfg.replicas > KVS_MAX_REPLICAS || cfg.quorum < 0 ||
+      cfg.quorum > cfg.replicas || cfg.threads <= 0 || cfg.reads == 0 || cfg.keys == 0 ||
+      cfg.vlen < 64 || cfg.vlen % 4 || cfg.percentile <= 0 || cfg.percentile >= 100) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  std::vector<kvs_device_handle> devs;
+  for (int i = 0; i < cfg.replicas; i++) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s%d", cfg.dev_prefix, i);
+    kvs_device_handle dev;
+    kvs_result ret = kvs_open_device(path, &dev);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Device open of %s failed 0x%x\n", path, ret);
+      for (auto d : devs) kvs_close_device(d);
+      return FAILED;
+    }
+    devs.push_back(dev);
+  }
+
+  printf("%d replicas, write quorum %d, %d threads x %u reads over %u keys, "
+         "%u byte values, hedging at p%g\n", cfg.replicas, cfg.quorum, cfg.threads,
+         cfg.reads, cfg.keys, cfg.vlen, cfg.percentile);
+  printf("%-8s %23s %9s %31s %9s %7s %7s %5s\n", "", "store latency (us)", "",
+         "read latency (us)", "", "", "", "");
+  printf("%-8s %7s %7s %7s %9s %7s %7s %7s %7s %9s %7s %7s %5s\n", "mode", "p50", "p99",
+         "p99.9", "reads/s", "p50", "p99", "p99.9", "max", "hedged", "wins", "failovr",
+         "errs");
+  int result = SUCCESS;
+  for (int mode : cfg.modes)
+    result |= _run_mode(devs, cfg, mode);
+
+  for (auto d : devs) kvs_close_device(d);
+  return result;
+}
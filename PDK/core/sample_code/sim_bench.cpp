@@ -0,0 +1,519 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Virtual time simulation benchmark.
+ *
+ * Runs one seeded workload against the emulator through the ADI in polling
+ * mode, once in real time (the IOPS model waits out every command) and once
+ * in simulation mode (simulation = true, see kv_get_sim_time), each on a
+ * fresh device. The workload stores every key, then mixes reads and
+ * overwrites of random keys at a fixed queue depth.
+ *
+ * Both runs have to return the same results: every op's result code and the
+ * values read are hashed in op order. The report compares the device time,
+ * throughput and latency each run measured (wall clock in real time, virtual
+ * clock in simulation) and how long each took in wall time.
+ *
+ * Real time runs have one unit, as the emulator executes one command at a
+ * time; -u gives simulated devices more units, which only the simulation
+ * mode can run.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "kvs_adi.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define SIM_KEYSPACE_ID 1
+#define SIM_KEY_LEN 16
+
+enum sim_mode { MODE_REAL = 0, MODE_SIM, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "real", "sim" };
+
+struct sim_config {
+  const char *dev_path;
+  const char *config_file;   // other emulator settings, may be NULL
+  uint32_t ops;
+  uint32_t keys;
+  uint32_t vlen;
+  uint32_t read_pct;
+  uint32_t qdepth;
+  uint32_t units;
+  uint32_t seed;
+  std::vector<int> modes;
+};
+
+struct sim_op {
+  uint32_t key;
+  bool read;
+};
+
+struct sim_run;
+
+// one command in flight, slots are reused
+struct sim_slot {
+  sim_run *run;
+  uint32_t op;
+  char key[SIM_KEY_LEN];
+  char *value;
+  kv_key kvkey;
+  kv_value kvvalue;
+};
+
+struct sim_run {
+  const sim_config *cfg;
+  int mode;
+  kv_device_handle devH;
+  kv_namespace_handle nsH;
+  kv_queue_handle sqH;
+  kv_queue_handle cqH;
+  std::vector<sim_slot> slots;
+  std::vector<sim_slot *> free_slots;
+  std::vector<uint64_t> submitted;   // per op, device clock in ns
+  std::vector<uint64_t> latency;     // per op, ns
+  std::vector<uint64_t> digest;      // per op, result and value read
+  uint32_t inflight;
+  uint32_t errors;
+};
+
+static uint64_t _wall_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// the clock of the device: virtual when simulated
+static uint64_t _dev_ns(sim_run *run) {
+  uint64_t ns;
+  if (run->mode == MODE_SIM && kv_get_sim_time(run->devH, &ns) == KV_SUCCESS)
+    return ns;
+  return _wall_ns();
+}
+
+static uint64_t _fnv(uint64_t h, const void *buf, size_t len) {
+  const uint8_t *p = (const uint8_t *)buf;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-c config] [-n ops] [-k keys] [-v vlen] [-r read_pct] "
+         "[-q queue_depth] [-u units] [-s seed] [-m modes]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-c      config       :  emulator configuration file for other settings (default none)\n");
+  printf("-n      ops          :  number of mixed ops after the keys are stored (default 200000)\n");
+  printf("-k      keys         :  number of keys (default 10000)\n");
+  printf("-v      vlen         :  value length (default 4096)\n");
+  printf("-r      read_pct     :  share of reads in percent, the others overwrite (default 50)\n");
+  printf("-q      queue_depth  :  commands in flight (default 64)\n");
+  printf("-u      units        :  parallel units of the simulated device (default 1)\n");
+  printf("-s      seed         :  workload and simulation seed (default 1)\n");
+  printf("-m      modes        :  comma separated list of real,sim (default all)\n");
+  printf("==============\n");
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  std::string s(str);
+  size_t pos = 0;
+  while (pos <= s.size()) {
+    size_t end = s.find(',', pos);
+    if (end == std::string::npos) end = s.size();
+    std::string name = s.substr(pos, end - pos);
+    int mode = 0;
+    while (mode < MODE_MAX && name != mode_names[mode]) mode++;
+    if (mode == MODE_MAX) return false;
+    out->push_back(mode);
+    pos = end + 1;
+  }
+  return !out->empty();
+}
+
+// the settings of this run come first, the configuration file cannot
+// override them
+static int _write_config(const sim_config &cfg, int mode, char *path) {
+  strcpy(path, "/tmp/kvs_sim_bench_XXXXXX");
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    fprintf(stderr, "can not create a configuration file\n");
+    return FAILED;
+  }
+  FILE *fp = fdopen(fd, "w");
+  fprintf(fp, "[ general ]\n");
+  fprintf(fp, "    polling = true\n");
+  fprintf(fp, "    use_iops_model = true\n");
+  fprintf(fp, "    simulation = %s\n", mode == MODE_SIM ? "true" : "false");
+  fprintf(fp, "    simulation_units = %u\n", cfg.units);
+  fprintf(fp, "    simulation_seed = %u\n", cfg.seed);
+  if (cfg.config_file) {
+    FILE *in = fopen(cfg.config_file, "r");
+    if (in == NULL) {
+      fprintf(stderr, "can not read %s\n", cfg.config_file);
+      fclose(fp);
+      unlink(path);
+      return FAILED;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), in))
+      fputs(line, fp);
+    fclose(in);
+  }
+  fclose(fp);
+  return SUCCESS;
+}
+
+static void _make_key(char *key, uint32_t idx) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "sim%013u", idx);
+  memcpy(key, buf, SIM_KEY_LEN);
+}
+
+static void _on_complete(kv_io_context *ctx) {
+  sim_slot *slot = (sim_slot *)ctx->private_data;
+  sim_run *run = slot->run;
+  const uint32_t op = slot->op;
+
+  run->latency[op] = _dev_ns(run) - run->submitted[op];
+  uint64_t h = _fnv(14695981039346656037ULL, &ctx->retcode, sizeof(ctx->retcode));
+  if (ctx->opcode == KV_OPC_GET && ctx->retcode == KV_SUCCESS)
+    h = _fnv(h, slot->value, slot->kvvalue.length);
+  run->digest[op] = h;
+  if (ctx->retcode != KV_SUCCESS) run->errors++;
+
+  run->free_slots.push_back(slot);
+  run->inflight--;
+}
+
+static int _submit(sim_run *run, uint32_t op, const sim_op &w, bool store) {
+  sim_slot *slot = run->free_slots.back();
+  run->free_slots.pop_back();
+  slot->op = op;
+  _make_key(slot->key, w.key);
+  slot->kvkey.key = slot->key;
+  slot->kvkey.length = SIM_KEY_LEN;
+  slot->kvvalue.value = slot->value;
+  slot->kvvalue.length = run->cfg->vlen;
+  slot->kvvalue.actual_value_size = 0;
+  slot->kvvalue.offset = 0;
+  if (store) {
+    // the value names the op that wrote it
+    memset(slot->value, 's', run->cfg->vlen);
+    memcpy(slot->value, &op, sizeof(op));
+  }
+
+  kv_postprocess_function f = { _on_complete, slot, 0 };
+  run->submitted[op] = _dev_ns(run);
+  run->inflight++;
+  kv_result ret;
+  if (store)
+    ret = kv_store(run->sqH, run->nsH, SIM_KEYSPACE_ID, &slot->kvkey, &slot->kvvalue,
+                   KV_STORE_OPT_DEFAULT, &f);
+  else
+    ret = kv_retrieve(run->sqH, run->nsH, SIM_KEYSPACE_ID, &slot->kvkey,
+                      KV_RETRIEVE_OPT_DEFAULT, &slot->kvvalue, &f);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "%s failed with err 0x%x\n", store ? "kv_store" : "kv_retrieve", ret);
+    run->inflight--;
+    run->free_slots.push_back(slot);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+static int _poll(sim_run *run) {
+  uint32_t completed = run->cfg->qdepth;
+  kv_result ret = kv_poll_completion(run->cqH, 0, &completed);
+  if (ret != KV_SUCCESS && ret != KV_WRN_MORE) {
+    fprintf(stderr, "kv_poll_completion failed 0x%x\n", ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+// runs ops [first, last) at the queue depth
+static int _run_ops(sim_run *run, const std::vector<sim_op> &ops, uint32_t first,
+                    uint32_t last, bool load) {
+  uint32_t next = first;
+  while (next < last || run->inflight > 0) {
+    while (next < last && run->inflight < run->cfg->qdepth) {
+      if (_submit(run, next, ops[next], load || !ops[next].read) != SUCCESS)
+        return FAILED;
+      next++;
+    }
+    if (_poll(run) != SUCCESS) return FAILED;
+  }
+  return SUCCESS;
+}
+
+static int _open(sim_run *run, const char *config) {
+  kv_device_init_t dev_init;
+  memset(&dev_init, 0, sizeof(dev_init));
+  dev_init.devpath = (char *)run->cfg->dev_path;
+  dev_init.configfile = (char *)config;
+  dev_init.need_persistency = FALSE;
+  dev_init.is_polling = TRUE;
+  dev_init.queuedepth = run->cfg->qdepth;
+
+  kv_result ret = kv_initialize_device(&dev_init, &run->devH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_initialize_device failed 0x%x\n", ret);
+    return FAILED;
+  }
+  ret = get_namespace_default(run->devH, &run->nsH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "get_namespace_default failed 0x%x\n", ret);
+    return FAILED;
+  }
+  if (run->mode == MODE_SIM) {
+    uint64_t ns;
+    if (kv_get_sim_time(run->devH, &ns) != KV_SUCCESS) {
+      fprintf(stderr, "the device is not simulated\n");
+      return FAILED;
+    }
+  }
+
+  kv_queue qinfo;
+  qinfo.queue_id = 0;
+  qinfo.queue_size = run->cfg->qdepth;
+  qinfo.completion_queue_id = 0;
+  qinfo.queue_type = COMPLETION_Q_TYPE;
+  qinfo.extended_info = NULL;
+  ret = kv_create_queue(run->devH, &qinfo, &run->cqH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_create_queue failed 0x%x\n", ret);
+    return FAILED;
+  }
+  qinfo.queue_id = 1;
+  qinfo.queue_type = SUBMISSION_Q_TYPE;
+  ret = kv_create_queue(run->devH, &qinfo, &run->sqH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_create_queue failed 0x%x\n", ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+static void _close(sim_run *run) {
+  if (run->devH == NULL) return;
+  if (run->sqH) kv_delete_queue(run->devH, run->sqH);
+  if (run->cqH) kv_delete_queue(run->devH, run->cqH);
+  if (run->nsH) kv_delete_namespace(run->devH, run->nsH);
+  kv_cleanup_device(run->devH);
+}
+
+struct sim_result {
+  double wall_sec;
+  double dev_sec;
+  double mean_us;
+  double p99_us;
+  uint64_t digest;
+  uint32_t errors;
+};
+
+static int _run_mode(const sim_config &cfg, const std::vector<sim_op> &ops, int mode,
+                     sim_result *res) {
+  char config[64];
+  if (_write_config(cfg, mode, config) != SUCCESS) return FAILED;
+
+  sim_run run;
+  run.cfg = &cfg;
+  run.mode = mode;
+  run.devH = NULL;
+  run.nsH = NULL;
+  run.sqH = NULL;
+  run.cqH = NULL;
+  run.inflight = 0;
+  run.errors = 0;
+  run.slots.resize(cfg.qdepth);
+  for (auto &slot : run.slots) {
+    slot.run = &run;
+    slot.value = (char *)malloc(cfg.vlen);
+    run.free_slots.push_back(&slot);
+  }
+  run.submitted.assign(ops.size(), 0);
+  run.latency.assign(ops.size(), 0);
+  run.digest.assign(ops.size(), 0);
+
+  int result = _open(&run, config);
+  unlink(config);
+
+  const uint64_t wall_start = _wall_ns();
+  if (result == SUCCESS)
+    result = _run_ops(&run, ops, 0, cfg.keys, true);
+  const uint64_t dev_start = (result == SUCCESS) ? _dev_ns(&run) : 0;
+  if (result == SUCCESS)
+    result = _run_ops(&run, ops, cfg.keys, ops.size(), false);
+  const uint64_t dev_end = (result == SUCCESS) ? _dev_ns(&run) : 0;
+  const uint64_t wall_end = _wall_ns();
+  _close(&run);
+
+  if (result == SUCCESS) {
+    std::vector<uint64_t> lat(run.latency.begin() + cfg.keys, run.latency.end());
+    std::sort(lat.begin(), lat.end());
+    double sum = 0;
+    for (uint64_t l : lat) sum += l;
+    res->wall_sec = (wall_end - wall_start) / 1e9;
+    res->dev_sec = (dev_end - dev_start) / 1e9;
+    res->mean_us = sum / lat.size() / 1000;
+    res->p99_us = lat[(size_t)(lat.size() * 0.99)] / 1000.0;
+    res->digest = 14695981039346656037ULL;
+    for (uint64_t h : run.digest) res->digest = _fnv(res->digest, &h, sizeof(h));
+    res->errors = run.errors;
+
+    printf("%-5s %10.3f %10.0f %9.1f %9.1f %10.3f %016llx %6u\n", mode_names[mode],
+           res->dev_sec, cfg.ops / res->dev_sec, res->mean_us, res->p99_us,
+           res->wall_sec, (unsigned long long)res->digest, res->errors);
+  }
+  for (auto &slot : run.slots) free(slot.value);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  sim_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.config_file = NULL;
+  cfg.ops = 200000;
+  cfg.keys = 10000;
+  cfg.vlen = 4096;
+  cfg.read_pct = 50;
+  cfg.qdepth = 64;
+  cfg.units = 1;
+  cfg.seed = 1;
+  cfg.modes = { MODE_REAL, MODE_SIM };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:c:n:k:v:r:q:u:s:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 'c':
+      cfg.config_file = optarg;
+      break;
+    case 'n':
+      cfg.ops = atoi(optarg);
+      break;
+    case 'k':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'r':
+      cfg.read_pct = atoi(optarg);
+      break;
+    case 'q':
+      cfg.qdepth = atoi(optarg);
+      break;
+    case 'u':
+      cfg.units = atoi(optarg);
+      break;
+    case 's':
+      cfg.seed = atoi(optarg);
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.ops == 0 || cfg.keys == 0 || cfg.vlen < 64 || cfg.read_pct > 100 ||
+      cfg.qdepth == 0 || cfg.units == 0) {
+    usage(argv[0]);
+    return FAILED;
+  }
+  if (cfg.units > 1 && std::find(cfg.modes.begin(), cfg.modes.end(), (int)MODE_REAL) != cfg.modes.end()) {
+    fprintf(stderr, "real time runs have one unit, use -m sim with -u %u\n", cfg.units);
+    return FAILED;
+  }
+
+  // keys are stored first, in order, then read or overwritten at random
+  std::vector<sim_op> ops(cfg.keys + cfg.ops);
+  std::mt19937 rng(cfg.seed);
+  for (uint32_t i = 0; i < cfg.keys; i++)
+    ops[i] = sim_op{ i, false };
+  for (uint32_t i = cfg.keys; i < ops.size(); i++) {
+    ops[i].key = std::uniform_int_distribution<uint32_t>(0, cfg.keys - 1)(rng);
+    ops[i].read = std::uniform_int_distribution<uint32_t>(0, 99)(rng) < cfg.read_pct;
+  }
+
+  printf("%u ops over %u keys, %u byte values, %u%% reads, queue depth %u, %u unit(s), seed %u\n",
+         cfg.ops, cfg.keys, cfg.vlen, cfg.read_pct, cfg.qdepth, cfg.units, cfg.seed);
+  printf("%-5s %10s %10s %9s %9s %10s %16s %6s\n", "mode", "device(s)", "ops/s",
+         "mean(us)", "p99(us)", "wall(s)", "results", "errs");
+
+  int result = SUCCESS;
+  sim_result res[MODE_MAX];
+  bool ran[MODE_MAX] = { false, false };
+  for (int mode : cfg.modes) {
+    if (_run_mode(cfg, ops, mode, &res[mode]) != SUCCESS) {
+      result = FAILED;
+      continue;
+    }
+    ran[mode] = true;
+  }
+
+  if (ran[MODE_REAL] && ran[MODE_SIM]) {
+    const bool same = res[MODE_REAL].digest == res[MODE_SIM].digest;
+    printf("results %s, device time %+.1f%% in simulation, wall time speedup %.1fx\n",
+           same ? "identical" : "DIFFER",
+           (res[MODE_SIM].dev_sec / res[MODE_REAL].dev_sec - 1) * 100,
+           res[MODE_REAL].wall_sec / res[MODE_SIM].wall_sec);
+    if (!same) result = FAILED;
+  }
+  return result;
+}
@@ -0,0 +1,604 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Statistics consistency test.
+ *
+ * The counters the library exports to shared memory (kvs_stats_shm.h) are
+ * updated by many threads while other processes read them without a lock.
+ * This test checks that a reader never sees a torn record and that no
+ * update is lost:
+ *
+ *  records  writer threads record requests into fewer shards than there are
+ *           writers, so they contend for them, and update one queue record
+ *           with read-modify-write steps; reader threads copy the records
+ *           all the time and check, on every copy, that the histograms add
+ *           up to the counters, that the latency sum matches the buckets and
+ *           that nothing went backwards. At the end the totals have to be
+ *           exactly what the writers recorded.
+ *  library  threads send synchronous and asynchronous requests through the
+ *           API with KVSSD_STATS_SHM set while a reader maps the segment by
+ *           name, as another process would, and checks the device, queue
+ *           and key space records the same way. At the end the key space
+ *           has to count exactly the requests that were sent.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+#include "kvs_stats_shm.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define STATS_KEYSPACE_NAME "stats_consistency"
+#define STATS_KEY_LEN 16
+#define RECORD_BYTES 512
+
+struct stats_config {
+  const char *dev_path;
+  int writers;
+  int readers;
+  int shards;     // shards the record writers share
+  uint32_t count; // records or requests per writer
+  uint32_t vlen;
+  uint32_t async; // asynchronous stores a library writer keeps in flight
+};
+
+// what the readers found
+struct read_result {
+  std::atomic<uint64_t> copies;
+  std::atomic<uint64_t> retries;
+  std::atomic<uint64_t> violations;
+  read_result() : copies(0), retries(0), violations(0) {}
+};
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t writers] [-r readers] [-s shards] [-n count] "
+         "[-v vlen] [-q async]\n", program);
+  printf("-d      device_path  :  kvssd device path (default /dev/kvemul)\n");
+  printf("-t      writers      :  writer threads (default 4)\n");
+  printf("-r      readers      :  reader threads of the record test (default 2)\n");
+  printf("-s      shards       :  shards the record writers share (default 2)\n");
+  printf("-n      count        :  records or requests per writer (default 200000)\n");
+  printf("-v      vlen         :  value length of the library test (default 512)\n");
+  printf("-q      async        :  asynchronous stores in flight per library writer (default 16)\n");
+  printf("==============\n");
+}
+
+static void _violation(read_result *res, const char *what) {
+  if (res->violations++ < 10) fprintf(stderr, "inconsistent copy: %s\n", what);
+}
+
+// a consistent copy of a shard adds up, and follows the previous copy
+static void _check_shard(const kvs_stats_shard &sh, const kvs_stats_shard *prev,
+                         uint64_t bytes_per_op, read_result *res) {
+  for (int i = 0; i < KVS_STATS_NR_OPS; i++) {
+    const kvs_stats_op &op = sh.op[i];
+    uint64_t ops = 0;
+    for (int b = 0; b < KVS_STATS_LAT_BUCKETS; b++) ops += op.lat_hist[b];
+    if (ops != op.ops) _violation(res, "histogram does not add up to ops");
+    if (op.errors > op.ops) _violation(res, "more errors than ops");
+    if (bytes_per_op && op.bytes != op.ops * bytes_per_op)
+      _violation(res, "bytes do not match ops");
+    if (prev && (op.ops < prev->op[i].ops || op.errors < prev->op[i].errors
+                 || op.bytes < prev->op[i].bytes || op.lat_sum_ns < prev->op[i].lat_sum_ns))
+      _violation(res, "counter went backwards");
+  }
+}
+
+static void _check_queue(const kvs_stats_queue &q, const kvs_stats_queue *prev,
+                         read_result *res) {
+  uint64_t enqueued = 0;
+  for (int b = 0; b < KVS_STATS_DEPTH_BUCKETS; b++) enqueued += q.depth_hist[b];
+  if (enqueued != q.enqueued) _violation(res, "depth histogram does not add up");
+  if (q.enqueued - q.dequeued != q.depth) _violation(res, "depth does not match the queue");
+  if (q.depth > q.max_depth) _violation(res, "depth above the maximum");
+  if (prev && (q.enqueued < prev->enqueued || q.dequeued < prev->dequeued))
+    _violation(res, "queue counter went backwards");
+}
+
+//
+// records: the primitives of kvs_stats_shm.h
+//
+
+struct record_expect {
+  uint64_t ops[KVS_STATS_NR_OPS];
+  uint64_t errors[KVS_STATS_NR_OPS];
+  uint64_t lat_sum[KVS_STATS_NR_OPS];
+  uint64_t queue_updates;
+};
+
+static void _record_writer(kvs_stats_shard *shards, kvs_stats_queue *que,
+                           const stats_config *cfg, int id, record_expect *exp) {
+  kvs_stats_shard *sh = &shards[id % cfg->shards];
+  unsigned int seed = 4321 + id;
+  memset(exp, 0, sizeof(*exp));
+  for (uint32_t i = 0; i < cfg->count; i++) {
+    const int op = rand_r(&seed) % KVS_STATS_NR_OPS;
+    // powers of two, so the latency sum follows from the histogram
+    const uint64_t lat = 1ULL << (rand_r(&seed) % 24);
+    const bool failed = rand_r(&seed) % 7 == 0;
+    kvs_stats_record(sh, op, failed, RECORD_BYTES, lat);
+    exp->ops[op]++;
+    exp->errors[op] += failed;
+    exp->lat_sum[op] += lat;
+
+    // the new values depend on the old ones, a lost update shows
+    uint32_t s = kvs_stats_write_begin(&que->seq);
+    const uint64_t depth = __atomic_load_n(&que->depth, __ATOMIC_RELAXED);
+    if (depth > 0 && rand_r(&seed) % 2) {
+      kvs_stats_add(&que->dequeued, 1);
+      kvs_stats_set(&que->depth, depth - 1);
+    } else {
+      kvs_stats_add(&que->enqueued, 1);
+      kvs_stats_add(&que->depth_hist[kvs_stats_log2(depth, KVS_STATS_DEPTH_BUCKETS)], 1);
+      kvs_stats_set(&que->depth, depth + 1);
+      if (depth + 1 > que->max_depth) kvs_stats_set(&que->max_depth, depth + 1);
+    }
+    kvs_stats_write_end(&que->seq, s);
+    exp->queue_updates++;
+  }
+}
+
+static void _record_reader(const kvs_stats_shard *shards, const kvs_stats_queue *que,
+                           const stats_config *cfg, std::atomic<bool> *done,
+                           read_result *res) {
+  // std::allocator does not keep the 64 byte alignment before C++17
+  kvs_stats_shard *prev = NULL;
+  if (posix_memalign((void **)&prev, 64, sizeof(kvs_stats_shard) * cfg->shards) != 0) {
+    _violation(res, "out of memory");
+    return;
+  }
+  kvs_stats_queue prev_que;
+  bool first = true;
+  while (!done->load()) {
+    for (int i = 0; i < cfg->shards; i++) {
+      kvs_stats_shard sh;
+      res->retries += kvs_stats_read_shard(&shards[i], &sh);
+      res->copies++;
+      _check_shard(sh, first ? NULL : &prev[i], RECORD_BYTES, res);
+      for (int o = 0; o < KVS_STATS_NR_OPS; o++) {
+        const kvs_stats_op &op = sh.op[o];
+        uint64_t sum = 0;
+        for (int b = 0; b < KVS_STATS_LAT_BUCKETS; b++) sum += op.lat_hist[b] << b;
+        if (sum != op.lat_sum_ns) _violation(res, "latency sum does not match the buckets");
+      }
+      prev[i] = sh;
+    }
+    kvs_stats_queue q;
+    res->retries += kvs_stats_read_queue(que, &q);
+    res->copies++;
+    _check_queue(q, first ? NULL : &prev_que, res);
+    prev_que = q;
+    first = false;
+  }
+  free(prev);
+}
+
+static int _run_records(const stats_config &cfg) {
+  // shared like the segment, so the readers could be another process
+  const size_t size = sizeof(kvs_stats_shard) * cfg.shards + sizeof(kvs_stats_queue);
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+    return FAILED;
+  }
+  kvs_stats_shard *shards = (kvs_stats_shard *)mem;
+  kvs_stats_queue *que = (kvs_stats_queue *)(shards + cfg.shards);
+
+  std::vector<record_expect> exp(cfg.writers);
+  std::atomic<bool> done(false);
+  read_result res;
+  std::vector<std::thread> readers, writers;
+  for (int i = 0; i < cfg.readers; i++)
+    readers.push_back(std::thread(_record_reader, shards, que, &cfg, &done, &res));
+  for (int i = 0; i < cfg.writers; i++)
+    writers.push_back(std::thread(_record_writer, shards, que, &cfg, i, &exp[i]));
+  for (auto &t : writers) t.join();
+  done = true;
+  for (auto &t : readers) t.join();
+
+  // the totals are exactly what the writers recorded
+  int result = SUCCESS;
+  kvs_stats_shard total;
+  memset(&total, 0, sizeof(total));
+  for (int i = 0; i < cfg.shards; i++) {
+    for (int o = 0; o < KVS_STATS_NR_OPS; o++) {
+      total.op[o].ops += shards[i].op[o].ops;
+      total.op[o].errors += shards[i].op[o].errors;
+      total.op[o].lat_sum_ns += shards[i].op[o].lat_sum_ns;
+    }
+  }
+  uint64_t queue_updates = 0;
+  for (int o = 0; o < KVS_STATS_NR_OPS; o++) {
+    uint64_t ops = 0, errors = 0, lat_sum = 0;
+    for (int w = 0; w < cfg.writers; w++) {
+      ops += exp[w].ops[o];
+      errors += exp[w].errors[o];
+      lat_sum += exp[w].lat_sum[o];
+    }
+    if (ops != total.op[o].ops || errors != total.op[o].errors
+        || lat_sum != total.op[o].lat_sum_ns) {
+      fprintf(stderr, "%s: recorded %lu ops, counted %lu\n", "records",
+              (unsigned long)ops, (unsigned long)total.op[o].ops);
+      result = FAILED;
+    }
+  }
+  for (int w = 0; w < cfg.writers; w++) queue_updates += exp[w].queue_updates;
+  if (que->enqueued + que->dequeued != queue_updates) {
+    fprintf(stderr, "records: %lu queue updates, counted %lu\n",
+            (unsigned long)queue_updates, (unsigned long)(que->enqueued + que->dequeued));
+    result = FAILED;
+  }
+  if (res.violations) result = FAILED;
+
+  printf("records: %d writers on %d shards, %lu updates, %lu copies read, %lu retries, "
+         "%lu inconsistent: %s\n", cfg.writers, cfg.shards,
+         (unsigned long)(queue_updates * 2), (unsigned long)res.copies.load(),
+         (unsigned long)res.retries.load(), (unsigned long)res.violations.load(),
+         result == SUCCESS ? "PASS" : "FAIL");
+  munmap(mem, size);
+  return result;
+}
+
+//
+// library: the counters of the API and the emulator
+//
+
+struct library_expect {
+  uint64_t stores;
+  uint64_t retrieves;
+  uint64_t deletes;
+  uint64_t errors;
+};
+
+struct async_store {
+  char key[STATS_KEY_LEN];
+  kvs_key kvskey;
+  kvs_value kvsvalue;
+  std::atomic<uint32_t> *pending;
+  std::atomic<uint64_t> *errors;
+};
+
+static void _on_store(kvs_postprocess_context *ctx) {
+  async_store *req = (async_store *)ctx->private1;
+  if (ctx->result != KVS_SUCCESS) (*req->errors)++;
+  (*req->pending)--;
+}
+
+static void _make_key(char *buf, int id, uint32_t idx) {
+  char tmp[32];
+  snprintf(tmp, sizeof(tmp), "st%02d%012u", id, idx);
+  memcpy(buf, tmp, STATS_KEY_LEN);
+}
+
+static void _library_writer(kvs_key_space_handle ks, const stats_config *cfg, int id,
+                            library_expect *exp) {
+  char *key = (char *)kvs_malloc(STATS_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  char *async_values = (char *)kvs_malloc((size_t)cfg->vlen * cfg->async, 4096);
+  std::vector<async_store> reqs(cfg->async);
+  std::atomic<uint32_t> pending(0);
+  std::atomic<uint64_t> async_errors(0);
+  memset(value, 's', cfg->vlen);
+  memset(async_values, 'a', (size_t)cfg->vlen * cfg->async);
+  memset(exp, 0, sizeof(*exp));
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  kvs_option_retrieve rt_opt;
+  memset(&rt_opt, 0, sizeof(rt_opt));
+  kvs_option_delete del_opt = { false };
+
+  for (uint32_t i = 0; i < cfg->count; i++) {
+    _make_key(key, id, i);
+    kvs_key kvskey = { key, STATS_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    kvs_result ret;
+    switch (i % 4) {
+    case 0:
+    case 1:
+      ret = kvs_store_kvp(ks, &kvskey, &kvsvalue, &st_opt);
+      exp->stores++;
+      break;
+    case 2:
+      // the key stored two requests ago
+      _make_key(key, id, i - 2);
+      ret = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &kvsvalue);
+      exp->retrieves++;
+      break;
+    default:
+      _make_key(key, id, i - 2);
+      ret = kvs_delete_kvp(ks, &kvskey, &del_opt);
+      exp->deletes++;
+      break;
+    }
+    if (ret != KVS_SUCCESS) exp->errors++;
+
+    if (cfg->async && i % 64 == 0) {
+      // a window of asynchronous stores, they complete on other threads
+      for (uint32_t a = 0; a < cfg->async; a++) {
+        async_store *req = &reqs[a];
+        _make_key(req->key, id, cfg->count + a);
+        req->kvskey = { req->key, STATS_KEY_LEN };
+        req->kvsvalue = { async_values + (size_t)a * cfg->vlen, cfg->vlen, 0, 0 };
+        req->pending = &pending;
+        req->errors = &async_errors;
+        pending++;
+        ret = kvs_store_kvp_async(ks, &req->kvskey, &req->kvsvalue, &st_opt, req, NULL,
+                                  _on_store);
+        if (ret != KVS_SUCCESS) {
+          pending--;
+          exp->errors++;
+        }
+        exp->stores++;
+      }
+      while (pending.load() > 0) usleep(10);
+    }
+  }
+  exp->errors += async_errors.load();
+  kvs_free(key);
+  kvs_free(value);
+  kvs_free(async_values);
+}
+
+static const kvs_stats_segment *_map(const char *path) {
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  void *addr = mmap(NULL, sizeof(kvs_stats_segment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "cannot map %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  const kvs_stats_segment *seg = (const kvs_stats_segment *)addr;
+  if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != KVS_STATS_SHM_MAGIC
+      || seg->version != KVS_STATS_SHM_VERSION || seg->size != sizeof(kvs_stats_segment)) {
+    fprintf(stderr, "%s is not a statistics segment of this version\n", path);
+    munmap(addr, sizeof(kvs_stats_segment));
+    return NULL;
+  }
+  return seg;
+}
+
+static void _library_reader(const kvs_stats_device *dev, const kvs_stats_key_space *ks,
+                            std::atomic<bool> *done, read_result *res) {
+  kvs_stats_shard prev_dev[KVS_STATS_SHARDS], prev_ks[KVS_STATS_SHARDS];
+  kvs_stats_queue prev_que[KVS_STATS_MAX_QUEUES];
+  bool first = true;
+  while (!done->load()) {
+    for (int i = 0; i < KVS_STATS_SHARDS; i++) {
+      kvs_stats_shard sh;
+      res->retries += kvs_stats_read_shard(&dev->shard[i], &sh);
+      _check_shard(sh, first ? NULL : &prev_dev[i], 0, res);
+      prev_dev[i] = sh;
+      res->retries += kvs_stats_read_shard(&ks->shard[i], &sh);
+      _check_shard(sh, first ? NULL : &prev_ks[i], 0, res);
+      prev_ks[i] = sh;
+      res->copies += 2;
+    }
+    const uint32_t nqueues = __atomic_load_n(&dev->nqueues, __ATOMIC_ACQUIRE);
+    for (uint32_t q = 0; q < nqueues && q < KVS_STATS_MAX_QUEUES; q++) {
+      kvs_stats_queue que;
+      res->retries += kvs_stats_read_queue(&dev->queue[q], &que);
+      _check_queue(que, first ? NULL : &prev_que[q], res);
+      prev_que[q] = que;
+      res->copies++;
+    }
+    first = false;
+    usleep(100);
+  }
+}
+
+static int _run_library(const stats_config &cfg) {
+  char name[64];
+  snprintf(name, sizeof(name), "/kvs_stats_consistency.%d", (int)getpid());
+  // read when the first device is opened
+  setenv("KVSSD_STATS_SHM", name, 1);
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)STATS_KEYSPACE_NAME;
+  ks_name.name_len = strlen(STATS_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_key_space_handle ks;
+  ret = kvs_open_key_space(dev, (char *)STATS_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  int result = FAILED;
+  const kvs_stats_segment *seg = _map(name);
+  const kvs_stats_device *sdev = NULL;
+  const kvs_stats_key_space *sks = NULL;
+  for (int i = 0; seg && i < KVS_STATS_MAX_DEVICES; i++) {
+    if (seg->device[i].state == KVS_STATS_SLOT_OPEN
+        && strcmp(seg->device[i].name, cfg.dev_path) == 0) sdev = &seg->device[i];
+  }
+  for (int i = 0; seg && i < KVS_STATS_MAX_KEY_SPACES; i++) {
+    if (seg->key_space[i].state == KVS_STATS_SLOT_OPEN
+        && strcmp(seg->key_space[i].name, STATS_KEYSPACE_NAME) == 0) sks = &seg->key_space[i];
+  }
+  if (sdev == NULL || sks == NULL) {
+    // shm_name of [stats] in env_init.conf wins over the environment
+    fprintf(stderr, "the device or key space is not exported to %s\n", name);
+  } else {
+    std::vector<library_expect> exp(cfg.writers);
+    std::atomic<bool> done(false);
+    read_result res;
+    std::thread reader(_library_reader, sdev, sks, &done, &res);
+    std::vector<std::thread> writers;
+    for (int i = 0; i < cfg.writers; i++)
+      writers.push_back(std::thread(_library_writer, ks, &cfg, i, &exp[i]));
+    for (auto &t : writers) t.join();
+    done = true;
+    reader.join();
+
+    library_expect sent;
+    memset(&sent, 0, sizeof(sent));
+    for (auto &e : exp) {
+      sent.stores += e.stores;
+      sent.retrieves += e.retrieves;
+      sent.deletes += e.deletes;
+      sent.errors += e.errors;
+    }
+    kvs_stats_shard dev_total, ks_total;
+    kvs_stats_read_total(sdev->shard, &dev_total);
+    kvs_stats_read_total(sks->shard, &ks_total);
+
+    result = SUCCESS;
+    const struct { int op; uint64_t sent; const char *name; } ops[] = {
+      { KVS_STATS_STORE, sent.stores, "stores" },
+      { KVS_STATS_RETRIEVE, sent.retrieves, "retrieves" },
+      { KVS_STATS_DELETE, sent.deletes, "deletes" },
+    };
+    for (const auto &o : ops) {
+      const uint64_t counted = ks_total.op[o.op].ops;
+      printf("library: %-9s sent %8lu, key space counted %8lu, device %8lu\n", o.name,
+             (unsigned long)o.sent, (unsigned long)counted,
+             (unsigned long)dev_total.op[o.op].ops);
+      // the device also counts the requests on the key space metadata
+      if (counted != o.sent || dev_total.op[o.op].ops < counted) result = FAILED;
+    }
+    if (ks_total.op[KVS_STATS_STORE].bytes != sent.stores * cfg.vlen) {
+      fprintf(stderr, "library: %lu store bytes counted, %lu sent\n",
+              (unsigned long)ks_total.op[KVS_STATS_STORE].bytes,
+              (unsigned long)(sent.stores * cfg.vlen));
+      result = FAILED;
+    }
+    uint64_t errors = 0;
+    for (int o = 0; o < KVS_STATS_NR_OPS; o++) errors += ks_total.op[o].errors;
+    if (errors != sent.errors) {
+      fprintf(stderr, "library: %lu errors counted, %lu returned\n",
+              (unsigned long)errors, (unsigned long)sent.errors);
+      result = FAILED;
+    }
+    // every command left its queues
+    const uint32_t nqueues = sdev->nqueues;
+    for (uint32_t q = 0; q < nqueues && q < KVS_STATS_MAX_QUEUES; q++) {
+      kvs_stats_queue que;
+      kvs_stats_read_queue(&sdev->queue[q], &que);
+      printf("library: queue %u enqueued %lu, dequeued %lu, max depth %lu\n", que.queue_id,
+             (unsigned long)que.enqueued, (unsigned long)que.dequeued,
+             (unsigned long)que.max_depth);
+      if (que.enqueued != que.dequeued || que.depth != 0) result = FAILED;
+    }
+    if (res.violations) result = FAILED;
+    printf("library: %d writers, %lu copies read, %lu retries, %lu inconsistent: %s\n",
+           cfg.writers, (unsigned long)res.copies.load(), (unsigned long)res.retries.load(),
+           (unsigned long)res.violations.load(), result == SUCCESS ? "PASS" : "FAIL");
+  }
+
+  if (seg) munmap((void *)seg, sizeof(kvs_stats_segment));
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+  shm_unlink(name);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  stats_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.writers = 4;
+  cfg.readers = 2;
+  cfg.shards = 2;
+  cfg.count = 200000;
+  cfg.vlen = 512;
+  cfg.async = 16;
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:r:s:n:v:q:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.writers = atoi(optarg);
+      break;
+    case 'r':
+      cfg.readers = atoi(optarg);
+      break;
+    case 's':
+      cfg.shards = atoi(optarg);
+      break;
+    case 'n':
+      cfg.count = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'q':
+      cfg.async = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.writers <= 0 || cfg.writers > 99 || cfg.readers <= 0 || cfg.shards <= 0
+      || cfg.count < 4 || cfg.vlen < 64 || cfg.vlen % 4) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  int result = _run_records(cfg);
+  result |= _run_library(cfg);
+  return result;
+}
@@ -0,0 +1,240 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Statistics reader.
+ *
+ * Maps the statistics segment of a process that uses the library with
+ * KVSSD_STATS_SHM set (see kvs_stats_shm.h) and prints the counters of its
+ * devices, their queues and key spaces. It only reads shared memory: the
+ * process being watched does not notice it.
+ *
+ * With -i it prints every interval seconds and adds the rates since the
+ * previous print; a slot that was taken again in between starts from zero.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include "kvs_stats_shm.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+static const char *op_names[KVS_STATS_NR_OPS] = {
+  "store", "retrieve", "delete", "exist", "iterate", "batch"
+};
+
+// what the previous print saw of a slot
+struct slot_prev {
+  uint32_t generation;
+  kvs_stats_shard total;
+};
+
+static double _now_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-n shm_name] [-i interval] [-c count]\n", program);
+  printf("-n      shm_name     :  statistics segment (default $KVSSD_STATS_SHM)\n");
+  printf("-i      interval     :  print every interval seconds with rates (default print once)\n");
+  printf("-c      count        :  prints with -i (default until interrupted)\n");
+  printf("==============\n");
+}
+
+static const kvs_stats_segment *_map(const char *name) {
+  const std::string path = name[0] == '/' ? name : std::string("/") + name;
+  int fd = shm_open(path.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s: %s\n", path.c_str(), strerror(errno));
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(kvs_stats_segment)) {
+    fprintf(stderr, "%s is not a statistics segment of this version\n", path.c_str());
+    close(fd);
+    return NULL;
+  }
+  void *addr = mmap(NULL, sizeof(kvs_stats_segment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "cannot map %s: %s\n", path.c_str(), strerror(errno));
+    return NULL;
+  }
+  const kvs_stats_segment *seg = (const kvs_stats_segment *)addr;
+  if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != KVS_STATS_SHM_MAGIC
+      || seg->version != KVS_STATS_SHM_VERSION || seg->size != sizeof(kvs_stats_segment)) {
+    fprintf(stderr, "%s is not a statistics segment of this version\n", path.c_str());
+    munmap(addr, sizeof(kvs_stats_segment));
+    return NULL;
+  }
+  return seg;
+}
+
+// upper bound of the bucket the quantile q falls in
+static uint64_t _quantile_ns(const kvs_stats_op &op, double q) {
+  uint64_t seen = 0;
+  const uint64_t want = (uint64_t)(op.ops * q);
+  for (int i = 0; i < KVS_STATS_LAT_BUCKETS; i++) {
+    seen += op.lat_hist[i];
+    if (seen > want) return 2ULL << i;
+  }
+  return 2ULL << (KVS_STATS_LAT_BUCKETS - 1);
+}
+
+static void _print_ops(const kvs_stats_shard &total, const kvs_stats_shard *prev,
+                       double secs) {
+  printf("    %-9s %12s %10s %8s %10s %9s %9s %9s\n", "op", "ops", "ops/s", "errors",
+         "MB", "mean us", "p50 us", "p99 us");
+  for (int i = 0; i < KVS_STATS_NR_OPS; i++) {
+    const kvs_stats_op &op = total.op[i];
+    if (op.ops == 0) continue;
+    double rate = 0;
+    if (prev && secs > 0) rate = (op.ops - prev->op[i].ops) / secs;
+    printf("    %-9s %12lu ", op_names[i], (unsigned long)op.ops);
+    if (prev) printf("%10.0f ", rate);
+    else printf("%10s ", "-");
+    printf("%8lu %10.1f %9.1f %9.1f %9.1f\n", (unsigned long)op.errors, op.bytes / 1e6,
+           op.lat_sum_ns / 1e3 / op.ops, _quantile_ns(op, 0.5) / 1e3,
+           _quantile_ns(op, 0.99) / 1e3);
+  }
+}
+
+// the previous total of a slot, NULL on the first print or after reuse
+static const kvs_stats_shard *_prev(slot_prev *prev, bool first, uint32_t generation) {
+  if (first || prev->generation != generation) return NULL;
+  return &prev->total;
+}
+
+static void _print(const kvs_stats_segment *seg, slot_prev *devs, slot_prev *kss,
+                   bool first, double secs) {
+  for (int d = 0; d < KVS_STATS_MAX_DEVICES; d++) {
+    const kvs_stats_device *dev = &seg->device[d];
+    if (__atomic_load_n(&dev->state, __ATOMIC_ACQUIRE) != KVS_STATS_SLOT_OPEN) continue;
+    const uint32_t generation = dev->generation;
+    kvs_stats_shard total;
+    kvs_stats_read_total(dev->shard, &total);
+    printf("device %d %s\n", d, dev->name);
+    _print_ops(total, _prev(&devs[d], first, generation), secs);
+    devs[d].generation = generation;
+    devs[d].total = total;
+
+    const uint32_t nqueues = __atomic_load_n(&dev->nqueues, __ATOMIC_ACQUIRE);
+    for (uint32_t q = 0; q < nqueues && q < KVS_STATS_MAX_QUEUES; q++) {
+      kvs_stats_queue que;
+      kvs_stats_read_queue(&dev->queue[q], &que);
+      printf("    queue %u (%s): enqueued %lu, dequeued %lu, depth %lu, max depth %lu, depth found:",
+             que.queue_id, que.queue_type == 0 ? "submission" : "completion",
+             (unsigned long)que.enqueued, (unsigned long)que.dequeued,
+             (unsigned long)que.depth, (unsigned long)que.max_depth);
+      for (int b = 0; b < KVS_STATS_DEPTH_BUCKETS; b++) {
+        if (que.depth_hist[b]) printf(" <%d:%lu", 2 << b, (unsigned long)que.depth_hist[b]);
+      }
+      printf("\n");
+    }
+  }
+  for (int k = 0; k < KVS_STATS_MAX_KEY_SPACES; k++) {
+    const kvs_stats_key_space *ks = &seg->key_space[k];
+    if (__atomic_load_n(&ks->state, __ATOMIC_ACQUIRE) != KVS_STATS_SLOT_OPEN) continue;
+    const uint32_t generation = ks->generation;
+    kvs_stats_shard total;
+    kvs_stats_read_total(ks->shard, &total);
+    printf("key space %s on device %d\n", ks->name, ks->device);
+    _print_ops(total, _prev(&kss[k], first, generation), secs);
+    kss[k].generation = generation;
+    kss[k].total = total;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *name = getenv("KVSSD_STATS_SHM");
+  double interval = 0;
+  int count = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "n:i:c:h")) != -1) {
+    switch (c) {
+    case 'n':
+      name = optarg;
+      break;
+    case 'i':
+      interval = atof(optarg);
+      break;
+    case 'c':
+      count = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (name == NULL || *name == '\0' || interval < 0 || count < 0) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  const kvs_stats_segment *seg = _map(name);
+  if (seg == NULL) return FAILED;
+  static slot_prev devs[KVS_STATS_MAX_DEVICES];
+  static slot_prev kss[KVS_STATS_MAX_KEY_SPACES];
+
+  double last = _now_s();
+  for (int n = 0; ; n++) {
+    const double now = _now_s();
+    const bool alive = kill(seg->pid, 0) == 0 || errno == EPERM;
+    printf("%s: pid %d%s\n", name, seg->pid, alive ? "" : " (exited)");
+    _print(seg, devs, kss, n == 0, now - last);
+    last = now;
+    if (interval == 0 || (count > 0 && n + 1 >= count)) break;
+    printf("\n");
+    usleep((useconds_t)(interval * 1e6));
+  }
+  return SUCCESS;
+}
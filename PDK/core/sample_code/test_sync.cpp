@@ -94,8 +94,7 @@ int perform_read(int id, kvs_key_space_handle ks_hd, int count, uint16_t klen, u
   for (int i = start_key; i < start_key + count; i++) {
     memset(value, 0, vlen);
     sprintf(key, "%0*d", klen - 1, i);
-    kvs_option_retrieve option;
-    option.kvs_retrieve_delete = false;
+    kvs_option_retrieve option = { false };
 
     kvs_key kvskey = {key, klen};
     kvs_value kvsvalue = {value, vlen, 0, 0};
@@ -129,9 +128,7 @@ int perform_insertion(int id, kvs_key_space_handle ks_hd, int count, uint16_t kl
   int start_key = id * count;
   for(int i = start_key; i < start_key + count; i++) {
     sprintf(key, "%0*d", klen - 1, i);
-    kvs_option_store option;
-    option.st_type = KVS_STORE_POST;
-    option.assoc = NULL;
+    kvs_option_store option = {KVS_STORE_POST, NULL};
         
     kvs_key  kvskey = {key, klen};
     kvs_value kvsvalue = {value, vlen, 0, 0};
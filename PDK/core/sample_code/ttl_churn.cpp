@@ -0,0 +1,484 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Steady churn benchmark for key value pairs with a time to live.
+ *
+ * Writer threads keep storing new keys at a fixed rate and read back random
+ * recent ones, so the live key set stays around rate * ttl pairs while
+ * older pairs keep expiring. Two ways of getting rid of them are compared:
+ *
+ *  ttl    pairs are stored with kvs_option_store.ttl_ms, the device drops
+ *         them lazily and with its rate limited background reaper
+ *  sweep  pairs carry their expiry time in the value, a host sweeper
+ *         iterates the key space, reads every value and deletes expired pairs
+ *
+ * For each mode the foreground rate, the work spent on expiration and the
+ * number of reads that returned an expired pair are reported.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define TTL_KEYSPACE_NAME "ttl_churn"
+#define TTL_KEY_PREFIX "ttlk"
+#define TTL_KEY_LEN 16
+
+enum ttl_mode { MODE_TTL = 0, MODE_SWEEP, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "ttl", "sweep" };
+
+struct ttl_config {
+  const char *dev_path;
+  int threads;
+  int seconds;
+  uint32_t ttl_ms;
+  uint32_t rate;       // stores per second per thread
+  uint32_t vlen;
+  int read_pct;
+  uint32_t sweep_pause_ms;
+  std::vector<int> modes;
+};
+
+struct ttl_writer {
+  int id;
+  const ttl_config *cfg;
+  kvs_key_space_handle ks;
+  int mode;
+  uint64_t deadline_ms;
+  std::vector<uint64_t> issued_ms;   // store issue and completion time per
+  std::vector<uint64_t> done_ms;     // sequence number
+  uint64_t stores;
+  uint64_t reads;
+  uint64_t stale;                    // read returned a pair past its ttl
+  uint64_t early;                    // pair was gone before its ttl
+  uint64_t errors;
+};
+
+struct ttl_sweeper {
+  const ttl_config *cfg;
+  kvs_key_space_handle ks;
+  std::atomic<bool> stop;
+  uint64_t passes;
+  uint64_t iterations;
+  uint64_t retrieves;
+  uint64_t deletes;
+  uint64_t deleted_bytes;
+  uint64_t errors;
+};
+
+static uint64_t _now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-s seconds] [-T ttl_ms] [-r rate] [-v vlen] "
+         "[-R read_pct] [-p sweep_pause_ms] [-m modes]\n", program);
+  printf("-d      device_path     :  device path (default /dev/kvemul)\n");
+  printf("-t      threads         :  number of writer threads (default 2)\n");
+  printf("-s      seconds         :  run time per mode (default 10)\n");
+  printf("-T      ttl_ms          :  time to live of every pair (default 1000)\n");
+  printf("-r      rate            :  stores per second per thread (default 5000)\n");
+  printf("-v      vlen            :  value length (default 512)\n");
+  printf("-R      read_pct        :  share of reads of recent keys (default 20)\n");
+  printf("-p      sweep_pause_ms  :  pause between sweeper passes (default 100)\n");
+  printf("-m      modes           :  comma separated list of ttl,sweep (default both)\n");
+  printf("==============\n");
+}
+
+static void _make_key(char *key, int thread, uint64_t seq) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%02d%010lu", TTL_KEY_PREFIX, thread % 100,
+           (unsigned long)(seq % 10000000000ULL));
+  memcpy(key, buf, TTL_KEY_LEN);
+}
+
+static void _run_writer(ttl_writer *w) {
+  const ttl_config *cfg = w->cfg;
+  unsigned int seed = w->id + 1;
+  char *key = (char *)kvs_malloc(TTL_KEY_LEN, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  memset(value, 'v', cfg->vlen);
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  if (w->mode == MODE_TTL) st_opt.ttl_ms = cfg->ttl_ms;
+  kvs_option_retrieve rt_opt = { false };
+  // reads pick among the keys of the last two ttl periods, half are expired
+  uint64_t window = 2ULL * cfg->ttl_ms * cfg->rate / 1000 + 1;
+  // reads come on top of the store rate
+  uint64_t op_rate = (uint64_t)cfg->rate * 100 / (100 - cfg->read_pct);
+  uint64_t start = _now_ms();
+
+  while (true) {
+    uint64_t now = _now_ms();
+    if (now >= w->deadline_ms) break;
+    if (now - start < (w->stores + w->reads) * 1000 / op_rate) {
+      usleep(1000);
+      continue;
+    }
+    bool read = w->stores > 0 && (int)(rand_r(&seed) % 100) < cfg->read_pct;
+
+    kvs_key kvskey = { key, TTL_KEY_LEN };
+    kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+    if (read) {
+      uint64_t back = rand_r(&seed) % std::min(window, w->stores);
+      uint64_t seq = w->stores - 1 - back;
+      _make_key(key, w->id, seq);
+      uint64_t before = _now_ms();
+      kvs_result ret = kvs_retrieve_kvp(w->ks, &kvskey, &rt_opt, &kvsvalue);
+      uint64_t after = _now_ms();
+      if (ret == KVS_ERR_BUFFER_SMALL) ret = KVS_SUCCESS;
+      // the device starts the ttl between issue and completion of the store,
+      // allow one ms of clock granularity
+      if (ret == KVS_SUCCESS) {
+        if (before > w->done_ms[seq] + cfg->ttl_ms + 1) w->stale++;
+      } else if (ret == KVS_ERR_KEY_NOT_EXIST) {
+        if (after + 1 < w->issued_ms[seq] + cfg->ttl_ms) w->early++;
+      } else {
+        w->errors++;
+      }
+      w->reads++;
+      continue;
+    }
+
+    _make_key(key, w->id, w->stores);
+    uint64_t issued = _now_ms();
+    uint64_t expiry = issued + cfg->ttl_ms;
+    memcpy(value, &expiry, sizeof(expiry));
+    kvs_result ret = kvs_store_kvp(w->ks, &kvskey, &kvsvalue, &st_opt);
+    if (ret != KVS_SUCCESS) w->errors++;
+    w->issued_ms.push_back(issued);
+    w->done_ms.push_back(_now_ms());
+    w->stores++;
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static void _key_group_filter(kvs_key_group_filter *fltr) {
+  memset(fltr, 0, sizeof(*fltr));
+  for (int i = 0; i < 4; i++) {
+    fltr->bitmask[i] = 0xff;
+    fltr->bit_pattern[i] = TTL_KEY_PREFIX[i];
+  }
+}
+
+// one pass over the key space: read the expiry time stored in every value
+// and delete the expired pairs
+static void _sweep_pass(ttl_sweeper *s, kvs_iterator_list *iter_list, char *value) {
+  kvs_option_iterator iter_op = { KVS_ITERATOR_KEY };
+  kvs_key_group_filter iter_fltr;
+  kvs_iterator_handle iter_hd;
+  _key_group_filter(&iter_fltr);
+
+  kvs_result ret = kvs_create_iterator(s->ks, &iter_op, &iter_fltr, &iter_hd);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "open iterator failed with err 0x%x\n", ret);
+    s->errors++;
+    return;
+  }
+
+  kvs_option_retrieve rt_opt = { false };
+  kvs_option_delete del_opt = { false };
+  do {
+    iter_list->size = KVS_ITERATOR_BUFFER_SIZE;
+    iter_list->num_entries = 0;
+    iter_list->end = false;
+    ret = kvs_iterate_next(s->ks, iter_hd, iter_list);
+    s->iterations++;
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "iterator next failed with err 0x%x\n", ret);
+      s->errors++;
+      break;
+    }
+
+    // variable key length iterator output: [u32 key_len][key]
+    uint8_t *it_buffer = iter_list->it_list;
+    for (uint32_t i = 0; i < iter_list->num_entries; i++) {
+      uint32_t key_size = *((uint32_t *)it_buffer);
+      it_buffer += sizeof(uint32_t);
+      kvs_key kvskey = { it_buffer, (uint16_t)key_size };
+      kvs_value kvsvalue = { value, s->cfg->vlen, 0, 0 };
+      it_buffer += key_size;
+
+      ret = kvs_retrieve_kvp(s->ks, &kvskey, &rt_opt, &kvsvalue);
+      s->retrieves++;
+      if (ret == KVS_ERR_KEY_NOT_EXIST) continue;
+      if (ret != KVS_SUCCESS && ret != KVS_ERR_BUFFER_SMALL) {
+        s->errors++;
+        continue;
+      }
+      uint64_t expiry;
+      memcpy(&expiry, value, sizeof(expiry));
+      if (expiry > _now_ms()) continue;
+
+      ret = kvs_delete_kvp(s->ks, &kvskey, &del_opt);
+      s->deletes++;
+      if (ret == KVS_SUCCESS) s->deleted_bytes += key_size + kvsvalue.actual_value_size;
+      else if (ret != KVS_ERR_KEY_NOT_EXIST) s->errors++;
+    }
+  } while (!iter_list->end && !s->stop);
+
+  kvs_delete_iterator(s->ks, iter_hd);
+}
+
+static void _run_sweeper(ttl_sweeper *s) {
+  kvs_iterator_list iter_list;
+  iter_list.it_list = (uint8_t *)kvs_malloc(KVS_ITERATOR_BUFFER_SIZE, 4096);
+  char *value = (char *)kvs_malloc(s->cfg->vlen, 4096);
+  while (!s->stop) {
+    _sweep_pass(s, &iter_list, value);
+    s->passes++;
+    for (uint32_t ms = 0; ms < s->cfg->sweep_pause_ms && !s->stop; ms++) usleep(1000);
+  }
+  kvs_free(value);
+  kvs_free(iter_list.it_list);
+}
+
+static int _open_key_space(kvs_device_handle dev, kvs_key_space_handle *ks) {
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)TTL_KEYSPACE_NAME;
+  ks_name.name_len = strlen(TTL_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  kvs_result ret = kvs_open_key_space(dev, (char *)TTL_KEYSPACE_NAME, ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+static void _drop_key_space(kvs_device_handle dev, kvs_key_space_handle ks) {
+  kvs_key_space_name ks_name;
+  ks_name.name = (char *)TTL_KEYSPACE_NAME;
+  ks_name.name_len = strlen(TTL_KEYSPACE_NAME);
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+}
+
+static int _run_mode(kvs_device_handle dev, const ttl_config &cfg, int mode) {
+  kvs_key_space_handle ks;
+  if (_open_key_space(dev, &ks) != SUCCESS) return FAILED;
+
+  kvs_ttl_stats before, after;
+  memset(&before, 0, sizeof(before));
+  memset(&after, 0, sizeof(after));
+  if (mode == MODE_TTL && kvs_get_ttl_stats(dev, &before) != KVS_SUCCESS) {
+    fprintf(stderr, "the device does not support time to live\n");
+    _drop_key_space(dev, ks);
+    return FAILED;
+  }
+
+  uint64_t start = _now_ms();
+  std::vector<ttl_writer *> writers;
+  for (int i = 0; i < cfg.threads; i++) {
+    ttl_writer *w = new ttl_writer();
+    w->id = i;
+    w->cfg = &cfg;
+    w->ks = ks;
+    w->mode = mode;
+    w->deadline_ms = start + cfg.seconds * 1000ULL;
+    w->issued_ms.reserve((uint64_t)cfg.rate * cfg.seconds + 1);
+    w->done_ms.reserve((uint64_t)cfg.rate * cfg.seconds + 1);
+    writers.push_back(w);
+  }
+  ttl_sweeper sweeper;
+  memset((void *)&sweeper, 0, sizeof(sweeper));
+  sweeper.cfg = &cfg;
+  sweeper.ks = ks;
+  sweeper.stop = false;
+
+  std::vector<std::thread> threads;
+  for (auto w : writers) threads.push_back(std::thread(_run_writer, w));
+  std::thread sweep_thread;
+  if (mode == MODE_SWEEP) sweep_thread = std::thread(_run_sweeper, &sweeper);
+  for (auto &t : threads) t.join();
+  sweeper.stop = true;
+  if (sweep_thread.joinable()) sweep_thread.join();
+  double secs = (_now_ms() - start) / 1000.0;
+  if (mode == MODE_TTL) kvs_get_ttl_stats(dev, &after);
+
+  uint64_t stores = 0, reads = 0, stale = 0, early = 0, errors = sweeper.errors;
+  for (auto w : writers) {
+    stores += w->stores;
+    reads += w->reads;
+    stale += w->stale;
+    early += w->early;
+    errors += w->errors;
+  }
+
+  // pairs expired by the device or the sweeper, and the commands it took
+  uint64_t expired, expired_bytes, commands;
+  double busy_pct;
+  if (mode == MODE_TTL) {
+    uint64_t reaped = after.reaped - before.reaped;
+    expired = reaped + after.expired_lazy - before.expired_lazy;
+    expired_bytes = after.reaped_bytes - before.reaped_bytes;
+    commands = 0;
+    busy_pct = (after.reaper_busy_ns - before.reaper_busy_ns) / (secs * 1e7);
+  } else {
+    expired = sweeper.deletes;
+    expired_bytes = sweeper.deleted_bytes;
+    commands = sweeper.iterations + sweeper.retrieves + sweeper.deletes;
+    busy_pct = 0;
+  }
+
+  printf("%-6s %9.0f %9.0f %9.0f %9.2f %9lu %8.1f %7.2f%% %8lu %6lu %6lu\n",
+         mode_names[mode], (stores + reads) / secs, stores / secs, expired / secs,
+         expired_bytes / secs / (1024 * 1024), commands,
+         expired ? (double)commands / expired : 0.0, busy_pct, stale, early, errors);
+  if (mode == MODE_TTL)
+    printf("       %lu pairs still live (expected about %lu), %lu reaped, %lu dropped lazily\n",
+           after.expiring, (uint64_t)cfg.threads * cfg.rate * cfg.ttl_ms / 1000,
+           after.reaped - before.reaped, after.expired_lazy - before.expired_lazy);
+  else
+    printf("       %lu sweeper passes, %lu iterator calls, %lu retrieves, %lu deletes\n",
+           sweeper.passes, sweeper.iterations, sweeper.retrieves, sweeper.deletes);
+
+  for (auto w : writers) delete w;
+  _drop_key_space(dev, ks);
+  // stale reads are the cost of a lagging sweeper, but the device must not
+  // return expired pairs or drop live ones
+  return (errors || early || (mode == MODE_TTL && stale)) ? FAILED : SUCCESS;
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+    int m;
+    for (m = 0; m < MODE_MAX; m++) {
+      if (strcmp(tok, mode_names[m]) == 0) break;
+    }
+    if (m == MODE_MAX) {
+      free(copy);
+      return false;
+    }
+    out->push_back(m);
+  }
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  ttl_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 2;
+  cfg.seconds = 10;
+  cfg.ttl_ms = 1000;
+  cfg.rate = 5000;
+  cfg.vlen = 512;
+  cfg.read_pct = 20;
+  cfg.sweep_pause_ms = 100;
+  cfg.modes = { MODE_TTL, MODE_SWEEP };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:s:T:r:v:R:p:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 's':
+      cfg.seconds = atoi(optarg);
+      break;
+    case 'T':
+      cfg.ttl_ms = atoi(optarg);
+      break;
+    case 'r':
+      cfg.rate = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'R':
+      cfg.read_pct = atoi(optarg);
+      break;
+    case 'p':
+      cfg.sweep_pause_ms = atoi(optarg);
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.threads <= 0 || cfg.threads > 99 || cfg.seconds <= 0 || cfg.ttl_ms == 0 ||
+      cfg.rate == 0 || cfg.read_pct < 0 || cfg.read_pct > 90 || cfg.vlen < 64 || cfg.vlen % 4) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  kvs_device_handle dev;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  printf("%d threads x %u stores/s for %d s, ttl %u ms, %u byte values, %d%% reads\n",
+         cfg.threads, cfg.rate, cfg.seconds, cfg.ttl_ms, cfg.vlen, cfg.read_pct);
+  printf("%-6s %9s %9s %9s %9s %9s %8s %8s %8s %6s %6s\n", "mode", "ops/s", "stores/s",
+         "expired/s", "MB/s", "host cmds", "cmds/exp", "reaper", "stale rd", "early", "errors");
+  int result = SUCCESS;
+  for (int mode : cfg.modes)
+    result |= _run_mode(dev, cfg, mode);
+
+  kvs_close_device(dev);
+  return result;
+}
@@ -0,0 +1,423 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Write-back buffer benchmark.
+ *
+ * Every thread stores values to its own share of a key range, optionally
+ * mixed with retrieves, first straight to the device and then through the
+ * write-back buffer of the key space in each durability mode. Time includes
+ * the final kvs_flush_key_space. Afterwards the buffer is disabled and every
+ * key is read back from the device and checked against the last version
+ * its thread wrote.
+ *
+ * Run it with the IOPS model of the emulator enabled (use_iops_model = true
+ * in kvssd_emul.conf) to see the effect of merged and batched writes.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "kvs_api.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define WB_KEYSPACE_NAME "writeback_bench"
+#define WB_KEY_LEN 16
+
+enum wb_mode { MODE_NONE = 0, MODE_BUFFERED, MODE_DEVICE, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "none", "buffered", "device" };
+
+struct wb_config {
+  const char *dev_path;
+  int threads;
+  uint64_t count;
+  uint32_t keys;
+  uint32_t vlen;
+  int read_pct;
+  int qdepth;        // 0: sync API
+  uint32_t buffer_kb;
+  uint32_t batch;
+  uint32_t interval_us;
+  std::vector<int> modes;
+};
+
+struct wb_slot {
+  std::atomic<bool> busy;
+  char key[WB_KEY_LEN + 1];
+  char *value;
+  kvs_key kvskey;
+  kvs_value kvsvalue;
+};
+
+struct wb_thread {
+  int id;
+  const wb_config *cfg;
+  kvs_key_space_handle ks;
+  std::vector<uint32_t> versions;   // last version written, per owned key
+  std::vector<wb_slot> slots;
+  std::atomic<uint64_t> callbacks;
+  std::atomic<uint64_t> errors;
+};
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s [-d device_path] [-t threads] [-n num_ios] [-k keys] [-v vlen] [-r read_pct] "
+         "[-q queue_depth] [-B buffer_kb] [-b batch] [-i interval_us] [-m modes]\n", program);
+  printf("-d      device_path  :  device path (default /dev/kvemul)\n");
+  printf("-t      threads      :  number of threads (default 4)\n");
+  printf("-n      num_ios      :  requests per thread (default 20000)\n");
+  printf("-k      keys         :  size of the key range, smaller means more overwrites (default 4096)\n");
+  printf("-v      vlen         :  value length (default 4096)\n");
+  printf("-r      read_pct     :  percentage of retrieves (default 0)\n");
+  printf("-q      queue_depth  :  use the async API with this many requests per thread, 0 for sync (default 0)\n");
+  printf("-B      buffer_kb    :  write-back buffer size in KB (default 16384)\n");
+  printf("-b      batch        :  flush after this many dirty pairs (default 256)\n");
+  printf("-i      interval_us  :  flush pairs older than this (default 500)\n");
+  printf("-m      modes        :  comma separated list of none,buffered,device (default all)\n");
+  printf("==============\n");
+}
+
+static void _make_key(char *key, uint32_t idx) {
+  snprintf(key, WB_KEY_LEN + 1, "wb%014u", idx);
+}
+
+static void _make_value(char *value, uint32_t vlen, uint32_t idx, uint32_t version) {
+  memset(value, 'a' + (version % 26), vlen);
+  snprintf(value, vlen, "%u:%u", idx, version);
+}
+
+static void _complete(kvs_postprocess_context *ctx) {
+  wb_thread *t = (wb_thread *)ctx->private1;
+  wb_slot *s = (wb_slot *)ctx->private2;
+  if (ctx->result != KVS_SUCCESS && ctx->result != KVS_ERR_KEY_NOT_EXIST)
+    t->errors++;
+  t->callbacks++;
+  s->busy.store(false, std::memory_order_release);
+}
+
+static wb_slot *_get_slot(wb_thread *t) {
+  while (true) {
+    for (auto &s : t->slots) {
+      if (!s.busy.load(std::memory_order_acquire)) return &s;
+    }
+    std::this_thread::yield();
+  }
+}
+
+static void _run_thread(wb_thread *t) {
+  const wb_config *cfg = t->cfg;
+  unsigned int seed = t->id + 1;
+  uint32_t owned = t->versions.size();
+  char *key = (char *)kvs_malloc(WB_KEY_LEN + 1, 4096);
+  char *value = (char *)kvs_malloc(cfg->vlen, 4096);
+  kvs_option_store st_opt = { KVS_STORE_POST, NULL };
+  kvs_option_retrieve rt_opt = { false };
+
+  for (uint64_t i = 0; i < cfg->count; i++) {
+    uint32_t local = rand_r(&seed) % owned;
+    uint32_t idx = local * cfg->threads + t->id;
+    bool read = (int)(rand_r(&seed) % 100) < cfg->read_pct;
+    kvs_result ret;
+
+    if (cfg->qdepth == 0) {
+      _make_key(key, idx);
+      kvs_key kvskey = { key, WB_KEY_LEN };
+      kvs_value kvsvalue = { value, cfg->vlen, 0, 0 };
+      if (read) {
+        ret = kvs_retrieve_kvp(t->ks, &kvskey, &rt_opt, &kvsvalue);
+        if (ret == KVS_ERR_KEY_NOT_EXIST) ret = KVS_SUCCESS;
+      } else {
+        _make_value(value, cfg->vlen, idx, ++t->versions[local]);
+        ret = kvs_store_kvp(t->ks, &kvskey, &kvsvalue, &st_opt);
+      }
+      if (ret != KVS_SUCCESS) t->errors++;
+      continue;
+    }
+
+    wb_slot *s = _get_slot(t);
+    s->busy.store(true, std::memory_order_relaxed);
+    _make_key(s->key, idx);
+    s->kvskey = { s->key, WB_KEY_LEN };
+    s->kvsvalue = { s->value, cfg->vlen, 0, 0 };
+    if (read) {
+      ret = kvs_retrieve_kvp_async(t->ks, &s->kvskey, &rt_opt, t, s, &s->kvsvalue, _complete);
+    } else {
+      _make_value(s->value, cfg->vlen, idx, ++t->versions[local]);
+      ret = kvs_store_kvp_async(t->ks, &s->kvskey, &s->kvsvalue, &st_opt, t, s, _complete);
+    }
+    if (ret != KVS_SUCCESS) {
+      t->errors++;
+      t->callbacks++;
+      s->busy.store(false, std::memory_order_release);
+    }
+  }
+
+  // async stores complete with the durability of the mode
+  for (auto &s : t->slots) {
+    while (s.busy.load(std::memory_order_acquire)) std::this_thread::yield();
+  }
+  kvs_free(key);
+  kvs_free(value);
+}
+
+static uint64_t _verify(kvs_key_space_handle ks, const wb_config &cfg,
+                        std::vector<wb_thread *> &threads) {
+  char *key = (char *)kvs_malloc(WB_KEY_LEN + 1, 4096);
+  char *value = (char *)kvs_malloc(cfg.vlen, 4096);
+  char *expect = (char *)malloc(cfg.vlen);
+  kvs_option_retrieve rt_opt = { false };
+  uint64_t bad = 0;
+
+  for (auto t : threads) {
+    for (uint32_t local = 0; local < t->versions.size(); local++) {
+      if (t->versions[local] == 0) continue;
+      uint32_t idx = local * cfg.threads + t->id;
+      _make_key(key, idx);
+      _make_value(expect, cfg.vlen, idx, t->versions[local]);
+      kvs_key kvskey = { key, WB_KEY_LEN };
+      kvs_value kvsvalue = { value, cfg.vlen, 0, 0 };
+      kvs_result ret = kvs_retrieve_kvp(ks, &kvskey, &rt_opt, &kvsvalue);
+      if (ret != KVS_SUCCESS || memcmp(value, expect, cfg.vlen) != 0) {
+        if (bad++ < 5)
+          fprintf(stderr, "key %s: result 0x%x, expected version %u\n", key, ret,
+                  t->versions[local]);
+      }
+    }
+  }
+  kvs_free(key);
+  kvs_free(value);
+  free(expect);
+  return bad;
+}
+
+static int _run_mode(kvs_key_space_handle ks, const wb_config &cfg, int mode) {
+  kvs_option_writeback wb_opt;
+  wb_opt.buffer_size = cfg.buffer_kb * 1024;
+  wb_opt.batch_size = cfg.batch;
+  wb_opt.flush_interval_us = cfg.interval_us;
+  wb_opt.durability = (mode == MODE_DEVICE) ? KVS_WRITEBACK_ACK_DEVICE : KVS_WRITEBACK_ACK_BUFFERED;
+  kvs_result ret = kvs_set_writeback(ks, mode == MODE_NONE ? NULL : &wb_opt);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "kvs_set_writeback failed 0x%x\n", ret);
+    return FAILED;
+  }
+
+  std::vector<wb_thread *> threads;
+  uint32_t per_thread = (cfg.keys + cfg.threads - 1) / cfg.threads;
+  for (int i = 0; i < cfg.threads; i++) {
+    wb_thread *t = new wb_thread();
+    t->id = i;
+    t->cfg = &cfg;
+    t->ks = ks;
+    t->versions.assign(per_thread, 0);
+    t->slots = std::vector<wb_slot>(cfg.qdepth);
+    for (auto &s : t->slots) {
+      s.busy.store(false);
+      s.value = (char *)kvs_malloc(cfg.vlen, 4096);
+    }
+    t->callbacks = 0;
+    t->errors = 0;
+    threads.push_back(t);
+  }
+
+  uint64_t start = _now_ns();
+  std::vector<std::thread> workers;
+  for (auto t : threads) workers.push_back(std::thread(_run_thread, t));
+  for (auto &w : workers) w.join();
+  ret = kvs_flush_key_space(ks);
+  double secs = (_now_ns() - start) / 1e9;
+
+  kvs_writeback_stats stats;
+  kvs_get_writeback_stats(ks, &stats);
+  kvs_set_writeback(ks, NULL);
+
+  uint64_t errors = (ret != KVS_SUCCESS);
+  uint64_t missing = 0;
+  for (auto t : threads) {
+    errors += t->errors;
+    if (cfg.qdepth && t->callbacks != cfg.count) missing += cfg.count - t->callbacks;
+  }
+  uint64_t bad = _verify(ks, cfg, threads);
+  uint64_t ops = cfg.count * cfg.threads;
+  uint64_t stores = 0;
+  for (auto t : threads) {
+    for (uint32_t v : t->versions) stores += v;
+  }
+
+  printf("%-9s %10.0f %9.1f %10lu %9lu %9lu %8lu %8lu %s\n", mode_names[mode], ops / secs,
+         secs * 1e6 / cfg.count, mode == MODE_NONE ? stores : stats.device_writes, stats.merged,
+         stats.read_hits, stats.flushes, errors + missing,
+         bad ? "MISMATCH" : "ok");
+
+  for (auto t : threads) {
+    for (auto &s : t->slots) kvs_free(s.value);
+    delete t;
+  }
+  return (errors || missing || bad) ? FAILED : SUCCESS;
+}
+
+static bool _parse_modes(const char *str, std::vector<int> *out) {
+  out->clear();
+  char *copy = strdup(str);
+  for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+    int m;
+    for (m = 0; m < MODE_MAX; m++) {
+      if (strcmp(tok, mode_names[m]) == 0) break;
+    }
+    if (m == MODE_MAX) {
+      free(copy);
+      return false;
+    }
+    out->push_back(m);
+  }
+  free(copy);
+  return !out->empty();
+}
+
+int main(int argc, char *argv[]) {
+  wb_config cfg;
+  cfg.dev_path = "/dev/kvemul";
+  cfg.threads = 4;
+  cfg.count = 20000;
+  cfg.keys = 4096;
+  cfg.vlen = 4096;
+  cfg.read_pct = 0;
+  cfg.qdepth = 0;
+  cfg.buffer_kb = 16384;
+  cfg.batch = 256;
+  cfg.interval_us = 500;
+  cfg.modes = { MODE_NONE, MODE_BUFFERED, MODE_DEVICE };
+
+  int c;
+  while ((c = getopt(argc, argv, "d:t:n:k:v:r:q:B:b:i:m:h")) != -1) {
+    switch (c) {
+    case 'd':
+      cfg.dev_path = optarg;
+      break;
+    case 't':
+      cfg.threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg.count = strtoull(optarg, NULL, 10);
+      break;
+    case 'k':
+      cfg.keys = atoi(optarg);
+      break;
+    case 'v':
+      cfg.vlen = atoi(optarg);
+      break;
+    case 'r':
+      cfg.read_pct = atoi(optarg);
+      break;
+    case 'q':
+      cfg.qdepth = atoi(optarg);
+      break;
+    case 'B':
+      cfg.buffer_kb = atoi(optarg);
+      break;
+    case 'b':
+      cfg.batch = atoi(optarg);
+      break;
+    case 'i':
+      cfg.interval_us = atoi(optarg);
+      break;
+    case 'm':
+      if (!_parse_modes(optarg, &cfg.modes)) {
+        usage(argv[0]);
+        return FAILED;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return SUCCESS;
+    default:
+      usage(argv[0]);
+      return FAILED;
+    }
+  }
+  if (cfg.threads <= 0 || cfg.keys < (uint32_t)cfg.threads || cfg.vlen == 0 ||
+      cfg.vlen % 4 || cfg.qdepth < 0 || cfg.batch == 0 || cfg.buffer_kb == 0) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  kvs_device_handle dev;
+  kvs_key_space_handle ks;
+  kvs_result ret = kvs_open_device((char *)cfg.dev_path, &dev);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    return FAILED;
+  }
+  kvs_key_space_name ks_name;
+  kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+  ks_name.name = (char *)WB_KEYSPACE_NAME;
+  ks_name.name_len = strlen(WB_KEYSPACE_NAME);
+  kvs_create_key_space(dev, &ks_name, 0, option);
+  ret = kvs_open_key_space(dev, (char *)WB_KEYSPACE_NAME, &ks);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Keyspace setup failed 0x%x\n", ret);
+    kvs_close_device(dev);
+    return FAILED;
+  }
+
+  printf("%d threads x %lu %s requests, %u keys, %u byte values, %d%% reads\n",
+         cfg.threads, cfg.count, cfg.qdepth ? "async" : "sync", cfg.keys, cfg.vlen, cfg.read_pct);
+  printf("write-back: %u KB buffer, batch %u, interval %u us\n",
+         cfg.buffer_kb, cfg.batch, cfg.interval_us);
+  printf("%-9s %10s %9s %10s %9s %9s %8s %8s %s\n", "mode", "ops/s", "us/op", "dev writes",
+         "merged", "read hits", "flushes", "errors", "verify");
+  int result = SUCCESS;
+  for (int mode : cfg.modes)
+    result |= _run_mode(ks, cfg, mode);
+
+  kvs_close_key_space(ks);
+  kvs_delete_key_space(dev, &ks_name);
+  kvs_close_device(dev);
+  return result;
+}
@@ -64,6 +64,10 @@ class KvEmulator: public KvsDriver {
     std::atomic<int> done_sync;
     std::condition_variable done_cond_sync;
     bool syncio;
+    uint32_t timeout_usec; // what is left of the request deadline, 0 if none
+    uint64_t submitter;    // thread that sent the request
+    uint64_t stats_start;  // kvs_stats_start(), 0 if the request is not counted
+    uint64_t stats_bytes;  // value bytes a store or batch writes
   } kv_emul_context;
 
   kv_interrupt_handler int_handler;
@@ -92,6 +96,11 @@ class KvEmulator: public KvsDriver {
                               const kvs_key *keys, kvs_exist_list *list,
                               void *private1 = NULL, void *private2 = NULL, bool sync = false,
                               kvs_postprocess_function post_fn = NULL) override;
+  virtual int32_t write_batch(kvs_key_space_handle ks_hd, const kvs_batch_op *ops,
+                              uint32_t op_cnt, void *private1 = NULL, void *private2 = NULL,
+                              bool sync = false, kvs_postprocess_function post_fn = NULL) override;
+  virtual int32_t cancel_io(kvs_key_space_handle ks_hd, void *private1,
+                            uint32_t *canceled) override;
   virtual int32_t create_iterator(kvs_key_space_handle ks_hd,
                                 kvs_option_iterator option, uint32_t bitmask, uint32_t bit_pattern,
                                 kvs_iterator_handle *iter_hd) override;
@@ -105,6 +114,9 @@ class KvEmulator: public KvsDriver {
   virtual float get_waf() override;
   virtual int32_t get_used_size(uint32_t *dev_util)override;
   virtual int32_t get_total_size(uint64_t *dev_capa) override;
+  virtual int32_t get_ttl_stats(kvs_ttl_stats *stats) override;
+  virtual int32_t get_cache_stats(kvs_cache_stats *stats) override;
+  virtual void export_stats(struct kvs_stats_device *stats) override;
   virtual int32_t get_device_info(kvs_device *dev_info) override;
 
  private:
@@ -114,7 +126,8 @@ class KvEmulator: public KvsDriver {
                    int is_polling);
   kv_emul_context* prep_io_context(kvs_context opcode, kvs_key_space_handle ks_hd,
                                    const kvs_key *key, const kvs_value *value, void *private1, void *private2,
-                                   bool syncio, kvs_postprocess_function cbfn);
+                                   bool syncio, kvs_postprocess_function cbfn,
+                                   uint32_t deadline_us = 0);
   bool ispersist;
   std::string datapath;
 };
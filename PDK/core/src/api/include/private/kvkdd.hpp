@@ -63,6 +63,9 @@ public:
 
     kvs_postprocess_context iocb;
     kvs_postprocess_function on_complete;
+    uint64_t submitter;
+    uint64_t stats_start;  // kvs_stats_start(), 0 if the request is not counted
+    uint64_t stats_bytes;  // value bytes a store writes
 
     std::mutex lock_sync;
     std::condition_variable done_cond_sync;
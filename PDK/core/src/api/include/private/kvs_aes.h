@@ -0,0 +1,114 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_PRIVATE_KVS_AES_H_
+#define INCLUDE_PRIVATE_KVS_AES_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include "kvs_chunk_io.h"
+
+/*
+ * AES-GCM with 96 bit IVs and 128 bit tags, for AES-128 and AES-256 keys.
+ *
+ * With AES-NI and PCLMULQDQ (chosen at compile time, the tree builds with
+ * -march=native) the counter blocks are encrypted four at a time and GHASH
+ * folds four blocks per reduction. Otherwise a byte oriented AES and a bit
+ * serial GHASH are used, which are slow but keep the format readable on
+ * any CPU.
+ */
+class kvs_aes_gcm {
+public:
+  // key_len is 16 or 32. hw = false forces the portable code, for
+  // comparisons.
+  kvs_aes_gcm(const uint8_t *key, int key_len, bool hw = true);
+  ~kvs_aes_gcm();
+
+  void encrypt(const uint8_t *iv, const uint8_t *aad, size_t aad_len,
+               const uint8_t *in, size_t len, uint8_t *out, uint8_t *tag) const;
+  // checks the tag over all len bytes of in and only then decrypts bytes
+  // [from, from + cnt) of it to out
+  bool decrypt(const uint8_t *iv, const uint8_t *aad, size_t aad_len,
+               const uint8_t *in, size_t len, const uint8_t *tag,
+               size_t from, size_t cnt, uint8_t *out) const;
+
+  const char *impl() const;
+
+private:
+  static const int BLOCK = 16;
+
+  void _encrypt_block(const uint8_t *in, uint8_t *out) const;
+  // xors the key stream of counter blocks starting at block ctr into out
+  void _ctr(const uint8_t *iv, uint32_t ctr, const uint8_t *in, size_t len,
+            uint8_t *out) const;
+  void _ghash(const uint8_t *aad, size_t aad_len, const uint8_t *c, size_t len,
+              uint8_t *out) const;
+  void _tag(const uint8_t *iv, const uint8_t *aad, size_t aad_len,
+            const uint8_t *c, size_t len, uint8_t *tag) const;
+
+  int rounds_;
+  bool hw_;
+  alignas(16) uint8_t round_keys_[15 * 16];
+  alignas(16) uint8_t h_[16];            // E(K, 0)
+  alignas(16) uint8_t h_pow_[4][16];     // byte reflected H, H^2, H^3, H^4
+};
+
+/*
+ * Encryption of a Key Space (see kvs_set_encryption). A chunk holds the
+ * AES-GCM ciphertext of its value bytes, the 64 bit nonce of the store and
+ * the tag. The IV is the nonce and the chunk index, the associated data is
+ * the key, the value length and the chunk index, so a chunk only opens at
+ * its own place in a value of its own key.
+ */
+class kvs_gcm_codec : public kvs_chunk_codec {
+public:
+  kvs_gcm_codec(const uint8_t *key, int key_len);
+
+  uint32_t overhead() const { return NONCE_LEN + TAG_LEN; }
+  uint64_t begin_value();
+  void seal(const kvs_chunk_ref &ref, const char *src, uint32_t n, char *dst);
+  bool open(const kvs_chunk_ref &ref, const char *src, uint32_t n,
+            uint32_t from, uint32_t cnt, char *dst);
+
+private:
+  static const uint32_t NONCE_LEN = 8;
+  static const uint32_t TAG_LEN = 16;
+
+  static size_t _make_aad(const kvs_chunk_ref &ref, uint8_t *aad);
+
+  kvs_aes_gcm gcm_;
+  std::atomic<uint64_t> next_nonce_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_AES_H_ */
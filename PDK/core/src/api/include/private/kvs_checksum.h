@@ -0,0 +1,63 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_PRIVATE_KVS_CHECKSUM_H_
+#define INCLUDE_PRIVATE_KVS_CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "kvs_chunk_io.h"
+
+/*
+ * CRC32C (Castagnoli). crc is the result of the previous call, 0 to start.
+ * kvs_crc32c uses the SSE4.2 or ARMv8 CRC instructions when the tree is
+ * built for a CPU that has them (-march=native), kvs_crc32c_sw is the
+ * table driven fallback.
+ */
+uint32_t kvs_crc32c(uint32_t crc, const void *buf, size_t len);
+uint32_t kvs_crc32c_sw(uint32_t crc, const void *buf, size_t len);
+const char *kvs_crc32c_impl();
+
+/*
+ * Checksums of a Key Space (see kvs_set_checksum): every chunk ends with
+ * the CRC32C of its value bytes, seeded with the chunk index.
+ */
+class kvs_crc_codec : public kvs_chunk_codec {
+public:
+  uint32_t overhead() const { return sizeof(uint32_t); }
+  void seal(const kvs_chunk_ref &ref, const char *src, uint32_t n, char *dst);
+  bool open(const kvs_chunk_ref &ref, const char *src, uint32_t n,
+            uint32_t from, uint32_t cnt, char *dst);
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_CHECKSUM_H_ */
@@ -0,0 +1,139 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_PRIVATE_KVS_CHUNK_IO_H_
+#define INCLUDE_PRIVATE_KVS_CHUNK_IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "kvs_api.h"
+
+/*
+ * What a chunk codec needs to know about the chunk it transforms. The value
+ * length and the key are those of the caller's value, so a codec can bind
+ * them into the chunk. nonce is what begin_value() returned for the value
+ * being sealed and is not set when a chunk is opened.
+ */
+struct kvs_chunk_ref {
+  const kvs_key *key;
+  uint32_t value_len;
+  uint32_t index;
+  uint64_t nonce;
+};
+
+/*
+ * Value transform of a Key Space (see kvs_set_checksum, kvs_set_encryption).
+ *
+ * A value is stored as chunks of CHUNK bytes, each holding up to payload()
+ * value bytes plus overhead() bytes added by the codec. Chunks start at
+ * multiples of CHUNK on the device, so a retrieve at a value offset only
+ * reads and opens the chunks it covers and the device offset stays aligned
+ * to KVS_ALIGNMENT_UNIT.
+ */
+class kvs_chunk_codec {
+public:
+  static const uint32_t CHUNK = 4096;
+
+  virtual ~kvs_chunk_codec() {}
+
+  virtual uint32_t overhead() const = 0;
+  uint32_t payload() const { return CHUNK - overhead(); }
+
+  // called once per stored value, before its chunks are sealed
+  virtual uint64_t begin_value() { return 0; }
+  // turns n value bytes at src into n + overhead() bytes at dst
+  virtual void seal(const kvs_chunk_ref &ref, const char *src, uint32_t n, char *dst) = 0;
+  // checks the n + overhead() bytes at src and copies value bytes
+  // [from, from + cnt) to dst, false if the chunk does not check out
+  virtual bool open(const kvs_chunk_ref &ref, const char *src, uint32_t n,
+                    uint32_t from, uint32_t cnt, char *dst) = 0;
+
+  uint32_t stored_length(uint32_t value_len) const;
+  // largest value that fits into stored_len bytes
+  uint32_t value_length(uint32_t stored_len) const;
+};
+
+/*
+ * One request to a Key Space with a value transform. prepare_*() builds the
+ * stored form in a bounce buffer from kvs_malloc, the caller hands stored()
+ * or ops() to the driver, and complete_retrieve() opens what came back. For
+ * asynchronous requests set_callback() keeps the caller's completion, the
+ * object is passed as private1 to the driver with on_done() and deletes
+ * itself there.
+ */
+class kvs_chunk_io {
+public:
+  explicit kvs_chunk_io(kvs_chunk_codec *codec);
+  ~kvs_chunk_io();
+
+  kvs_result prepare_store(const kvs_key *key, kvs_value *value);
+  kvs_result prepare_retrieve(const kvs_key *key, kvs_value *value);
+  kvs_result prepare_batch(kvs_batch_op *ops, uint32_t op_cnt);
+  // opens the chunks the device returned with result and copies the
+  // requested range to the caller's value
+  kvs_result complete_retrieve(kvs_result result);
+
+  kvs_value *stored() { return &stored_; }
+  kvs_batch_op *ops() { return ops_.data(); }
+
+  void set_callback(void *private1, void *private2, kvs_postprocess_function post_fn);
+  static void on_done(kvs_postprocess_context *ctx);
+  // the caller's request, see kvs_cancel_io
+  void *user_private1() const { return private1_; }
+  kvs_postprocess_function user_post_fn() const { return post_fn_; }
+
+private:
+  kvs_chunk_codec *codec_;
+  const kvs_key *key_;
+  kvs_value *user_;
+  kvs_value stored_;
+  uint32_t first_chunk_;
+
+  // batches: the stored form of every store op
+  std::vector<kvs_batch_op> ops_;
+  std::vector<kvs_value> values_;
+  std::vector<void*> buffers_;
+
+  void *private1_;
+  void *private2_;
+  kvs_postprocess_function post_fn_;
+
+  void _seal(const kvs_key *key, const kvs_value *value, void *dst);
+  void *_alloc(uint32_t len);
+
+  kvs_chunk_io(const kvs_chunk_io&);
+  kvs_chunk_io& operator=(const kvs_chunk_io&);
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_CHUNK_IO_H_ */
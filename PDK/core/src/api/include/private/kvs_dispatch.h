@@ -0,0 +1,97 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_DISPATCH_H_
+#define INCLUDE_PRIVATE_KVS_DISPATCH_H_
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "kvs_api.h"
+
+/*
+ * Completion dispatch of a device (see kvs_set_completion_dispatch).
+ *
+ * The drivers hand every asynchronous completion to complete() instead of
+ * calling the post process function themselves. Inline, it is called right
+ * away; otherwise a copy of the context is queued to a pool thread or passed
+ * to the caller's executor, and the key space reference of the request is
+ * dropped only after the function has returned.
+ *
+ * Every pool thread has its own queue. Ordered completions go to the thread
+ * their submitter hashes to, others to the less loaded of two threads.
+ */
+class kvs_dispatcher {
+public:
+  kvs_dispatcher();
+  // runs what is still queued and stops the pool
+  ~kvs_dispatcher();
+
+  kvs_result configure(const kvs_option_dispatch *opt);
+  void complete(kvs_postprocess_function post_fn, const kvs_postprocess_context *iocb,
+                uint64_t submitter);
+  // id of the calling thread, recorded by the drivers when a request is sent
+  static uint64_t submitter();
+
+private:
+  struct task {
+    kvs_postprocess_function post_fn;
+    kvs_postprocess_context iocb;
+  };
+
+  struct worker {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<task*> queue;
+    std::atomic<uint32_t> pending;
+    bool stop;
+    int cpu;                 // bound to this CPU, -1 if not bound
+    std::thread thread;
+  };
+
+  static void _run(void *t);
+  void _work(worker *w);
+  void _stop();
+
+  kvs_option_dispatch opt_;
+  std::vector<worker*> workers_;
+  std::atomic<uint32_t> next_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_DISPATCH_H_ */
@@ -0,0 +1,121 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_ERASURE_H_
+#define INCLUDE_PRIVATE_KVS_ERASURE_H_
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "kvs_api.h"
+#include "kvs_rs.h"
+
+/*
+ * Erasure coded set over Key Spaces (see kvs_open_ec_set).
+ *
+ * Fragment i of a key is stored under the key plus the byte i on Key Space
+ * (home + i) % n, where home is a hash of the key. Every fragment starts
+ * with a frag_header; the stamp is the same for all fragments of one store,
+ * so leftovers of an older value under the same key are not mixed in.
+ *
+ * All fragment I/O is issued with asynchronous commands and the caller
+ * waits for the whole wave: the data fragments first and, if any of them is
+ * missing, all parity fragments at once.
+ */
+class kvs_ec_set {
+public:
+  kvs_ec_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt, const kvs_option_ec &opt);
+
+  kvs_result store(const kvs_key *key, const kvs_value *value,
+                   const kvs_option_store *opt);
+  kvs_result retrieve(const kvs_key *key, kvs_value *value);
+  kvs_result remove(const kvs_key *key, const kvs_option_delete *opt);
+  void set_failed(uint8_t ks_idx, bool failed);
+  uint8_t size() const { return ks_.size(); }
+  void get_stats(kvs_ec_stats *stats);
+
+private:
+  static const uint32_t FRAG_MAGIC = 0x4b564543;   // "KVEC"
+
+  enum frag_kind { FRAG_COPY = 0, FRAG_CODED = 1 };
+
+  struct frag_header {
+    uint32_t magic;
+    uint32_t value_len;
+    uint32_t stamp;
+    uint8_t kind;
+    uint8_t index;
+    uint8_t k;
+    uint8_t m;
+  };
+
+  // one wave of fragment commands the caller waits for
+  struct io_wave {
+    std::mutex lock;
+    std::condition_variable cond;
+    int pending;
+  };
+
+  struct frag_io {
+    io_wave *wave;
+    kvs_key key;
+    kvs_value value;
+    kvs_result result;
+  };
+
+  static void _on_frag_done(kvs_postprocess_context *ctx);
+  static void _frag_done(frag_io *io, kvs_result result);
+
+  uint32_t _home(const kvs_key *key) const;
+  uint8_t _ks_of(uint32_t home, int index) const { return (home + index) % ks_.size(); }
+  uint32_t _frag_len(uint32_t value_len) const;
+  void _make_keys(const kvs_key *key, char *keys, std::vector<frag_io> &ios);
+  void _wait(io_wave &wave);
+  kvs_result _retrieve_copy(const kvs_key *key, uint32_t home, kvs_value *value);
+  bool _valid(const frag_io &io, frag_header *hdr) const;
+
+  std::vector<kvs_key_space_handle> ks_;
+  std::vector<std::atomic<bool> > failed_;
+  kvs_option_ec opt_;
+  kvs_rs_codec codec_;
+  std::atomic<uint32_t> stamp_;
+
+  std::mutex lock_;
+  kvs_ec_stats stats_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_ERASURE_H_ */
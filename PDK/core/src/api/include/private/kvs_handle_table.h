@@ -0,0 +1,230 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_HANDLE_TABLE_H_
+#define INCLUDE_PRIVATE_KVS_HANDLE_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Fixed size table of handle objects handed out to API users as raw pointers.
+ *
+ * Every object lives in a statically allocated slot that is never returned to
+ * the heap, so a stale or bogus handle can be checked without dereferencing
+ * freed memory: the pointer is mapped to its slot by address arithmetic and
+ * validated against the slot state word in O(1).
+ *
+ * The state word packs a generation (bumped every time the slot is recycled),
+ * an open bit and a reference count:
+ *
+ *   63            32 31   30              0
+ *   +---------------+----+-----------------+
+ *   |  generation   |open|      refs       |
+ *   +---------------+----+-----------------+
+ *
+ * acquire() takes a reference with a single CAS as long as the slot is open,
+ * so it can never succeed on a slot that has been closed. close() clears the
+ * open bit (exactly one caller wins) and then waits for the outstanding
+ * references to drain.
+ *
+ * The public handles are plain pointers and carry no generation, so a stale
+ * pointer to a recycled slot resolves to the new incarnation. Released slots
+ * are therefore reused in FIFO order, which keeps that from happening until
+ * N - 1 other handles have been closed after it.
+ */
+template <typename T, uint32_t N>
+class kvs_handle_table {
+  static const uint64_t OPEN = 1ULL << 31;
+  static const uint64_t REFS = OPEN - 1;
+  static const int GEN_SHIFT = 32;
+
+  struct slot {
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type obj;
+    std::atomic<uint64_t> state;
+  };
+
+  slot slots_[N];
+  std::mutex lock_;
+  std::deque<uint32_t> free_;
+
+  slot *slot_of(const void *p) const {
+    uintptr_t base = (uintptr_t)slots_;
+    uintptr_t addr = (uintptr_t)p;
+    if (addr < base || addr >= base + sizeof(slots_)) return NULL;
+    if ((addr - base) % sizeof(slot) != offsetof(slot, obj)) return NULL;
+    return (slot*)&slots_[(addr - base) / sizeof(slot)];
+  }
+
+public:
+  kvs_handle_table() {
+    for (uint32_t i = 0; i < N; i++) {
+      slots_[i].state.store(0, std::memory_order_relaxed);
+      free_.push_back(i);
+    }
+  }
+
+  // constructs a new object in a free slot and opens it, NULL when full
+  template <typename... Args>
+  T *alloc(Args&&... args) {
+    std::unique_lock<std::mutex> lock(lock_);
+    if (free_.empty()) return NULL;
+    uint32_t idx = free_.front();
+    free_.pop_front();
+    lock.unlock();
+
+    slot &s = slots_[idx];
+    T *obj = new (&s.obj) T(std::forward<Args>(args)...);
+    uint64_t gen = s.state.load(std::memory_order_relaxed) >> GEN_SHIFT;
+    s.state.store((gen << GEN_SHIFT) | OPEN, std::memory_order_release);
+    return obj;
+  }
+
+  bool owns(const T *p) const { return slot_of(p) != NULL; }
+
+  // takes a reference on an open handle
+  bool acquire(const T *p) {
+    slot *s = slot_of(p);
+    if (s == NULL) return false;
+    uint64_t st = s->state.load(std::memory_order_acquire);
+    while (st & OPEN) {
+      if ((st & REFS) == REFS) return false;
+      if (s->state.compare_exchange_weak(st, st + 1, std::memory_order_acq_rel,
+                                         std::memory_order_acquire))
+        return true;
+    }
+    return false;
+  }
+
+  // takes a reference whether the slot is open or not, for a caller that
+  // knows the object is alive (e.g. it is the one closing it)
+  bool hold(const T *p) {
+    slot *s = slot_of(p);
+    if (s == NULL) return false;
+    s->state.fetch_add(1, std::memory_order_acq_rel);
+    return true;
+  }
+
+  void release(const T *p) {
+    slot *s = slot_of(p);
+    if (s) s->state.fetch_sub(1, std::memory_order_release);
+  }
+
+  // stops new acquires and waits for the holders to go away. Only the
+  // caller that gets true back may free() the handle. The caller must not
+  // hold a reference itself.
+  bool close(const T *p) {
+    slot *s = slot_of(p);
+    if (s == NULL) return false;
+    uint64_t st = s->state.load(std::memory_order_acquire);
+    do {
+      if (!(st & OPEN)) return false;
+    } while (!s->state.compare_exchange_weak(st, st & ~OPEN,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire));
+    while (s->state.load(std::memory_order_acquire) & REFS)
+      std::this_thread::yield();
+    return true;
+  }
+
+  // destroys a closed handle and recycles its slot, after references taken
+  // with hold() have been dropped
+  void free(T *p) {
+    slot *s = slot_of(p);
+    if (s == NULL) return;
+    while (s->state.load(std::memory_order_acquire) & REFS)
+      std::this_thread::yield();
+    p->~T();
+    uint64_t gen = (s->state.load(std::memory_order_relaxed) >> GEN_SHIFT) + 1;
+    s->state.store(gen << GEN_SHIFT, std::memory_order_release);
+    std::unique_lock<std::mutex> lock(lock_);
+    free_.push_back((uint32_t)(s - slots_));
+  }
+
+  bool is_open(const T *p) const {
+    const slot *s = slot_of(p);
+    return s && (s->state.load(std::memory_order_acquire) & OPEN);
+  }
+
+  uint32_t generation(const T *p) const {
+    const slot *s = slot_of(p);
+    return s ? (uint32_t)(s->state.load(std::memory_order_acquire) >> GEN_SHIFT) : 0;
+  }
+
+  // calls fn on every open handle. Handles may be closed concurrently, the
+  // caller has to acquire() one before using it.
+  template <typename F>
+  void for_each_open(F fn) {
+    for (uint32_t i = 0; i < N; i++) {
+      if (slots_[i].state.load(std::memory_order_acquire) & OPEN)
+        fn((T*)&slots_[i].obj);
+    }
+  }
+};
+
+/*
+ * Scoped reference on a handle table entry. detach() hands the reference
+ * over to someone else, e.g. an asynchronous I/O that drops it on completion.
+ */
+template <typename Table, typename T>
+class kvs_handle_ref {
+  Table &table_;
+  const T *p_;
+
+public:
+  explicit kvs_handle_ref(Table &table) : table_(table), p_(NULL) {}
+  ~kvs_handle_ref() { if (p_) table_.release(p_); }
+
+  bool acquire(const T *p) {
+    if (p_ || !table_.acquire(p)) return false;
+    p_ = p;
+    return true;
+  }
+
+  void detach() { p_ = NULL; }
+
+private:
+  kvs_handle_ref(const kvs_handle_ref&);
+  kvs_handle_ref& operator=(const kvs_handle_ref&);
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_HANDLE_TABLE_H_ */
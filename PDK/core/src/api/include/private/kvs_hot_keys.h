@@ -0,0 +1,116 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_HOT_KEYS_H_
+#define INCLUDE_PRIVATE_KVS_HOT_KEYS_H_
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "kvs_api.h"
+
+/*
+ * Hot key tracking of a key space (see kvs_set_hot_keys).
+ *
+ * Sampled requests are added to a count-min sketch of depth rows by width
+ * cells; a cell holds the read, write and byte counters of the keys hashing
+ * to it, so one request touches one cache line per row. The estimate of a
+ * key is the smallest of its cells. Keys whose estimate beats the coldest
+ * key of a ranking are offered to that ranking under the lock; the threshold
+ * is read without it, so requests for cold keys never take the lock.
+ *
+ * Requests count down a sampling counter of the key space that is reset to
+ * a random interval averaging the sample rate, so periodic access patterns
+ * are not aliased.
+ */
+class kvs_hot_keys {
+public:
+  explicit kvs_hot_keys(const kvs_option_hot_keys &opt);
+
+  void read(const kvs_key *key, uint64_t bytes) {
+    if (_sampled()) _record(KVS_HOT_KEYS_READS, key, bytes);
+  }
+  void write(const kvs_key *key, uint64_t bytes) {
+    if (_sampled()) _record(KVS_HOT_KEYS_WRITES, key, bytes);
+  }
+
+  // asynchronous retrieves learn the value size on completion: they take
+  // the sample when submitted and record it with read_sampled
+  bool sample() { return _sampled(); }
+  void read_sampled(const kvs_key *key, uint64_t bytes) {
+    _record(KVS_HOT_KEYS_READS, key, bytes);
+  }
+
+  uint32_t get(kvs_hot_keys_order order, kvs_hot_key *keys, uint32_t count);
+
+private:
+  static const int NORDERS = 3;
+
+  struct cell {
+    std::atomic<uint64_t> n[NORDERS];
+  };
+
+  struct entry {
+    std::string key;
+    uint64_t estimate;
+  };
+
+  bool _sampled();
+  static uint64_t _hash(const void *key, uint32_t len);
+  uint64_t _index(uint64_t hash, uint32_t row) const;
+  void _record(int op, const kvs_key *key, uint64_t bytes);
+  void _estimate(uint64_t hash, uint64_t est[]);
+  // lock_ held
+  void _offer(int order, const kvs_key *key, uint64_t estimate);
+  void _set_threshold(int order);
+  void _decay(uint64_t now_ms);
+
+  kvs_option_hot_keys opt_;
+  uint32_t mask_;
+  std::vector<cell> cells_;
+  std::atomic<uint64_t> threshold_[NORDERS];
+  std::atomic<uint64_t> decay_at_ms_;
+  std::atomic<int64_t> countdown_;    // requests until the next sample
+  std::atomic<uint64_t> rnd_;
+  std::chrono::steady_clock::time_point start_;
+
+  std::mutex lock_;
+  std::vector<entry> top_[NORDERS];
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_HOT_KEYS_H_ */
@@ -0,0 +1,156 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_LONG_KEY_H_
+#define INCLUDE_PRIVATE_KVS_LONG_KEY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <deque>
+#include <vector>
+#include "kvs_api.h"
+
+void kvs_sha256(const void *data, size_t len, uint8_t *digest);
+
+/*
+ * One request to a Key Space with long keys (see kvs_set_long_keys).
+ *
+ * A key of KVS_MAX_KEY_LENGTH bytes or more is stored under a digest key of
+ * exactly KVS_MAX_KEY_LENGTH bytes: the first PREFIX bytes of the key, so
+ * iterator filters and key order still see them, followed by the SHA-256 of
+ * the whole key. The stored value starts with a header and the original key:
+ *
+ *   +-------+---------+---------+-----------+------------+
+ *   | magic | key_len | 0 (u16) | key bytes | value ...  |
+ *   +-------+---------+---------+-----------+------------+
+ *
+ * so a retrieve reads the key back with the value in one command and can
+ * tell a digest collision from a hit. Like kvs_chunk_io, prepare_*() builds
+ * what goes to the device, set_callback() keeps the caller's completion and
+ * on_done() restores the caller's key and value before calling it.
+ */
+class kvs_long_key_io {
+public:
+  static const uint32_t MAGIC = 0x4b4c564b;   // "KVLK"
+  static const uint32_t HDR = 8;
+  static const uint32_t PREFIX = KVS_MAX_KEY_LENGTH - 32;
+
+  kvs_long_key_io();
+  ~kvs_long_key_io();
+
+  static bool is_long(const kvs_key *key) { return key->length >= KVS_MAX_KEY_LENGTH; }
+  static void make_digest_key(const kvs_key *key, uint8_t *dst);
+  // finds the original key in the first len bytes of a stored value
+  static bool parse(const char *stored, uint32_t len, const char **key, uint16_t *key_len);
+
+  kvs_result prepare_key(kvs_key *key);
+  kvs_result prepare_store(kvs_key *key, kvs_value *value);
+  kvs_result prepare_retrieve(kvs_key *key, kvs_value *value);
+  kvs_result prepare_keys(kvs_key *keys, uint32_t key_cnt);
+  kvs_result prepare_batch(kvs_batch_op *ops, uint32_t op_cnt);
+  // checks the key read back and copies the requested range of the value
+  kvs_result complete_retrieve(kvs_result result);
+
+  kvs_key *key() { return &key_; }
+  kvs_value *stored() { return &stored_; }
+  kvs_key *keys() { return keys_.data(); }
+  kvs_batch_op *ops() { return ops_.data(); }
+
+  void set_callback(void *private1, void *private2, kvs_postprocess_function post_fn);
+  static void on_done(kvs_postprocess_context *ctx);
+  // the caller's request, see kvs_cancel_io
+  void *user_private1() const { return private1_; }
+  kvs_postprocess_function user_post_fn() const { return post_fn_; }
+
+private:
+  kvs_key *user_key_;
+  kvs_value *user_;
+  kvs_key key_;
+  uint8_t digest_[KVS_MAX_KEY_LENGTH];
+  kvs_value stored_;
+
+  // existence checks and batches: one digest key per long key
+  std::vector<kvs_key> keys_;
+  std::vector<uint8_t> digests_;
+  std::vector<kvs_batch_op> ops_;
+  std::vector<kvs_value> values_;
+  std::vector<void*> buffers_;
+
+  void *private1_;
+  void *private2_;
+  kvs_postprocess_function post_fn_;
+
+  static kvs_result _check_key(const kvs_key *key);
+  void *_alloc(uint32_t len);
+  kvs_result _pack(const kvs_key *key, const kvs_value *value, kvs_value *dst);
+
+  kvs_long_key_io(const kvs_long_key_io&);
+  kvs_long_key_io& operator=(const kvs_long_key_io&);
+};
+
+/*
+ * Long key state of a Key Space: iterators return the original keys, so
+ * every digest key in the device's list is replaced by the key stored with
+ * its value. Keys that no longer fit into the caller's buffer are kept and
+ * returned by the next call; an entry larger than the whole buffer is
+ * skipped and fails the call with KVS_ERR_BUFFER_SMALL.
+ */
+class kvs_long_keys {
+public:
+  explicit kvs_long_keys(kvs_key_space_handle ks_hd) : ks_hd_(ks_hd) {}
+
+  void open_iterator(kvs_iterator_handle iter_hd, kvs_iterator_type type);
+  void close_iterator(kvs_iterator_handle iter_hd);
+  kvs_result iterate_next(kvs_iterator_handle iter_hd, kvs_iterator_list *iter_list);
+
+private:
+  struct iter_state {
+    kvs_iterator_type type;
+    bool device_end;
+    std::deque<std::string> pending;   // translated list entries
+  };
+
+  kvs_result _fill(iter_state *st, kvs_iterator_handle iter_hd);
+  kvs_result _original_key(const uint8_t *digest, std::string *key);
+
+  kvs_key_space_handle ks_hd_;
+  std::mutex lock_;
+  std::map<kvs_iterator_handle, iter_state> iters_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_LONG_KEY_H_ */
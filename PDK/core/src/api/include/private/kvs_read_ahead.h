@@ -0,0 +1,225 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_READ_AHEAD_H_
+#define INCLUDE_PRIVATE_KVS_READ_AHEAD_H_
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "kvs_api.h"
+
+/*
+ * Speculative read-ahead of a key space (see kvs_set_read_ahead).
+ *
+ * Every retrieve of a key that ends in a number is matched against a small
+ * table of streams, each remembering the kind of key (the bytes around the
+ * number), its last number and its stride. A stream that was followed twice
+ * with the same stride keeps up to depth speculative retrieves in flight or
+ * buffered ahead of it; the buffers are slots of a pool shared by all
+ * streams, found by key. A retrieve that finds a completed slot copies its
+ * value, one that finds a slot in flight waits for it, synchronously or as
+ * a waiter completed from the speculative retrieve's completion. Waiters the
+ * slot cannot serve are retrieved from the device again by a resubmitter
+ * thread: a completion thread that sends a command may wait for a context
+ * that only its own return frees.
+ *
+ * Writes bump a version counter of their key's bucket when they are sent
+ * and again when they complete (kvs_dispatcher::complete, or the return of
+ * a synchronous call). A slot remembers the version it was sent under and
+ * is only served while it is unchanged, so a speculative retrieve that may
+ * have read the device before a write completed is never returned after it.
+ * Batches bump one counter for the whole key space.
+ *
+ * Each stream ramps its depth up by one for every slot used and halves it
+ * when the share of used slots in a window falls below min_accuracy. Slots
+ * that are dropped while still queued are canceled outside the lock, as the
+ * emulator completes canceled commands on the canceling thread.
+ */
+class kvs_read_ahead {
+public:
+  kvs_read_ahead(kvs_key_space_handle ks_hd, const kvs_option_read_ahead &opt);
+  // waits for the speculative retrieves in flight
+  ~kvs_read_ahead();
+
+  // serves a retrieve from the slots, false on a miss, and sends the
+  // speculative retrieves the key's stream wants. A synchronous retrieve
+  // (post_fn NULL) waits for a slot of the key in flight; an asynchronous
+  // one is queued on it, *queued is set and the caller's key space reference
+  // passes to the waiter. A completed slot is passed to post_fn before this
+  // returns.
+  bool retrieve(kvs_key *key, kvs_value *value, void *private1, void *private2,
+                kvs_postprocess_function post_fn, bool *queued, kvs_result *ret);
+  // a write of key was sent or completed, NULL for writes of many keys
+  void written(const kvs_key *key);
+  // called for every asynchronous completion of the key space before its
+  // post process function runs
+  void completed(const kvs_postprocess_context *iocb, kvs_postprocess_function post_fn);
+  void get_stats(kvs_read_ahead_stats *stats);
+
+private:
+  static const uint32_t NVERSIONS = 4096;
+
+  enum key_format { DECIMAL, DECIMAL_PADDED, BINARY };
+  enum slot_state { FREE, INFLIGHT, READY };
+
+  // where the number of a key is
+  struct key_number {
+    key_format format;
+    uint32_t pos;       // of the first byte of the number
+    uint32_t width;     // bytes of the number
+    uint64_t n;
+    uint64_t kind;      // hash of the format and the bytes around the number
+  };
+
+  struct waiter {
+    kvs_postprocess_function post_fn;   // NULL for a synchronous retrieve
+    void *private1;
+    void *private2;
+    kvs_key *key;
+    kvs_value *value;
+    // set for a synchronous retrieve, signalled through done_cond_
+    bool *done;
+    bool *served;
+    kvs_result *result;
+  };
+
+  struct stream;
+
+  struct slot {
+    kvs_read_ahead *owner;
+    stream *st;           // NULL once dropped
+    slot_state state;
+    std::string key;
+    uint64_t n;
+    uint32_t bucket;      // of versions_
+    uint32_t version;
+    uint64_t epoch;
+    kvs_key dev_key;
+    kvs_value dev_value;
+    char *buf;            // allocated with kvs_malloc, DMA capable for UDD
+    kvs_result result;
+    uint32_t size;
+    std::vector<waiter> waiters;
+  };
+
+  struct stream {
+    uint64_t kind;
+    std::string prefix;   // bytes before and after the number
+    std::string suffix;
+    key_format format;
+    uint32_t width;
+    uint64_t last;
+    int64_t stride;       // 0 until a second retrieve of the kind
+    uint32_t confirmed;   // retrieves that followed the stride
+    uint64_t next;        // next number to read ahead
+    uint64_t lru;
+    uint32_t depth;       // current depth, 0 while throttled
+    std::vector<slot*> slots;   // in flight or buffered
+    uint32_t used;        // outcomes of the current accuracy window
+    uint32_t wasted;
+    uint32_t idle;        // confirmed retrieves while throttled
+  };
+
+  static void _on_done(kvs_postprocess_context *ctx);
+  static bool _parse(const kvs_key *key, key_number *num);
+  static uint64_t _hash(const void *p, uint32_t len, uint64_t h);
+  uint32_t _bucket(const void *key, uint32_t len) const;
+
+  // lock_ held
+  stream *_follow(const kvs_key *key, const key_number &num, std::vector<slot*> &cancel);
+  void _plan(stream *s, std::vector<slot*> &send);
+  bool _render(const stream *s, uint64_t n, std::string *key) const;
+  bool _current(const slot *sl) const;
+  bool _fits(const slot *sl, const kvs_value *value) const;
+  void _serve(const slot *sl, kvs_value *value, kvs_result *ret) const;
+  void _used(slot *sl);
+  void _drop(slot *sl, bool invalid, std::vector<slot*> &cancel);
+  void _free(slot *sl);
+  void _window(stream *s);
+  void _reset(stream *s, std::vector<slot*> &cancel);
+
+  void _send(std::vector<slot*> &send);
+  void _cancel(std::vector<slot*> &cancel);
+  void _complete(slot *sl, kvs_result result, uint32_t size);
+  void _resubmitter();
+
+  kvs_key_space_handle ks_hd_;
+  kvs_option_read_ahead opt_;
+  std::unique_ptr<std::atomic<uint32_t>[]> versions_;
+  std::atomic<uint64_t> epoch_;
+  std::atomic<bool> cancel_;   // the driver cancels queued commands
+
+  std::mutex lock_;
+  std::condition_variable done_cond_;       // slots completed or resubmitted
+  std::condition_variable resubmit_cond_;   // wakes the resubmitter
+  std::vector<slot> slots_;
+  std::vector<slot*> free_;
+  std::vector<stream> streams_;
+  std::unordered_map<std::string, slot*> map_;
+  uint64_t clock_;
+  uint32_t inflight_;
+  kvs_read_ahead_stats stats_;
+  std::deque<waiter> resubmits_;
+  bool stop_;
+  std::thread resubmitter_;
+};
+
+/*
+ * Brackets a synchronous write in the version counters of its key, see
+ * kvs_read_ahead::written.
+ */
+class kvs_read_ahead_write {
+public:
+  kvs_read_ahead_write(kvs_read_ahead *ra, const kvs_key *key) : ra_(ra), key_(key) {
+    if (ra_) ra_->written(key_);
+  }
+  ~kvs_read_ahead_write() {
+    if (ra_) ra_->written(key_);
+  }
+
+private:
+  kvs_read_ahead *ra_;
+  const kvs_key *key_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_READ_AHEAD_H_ */
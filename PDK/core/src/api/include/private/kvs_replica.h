@@ -0,0 +1,142 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_REPLICA_H_
+#define INCLUDE_PRIVATE_KVS_REPLICA_H_
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "kvs_api.h"
+
+/*
+ * Replica set over Key Spaces (see kvs_open_replica_set).
+ *
+ * Writes are sent to every replica as asynchronous commands and the caller
+ * waits until write_quorum of them have completed. When that is fewer than
+ * all of them, the key and value are copied first so that the remaining
+ * writes can finish after the call has returned.
+ *
+ * Hedged reads go through private buffers, one per replica asked, because a
+ * read that lost the race still completes later. The first definitive
+ * answer (a value, a missing key or a short buffer) is copied to the
+ * caller. The backup read delay is the hedge_percentile of the latencies of
+ * the last LATENCY_WINDOW reads, recomputed every LATENCY_UPDATE reads;
+ * there is no hedging until the first window has been filled.
+ */
+class kvs_replica_set {
+public:
+  kvs_replica_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt,
+                  const kvs_option_replica &opt);
+  // waits for the replica writes still in flight
+  ~kvs_replica_set();
+
+  kvs_result store(const kvs_key *key, const kvs_value *value,
+                   const kvs_option_store *opt);
+  kvs_result remove(const kvs_key *key, const kvs_option_delete *opt);
+  kvs_result retrieve(const kvs_key *key, kvs_value *value);
+  void get_stats(kvs_replica_stats *stats);
+
+private:
+  static const uint32_t LATENCY_WINDOW = 1024;
+  static const uint32_t LATENCY_UPDATE = 64;
+
+  struct write_op {
+    kvs_replica_set *owner;
+    kvs_key key;
+    kvs_value value;
+    char *buf;            // copy of key and value, NULL when the caller waits for all
+    kvs_context cmd;
+    kvs_option_store st_opt;
+    kvs_option_delete del_opt;
+    uint8_t pending;      // replica writes not completed yet
+    uint8_t acked;        // replica writes that succeeded
+    uint8_t missing;      // acknowledged deletes of a key the replica did not have
+    kvs_result error;     // first replica error
+    bool waiting;         // the caller has not returned yet
+  };
+
+  struct read_op;
+
+  struct read_attempt {
+    read_op *op;
+    uint8_t replica;
+    char *buf;
+    kvs_value value;
+    uint64_t start_us;
+  };
+
+  struct read_op {
+    kvs_replica_set *owner;
+    char *key_buf;
+    kvs_key key;
+    read_attempt attempts[KVS_MAX_REPLICAS];
+    uint8_t issued;
+    uint8_t completed;
+    int winner;           // attempt that answered first, -1 while none has
+    kvs_result result;    // answer of the winner, else the last error
+    bool waiting;
+  };
+
+  static void _on_write_done(kvs_postprocess_context *ctx);
+  static void _on_read_done(kvs_postprocess_context *ctx);
+
+  kvs_result _write(write_op *op);
+  void _write_done(write_op *op, kvs_result result);
+  void _free_write(write_op *op);
+  kvs_result _retrieve_direct(const kvs_key *key, kvs_value *value);
+  void _issue_read(read_op *op, std::unique_lock<std::mutex> &lock);
+  void _read_done(read_attempt *att, kvs_result result);
+  void _free_read(read_op *op);
+  void _record_latency(uint64_t us);
+  uint8_t _next_replica();
+
+  std::vector<kvs_key_space_handle> ks_;
+  kvs_option_replica opt_;
+  uint8_t quorum_;
+  std::atomic<uint32_t> next_;
+
+  std::mutex lock_;
+  std::condition_variable done_cond_;   // a replica command completed
+  uint64_t outstanding_;                // operations replica commands still refer to
+  std::vector<uint32_t> latencies_;     // ring of recent read latencies in us
+  uint32_t latency_pos_;
+  uint64_t latency_cnt_;
+  kvs_replica_stats stats_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_REPLICA_H_ */
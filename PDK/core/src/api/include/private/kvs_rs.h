@@ -0,0 +1,91 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_RS_H_
+#define INCLUDE_PRIVATE_KVS_RS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Systematic Reed-Solomon code over GF(2^8) (polynomial 0x11d).
+ *
+ * The encoding matrix is the k x k identity on top of an m x k Cauchy
+ * matrix, so every k of the k + m fragments are enough to rebuild the data.
+ * Fragments are combined with region multiplies: each constant gets a table
+ * of its products with the 16 low and the 16 high nibbles, and with SSSE3 or
+ * AVX2 (chosen at compile time, the tree builds with -march=native) a byte
+ * shuffle looks up 16 or 32 bytes at once.
+ */
+class kvs_rs_codec {
+public:
+  // k data and m parity fragments, k + m <= 255. simd = false forces the
+  // scalar region multiply, for comparisons.
+  kvs_rs_codec(int k, int m, bool simd = true);
+
+  int data_fragments() const { return k_; }
+  int parity_fragments() const { return m_; }
+
+  // computes the m parity fragments of len bytes from the k data fragments
+  void encode(const uint8_t * const *data, uint8_t * const *parity, size_t len) const;
+
+  // frags holds k + m fragments of len bytes, data first. Rebuilds the data
+  // fragments whose present[] entry is false from k present ones; false if
+  // fewer than k are present.
+  bool decode(uint8_t * const *frags, const bool *present, size_t len) const;
+
+  // name of the region multiply in use
+  const char *simd_name() const;
+
+private:
+  struct mul_table {
+    uint8_t lo[16];
+    uint8_t hi[16];
+  };
+
+  static void _make_table(uint8_t c, mul_table *t);
+  // dst (^)= c * src
+  void _mul_region(const mul_table &t, const uint8_t *src, uint8_t *dst,
+                   size_t len, bool add) const;
+
+  int k_;
+  int m_;
+  bool simd_;
+  std::vector<uint8_t> parity_rows_;        // m x k Cauchy coefficients
+  std::vector<mul_table> parity_tables_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_RS_H_ */
@@ -0,0 +1,78 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_STATS_H_
+#define INCLUDE_PRIVATE_KVS_STATS_H_
+
+#include <cstdint>
+#include <time.h>
+#include "private_types.h"
+#include "kvs_stats_shm.h"
+
+/*
+ * Export of the device, key space and queue statistics to shared memory,
+ * see kvs_stats_shm.h for the layout.
+ *
+ * kvs_stats_open() maps the segment once per process. Devices and key
+ * spaces take a slot of it when they are opened and give it back when they
+ * are closed; the ones that find no free slot are not exported. A driver
+ * stamps a request with kvs_stats_start() when it prepares it and counts it
+ * with kvs_stats_done() when it completes, before the caller is told. A
+ * request is counted in the shard of the thread that completes it.
+ */
+
+// creates the named segment, warns and returns false if it cannot
+bool kvs_stats_open(const char *name);
+kvs_stats_device *kvs_stats_device_alloc(const char *path);
+void kvs_stats_device_free(kvs_stats_device *dev);
+kvs_stats_key_space *kvs_stats_key_space_alloc(kvs_stats_device *dev, const char *name);
+void kvs_stats_key_space_free(kvs_stats_key_space *ks);
+
+inline uint64_t kvs_stats_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// the start time of a request, 0 when its device is not exported
+inline uint64_t kvs_stats_start(kvs_key_space_handle ks_hd) {
+  if (ks_hd == NULL || ks_hd->dev == NULL || ks_hd->dev->stats == NULL) return 0;
+  return kvs_stats_now();
+}
+
+void kvs_stats_done(kvs_key_space_handle ks_hd, kvs_context op, bool failed,
+                    uint64_t bytes, uint64_t start);
+
+#endif /* INCLUDE_PRIVATE_KVS_STATS_H_ */
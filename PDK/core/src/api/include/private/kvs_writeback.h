@@ -0,0 +1,165 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef INCLUDE_PRIVATE_KVS_WRITEBACK_H_
+#define INCLUDE_PRIVATE_KVS_WRITEBACK_H_
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include "kvs_api.h"
+
+/*
+ * Write-back buffer of a key space (see kvs_set_writeback).
+ *
+ * Every buffered key has one entry in the map that points to its newest
+ * value. An entry is DIRTY until a flush picks it up, then FLUSHING until
+ * the device write completes. A store to a DIRTY entry replaces its value in
+ * place; a store to a FLUSHING entry creates a new DIRTY entry that is held
+ * back until the older write has completed, so writes of one key reach the
+ * device in order. Reads are served from the newest entry either way.
+ *
+ * A flusher thread writes all eligible DIRTY entries with asynchronous
+ * driver commands when a size, time or explicit trigger fires.
+ *
+ * Requests that have to reach the device after the buffered writes of their
+ * keys wait only for those keys: their entries are flushed at once, out of
+ * the regular rounds. A synchronous caller waits for them; an asynchronous
+ * one is parked on them and sent by the flusher thread once they completed,
+ * as the completion may run on the driver thread that a caller waiting
+ * there would block.
+ */
+class kvs_writeback {
+public:
+  kvs_writeback(kvs_key_space_handle ks_hd, const kvs_option_writeback &opt);
+  // flushes what is left and stops the flusher
+  ~kvs_writeback();
+
+  // false when the store has to go to the device instead. A synchronous
+  // store returns after any buffered value of the key has been flushed, an
+  // asynchronous one has to be parked behind it.
+  bool store(const kvs_key *key, const kvs_value *value, const kvs_option_store *opt,
+             void *private1, void *private2, kvs_postprocess_function post_fn,
+             kvs_result *ret);
+  // false on a miss
+  bool retrieve(const kvs_key *key, kvs_value *value, kvs_result *ret);
+  // flushes the buffered writes of the keys and waits for them
+  void flush_keys(const kvs_key *keys, uint32_t key_cnt);
+  // false if none of the keys is buffered. Otherwise their writes are
+  // flushed and the flusher thread calls send once all of them completed;
+  // send must not block.
+  bool park(const kvs_key *keys, uint32_t key_cnt, const std::function<void()> &send);
+  // flushes the buffer and waits for the writes
+  void drain();
+  // flushes the buffer, returns the first write error since the last call
+  kvs_result flush();
+  void get_stats(kvs_writeback_stats *stats);
+
+private:
+  enum entry_state { DIRTY, FLUSHING };
+
+  struct waiter {
+    kvs_postprocess_function post_fn;
+    void *private1;
+    void *private2;
+    kvs_key *key;
+    kvs_value *value;
+    // set for a synchronous store, signalled through done_cond_
+    bool *done;
+    kvs_result *result;
+  };
+
+  // a request waiting for the writes of its keys
+  struct parked_request {
+    uint32_t pending;             // entries it still waits for
+    std::function<void()> send;   // empty for a synchronous caller
+  };
+
+  struct entry {
+    std::string key;
+    char *buf;              // allocated with kvs_malloc, DMA capable for UDD
+    uint32_t buf_size;
+    uint32_t length;
+    entry_state state;
+    bool urgent;            // a parked request waits for it, flush at once
+    entry *older;           // FLUSHING entry of the same key this one waits for
+    kvs_key dev_key;
+    kvs_value dev_value;
+    kvs_writeback *owner;
+    std::vector<waiter> waiters;
+    std::vector<parked_request*> parked;
+  };
+
+  static void _on_flushed(kvs_postprocess_context *ctx);
+
+  void _flusher();
+  bool _flush_due(uint64_t now_us) const;
+  bool _urgent_due() const;
+  bool _park(const kvs_key *keys, uint32_t key_cnt, parked_request *p);
+  void _submit(entry *e);
+  void _complete(entry *e, kvs_result result);
+  void _drain(std::unique_lock<std::mutex> &lock);
+  bool _set_value(entry *e, const kvs_value *value);
+  void _free_entry(entry *e);
+
+  kvs_key_space_handle ks_hd_;
+  kvs_option_writeback opt_;
+
+  std::mutex lock_;
+  std::condition_variable flush_cond_;   // wakes the flusher
+  std::condition_variable space_cond_;   // buffer space freed or writes completed
+  std::condition_variable done_cond_;    // synchronous stores or key flushes completed
+  std::unordered_map<std::string, entry*> map_;
+  std::deque<entry*> dirty_;
+  std::deque<parked_request*> ready_;    // parked requests to send
+  uint64_t urgent_;                      // urgent entries in dirty_
+  uint64_t parked_;                      // parked requests not sent yet
+  uint64_t bytes_;
+  uint64_t inflight_;
+  uint64_t first_dirty_us_;
+  bool want_flush_;
+  bool stop_;
+  kvs_result first_error_;
+  kvs_writeback_stats stats_;
+  std::thread flusher_;
+};
+
+#endif /* INCLUDE_PRIVATE_KVS_WRITEBACK_H_ */
@@ -44,6 +44,7 @@
 #include <map>
 #include <condition_variable>
 #include "kvs_api.h"
+#include "kvs_dispatch.h"
 
 
 #ifndef WITH_SPDK
@@ -130,6 +131,7 @@ public:
   kvs_postprocess_function user_io_complete;
   std::list<kvs_key_space*> list_containers;
   std::list<kvs_key_space_handle> open_containers;
+  kvs_dispatcher dispatcher;    // runs the post process functions of asynchronous I/O
 
  public:
  KvsDriver(kv_device_priv *dev_, kvs_postprocess_function user_io_complete_):
@@ -179,6 +181,14 @@ public:
   virtual int32_t get_used_size(uint32_t *dev_util) {return 0;}
   virtual int32_t get_total_size(uint64_t *dev_capa) {return 0;}
   virtual int32_t get_device_info(kvs_device *dev_info) {return 0;}
+  virtual int32_t get_ttl_stats(kvs_ttl_stats *stats) {return KVS_ERR_OPTION_INVALID;}
+  virtual int32_t get_cache_stats(kvs_cache_stats *stats) {return KVS_ERR_OPTION_INVALID;}
+  virtual int32_t write_batch(kvs_key_space_handle ks_hd, const kvs_batch_op *ops, uint32_t op_cnt,
+    void *private1=NULL, void *private2=NULL, bool sync = false, kvs_postprocess_function cbfn = NULL) {return KVS_ERR_OPTION_INVALID;}
+  virtual int32_t cancel_io(kvs_key_space_handle ks_hd, void *private1, uint32_t *canceled) {return KVS_ERR_OPTION_INVALID;}
+  //lets the driver publish its own counters, e.g. of its queues, next to the
+  //ones the library keeps for the device
+  virtual void export_stats(struct kvs_stats_device *stats) {}
   
   std::string path;
 };
@@ -188,16 +198,60 @@ struct _kvs_device_handle {
   KvsDriver* driver;
   char* dev_path;
   kvs_key_space_handle meta_ks_hd;
+  std::mutex ks_lock; //protects open_ks_hds
   std::list<kvs_key_space_handle> open_ks_hds; //containers opened by user
+  struct kvs_stats_device *stats; //shared memory statistics, NULL when not exported
 };
 
+class kvs_writeback;
+class kvs_chunk_codec;
+class kvs_long_keys;
+class kvs_hot_keys;
+class kvs_read_ahead;
+
 struct _kvs_key_space_handle {
   uint8_t container_id;
   uint8_t keyspace_id; //corresponding keyspace id in KVSSD
   kvs_device_handle dev;
   char name[MAX_CONT_PATH_LEN + 1];
+  kvs_writeback *wb; //write-back buffer, NULL when disabled
+  kvs_chunk_codec *codec; //value checksums or encryption, NULL when disabled
+  kvs_long_keys *long_keys; //long key iterators, NULL when disabled
+  kvs_hot_keys *hot_keys; //hot key tracking, NULL when disabled
+  kvs_read_ahead *read_ahead; //speculative read-ahead, NULL when disabled
+  struct kvs_stats_key_space *stats; //shared memory statistics, NULL when not exported
+};
+
+class kvs_replica_set;
+
+struct _kvs_replica_set_handle {
+  kvs_replica_set *rs;
+};
+
+class kvs_ec_set;
+
+struct _kvs_ec_set_handle {
+  kvs_ec_set *ec;
 };
 
+//capacity of the handle tables in cfrontend
+const int MAX_OPEN_DEVICES = 64;
+const int MAX_OPEN_KEY_SPACES = 1024;
+const int MAX_OPEN_REPLICA_SETS = 64;
+const int MAX_OPEN_EC_SETS = 64;
+
+//drops the reference an asynchronous I/O holds on its key space, called by
+//the dispatcher of the driver once the user completion function has returned
+void _kvs_key_space_io_done(kvs_key_space_handle ks_hd);
+//takes such a reference for an I/O issued inside the library
+bool _kvs_key_space_hold(kvs_key_space_handle ks_hd);
+//the private1 the caller passed for an asynchronous request, looking through
+//the objects the library wraps a request in (for kvs_cancel_io)
+void *_kvs_user_private1(void *private1, kvs_postprocess_function post_fn);
+//retrieve below the long key layer, with the write-back buffer and codec
+kvs_result _kvs_retrieve_kvp(kvs_key_space_handle ks_hd, kvs_key *key,
+  kvs_option_retrieve *opt, kvs_value *value);
+
 typedef struct {
   struct {
     int use_dpdk;                 /*!< use DPDK as a memory allocator. It should be 1 if SPDK driver is in use. */
@@ -220,6 +274,9 @@ typedef struct {
     uint32_t mem_size_mb;
     int syncio;
   } udd;
+  struct {
+    char shm_name[256];           /*!< shared memory object the statistics are exported to, empty for none */
+  } stats;
     char *emul_config_file;
 } kvs_init_options;
 
@@ -67,6 +67,7 @@ public:
     KUDDriver *owner;
     kvs_postprocess_function on_complete;
     kvs_iterator_list *iter_list;
+    uint64_t submitter;
   } kv_udd_context;
   
   std::mutex lock;
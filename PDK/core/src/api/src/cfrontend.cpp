@@ -35,8 +35,20 @@
 #include <string.h>
 #include <map>
 #include <list>
+#include <vector>
+#include <functional>
 #include "kvs_utils.h"
 #include "private_types.h"
+#include "kvs_handle_table.h"
+#include "kvs_writeback.h"
+#include "kvs_checksum.h"
+#include "kvs_aes.h"
+#include "kvs_long_key.h"
+#include "kvs_hot_keys.h"
+#include "kvs_read_ahead.h"
+#include "kvs_stats.h"
+#include "kvs_replica.h"
+#include "kvs_erasure.h"
 #ifdef WITH_EMU
 #include "kvemul.hpp"
 #elif WITH_KDD
@@ -64,8 +76,6 @@ struct {
   int is_polling = 0;
   int opened_device_num = 0;
   std::map<std::string, kv_device_priv *> list_devices;
-  std::list<kvs_device_handle> open_devices;
-  std::list<kvs_key_space_handle> list_open_ks;
 #if defined WITH_SPDK
   struct {
     uint64_t cq_masks[NR_MAX_SSD];
@@ -78,6 +88,20 @@ struct {
   char configfile[256];
 } g_env;
 
+//open device and key space handles, see kvs_handle_table.h
+typedef kvs_handle_table<_kvs_device_handle, MAX_OPEN_DEVICES> device_table;
+typedef kvs_handle_table<_kvs_key_space_handle, MAX_OPEN_KEY_SPACES> key_space_table;
+typedef kvs_handle_ref<device_table, _kvs_device_handle> device_ref;
+typedef kvs_handle_ref<key_space_table, _kvs_key_space_handle> key_space_ref;
+typedef kvs_handle_table<_kvs_replica_set_handle, MAX_OPEN_REPLICA_SETS> replica_set_table;
+typedef kvs_handle_ref<replica_set_table, _kvs_replica_set_handle> replica_set_ref;
+typedef kvs_handle_table<_kvs_ec_set_handle, MAX_OPEN_EC_SETS> ec_set_table;
+typedef kvs_handle_ref<ec_set_table, _kvs_ec_set_handle> ec_set_ref;
+static device_table g_devices;
+static key_space_table g_key_spaces;
+static replica_set_table g_replica_sets;
+static ec_set_table g_ec_sets;
+
 #define stringify(name) # name
 #define kvs_errstr(name) (errortable[name])
 const char* errortable[] = {
@@ -106,6 +130,9 @@ const char* errortable[] = {
   stringify(KVS_ERR_VALUE_OFFSET_MISALIGNED),
   stringify(KVS_ERR_VALUE_UPDATE_NOT_ALLOWED),
   stringify(KVS_ERR_DEV_NOT_OPENED),
+  stringify(KVS_ERR_CHECKSUM_MISMATCH),
+  stringify(KVS_ERR_DEADLINE_EXCEEDED),
+  stringify(KVS_ERR_CANCELED),
 };
 
 void init_default_option(kvs_init_options &options) {
@@ -143,6 +170,9 @@ void init_env_from_cfgfile(kvs_init_options &options) {
   if (cfg_file_path != "") {
     strncpy(options.emul_config_file, cfg_file_path.c_str(), cfg_file_path.length() + 1);
   }
+  std::string stats_shm = cfg.getkv("stats", "shm_name");
+  if (stats_shm != "")
+    snprintf(options.stats.shm_name, sizeof(options.stats.shm_name), "%s", stats_shm.c_str());
 #ifdef WITH_SPDK
   options.memory.use_dpdk = 1;
   if (strcmp(cfg.getkv("udd", "core_mask_str").c_str(), ""))
@@ -167,6 +197,8 @@ void init_env_from_environ(kvs_init_options &options) {
   if (env_str) options.aio.iocoremask = (uint64_t)atoi(env_str);
   env_str = getenv("KVSSD_EMU_CONFIGFILE");
   if (env_str) strncpy(options.emul_config_file, env_str, PATH_MAX);
+  env_str = getenv("KVSSD_STATS_SHM");
+  if (env_str) snprintf(options.stats.shm_name, sizeof(options.stats.shm_name), "%s", env_str);
 #ifdef WITH_SPDK
   options.memory.use_dpdk = 1;
   env_str = getenv("KVSSD_COREMASK_STR");
@@ -244,6 +276,10 @@ kvs_result kvs_init_env(kvs_init_options* options) {
       //g_env.is_polling = options->aio.is_polling;
     }
 
+    // export statistics, the library works on without them
+    if (options->stats.shm_name[0] != '\0')
+      kvs_stats_open(options->stats.shm_name);
+
     // initialize cache if needed
     if (options->memory.max_cachesize_mb > 0) {
       WRITE_WARNING("Key-value caching is not supported yet\n");
@@ -289,20 +325,13 @@ kvs_result init_env() {
   return ret;
 }
 
+//caller holds env_mutex, which serializes device open and close
 bool _device_opened(const char* dev_path) {
-  std::string dev(dev_path);
-  for (auto &t : g_env.open_devices) {
-    if (t->dev_path == dev) return true;
-  }
-  return false;
-}
-
-bool _device_opened(kvs_device_handle dev_hd){
-  auto t  = find(g_env.open_devices.begin(), g_env.open_devices.end(), dev_hd);
-  if (t == g_env.open_devices.end()){
-    return false;
-  }
-  return true;
+  bool opened = false;
+  g_devices.for_each_open([&](kvs_device_handle t) {
+    if (t->dev_path && strcmp(t->dev_path, dev_path) == 0) opened = true;
+  });
+  return opened;
 }
 
 kv_device_priv *_find_local_device_from_path(const std::string &devpath,
@@ -373,17 +402,91 @@ KvsDriver *_select_driver(kv_device_priv *dev) {
     return nullptr;
 }
 
-void _remove_key_space_from_g_env(kvs_key_space_handle ks_hd) {
-  auto t = find(g_env.list_open_ks.begin(), g_env.list_open_ks.end(), ks_hd);
-  if (t != g_env.list_open_ks.end()) {
-    g_env.list_open_ks.erase(t);
+void _kvs_key_space_io_done(kvs_key_space_handle ks_hd) {
+  g_key_spaces.release(ks_hd);
+}
+
+bool _kvs_key_space_hold(kvs_key_space_handle ks_hd) {
+  return g_key_spaces.hold(ks_hd);
+}
+
+void *_kvs_user_private1(void *private1, kvs_postprocess_function post_fn) {
+  while (true) {
+    if (post_fn == kvs_long_key_io::on_done) {
+      kvs_long_key_io *io = (kvs_long_key_io*)private1;
+      private1 = io->user_private1();
+      post_fn = io->user_post_fn();
+    } else if (post_fn == kvs_chunk_io::on_done) {
+      kvs_chunk_io *io = (kvs_chunk_io*)private1;
+      private1 = io->user_private1();
+      post_fn = io->user_post_fn();
+    } else {
+      return private1;
+    }
   }
 }
 
+//flushes and removes the write-back buffer of a key space
+kvs_result _kvs_writeback_close(kvs_key_space_handle ks_hd) {
+  if (ks_hd->wb == NULL) return KVS_SUCCESS;
+  kvs_result ret = ks_hd->wb->flush();
+  delete ks_hd->wb;
+  ks_hd->wb = NULL;
+  return ret;
+}
+
+//removes the checksum or encryption codec of a key space
+void _kvs_codec_close(kvs_key_space_handle ks_hd) {
+  delete ks_hd->codec;
+  ks_hd->codec = NULL;
+}
+
+//removes the long key layer of a key space
+void _kvs_long_keys_close(kvs_key_space_handle ks_hd) {
+  delete ks_hd->long_keys;
+  ks_hd->long_keys = NULL;
+}
+
+//stops hot key tracking of a key space
+void _kvs_hot_keys_close(kvs_key_space_handle ks_hd) {
+  delete ks_hd->hot_keys;
+  ks_hd->hot_keys = NULL;
+}
+
+//a sampled asynchronous retrieve, recorded once its value size is known
+struct hot_key_read {
+  kvs_hot_keys *hot_keys;
+  void *private1;
+  void *private2;
+  kvs_postprocess_function post_fn;
+};
+
+static void _hot_key_read_done(kvs_postprocess_context *ctx) {
+  hot_key_read *r = (hot_key_read*)ctx->private1;
+  r->hot_keys->read_sampled(ctx->key,
+    ctx->result == KVS_SUCCESS ? ctx->value->actual_value_size : 0);
+  ctx->private1 = r->private1;
+  ctx->private2 = r->private2;
+  r->post_fn(ctx);
+  delete r;
+}
+
+//stops read-ahead of a key space, waits for its speculative retrieves
+void _kvs_read_ahead_close(kvs_key_space_handle ks_hd) {
+  delete ks_hd->read_ahead;
+  ks_hd->read_ahead = NULL;
+}
+
+//gives back the shared memory statistics slot of a key space
+void _kvs_stats_close(kvs_key_space_handle ks_hd) {
+  kvs_stats_key_space_free(ks_hd->stats);
+  ks_hd->stats = NULL;
+}
+
 kvs_result _kvs_exit_env() {
   g_env.initialized = false;
-  std::list<kvs_device_handle > clone(g_env.open_devices.begin(),
-                                      g_env.open_devices.end());
+  std::list<kvs_device_handle > clone;
+  g_devices.for_each_open([&](kvs_device_handle t) { clone.push_back(t); });
   
   //fprintf(stderr, "KVSSD: Close %d unclosed devices\n", (int) clone.size());
   for (kvs_device_handle t : clone) {
@@ -416,16 +519,17 @@ kvs_result kvs_open_device(char *URI, kvs_device_handle *dev_hd) {
     return KVS_ERR_SYS_IO;
   }
 
-  kvs_device_handle user_dev = new _kvs_device_handle();
+  kvs_device_handle user_dev = g_devices.alloc();
   if (user_dev == NULL) {
-    WRITE_ERR("Out of memory, malloc failed\n");
+    WRITE_ERR("Too many open devices\n");
     pthread_mutex_unlock(&env_mutex);
     return KVS_ERR_SYS_IO;
   }
   kv_device_priv *dev = _find_local_device_from_path(URI, &(g_env.list_devices));
   if (dev == NULL) {
     WRITE_ERR("can't find the device: %s\n", URI);
-    delete user_dev;
+    g_devices.close(user_dev);
+    g_devices.free(user_dev);
     pthread_mutex_unlock(&env_mutex);
     return KVS_ERR_DEV_NOT_EXIST;
   }
@@ -450,25 +554,29 @@ kvs_result kvs_open_device(char *URI, kvs_device_handle *dev_hd) {
     ret = (kvs_result)user_dev->driver->init(URI, g_env.configfile, g_env.queuedepth,
       g_env.is_polling);
   if(ret != KVS_SUCCESS) {
-    delete user_dev;
+    g_devices.close(user_dev);
+    g_devices.free(user_dev);
     pthread_mutex_unlock(&env_mutex);
     return ret;
   }
 #endif
   user_dev->dev_path = (char*)malloc(strlen(URI) + 1);
   if (user_dev->dev_path == NULL) {
-    delete user_dev;
+    g_devices.close(user_dev);
+    g_devices.free(user_dev);
     pthread_mutex_unlock(&env_mutex);
     return KVS_ERR_SYS_IO;
   }
   snprintf(user_dev->dev_path, strlen(URI) + 1, "%s", URI);
-  g_env.open_devices.push_back(user_dev);
+  user_dev->stats = kvs_stats_device_alloc(URI);
+  if (user_dev->stats) user_dev->driver->export_stats(user_dev->stats);
 
-  //create meta data key space
+  //create meta data key space, it is only used internally and does not need
+  //a slot in the key space table
   kvs_key_space_handle ks_handle = (kvs_key_space_handle)malloc(sizeof(struct _kvs_key_space_handle));
   if (!ks_handle) {
     user_dev->meta_ks_hd = NULL;
-    g_env.open_devices.remove(user_dev);
+    ++g_env.opened_device_num;
     pthread_mutex_unlock(&env_mutex);
     kvs_close_device(user_dev);
     *dev_hd = NULL;
@@ -477,6 +585,12 @@ kvs_result kvs_open_device(char *URI, kvs_device_handle *dev_hd) {
   user_dev->meta_ks_hd = ks_handle;
   ks_handle->keyspace_id = META_DATA_KEYSPACE_ID;
   ks_handle->dev = user_dev;
+  ks_handle->wb = NULL;
+  ks_handle->codec = NULL;
+  ks_handle->long_keys = NULL;
+  ks_handle->hot_keys = NULL;
+  ks_handle->read_ahead = NULL;
+  ks_handle->stats = NULL;
   snprintf(ks_handle->name, sizeof(ks_handle->name), "%s", "meta_data_keyspace");
   *dev_hd = user_dev;
 
@@ -490,7 +604,8 @@ kvs_result kvs_get_device_info(kvs_device_handle dev_hd, kvs_device *dev_info) {
   if((dev_hd == NULL) || (dev_info == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if (!_device_opened(dev_hd)) {
+  device_ref ref(g_devices);
+  if (!ref.acquire(dev_hd)) {
     ret = KVS_ERR_DEV_NOT_OPENED;
   } else {  
     ret = (kvs_result)dev_hd->driver->get_total_size(&dev_info->capacity);
@@ -502,31 +617,78 @@ kvs_result kvs_get_device_info(kvs_device_handle dev_hd, kvs_device *dev_info) {
   return ret;
 }
 
+kvs_result kvs_get_ttl_stats(kvs_device_handle dev_hd, kvs_ttl_stats *stats) {
+  if (dev_hd == NULL || stats == NULL) {
+    return KVS_ERR_PARAM_INVALID;
+  }
+  device_ref ref(g_devices);
+  if (!ref.acquire(dev_hd)) {
+    return KVS_ERR_DEV_NOT_OPENED;
+  }
+  return (kvs_result)dev_hd->driver->get_ttl_stats(stats);
+}
+
+kvs_result kvs_get_cache_stats(kvs_device_handle dev_hd, kvs_cache_stats *stats) {
+  if (dev_hd == NULL || stats == NULL) {
+    return KVS_ERR_PARAM_INVALID;
+  }
+  device_ref ref(g_devices);
+  if (!ref.acquire(dev_hd)) {
+    return KVS_ERR_DEV_NOT_OPENED;
+  }
+  return (kvs_result)dev_hd->driver->get_cache_stats(stats);
+}
+
+kvs_result kvs_set_completion_dispatch(kvs_device_handle dev_hd, kvs_option_dispatch *opt) {
+  if (dev_hd == NULL) {
+    return KVS_ERR_PARAM_INVALID;
+  }
+  device_ref ref(g_devices);
+  if (!ref.acquire(dev_hd)) {
+    return KVS_ERR_DEV_NOT_OPENED;
+  }
+  return dev_hd->driver->dispatcher.configure(opt);
+}
+
 kvs_result kvs_close_device(kvs_device_handle dev_hd) {
   pthread_mutex_lock(&env_mutex);
   if(dev_hd == NULL) {
     pthread_mutex_unlock(&env_mutex);
     return KVS_ERR_PARAM_INVALID;
   }
-  if (!_device_opened(dev_hd)) {
+  //stop new calls on the device and wait for the ones in progress
+  if (!g_devices.close(dev_hd)) {
     pthread_mutex_unlock(&env_mutex);
     return KVS_ERR_DEV_NOT_OPENED;
   }
 
-  //free all opened key space handle in this device
+  //close all key spaces still open in this device, this waits for their
+  //outstanding asynchronous I/O to complete before the driver goes away
+  std::list<kvs_key_space_handle> open_ks_hds;
+  {
+    std::unique_lock<std::mutex> lock(dev_hd->ks_lock);
+    open_ks_hds.swap(dev_hd->open_ks_hds);
+  }
+  for (const auto &t : open_ks_hds) {
+    if (g_key_spaces.close(t)) {
+      if (_kvs_writeback_close(t) != KVS_SUCCESS)
+        fprintf(stderr, "Write-back flush of key space %s failed\n", t->name);
+      _kvs_codec_close(t);
+      _kvs_long_keys_close(t);
+      _kvs_hot_keys_close(t);
+      _kvs_read_ahead_close(t);
+      _kvs_stats_close(t);
+      g_key_spaces.free(t);
+    }
+  }
   if(dev_hd->meta_ks_hd)
     free(dev_hd->meta_ks_hd);
 
-  for (const auto &t : dev_hd->open_ks_hds) {
-    _remove_key_space_from_g_env(t);
-    free(t);
-  }
-  
   delete dev_hd->driver;
+  kvs_stats_device_free(dev_hd->stats);
   delete dev_hd->dev;
-  g_env.open_devices.remove(dev_hd);
   free(dev_hd->dev_path);
-  delete dev_hd;
+  g_devices.free(dev_hd);
 
   if (--g_env.opened_device_num == 0) {
     _kvs_exit_env();
@@ -542,7 +704,8 @@ kvs_result kvs_get_device_capacity(kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (dev_capa == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if (!_device_opened(dev_hd)) {
+  device_ref ref(g_devices);
+  if (!ref.acquire(dev_hd)) {
     ret = KVS_ERR_DEV_NOT_OPENED;
   } else {
     ret = (kvs_result)dev_hd->driver->get_total_size(dev_capa);
@@ -556,7 +719,8 @@ kvs_result kvs_get_device_utilization(kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (dev_utilization == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if (!_device_opened(dev_hd)) {
+  device_ref ref(g_devices);
+  if (!ref.acquire(dev_hd)) {
     ret = KVS_ERR_DEV_NOT_OPENED;
   } else {
     ret = (kvs_result)dev_hd->driver->get_used_size(dev_utilization);
@@ -569,7 +733,7 @@ kvs_result kvs_get_min_key_length (kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (min_key_length == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if(!_device_opened(dev_hd)){
+  if(!g_devices.is_open(dev_hd)){
     return KVS_ERR_DEV_NOT_OPENED;
   }
   *min_key_length = KVS_MIN_KEY_LENGTH;
@@ -581,7 +745,7 @@ kvs_result kvs_get_max_key_length (kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (max_key_length == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if(!_device_opened(dev_hd)){
+  if(!g_devices.is_open(dev_hd)){
     return KVS_ERR_DEV_NOT_OPENED;
   }
   *max_key_length = KVS_MAX_KEY_LENGTH;
@@ -593,7 +757,7 @@ kvs_result kvs_get_min_value_length (kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (min_value_length == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if(!_device_opened(dev_hd)){
+  if(!g_devices.is_open(dev_hd)){
     return KVS_ERR_DEV_NOT_OPENED;
   }
   *min_value_length = KVS_MIN_VALUE_LENGTH;
@@ -605,7 +769,7 @@ kvs_result kvs_get_max_value_length (kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (max_value_length == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if(!_device_opened(dev_hd)){
+  if(!g_devices.is_open(dev_hd)){
     return KVS_ERR_DEV_NOT_OPENED;
   }
   *max_value_length = KVS_MAX_VALUE_LENGTH;
@@ -617,34 +781,36 @@ kvs_result kvs_get_optimal_value_length (kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (opt_value_length == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if(!_device_opened(dev_hd)){
+  if(!g_devices.is_open(dev_hd)){
     return KVS_ERR_DEV_NOT_OPENED;
   }
   *opt_value_length = KVS_OPTIMAL_VALUE_LENGTH;
   return KVS_SUCCESS;
 }
 
-bool _key_space_opened(kvs_device_handle dev_hd, const char* name) {
-  if (dev_hd->open_ks_hds.empty()) return false;
+//caller holds dev_hd->ks_lock
+bool _key_space_opened_locked(kvs_device_handle dev_hd, const char* name) {
   for (const auto &t : dev_hd->open_ks_hds) {
     if (strcmp(t->name, name) == 0) return true;
   }
   return false;
 }
 
-bool _key_space_opened(kvs_key_space_handle ks_hd) {
-  auto t = find(g_env.list_open_ks.begin(), g_env.list_open_ks.end(), ks_hd);
-  if (t == g_env.list_open_ks.end()) return false;
-  else return true;
+bool _key_space_opened(kvs_device_handle dev_hd, const char* name) {
+  std::unique_lock<std::mutex> lock(dev_hd->ks_lock);
+  return _key_space_opened_locked(dev_hd, name);
 }
 
-inline kvs_result _check_key_space_handle(kvs_key_space_handle ks_hd) {
+//Validates a key space handle and pins it until ref goes out of scope.
+//A device close closes all of its key spaces first, so the device and its
+//driver stay valid while the reference is held.
+inline kvs_result _check_key_space_handle(kvs_key_space_handle ks_hd,
+  key_space_ref &ref) {
   if (ks_hd == NULL) return KVS_ERR_PARAM_INVALID;
-  if (!_key_space_opened(ks_hd)) return KVS_ERR_KS_NOT_OPEN;
+  if (!ref.acquire(ks_hd)) return KVS_ERR_KS_NOT_OPEN;
   if ((ks_hd->dev == NULL) || (ks_hd->dev->driver == NULL))
     return KVS_ERR_PARAM_INVALID;
-  if (!_device_opened(ks_hd->dev)) return KVS_ERR_DEV_NOT_OPENED;
-  
+
   return KVS_SUCCESS;
 }
 
@@ -944,8 +1110,7 @@ kvs_result _store_key_space_metadata(kvs_device_handle dev_hd,
   _construct_key_space_metadata_payload(cont, payload_buff);
 
   //store to metadata keyspace
-  kvs_option_store option;
-  option.st_type = st_type;
+  kvs_option_store option = {st_type, NULL};
   const kvs_key kvskey = {key, klen};
   kvs_value kvsvalue = {payload_buff, payload_size, 0, 0};
   ret = _sync_io_to_meta_keyspace(dev_hd, &kvskey, &kvsvalue, &option, KVS_CMD_STORE);
@@ -1083,8 +1248,7 @@ kvs_result _store_key_space_list(kvs_device_handle dev_hd,
   _construct_key_space_list_payload(kslist, payload_buff, &vlen);
 
   //store to meta data keyspace
-  kvs_option_store option;
-  option.st_type = KVS_STORE_POST;
+  kvs_option_store option = {KVS_STORE_POST, NULL};
   const kvs_key  kvskey = {key, klen};
   kvs_value kvsvalue = {payload_buff, vlen, 0, 0};  
   ret = _sync_io_to_meta_keyspace(dev_hd, &kvskey, &kvsvalue, &option,
@@ -1247,7 +1411,8 @@ kvs_result kvs_create_key_space(kvs_device_handle dev_hd,
     return KVS_ERR_KS_NAME;
   }
 
-  if (!_device_opened(dev_hd)) {
+  device_ref dev_ref(g_devices);
+  if (!dev_ref.acquire(dev_hd)) {
     return KVS_ERR_DEV_NOT_EXIST;
   }
   
@@ -1275,7 +1440,8 @@ kvs_result kvs_delete_key_space(kvs_device_handle dev_hd,
   if((dev_hd == NULL) || (key_space_name == NULL) || (key_space_name->name == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  if (!_device_opened(dev_hd)) {
+  device_ref dev_ref(g_devices);
+  if (!dev_ref.acquire(dev_hd)) {
     return KVS_ERR_DEV_NOT_EXIST;
   }
   //before delete key space, key space should in close state
@@ -1308,7 +1474,8 @@ kvs_result kvs_list_key_spaces(kvs_device_handle dev_hd, uint32_t index,
     WRITE_ERR("Index of keyspace should be start form 1 to less or equal MAX keyspace number!\n");
     return KVS_ERR_KS_INDEX;
   }
-  if (!_device_opened(dev_hd)) {
+  device_ref dev_ref(g_devices);
+  if (!dev_ref.acquire(dev_hd)) {
     return KVS_ERR_DEV_NOT_EXIST;
   }
 
@@ -1367,7 +1534,8 @@ kvs_result kvs_open_key_space(kvs_device_handle dev_hd, char *name, kvs_key_spac
     fprintf(stderr, "key space name size is out of range, key space name size = %d\n", ks_name_len);
       return KVS_ERR_KS_NAME;
     }
-  if (!_device_opened(dev_hd)) return KVS_ERR_DEV_NOT_EXIST;
+  device_ref dev_ref(g_devices);
+  if (!dev_ref.acquire(dev_hd)) return KVS_ERR_DEV_NOT_EXIST;
   if (_key_space_opened(dev_hd, name)) return KVS_ERR_KS_OPEN;
 
   uint8_t exist = 0;
@@ -1379,20 +1547,34 @@ kvs_result kvs_open_key_space(kvs_device_handle dev_hd, char *name, kvs_key_spac
   if (!exist) return KVS_ERR_KS_NOT_EXIST;
 
   //open key space
-  kvs_key_space_handle ks_handle = (kvs_key_space_handle)malloc(sizeof(struct _kvs_key_space_handle));
-  if (!ks_handle) return KVS_ERR_SYS_IO;
+  kvs_key_space_handle ks_handle = g_key_spaces.alloc();
+  if (!ks_handle) {
+    fprintf(stderr, "Too many open key spaces\n");
+    return KVS_ERR_SYS_IO;
+  }
   ks_handle->dev = dev_hd;
   snprintf(ks_handle->name, sizeof(ks_handle->name), "%s", name);
 
   ret = _open_key_space(ks_handle);
   if (ret != KVS_SUCCESS) {
     fprintf(stderr, "Update key space state failed. error code:0x%x,\n", ret);
-    free(ks_handle);
+    g_key_spaces.close(ks_handle);
+    g_key_spaces.free(ks_handle);
     return ret;
   }
 
+  ks_handle->stats = kvs_stats_key_space_alloc(dev_hd->stats, name);
+
+  std::unique_lock<std::mutex> lock(dev_hd->ks_lock);
+  if (_key_space_opened_locked(dev_hd, name)) {
+    //lost a race with another open of the same key space
+    lock.unlock();
+    _kvs_stats_close(ks_handle);
+    g_key_spaces.close(ks_handle);
+    g_key_spaces.free(ks_handle);
+    return KVS_ERR_KS_OPEN;
+  }
   dev_hd->open_ks_hds.push_back(ks_handle);
-  g_env.list_open_ks.push_back(ks_handle);
   *ks_hd = ks_handle;
   return KVS_SUCCESS;
 }
@@ -1408,19 +1590,43 @@ kvs_result _close_key_space(kvs_key_space_handle ks_hd) {
 }
 
 kvs_result kvs_close_key_space(kvs_key_space_handle ks_hd) {
-  kvs_result ret = _check_key_space_handle(ks_hd);
-  if (ret != KVS_SUCCESS) return ret;
+  kvs_result ret;
+  kvs_device_handle dev_hd;
+  //pins the device so that a concurrent device close waits for us
+  device_ref dev_ref(g_devices);
+  {
+    key_space_ref ref(g_key_spaces);
+    ret = _check_key_space_handle(ks_hd, ref);
+    if (ret != KVS_SUCCESS) return ret;
+    dev_hd = ks_hd->dev;
+    if (!dev_ref.acquire(dev_hd)) return KVS_ERR_DEV_NOT_OPENED;
+
+    ret = _close_key_space(ks_hd);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Close key space failed. error code:0x%x-%s.\n", ret,
+          kvs_errstr(ret));
+      return ret;
+    }
+  }
 
-  ret = _close_key_space(ks_hd);
+  //wait for the calls and asynchronous I/O in flight on this key space,
+  //closing it from its own completion function would wait forever
+  if (!g_key_spaces.close(ks_hd)) return KVS_ERR_KS_NOT_OPEN;
+  ret = _kvs_writeback_close(ks_hd);
   if (ret != KVS_SUCCESS) {
-    fprintf(stderr, "Close key space failed. error code:0x%x-%s.\n", ret,
+    fprintf(stderr, "Write-back flush failed. error code:0x%x-%s.\n", ret,
         kvs_errstr(ret));
-    return ret;
   }
-  kvs_device_handle dev_hd = ks_hd->dev;
-  dev_hd->open_ks_hds.remove(ks_hd);
-  g_env.list_open_ks.remove(ks_hd);
-  free(ks_hd);
+  _kvs_codec_close(ks_hd);
+  _kvs_long_keys_close(ks_hd);
+  _kvs_hot_keys_close(ks_hd);
+  _kvs_read_ahead_close(ks_hd);
+  _kvs_stats_close(ks_hd);
+  {
+    std::unique_lock<std::mutex> lock(dev_hd->ks_lock);
+    dev_hd->open_ks_hds.remove(ks_hd);
+  }
+  g_key_spaces.free(ks_hd);
   return ret;
 }
 
@@ -1436,7 +1642,8 @@ kvs_result kvs_delete_key_group_async(kvs_key_space_handle ks_hd,
 }
 
 kvs_result kvs_get_kvp_info(kvs_key_space_handle ks_hd, kvs_key *key, kvs_kvp_info *info) {
-  kvs_result ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) return ret;
 
   if (key == NULL || info == NULL) return KVS_ERR_PARAM_INVALID;
@@ -1448,8 +1655,7 @@ kvs_result kvs_get_kvp_info(kvs_key_space_handle ks_hd, kvs_key *key, kvs_kvp_in
     return KVS_ERR_SYS_IO;
   }
 
-  kvs_option_retrieve option;
-  option.kvs_retrieve_delete = false;
+  kvs_option_retrieve option = { false };
   kvs_value kvsvalue = {value, vlen, 0, 0};
   ret = kvs_retrieve_kvp(ks_hd, key, &option, &kvsvalue);
   if (ret != KVS_SUCCESS)
@@ -1468,7 +1674,8 @@ kvs_result kvs_get_key_space_info(kvs_key_space_handle ks_hd, kvs_key_space *ks)
   if(ks == NULL) {
     return KVS_ERR_PARAM_INVALID;
   }
-  kvs_result ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) {
     return ret;
   }
@@ -1486,9 +1693,198 @@ kvs_result kvs_get_key_space_info(kvs_key_space_handle ks_hd, kvs_key_space *ks)
   return ret;
 }
 
-kvs_result kvs_store_kvp(kvs_key_space_handle ks_hd, kvs_key *key, 
+kvs_result kvs_set_writeback(kvs_key_space_handle ks_hd,
+  kvs_option_writeback *opt) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  if (opt && (opt->buffer_size == 0 || opt->batch_size == 0))
+    return KVS_ERR_PARAM_INVALID;
+  if (opt && ks_hd->codec) return KVS_ERR_OPTION_INVALID;
+
+  ret = _kvs_writeback_close(ks_hd);
+  if (opt) ks_hd->wb = new kvs_writeback(ks_hd, *opt);
+  return ret;
+}
+
+kvs_result kvs_flush_key_space(kvs_key_space_handle ks_hd) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  return ks_hd->wb ? ks_hd->wb->flush() : KVS_SUCCESS;
+}
+
+kvs_result kvs_get_writeback_stats(kvs_key_space_handle ks_hd,
+  kvs_writeback_stats *stats) {
+  if (stats == NULL) return KVS_ERR_PARAM_INVALID;
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  if (ks_hd->wb) ks_hd->wb->get_stats(stats);
+  else memset(stats, 0, sizeof(*stats));
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_set_checksum(kvs_key_space_handle ks_hd, bool enable) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  bool crc = dynamic_cast<kvs_crc_codec*>(ks_hd->codec) != NULL;
+  if (ks_hd->codec && !crc) return KVS_ERR_OPTION_INVALID;
+  if (enable && (ks_hd->wb || ks_hd->read_ahead)) return KVS_ERR_OPTION_INVALID;
+  if (enable && !crc) ks_hd->codec = new kvs_crc_codec();
+  if (!enable) _kvs_codec_close(ks_hd);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_set_encryption(kvs_key_space_handle ks_hd,
+  kvs_option_encryption *opt) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  if (opt && opt->key_len != 16 && opt->key_len != 32)
+    return KVS_ERR_PARAM_INVALID;
+  bool gcm = dynamic_cast<kvs_gcm_codec*>(ks_hd->codec) != NULL;
+  if (ks_hd->codec && !gcm) return KVS_ERR_OPTION_INVALID;
+  if (opt && (ks_hd->wb || ks_hd->read_ahead)) return KVS_ERR_OPTION_INVALID;
+  _kvs_codec_close(ks_hd);
+  if (opt) ks_hd->codec = new kvs_gcm_codec(opt->key, opt->key_len);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_set_long_keys(kvs_key_space_handle ks_hd, bool enable) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  if (enable && !ks_hd->long_keys) ks_hd->long_keys = new kvs_long_keys(ks_hd);
+  if (!enable) _kvs_long_keys_close(ks_hd);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_set_hot_keys(kvs_key_space_handle ks_hd, kvs_option_hot_keys *opt) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  if (opt && (opt->top_k == 0 || opt->top_k > 256 || opt->depth > 8))
+    return KVS_ERR_PARAM_INVALID;
+  _kvs_hot_keys_close(ks_hd);
+  if (opt) ks_hd->hot_keys = new kvs_hot_keys(*opt);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_get_hot_keys(kvs_key_space_handle ks_hd, kvs_hot_keys_order order,
+  kvs_hot_key *keys, uint32_t *count) {
+  if (keys == NULL || count == NULL) return KVS_ERR_PARAM_INVALID;
+  if (order != KVS_HOT_KEYS_READS && order != KVS_HOT_KEYS_WRITES &&
+      order != KVS_HOT_KEYS_BYTES)
+    return KVS_ERR_PARAM_INVALID;
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  *count = ks_hd->hot_keys ? ks_hd->hot_keys->get(order, keys, *count) : 0;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_set_read_ahead(kvs_key_space_handle ks_hd, kvs_option_read_ahead *opt) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  if (opt && (opt->streams > 64 || opt->depth > 64 || opt->min_accuracy > 100 ||
+              (opt->value_size & (KVS_VALUE_LENGTH_ALIGNMENT_UNIT - 1))))
+    return KVS_ERR_PARAM_INVALID;
+  //served values would skip the codec
+  if (opt && ks_hd->codec) return KVS_ERR_OPTION_INVALID;
+  _kvs_read_ahead_close(ks_hd);
+  if (opt) ks_hd->read_ahead = new kvs_read_ahead(ks_hd, *opt);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_get_read_ahead_stats(kvs_key_space_handle ks_hd,
+  kvs_read_ahead_stats *stats) {
+  if (stats == NULL) return KVS_ERR_PARAM_INVALID;
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+  if (ks_hd->read_ahead) ks_hd->read_ahead->get_stats(stats);
+  else memset(stats, 0, sizeof(*stats));
+  return KVS_SUCCESS;
+}
+
+static kvs_postprocess_context _request_context(kvs_context op,
+  kvs_key_space_handle ks_hd, kvs_key *key, kvs_value *value, void *private1,
+  void *private2) {
+  kvs_postprocess_context ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.context = op;
+  ctx.ks_hd = ks_hd;
+  ctx.key = key;
+  ctx.value = value;
+  ctx.private1 = private1;
+  ctx.private2 = private2;
+  return ctx;
+}
+
+//completes an asynchronous request that never went to the device
+static void _post_inline(kvs_context op, kvs_key_space_handle ks_hd,
+  kvs_key *key, kvs_value *value, void *private1, void *private2,
+  kvs_result result, kvs_postprocess_function post_fn) {
+  kvs_postprocess_context ctx = _request_context(op, ks_hd, key, value,
+    private1, private2);
+  ctx.result = result;
+  post_fn(&ctx);
+}
+
+//sends an asynchronous request once the buffered writes of its keys have
+//reached the device (see kvs_writeback::park); false if none of them is
+//buffered and the caller sends it now. A parked request that the driver
+//refuses completes with the error through ctx.
+static bool _park_async(kvs_key_space_handle ks_hd, const kvs_key *keys,
+  uint32_t key_cnt, const kvs_postprocess_context &ctx,
+  kvs_postprocess_function post_fn, const std::function<kvs_result()> &send,
+  key_space_ref &ref) {
+  bool parked = ks_hd->wb->park(keys, key_cnt, [ctx, post_fn, send]() {
+    kvs_postprocess_context c = ctx;
+    c.result = send();
+    if (c.result == KVS_SUCCESS) return;
+    post_fn(&c);
+    _kvs_key_space_io_done(c.ks_hd);
+  });
+  //the parked request owns the reference, as an I/O would
+  if (parked) ref.detach();
+  return parked;
+}
+
+//keys that do not fit the device go through the long key layer
+static bool _is_long_key(kvs_key_space_handle ks_hd, const kvs_key *key) {
+  return ks_hd->long_keys && key && kvs_long_key_io::is_long(key);
+}
+
+static kvs_result _store_kvp(kvs_key_space_handle ks_hd, kvs_key *key,
+  kvs_value *value, kvs_option_store *opt) {
+  kvs_read_ahead_write raw(ks_hd->read_ahead, key);
+  kvs_result wb_ret;
+  if (ks_hd->wb && ks_hd->wb->store(key, value, opt, NULL, NULL, NULL, &wb_ret))
+    return wb_ret;
+
+  int ret;
+  if (ks_hd->codec) {
+    if (opt->st_type == KVS_STORE_APPEND) return KVS_ERR_OPTION_INVALID;
+    kvs_chunk_io io(ks_hd->codec);
+    ret = io.prepare_store(key, value);
+    if (ret) return (kvs_result)ret;
+    return (kvs_result)ks_hd->dev->driver->store_tuple(ks_hd, key, io.stored(),
+      *opt, 0, 0, 1, 0);
+  }
+
+  ret = ks_hd->dev->driver->store_tuple(ks_hd, key, value,
+    *opt, 0, 0, 1, 0);
+  return (kvs_result)ret;
+}
+
+kvs_result kvs_store_kvp(kvs_key_space_handle ks_hd, kvs_key *key,
                       kvs_value *value, kvs_option_store *opt) {
-  int ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  int ret = _check_key_space_handle(ks_hd, ref);
   if (ret!=KVS_SUCCESS) {
     return (kvs_result)ret;
   }
@@ -1497,18 +1893,76 @@ kvs_result kvs_store_kvp(kvs_key_space_handle ks_hd, kvs_key *key,
     return KVS_ERR_PARAM_INVALID;
   }
 
+  if (_is_long_key(ks_hd, key)) {
+    if (opt->st_type == KVS_STORE_APPEND) return KVS_ERR_OPTION_INVALID;
+    ret = validate_request(NULL, value);
+    if (ret) return (kvs_result)ret;
+    kvs_long_key_io io;
+    ret = io.prepare_store(key, value);
+    if (ret) return (kvs_result)ret;
+    if (ks_hd->hot_keys) ks_hd->hot_keys->write(key, value->length);
+    return _store_kvp(ks_hd, io.key(), io.stored(), opt);
+  }
+
   ret = validate_request(key, value);
   if(ret)
     return (kvs_result)ret;
+  if (ks_hd->hot_keys) ks_hd->hot_keys->write(key, value->length);
+
+  return _store_kvp(ks_hd, key, value, opt);
+}
+
+static kvs_result _send_store_async(kvs_key_space_handle ks_hd, kvs_key *key,
+  kvs_value *value, kvs_option_store *opt, void *private1, void *private2,
+  kvs_postprocess_function post_fn) {
+  int ret;
+  if (ks_hd->codec) {
+    kvs_chunk_io *io = new kvs_chunk_io(ks_hd->codec);
+    ret = io->prepare_store(key, value);
+    if (ret == KVS_SUCCESS) {
+      io->set_callback(private1, private2, post_fn);
+      ret = ks_hd->dev->driver->store_tuple(ks_hd, key, io->stored(), *opt, io,
+        NULL, 0, kvs_chunk_io::on_done);
+    }
+    if (ret != KVS_SUCCESS) delete io;
+    return (kvs_result)ret;
+  }
 
   ret = ks_hd->dev->driver->store_tuple(ks_hd, key, value,
-    *opt, 0, 0, 1, 0);
+    *opt, private1, private2, 0, post_fn);
   return (kvs_result)ret;
 }
 
+static kvs_result _store_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key,
+  kvs_value *value, kvs_option_store *opt, void *private1, void *private2,
+  kvs_postprocess_function post_fn, key_space_ref &ref) {
+  if (ks_hd->codec && opt->st_type == KVS_STORE_APPEND) return KVS_ERR_OPTION_INVALID;
+  //and again by the completion, see kvs_read_ahead::completed
+  if (ks_hd->read_ahead) ks_hd->read_ahead->written(key);
+  if (ks_hd->wb) {
+    kvs_result wb_ret;
+    if (ks_hd->wb->store(key, value, opt, private1, private2, post_fn, &wb_ret))
+      return wb_ret;
+    //behind a buffered write of the key
+    kvs_option_store o = *opt;
+    if (_park_async(ks_hd, key, 1, _request_context(KVS_CMD_STORE, ks_hd, key,
+          value, private1, private2), post_fn, [=]() mutable {
+          return _send_store_async(ks_hd, key, value, &o, private1, private2, post_fn);
+        }, ref))
+      return KVS_SUCCESS;
+  }
+
+  kvs_result ret = _send_store_async(ks_hd, key, value, opt, private1, private2,
+    post_fn);
+  //the I/O now owns the reference, the driver drops it on completion
+  if (ret == KVS_SUCCESS) ref.detach();
+  return ret;
+}
+
 kvs_result kvs_store_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key, kvs_value *value,
         kvs_option_store *opt, void *private1, void *private2, kvs_postprocess_function post_fn) {
-  int ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  int ret = _check_key_space_handle(ks_hd, ref);
   if (ret!=KVS_SUCCESS) {
     return (kvs_result)ret;
   }
@@ -1516,112 +1970,296 @@ kvs_result kvs_store_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key, kvs_val
   if(key == NULL || value == NULL || opt == NULL || post_fn == NULL)
     return KVS_ERR_PARAM_INVALID;
 
+  if (_is_long_key(ks_hd, key)) {
+    if (opt->st_type == KVS_STORE_APPEND) return KVS_ERR_OPTION_INVALID;
+    ret = validate_request(NULL, value);
+    if (ret) return (kvs_result)ret;
+    kvs_long_key_io *io = new kvs_long_key_io();
+    ret = io->prepare_store(key, value);
+    if (ret == KVS_SUCCESS) {
+      if (ks_hd->hot_keys) ks_hd->hot_keys->write(key, value->length);
+      io->set_callback(private1, private2, post_fn);
+      ret = _store_kvp_async(ks_hd, io->key(), io->stored(), opt, io, NULL,
+        kvs_long_key_io::on_done, ref);
+    }
+    //on success the completion has the object, it may be gone already
+    if (ret != KVS_SUCCESS) delete io;
+    return (kvs_result)ret;
+  }
+
   ret = validate_request(key, value);
   if(ret)
     return (kvs_result)ret;
+  if (ks_hd->hot_keys) ks_hd->hot_keys->write(key, value->length);
 
-  ret = ks_hd->dev->driver->store_tuple(ks_hd, key, value,
-    *opt, private1, private2, 0, post_fn);
+  return _store_kvp_async(ks_hd, key, value, opt, private1, private2, post_fn, ref);
+}
+
+kvs_result _kvs_retrieve_kvp(kvs_key_space_handle ks_hd, kvs_key *key,
+  kvs_option_retrieve *opt, kvs_value *value) {
+  if (ks_hd->wb) {
+    kvs_result wb_ret;
+    if (opt->kvs_retrieve_delete) ks_hd->wb->flush_keys(key, 1);
+    else if (ks_hd->wb->retrieve(key, value, &wb_ret)) return wb_ret;
+  }
+  kvs_read_ahead_write raw(opt->kvs_retrieve_delete ? ks_hd->read_ahead : NULL, key);
+  if (ks_hd->read_ahead && !opt->kvs_retrieve_delete) {
+    kvs_result ra_ret;
+    bool queued;
+    if (ks_hd->read_ahead->retrieve(key, value, NULL, NULL, NULL, &queued, &ra_ret))
+      return ra_ret;
+  }
+
+  int ret;
+  if (ks_hd->codec) {
+    kvs_chunk_io io(ks_hd->codec);
+    ret = io.prepare_retrieve(key, value);
+    if (ret) return (kvs_result)ret;
+    ret = ks_hd->dev->driver->retrieve_tuple(ks_hd, key, io.stored(),
+      *opt, 0, 0, 1, 0);
+    return io.complete_retrieve((kvs_result)ret);
+  }
+
+  ret = ks_hd->dev->driver->retrieve_tuple(ks_hd, key, value,
+    *opt, 0, 0, 1, 0);
   return (kvs_result)ret;
 }
 
 kvs_result kvs_retrieve_kvp(kvs_key_space_handle ks_hd, kvs_key *key,
                         kvs_option_retrieve *opt, kvs_value *value) {
-  int ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  int ret = _check_key_space_handle(ks_hd, ref);
   if (ret!=KVS_SUCCESS) {
     return (kvs_result)ret;
   }
   if((key == NULL) || (value == NULL) || (opt == NULL)) {
     return KVS_ERR_PARAM_INVALID;
   }
-  ret = validate_request(key, value);
+  bool long_key = _is_long_key(ks_hd, key);
+  ret = validate_request(long_key ? NULL : key, value);
   if(ret)
     return (kvs_result)ret;
   if (value->length & (KVS_VALUE_LENGTH_ALIGNMENT_UNIT - 1))
       return KVS_ERR_PARAM_INVALID;
 
+  if (long_key) {
+    kvs_long_key_io io;
+    ret = io.prepare_retrieve(key, value);
+    if (ret == KVS_SUCCESS) {
+      ret = _kvs_retrieve_kvp(ks_hd, io.key(), opt, io.stored());
+      ret = io.complete_retrieve((kvs_result)ret);
+    }
+  } else {
+    ret = _kvs_retrieve_kvp(ks_hd, key, opt, value);
+  }
+  if (ks_hd->hot_keys)
+    ks_hd->hot_keys->read(key, ret == KVS_SUCCESS ? value->actual_value_size : 0);
+  return (kvs_result)ret;
+}
+
+static kvs_result _send_retrieve_async(kvs_key_space_handle ks_hd, kvs_key *key,
+  kvs_option_retrieve *opt, void *private1, void *private2, kvs_value *value,
+  kvs_postprocess_function post_fn) {
+  int ret;
+  if (ks_hd->codec) {
+    kvs_chunk_io *io = new kvs_chunk_io(ks_hd->codec);
+    ret = io->prepare_retrieve(key, value);
+    if (ret == KVS_SUCCESS) {
+      io->set_callback(private1, private2, post_fn);
+      ret = ks_hd->dev->driver->retrieve_tuple(ks_hd, key, io->stored(), *opt, io,
+        NULL, 0, kvs_chunk_io::on_done);
+    }
+    if (ret != KVS_SUCCESS) delete io;
+    return (kvs_result)ret;
+  }
+
   ret = ks_hd->dev->driver->retrieve_tuple(ks_hd, key, value,
-    *opt, 0, 0, 1, 0);
+    *opt, private1, private2, 0, post_fn);
   return (kvs_result)ret;
 }
 
-kvs_result kvs_retrieve_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key, 
-      kvs_option_retrieve *opt, void *private1, void *private2, kvs_value *value, 
+static kvs_result _retrieve_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key,
+  kvs_option_retrieve *opt, void *private1, void *private2, kvs_value *value,
+  kvs_postprocess_function post_fn, key_space_ref &ref) {
+  if (ks_hd->wb) {
+    kvs_result wb_ret;
+    if (opt->kvs_retrieve_delete) {
+      kvs_option_retrieve o = *opt;
+      if (_park_async(ks_hd, key, 1, _request_context(KVS_CMD_RETRIEVE, ks_hd, key,
+            value, private1, private2), post_fn, [=]() mutable {
+            if (ks_hd->read_ahead) ks_hd->read_ahead->written(key);
+            return _send_retrieve_async(ks_hd, key, &o, private1, private2, value,
+              post_fn);
+          }, ref))
+        return KVS_SUCCESS;
+    } else if (ks_hd->wb->retrieve(key, value, &wb_ret)) {
+      _post_inline(KVS_CMD_RETRIEVE, ks_hd, key, value, private1, private2,
+                   wb_ret, post_fn);
+      return KVS_SUCCESS;
+    }
+  }
+  if (ks_hd->read_ahead) {
+    kvs_result ra_ret;
+    bool queued = false;
+    if (opt->kvs_retrieve_delete) {
+      ks_hd->read_ahead->written(key);
+    } else if (ks_hd->read_ahead->retrieve(key, value, private1, private2, post_fn,
+                                           &queued, &ra_ret)) {
+      //a waiter of a speculative retrieve in flight, which drops the reference
+      if (queued) ref.detach();
+      return KVS_SUCCESS;
+    }
+  }
+
+  kvs_result ret = _send_retrieve_async(ks_hd, key, opt, private1, private2,
+    value, post_fn);
+  if (ret == KVS_SUCCESS) ref.detach();
+  return ret;
+}
+
+kvs_result kvs_retrieve_kvp_async(kvs_key_space_handle ks_hd, kvs_key *key,
+      kvs_option_retrieve *opt, void *private1, void *private2, kvs_value *value,
       kvs_postprocess_function post_fn) {
-  int ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  int ret = _check_key_space_handle(ks_hd, ref);
   if (ret!=KVS_SUCCESS) {
     return (kvs_result)ret;
   }
   if(key == NULL || value == NULL || opt == NULL || post_fn == NULL)
     return KVS_ERR_PARAM_INVALID;
-  ret = validate_request(key, value);
+  bool long_key = _is_long_key(ks_hd, key);
+  ret = validate_request(long_key ? NULL : key, value);
   if(ret)
     return (kvs_result)ret;
   if (value->length & (KVS_VALUE_LENGTH_ALIGNMENT_UNIT - 1))
       return KVS_ERR_PARAM_INVALID;
-
-  ret = ks_hd->dev->driver->retrieve_tuple(ks_hd, key, value,
-    *opt, private1, private2, 0, post_fn);
+  //the value size is not known before the completion
+  hot_key_read *hot = NULL;
+  if (ks_hd->hot_keys && ks_hd->hot_keys->sample()) {
+    hot = new hot_key_read { ks_hd->hot_keys, private1, private2, post_fn };
+    private1 = hot;
+    private2 = NULL;
+    post_fn = _hot_key_read_done;
+  }
+
+  if (long_key) {
+    kvs_long_key_io *io = new kvs_long_key_io();
+    ret = io->prepare_retrieve(key, value);
+    if (ret == KVS_SUCCESS) {
+      io->set_callback(private1, private2, post_fn);
+      ret = _retrieve_kvp_async(ks_hd, io->key(), opt, io, NULL, io->stored(),
+        kvs_long_key_io::on_done, ref);
+    }
+    if (ret != KVS_SUCCESS) delete io;
+  } else {
+    ret = _retrieve_kvp_async(ks_hd, key, opt, private1, private2, value, post_fn, ref);
+  }
+  if (ret != KVS_SUCCESS) delete hot;
   return (kvs_result)ret;
 }
 
-kvs_result kvs_exist_kv_pairs(kvs_key_space_handle ks_hd, uint32_t key_cnt, kvs_key *keys, kvs_exist_list *list) {
-  int ret = KVS_SUCCESS;
-  if (keys == NULL || list == NULL || (key_cnt <= 0) || (list->result_buffer == NULL))
-    return KVS_ERR_PARAM_INVALID;
+//checks the keys of an existence check, long keys are replaced by their
+//digest keys in io
+static kvs_result _prepare_exist_keys(kvs_key_space_handle ks_hd, uint32_t key_cnt,
+  kvs_key **keys, kvs_long_key_io *io) {
+  bool long_keys = false;
   for (unsigned int i = 0; i != key_cnt; ++i) {
-    ret = validate_kv_pair_(keys + i, 0, 0);
+    if (_is_long_key(ks_hd, *keys + i)) {
+      long_keys = true;
+      continue;
+    }
+    int ret = validate_kv_pair_(*keys + i, 0, 0);
     if (ret != KVS_SUCCESS) {
       return (kvs_result)ret;
     }
   }
+  if (!long_keys) return KVS_SUCCESS;
+  kvs_result ret = io->prepare_keys(*keys, key_cnt);
+  if (ret == KVS_SUCCESS) *keys = io->keys();
+  return ret;
+}
+
+kvs_result kvs_exist_kv_pairs(kvs_key_space_handle ks_hd, uint32_t key_cnt, kvs_key *keys, kvs_exist_list *list) {
+  int ret = KVS_SUCCESS;
+  if (keys == NULL || list == NULL || (key_cnt <= 0) || (list->result_buffer == NULL))
+    return KVS_ERR_PARAM_INVALID;
   list->keys = keys;
   list->num_keys = key_cnt;
-  
-  ret = _check_key_space_handle(ks_hd);
+
+  key_space_ref ref(g_key_spaces);
+  ret = _check_key_space_handle(ks_hd, ref);
   if (ret!=KVS_SUCCESS) {
     return (kvs_result)ret;
   }
+  kvs_long_key_io io;
+  ret = _prepare_exist_keys(ks_hd, key_cnt, &keys, &io);
+  if (ret != KVS_SUCCESS)
+    return (kvs_result)ret;
   if(list->length <= 0)
       return KVS_ERR_BUFFER_SMALL;
-  
+
+  if (ks_hd->wb) ks_hd->wb->flush_keys(keys, key_cnt);
   ret = ks_hd->dev->driver->exist_tuple(ks_hd, key_cnt, keys,
-    list, NULL, NULL, 1, 0); 
+    list, NULL, NULL, 1, 0);
   return (kvs_result)ret;
 }
 
-kvs_result kvs_exist_kv_pairs_async(kvs_key_space_handle ks_hd, uint32_t key_cnt, 
-      kvs_key *keys, kvs_exist_list *list, void *private1, void *private2, 
+kvs_result kvs_exist_kv_pairs_async(kvs_key_space_handle ks_hd, uint32_t key_cnt,
+      kvs_key *keys, kvs_exist_list *list, void *private1, void *private2,
       kvs_postprocess_function post_fn) {
-  int ret = KVS_SUCCESS;    
+  int ret = KVS_SUCCESS;
   if (keys == NULL || list == NULL || post_fn == NULL || list->result_buffer == NULL || (key_cnt <= 0))
     return KVS_ERR_PARAM_INVALID;
 
-  for (unsigned int i = 0; i != key_cnt; ++i) {
-    ret = validate_kv_pair_(keys + i, 0, 0);
-    if (ret != KVS_SUCCESS) {
-      return (kvs_result)ret;
-    }
-  }
   list->keys = keys;
   list->num_keys = key_cnt;
-  
-  ret = _check_key_space_handle(ks_hd);
+
+  key_space_ref ref(g_key_spaces);
+  ret = _check_key_space_handle(ks_hd, ref);
   if (ret!=KVS_SUCCESS) {
     return (kvs_result)ret;
   }
-  if(list->length  <= 0)
-    return KVS_ERR_BUFFER_SMALL;
-  
+  kvs_long_key_io *io = new kvs_long_key_io();
+  ret = _prepare_exist_keys(ks_hd, key_cnt, &keys, io);
+  if (ret == KVS_SUCCESS && list->length <= 0)
+    ret = KVS_ERR_BUFFER_SMALL;
+  if (ret != KVS_SUCCESS) {
+    delete io;
+    return (kvs_result)ret;
+  }
+  //the digest keys have to live until the command completes
+  if (keys == io->keys()) {
+    io->set_callback(private1, private2, post_fn);
+    private1 = io;
+    private2 = NULL;
+    post_fn = kvs_long_key_io::on_done;
+  } else {
+    delete io;
+    io = NULL;
+  }
+
+  if (ks_hd->wb) {
+    kvs_postprocess_context ctx = _request_context(KVS_CMD_EXIST, ks_hd, keys,
+      NULL, private1, private2);
+    ctx.result_buffer.list = list;
+    if (_park_async(ks_hd, keys, key_cnt, ctx, post_fn, [=]() {
+          return (kvs_result)ks_hd->dev->driver->exist_tuple(ks_hd, key_cnt, keys,
+            list, private1, private2, 0, post_fn);
+        }, ref))
+      return KVS_SUCCESS;
+  }
   ret = ks_hd->dev->driver->exist_tuple(ks_hd, key_cnt, keys,
     list, private1, private2, 0, post_fn);
+  if (ret == KVS_SUCCESS) ref.detach();
+  else delete io;
 
   return (kvs_result)ret;
 }
 
 kvs_result kvs_create_iterator(kvs_key_space_handle ks_hd, kvs_option_iterator *iter_op,
                       kvs_key_group_filter *iter_fltr, kvs_iterator_handle *iter_hd) {
-  int ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  int ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) {
     return (kvs_result)ret;
   }
@@ -1633,67 +2271,278 @@ kvs_result kvs_create_iterator(kvs_key_space_handle ks_hd, kvs_option_iterator *
   filter2context(iter_fltr, &bitmask, &bit_pattern);
   if(!_is_valid_bitmask(bitmask))
     return KVS_ERR_ITERATOR_FILTER_INVALID;
+  //values of long keys have to be parsed, stored values of a codec cannot be
+  if (ks_hd->long_keys && ks_hd->codec && iter_op->iter_type == KVS_ITERATOR_KEY_VALUE)
+    return KVS_ERR_OPTION_INVALID;
 
+  if (ks_hd->wb) ks_hd->wb->drain();
   ret = ks_hd->dev->driver->create_iterator(ks_hd, *iter_op,
     bitmask, bit_pattern, iter_hd);
+  if (ret == KVS_SUCCESS && ks_hd->long_keys)
+    ks_hd->long_keys->open_iterator(*iter_hd, iter_op->iter_type);
   return (kvs_result)ret;
 }
 
 kvs_result kvs_delete_iterator(kvs_key_space_handle ks_hd, kvs_iterator_handle iter_hd) {
-  int ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  int ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) {
     return (kvs_result)ret;
   }
 
   ret =  ks_hd->dev->driver->delete_iterator(ks_hd, iter_hd);
+  if (ks_hd->long_keys) ks_hd->long_keys->close_iterator(iter_hd);
   return (kvs_result)ret;
 }
 
 kvs_result kvs_delete_kvp(kvs_key_space_handle ks_hd, kvs_key *key, kvs_option_delete *opt) {
-  kvs_result ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) {
     return ret;
   }
-  
+
   if(key == NULL || opt == NULL)
     return KVS_ERR_PARAM_INVALID;
 
-  ret = (kvs_result)validate_request(key, 0);
+  kvs_long_key_io io;
+  bool long_key = _is_long_key(ks_hd, key);
+  if (long_key) {
+    ret = io.prepare_key(key);
+  } else {
+    ret = (kvs_result)validate_request(key, 0);
+  }
   if(ret != KVS_SUCCESS)
     return ret;
+  if (ks_hd->hot_keys) ks_hd->hot_keys->write(key, 0);
+  if (long_key) key = io.key();
 
-  ret = (kvs_result)ks_hd->dev->driver->delete_tuple(ks_hd, key, 
+  if (ks_hd->wb) ks_hd->wb->flush_keys(key, 1);
+  kvs_read_ahead_write raw(ks_hd->read_ahead, key);
+  ret = (kvs_result)ks_hd->dev->driver->delete_tuple(ks_hd, key,
     *opt, NULL, NULL, 1, 0);
   return ret;
 }
 
-kvs_result kvs_delete_kvp_async(kvs_key_space_handle ks_hd, kvs_key* key, 
-      kvs_option_delete *opt, void *private1, void *private2, 
+kvs_result kvs_delete_kvp_async(kvs_key_space_handle ks_hd, kvs_key* key,
+      kvs_option_delete *opt, void *private1, void *private2,
       kvs_postprocess_function post_fn) {
 
-  kvs_result ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) {
     return ret;
   }
   if((key == NULL) || (opt == NULL) || (post_fn == NULL))
     return KVS_ERR_PARAM_INVALID;
 
-  ret = (kvs_result)validate_request(key, 0);
-  if(ret != KVS_SUCCESS) 
+  kvs_long_key_io *io = NULL;
+  if (_is_long_key(ks_hd, key)) {
+    io = new kvs_long_key_io();
+    ret = io->prepare_key(key);
+  } else {
+    ret = (kvs_result)validate_request(key, 0);
+  }
+  if(ret != KVS_SUCCESS) {
+    delete io;
     return ret;
-  
+  }
+  if (ks_hd->hot_keys) ks_hd->hot_keys->write(key, 0);
+  if (io) {
+    io->set_callback(private1, private2, post_fn);
+    key = io->key();
+    private1 = io;
+    private2 = NULL;
+    post_fn = kvs_long_key_io::on_done;
+  }
+
+  if (ks_hd->wb) {
+    kvs_option_delete o = *opt;
+    if (_park_async(ks_hd, key, 1, _request_context(KVS_CMD_DELETE, ks_hd, key,
+          NULL, private1, private2), post_fn, [=]() {
+          if (ks_hd->read_ahead) ks_hd->read_ahead->written(key);
+          return (kvs_result)ks_hd->dev->driver->delete_tuple(ks_hd, key, o,
+            private1, private2, 0, post_fn);
+        }, ref))
+      return KVS_SUCCESS;
+  }
+  if (ks_hd->read_ahead) ks_hd->read_ahead->written(key);
   ret = (kvs_result)ks_hd->dev->driver->delete_tuple(ks_hd, key,
     *opt, private1, private2, 0, post_fn);
+  if (ret == KVS_SUCCESS) ref.detach();
+  else delete io;
+  return ret;
+}
+
+kvs_result kvs_cancel_io(kvs_key_space_handle ks_hd, void *private1,
+  uint32_t *canceled) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) return ret;
+
+  uint32_t cnt = 0;
+  ret = (kvs_result)ks_hd->dev->driver->cancel_io(ks_hd, private1, &cnt);
+  if (canceled) *canceled = cnt;
+  return ret;
+}
+
+static kvs_result _validate_batch(kvs_key_space_handle ks_hd, kvs_batch_op *ops,
+  uint32_t op_cnt, bool *long_keys) {
+  *long_keys = false;
+  if (ops == NULL || op_cnt == 0 || op_cnt > KVS_MAX_BATCH_OPS)
+    return KVS_ERR_PARAM_INVALID;
+  for (uint32_t i = 0; i < op_cnt; i++) {
+    if (ops[i].key == NULL)
+      return KVS_ERR_PARAM_INVALID;
+    if (ops[i].type == KVS_BATCH_STORE) {
+      if (ops[i].value == NULL)
+        return KVS_ERR_PARAM_INVALID;
+    } else if (ops[i].type != KVS_BATCH_DELETE) {
+      return KVS_ERR_PARAM_INVALID;
+    }
+    kvs_value *value = (ops[i].type == KVS_BATCH_STORE) ? ops[i].value : 0;
+    kvs_key *key = ops[i].key;
+    if (_is_long_key(ks_hd, key)) {
+      //the long key layer checks the key
+      *long_keys = true;
+      key = 0;
+    }
+    int ret = validate_request(key, value);
+    if (ret != KVS_SUCCESS)
+      return (kvs_result)ret;
+  }
+  return KVS_SUCCESS;
+}
+
+static void _record_batch(kvs_hot_keys *hot_keys, kvs_batch_op *ops,
+  uint32_t op_cnt) {
+  for (uint32_t i = 0; i < op_cnt; i++)
+    hot_keys->write(ops[i].key,
+      ops[i].type == KVS_BATCH_STORE ? ops[i].value->length : 0);
+}
+
+//buffered writes to the batch's keys have to reach the device first, or
+//they would land on top of the batch later
+static std::vector<kvs_key> _batch_keys(kvs_batch_op *ops, uint32_t op_cnt) {
+  std::vector<kvs_key> keys(op_cnt);
+  for (uint32_t i = 0; i < op_cnt; i++) keys[i] = *ops[i].key;
+  return keys;
+}
+
+static kvs_result _write_batch(kvs_key_space_handle ks_hd, kvs_batch_op *ops,
+  uint32_t op_cnt) {
+  kvs_result ret;
+  if (ks_hd->wb) ks_hd->wb->flush_keys(_batch_keys(ops, op_cnt).data(), op_cnt);
+  kvs_read_ahead_write raw(ks_hd->read_ahead, NULL);
+  if (ks_hd->codec) {
+    kvs_chunk_io io(ks_hd->codec);
+    ret = io.prepare_batch(ops, op_cnt);
+    if (ret != KVS_SUCCESS) return ret;
+    return (kvs_result)ks_hd->dev->driver->write_batch(ks_hd, io.ops(), op_cnt,
+      NULL, NULL, 1, 0);
+  }
+  ret = (kvs_result)ks_hd->dev->driver->write_batch(ks_hd, ops, op_cnt,
+    NULL, NULL, 1, 0);
+  return ret;
+}
+
+kvs_result kvs_write_batch(kvs_key_space_handle ks_hd, kvs_batch_op *ops,
+  uint32_t op_cnt) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) {
+    return ret;
+  }
+
+  bool long_keys;
+  ret = _validate_batch(ks_hd, ops, op_cnt, &long_keys);
+  if (ret != KVS_SUCCESS)
+    return ret;
+  if (ks_hd->hot_keys) _record_batch(ks_hd->hot_keys, ops, op_cnt);
+
+  if (long_keys) {
+    kvs_long_key_io io;
+    ret = io.prepare_batch(ops, op_cnt);
+    if (ret != KVS_SUCCESS) return ret;
+    return _write_batch(ks_hd, io.ops(), op_cnt);
+  }
+  return _write_batch(ks_hd, ops, op_cnt);
+}
+
+static kvs_result _send_batch_async(kvs_key_space_handle ks_hd, kvs_batch_op *ops,
+  uint32_t op_cnt, void *private1, void *private2,
+  kvs_postprocess_function post_fn) {
+  kvs_result ret;
+  if (ks_hd->read_ahead) ks_hd->read_ahead->written(NULL);
+  if (ks_hd->codec) {
+    kvs_chunk_io *io = new kvs_chunk_io(ks_hd->codec);
+    ret = io->prepare_batch(ops, op_cnt);
+    if (ret == KVS_SUCCESS) {
+      io->set_callback(private1, private2, post_fn);
+      ret = (kvs_result)ks_hd->dev->driver->write_batch(ks_hd, io->ops(), op_cnt,
+        io, NULL, 0, kvs_chunk_io::on_done);
+    }
+    if (ret != KVS_SUCCESS) delete io;
+    return ret;
+  }
+  return (kvs_result)ks_hd->dev->driver->write_batch(ks_hd, ops, op_cnt,
+    private1, private2, 0, post_fn);
+}
+
+static kvs_result _write_batch_async(kvs_key_space_handle ks_hd, kvs_batch_op *ops,
+  uint32_t op_cnt, void *private1, void *private2,
+  kvs_postprocess_function post_fn, key_space_ref &ref) {
+  if (ks_hd->wb &&
+      _park_async(ks_hd, _batch_keys(ops, op_cnt).data(), op_cnt,
+        _request_context(KVS_CMD_WRITE_BATCH, ks_hd, NULL, NULL, private1, private2),
+        post_fn, [=]() {
+          return _send_batch_async(ks_hd, ops, op_cnt, private1, private2, post_fn);
+        }, ref))
+    return KVS_SUCCESS;
+  kvs_result ret = _send_batch_async(ks_hd, ops, op_cnt, private1, private2, post_fn);
+  if (ret == KVS_SUCCESS) ref.detach();
   return ret;
 }
 
-kvs_result kvs_iterate_next(kvs_key_space_handle ks_hd, kvs_iterator_handle iter_hd, 
+kvs_result kvs_write_batch_async(kvs_key_space_handle ks_hd, kvs_batch_op *ops,
+  uint32_t op_cnt, void *private1, void *private2,
+  kvs_postprocess_function post_fn) {
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
+  if (ret != KVS_SUCCESS) {
+    return ret;
+  }
+  if (post_fn == NULL)
+    return KVS_ERR_PARAM_INVALID;
+
+  bool long_keys;
+  ret = _validate_batch(ks_hd, ops, op_cnt, &long_keys);
+  if (ret != KVS_SUCCESS)
+    return ret;
+  if (ks_hd->hot_keys) _record_batch(ks_hd->hot_keys, ops, op_cnt);
+
+  if (long_keys) {
+    kvs_long_key_io *io = new kvs_long_key_io();
+    ret = io->prepare_batch(ops, op_cnt);
+    if (ret == KVS_SUCCESS) {
+      io->set_callback(private1, private2, post_fn);
+      ret = _write_batch_async(ks_hd, io->ops(), op_cnt, io, NULL,
+        kvs_long_key_io::on_done, ref);
+    }
+    if (ret != KVS_SUCCESS) delete io;
+    return ret;
+  }
+  return _write_batch_async(ks_hd, ops, op_cnt, private1, private2, post_fn, ref);
+}
+
+kvs_result kvs_iterate_next(kvs_key_space_handle ks_hd, kvs_iterator_handle iter_hd,
     kvs_iterator_list *iter_list) {
 
   if(iter_list == NULL || iter_list->it_list == NULL)
     return KVS_ERR_PARAM_INVALID;
 
-  kvs_result ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) {
     return ret;
   }
@@ -1702,17 +2551,21 @@ kvs_result kvs_iterate_next(kvs_key_space_handle ks_hd, kvs_iterator_handle iter
     return KVS_ERR_SYS_IO;
   }
 
+  if (ks_hd->long_keys)
+    return ks_hd->long_keys->iterate_next(iter_hd, iter_list);
+
   ret = (kvs_result)ks_hd->dev->driver->iterator_next(ks_hd, iter_hd, iter_list, NULL, NULL, 1, 0);
   return ret;
 }
 
-kvs_result kvs_iterate_next_async(kvs_key_space_handle ks_hd, kvs_iterator_handle iter_hd , 
+kvs_result kvs_iterate_next_async(kvs_key_space_handle ks_hd, kvs_iterator_handle iter_hd ,
     kvs_iterator_list *iter_list, void *private1, void *private2, kvs_postprocess_function post_fn) {
   if (iter_list == NULL || iter_list->it_list == NULL || post_fn == NULL){
     return KVS_ERR_PARAM_INVALID;
   }
 
-  kvs_result ret = _check_key_space_handle(ks_hd);
+  key_space_ref ref(g_key_spaces);
+  kvs_result ret = _check_key_space_handle(ks_hd, ref);
   if (ret != KVS_SUCCESS) {
     return ret;
   }
@@ -1721,11 +2574,197 @@ kvs_result kvs_iterate_next_async(kvs_key_space_handle ks_hd, kvs_iterator_handl
     return KVS_ERR_SYS_IO;
   }
 
-  ret = (kvs_result)ks_hd->dev->driver->iterator_next(ks_hd, iter_hd, iter_list, private1, 
+  //original keys are looked up with further reads, the list is completed
+  //before returning
+  if (ks_hd->long_keys) {
+    kvs_postprocess_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.context = KVS_CMD_ITER_NEXT;
+    ctx.ks_hd = ks_hd;
+    ctx.private1 = private1;
+    ctx.private2 = private2;
+    ctx.iter_hd = iter_hd;
+    ctx.result_buffer.iter_list = iter_list;
+    ctx.result = ks_hd->long_keys->iterate_next(iter_hd, iter_list);
+    post_fn(&ctx);
+    return KVS_SUCCESS;
+  }
+
+  ret = (kvs_result)ks_hd->dev->driver->iterator_next(ks_hd, iter_hd, iter_list, private1,
     private2, 0, post_fn);
+  if (ret == KVS_SUCCESS) ref.detach();
   return ret;
 }
 
+kvs_result kvs_open_replica_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt,
+  kvs_option_replica *opt, kvs_replica_set_handle *rs_hd) {
+  if (ks_hds == NULL || opt == NULL || rs_hd == NULL)
+    return KVS_ERR_PARAM_INVALID;
+  if (ks_cnt == 0 || ks_cnt > KVS_MAX_REPLICAS || opt->write_quorum > ks_cnt)
+    return KVS_ERR_PARAM_INVALID;
+  if (opt->hedge_reads &&
+      (opt->hedge_percentile <= 0 || opt->hedge_percentile >= 100))
+    return KVS_ERR_PARAM_INVALID;
+  for (uint8_t i = 0; i < ks_cnt; i++) {
+    key_space_ref ref(g_key_spaces);
+    kvs_result ret = _check_key_space_handle(ks_hds[i], ref);
+    if (ret != KVS_SUCCESS) return ret;
+  }
+
+  kvs_replica_set_handle user_rs = g_replica_sets.alloc();
+  if (user_rs == NULL) {
+    WRITE_ERR("Too many open replica sets\n");
+    return KVS_ERR_SYS_IO;
+  }
+  user_rs->rs = new kvs_replica_set(ks_hds, ks_cnt, *opt);
+  *rs_hd = user_rs;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_close_replica_set(kvs_replica_set_handle rs_hd) {
+  //only one caller gets past close, after the other users have left
+  if (rs_hd == NULL || !g_replica_sets.close(rs_hd))
+    return KVS_ERR_PARAM_INVALID;
+  delete rs_hd->rs;
+  g_replica_sets.free(rs_hd);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_replica_store_kvp(kvs_replica_set_handle rs_hd, kvs_key *key,
+  kvs_value *value, kvs_option_store *opt) {
+  replica_set_ref ref(g_replica_sets);
+  if (rs_hd == NULL || !ref.acquire(rs_hd)) return KVS_ERR_PARAM_INVALID;
+  if (key == NULL || value == NULL || opt == NULL) return KVS_ERR_PARAM_INVALID;
+  int ret = validate_request(key, value);
+  if (ret) return (kvs_result)ret;
+  return rs_hd->rs->store(key, value, opt);
+}
+
+kvs_result kvs_replica_retrieve_kvp(kvs_replica_set_handle rs_hd, kvs_key *key,
+  kvs_option_retrieve *opt, kvs_value *value) {
+  replica_set_ref ref(g_replica_sets);
+  if (rs_hd == NULL || !ref.acquire(rs_hd)) return KVS_ERR_PARAM_INVALID;
+  if (key == NULL || value == NULL || opt == NULL) return KVS_ERR_PARAM_INVALID;
+  if (opt->kvs_retrieve_delete) return KVS_ERR_OPTION_INVALID;
+  int ret = validate_request(key, value);
+  if (ret) return (kvs_result)ret;
+  if (value->length & (KVS_VALUE_LENGTH_ALIGNMENT_UNIT - 1))
+    return KVS_ERR_PARAM_INVALID;
+  return rs_hd->rs->retrieve(key, value);
+}
+
+kvs_result kvs_replica_delete_kvp(kvs_replica_set_handle rs_hd, kvs_key *key,
+  kvs_option_delete *opt) {
+  replica_set_ref ref(g_replica_sets);
+  if (rs_hd == NULL || !ref.acquire(rs_hd)) return KVS_ERR_PARAM_INVALID;
+  if (key == NULL || opt == NULL) return KVS_ERR_PARAM_INVALID;
+  int ret = validate_request(key, 0);
+  if (ret) return (kvs_result)ret;
+  return rs_hd->rs->remove(key, opt);
+}
+
+kvs_result kvs_get_replica_stats(kvs_replica_set_handle rs_hd,
+  kvs_replica_stats *stats) {
+  replica_set_ref ref(g_replica_sets);
+  if (rs_hd == NULL || !ref.acquire(rs_hd) || stats == NULL)
+    return KVS_ERR_PARAM_INVALID;
+  rs_hd->rs->get_stats(stats);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_open_ec_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt,
+  kvs_option_ec *opt, kvs_ec_set_handle *ec_hd) {
+  if (ks_hds == NULL || opt == NULL || ec_hd == NULL)
+    return KVS_ERR_PARAM_INVALID;
+  if (opt->data_fragments == 0 || opt->parity_fragments == 0 ||
+      ks_cnt < opt->data_fragments + opt->parity_fragments ||
+      ks_cnt > KVS_MAX_EC_FRAGMENTS)
+    return KVS_ERR_PARAM_INVALID;
+  for (uint8_t i = 0; i < ks_cnt; i++) {
+    key_space_ref ref(g_key_spaces);
+    kvs_result ret = _check_key_space_handle(ks_hds[i], ref);
+    if (ret != KVS_SUCCESS) return ret;
+  }
+
+  kvs_ec_set_handle user_ec = g_ec_sets.alloc();
+  if (user_ec == NULL) {
+    WRITE_ERR("Too many open erasure coded sets\n");
+    return KVS_ERR_SYS_IO;
+  }
+  user_ec->ec = new kvs_ec_set(ks_hds, ks_cnt, *opt);
+  *ec_hd = user_ec;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_close_ec_set(kvs_ec_set_handle ec_hd) {
+  if (ec_hd == NULL || !g_ec_sets.close(ec_hd))
+    return KVS_ERR_PARAM_INVALID;
+  delete ec_hd->ec;
+  g_ec_sets.free(ec_hd);
+  return KVS_SUCCESS;
+}
+
+//fragment keys carry one more byte than the key
+static int32_t _validate_ec_key(const kvs_key *key) {
+  if (key->length > KVS_MAX_KEY_LENGTH - 1) return KVS_ERR_KEY_LENGTH_INVALID;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_ec_store_kvp(kvs_ec_set_handle ec_hd, kvs_key *key,
+  kvs_value *value, kvs_option_store *opt) {
+  ec_set_ref ref(g_ec_sets);
+  if (ec_hd == NULL || !ref.acquire(ec_hd)) return KVS_ERR_PARAM_INVALID;
+  if (key == NULL || value == NULL || opt == NULL) return KVS_ERR_PARAM_INVALID;
+  if (opt->st_type != KVS_STORE_POST) return KVS_ERR_OPTION_INVALID;
+  int ret = validate_request(key, value);
+  if (ret == KVS_SUCCESS) ret = _validate_ec_key(key);
+  if (ret) return (kvs_result)ret;
+  return ec_hd->ec->store(key, value, opt);
+}
+
+kvs_result kvs_ec_retrieve_kvp(kvs_ec_set_handle ec_hd, kvs_key *key,
+  kvs_option_retrieve *opt, kvs_value *value) {
+  ec_set_ref ref(g_ec_sets);
+  if (ec_hd == NULL || !ref.acquire(ec_hd)) return KVS_ERR_PARAM_INVALID;
+  if (key == NULL || value == NULL || opt == NULL) return KVS_ERR_PARAM_INVALID;
+  if (opt->kvs_retrieve_delete) return KVS_ERR_OPTION_INVALID;
+  if (value->offset != 0) return KVS_ERR_VALUE_OFFSET_INVALID;
+  int ret = validate_request(key, value);
+  if (ret == KVS_SUCCESS) ret = _validate_ec_key(key);
+  if (ret) return (kvs_result)ret;
+  if (value->length & (KVS_VALUE_LENGTH_ALIGNMENT_UNIT - 1))
+    return KVS_ERR_PARAM_INVALID;
+  return ec_hd->ec->retrieve(key, value);
+}
+
+kvs_result kvs_ec_delete_kvp(kvs_ec_set_handle ec_hd, kvs_key *key,
+  kvs_option_delete *opt) {
+  ec_set_ref ref(g_ec_sets);
+  if (ec_hd == NULL || !ref.acquire(ec_hd)) return KVS_ERR_PARAM_INVALID;
+  if (key == NULL || opt == NULL) return KVS_ERR_PARAM_INVALID;
+  int ret = validate_request(key, 0);
+  if (ret == KVS_SUCCESS) ret = _validate_ec_key(key);
+  if (ret) return (kvs_result)ret;
+  return ec_hd->ec->remove(key, opt);
+}
+
+kvs_result kvs_ec_set_failed(kvs_ec_set_handle ec_hd, uint8_t ks_idx,
+  bool failed) {
+  ec_set_ref ref(g_ec_sets);
+  if (ec_hd == NULL || !ref.acquire(ec_hd)) return KVS_ERR_PARAM_INVALID;
+  if (ks_idx >= ec_hd->ec->size()) return KVS_ERR_PARAM_INVALID;
+  ec_hd->ec->set_failed(ks_idx, failed);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_get_ec_stats(kvs_ec_set_handle ec_hd, kvs_ec_stats *stats) {
+  ec_set_ref ref(g_ec_sets);
+  if (ec_hd == NULL || !ref.acquire(ec_hd) || stats == NULL)
+    return KVS_ERR_PARAM_INVALID;
+  ec_hd->ec->get_stats(stats);
+  return KVS_SUCCESS;
+}
+
 
 void *_kvs_zalloc(size_t size_bytes, size_t alignment, const char *file) {
   WRITE_LOG("kvs_zalloc size: %ld, align: %ld, from %s\n", size_bytes, alignment, file);
@@ -36,6 +36,7 @@
 #include <fstream>
 #include "kvs_utils.h"
 #include "kvemul.hpp"
+#include "kvs_stats.h"
 
 #include <algorithm>
 #include <atomic>
@@ -45,13 +46,20 @@
 
 #define MAX_POOLSIZE 10240
 #define use_pool
-inline void malloc_context(KvEmulator::kv_emul_context **ctx,
+//waits for a free context, but not past deadline if one is given
+inline bool malloc_context(KvEmulator::kv_emul_context **ctx,
                            std::condition_variable* ctx_pool_notfull,
-                           std::queue<KvEmulator::kv_emul_context *> &pool, std::mutex& pool_lock) {
+                           std::queue<KvEmulator::kv_emul_context *> &pool, std::mutex& pool_lock,
+                           const std::chrono::steady_clock::time_point *deadline = NULL) {
 #if defined use_pool
   std::unique_lock<std::mutex> lock(pool_lock);
   while (pool.empty()) {
-    ctx_pool_notfull->wait(lock);
+    if (deadline == NULL) {
+      ctx_pool_notfull->wait(lock);
+    } else if (ctx_pool_notfull->wait_until(lock, *deadline) == std::cv_status::timeout
+               && pool.empty()) {
+      return false;
+    }
   }
   *ctx = pool.front();
   pool.pop();
@@ -59,6 +67,7 @@ inline void malloc_context(KvEmulator::kv_emul_context **ctx,
 #else
   *ctx = (kv_emul_context *)calloc(1, sizeof(kv_emul_context));
 #endif
+  return true;
 }
 
 inline void free_context(KvEmulator::kv_emul_context *ctx,
@@ -141,15 +150,24 @@ std::map<kv_result, kvs_result> code_map = {
   {KV_ERR_DD_UNSUPPORTED_CMD, KVS_ERR_SYS_IO},
   {KV_ERR_ITERATE_REQUEST_FAIL, KVS_ERR_SYS_IO},
   {KV_ERR_DD_UNSUPPORTED, KVS_ERR_SYS_IO},
-  {KV_ERR_KEYSPACE_INVALID, KVS_ERR_SYS_IO}
+  {KV_ERR_KEYSPACE_INVALID, KVS_ERR_SYS_IO},
+  {KV_ERR_ITERATOR_IN_PROGRESS, KVS_ERR_ITERATOR_OPEN},
+  {KV_ERR_DEADLINE_EXCEEDED, KVS_ERR_DEADLINE_EXCEEDED},
+  {KV_ERR_CANCELED, KVS_ERR_CANCELED}
 };
 
 void on_io_complete(kv_io_context *context) {
 
+  //a failed write batch left nothing behind, its caller gets the result.
+  //reads of part of a value at an offset end with a small buffer, and
+  //requests dropped at their deadline or canceled were asked for
   if ((context->retcode != KV_SUCCESS)
       && (context->retcode != KV_ERR_KEY_NOT_EXIST)
+      && context->retcode != KV_ERR_DEADLINE_EXCEEDED
+      && context->retcode != KV_ERR_CANCELED
       && context->retcode !=
-      KV_WRN_MORE) {
+      KV_WRN_MORE && context->opcode != KV_OPC_WRITE_BATCH
+      && !(context->opcode == KV_OPC_GET && context->retcode == KV_ERR_BUFFER_SMALL)) {
     const char *cmd = (context->opcode == KV_OPC_GET) ? "GET" : ((
                         context->opcode == KV_OPC_STORE) ? "PUT" : (context->opcode == KV_OPC_DELETE) ?
                       "DEL" : "OTHER");
@@ -165,6 +183,17 @@ void on_io_complete(kv_io_context *context) {
     iocb->value->actual_value_size = context->value->actual_value_size -
                                      context->value->offset;
 
+  //counted before the caller can close the key space
+  if (ctx->stats_start) {
+    const bool failed = context->retcode != KV_SUCCESS
+                        && context->retcode != KV_ERR_KEY_NOT_EXIST
+                        && context->retcode != KV_WRN_MORE;
+    uint64_t bytes = ctx->stats_bytes;
+    if (context->opcode == KV_OPC_GET && context->retcode == KV_SUCCESS)
+      bytes = context->value->length;
+    kvs_stats_done(iocb->ks_hd, iocb->context, failed, bytes, ctx->stats_start);
+  }
+
   if (ctx->syncio) {  	
     /*The conversion of the adi layer return code in the synchronous call is in the main entry method.*/
     iocb->result = (kvs_result)context->retcode;
@@ -182,9 +211,8 @@ void on_io_complete(kv_io_context *context) {
     iocb->result = convert_return_code(context->retcode);
     if (context->opcode != KV_OPC_OPEN_ITERATOR
         && context->opcode != KV_OPC_CLOSE_ITERATOR) {
-      if (ctx->on_complete && iocb) {
-        ctx->on_complete(iocb);
-      }
+      if (ctx->on_complete && iocb)
+        owner->dispatcher.complete(ctx->on_complete, iocb, ctx->submitter);
     }
     free_context(ctx, &owner->ctx_pool_notfull, owner->kv_ctx_pool, owner->lock);
   }
@@ -262,10 +290,26 @@ int32_t KvEmulator::init(const char* devpath, const char* configfile,
 KvEmulator::kv_emul_context* KvEmulator::prep_io_context(kvs_context opcode,
     kvs_key_space_handle ks_hd, const kvs_key *key, const kvs_value *value,
     void *private1,
-    void *private2, bool syncio, kvs_postprocess_function post_fn) {
+    void *private2, bool syncio, kvs_postprocess_function post_fn,
+    uint32_t deadline_us) {
   kv_emul_context *ctx = NULL;
-  malloc_context(&ctx, &this->ctx_pool_notfull, this->kv_ctx_pool, this->lock);
+  if (deadline_us == 0) {
+    malloc_context(&ctx, &this->ctx_pool_notfull, this->kv_ctx_pool, this->lock);
+  } else {
+    //the deadline counts from here, the ADI gets what is left of it
+    const auto deadline = std::chrono::steady_clock::now()
+      + std::chrono::microseconds(deadline_us);
+    if (!malloc_context(&ctx, &this->ctx_pool_notfull, this->kv_ctx_pool,
+                        this->lock, &deadline))
+      return NULL;
+    const auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+      deadline - std::chrono::steady_clock::now()).count();
+    ctx->timeout_usec = left > 0 ? (uint32_t)left : 1;
+  }
   ctx->on_complete = post_fn;
+  ctx->submitter = kvs_dispatcher::submitter();
+  ctx->stats_start = kvs_stats_start(ks_hd);
+  ctx->stats_bytes = (opcode == KVS_CMD_STORE && value) ? value->length : 0;
   ctx->iocb.context = opcode;
   ctx->iocb.ks_hd = ks_hd;
   if (key) {
@@ -295,8 +339,9 @@ int32_t KvEmulator::store_tuple(kvs_key_space_handle ks_hd, const kvs_key *key,
                                 const kvs_value *value, kvs_option_store option, void *private1, void *private2,
                                 bool syncio, kvs_postprocess_function post_fn) {
   auto ctx = prep_io_context(KVS_CMD_STORE, ks_hd, key, value, private1,
-                             private2, syncio, post_fn);
-  kv_postprocess_function f = {on_io_complete, (void*)ctx};
+                             private2, syncio, post_fn, option.deadline_us);
+  if (ctx == NULL) return KVS_ERR_DEADLINE_EXCEEDED;
+  kv_postprocess_function f = {on_io_complete, (void*)ctx, ctx->timeout_usec};
 
   kv_store_option option_adi;
 
@@ -321,8 +366,8 @@ int32_t KvEmulator::store_tuple(kvs_key_space_handle ks_hd, const kvs_key *key,
 
   ctx->key = (kv_key*)key;
   ctx->value = (kv_value*)value;
-  int ret = kv_store(this->sqH, this->nsH, ks_hd->keyspace_id, (kv_key*)key,
-                     (kv_value*)value, option_adi, &f);
+  int ret = kv_store_ttl(this->sqH, this->nsH, ks_hd->keyspace_id, (kv_key*)key,
+                         (kv_value*)value, option_adi, option.ttl_ms, &f);
   if (ret != KV_SUCCESS) {
     fprintf(stderr, "kv_store failed with error:  0x%X\n", ret);
     free_context(ctx, &this->ctx_pool_notfull, this->kv_ctx_pool, this->lock);
@@ -347,8 +392,9 @@ int32_t KvEmulator::retrieve_tuple(kvs_key_space_handle ks_hd, const kvs_key *ke
   kvs_value *value, kvs_option_retrieve option, void *private1, void *private2,
   bool syncio, kvs_postprocess_function cbfn) {
   auto ctx = prep_io_context(KVS_CMD_RETRIEVE, ks_hd, key, value, private1, 
-    private2, syncio, cbfn);
-  kv_postprocess_function f = {on_io_complete, (void*)ctx};
+    private2, syncio, cbfn, option.deadline_us);
+  if (ctx == NULL) return KVS_ERR_DEADLINE_EXCEEDED;
+  kv_postprocess_function f = {on_io_complete, (void*)ctx, ctx->timeout_usec};
 
   kv_retrieve_option option_adi;
   if(!option.kvs_retrieve_delete){
@@ -386,8 +432,9 @@ int32_t KvEmulator::delete_tuple(kvs_key_space_handle ks_hd, const kvs_key *key,
                                  kvs_option_delete option, void *private1, void *private2, bool syncio,
                                  kvs_postprocess_function post_fn) {
   auto ctx = prep_io_context(KVS_CMD_DELETE, ks_hd, key, NULL, private1, private2,
-                             syncio, post_fn);
-  kv_postprocess_function f = {on_io_complete, (void*)ctx};
+                             syncio, post_fn, option.deadline_us);
+  if (ctx == NULL) return KVS_ERR_DEADLINE_EXCEEDED;
+  kv_postprocess_function f = {on_io_complete, (void*)ctx, ctx->timeout_usec};
 
   kv_delete_option option_adi;
   if (!option.kvs_delete_error)
@@ -418,6 +465,70 @@ int32_t KvEmulator::delete_tuple(kvs_key_space_handle ks_hd, const kvs_key *key,
   return convert_return_code(ret);
 }
 
+//kvs_batch_op, kvs_key and kvs_value share the layout of their ADI
+//counterparts, so the operations are passed down without a copy
+static_assert(sizeof(kvs_batch_op) == sizeof(kv_batch_op)
+              && (int)KVS_BATCH_STORE == (int)KV_BATCH_OP_STORE
+              && (int)KVS_BATCH_DELETE == (int)KV_BATCH_OP_DELETE,
+              "kvs_batch_op does not match kv_batch_op");
+
+int32_t KvEmulator::write_batch(kvs_key_space_handle ks_hd, const kvs_batch_op *ops,
+                                uint32_t op_cnt, void *private1, void *private2,
+                                bool syncio, kvs_postprocess_function post_fn) {
+  auto ctx = prep_io_context(KVS_CMD_WRITE_BATCH, ks_hd, NULL, NULL, private1,
+                             private2, syncio, post_fn);
+  kv_postprocess_function f = {on_io_complete, (void*)ctx};
+
+  ctx->key = NULL;
+  ctx->value = NULL;
+  for (uint32_t i = 0; ctx->stats_start && i < op_cnt; i++) {
+    if (ops[i].type == KVS_BATCH_STORE) ctx->stats_bytes += ops[i].value->length;
+  }
+  int ret = kv_write_batch(this->sqH, this->nsH, ks_hd->keyspace_id,
+                           (const kv_batch_op*)ops, op_cnt, &f);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_write_batch failed with error:  0x%X\n", ret);
+    free_context(ctx, &this->ctx_pool_notfull, this->kv_ctx_pool, this->lock);
+    return convert_return_code(ret);
+  }
+
+  if (syncio) {
+    std::unique_lock<std::mutex> lock_s(ctx->lock_sync);
+    while (ctx->done_sync == 0)
+      ctx->done_cond_sync.wait(lock_s);
+    lock_s.unlock();
+    ret = ctx->iocb.result;
+
+    free_context(ctx, &this->ctx_pool_notfull, this->kv_ctx_pool, this->lock);
+  }
+
+  return convert_return_code(ret);
+}
+
+struct cancel_filter {
+  kvs_key_space_handle ks_hd;
+  void *private1;
+};
+
+//called by the ADI for every queued command with the queue locked
+static bool_t match_canceled(const kv_io_context *op, void *arg) {
+  const cancel_filter *filter = (const cancel_filter*)arg;
+  const KvEmulator::kv_emul_context *ctx = (const KvEmulator::kv_emul_context*)
+                                           op->private_data;
+  if (ctx == NULL || ctx->syncio || ctx->iocb.ks_hd != filter->ks_hd)
+    return FALSE;
+  if (filter->private1 == NULL) return TRUE;
+  return _kvs_user_private1(ctx->iocb.private1, ctx->on_complete) == filter->private1
+         ? TRUE : FALSE;
+}
+
+int32_t KvEmulator::cancel_io(kvs_key_space_handle ks_hd, void *private1,
+                              uint32_t *canceled) {
+  cancel_filter filter = {ks_hd, private1};
+  kv_result ret = kv_cancel(this->sqH, match_canceled, &filter, canceled);
+  return convert_return_code(ret);
+}
+
 int32_t KvEmulator::exist_tuple(kvs_key_space_handle ks_hd, uint32_t key_cnt,
                                 const kvs_key *keys,kvs_exist_list *list, void *private1,
                                 void *private2, bool syncio, kvs_postprocess_function post_fn) {
@@ -606,6 +717,45 @@ int32_t KvEmulator::get_used_size(uint32_t *dev_util){
   return convert_return_code(ret);
 }
 
+int32_t KvEmulator::get_ttl_stats(kvs_ttl_stats *stats) {
+  kv_expiry_stat st;
+  int ret = kv_get_expiry_stat(devH, nsH, &st);
+  if (ret != KV_SUCCESS) return convert_return_code(ret);
+
+  stats->expiring = st.expiring;
+  stats->expired_lazy = st.expired_lazy;
+  stats->reaped = st.reaped;
+  stats->reaped_bytes = st.reaped_bytes;
+  stats->reaper_busy_ns = st.reaper_busy_ns;
+  return KVS_SUCCESS;
+}
+
+int32_t KvEmulator::get_cache_stats(kvs_cache_stats *stats) {
+  kv_cache_stat st;
+  int ret = kv_get_cache_stat(devH, nsH, &st);
+  if (ret != KV_SUCCESS) return convert_return_code(ret);
+
+  stats->capacity = st.capacity;
+  stats->used = st.used;
+  stats->dirty = st.dirty;
+  stats->pairs = st.pairs;
+  stats->read_hits = st.read_hits;
+  stats->read_misses = st.read_misses;
+  stats->write_absorbed = st.write_absorbed;
+  stats->write_through = st.write_through;
+  stats->flushes = st.flushes;
+  stats->flushed_bytes = st.flushed_bytes;
+  stats->evictions = st.evictions;
+  return KVS_SUCCESS;
+}
+
+void KvEmulator::export_stats(kvs_stats_device *stats) {
+  //the emulator counts its submission and completion queue itself
+  if (_kv_set_queue_stats(devH, sqH, &stats->queue[0]) == KV_SUCCESS
+      && _kv_set_queue_stats(devH, cqH, &stats->queue[1]) == KV_SUCCESS)
+    __atomic_store_n(&stats->nqueues, 2, __ATOMIC_RELEASE);
+}
+
 int32_t KvEmulator::get_total_size(uint64_t *dev_capa){
   int ret = 0;
   kv_device *devinfo = (kv_device *)malloc(sizeof(kv_device));
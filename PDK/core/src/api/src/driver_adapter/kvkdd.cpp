@@ -38,6 +38,7 @@
 
 #include "kvs_utils.h"
 #include "kvkdd.hpp"
+#include "kvs_stats.h"
 #include <algorithm>
 #include <atomic>
 #include <tbb/concurrent_queue.h>
@@ -437,6 +438,17 @@ void kdd_on_io_complete(kv_io_context *context){
     *(uint8_t*)iocb->result_buffer.list->result_buffer = (context->retcode == 0x310)? 0:1;
   }
 
+  //counted before the caller can close the key space
+  if (ctx->stats_start) {
+    const bool failed = context->retcode != KV_SUCCESS
+                        && context->retcode != KV_ERR_KEY_NOT_EXIST
+                        && !(iocb->context == KVS_CMD_EXIST && context->retcode == 0x310);
+    uint64_t bytes = ctx->stats_bytes;
+    if (iocb->context == KVS_CMD_RETRIEVE && context->retcode == KV_SUCCESS)
+      bytes = iocb->value->length;
+    kvs_stats_done(iocb->ks_hd, iocb->context, failed, bytes, ctx->stats_start);
+  }
+
   #ifdef KVKDD_DEBUG 
     if(iocb->context == KVS_CMD_STORE) {
       kvkdd_logger.log_write(context->key->key, context->key->length, context->value->value, context->value->length, context->retcode);
@@ -454,9 +466,8 @@ void kdd_on_io_complete(kv_io_context *context){
 
   } else { 
     iocb->result = convert_return_code(iocb->context, context->retcode);
-    if(ctx->on_complete && iocb) {
-      ctx->on_complete(iocb);
-    }
+    if(ctx->on_complete && iocb)
+      ctx->owner->dispatcher.complete(ctx->on_complete, iocb, ctx->submitter);
     delete ctx;
     ctx = NULL;
   }
@@ -846,6 +857,9 @@ KDDriver::kv_kdd_context* KDDriver::prep_io_context(kvs_context opcode, kvs_key_
   ctx->iocb.result_buffer.iter_list = NULL;
   ctx->iocb.result_buffer.list = NULL;
   ctx->on_complete = cbfn;
+  ctx->submitter = kvs_dispatcher::submitter();
+  ctx->stats_start = kvs_stats_start(ks_hd);
+  ctx->stats_bytes = (opcode == KVS_CMD_STORE && value) ? value->length : 0;
 
   ctx->done= false;
   ctx->syncio = syncio;
@@ -876,6 +890,9 @@ int32_t KDDriver::trans_iter_type(uint8_t dev_it_type, uint8_t* kvs_it_type){
 int32_t KDDriver::trans_store_cmd_opt(kvs_option_store kvs_opt,
                                             kv_store_option *kv_opt){
  
+    // time to live is only supported by the emulator
+    if (kvs_opt.ttl_ms) return KVS_ERR_OPTION_INVALID;
+
     // Default: no compression
     switch(kvs_opt.st_type) {
     case KVS_STORE_POST:
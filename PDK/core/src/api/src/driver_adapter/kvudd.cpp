@@ -135,7 +135,8 @@ void udd_iterate_cb(kv_iterate *it, unsigned int result, unsigned int status) {
     ctx->iter_list->size = it->kv.value.length - KV_IT_READ_BUFFER_META_LEN;
   else
     ctx->iter_list->size = it->kv.value.length;
-  if(ctx->on_complete && iocb) ctx->on_complete(iocb);    
+  if(ctx->on_complete && iocb)
+    ctx->owner->dispatcher.complete(ctx->on_complete, iocb, ctx->submitter);
   
   if (ctx) {
     free(ctx);
@@ -212,7 +213,8 @@ void udd_write_cb(kv_pair *kv, unsigned int result, unsigned int status) {
     iocb->value->length = kv->value.length;
   }
   
-  if(ctx->on_complete && iocb) ctx->on_complete(iocb);
+  if(ctx->on_complete && iocb)
+    ctx->owner->dispatcher.complete(ctx->on_complete, iocb, ctx->submitter);
  
   const auto owner = ctx->owner;
   if (ctx) {
@@ -313,6 +315,7 @@ KUDDriver::kv_udd_context* KUDDriver::prep_io_context(kvs_context opcode,
   void *private1, void *private2, bool syncio, kvs_postprocess_function cbfn) {
   kv_udd_context *ctx = (kv_udd_context*)calloc(1, sizeof(kv_udd_context));
   ctx->on_complete = cbfn;
+  ctx->submitter = kvs_dispatcher::submitter();
   ctx->iocb.context = opcode;
   ctx->iocb.ks_hd = ks_hd;
   if(key) {
@@ -1054,6 +1057,9 @@ int32_t KUDDriver::iterator_next(kvs_key_space_handle ks_hd, kvs_iterator_handle
 }  
 
 int32_t KUDDriver::trans_store_cmd_opt(kvs_option_store kvs_opt, int *kv_opt){
+    // time to live is only supported by the emulator
+    if (kvs_opt.ttl_ms) return KVS_ERR_OPTION_INVALID;
+
     // Default: no compression
     switch(kvs_opt.st_type) {
       case KVS_STORE_POST:
@@ -0,0 +1,431 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include "kvs_aes.h"
+
+#if defined(__AES__) && defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define KVS_AES_HW 1
+#else
+#define KVS_AES_HW 0
+#endif
+
+static const uint8_t aes_sbox[256] = {
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static inline uint8_t _xtime(uint8_t x) {
+  return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+static inline void _put_be32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static inline void _put_be64(uint8_t *p, uint64_t v) {
+  _put_be32(p, v >> 32);
+  _put_be32(p + 4, (uint32_t)v);
+}
+
+static inline uint64_t _get_be64(const uint8_t *p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+  return v;
+}
+
+// X = X * Y in GF(2^128) with the GCM bit order, one bit at a time
+static void _gf_mul_sw(uint8_t *x, const uint8_t *y) {
+  uint64_t zh = 0, zl = 0;
+  uint64_t vh = _get_be64(y), vl = _get_be64(y + 8);
+  for (int i = 0; i < 128; i++) {
+    if ((x[i / 8] >> (7 - i % 8)) & 1) {
+      zh ^= vh;
+      zl ^= vl;
+    }
+    uint64_t lsb = vl & 1;
+    vl = (vl >> 1) | (vh << 63);
+    vh = (vh >> 1) ^ (lsb ? 0xe100000000000000ULL : 0);
+  }
+  _put_be64(x, zh);
+  _put_be64(x + 8, zl);
+}
+
+#if KVS_AES_HW
+static inline __m128i _bswap128(__m128i x) {
+  return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+// unreduced 256 bit carry-less product of two byte reflected elements
+static inline void _clmul(__m128i a, __m128i b, __m128i *lo, __m128i *hi) {
+  __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+  __m128i t1 = _mm_clmulepi64_si128(a, b, 0x10);
+  __m128i t2 = _mm_clmulepi64_si128(a, b, 0x01);
+  __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+  t1 = _mm_xor_si128(t1, t2);
+  *lo = _mm_xor_si128(t0, _mm_slli_si128(t1, 8));
+  *hi = _mm_xor_si128(t3, _mm_srli_si128(t1, 8));
+}
+
+// shifts the product left by one bit for the reflected bit order and
+// reduces it modulo x^128 + x^7 + x^2 + x + 1
+static inline __m128i _reduce(__m128i lo, __m128i hi) {
+  __m128i t7 = _mm_srli_epi32(lo, 31);
+  __m128i t8 = _mm_srli_epi32(hi, 31);
+  lo = _mm_slli_epi32(lo, 1);
+  hi = _mm_slli_epi32(hi, 1);
+  __m128i t9 = _mm_srli_si128(t7, 12);
+  t8 = _mm_slli_si128(t8, 4);
+  t7 = _mm_slli_si128(t7, 4);
+  lo = _mm_or_si128(lo, t7);
+  hi = _mm_or_si128(hi, t8);
+  hi = _mm_or_si128(hi, t9);
+
+  t7 = _mm_slli_epi32(lo, 31);
+  t8 = _mm_slli_epi32(lo, 30);
+  t9 = _mm_slli_epi32(lo, 25);
+  t7 = _mm_xor_si128(t7, t8);
+  t7 = _mm_xor_si128(t7, t9);
+  t8 = _mm_srli_si128(t7, 4);
+  t7 = _mm_slli_si128(t7, 12);
+  lo = _mm_xor_si128(lo, t7);
+
+  __m128i t2 = _mm_srli_epi32(lo, 1);
+  __m128i t4 = _mm_srli_epi32(lo, 2);
+  __m128i t5 = _mm_srli_epi32(lo, 7);
+  t2 = _mm_xor_si128(t2, t4);
+  t2 = _mm_xor_si128(t2, t5);
+  t2 = _mm_xor_si128(t2, t8);
+  lo = _mm_xor_si128(lo, t2);
+  return _mm_xor_si128(hi, lo);
+}
+
+static inline __m128i _gf_mul(__m128i a, __m128i b) {
+  __m128i lo, hi;
+  _clmul(a, b, &lo, &hi);
+  return _reduce(lo, hi);
+}
+
+static inline __m128i _load_padded(const uint8_t *p, size_t len) {
+  alignas(16) uint8_t block[16] = { 0 };
+  memcpy(block, p, len);
+  return _mm_load_si128((const __m128i*)block);
+}
+#endif
+
+kvs_aes_gcm::kvs_aes_gcm(const uint8_t *key, int key_len, bool hw)
+  : rounds_(key_len / 4 + 6), hw_(hw && KVS_AES_HW) {
+  // FIPS-197 key expansion, the byte order is also the one AESENC expects
+  const int nk = key_len / 4;
+  const int words = 4 * (rounds_ + 1);
+  uint8_t *w = round_keys_;
+  memcpy(w, key, key_len);
+  uint8_t rcon = 1;
+  for (int i = nk; i < words; i++) {
+    uint8_t t[4];
+    memcpy(t, w + 4 * (i - 1), 4);
+    if (i % nk == 0) {
+      uint8_t t0 = t[0];
+      t[0] = aes_sbox[t[1]] ^ rcon;
+      t[1] = aes_sbox[t[2]];
+      t[2] = aes_sbox[t[3]];
+      t[3] = aes_sbox[t0];
+      rcon = _xtime(rcon);
+    } else if (nk > 6 && i % nk == 4) {
+      for (int j = 0; j < 4; j++) t[j] = aes_sbox[t[j]];
+    }
+    for (int j = 0; j < 4; j++) w[4 * i + j] = w[4 * (i - nk) + j] ^ t[j];
+  }
+
+  uint8_t zero[BLOCK] = { 0 };
+  _encrypt_block(zero, h_);
+#if KVS_AES_HW
+  __m128i h = _bswap128(_mm_load_si128((const __m128i*)h_));
+  __m128i p = h;
+  for (int i = 0; i < 4; i++) {
+    _mm_store_si128((__m128i*)h_pow_[i], p);
+    p = _gf_mul(p, h);
+  }
+#else
+  memset(h_pow_, 0, sizeof(h_pow_));
+#endif
+}
+
+kvs_aes_gcm::~kvs_aes_gcm() {
+  volatile uint8_t *p = round_keys_;
+  for (size_t i = 0; i < sizeof(round_keys_); i++) p[i] = 0;
+  p = h_;
+  for (size_t i = 0; i < sizeof(h_); i++) p[i] = 0;
+  p = &h_pow_[0][0];
+  for (size_t i = 0; i < sizeof(h_pow_); i++) p[i] = 0;
+}
+
+const char *kvs_aes_gcm::impl() const {
+  return hw_ ? "aes-ni" : "portable";
+}
+
+void kvs_aes_gcm::_encrypt_block(const uint8_t *in, uint8_t *out) const {
+#if KVS_AES_HW
+  if (hw_) {
+    const __m128i *rk = (const __m128i*)round_keys_;
+    __m128i m = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), rk[0]);
+    for (int r = 1; r < rounds_; r++) m = _mm_aesenc_si128(m, rk[r]);
+    m = _mm_aesenclast_si128(m, rk[rounds_]);
+    _mm_storeu_si128((__m128i*)out, m);
+    return;
+  }
+#endif
+  uint8_t s[BLOCK];
+  for (int i = 0; i < BLOCK; i++) s[i] = in[i] ^ round_keys_[i];
+  for (int r = 1; r <= rounds_; r++) {
+    uint8_t t[BLOCK];
+    // SubBytes and ShiftRows, s[row + 4 * column]
+    for (int c = 0; c < 4; c++) {
+      for (int row = 0; row < 4; row++)
+        t[row + 4 * c] = aes_sbox[s[row + 4 * ((c + row) % 4)]];
+    }
+    if (r < rounds_) {
+      for (int c = 0; c < 4; c++) {
+        uint8_t *a = t + 4 * c;
+        uint8_t a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+        uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+        a[0] ^= all ^ _xtime(a0 ^ a1);
+        a[1] ^= all ^ _xtime(a1 ^ a2);
+        a[2] ^= all ^ _xtime(a2 ^ a3);
+        a[3] ^= all ^ _xtime(a3 ^ a0);
+      }
+    }
+    for (int i = 0; i < BLOCK; i++) s[i] = t[i] ^ round_keys_[16 * r + i];
+  }
+  memcpy(out, s, BLOCK);
+}
+
+void kvs_aes_gcm::_ctr(const uint8_t *iv, uint32_t ctr, const uint8_t *in,
+  size_t len, uint8_t *out) const {
+  size_t pos = 0;
+#if KVS_AES_HW
+  if (hw_) {
+    const __m128i *rk = (const __m128i*)round_keys_;
+    alignas(16) uint8_t base[BLOCK] = { 0 };
+    memcpy(base, iv, 12);
+    __m128i b = _mm_load_si128((const __m128i*)base);
+    for (; pos + 4 * BLOCK <= len; pos += 4 * BLOCK, ctr += 4) {
+      __m128i c0 = _mm_insert_epi32(b, __builtin_bswap32(ctr), 3);
+      __m128i c1 = _mm_insert_epi32(b, __builtin_bswap32(ctr + 1), 3);
+      __m128i c2 = _mm_insert_epi32(b, __builtin_bswap32(ctr + 2), 3);
+      __m128i c3 = _mm_insert_epi32(b, __builtin_bswap32(ctr + 3), 3);
+      c0 = _mm_xor_si128(c0, rk[0]);
+      c1 = _mm_xor_si128(c1, rk[0]);
+      c2 = _mm_xor_si128(c2, rk[0]);
+      c3 = _mm_xor_si128(c3, rk[0]);
+      for (int r = 1; r < rounds_; r++) {
+        c0 = _mm_aesenc_si128(c0, rk[r]);
+        c1 = _mm_aesenc_si128(c1, rk[r]);
+        c2 = _mm_aesenc_si128(c2, rk[r]);
+        c3 = _mm_aesenc_si128(c3, rk[r]);
+      }
+      c0 = _mm_aesenclast_si128(c0, rk[rounds_]);
+      c1 = _mm_aesenclast_si128(c1, rk[rounds_]);
+      c2 = _mm_aesenclast_si128(c2, rk[rounds_]);
+      c3 = _mm_aesenclast_si128(c3, rk[rounds_]);
+      const __m128i *src = (const __m128i*)(in + pos);
+      __m128i *dst = (__m128i*)(out + pos);
+      _mm_storeu_si128(dst, _mm_xor_si128(c0, _mm_loadu_si128(src)));
+      _mm_storeu_si128(dst + 1, _mm_xor_si128(c1, _mm_loadu_si128(src + 1)));
+      _mm_storeu_si128(dst + 2, _mm_xor_si128(c2, _mm_loadu_si128(src + 2)));
+      _mm_storeu_si128(dst + 3, _mm_xor_si128(c3, _mm_loadu_si128(src + 3)));
+    }
+  }
+#endif
+  uint8_t block[BLOCK], ks[BLOCK];
+  memcpy(block, iv, 12);
+  for (; pos < len; pos += BLOCK, ctr++) {
+    _put_be32(block + 12, ctr);
+    _encrypt_block(block, ks);
+    size_t n = std::min((size_t)BLOCK, len - pos);
+    for (size_t i = 0; i < n; i++) out[pos + i] = in[pos + i] ^ ks[i];
+  }
+}
+
+void kvs_aes_gcm::_ghash(const uint8_t *aad, size_t aad_len, const uint8_t *c,
+  size_t len, uint8_t *out) const {
+  uint8_t lens[BLOCK];
+  _put_be64(lens, (uint64_t)aad_len * 8);
+  _put_be64(lens + 8, (uint64_t)len * 8);
+#if KVS_AES_HW
+  if (hw_) {
+    const __m128i *hp = (const __m128i*)h_pow_;
+    __m128i x = _mm_setzero_si128();
+    for (size_t pos = 0; pos < aad_len; pos += BLOCK) {
+      __m128i a = _load_padded(aad + pos, std::min((size_t)BLOCK, aad_len - pos));
+      x = _gf_mul(_mm_xor_si128(x, _bswap128(a)), hp[0]);
+    }
+    size_t pos = 0;
+    for (; pos + 4 * BLOCK <= len; pos += 4 * BLOCK) {
+      const __m128i *src = (const __m128i*)(c + pos);
+      __m128i lo, hi, l, h;
+      _clmul(_mm_xor_si128(x, _bswap128(_mm_loadu_si128(src))), hp[3], &lo, &hi);
+      _clmul(_bswap128(_mm_loadu_si128(src + 1)), hp[2], &l, &h);
+      lo = _mm_xor_si128(lo, l);
+      hi = _mm_xor_si128(hi, h);
+      _clmul(_bswap128(_mm_loadu_si128(src + 2)), hp[1], &l, &h);
+      lo = _mm_xor_si128(lo, l);
+      hi = _mm_xor_si128(hi, h);
+      _clmul(_bswap128(_mm_loadu_si128(src + 3)), hp[0], &l, &h);
+      lo = _mm_xor_si128(lo, l);
+      hi = _mm_xor_si128(hi, h);
+      x = _reduce(lo, hi);
+    }
+    for (; pos < len; pos += BLOCK) {
+      __m128i b = _load_padded(c + pos, std::min((size_t)BLOCK, len - pos));
+      x = _gf_mul(_mm_xor_si128(x, _bswap128(b)), hp[0]);
+    }
+    __m128i l = _mm_loadu_si128((const __m128i*)lens);
+    x = _gf_mul(_mm_xor_si128(x, _bswap128(l)), hp[0]);
+    _mm_storeu_si128((__m128i*)out, _bswap128(x));
+    return;
+  }
+#endif
+  uint8_t x[BLOCK] = { 0 };
+  for (size_t pos = 0; pos < aad_len; pos += BLOCK) {
+    size_t n = std::min((size_t)BLOCK, aad_len - pos);
+    for (size_t i = 0; i < n; i++) x[i] ^= aad[pos + i];
+    _gf_mul_sw(x, h_);
+  }
+  for (size_t pos = 0; pos < len; pos += BLOCK) {
+    size_t n = std::min((size_t)BLOCK, len - pos);
+    for (size_t i = 0; i < n; i++) x[i] ^= c[pos + i];
+    _gf_mul_sw(x, h_);
+  }
+  for (int i = 0; i < BLOCK; i++) x[i] ^= lens[i];
+  _gf_mul_sw(x, h_);
+  memcpy(out, x, BLOCK);
+}
+
+void kvs_aes_gcm::_tag(const uint8_t *iv, const uint8_t *aad, size_t aad_len,
+  const uint8_t *c, size_t len, uint8_t *tag) const {
+  uint8_t j0[BLOCK], ek[BLOCK];
+  memcpy(j0, iv, 12);
+  _put_be32(j0 + 12, 1);
+  _encrypt_block(j0, ek);
+  _ghash(aad, aad_len, c, len, tag);
+  for (int i = 0; i < BLOCK; i++) tag[i] ^= ek[i];
+}
+
+void kvs_aes_gcm::encrypt(const uint8_t *iv, const uint8_t *aad, size_t aad_len,
+  const uint8_t *in, size_t len, uint8_t *out, uint8_t *tag) const {
+  _ctr(iv, 2, in, len, out);
+  _tag(iv, aad, aad_len, out, len, tag);
+}
+
+bool kvs_aes_gcm::decrypt(const uint8_t *iv, const uint8_t *aad, size_t aad_len,
+  const uint8_t *in, size_t len, const uint8_t *tag, size_t from, size_t cnt,
+  uint8_t *out) const {
+  uint8_t expect[BLOCK];
+  _tag(iv, aad, aad_len, in, len, expect);
+  uint8_t diff = 0;
+  for (int i = 0; i < BLOCK; i++) diff |= expect[i] ^ tag[i];
+  if (diff) return false;
+
+  // a range that starts inside a block takes that block's key stream apart
+  uint32_t ctr = 2 + from / BLOCK;
+  size_t skip = from % BLOCK;
+  if (skip && cnt) {
+    uint8_t block[BLOCK], ks[BLOCK];
+    memcpy(block, iv, 12);
+    _put_be32(block + 12, ctr++);
+    _encrypt_block(block, ks);
+    size_t n = std::min(cnt, BLOCK - skip);
+    for (size_t i = 0; i < n; i++) out[i] = in[from + i] ^ ks[skip + i];
+    from += n;
+    out += n;
+    cnt -= n;
+  }
+  _ctr(iv, ctr, in + from, cnt, out);
+  return true;
+}
+
+kvs_gcm_codec::kvs_gcm_codec(const uint8_t *key, int key_len)
+  : gcm_(key, key_len) {
+  std::random_device rd;
+  next_nonce_ = ((uint64_t)rd() << 32) | rd();
+}
+
+uint64_t kvs_gcm_codec::begin_value() {
+  return next_nonce_.fetch_add(1);
+}
+
+size_t kvs_gcm_codec::_make_aad(const kvs_chunk_ref &ref, uint8_t *aad) {
+  memcpy(aad, ref.key->key, ref.key->length);
+  _put_be32(aad + ref.key->length, ref.value_len);
+  _put_be32(aad + ref.key->length + 4, ref.index);
+  return ref.key->length + 8;
+}
+
+void kvs_gcm_codec::seal(const kvs_chunk_ref &ref, const char *src, uint32_t n,
+  char *dst) {
+  uint8_t iv[12], aad[KVS_MAX_KEY_LENGTH + 8];
+  memcpy(iv, &ref.nonce, NONCE_LEN);
+  _put_be32(iv + NONCE_LEN, ref.index);
+  size_t aad_len = _make_aad(ref, aad);
+  memcpy(dst + n, &ref.nonce, NONCE_LEN);
+  gcm_.encrypt(iv, aad, aad_len, (const uint8_t*)src, n, (uint8_t*)dst,
+               (uint8_t*)dst + n + NONCE_LEN);
+}
+
+bool kvs_gcm_codec::open(const kvs_chunk_ref &ref, const char *src, uint32_t n,
+  uint32_t from, uint32_t cnt, char *dst) {
+  uint8_t iv[12], aad[KVS_MAX_KEY_LENGTH + 8];
+  memcpy(iv, src + n, NONCE_LEN);
+  _put_be32(iv + NONCE_LEN, ref.index);
+  size_t aad_len = _make_aad(ref, aad);
+  return gcm_.decrypt(iv, aad, aad_len, (const uint8_t*)src, n,
+                      (const uint8_t*)src + n + NONCE_LEN, from, cnt, (uint8_t*)dst);
+}
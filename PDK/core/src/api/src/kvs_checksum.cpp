@@ -0,0 +1,144 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "kvs_checksum.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+static const uint32_t CRC32C_POLY = 0x82f63b78;   // reflected 0x1edc6f41
+
+// slicing-by-8 tables, table[k][b] is the CRC of byte b followed by k zeros
+struct crc32c_tables {
+  uint32_t t[8][256];
+
+  crc32c_tables() {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int i = 0; i < 8; i++)
+        crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+      t[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      for (int k = 1; k < 8; k++)
+        t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+    }
+  }
+};
+
+static const crc32c_tables g_crc32c;
+
+uint32_t kvs_crc32c_sw(uint32_t crc, const void *buf, size_t len) {
+  const uint8_t *p = (const uint8_t*)buf;
+  crc = ~crc;
+  for (; len && ((uintptr_t)p & 7); len--)
+    crc = (crc >> 8) ^ g_crc32c.t[0][(crc ^ *p++) & 0xff];
+  for (; len >= 8; len -= 8, p += 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;
+    crc = g_crc32c.t[7][lo & 0xff] ^ g_crc32c.t[6][(lo >> 8) & 0xff] ^
+          g_crc32c.t[5][(lo >> 16) & 0xff] ^ g_crc32c.t[4][lo >> 24] ^
+          g_crc32c.t[3][hi & 0xff] ^ g_crc32c.t[2][(hi >> 8) & 0xff] ^
+          g_crc32c.t[1][(hi >> 16) & 0xff] ^ g_crc32c.t[0][hi >> 24];
+  }
+  for (; len; len--)
+    crc = (crc >> 8) ^ g_crc32c.t[0][(crc ^ *p++) & 0xff];
+  return ~crc;
+}
+
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+uint32_t kvs_crc32c(uint32_t crc, const void *buf, size_t len) {
+  const uint8_t *p = (const uint8_t*)buf;
+  crc = ~crc;
+#if defined(__SSE4_2__)
+  for (; len && ((uintptr_t)p & 7); len--)
+    crc = _mm_crc32_u8(crc, *p++);
+  uint64_t crc64 = crc;
+  for (; len >= 8; len -= 8, p += 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc64 = _mm_crc32_u64(crc64, v);
+  }
+  crc = (uint32_t)crc64;
+  for (; len; len--)
+    crc = _mm_crc32_u8(crc, *p++);
+#else
+  for (; len && ((uintptr_t)p & 7); len--)
+    crc = __crc32cb(crc, *p++);
+  for (; len >= 8; len -= 8, p += 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc = __crc32cd(crc, v);
+  }
+  for (; len; len--)
+    crc = __crc32cb(crc, *p++);
+#endif
+  return ~crc;
+}
+#else
+uint32_t kvs_crc32c(uint32_t crc, const void *buf, size_t len) {
+  return kvs_crc32c_sw(crc, buf, len);
+}
+#endif
+
+const char *kvs_crc32c_impl() {
+#if defined(__SSE4_2__)
+  return "sse4.2";
+#elif defined(__ARM_FEATURE_CRC32)
+  return "armv8-crc";
+#else
+  return "table";
+#endif
+}
+
+void kvs_crc_codec::seal(const kvs_chunk_ref &ref, const char *src, uint32_t n,
+  char *dst) {
+  memcpy(dst, src, n);
+  uint32_t crc = kvs_crc32c(ref.index, src, n);
+  memcpy(dst + n, &crc, sizeof(crc));
+}
+
+bool kvs_crc_codec::open(const kvs_chunk_ref &ref, const char *src, uint32_t n,
+  uint32_t from, uint32_t cnt, char *dst) {
+  uint32_t crc;
+  memcpy(&crc, src + n, sizeof(crc));
+  if (kvs_crc32c(ref.index, src, n) != crc) return false;
+  memcpy(dst, src + from, cnt);
+  return true;
+}
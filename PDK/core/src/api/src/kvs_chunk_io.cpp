@@ -0,0 +1,178 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "kvs_utils.h"
+#include "kvs_chunk_io.h"
+
+uint32_t kvs_chunk_codec::stored_length(uint32_t value_len) const {
+  uint32_t chunks = (value_len + payload() - 1) / payload();
+  return value_len + chunks * overhead();
+}
+
+uint32_t kvs_chunk_codec::value_length(uint32_t stored_len) const {
+  uint32_t rem = stored_len % CHUNK;
+  uint32_t len = stored_len / CHUNK * payload();
+  return rem > overhead() ? len + rem - overhead() : len;
+}
+
+kvs_chunk_io::kvs_chunk_io(kvs_chunk_codec *codec)
+  : codec_(codec), key_(NULL), user_(NULL), first_chunk_(0), private1_(NULL),
+    private2_(NULL), post_fn_(NULL) {
+  memset(&stored_, 0, sizeof(stored_));
+}
+
+kvs_chunk_io::~kvs_chunk_io() {
+  for (void *buf : buffers_) kvs_free(buf);
+}
+
+void *kvs_chunk_io::_alloc(uint32_t len) {
+  void *buf = kvs_malloc(std::max(len, kvs_chunk_codec::CHUNK), 4096);
+  if (buf) buffers_.push_back(buf);
+  return buf;
+}
+
+void kvs_chunk_io::_seal(const kvs_key *key, const kvs_value *value, void *dst) {
+  const uint32_t payload = codec_->payload();
+  const char *s = (const char*)value->value;
+  char *d = (char*)dst;
+  kvs_chunk_ref ref = { key, value->length, 0, codec_->begin_value() };
+  for (uint32_t pos = 0; pos < value->length; ref.index++, pos += payload) {
+    uint32_t n = std::min(payload, value->length - pos);
+    codec_->seal(ref, s + pos, n, d + (size_t)ref.index * kvs_chunk_codec::CHUNK);
+  }
+}
+
+kvs_result kvs_chunk_io::prepare_store(const kvs_key *key, kvs_value *value) {
+  uint32_t len = codec_->stored_length(value->length);
+  if (len > KVS_MAX_VALUE_LENGTH) return KVS_ERR_VALUE_LENGTH_INVALID;
+  void *buf = _alloc(len);
+  if (buf == NULL) return KVS_ERR_SYS_IO;
+  _seal(key, value, buf);
+  key_ = key;
+  user_ = value;
+  stored_.value = buf;
+  stored_.length = len;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_chunk_io::prepare_retrieve(const kvs_key *key, kvs_value *value) {
+  const uint32_t payload = codec_->payload();
+  first_chunk_ = value->offset / payload;
+  uint64_t start = (uint64_t)first_chunk_ * kvs_chunk_codec::CHUNK;
+  if (start >= KVS_MAX_VALUE_LENGTH) return KVS_ERR_VALUE_OFFSET_INVALID;
+  uint64_t end = (uint64_t)value->offset + std::max(value->length, 1u);
+  uint64_t last = (end - 1) / payload;
+  uint32_t len = std::min<uint64_t>((last - first_chunk_ + 1) * kvs_chunk_codec::CHUNK,
+                                    KVS_MAX_VALUE_LENGTH - start);
+  void *buf = _alloc(len);
+  if (buf == NULL) return KVS_ERR_SYS_IO;
+  key_ = key;
+  user_ = value;
+  stored_.value = buf;
+  stored_.length = len;
+  stored_.offset = start;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_chunk_io::prepare_batch(kvs_batch_op *ops, uint32_t op_cnt) {
+  ops_.assign(ops, ops + op_cnt);
+  values_.resize(op_cnt);
+  for (uint32_t i = 0; i < op_cnt; i++) {
+    if (ops[i].type != KVS_BATCH_STORE) continue;
+    uint32_t len = codec_->stored_length(ops[i].value->length);
+    if (len > KVS_MAX_VALUE_LENGTH) return KVS_ERR_VALUE_LENGTH_INVALID;
+    void *buf = _alloc(len);
+    if (buf == NULL) return KVS_ERR_SYS_IO;
+    _seal(ops[i].key, ops[i].value, buf);
+    values_[i] = *ops[i].value;
+    values_[i].value = buf;
+    values_[i].length = len;
+    ops_[i].value = &values_[i];
+  }
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_chunk_io::complete_retrieve(kvs_result result) {
+  if (result != KVS_SUCCESS && result != KVS_ERR_BUFFER_SMALL) return result;
+  const uint32_t chunk = kvs_chunk_codec::CHUNK;
+  const uint32_t payload = codec_->payload();
+
+  // the driver reports the stored size from the requested offset on
+  uint32_t got = std::min(stored_.length, stored_.actual_value_size);
+  uint32_t tail = stored_.actual_value_size % chunk;
+  if (tail && tail <= codec_->overhead()) return KVS_ERR_CHECKSUM_MISMATCH;
+  uint32_t total = codec_->value_length(stored_.actual_value_size);
+  uint32_t skip = user_->offset - first_chunk_ * payload;
+  if (user_->offset != 0 && skip >= total) return KVS_ERR_VALUE_OFFSET_INVALID;
+
+  const char *src = (const char*)stored_.value;
+  char *dst = (char*)user_->value;
+  uint32_t want = std::min(user_->length, total - skip);
+  kvs_chunk_ref ref = { key_, first_chunk_ * payload + total, first_chunk_, 0 };
+  uint32_t copied = 0;
+  for (uint32_t pos = 0; pos < got; ref.index++, pos += chunk) {
+    uint32_t n = std::min(chunk, got - pos);
+    if (n <= codec_->overhead()) return KVS_ERR_CHECKSUM_MISMATCH;
+    n -= codec_->overhead();
+    uint32_t from = std::min(skip, n);
+    uint32_t cnt = std::min(n - from, want - copied);
+    if (!codec_->open(ref, src + pos, n, from, cnt, dst + copied))
+      return KVS_ERR_CHECKSUM_MISMATCH;
+    copied += cnt;
+    skip -= from;
+  }
+
+  user_->length = copied;
+  user_->actual_value_size = total - (user_->offset - first_chunk_ * payload);
+  return copied < user_->actual_value_size ? KVS_ERR_BUFFER_SMALL : KVS_SUCCESS;
+}
+
+void kvs_chunk_io::set_callback(void *private1, void *private2,
+  kvs_postprocess_function post_fn) {
+  private1_ = private1;
+  private2_ = private2;
+  post_fn_ = post_fn;
+}
+
+void kvs_chunk_io::on_done(kvs_postprocess_context *ctx) {
+  kvs_chunk_io *io = (kvs_chunk_io*)ctx->private1;
+  if (ctx->context == KVS_CMD_RETRIEVE)
+    ctx->result = io->complete_retrieve(ctx->result);
+  if (io->user_) ctx->value = io->user_;
+  ctx->private1 = io->private1_;
+  ctx->private2 = io->private2_;
+  io->post_fn_(ctx);
+  delete io;
+}
@@ -0,0 +1,179 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <sched.h>
+#include <string.h>
+#include "private_types.h"
+#include "kvs_dispatch.h"
+#include "kvs_read_ahead.h"
+
+kvs_dispatcher::kvs_dispatcher() : next_(0) {
+  memset(&opt_, 0, sizeof(opt_));
+  opt_.mode = KVS_DISPATCH_INLINE;
+}
+
+kvs_dispatcher::~kvs_dispatcher() {
+  _stop();
+}
+
+uint64_t kvs_dispatcher::submitter() {
+  static std::atomic<uint64_t> next_id(0);
+  static thread_local uint64_t id = 0;
+  if (id == 0) id = ++next_id;
+  return id;
+}
+
+kvs_result kvs_dispatcher::configure(const kvs_option_dispatch *opt) {
+  kvs_option_dispatch inline_opt;
+  memset(&inline_opt, 0, sizeof(inline_opt));
+  inline_opt.mode = KVS_DISPATCH_INLINE;
+  if (opt == NULL) opt = &inline_opt;
+
+  if (opt->mode != KVS_DISPATCH_INLINE && opt->mode != KVS_DISPATCH_POOL &&
+      opt->mode != KVS_DISPATCH_EXECUTOR)
+    return KVS_ERR_PARAM_INVALID;
+  if (opt->mode == KVS_DISPATCH_EXECUTOR && opt->executor == NULL)
+    return KVS_ERR_PARAM_INVALID;
+
+  _stop();
+  opt_ = *opt;
+  if (opt_.mode != KVS_DISPATCH_POOL) return KVS_SUCCESS;
+
+  //one thread per CPU the caller may run on, each bound to its CPU
+  std::vector<int> cpus;
+  if (opt_.threads == 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &set)) cpus.push_back(c);
+      }
+    }
+    if (cpus.empty()) cpus.push_back(-1);
+  }
+  const uint32_t n = opt_.threads ? opt_.threads : cpus.size();
+  for (uint32_t i = 0; i < n; i++) {
+    worker *w = new worker();
+    w->pending = 0;
+    w->stop = false;
+    w->cpu = opt_.threads ? -1 : cpus[i];
+    workers_.push_back(w);
+  }
+  for (auto w : workers_)
+    w->thread = std::thread(&kvs_dispatcher::_work, this, w);
+  return KVS_SUCCESS;
+}
+
+void kvs_dispatcher::complete(kvs_postprocess_function post_fn,
+  const kvs_postprocess_context *iocb, uint64_t submitter) {
+  //writes are complete on the device from here on
+  if (iocb->ks_hd && iocb->ks_hd->read_ahead)
+    iocb->ks_hd->read_ahead->completed(iocb, post_fn);
+  if (opt_.mode == KVS_DISPATCH_INLINE) {
+    post_fn((kvs_postprocess_context*)iocb);
+    _kvs_key_space_io_done(iocb->ks_hd);
+    return;
+  }
+
+  task *t = new task;
+  t->post_fn = post_fn;
+  t->iocb = *iocb;
+  if (opt_.mode == KVS_DISPATCH_EXECUTOR) {
+    opt_.executor(_run, t, submitter, opt_.executor_private);
+    return;
+  }
+
+  const uint32_t n = workers_.size();
+  worker *w;
+  if (opt_.ordered) {
+    w = workers_[(submitter * 0x9e3779b97f4a7c15ULL >> 32) % n];
+  } else {
+    //the less loaded of two threads
+    const uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+    worker *a = workers_[ticket % n];
+    worker *b = workers_[(ticket * 2654435761U >> 16) % n];
+    w = b->pending.load(std::memory_order_relaxed) <
+        a->pending.load(std::memory_order_relaxed) ? b : a;
+  }
+  w->pending.fetch_add(1, std::memory_order_relaxed);
+  std::unique_lock<std::mutex> lock(w->lock);
+  w->queue.push_back(t);
+  if (w->queue.size() == 1) w->cond.notify_one();
+}
+
+void kvs_dispatcher::_run(void *t) {
+  task *tk = (task*)t;
+  tk->post_fn(&tk->iocb);
+  _kvs_key_space_io_done(tk->iocb.ks_hd);
+  delete tk;
+}
+
+void kvs_dispatcher::_work(worker *w) {
+  if (w->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+
+  std::deque<task*> batch;
+  std::unique_lock<std::mutex> lock(w->lock);
+  while (true) {
+    while (w->queue.empty() && !w->stop)
+      w->cond.wait(lock);
+    if (w->queue.empty()) break;
+    batch.swap(w->queue);
+    lock.unlock();
+    for (auto t : batch) {
+      _run(t);
+      w->pending.fetch_sub(1, std::memory_order_relaxed);
+    }
+    batch.clear();
+    lock.lock();
+  }
+}
+
+//runs what is queued and joins the pool threads
+void kvs_dispatcher::_stop() {
+  for (auto w : workers_) {
+    std::unique_lock<std::mutex> lock(w->lock);
+    w->stop = true;
+    w->cond.notify_one();
+  }
+  for (auto w : workers_) {
+    w->thread.join();
+    delete w;
+  }
+  workers_.clear();
+}
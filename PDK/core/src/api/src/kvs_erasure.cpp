@@ -0,0 +1,468 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include "kvs_utils.h"
+#include "private_types.h"
+#include "kvs_erasure.h"
+
+static uint64_t _now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+kvs_ec_set::kvs_ec_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt,
+  const kvs_option_ec &opt)
+  : ks_(ks_hds, ks_hds + ks_cnt), failed_(ks_cnt), opt_(opt),
+    codec_(opt.data_fragments, opt.parity_fragments),
+    stamp_(std::random_device()()) {
+  for (auto &f : failed_) f = false;
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void kvs_ec_set::set_failed(uint8_t ks_idx, bool failed) {
+  failed_[ks_idx] = failed;
+}
+
+void kvs_ec_set::get_stats(kvs_ec_stats *stats) {
+  std::unique_lock<std::mutex> lock(lock_);
+  *stats = stats_;
+}
+
+//FNV-1a, spreads the fragments of different keys over the Key Spaces
+uint32_t kvs_ec_set::_home(const kvs_key *key) const {
+  uint32_t h = 2166136261u;
+  const uint8_t *p = (const uint8_t*)key->key;
+  for (uint16_t i = 0; i < key->length; i++) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h % ks_.size();
+}
+
+//payload bytes of each fragment of a coded value, padded for the codec
+uint32_t kvs_ec_set::_frag_len(uint32_t value_len) const {
+  uint32_t k = opt_.data_fragments;
+  return (((value_len + k - 1) / k) + 31) & ~31u;
+}
+
+void kvs_ec_set::_make_keys(const kvs_key *key, char *keys,
+  std::vector<frag_io> &ios) {
+  for (size_t i = 0; i < ios.size(); i++) {
+    char *k = keys + i * (key->length + 1);
+    memcpy(k, key->key, key->length);
+    k[key->length] = (char)i;
+    ios[i].key.key = k;
+    ios[i].key.length = key->length + 1;
+    ios[i].result = KVS_ERR_SYS_IO;
+  }
+}
+
+void kvs_ec_set::_on_frag_done(kvs_postprocess_context *ctx) {
+  _frag_done((frag_io*)ctx->private1, ctx->result);
+}
+
+void kvs_ec_set::_frag_done(frag_io *io, kvs_result result) {
+  io->result = result;
+  //the wave lives on the waiter's stack, notify before letting it go
+  std::unique_lock<std::mutex> lock(io->wave->lock);
+  io->wave->pending--;
+  io->wave->cond.notify_all();
+}
+
+void kvs_ec_set::_wait(io_wave &wave) {
+  std::unique_lock<std::mutex> lock(wave.lock);
+  while (wave.pending)
+    wave.cond.wait(lock);
+}
+
+//reads the header of a fragment that came back, even partially
+bool kvs_ec_set::_valid(const frag_io &io, frag_header *hdr) const {
+  if (io.result != KVS_SUCCESS && io.result != KVS_ERR_BUFFER_SMALL) return false;
+  if (io.value.length < sizeof(frag_header)) return false;
+  memcpy(hdr, io.value.value, sizeof(*hdr));
+  return hdr->magic == FRAG_MAGIC;
+}
+
+kvs_result kvs_ec_set::store(const kvs_key *key, const kvs_value *value,
+  const kvs_option_store *opt) {
+  const int k = opt_.data_fragments, m = opt_.parity_fragments;
+  bool copy = value->length < opt_.min_value_size;
+  int frags = copy ? m + 1 : k + m;
+  uint32_t payload = copy ? value->length : _frag_len(value->length);
+  uint32_t slot = sizeof(frag_header) + payload;
+  uint32_t home = _home(key);
+
+  //copies share one buffer, coded fragments have one slot each
+  char *bufs = (char*)kvs_malloc((size_t)slot * (copy ? 1 : frags), 4096);
+  char *keys = (char*)kvs_malloc(frags * (key->length + 1), 4096);
+  if (bufs == NULL || keys == NULL) {
+    if (bufs) kvs_free(bufs);
+    if (keys) kvs_free(keys);
+    return KVS_ERR_SYS_IO;
+  }
+
+  std::vector<frag_io> ios(frags);
+  _make_keys(key, keys, ios);
+  frag_header hdr = { FRAG_MAGIC, value->length, stamp_++,
+                      (uint8_t)(copy ? FRAG_COPY : FRAG_CODED), 0,
+                      (uint8_t)k, (uint8_t)m };
+  uint64_t encode_ns = 0;
+  if (copy) {
+    memcpy(bufs, &hdr, sizeof(hdr));
+    memcpy(bufs + sizeof(hdr), value->value, value->length);
+  } else {
+    std::vector<uint8_t*> p(frags);
+    for (int i = 0; i < frags; i++) {
+      char *s = bufs + (size_t)i * slot;
+      hdr.index = i;
+      memcpy(s, &hdr, sizeof(hdr));
+      p[i] = (uint8_t*)s + sizeof(hdr);
+      if (i >= k) continue;
+      uint32_t off = i * payload;
+      uint32_t n = (off < value->length) ? std::min(payload, value->length - off) : 0;
+      memcpy(p[i], (const char*)value->value + off, n);
+      memset(p[i] + n, 0, payload - n);
+    }
+    uint64_t start = _now_ns();
+    codec_.encode(p.data(), p.data() + k, payload);
+    encode_ns = _now_ns() - start;
+  }
+
+  //failed_ may change meanwhile, the request sticks to one view of it
+  bool issued[KVS_MAX_EC_FRAGMENTS];
+  io_wave wave;
+  wave.pending = 0;
+  for (int i = 0; i < frags; i++) {
+    ios[i].wave = &wave;
+    ios[i].value.value = copy ? bufs : bufs + (size_t)i * slot;
+    ios[i].value.length = slot;
+    ios[i].value.actual_value_size = 0;
+    ios[i].value.offset = 0;
+    issued[i] = !failed_[_ks_of(home, i)];
+    if (issued[i]) wave.pending++;
+  }
+  for (int i = 0; i < frags; i++) {
+    if (!issued[i]) continue;
+    uint8_t ks = _ks_of(home, i);
+    kvs_result ret = kvs_store_kvp_async(ks_[ks], &ios[i].key, &ios[i].value,
+      (kvs_option_store*)opt, &ios[i], NULL, _on_frag_done);
+    if (ret != KVS_SUCCESS) _frag_done(&ios[i], ret);
+  }
+  _wait(wave);
+
+  int written = 0;
+  kvs_result error = KVS_ERR_SYS_IO;
+  uint64_t errors = 0;
+  for (int i = 0; i < frags; i++) {
+    if (!issued[i]) continue;
+    if (ios[i].result == KVS_SUCCESS) {
+      written++;
+    } else {
+      errors++;
+      error = ios[i].result;
+    }
+  }
+  kvs_free(bufs);
+  kvs_free(keys);
+
+  std::unique_lock<std::mutex> lock(lock_);
+  stats_.stores++;
+  if (copy) stats_.copied++;
+  stats_.fragment_errors += errors;
+  if (written < frags) stats_.degraded_writes++;
+  if (!copy) {
+    stats_.encode_bytes += value->length;
+    stats_.encode_ns += encode_ns;
+  }
+  return (written >= (copy ? 1 : k)) ? KVS_SUCCESS : error;
+}
+
+//a value smaller than min_value_size, or a buffer too small for a coded
+//one: the copies are tried one after the other
+kvs_result kvs_ec_set::_retrieve_copy(const kvs_key *key, uint32_t home,
+  kvs_value *value) {
+  const int m = opt_.parity_fragments;
+  uint32_t slot = sizeof(frag_header) + ((value->length + 3) & ~3u);
+  char *buf = (char*)kvs_malloc(slot, 4096);
+  char *keys = (char*)kvs_malloc((m + 1) * (key->length + 1), 4096);
+  if (buf == NULL || keys == NULL) {
+    if (buf) kvs_free(buf);
+    if (keys) kvs_free(keys);
+    return KVS_ERR_SYS_IO;
+  }
+  std::vector<frag_io> ios(m + 1);
+  _make_keys(key, keys, ios);
+
+  kvs_result ret = KVS_ERR_KEY_NOT_EXIST;
+  bool io_error = false;
+  uint64_t errors = 0;
+  kvs_option_retrieve option = { false };
+  for (int i = 0; i <= m; i++) {
+    uint8_t ks = _ks_of(home, i);
+    if (failed_[ks]) {
+      io_error = true;
+      continue;
+    }
+    frag_io &io = ios[i];
+    io.value.value = buf;
+    io.value.length = slot;
+    io.value.actual_value_size = 0;
+    io.value.offset = 0;
+    io.result = kvs_retrieve_kvp(ks_[ks], &io.key, &option, &io.value);
+    frag_header hdr;
+    if (!_valid(io, &hdr)) {
+      if (io.result != KVS_ERR_KEY_NOT_EXIST) {
+        errors++;
+        io_error = true;
+      }
+      continue;
+    }
+    if (hdr.kind != FRAG_COPY || hdr.value_len > value->length) {
+      value->actual_value_size = hdr.value_len;
+      ret = KVS_ERR_BUFFER_SMALL;
+    } else {
+      memcpy(value->value, buf + sizeof(hdr), hdr.value_len);
+      value->length = hdr.value_len;
+      value->actual_value_size = hdr.value_len;
+      ret = KVS_SUCCESS;
+    }
+    io_error = false;
+    break;
+  }
+  kvs_free(buf);
+  kvs_free(keys);
+
+  std::unique_lock<std::mutex> lock(lock_);
+  stats_.retrieves++;
+  stats_.fragment_errors += errors;
+  //nothing found, but a copy may sit on a Key Space that could not be read
+  if (ret == KVS_ERR_KEY_NOT_EXIST && io_error) ret = KVS_ERR_SYS_IO;
+  return ret;
+}
+
+kvs_result kvs_ec_set::retrieve(const kvs_key *key, kvs_value *value) {
+  const int k = opt_.data_fragments, m = opt_.parity_fragments;
+  uint32_t home = _home(key);
+  if (value->length < opt_.min_value_size)
+    return _retrieve_copy(key, home, value);
+
+  //slots are large enough for any fragment of a value that fits the
+  //caller's buffer, and for a copy
+  uint32_t copy_len = (std::min(value->length, opt_.min_value_size) + 3) & ~3u;
+  uint32_t payload = std::max(_frag_len(value->length), copy_len);
+  uint32_t slot = sizeof(frag_header) + payload;
+  char *bufs = (char*)kvs_malloc((size_t)slot * (k + m), 4096);
+  char *keys = (char*)kvs_malloc((k + m) * (key->length + 1), 4096);
+  if (bufs == NULL || keys == NULL) {
+    if (bufs) kvs_free(bufs);
+    if (keys) kvs_free(keys);
+    return KVS_ERR_SYS_IO;
+  }
+  std::vector<frag_io> ios(k + m);
+  _make_keys(key, keys, ios);
+  bool issued[KVS_MAX_EC_FRAGMENTS] = { false };
+
+  kvs_option_retrieve option = { false };
+  kvs_result ret = KVS_ERR_SYS_IO;
+  bool done = false, degraded = false, unreadable = false;
+  uint64_t errors = 0, decode_ns = 0, decode_bytes = 0;
+  //first wave: the data fragments, second wave: all parity fragments
+  for (int wave_no = 0; wave_no < 2 && !done; wave_no++) {
+    io_wave wave;
+    wave.pending = 0;
+    int first = wave_no ? k : 0, last = wave_no ? k + m : k;
+    for (int i = first; i < last; i++) {
+      ios[i].wave = &wave;
+      ios[i].value.value = bufs + (size_t)i * slot;
+      ios[i].value.length = slot;
+      ios[i].value.actual_value_size = 0;
+      ios[i].value.offset = 0;
+      issued[i] = !failed_[_ks_of(home, i)];
+      if (issued[i]) wave.pending++;
+      else unreadable = true;
+    }
+    for (int i = first; i < last; i++) {
+      if (!issued[i]) continue;
+      kvs_result r = kvs_retrieve_kvp_async(ks_[_ks_of(home, i)], &ios[i].key,
+        &option, &ios[i], NULL, &ios[i].value, _on_frag_done);
+      if (r != KVS_SUCCESS) _frag_done(&ios[i], r);
+    }
+    _wait(wave);
+
+    //a copy answers by itself, coded fragments have to agree on the stamp
+    std::map<uint32_t, int> stamps;
+    std::vector<frag_header> hdrs(k + m);
+    bool found = false;
+    for (int i = 0; i < last && !done; i++) {
+      if (!issued[i]) continue;
+      if (!_valid(ios[i], &hdrs[i])) {
+        if (i >= first && ios[i].result != KVS_ERR_KEY_NOT_EXIST) {
+          errors++;
+          unreadable = true;
+        }
+        continue;
+      }
+      found = true;
+      if (hdrs[i].value_len > value->length) {
+        value->actual_value_size = hdrs[i].value_len;
+        ret = KVS_ERR_BUFFER_SMALL;
+        done = true;
+      } else if (hdrs[i].kind == FRAG_COPY && ios[i].result == KVS_SUCCESS) {
+        memcpy(value->value, (char*)ios[i].value.value + sizeof(frag_header), hdrs[i].value_len);
+        value->length = hdrs[i].value_len;
+        value->actual_value_size = hdrs[i].value_len;
+        ret = KVS_SUCCESS;
+        done = true;
+      } else if (hdrs[i].kind == FRAG_CODED && hdrs[i].index == i &&
+                 hdrs[i].k == k && hdrs[i].m == m && ios[i].result == KVS_SUCCESS) {
+        stamps[hdrs[i].stamp]++;
+      }
+    }
+    if (done) break;
+    if (!found) {
+      //every data fragment is known to be missing, the key does not exist
+      ret = unreadable ? KVS_ERR_SYS_IO : KVS_ERR_KEY_NOT_EXIST;
+      if (!unreadable) break;
+      continue;
+    }
+
+    uint32_t stamp = 0;
+    int best = 0;
+    for (auto &s : stamps) {
+      if (s.second > best) {
+        best = s.second;
+        stamp = s.first;
+      }
+    }
+    bool present[KVS_MAX_EC_FRAGMENTS];
+    int have = 0, data_have = 0;
+    uint32_t value_len = 0;
+    for (int i = 0; i < k + m; i++) {
+      present[i] = issued[i] && i < last && _valid(ios[i], &hdrs[i]) &&
+        hdrs[i].kind == FRAG_CODED && hdrs[i].index == i && hdrs[i].stamp == stamp &&
+        ios[i].result == KVS_SUCCESS;
+      if (!present[i]) continue;
+      have++;
+      if (i < k) data_have++;
+      value_len = hdrs[i].value_len;
+    }
+    if (have < k) {
+      ret = KVS_ERR_SYS_IO;
+      continue;
+    }
+
+    uint32_t frag_len = _frag_len(value_len);
+    if (data_have < k) {
+      std::vector<uint8_t*> p(k + m);
+      for (int i = 0; i < k + m; i++)
+        p[i] = (uint8_t*)ios[i].value.value + sizeof(frag_header);
+      uint64_t start = _now_ns();
+      bool decoded = codec_.decode(p.data(), present, frag_len);
+      decode_ns += _now_ns() - start;
+      if (!decoded) {
+        ret = KVS_ERR_SYS_IO;
+        continue;
+      }
+      decode_bytes += (uint64_t)(k - data_have) * frag_len;
+      degraded = true;
+    }
+    for (int i = 0; i < k; i++) {
+      uint32_t off = i * frag_len;
+      if (off >= value_len) break;
+      memcpy((char*)value->value + off, (char*)ios[i].value.value + sizeof(frag_header),
+             std::min(frag_len, value_len - off));
+    }
+    value->length = value_len;
+    value->actual_value_size = value_len;
+    ret = KVS_SUCCESS;
+    done = true;
+  }
+  kvs_free(bufs);
+  kvs_free(keys);
+
+  std::unique_lock<std::mutex> lock(lock_);
+  stats_.retrieves++;
+  stats_.fragment_errors += errors;
+  if (degraded) stats_.degraded_reads++;
+  stats_.decode_ns += decode_ns;
+  stats_.decode_bytes += decode_bytes;
+  return ret;
+}
+
+kvs_result kvs_ec_set::remove(const kvs_key *key, const kvs_option_delete *opt) {
+  const int frags = opt_.data_fragments + opt_.parity_fragments;
+  uint32_t home = _home(key);
+  char *keys = (char*)kvs_malloc(frags * (key->length + 1), 4096);
+  if (keys == NULL) return KVS_ERR_SYS_IO;
+  std::vector<frag_io> ios(frags);
+  _make_keys(key, keys, ios);
+
+  //a missing fragment is not an error, but has to be told apart
+  kvs_option_delete option = { true };
+  bool issued[KVS_MAX_EC_FRAGMENTS];
+  io_wave wave;
+  wave.pending = 0;
+  for (int i = 0; i < frags; i++) {
+    ios[i].wave = &wave;
+    issued[i] = !failed_[_ks_of(home, i)];
+    if (issued[i]) wave.pending++;
+  }
+  for (int i = 0; i < frags; i++) {
+    if (!issued[i]) continue;
+    uint8_t ks = _ks_of(home, i);
+    kvs_result r = kvs_delete_kvp_async(ks_[ks], &ios[i].key, &option, &ios[i],
+      NULL, _on_frag_done);
+    if (r != KVS_SUCCESS) _frag_done(&ios[i], r);
+  }
+  _wait(wave);
+  kvs_free(keys);
+
+  int deleted = 0;
+  uint64_t errors = 0;
+  for (int i = 0; i < frags; i++) {
+    if (!issued[i]) continue;
+    if (ios[i].result == KVS_SUCCESS) deleted++;
+    else if (ios[i].result != KVS_ERR_KEY_NOT_EXIST) errors++;
+  }
+  std::unique_lock<std::mutex> lock(lock_);
+  stats_.fragment_errors += errors;
+  if (errors) return KVS_ERR_SYS_IO;
+  if (deleted == 0 && opt->kvs_delete_error) return KVS_ERR_KEY_NOT_EXIST;
+  return KVS_SUCCESS;
+}
@@ -0,0 +1,227 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "kvs_hot_keys.h"
+
+kvs_hot_keys::kvs_hot_keys(const kvs_option_hot_keys &opt) : opt_(opt) {
+  if (opt_.sample_rate == 0) opt_.sample_rate = 1;
+  if (opt_.depth == 0) opt_.depth = 4;
+  uint32_t width = 1;
+  while (width < (opt_.width ? opt_.width : 4096)) width <<= 1;
+  opt_.width = width;
+  mask_ = width - 1;
+
+  cells_ = std::vector<cell>((size_t)opt_.depth * width);
+  for (auto &c : cells_) {
+    for (int i = 0; i < NORDERS; i++) c.n[i].store(0, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < NORDERS; i++) {
+    threshold_[i].store(0, std::memory_order_relaxed);
+    top_[i].reserve(opt_.top_k);
+  }
+  start_ = std::chrono::steady_clock::now();
+  decay_at_ms_.store(opt_.decay_ms, std::memory_order_relaxed);
+  countdown_.store(1, std::memory_order_relaxed);
+  rnd_.store(((uintptr_t)this * 0x9E3779B97F4A7C15ULL) | 1, std::memory_order_relaxed);
+}
+
+bool kvs_hot_keys::_sampled() {
+  if (opt_.sample_rate <= 1) return true;
+  //only the request taking the counter from 1 samples and resets it; the
+  //ones counting below 0 meanwhile are skipped
+  if (countdown_.fetch_sub(1, std::memory_order_relaxed) != 1) return false;
+  uint64_t rnd = rnd_.load(std::memory_order_relaxed);
+  rnd ^= rnd << 13;
+  rnd ^= rnd >> 7;
+  rnd ^= rnd << 17;
+  rnd_.store(rnd, std::memory_order_relaxed);
+  //1 .. 2 * rate - 1, so every rate-th request is counted on average
+  countdown_.store(1 + rnd % (2 * opt_.sample_rate - 1), std::memory_order_relaxed);
+  return true;
+}
+
+static uint64_t _mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint64_t kvs_hot_keys::_hash(const void *key, uint32_t len) {
+  const uint8_t *p = (const uint8_t *)key;
+  uint64_t h = len * 0x9E3779B97F4A7C15ULL;
+  uint32_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    memcpy(&v, p + i, 8);
+    h = (h ^ _mix(v)) * 0x9E3779B97F4A7C15ULL;
+  }
+  if (i < len) {
+    uint64_t v = 0;
+    memcpy(&v, p + i, len - i);
+    h = (h ^ _mix(v)) * 0x9E3779B97F4A7C15ULL;
+  }
+  return _mix(h);
+}
+
+//double hashing, row r probes hash + r * step
+uint64_t kvs_hot_keys::_index(uint64_t hash, uint32_t row) const {
+  uint64_t step = (hash >> 32) | 1;
+  return (uint64_t)row * opt_.width + ((hash + row * step) & mask_);
+}
+
+void kvs_hot_keys::_record(int op, const kvs_key *key, uint64_t bytes) {
+  uint64_t hash = _hash(key->key, key->length);
+  uint64_t est_op = UINT64_MAX, est_bytes = UINT64_MAX;
+
+  for (uint32_t row = 0; row < opt_.depth; row++) {
+    cell &c = cells_[_index(hash, row)];
+    est_op = std::min(est_op, c.n[op].fetch_add(1, std::memory_order_relaxed) + 1);
+    if (bytes)
+      est_bytes = std::min(est_bytes, c.n[KVS_HOT_KEYS_BYTES].fetch_add(bytes,
+                           std::memory_order_relaxed) + bytes);
+  }
+
+  if (opt_.decay_ms) {
+    uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_).count();
+    if (now_ms >= decay_at_ms_.load(std::memory_order_relaxed)) _decay(now_ms);
+  }
+
+  bool hot_op = est_op > threshold_[op].load(std::memory_order_relaxed);
+  bool hot_bytes = bytes &&
+    est_bytes > threshold_[KVS_HOT_KEYS_BYTES].load(std::memory_order_relaxed);
+  if (!hot_op && !hot_bytes) return;
+
+  std::unique_lock<std::mutex> lock(lock_);
+  if (hot_op) _offer(op, key, est_op);
+  if (hot_bytes) _offer(KVS_HOT_KEYS_BYTES, key, est_bytes);
+}
+
+void kvs_hot_keys::_set_threshold(int order) {
+  std::vector<entry> &top = top_[order];
+  uint64_t min = 0;
+  if (top.size() == opt_.top_k) {
+    min = UINT64_MAX;
+    for (const auto &e : top) min = std::min(min, e.estimate);
+  }
+  threshold_[order].store(min, std::memory_order_relaxed);
+}
+
+void kvs_hot_keys::_offer(int order, const kvs_key *key, uint64_t estimate) {
+  std::vector<entry> &top = top_[order];
+  size_t coldest = 0;
+  for (size_t i = 0; i < top.size(); i++) {
+    if (top[i].key.size() == key->length &&
+        memcmp(top[i].key.data(), key->key, key->length) == 0) {
+      top[i].estimate = estimate;
+      _set_threshold(order);
+      return;
+    }
+    if (top[i].estimate < top[coldest].estimate) coldest = i;
+  }
+
+  if (top.size() < opt_.top_k) {
+    top.push_back(entry());
+    coldest = top.size() - 1;
+  } else if (estimate <= top[coldest].estimate) {
+    return;
+  }
+  top[coldest].key.assign((const char *)key->key, key->length);
+  top[coldest].estimate = estimate;
+  _set_threshold(order);
+}
+
+void kvs_hot_keys::_decay(uint64_t now_ms) {
+  uint64_t at = decay_at_ms_.load(std::memory_order_relaxed);
+  //one thread halves the counts, the others go on
+  if (now_ms < at || !decay_at_ms_.compare_exchange_strong(at, now_ms + opt_.decay_ms))
+    return;
+
+  for (auto &c : cells_) {
+    for (int i = 0; i < NORDERS; i++) {
+      uint64_t v = c.n[i].load(std::memory_order_relaxed);
+      if (v) c.n[i].fetch_sub(v / 2, std::memory_order_relaxed);
+    }
+  }
+  std::unique_lock<std::mutex> lock(lock_);
+  for (int i = 0; i < NORDERS; i++) {
+    for (auto &e : top_[i]) e.estimate /= 2;
+    _set_threshold(i);
+  }
+}
+
+void kvs_hot_keys::_estimate(uint64_t hash, uint64_t est[]) {
+  for (int i = 0; i < NORDERS; i++) est[i] = UINT64_MAX;
+  for (uint32_t row = 0; row < opt_.depth; row++) {
+    cell &c = cells_[_index(hash, row)];
+    for (int i = 0; i < NORDERS; i++)
+      est[i] = std::min(est[i], c.n[i].load(std::memory_order_relaxed));
+  }
+}
+
+uint32_t kvs_hot_keys::get(kvs_hot_keys_order order, kvs_hot_key *keys, uint32_t count) {
+  struct ranked {
+    std::string key;
+    uint64_t est[NORDERS];
+  };
+  std::vector<ranked> list;
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    list.resize(top_[order].size());
+    for (size_t i = 0; i < list.size(); i++) {
+      const std::string &key = top_[order][i].key;
+      list[i].key = key;
+      _estimate(_hash(key.data(), key.size()), list[i].est);
+    }
+  }
+  std::sort(list.begin(), list.end(), [order](const ranked &a, const ranked &b) {
+    return a.est[order] > b.est[order];
+  });
+
+  uint32_t n = std::min<size_t>(count, list.size());
+  for (uint32_t i = 0; i < n; i++) {
+    const ranked &r = list[i];
+    memset(&keys[i], 0, sizeof(keys[i]));
+    keys[i].key_len = r.key.size();
+    memcpy(keys[i].key, r.key.data(), std::min<size_t>(r.key.size(), KVS_MAX_KEY_LENGTH));
+    keys[i].reads = r.est[KVS_HOT_KEYS_READS] * opt_.sample_rate;
+    keys[i].writes = r.est[KVS_HOT_KEYS_WRITES] * opt_.sample_rate;
+    keys[i].bytes = r.est[KVS_HOT_KEYS_BYTES] * opt_.sample_rate;
+  }
+  return n;
+}
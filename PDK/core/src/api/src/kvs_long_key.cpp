@@ -0,0 +1,401 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "kvs_utils.h"
+#include "private_types.h"
+#include "kvs_long_key.h"
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t _rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void _sha256_block(uint32_t *h, const uint8_t *p) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+           (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = _rotr(w[i - 15], 7) ^ _rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = _rotr(w[i - 2], 17) ^ _rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = k + (_rotr(e, 6) ^ _rotr(e, 11) ^ _rotr(e, 25)) +
+                  ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+    uint32_t t2 = (_rotr(a, 2) ^ _rotr(a, 13) ^ _rotr(a, 22)) +
+                  ((a & b) ^ (a & c) ^ (b & c));
+    k = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+  h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+void kvs_sha256(const void *data, size_t len, uint8_t *digest) {
+  uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+  const uint8_t *p = (const uint8_t*)data;
+  size_t n = len;
+  for (; n >= 64; p += 64, n -= 64) _sha256_block(h, p);
+
+  // the tail, a 1 bit and the message length in bits fill one or two blocks
+  uint8_t tail[128];
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, p, n);
+  tail[n] = 0x80;
+  size_t tail_len = n < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)len * 8;
+  for (int i = 0; i < 8; i++) tail[tail_len - 1 - i] = (uint8_t)(bits >> (8 * i));
+  _sha256_block(h, tail);
+  if (tail_len == 128) _sha256_block(h, tail + 64);
+
+  for (int i = 0; i < 8; i++) {
+    digest[4 * i] = (uint8_t)(h[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(h[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(h[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)h[i];
+  }
+}
+
+kvs_long_key_io::kvs_long_key_io()
+  : user_key_(NULL), user_(NULL), private1_(NULL), private2_(NULL), post_fn_(NULL) {
+  memset(&key_, 0, sizeof(key_));
+  memset(&stored_, 0, sizeof(stored_));
+}
+
+kvs_long_key_io::~kvs_long_key_io() {
+  for (void *buf : buffers_) kvs_free(buf);
+}
+
+void *kvs_long_key_io::_alloc(uint32_t len) {
+  void *buf = kvs_malloc(std::max(len, 4u), 4096);
+  if (buf) buffers_.push_back(buf);
+  return buf;
+}
+
+void kvs_long_key_io::make_digest_key(const kvs_key *key, uint8_t *dst) {
+  memcpy(dst, key->key, PREFIX);
+  kvs_sha256(key->key, key->length, dst + PREFIX);
+}
+
+bool kvs_long_key_io::parse(const char *stored, uint32_t len, const char **key,
+  uint16_t *key_len) {
+  uint32_t magic;
+  uint16_t klen;
+  if (len < HDR) return false;
+  memcpy(&magic, stored, sizeof(magic));
+  memcpy(&klen, stored + sizeof(magic), sizeof(klen));
+  if (magic != MAGIC || klen < KVS_MAX_KEY_LENGTH || HDR + klen > len) return false;
+  *key = stored + HDR;
+  *key_len = klen;
+  return true;
+}
+
+kvs_result kvs_long_key_io::_check_key(const kvs_key *key) {
+  if (key->key == NULL) return KVS_ERR_PARAM_INVALID;
+  if (key->length > KVS_MAX_LONG_KEY_LENGTH) return KVS_ERR_KEY_LENGTH_INVALID;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_long_key_io::_pack(const kvs_key *key, const kvs_value *value,
+  kvs_value *dst) {
+  uint64_t len = (uint64_t)HDR + key->length + value->length;
+  if (len > KVS_MAX_VALUE_LENGTH) return KVS_ERR_VALUE_LENGTH_INVALID;
+  char *buf = (char*)_alloc(len);
+  if (buf == NULL) return KVS_ERR_SYS_IO;
+  uint32_t magic = MAGIC;
+  uint16_t klen = key->length, pad = 0;
+  memcpy(buf, &magic, sizeof(magic));
+  memcpy(buf + 4, &klen, sizeof(klen));
+  memcpy(buf + 6, &pad, sizeof(pad));
+  memcpy(buf + HDR, key->key, key->length);
+  memcpy(buf + HDR + key->length, value->value, value->length);
+  *dst = *value;
+  dst->value = buf;
+  dst->length = len;
+  dst->offset = 0;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_long_key_io::prepare_key(kvs_key *key) {
+  kvs_result ret = _check_key(key);
+  if (ret != KVS_SUCCESS) return ret;
+  make_digest_key(key, digest_);
+  key_.key = digest_;
+  key_.length = KVS_MAX_KEY_LENGTH;
+  user_key_ = key;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_long_key_io::prepare_store(kvs_key *key, kvs_value *value) {
+  kvs_result ret = prepare_key(key);
+  if (ret != KVS_SUCCESS) return ret;
+  user_ = value;
+  return _pack(key, value, &stored_);
+}
+
+kvs_result kvs_long_key_io::prepare_retrieve(kvs_key *key, kvs_value *value) {
+  kvs_result ret = prepare_key(key);
+  if (ret != KVS_SUCCESS) return ret;
+  // the key comes first, so the read starts at 0 and covers it, everything
+  // up to the offset and the requested range
+  uint64_t len = (uint64_t)HDR + key->length + value->offset + value->length;
+  len = std::min<uint64_t>((len + 3) & ~3ULL, KVS_MAX_VALUE_LENGTH);
+  void *buf = _alloc(len);
+  if (buf == NULL) return KVS_ERR_SYS_IO;
+  user_ = value;
+  stored_.value = buf;
+  stored_.length = len;
+  stored_.offset = 0;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_long_key_io::prepare_keys(kvs_key *keys, uint32_t key_cnt) {
+  keys_.assign(keys, keys + key_cnt);
+  digests_.resize((size_t)key_cnt * KVS_MAX_KEY_LENGTH);
+  for (uint32_t i = 0; i < key_cnt; i++) {
+    if (!is_long(&keys[i])) continue;
+    kvs_result ret = _check_key(&keys[i]);
+    if (ret != KVS_SUCCESS) return ret;
+    keys_[i].key = &digests_[(size_t)i * KVS_MAX_KEY_LENGTH];
+    keys_[i].length = KVS_MAX_KEY_LENGTH;
+    make_digest_key(&keys[i], (uint8_t*)keys_[i].key);
+  }
+  user_key_ = keys;
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_long_key_io::prepare_batch(kvs_batch_op *ops, uint32_t op_cnt) {
+  ops_.assign(ops, ops + op_cnt);
+  values_.resize(op_cnt);
+  keys_.resize(op_cnt);
+  digests_.resize((size_t)op_cnt * KVS_MAX_KEY_LENGTH);
+  for (uint32_t i = 0; i < op_cnt; i++) {
+    if (!is_long(ops[i].key)) continue;
+    kvs_result ret = _check_key(ops[i].key);
+    if (ret != KVS_SUCCESS) return ret;
+    keys_[i].key = &digests_[(size_t)i * KVS_MAX_KEY_LENGTH];
+    keys_[i].length = KVS_MAX_KEY_LENGTH;
+    make_digest_key(ops[i].key, (uint8_t*)keys_[i].key);
+    ops_[i].key = &keys_[i];
+    if (ops[i].type != KVS_BATCH_STORE) continue;
+    ret = _pack(ops[i].key, ops[i].value, &values_[i]);
+    if (ret != KVS_SUCCESS) return ret;
+    ops_[i].value = &values_[i];
+  }
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_long_key_io::complete_retrieve(kvs_result result) {
+  if (result != KVS_SUCCESS && result != KVS_ERR_BUFFER_SMALL) return result;
+  const char *src = (const char*)stored_.value;
+  uint32_t got = std::min(stored_.length, stored_.actual_value_size);
+  const char *key;
+  uint16_t key_len;
+  // another key with the same digest key is not the one asked for
+  if (!parse(src, got, &key, &key_len) || key_len != user_key_->length ||
+      memcmp(key, user_key_->key, key_len) != 0)
+    return KVS_ERR_KEY_NOT_EXIST;
+
+  uint32_t skip = HDR + key_len;
+  uint32_t total = stored_.actual_value_size - skip;
+  if (user_->offset != 0 && user_->offset >= total) return KVS_ERR_VALUE_OFFSET_INVALID;
+  uint32_t avail = got - skip > user_->offset ? got - skip - user_->offset : 0;
+  uint32_t want = std::min(std::min(user_->length, total - user_->offset), avail);
+  memcpy(user_->value, src + skip + user_->offset, want);
+  user_->length = want;
+  user_->actual_value_size = total - user_->offset;
+  return want < user_->actual_value_size ? KVS_ERR_BUFFER_SMALL : KVS_SUCCESS;
+}
+
+void kvs_long_key_io::set_callback(void *private1, void *private2,
+  kvs_postprocess_function post_fn) {
+  private1_ = private1;
+  private2_ = private2;
+  post_fn_ = post_fn;
+}
+
+void kvs_long_key_io::on_done(kvs_postprocess_context *ctx) {
+  kvs_long_key_io *io = (kvs_long_key_io*)ctx->private1;
+  if (ctx->context == KVS_CMD_RETRIEVE)
+    ctx->result = io->complete_retrieve(ctx->result);
+  if (io->user_key_) ctx->key = io->user_key_;
+  if (io->user_) ctx->value = io->user_;
+  ctx->private1 = io->private1_;
+  ctx->private2 = io->private2_;
+  io->post_fn_(ctx);
+  delete io;
+}
+
+void kvs_long_keys::open_iterator(kvs_iterator_handle iter_hd, kvs_iterator_type type) {
+  std::unique_lock<std::mutex> lock(lock_);
+  iter_state &st = iters_[iter_hd];
+  st.type = type;
+  st.device_end = false;
+  st.pending.clear();
+}
+
+void kvs_long_keys::close_iterator(kvs_iterator_handle iter_hd) {
+  std::unique_lock<std::mutex> lock(lock_);
+  iters_.erase(iter_hd);
+}
+
+//reads the original key stored with the value of a digest key,
+//KVS_ERR_KEY_NOT_EXIST if the pair is gone
+kvs_result kvs_long_keys::_original_key(const uint8_t *digest, std::string *key) {
+  const uint32_t len = (kvs_long_key_io::HDR + KVS_MAX_LONG_KEY_LENGTH + 3) & ~3u;
+  char *buf = (char*)kvs_malloc(len, 4096);
+  if (buf == NULL) return KVS_ERR_SYS_IO;
+  kvs_key dkey = { (void*)digest, KVS_MAX_KEY_LENGTH };
+  kvs_value value = { buf, len, 0, 0 };
+  kvs_option_retrieve opt = { false };
+  kvs_result ret = _kvs_retrieve_kvp(ks_hd_, &dkey, &opt, &value);
+  const char *k;
+  uint16_t klen;
+  if ((ret == KVS_SUCCESS || ret == KVS_ERR_BUFFER_SMALL) &&
+      kvs_long_key_io::parse(buf, std::min(len, value.actual_value_size), &k, &klen))
+    key->assign(k, klen);
+  kvs_free(buf);
+  return ret == KVS_ERR_KEY_NOT_EXIST ? ret : KVS_SUCCESS;
+}
+
+//reads the next part of the device list and queues its entries with the
+//original keys
+kvs_result kvs_long_keys::_fill(iter_state *st, kvs_iterator_handle iter_hd) {
+  kvs_iterator_list raw;
+  raw.num_entries = 0;
+  raw.end = false;
+  raw.size = KVS_ITERATOR_BUFFER_SIZE;
+  raw.it_list = (uint8_t*)kvs_malloc(raw.size, 4096);
+  if (raw.it_list == NULL) return KVS_ERR_SYS_IO;
+  kvs_result ret = (kvs_result)ks_hd_->dev->driver->iterator_next(ks_hd_, iter_hd,
+    &raw, NULL, NULL, 1, 0);
+  if (ret != KVS_SUCCESS) {
+    kvs_free(raw.it_list);
+    return ret;
+  }
+
+  const bool with_value = st->type == KVS_ITERATOR_KEY_VALUE;
+  const uint8_t *p = raw.it_list;
+  for (uint32_t i = 0; i < raw.num_entries; i++) {
+    uint32_t klen, vlen = 0;
+    memcpy(&klen, p, sizeof(klen));
+    std::string key((const char*)p + sizeof(klen), klen);
+    p += sizeof(klen) + klen;
+    const char *value = NULL;
+    if (with_value) {
+      memcpy(&vlen, p, sizeof(vlen));
+      value = (const char*)p + sizeof(vlen);
+      p += sizeof(vlen) + vlen;
+    }
+    if (klen == KVS_MAX_KEY_LENGTH) {
+      const char *k;
+      uint16_t kl;
+      if (!with_value) {
+        ret = _original_key((const uint8_t*)key.data(), &key);
+        if (ret == KVS_ERR_KEY_NOT_EXIST) continue;
+        if (ret != KVS_SUCCESS) {
+          kvs_free(raw.it_list);
+          return ret;
+        }
+      } else if (kvs_long_key_io::parse(value, vlen, &k, &kl)) {
+        key.assign(k, kl);
+        value += kvs_long_key_io::HDR + kl;
+        vlen -= kvs_long_key_io::HDR + kl;
+      }
+    }
+    std::string entry;
+    uint32_t len = key.size();
+    entry.append((const char*)&len, sizeof(len));
+    entry.append(key);
+    if (with_value) {
+      entry.append((const char*)&vlen, sizeof(vlen));
+      entry.append(value, vlen);
+    }
+    st->pending.push_back(entry);
+  }
+  st->device_end = raw.end;
+  kvs_free(raw.it_list);
+  return KVS_SUCCESS;
+}
+
+kvs_result kvs_long_keys::iterate_next(kvs_iterator_handle iter_hd,
+  kvs_iterator_list *iter_list) {
+  std::unique_lock<std::mutex> lock(lock_);
+  auto it = iters_.find(iter_hd);
+  if (it == iters_.end()) {
+    //opened before long keys were enabled
+    it = iters_.insert(std::make_pair(iter_hd, iter_state())).first;
+    it->second.type = KVS_ITERATOR_KEY;
+    it->second.device_end = false;
+  }
+  iter_state *st = &it->second;
+  lock.unlock();
+
+  if (st->pending.empty() && !st->device_end) {
+    kvs_result ret = _fill(st, iter_hd);
+    if (ret != KVS_SUCCESS) return ret;
+  }
+  uint32_t pos = 0, cnt = 0;
+  while (!st->pending.empty() &&
+         pos + st->pending.front().size() <= iter_list->size) {
+    const std::string &entry = st->pending.front();
+    memcpy(iter_list->it_list + pos, entry.data(), entry.size());
+    pos += entry.size();
+    cnt++;
+    st->pending.pop_front();
+  }
+  //the buffer size is fixed, so an entry larger than all of it is dropped
+  //and reported rather than returned again on every call
+  if (cnt == 0 && !st->pending.empty()) {
+    st->pending.pop_front();
+    return KVS_ERR_BUFFER_SMALL;
+  }
+  iter_list->num_entries = cnt;
+  iter_list->size = pos;
+  iter_list->end = st->device_end && st->pending.empty();
+  return KVS_SUCCESS;
+}
@@ -0,0 +1,547 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "private_types.h"
+#include "kvs_read_ahead.h"
+
+kvs_read_ahead::kvs_read_ahead(kvs_key_space_handle ks_hd,
+  const kvs_option_read_ahead &opt)
+  : ks_hd_(ks_hd), opt_(opt), versions_(new std::atomic<uint32_t>[NVERSIONS]),
+    epoch_(0), cancel_(true), clock_(0), inflight_(0), stop_(false) {
+  if (opt_.streams == 0) opt_.streams = 16;
+  if (opt_.depth == 0) opt_.depth = 8;
+  if (opt_.value_size == 0) opt_.value_size = 4096;
+  if (opt_.max_stride == 0) opt_.max_stride = 64;
+  if (opt_.min_accuracy == 0) opt_.min_accuracy = 50;
+  for (uint32_t i = 0; i < NVERSIONS; i++)
+    versions_[i].store(0, std::memory_order_relaxed);
+  memset(&stats_, 0, sizeof(stats_));
+
+  streams_.resize(opt_.streams);
+  for (auto &s : streams_) {
+    s.kind = 0;
+    s.lru = 0;
+    s.slots.reserve(opt_.depth);
+  }
+  slots_.resize((size_t)opt_.streams * opt_.depth);
+  for (auto &sl : slots_) {
+    sl.owner = this;
+    sl.st = NULL;
+    sl.state = FREE;
+    sl.buf = (char*)kvs_malloc(opt_.value_size, PAGE_ALIGN);
+    free_.push_back(&sl);
+  }
+  resubmitter_ = std::thread(&kvs_read_ahead::_resubmitter, this);
+}
+
+kvs_read_ahead::~kvs_read_ahead() {
+  std::vector<slot*> cancel;
+  std::unique_lock<std::mutex> lock(lock_);
+  for (auto &s : streams_) _reset(&s, cancel);
+  lock.unlock();
+  _cancel(cancel);
+
+  lock.lock();
+  while (inflight_ || !resubmits_.empty()) done_cond_.wait(lock);
+  stop_ = true;
+  resubmit_cond_.notify_one();
+  lock.unlock();
+  resubmitter_.join();
+  for (auto &sl : slots_) kvs_free(sl.buf);
+}
+
+uint64_t kvs_read_ahead::_hash(const void *p, uint32_t len, uint64_t h) {
+  const uint8_t *b = (const uint8_t *)p;
+  h ^= 0xcbf29ce484222325ULL;
+  for (uint32_t i = 0; i < len; i++) {
+    h ^= b[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint32_t kvs_read_ahead::_bucket(const void *key, uint32_t len) const {
+  const uint64_t h = _hash(key, len, 0);
+  return (uint32_t)(h ^ (h >> 32)) & (NVERSIONS - 1);
+}
+
+bool kvs_read_ahead::_parse(const kvs_key *key, key_number *num) {
+  const uint8_t *k = (const uint8_t *)key->key;
+  const uint32_t len = key->length;
+  if (k == NULL || len == 0) return false;
+
+  //keygen_seqfill style keys end in a NUL
+  uint32_t end = len;
+  while (end > 0 && k[end - 1] == 0) end--;
+  uint32_t pos = end;
+  while (pos > 0 && k[pos - 1] >= '0' && k[pos - 1] <= '9') pos--;
+  if (pos < end) {
+    //longer numbers may not fit, their leading digits count as key bytes
+    const bool cut = end - pos > 18;
+    if (cut) pos = end - 18;
+    num->format = (cut || (k[pos] == '0' && end - pos > 1)) ? DECIMAL_PADDED : DECIMAL;
+    num->pos = pos;
+    num->width = end - pos;
+    num->n = 0;
+    for (uint32_t i = pos; i < end; i++) num->n = num->n * 10 + (k[i] - '0');
+  } else {
+    num->format = BINARY;
+    num->width = len < 8 ? len : 8;
+    num->pos = len - num->width;
+    num->n = 0;
+    for (uint32_t i = num->pos; i < len; i++) num->n = (num->n << 8) | k[i];
+  }
+  //the width of an unpadded number may change within a stream
+  const uint64_t seed = ((uint64_t)num->pos << 32) | ((uint64_t)num->format << 16) |
+                        (num->format == DECIMAL ? 0 : num->width);
+  const uint32_t tail = num->pos + num->width;
+  num->kind = _hash(k + tail, len - tail, _hash(k, num->pos, seed));
+  return true;
+}
+
+bool kvs_read_ahead::_render(const stream *s, uint64_t n, std::string *key) const {
+  char field[24];
+  uint32_t len;
+  if (s->format == DECIMAL) {
+    len = snprintf(field, sizeof(field), "%llu", (unsigned long long)n);
+  } else if (s->format == DECIMAL_PADDED) {
+    len = snprintf(field, sizeof(field), "%0*llu", (int)s->width, (unsigned long long)n);
+    if (len != s->width) return false;
+  } else {
+    if (s->width < 8 && (n >> (8 * s->width)) != 0) return false;
+    len = s->width;
+    for (uint32_t i = 0; i < len; i++) field[i] = (char)(n >> (8 * (len - 1 - i)));
+  }
+  key->assign(s->prefix);
+  key->append(field, len);
+  key->append(s->suffix);
+  return key->size() >= KVS_MIN_KEY_LENGTH && key->size() <= KVS_MAX_KEY_LENGTH;
+}
+
+void kvs_read_ahead::written(const kvs_key *key) {
+  if (key == NULL) epoch_.fetch_add(1);
+  else versions_[_bucket(key->key, key->length)].fetch_add(1);
+}
+
+void kvs_read_ahead::completed(const kvs_postprocess_context *iocb,
+  kvs_postprocess_function post_fn) {
+  if (post_fn == _on_done) return;
+  switch (iocb->context) {
+  case KVS_CMD_STORE:
+  case KVS_CMD_DELETE:
+  //a retrieve may have deleted the pair (kvs_option_retrieve.kvs_retrieve_delete)
+  case KVS_CMD_RETRIEVE:
+    written(iocb->key);
+    break;
+  case KVS_CMD_WRITE_BATCH:
+  case KVS_CMD_DELETE_GROUP:
+    written(NULL);
+    break;
+  default:
+    break;
+  }
+}
+
+bool kvs_read_ahead::_current(const slot *sl) const {
+  return versions_[sl->bucket].load() == sl->version && epoch_.load() == sl->epoch;
+}
+
+bool kvs_read_ahead::_fits(const slot *sl, const kvs_value *value) const {
+  if (sl->result == KVS_ERR_KEY_NOT_EXIST) return true;
+  return sl->result == KVS_SUCCESS && sl->size <= value->length;
+}
+
+void kvs_read_ahead::_serve(const slot *sl, kvs_value *value, kvs_result *ret) const {
+  *ret = sl->result;
+  if (sl->result != KVS_SUCCESS) return;
+  memcpy(value->value, sl->buf, sl->size);
+  //as a retrieve from the device leaves them
+  value->length = sl->size;
+  value->actual_value_size = sl->size;
+}
+
+void kvs_read_ahead::_window(stream *s) {
+  if (s->used + s->wasted < 32) return;
+  if ((uint64_t)s->used * 100 < (uint64_t)opt_.min_accuracy * (s->used + s->wasted))
+    s->depth /= 2;
+  s->used = s->wasted = 0;
+}
+
+void kvs_read_ahead::_free(slot *sl) {
+  if (sl->st) {
+    std::vector<slot*> &v = sl->st->slots;
+    for (size_t i = 0; i < v.size(); i++) {
+      if (v[i] == sl) {
+        v[i] = v.back();
+        v.pop_back();
+        break;
+      }
+    }
+    sl->st = NULL;
+  }
+  auto it = map_.find(sl->key);
+  if (it != map_.end() && it->second == sl) map_.erase(it);
+  if (sl->state == INFLIGHT) return;
+  sl->state = FREE;
+  free_.push_back(sl);
+}
+
+void kvs_read_ahead::_used(slot *sl) {
+  stream *s = sl->st;
+  if (s) {
+    s->used++;
+    if (s->depth < opt_.depth) s->depth++;
+    _window(s);
+  }
+  _free(sl);
+}
+
+void kvs_read_ahead::_drop(slot *sl, bool invalid, std::vector<slot*> &cancel) {
+  stats_.wasted++;
+  if (invalid) stats_.invalidated++;
+  if (sl->st) {
+    sl->st->wasted++;
+    _window(sl->st);
+  }
+  //a slot in flight is forgotten now and freed by its completion
+  if (sl->state == INFLIGHT && sl->waiters.empty()) cancel.push_back(sl);
+  _free(sl);
+}
+
+void kvs_read_ahead::_reset(stream *s, std::vector<slot*> &cancel) {
+  while (!s->slots.empty()) _drop(s->slots.back(), false, cancel);
+  s->lru = 0;
+}
+
+kvs_read_ahead::stream *kvs_read_ahead::_follow(const kvs_key *key,
+  const key_number &num, std::vector<slot*> &cancel) {
+  //replaced first: unused streams, then the ones not followed yet, then any
+  auto rank = [](const stream &s) { return s.lru == 0 ? 0 : (s.confirmed < 2 ? 1 : 2); };
+  stream *victim = NULL;
+  clock_++;
+  for (auto &s : streams_) {
+    if (s.lru != 0 && s.kind == num.kind) {
+      const int64_t d = (int64_t)(num.n - s.last);
+      if (s.stride == 0) {
+        if (d != 0 && (uint64_t)llabs(d) <= opt_.max_stride) {
+          s.stride = d;
+          s.last = num.n;
+          s.next = num.n + d;
+          s.confirmed = 1;
+          s.lru = clock_;
+          return &s;
+        }
+      } else if (d % s.stride == 0) {
+        const int64_t steps = d / s.stride;
+        //a few keys on: skipped keys, or retrieves of the stream that
+        //overtook each other
+        if (steps >= 1 && steps <= 4) {
+          s.last = num.n;
+          s.confirmed++;
+          s.lru = clock_;
+          //slots left behind are of no use any more
+          for (size_t i = 0; i < s.slots.size();) {
+            slot *sl = s.slots[i];
+            if ((int64_t)(sl->n - s.last) / s.stride < -(int64_t)opt_.depth)
+              _drop(sl, false, cancel);
+            else
+              i++;
+          }
+          return &s;
+        }
+        if (steps <= 0 && steps > -(int64_t)opt_.depth) {
+          s.lru = clock_;
+          return &s;
+        }
+      }
+    }
+    if (victim == NULL || rank(s) < rank(*victim) ||
+        (rank(s) == rank(*victim) && s.lru < victim->lru))
+      victim = &s;
+  }
+
+  const uint8_t *k = (const uint8_t *)key->key;
+  const uint32_t tail = num.pos + num.width;
+  _reset(victim, cancel);
+  victim->kind = num.kind;
+  victim->prefix.assign((const char *)k, num.pos);
+  victim->suffix.assign((const char *)k + tail, key->length - tail);
+  victim->format = num.format;
+  victim->width = num.width;
+  victim->last = num.n;
+  victim->stride = 0;
+  victim->confirmed = 0;
+  victim->next = num.n;
+  victim->lru = clock_;
+  victim->depth = opt_.depth < 2 ? opt_.depth : 2;
+  victim->used = victim->wasted = victim->idle = 0;
+  return NULL;
+}
+
+void kvs_read_ahead::_plan(stream *s, std::vector<slot*> &send) {
+  if (s->confirmed < 2) return;
+  if (s->depth == 0) {
+    stats_.throttled++;
+    //tries again once the stream has been followed for a while
+    if (++s->idle >= 4 * opt_.depth) {
+      s->depth = 1;
+      s->idle = 0;
+    }
+    return;
+  }
+
+  const int64_t stride = s->stride;
+  uint64_t n = s->next;
+  if ((int64_t)(n - s->last) / stride < 1) n = s->last + stride;
+  std::string key;
+  while (s->slots.size() < s->depth && !free_.empty()) {
+    if ((int64_t)(n - s->last) / stride > (int64_t)s->depth) break;
+    //the number wrapped around
+    if ((stride > 0) != (n > s->last)) break;
+    if (!_render(s, n, &key)) break;
+    if (map_.find(key) == map_.end()) {
+      slot *sl = free_.back();
+      free_.pop_back();
+      sl->st = s;
+      sl->state = INFLIGHT;
+      sl->key = key;
+      sl->n = n;
+      sl->bucket = _bucket(key.data(), key.size());
+      //before the retrieve is sent, writes after this invalidate it
+      sl->version = versions_[sl->bucket].load();
+      sl->epoch = epoch_.load();
+      sl->result = KVS_SUCCESS;
+      sl->size = 0;
+      map_[key] = sl;
+      s->slots.push_back(sl);
+      inflight_++;
+      stats_.issued++;
+      send.push_back(sl);
+    }
+    n += stride;
+  }
+  s->next = n;
+}
+
+void kvs_read_ahead::_send(std::vector<slot*> &send) {
+  for (slot *sl : send) {
+    sl->dev_key.key = (void*)sl->key.data();
+    sl->dev_key.length = sl->key.size();
+    sl->dev_value.value = sl->buf;
+    sl->dev_value.length = opt_.value_size;
+    sl->dev_value.actual_value_size = 0;
+    sl->dev_value.offset = 0;
+
+    //the driver drops the key space reference on completion
+    _kvs_key_space_hold(ks_hd_);
+    kvs_option_retrieve option;
+    memset(&option, 0, sizeof(option));
+    kvs_result ret = (kvs_result)ks_hd_->dev->driver->retrieve_tuple(ks_hd_,
+      &sl->dev_key, &sl->dev_value, option, sl, this, false, _on_done);
+    if (ret != KVS_SUCCESS) {
+      _kvs_key_space_io_done(ks_hd_);
+      _complete(sl, ret, 0);
+    }
+  }
+}
+
+//a slot may have completed and been sent again for another key since it was
+//dropped; canceling that one only costs a speculative retrieve
+void kvs_read_ahead::_cancel(std::vector<slot*> &cancel) {
+  for (slot *sl : cancel) {
+    if (!cancel_.load(std::memory_order_relaxed)) return;
+    uint32_t canceled = 0;
+    if (ks_hd_->dev->driver->cancel_io(ks_hd_, sl, &canceled) == KVS_ERR_OPTION_INVALID)
+      cancel_.store(false, std::memory_order_relaxed);
+  }
+}
+
+void kvs_read_ahead::_on_done(kvs_postprocess_context *ctx) {
+  slot *sl = (slot*)ctx->private1;
+  sl->owner->_complete(sl, ctx->result,
+    ctx->result == KVS_SUCCESS ? ctx->value->actual_value_size : 0);
+}
+
+static void _post(kvs_key_space_handle ks_hd, kvs_postprocess_function post_fn,
+  kvs_key *key, kvs_value *value, void *private1, void *private2,
+  kvs_result result) {
+  kvs_postprocess_context ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.context = KVS_CMD_RETRIEVE;
+  ctx.ks_hd = ks_hd;
+  ctx.key = key;
+  ctx.value = value;
+  ctx.private1 = private1;
+  ctx.private2 = private2;
+  ctx.result = result;
+  post_fn(&ctx);
+}
+
+void kvs_read_ahead::_complete(slot *sl, kvs_result result, uint32_t size) {
+  std::vector<waiter> posts;
+  std::vector<kvs_result> results;
+  kvs_key_space_handle ks_hd = ks_hd_;
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    sl->state = READY;
+    sl->result = result;
+    sl->size = size;
+    if (result == KVS_ERR_CANCELED) stats_.canceled++;
+    const bool found = result == KVS_SUCCESS || result == KVS_ERR_KEY_NOT_EXIST;
+    const bool current = _current(sl);
+    for (auto &w : sl->waiters) {
+      kvs_result ret = KVS_SUCCESS;
+      const bool fit = found && current && _fits(sl, w.value);
+      if (fit) {
+        _serve(sl, w.value, &ret);
+        stats_.late_hits++;
+      }
+      if (w.done) {
+        if (fit) *w.result = ret;
+        *w.served = fit;
+        *w.done = true;
+      } else if (fit) {
+        posts.push_back(w);
+        results.push_back(ret);
+      } else {
+        //retrieved from the device by the resubmitter, this may be the
+        //completion thread that a full context pool waits for
+        resubmits_.push_back(w);
+        resubmit_cond_.notify_one();
+      }
+    }
+    sl->waiters.clear();
+
+    std::vector<slot*> none;
+    //claimed by a waiter or dropped while in flight, counted then
+    if (sl->st == NULL) _free(sl);
+    else if (!found || !current) _drop(sl, found, none);
+    done_cond_.notify_all();
+  }
+
+  for (size_t i = 0; i < posts.size(); i++) {
+    const waiter &w = posts[i];
+    _post(ks_hd, w.post_fn, w.key, w.value, w.private1, w.private2, results[i]);
+    _kvs_key_space_io_done(ks_hd);
+  }
+
+  std::unique_lock<std::mutex> lock(lock_);
+  inflight_--;
+  done_cond_.notify_all();
+}
+
+void kvs_read_ahead::_resubmitter() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    while (resubmits_.empty() && !stop_) resubmit_cond_.wait(lock);
+    if (stop_) break;
+    waiter w = resubmits_.front();
+    resubmits_.pop_front();
+    lock.unlock();
+
+    //the waiter's key space reference passes to its retrieve
+    kvs_option_retrieve option;
+    memset(&option, 0, sizeof(option));
+    kvs_result ret = (kvs_result)ks_hd_->dev->driver->retrieve_tuple(ks_hd_,
+      w.key, w.value, option, w.private1, w.private2, false, w.post_fn);
+    if (ret != KVS_SUCCESS) {
+      _post(ks_hd_, w.post_fn, w.key, w.value, w.private1, w.private2, ret);
+      _kvs_key_space_io_done(ks_hd_);
+    }
+    lock.lock();
+    done_cond_.notify_all();
+  }
+}
+
+bool kvs_read_ahead::retrieve(kvs_key *key, kvs_value *value, void *private1,
+  void *private2, kvs_postprocess_function post_fn, bool *queued,
+  kvs_result *ret) {
+  key_number num;
+  if (value->offset != 0 || !_parse(key, &num)) return false;
+
+  std::vector<slot*> send, cancel;
+  bool hit = false, wait = false, done = false, served = false;
+  kvs_result result = KVS_SUCCESS;
+  std::unique_lock<std::mutex> lock(lock_);
+  stats_.retrieves++;
+  auto it = map_.find(std::string((const char *)key->key, key->length));
+  if (it != map_.end()) {
+    slot *sl = it->second;
+    if (!_current(sl)) {
+      _drop(sl, true, cancel);
+    } else if (sl->state == INFLIGHT) {
+      waiter w = {post_fn, private1, private2, key, value,
+                  post_fn ? NULL : &done, &served, ret};
+      sl->waiters.push_back(w);
+      //used by the stream now, its completion frees it
+      _used(sl);
+      if (post_fn) *queued = hit = true;
+      else wait = true;
+    } else if (_fits(sl, value)) {
+      _serve(sl, value, &result);
+      stats_.hits++;
+      _used(sl);
+      hit = true;
+    } else {
+      _drop(sl, false, cancel);
+    }
+  }
+  stream *s = _follow(key, num, cancel);
+  if (s) _plan(s, send);
+  lock.unlock();
+
+  _cancel(cancel);
+  _send(send);
+  if (wait) {
+    lock.lock();
+    while (!done) done_cond_.wait(lock);
+    return served;
+  }
+  if (hit && !(post_fn && *queued)) {
+    if (post_fn) _post(ks_hd_, post_fn, key, value, private1, private2, result);
+    else *ret = result;
+  }
+  return hit;
+}
+
+void kvs_read_ahead::get_stats(kvs_read_ahead_stats *stats) {
+  std::unique_lock<std::mutex> lock(lock_);
+  *stats = stats_;
+  stats->streams = 0;
+  for (auto &s : streams_) {
+    if (s.lru != 0 && s.confirmed >= 2 && s.depth > 0) stats->streams++;
+  }
+}
@@ -0,0 +1,351 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "kvs_utils.h"
+#include "private_types.h"
+#include "kvs_replica.h"
+
+static uint64_t _now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//answers a read does not have to be retried elsewhere for
+static bool _definitive(kvs_result result) {
+  return result == KVS_SUCCESS || result == KVS_ERR_KEY_NOT_EXIST ||
+    result == KVS_ERR_BUFFER_SMALL;
+}
+
+kvs_replica_set::kvs_replica_set(kvs_key_space_handle *ks_hds, uint8_t ks_cnt,
+  const kvs_option_replica &opt)
+  : ks_(ks_hds, ks_hds + ks_cnt), opt_(opt), next_(0), outstanding_(0),
+    latency_pos_(0), latency_cnt_(0) {
+  quorum_ = (opt.write_quorum == 0) ? ks_cnt : opt.write_quorum;
+  latencies_.resize(LATENCY_WINDOW);
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+kvs_replica_set::~kvs_replica_set() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (outstanding_)
+    done_cond_.wait(lock);
+}
+
+uint8_t kvs_replica_set::_next_replica() {
+  return next_.fetch_add(1, std::memory_order_relaxed) % ks_.size();
+}
+
+void kvs_replica_set::get_stats(kvs_replica_stats *stats) {
+  std::unique_lock<std::mutex> lock(lock_);
+  *stats = stats_;
+}
+
+kvs_result kvs_replica_set::store(const kvs_key *key, const kvs_value *value,
+  const kvs_option_store *opt) {
+  write_op *op = new write_op();
+  op->cmd = KVS_CMD_STORE;
+  op->st_opt = *opt;
+  op->key = *key;
+  op->value = *value;
+  op->buf = NULL;
+  if (quorum_ < ks_.size()) {
+    //the slower replicas may still read key and value after we return
+    uint32_t key_off = (value->length + 7) & ~7u;
+    op->buf = (char*)kvs_malloc(key_off + key->length, 4096);
+    if (op->buf == NULL) {
+      delete op;
+      return KVS_ERR_SYS_IO;
+    }
+    memcpy(op->buf, value->value, value->length);
+    memcpy(op->buf + key_off, key->key, key->length);
+    op->value.value = op->buf;
+    op->key.key = op->buf + key_off;
+  }
+  return _write(op);
+}
+
+kvs_result kvs_replica_set::remove(const kvs_key *key,
+  const kvs_option_delete *opt) {
+  write_op *op = new write_op();
+  op->cmd = KVS_CMD_DELETE;
+  op->del_opt = *opt;
+  op->key = *key;
+  op->buf = NULL;
+  if (quorum_ < ks_.size()) {
+    op->buf = (char*)kvs_malloc(key->length, 4096);
+    if (op->buf == NULL) {
+      delete op;
+      return KVS_ERR_SYS_IO;
+    }
+    memcpy(op->buf, key->key, key->length);
+    op->key.key = op->buf;
+  }
+  return _write(op);
+}
+
+kvs_result kvs_replica_set::_write(write_op *op) {
+  uint8_t n = ks_.size();
+  op->owner = this;
+  op->pending = n;
+  op->acked = 0;
+  op->missing = 0;
+  op->error = KVS_SUCCESS;
+  op->waiting = true;
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    outstanding_++;
+    stats_.stores++;
+  }
+
+  for (uint8_t i = 0; i < n; i++) {
+    kvs_result ret;
+    if (op->cmd == KVS_CMD_STORE)
+      ret = kvs_store_kvp_async(ks_[i], &op->key, &op->value, &op->st_opt,
+                                op, NULL, _on_write_done);
+    else
+      ret = kvs_delete_kvp_async(ks_[i], &op->key, &op->del_opt,
+                                 op, NULL, _on_write_done);
+    if (ret != KVS_SUCCESS) _write_done(op, ret);
+  }
+
+  std::unique_lock<std::mutex> lock(lock_);
+  //wait while the quorum is not reached but still can be
+  while (op->acked < quorum_ && op->acked + op->pending >= quorum_)
+    done_cond_.wait(lock);
+
+  kvs_result ret;
+  if (op->acked >= quorum_) {
+    ret = (op->missing == op->acked) ? KVS_ERR_KEY_NOT_EXIST : KVS_SUCCESS;
+    if (op->cmd == KVS_CMD_STORE || !op->del_opt.kvs_delete_error)
+      ret = KVS_SUCCESS;
+  } else {
+    ret = op->error;
+    stats_.quorum_failures++;
+  }
+  op->waiting = false;
+  if (op->pending == 0) _free_write(op);
+  return ret;
+}
+
+void kvs_replica_set::_on_write_done(kvs_postprocess_context *ctx) {
+  write_op *op = (write_op*)ctx->private1;
+  op->owner->_write_done(op, ctx->result);
+}
+
+void kvs_replica_set::_write_done(write_op *op, kvs_result result) {
+  std::unique_lock<std::mutex> lock(lock_);
+  if (result == KVS_SUCCESS) {
+    op->acked++;
+  } else if (result == KVS_ERR_KEY_NOT_EXIST && op->cmd == KVS_CMD_DELETE) {
+    op->acked++;
+    op->missing++;
+  } else {
+    stats_.write_errors++;
+    if (op->error == KVS_SUCCESS) op->error = result;
+  }
+  op->pending--;
+  if (op->pending == 0 && !op->waiting) _free_write(op);
+  done_cond_.notify_all();
+}
+
+//caller holds lock_
+void kvs_replica_set::_free_write(write_op *op) {
+  if (op->buf) kvs_free(op->buf);
+  delete op;
+  outstanding_--;
+  done_cond_.notify_all();
+}
+
+//without hedging the caller's buffer is used and a failed replica is
+//replaced by the next one
+kvs_result kvs_replica_set::_retrieve_direct(const kvs_key *key,
+  kvs_value *value) {
+  kvs_option_retrieve option = { false };
+  uint8_t first = _next_replica();
+  kvs_result ret = KVS_ERR_SYS_IO;
+  for (uint8_t i = 0; i < ks_.size(); i++) {
+    if (i) {
+      std::unique_lock<std::mutex> lock(lock_);
+      stats_.failovers++;
+    }
+    ret = kvs_retrieve_kvp(ks_[(first + i) % ks_.size()], (kvs_key*)key,
+                           &option, value);
+    if (_definitive(ret)) break;
+  }
+  std::unique_lock<std::mutex> lock(lock_);
+  stats_.retrieves++;
+  return ret;
+}
+
+kvs_result kvs_replica_set::retrieve(const kvs_key *key, kvs_value *value) {
+  if (!opt_.hedge_reads || ks_.size() == 1)
+    return _retrieve_direct(key, value);
+
+  read_op *op = new read_op();
+  op->owner = this;
+  op->key_buf = (char*)kvs_malloc(key->length, 4096);
+  if (op->key_buf == NULL) {
+    delete op;
+    return KVS_ERR_SYS_IO;
+  }
+  memcpy(op->key_buf, key->key, key->length);
+  op->key.key = op->key_buf;
+  op->key.length = key->length;
+  op->issued = 0;
+  op->completed = 0;
+  op->winner = -1;
+  op->result = KVS_ERR_SYS_IO;
+  op->waiting = true;
+  uint8_t first = _next_replica();
+  for (uint8_t i = 0; i < ks_.size(); i++) {
+    read_attempt &att = op->attempts[i];
+    att.op = op;
+    att.replica = (first + i) % ks_.size();
+    att.buf = NULL;
+    att.value.value = NULL;
+    att.value.length = value->length;
+    att.value.actual_value_size = 0;
+    att.value.offset = value->offset;
+  }
+
+  std::unique_lock<std::mutex> lock(lock_);
+  outstanding_++;
+  stats_.retrieves++;
+  _issue_read(op, lock);
+  while (op->winner < 0) {
+    if (op->completed == op->issued) {
+      //every read sent so far failed
+      if (op->issued == ks_.size()) break;
+      stats_.failovers++;
+      _issue_read(op, lock);
+      continue;
+    }
+    uint32_t delay = stats_.hedge_delay_us;
+    if (delay == 0 || op->issued == ks_.size()) {
+      done_cond_.wait(lock);
+      continue;
+    }
+    //the delay counts from the newest read, so one more is sent per delay
+    uint64_t deadline = op->attempts[op->issued - 1].start_us + delay;
+    uint64_t now = _now_us();
+    if (now >= deadline) {
+      stats_.hedged++;
+      _issue_read(op, lock);
+      continue;
+    }
+    done_cond_.wait_for(lock, std::chrono::microseconds(deadline - now));
+  }
+
+  kvs_result ret = op->result;
+  if (op->winner >= 0) {
+    const read_attempt &att = op->attempts[op->winner];
+    if (ret == KVS_SUCCESS)
+      memcpy(value->value, att.buf, std::min(att.value.length, value->length));
+    value->length = att.value.length;
+    value->actual_value_size = att.value.actual_value_size;
+    if (op->winner > 0) stats_.hedge_wins++;
+  }
+  op->waiting = false;
+  if (op->completed == op->issued) _free_read(op);
+  return ret;
+}
+
+//sends the next read of an operation, drops lock_ while submitting as the
+//completion may be called from this thread
+void kvs_replica_set::_issue_read(read_op *op,
+  std::unique_lock<std::mutex> &lock) {
+  read_attempt &att = op->attempts[op->issued++];
+  lock.unlock();
+  kvs_result ret = KVS_ERR_SYS_IO;
+  att.start_us = _now_us();
+  att.buf = (char*)kvs_malloc(att.value.length, 4096);
+  if (att.buf) {
+    att.value.value = att.buf;
+    kvs_option_retrieve option = { false };
+    ret = kvs_retrieve_kvp_async(ks_[att.replica], &op->key, &option, &att,
+                                 NULL, &att.value, _on_read_done);
+  }
+  if (ret != KVS_SUCCESS) _read_done(&att, ret);
+  lock.lock();
+}
+
+void kvs_replica_set::_on_read_done(kvs_postprocess_context *ctx) {
+  read_attempt *att = (read_attempt*)ctx->private1;
+  att->op->owner->_read_done(att, ctx->result);
+}
+
+void kvs_replica_set::_read_done(read_attempt *att, kvs_result result) {
+  read_op *op = att->op;
+  uint64_t now = _now_us();
+  std::unique_lock<std::mutex> lock(lock_);
+  op->completed++;
+  if (_definitive(result)) {
+    _record_latency(now - att->start_us);
+    if (op->winner < 0) {
+      op->winner = att - op->attempts;
+      op->result = result;
+    }
+  } else if (op->winner < 0) {
+    op->result = result;
+  }
+  if (!op->waiting && op->completed == op->issued) _free_read(op);
+  done_cond_.notify_all();
+}
+
+//caller holds lock_
+void kvs_replica_set::_free_read(read_op *op) {
+  for (uint8_t i = 0; i < op->issued; i++) {
+    if (op->attempts[i].buf) kvs_free(op->attempts[i].buf);
+  }
+  kvs_free(op->key_buf);
+  delete op;
+  outstanding_--;
+  done_cond_.notify_all();
+}
+
+//caller holds lock_
+void kvs_replica_set::_record_latency(uint64_t us) {
+  latencies_[latency_pos_] = (uint32_t)std::min<uint64_t>(us, UINT32_MAX);
+  latency_pos_ = (latency_pos_ + 1) % LATENCY_WINDOW;
+  latency_cnt_++;
+  if (latency_cnt_ < LATENCY_WINDOW || latency_cnt_ % LATENCY_UPDATE) return;
+
+  std::vector<uint32_t> window(latencies_);
+  size_t rank = (size_t)(opt_.hedge_percentile / 100.0 * (LATENCY_WINDOW - 1));
+  std::nth_element(window.begin(), window.begin() + rank, window.end());
+  stats_.hedge_delay_us = std::max({ window[rank], opt_.hedge_min_us, 1u });
+}
@@ -0,0 +1,229 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include "kvs_rs.h"
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct gf_tables {
+  uint8_t exp[512];
+  uint8_t log[256];
+
+  gf_tables() {
+    int x = 1;
+    for (int i = 0; i < 255; i++) {
+      exp[i] = (uint8_t)x;
+      log[x] = (uint8_t)i;
+      x <<= 1;
+      if (x & 0x100) x ^= 0x11d;
+    }
+    for (int i = 255; i < 512; i++) exp[i] = exp[i - 255];
+    log[0] = 0;
+  }
+};
+
+const gf_tables &gf() {
+  static const gf_tables tables;
+  return tables;
+}
+
+inline uint8_t gf_mul(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) return 0;
+  const gf_tables &t = gf();
+  return t.exp[t.log[a] + t.log[b]];
+}
+
+inline uint8_t gf_inv(uint8_t a) {
+  const gf_tables &t = gf();
+  return t.exp[255 - t.log[a]];
+}
+
+// inverts the n x n matrix a in place, false if it is singular
+bool gf_invert(std::vector<uint8_t> &a, int n) {
+  std::vector<uint8_t> inv(n * n, 0);
+  for (int i = 0; i < n; i++) inv[i * n + i] = 1;
+  for (int col = 0; col < n; col++) {
+    int pivot = col;
+    while (pivot < n && a[pivot * n + col] == 0) pivot++;
+    if (pivot == n) return false;
+    if (pivot != col) {
+      for (int j = 0; j < n; j++) {
+        std::swap(a[pivot * n + j], a[col * n + j]);
+        std::swap(inv[pivot * n + j], inv[col * n + j]);
+      }
+    }
+    uint8_t scale = gf_inv(a[col * n + col]);
+    for (int j = 0; j < n; j++) {
+      a[col * n + j] = gf_mul(a[col * n + j], scale);
+      inv[col * n + j] = gf_mul(inv[col * n + j], scale);
+    }
+    for (int row = 0; row < n; row++) {
+      uint8_t f = a[row * n + col];
+      if (row == col || f == 0) continue;
+      for (int j = 0; j < n; j++) {
+        a[row * n + j] ^= gf_mul(f, a[col * n + j]);
+        inv[row * n + j] ^= gf_mul(f, inv[col * n + j]);
+      }
+    }
+  }
+  a.swap(inv);
+  return true;
+}
+
+// fragments are combined in slices that stay in the cache across sources
+const size_t SLICE = 16 * 1024;
+
+} // namespace
+
+kvs_rs_codec::kvs_rs_codec(int k, int m, bool simd)
+  : k_(k), m_(m), simd_(simd) {
+  parity_rows_.resize(m * k);
+  parity_tables_.resize(m * k);
+  // Cauchy rows 1 / (x_i + y_j) with x_i = k + i and y_j = j, all distinct
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < k; j++) {
+      uint8_t c = gf_inv((uint8_t)((k + i) ^ j));
+      parity_rows_[i * k + j] = c;
+      _make_table(c, &parity_tables_[i * k + j]);
+    }
+  }
+}
+
+const char *kvs_rs_codec::simd_name() const {
+  if (!simd_) return "scalar";
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSSE3__)
+  return "ssse3";
+#else
+  return "scalar";
+#endif
+}
+
+void kvs_rs_codec::_make_table(uint8_t c, mul_table *t) {
+  for (int x = 0; x < 16; x++) {
+    t->lo[x] = gf_mul(c, (uint8_t)x);
+    t->hi[x] = gf_mul(c, (uint8_t)(x << 4));
+  }
+}
+
+void kvs_rs_codec::_mul_region(const mul_table &t, const uint8_t *src,
+  uint8_t *dst, size_t len, bool add) const {
+  size_t i = 0;
+  if (simd_) {
+#if defined(__AVX2__)
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)t.lo));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)t.hi));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    for (; i + 32 <= len; i += 32) {
+      __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+      __m256i p = _mm256_xor_si256(
+        _mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+        _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+      if (add) p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i*)(dst + i)));
+      _mm256_storeu_si256((__m256i*)(dst + i), p);
+    }
+#elif defined(__SSSE3__)
+    const __m128i lo = _mm_loadu_si128((const __m128i*)t.lo);
+    const __m128i hi = _mm_loadu_si128((const __m128i*)t.hi);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= len; i += 16) {
+      __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+      __m128i p = _mm_xor_si128(
+        _mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+        _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+      if (add) p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i*)(dst + i)));
+      _mm_storeu_si128((__m128i*)(dst + i), p);
+    }
+#endif
+  }
+  for (; i < len; i++) {
+    uint8_t p = t.lo[src[i] & 0x0f] ^ t.hi[src[i] >> 4];
+    dst[i] = add ? (dst[i] ^ p) : p;
+  }
+}
+
+void kvs_rs_codec::encode(const uint8_t * const *data, uint8_t * const *parity,
+  size_t len) const {
+  for (size_t off = 0; off < len; off += SLICE) {
+    size_t n = std::min(SLICE, len - off);
+    for (int i = 0; i < m_; i++) {
+      for (int j = 0; j < k_; j++)
+        _mul_region(parity_tables_[i * k_ + j], data[j] + off, parity[i] + off, n, j > 0);
+    }
+  }
+}
+
+bool kvs_rs_codec::decode(uint8_t * const *frags, const bool *present,
+  size_t len) const {
+  std::vector<int> missing;
+  for (int j = 0; j < k_; j++) {
+    if (!present[j]) missing.push_back(j);
+  }
+  if (missing.empty()) return true;
+
+  // the first k present fragments and their rows of the encoding matrix
+  std::vector<int> rows;
+  for (int i = 0; i < k_ + m_ && (int)rows.size() < k_; i++) {
+    if (present[i]) rows.push_back(i);
+  }
+  if ((int)rows.size() < k_) return false;
+
+  std::vector<uint8_t> a(k_ * k_, 0);
+  for (int r = 0; r < k_; r++) {
+    if (rows[r] < k_) a[r * k_ + rows[r]] = 1;
+    else memcpy(&a[r * k_], &parity_rows_[(rows[r] - k_) * k_], k_);
+  }
+  if (!gf_invert(a, k_)) return false;
+
+  // each missing data fragment is a combination of the chosen ones
+  std::vector<mul_table> tables(missing.size() * k_);
+  for (size_t d = 0; d < missing.size(); d++) {
+    for (int r = 0; r < k_; r++)
+      _make_table(a[missing[d] * k_ + r], &tables[d * k_ + r]);
+  }
+  for (size_t off = 0; off < len; off += SLICE) {
+    size_t n = std::min(SLICE, len - off);
+    for (size_t d = 0; d < missing.size(); d++) {
+      for (int r = 0; r < k_; r++)
+        _mul_region(tables[d * k_ + r], frags[rows[r]] + off, frags[missing[d]] + off, n, r > 0);
+    }
+  }
+  return true;
+}
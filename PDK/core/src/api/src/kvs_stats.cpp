@@ -0,0 +1,194 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include "kvs_utils.h"
+#include "kvs_stats.h"
+
+namespace {
+
+//mapped for the lifetime of the process, readers may outlive it
+kvs_stats_segment *g_segment = NULL;
+//taking and giving back slots, never in the I/O path
+std::mutex g_slot_lock;
+std::atomic<uint32_t> g_next_shard(0);
+
+uint32_t _shard() {
+  static thread_local uint32_t shard = g_next_shard++ % KVS_STATS_SHARDS;
+  return shard;
+}
+
+int _op_type(kvs_context op) {
+  switch (op) {
+  case KVS_CMD_STORE: return KVS_STATS_STORE;
+  case KVS_CMD_RETRIEVE: return KVS_STATS_RETRIEVE;
+  case KVS_CMD_DELETE: return KVS_STATS_DELETE;
+  case KVS_CMD_EXIST: return KVS_STATS_EXIST;
+  case KVS_CMD_ITER_NEXT: return KVS_STATS_ITERATE;
+  case KVS_CMD_WRITE_BATCH: return KVS_STATS_BATCH;
+  default: return -1;
+  }
+}
+
+//zeroes the counters of a slot, readers never see them half cleared
+void _clear_shards(kvs_stats_shard *shards) {
+  for (int i = 0; i < KVS_STATS_SHARDS; i++) {
+    kvs_stats_op *op = shards[i].op;
+    uint32_t s = kvs_stats_write_begin(&shards[i].seq);
+    for (int o = 0; o < KVS_STATS_NR_OPS; o++) {
+      kvs_stats_set(&op[o].ops, 0);
+      kvs_stats_set(&op[o].errors, 0);
+      kvs_stats_set(&op[o].bytes, 0);
+      kvs_stats_set(&op[o].lat_sum_ns, 0);
+      for (int b = 0; b < KVS_STATS_LAT_BUCKETS; b++) kvs_stats_set(&op[o].lat_hist[b], 0);
+    }
+    kvs_stats_write_end(&shards[i].seq, s);
+  }
+}
+
+void _clear_queue(kvs_stats_queue *q) {
+  uint32_t s = kvs_stats_write_begin(&q->seq);
+  kvs_stats_set(&q->enqueued, 0);
+  kvs_stats_set(&q->dequeued, 0);
+  kvs_stats_set(&q->depth, 0);
+  kvs_stats_set(&q->max_depth, 0);
+  for (int b = 0; b < KVS_STATS_DEPTH_BUCKETS; b++) kvs_stats_set(&q->depth_hist[b], 0);
+  kvs_stats_write_end(&q->seq, s);
+}
+
+} // namespace
+
+bool kvs_stats_open(const char *name) {
+  std::unique_lock<std::mutex> lock(g_slot_lock);
+  if (g_segment) return true;
+
+  const std::string path = name[0] == '/' ? name : std::string("/") + name;
+  const size_t size = sizeof(kvs_stats_segment);
+  int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    WRITE_WARNING("Cannot create the statistics segment %s: %s\n", path.c_str(),
+                  strerror(errno));
+    return false;
+  }
+  //truncating first drops what a previous process left
+  if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+    WRITE_WARNING("Cannot size the statistics segment %s: %s\n", path.c_str(),
+                  strerror(errno));
+    close(fd);
+    return false;
+  }
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    WRITE_WARNING("Cannot map the statistics segment %s: %s\n", path.c_str(),
+                  strerror(errno));
+    return false;
+  }
+
+  kvs_stats_segment *seg = (kvs_stats_segment *)addr;
+  seg->version = KVS_STATS_SHM_VERSION;
+  seg->size = size;
+  seg->pid = getpid();
+  seg->created = time(NULL);
+  //readers that see the magic number see the rest of the header
+  __atomic_store_n(&seg->magic, KVS_STATS_SHM_MAGIC, __ATOMIC_RELEASE);
+  g_segment = seg;
+  return true;
+}
+
+kvs_stats_device *kvs_stats_device_alloc(const char *path) {
+  std::unique_lock<std::mutex> lock(g_slot_lock);
+  if (g_segment == NULL) return NULL;
+  for (int i = 0; i < KVS_STATS_MAX_DEVICES; i++) {
+    kvs_stats_device *dev = &g_segment->device[i];
+    if (dev->state != KVS_STATS_SLOT_FREE) continue;
+    _clear_shards(dev->shard);
+    for (int q = 0; q < KVS_STATS_MAX_QUEUES; q++) _clear_queue(&dev->queue[q]);
+    dev->nqueues = 0;
+    snprintf(dev->name, sizeof(dev->name), "%s", path);
+    dev->generation++;
+    __atomic_store_n(&dev->state, KVS_STATS_SLOT_OPEN, __ATOMIC_RELEASE);
+    return dev;
+  }
+  WRITE_WARNING("No statistics slot left for device %s\n", path);
+  return NULL;
+}
+
+void kvs_stats_device_free(kvs_stats_device *dev) {
+  if (dev == NULL) return;
+  std::unique_lock<std::mutex> lock(g_slot_lock);
+  __atomic_store_n(&dev->state, KVS_STATS_SLOT_FREE, __ATOMIC_RELEASE);
+}
+
+kvs_stats_key_space *kvs_stats_key_space_alloc(kvs_stats_device *dev, const char *name) {
+  if (dev == NULL) return NULL;
+  std::unique_lock<std::mutex> lock(g_slot_lock);
+  for (int i = 0; i < KVS_STATS_MAX_KEY_SPACES; i++) {
+    kvs_stats_key_space *ks = &g_segment->key_space[i];
+    if (ks->state != KVS_STATS_SLOT_FREE) continue;
+    _clear_shards(ks->shard);
+    ks->device = (int32_t)(dev - g_segment->device);
+    snprintf(ks->name, sizeof(ks->name), "%s", name);
+    ks->generation++;
+    __atomic_store_n(&ks->state, KVS_STATS_SLOT_OPEN, __ATOMIC_RELEASE);
+    return ks;
+  }
+  WRITE_WARNING("No statistics slot left for key space %s\n", name);
+  return NULL;
+}
+
+void kvs_stats_key_space_free(kvs_stats_key_space *ks) {
+  if (ks == NULL) return;
+  std::unique_lock<std::mutex> lock(g_slot_lock);
+  __atomic_store_n(&ks->state, KVS_STATS_SLOT_FREE, __ATOMIC_RELEASE);
+}
+
+void kvs_stats_done(kvs_key_space_handle ks_hd, kvs_context op, bool failed,
+                    uint64_t bytes, uint64_t start) {
+  const int type = _op_type(op);
+  if (type < 0) return;
+  const uint64_t now = kvs_stats_now();
+  const uint64_t lat = now > start ? now - start : 0;
+  const uint32_t shard = _shard();
+  kvs_stats_record(&ks_hd->dev->stats->shard[shard], type, failed, bytes, lat);
+  if (ks_hd->stats)
+    kvs_stats_record(&ks_hd->stats->shard[shard], type, failed, bytes, lat);
+}
@@ -0,0 +1,419 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+#include <chrono>
+#include "kvs_utils.h"
+#include "private_types.h"
+#include "kvs_writeback.h"
+
+static uint64_t _now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+kvs_writeback::kvs_writeback(kvs_key_space_handle ks_hd,
+  const kvs_option_writeback &opt)
+  : ks_hd_(ks_hd), opt_(opt), urgent_(0), parked_(0), bytes_(0), inflight_(0),
+    first_dirty_us_(0),
+    want_flush_(false), stop_(false), first_error_(KVS_SUCCESS) {
+  memset(&stats_, 0, sizeof(stats_));
+  flusher_ = std::thread(&kvs_writeback::_flusher, this);
+}
+
+kvs_writeback::~kvs_writeback() {
+  std::unique_lock<std::mutex> lock(lock_);
+  _drain(lock);
+  stop_ = true;
+  flush_cond_.notify_one();
+  lock.unlock();
+  flusher_.join();
+}
+
+bool kvs_writeback::_set_value(entry *e, const kvs_value *value) {
+  if (value->length > e->buf_size || e->buf == NULL) {
+    uint32_t size = value->length ? value->length : 1;
+    char *buf = (char*)kvs_malloc(size, PAGE_ALIGN);
+    if (buf == NULL) return false;
+    if (e->buf) kvs_free(e->buf);
+    e->buf = buf;
+    e->buf_size = size;
+  }
+  memcpy(e->buf, value->value, value->length);
+  e->length = value->length;
+  return true;
+}
+
+void kvs_writeback::_free_entry(entry *e) {
+  if (e->buf) kvs_free(e->buf);
+  delete e;
+}
+
+bool kvs_writeback::store(const kvs_key *key, const kvs_value *value,
+  const kvs_option_store *opt, void *private1, void *private2,
+  kvs_postprocess_function post_fn, kvs_result *ret) {
+  uint64_t need = key->length + value->length;
+  if (opt->st_type != KVS_STORE_POST || opt->ttl_ms || value->offset != 0 ||
+      need > opt_.buffer_size) {
+    if (!post_fn) flush_keys(key, 1);
+    std::unique_lock<std::mutex> lock(lock_);
+    stats_.bypassed++;
+    return false;
+  }
+
+  std::string k((const char*)key->key, key->length);
+  std::unique_lock<std::mutex> lock(lock_);
+  auto it = map_.find(k);
+  entry *e = (it == map_.end()) ? NULL : it->second;
+  if (e == NULL || e->state != DIRTY) {
+    while (bytes_ + need > opt_.buffer_size) {
+      if (post_fn) {
+        //never block an asynchronous caller, it may be running on the
+        //driver completion thread that frees the space
+        stats_.bypassed++;
+        return false;
+      }
+      want_flush_ = true;
+      flush_cond_.notify_one();
+      space_cond_.wait(lock);
+      it = map_.find(k);
+      e = (it == map_.end()) ? NULL : it->second;
+      if (e && e->state == DIRTY) break;
+    }
+  }
+
+  if (e && e->state == DIRTY) {
+    uint32_t old_length = e->length;
+    if (!_set_value(e, value)) {
+      *ret = KVS_ERR_SYS_IO;
+      return true;
+    }
+    bytes_ = bytes_ + e->length - old_length;
+    stats_.merged++;
+  } else {
+    entry *n = new entry();
+    n->key = k;
+    n->buf = NULL;
+    n->buf_size = 0;
+    if (!_set_value(n, value)) {
+      delete n;
+      *ret = KVS_ERR_SYS_IO;
+      return true;
+    }
+    n->state = DIRTY;
+    n->urgent = false;
+    n->older = e;
+    n->owner = this;
+    map_[k] = n;
+    //the first dirty pair arms the flush interval of an idle flusher
+    bool arm = dirty_.empty() && opt_.flush_interval_us;
+    if (arm) first_dirty_us_ = _now_us();
+    dirty_.push_back(n);
+    if (arm) flush_cond_.notify_one();
+    bytes_ += need;
+    e = n;
+  }
+  stats_.stores++;
+
+  bool done = false;
+  kvs_result result = KVS_SUCCESS;
+  bool ack_device = (opt_.durability == KVS_WRITEBACK_ACK_DEVICE);
+  if (ack_device) {
+    waiter w = { post_fn, private1, private2, (kvs_key*)key, (kvs_value*)value,
+                 post_fn ? NULL : &done, post_fn ? NULL : &result };
+    e->waiters.push_back(w);
+  }
+  if (dirty_.size() >= opt_.batch_size || bytes_ >= opt_.buffer_size / 2)
+    flush_cond_.notify_one();
+
+  *ret = KVS_SUCCESS;
+  if (!ack_device) {
+    lock.unlock();
+    if (post_fn) {
+      kvs_postprocess_context ctx;
+      memset(&ctx, 0, sizeof(ctx));
+      ctx.context = KVS_CMD_STORE;
+      ctx.ks_hd = ks_hd_;
+      ctx.key = (kvs_key*)key;
+      ctx.value = (kvs_value*)value;
+      ctx.private1 = private1;
+      ctx.private2 = private2;
+      ctx.result = KVS_SUCCESS;
+      post_fn(&ctx);
+    }
+  } else if (!post_fn) {
+    while (!done) done_cond_.wait(lock);
+    *ret = result;
+  }
+  return true;
+}
+
+bool kvs_writeback::retrieve(const kvs_key *key, kvs_value *value,
+  kvs_result *ret) {
+  std::string k((const char*)key->key, key->length);
+  std::unique_lock<std::mutex> lock(lock_);
+  auto it = map_.find(k);
+  if (it == map_.end()) return false;
+
+  //same results as a device read
+  entry *e = it->second;
+  stats_.read_hits++;
+  if (value->offset != 0 && value->offset >= e->length) {
+    *ret = KVS_ERR_VALUE_OFFSET_INVALID;
+    return true;
+  }
+  uint32_t avail = e->length - value->offset;
+  uint32_t copylen = std::min(avail, value->length);
+  memcpy(value->value, e->buf + value->offset, copylen);
+  *ret = (value->length < avail) ? KVS_ERR_BUFFER_SMALL : KVS_SUCCESS;
+  value->length = copylen;
+  value->actual_value_size = avail;
+  return true;
+}
+
+void kvs_writeback::flush_keys(const kvs_key *keys, uint32_t key_cnt) {
+  parked_request p;
+  std::unique_lock<std::mutex> lock(lock_);
+  if (!_park(keys, key_cnt, &p)) return;
+  while (p.pending) done_cond_.wait(lock);
+}
+
+bool kvs_writeback::park(const kvs_key *keys, uint32_t key_cnt,
+  const std::function<void()> &send) {
+  parked_request *p = new parked_request();
+  p->send = send;
+  std::unique_lock<std::mutex> lock(lock_);
+  if (!_park(keys, key_cnt, p)) {
+    delete p;
+    return false;
+  }
+  parked_++;
+  return true;
+}
+
+//attaches p to the newest entry of each buffered key, which completes
+//after any older one of the key
+bool kvs_writeback::_park(const kvs_key *keys, uint32_t key_cnt, parked_request *p) {
+  p->pending = 0;
+  for (uint32_t i = 0; i < key_cnt; i++) {
+    auto it = map_.find(std::string((const char*)keys[i].key, keys[i].length));
+    if (it == map_.end()) continue;
+    entry *e = it->second;
+    //a key given twice
+    if (!e->parked.empty() && e->parked.back() == p) continue;
+    e->parked.push_back(p);
+    p->pending++;
+    if (e->state == DIRTY && !e->urgent) {
+      e->urgent = true;
+      urgent_++;
+    }
+  }
+  if (p->pending) flush_cond_.notify_one();
+  return p->pending > 0;
+}
+
+void kvs_writeback::drain() {
+  std::unique_lock<std::mutex> lock(lock_);
+  _drain(lock);
+}
+
+kvs_result kvs_writeback::flush() {
+  std::unique_lock<std::mutex> lock(lock_);
+  _drain(lock);
+  kvs_result ret = first_error_;
+  first_error_ = KVS_SUCCESS;
+  return ret;
+}
+
+void kvs_writeback::get_stats(kvs_writeback_stats *stats) {
+  std::unique_lock<std::mutex> lock(lock_);
+  *stats = stats_;
+}
+
+//waits until everything buffered has been written and the requests parked
+//on it have been sent
+void kvs_writeback::_drain(std::unique_lock<std::mutex> &lock) {
+  while (!dirty_.empty() || inflight_ > 0 || parked_ > 0) {
+    want_flush_ = true;
+    flush_cond_.notify_one();
+    space_cond_.wait(lock);
+  }
+}
+
+bool kvs_writeback::_flush_due(uint64_t now_us) const {
+  if (dirty_.empty()) return false;
+  if (want_flush_ || dirty_.size() >= opt_.batch_size ||
+      bytes_ >= opt_.buffer_size / 2)
+    return true;
+  return opt_.flush_interval_us &&
+    now_us - first_dirty_us_ >= opt_.flush_interval_us;
+}
+
+//an urgent entry that no older write of its key holds back
+bool kvs_writeback::_urgent_due() const {
+  if (urgent_ == 0) return false;
+  for (entry *e : dirty_) {
+    if (e->urgent && !e->older) return true;
+  }
+  return false;
+}
+
+void kvs_writeback::_flusher() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    uint64_t now = _now_us();
+    while (!stop_ && ready_.empty() && !_flush_due(now) && !_urgent_due()) {
+      if (!dirty_.empty() && opt_.flush_interval_us) {
+        uint64_t due = first_dirty_us_ + opt_.flush_interval_us;
+        flush_cond_.wait_for(lock, std::chrono::microseconds(due > now ? due - now : 1));
+      } else {
+        flush_cond_.wait(lock);
+      }
+      now = _now_us();
+    }
+    if (stop_) break;
+
+    std::deque<parked_request*> send;
+    send.swap(ready_);
+
+    //entries behind an older write of the same key wait for the next round,
+    //between rounds only urgent entries are written
+    bool round = _flush_due(now);
+    std::vector<entry*> batch;
+    std::deque<entry*> held;
+    for (entry *e : dirty_) {
+      if (e->older || !(round || e->urgent)) held.push_back(e);
+      else batch.push_back(e);
+    }
+    dirty_.swap(held);
+    if (round) {
+      if (dirty_.empty()) want_flush_ = false;
+      else first_dirty_us_ = now;
+    }
+    if (batch.empty() && send.empty()) {
+      //everything left waits for writes in flight, their completion wakes us
+      flush_cond_.wait(lock);
+      continue;
+    }
+    for (entry *e : batch) {
+      e->state = FLUSHING;
+      if (e->urgent) urgent_--;
+    }
+    inflight_ += batch.size();
+    if (!batch.empty()) stats_.flushes++;
+    stats_.device_writes += batch.size();
+    lock.unlock();
+
+    for (entry *e : batch) _submit(e);
+    for (parked_request *p : send) {
+      p->send();
+      delete p;
+    }
+    lock.lock();
+    if (!send.empty()) {
+      parked_ -= send.size();
+      space_cond_.notify_all();
+    }
+  }
+}
+
+void kvs_writeback::_submit(entry *e) {
+  e->dev_key.key = (void*)e->key.data();
+  e->dev_key.length = e->key.size();
+  e->dev_value.value = e->buf;
+  e->dev_value.length = e->length;
+  e->dev_value.actual_value_size = 0;
+  e->dev_value.offset = 0;
+
+  //the driver drops a key space reference on completion, as for any
+  //asynchronous store. Taken unconditionally, the buffer is flushed after
+  //the key space has been closed to new calls.
+  _kvs_key_space_hold(ks_hd_);
+  kvs_option_store option = { KVS_STORE_POST, NULL };
+  kvs_result ret = (kvs_result)ks_hd_->dev->driver->store_tuple(ks_hd_,
+    &e->dev_key, &e->dev_value, option, this, e, false, _on_flushed);
+  if (ret != KVS_SUCCESS) {
+    _kvs_key_space_io_done(ks_hd_);
+    _complete(e, ret);
+  }
+}
+
+void kvs_writeback::_on_flushed(kvs_postprocess_context *ctx) {
+  kvs_writeback *wb = (kvs_writeback*)ctx->private1;
+  wb->_complete((entry*)ctx->private2, ctx->result);
+}
+
+void kvs_writeback::_complete(entry *e, kvs_result result) {
+  std::vector<waiter> waiters;
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    if (result != KVS_SUCCESS) {
+      stats_.errors++;
+      if (first_error_ == KVS_SUCCESS) first_error_ = result;
+    }
+    bytes_ -= e->key.size() + e->length;
+    auto it = map_.find(e->key);
+    if (it->second == e) map_.erase(it);
+    else it->second->older = NULL;
+    waiters.swap(e->waiters);
+    for (parked_request *p : e->parked) {
+      if (--p->pending == 0 && p->send) ready_.push_back(p);
+    }
+    for (auto &w : waiters) {
+      if (w.done) {
+        *w.result = result;
+        *w.done = true;
+      }
+    }
+    inflight_--;
+    space_cond_.notify_all();
+    done_cond_.notify_all();
+    flush_cond_.notify_one();
+  }
+
+  for (auto &w : waiters) {
+    if (w.done) continue;
+    kvs_postprocess_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.context = KVS_CMD_STORE;
+    ctx.ks_hd = ks_hd_;
+    ctx.key = w.key;
+    ctx.value = w.value;
+    ctx.private1 = w.private1;
+    ctx.private2 = w.private2;
+    ctx.result = result;
+    w.post_fn(&ctx);
+  }
+  _free_entry(e);
+}
@@ -53,6 +53,8 @@ io_cmd::io_cmd(kv_device_internal *dev, kv_namespace_internal *ns, kv_queue_hand
     m_dev = dev;
     m_ns = ns;
     m_cmd_id = 0;  // TODO:REMOVE THIS
+    m_has_deadline = false;
+    m_service_ns = 0;
 
     // submission Q
     ioqueue *que = (ioqueue *)que_hdl->queue;
@@ -110,6 +112,9 @@ kv_result io_cmd::execute_cmd() {
 
     kv_namespace_internal *ns = m_ns;
 
+    // latency outliers configured for the device, if any
+    m_dev->simulate_slow_io(this);
+
     switch(ioctx.opcode) {
         case KV_OPC_GET: {
                 // set result into value
@@ -121,7 +126,7 @@ kv_result io_cmd::execute_cmd() {
         case KV_OPC_STORE: {
                 uint32_t consumed_bytes = 0;
                 op_store_struct_t info = ioctx.command.store_info;
-                ioctx.retcode = ns->kv_store(ioctx.ks_id, ioctx.key, ioctx.value, info.option, &consumed_bytes, (void *) this);
+                ioctx.retcode = ns->kv_store(ioctx.ks_id, ioctx.key, ioctx.value, info.option, info.ttl_ms, &consumed_bytes, (void *) this);
 
                 // kv_namespace_stat ns_st;
                 // ns->kv_get_namespace_stat(&ns_st);
@@ -138,6 +143,13 @@ kv_result io_cmd::execute_cmd() {
                 break;
             }
 
+        case KV_OPC_WRITE_BATCH: {
+                int64_t consumed_bytes = 0;
+                op_write_batch_struct_t info = ioctx.command.write_batch_info;
+                ioctx.retcode = ns->kv_write_batch(ioctx.ks_id, info.ops, info.op_cnt, &consumed_bytes, (void *) this);
+                break;
+            }
+
         case KV_OPC_DELETE_GROUP: {
                 uint64_t reclaimed_bytes = 0;
                 op_delete_group_struct_t info = ioctx.command.delete_group_info;
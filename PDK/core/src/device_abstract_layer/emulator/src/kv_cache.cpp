@@ -0,0 +1,156 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "kv_cache.hpp"
+
+namespace kvadi {
+
+kv_device_cache::kv_device_cache(const config &cfg): m_cfg(cfg), m_generation(1), m_used(0), m_dirty_bytes(0), m_dirty_pairs(0) {
+    memset(&m_stat, 0, sizeof(m_stat));
+}
+
+std::string kv_device_cache::make_id(uint8_t ks_id, const kv_key *key) {
+    std::string id(1, (char)ks_id);
+    id.append((const char *)key->key, key->length);
+    return id;
+}
+
+double kv_device_cache::remove(entry_list_t::iterator it, bool evicted) {
+    double cost = 0;
+    if (is_dirty(*it)) {
+        m_dirty_bytes -= it->size;
+        m_dirty_pairs--;
+        if (evicted) {
+            m_stat.flushed_bytes += it->size;
+            cost = m_cfg.flush_cost;
+        }
+    }
+    if (evicted) m_stat.evictions++;
+    m_used -= it->size;
+    m_index.erase(it->id);
+    m_entries.erase(it);
+    return cost;
+}
+
+double kv_device_cache::make_room(uint32_t size) {
+    double cost = 0;
+    while (!m_entries.empty() && m_used + size > m_cfg.size) {
+        cost += remove(std::prev(m_entries.end()), true);
+    }
+    return cost;
+}
+
+double kv_device_cache::flush() {
+    if (m_dirty_pairs == 0) return 0;
+    const double cost = m_dirty_pairs * m_cfg.flush_cost;
+    m_stat.flushes++;
+    m_stat.flushed_bytes += m_dirty_bytes;
+    m_dirty_bytes = 0;
+    m_dirty_pairs = 0;
+    m_generation++;
+    return cost;
+}
+
+double kv_device_cache::read(uint8_t ks_id, const kv_key *key, uint32_t vlen) {
+    const std::string id = make_id(ks_id, key);
+    auto i = m_index.find(id);
+    if (i != m_index.end()) {
+        if (m_cfg.policy == POLICY_LRU) {
+            m_entries.splice(m_entries.begin(), m_entries, i->second);
+        }
+        m_stat.read_hits++;
+        return m_cfg.hit_cost;
+    }
+
+    m_stat.read_misses++;
+    const uint32_t size = key->length + vlen;
+    if (vlen <= m_cfg.max_value && size <= m_cfg.size) {
+        make_room(size);
+        m_entries.push_front(entry{ id, size, 0 });
+        m_index.emplace(id, m_entries.begin());
+        m_used += size;
+    }
+    return -1;
+}
+
+double kv_device_cache::write(uint8_t ks_id, const kv_key *key, uint32_t vlen) {
+    const std::string id = make_id(ks_id, key);
+    const uint32_t size = key->length + vlen;
+
+    // the old value is overwritten, a dirty one never reaches the media
+    auto i = m_index.find(id);
+    if (i != m_index.end()) remove(i->second, false);
+
+    if (vlen > m_cfg.max_value || size > m_cfg.size) {
+        m_stat.write_through++;
+        return -1;
+    }
+
+    double cost = make_room(size);
+    m_entries.push_front(entry{ id, size, m_generation });
+    m_index.emplace(id, m_entries.begin());
+    m_used += size;
+    m_dirty_bytes += size;
+    m_dirty_pairs++;
+    m_stat.write_absorbed++;
+
+    if (m_dirty_bytes >= m_cfg.write_buffer) {
+        cost += flush();
+    }
+    return m_cfg.write_cost + cost;
+}
+
+void kv_device_cache::erase(uint8_t ks_id, const kv_key *key) {
+    if (m_index.empty()) return;
+    auto i = m_index.find(make_id(ks_id, key));
+    if (i != m_index.end()) remove(i->second, false);
+}
+
+void kv_device_cache::clear(uint8_t ks_id) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+        auto cur = it++;
+        if ((uint8_t)cur->id[0] == ks_id) remove(cur, false);
+    }
+}
+
+void kv_device_cache::get_stat(kv_cache_stat *st) const {
+    *st = m_stat;
+    st->capacity = m_cfg.size;
+    st->used = m_used;
+    st->dirty = m_dirty_bytes;
+    st->pairs = m_entries.size();
+}
+
+} // end of namespace
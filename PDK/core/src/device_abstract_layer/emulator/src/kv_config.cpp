@@ -116,6 +116,9 @@ static std::string opcode_to_string(uint16_t opcode) {
         case KV_OPC_SANITIZE_DEVICE:
             str = "SANITIZE_DEVICE";
             break;
+        case KV_OPC_WRITE_BATCH:
+            str = "WRITE_BATCH";
+            break;
     }
     return str;
 }
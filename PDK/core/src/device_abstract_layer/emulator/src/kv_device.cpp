@@ -92,6 +92,11 @@ kv_device_internal::kv_device_internal(kv_device_init_t *options) {
 
     m_capacity = 7 * GB;
     m_has_fixed_keylen = TRUE;
+    m_slow_io_rate = 0;
+    m_slow_io_us = 2000;
+    m_slow_io_rng.seed(std::random_device()());
+    m_sim = NULL;
+    m_sim_seed = 0;
 
     // load configuration
     // these configurations are only for emulator
@@ -153,6 +158,37 @@ kv_device_internal::kv_device_internal(kv_device_init_t *options) {
         if (!strcasecmp(use_iops_model_str.c_str(), "false")) {
             m_use_iops_model = FALSE;
         }
+
+        // latency outliers, off unless slow_io_rate is set
+        std::string slow_rate_str = m_config->getkv("general", "slow_io_rate");
+        if (!slow_rate_str.empty()) {
+            m_slow_io_rate = std::stod(slow_rate_str);
+        }
+        std::string slow_us_str = m_config->getkv("general", "slow_io_us");
+        if (!slow_us_str.empty()) {
+            m_slow_io_us = std::stoul(slow_us_str);
+        }
+
+        // virtual time simulation, the clock moves when the host polls
+        std::string sim_str = m_config->getkv("general", "simulation");
+        if (!strcasecmp(sim_str.c_str(), "true")) {
+            if (!m_is_poll) {
+                WRITE_WARN("simulation needs polling mode, running in real time\n");
+            } else {
+                uint32_t units = 1;
+                std::string units_str = m_config->getkv("general", "simulation_units");
+                if (!units_str.empty()) {
+                    units = std::stoul(units_str);
+                }
+                m_sim_seed = 1;
+                std::string seed_str = m_config->getkv("general", "simulation_seed");
+                if (!seed_str.empty()) {
+                    m_sim_seed = std::stoul(seed_str);
+                }
+                m_slow_io_rng.seed(m_sim_seed);
+                m_sim = new kv_sim(units);
+            }
+        }
     }
     // XXX TODO how to get capacity or other parameters from a physical device??
     // such as m_has_fixed_keylen, which is used by iterator
@@ -220,6 +256,7 @@ kv_device_internal::~kv_device_internal() {
 
     // shutdown all queues
     shutdown_all_queues();
+    delete m_sim;
 
     // delete default namespace
     auto it = m_ns_list.find(KV_NAMESPACE_DEFAULT);
@@ -494,6 +531,22 @@ kv_result kv_device_internal::kv_get_device_stat(const kv_device_handle dev_hdl,
     return KV_SUCCESS;
 }
 
+kv_result kv_device_internal::kv_get_sim_time(const kv_device_handle dev_hdl, uint64_t *time_ns) {
+    if (dev_hdl == NULL || time_ns == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+    kv_device_internal *dev = (kv_device_internal *) dev_hdl->dev;
+    if (dev == NULL) {
+        return KV_ERR_DEV_NOT_EXIST;
+    }
+    if (!dev->is_simulated()) {
+        return KV_ERR_DD_UNSUPPORTED_CMD;
+    }
+
+    *time_ns = kv_sim::now_ns();
+    return KV_SUCCESS;
+}
+
 ioqueue *kv_device_internal::get_ioqueue(uint16_t qid) {
     std::unordered_map<uint16_t, ioqueue *>::const_iterator it = m_ioque_list.find(qid);
     if (it != m_ioque_list.end()) {
@@ -552,7 +605,7 @@ kv_result kv_device_internal::kv_sanitize(kv_queue_handle que_hdl, kv_device_han
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
 
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
         cmd->ioctx.private_data = post_fn->private_data;
@@ -606,6 +659,9 @@ kv_result kv_device_internal::remove_queue(uint16_t qid) {
     // abort any IOs left, shutdown the queue
     m_ioque_list.erase(qid);
     m_sq_to_cq_pairs.erase(qid);
+    if (m_sim) {
+        m_sim->drop_queue((emul_ioqueue *)que);
+    }
     que->terminate();
     delete que;
     m_device_stat.queue_count--;
@@ -792,6 +848,19 @@ kv_result kv_device_internal::_kv_bypass_namespace(const kv_device_handle dev_hd
     return KV_SUCCESS;
 }
 
+kv_result kv_device_internal::_kv_set_queue_stats(const kv_device_handle dev_hdl, const kv_queue_handle que_hdl, struct kvs_stats_queue *stats) {
+    if (dev_hdl == NULL || que_hdl == NULL || stats == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    ioqueue *que = (ioqueue *)(que_hdl->queue);
+    if (que == NULL) {
+        return KV_ERR_QUEUE_QID_INVALID;
+    }
+
+    return que->set_stats(stats);
+}
+
 kv_result kv_device_internal::kv_get_namespace_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_namespace_stat *ns_stat) {
     if (dev_hdl == NULL || ns_stat == NULL) {
         return KV_ERR_PARAM_INVALID;
@@ -810,6 +879,42 @@ kv_result kv_device_internal::kv_get_namespace_stat(const kv_device_handle dev_h
     return (ns->kv_get_namespace_stat(ns_stat));
 }
 
+kv_result kv_device_internal::kv_get_expiry_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_expiry_stat *st) {
+    if (dev_hdl == NULL || ns_hdl == NULL || st == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    kv_device_internal *dev = (kv_device_internal *) dev_hdl->dev;
+    if (dev == NULL) {
+        return KV_ERR_DEV_NOT_EXIST;
+    }
+
+    kv_namespace_internal *ns = (kv_namespace_internal *) ns_hdl->ns;
+    if (ns == NULL) {
+        return KV_ERR_NS_INVALID;
+    }
+
+    return (ns->kv_get_expiry_stat(st));
+}
+
+kv_result kv_device_internal::kv_get_cache_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_cache_stat *st) {
+    if (dev_hdl == NULL || ns_hdl == NULL || st == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    kv_device_internal *dev = (kv_device_internal *) dev_hdl->dev;
+    if (dev == NULL) {
+        return KV_ERR_DEV_NOT_EXIST;
+    }
+
+    kv_namespace_internal *ns = (kv_namespace_internal *) ns_hdl->ns;
+    if (ns == NULL) {
+        return KV_ERR_NS_INVALID;
+    }
+
+    return (ns->kv_get_cache_stat(st));
+}
+
 // more important IO APIs below
 // operate on a device object, can access kv_device_internal members
 // ASYNC IO in a device context
@@ -846,7 +951,7 @@ kv_result kv_device_internal::kv_purge(kv_queue_handle que_hdl, kv_namespace_han
     info.option = option;
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
         cmd->ioctx.private_data = post_fn->private_data;
@@ -894,7 +999,7 @@ kv_result kv_device_internal::kv_open_iterator(kv_queue_handle que_hdl, kv_names
     }
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     cmd->ioctx.result.hiter = 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
@@ -936,7 +1041,7 @@ kv_result kv_device_internal::kv_close_iterator(kv_queue_handle que_hdl, kv_name
     info.iter_hdl = iter_hdl;
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     cmd->ioctx.result.hiter = iter_hdl;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
@@ -957,6 +1062,21 @@ bool_t kv_device_internal::use_iops_model() {
     return m_use_iops_model;
 }
 
+void kv_device_internal::simulate_slow_io(io_cmd *cmd) {
+    if (m_slow_io_rate <= 0) return;
+    bool slow;
+    {
+        std::lock_guard<std::mutex> lock(m_slow_io_mutex);
+        slow = std::uniform_real_distribution<double>(0, 1)(m_slow_io_rng) < m_slow_io_rate;
+    }
+    if (!slow) return;
+    if (m_sim) {
+        cmd->charge(m_slow_io_us * 1000LL);
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(m_slow_io_us));
+    }
+}
+
 bool_t kv_device_internal::is_keylen_fixed() {
     return m_has_fixed_keylen;
 }
@@ -987,7 +1107,7 @@ kv_result kv_device_internal::kv_iterator_next_set(kv_queue_handle que_hdl, kv_n
     info.iter_hdl = iter_hdl;
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     cmd->ioctx.result.hiter = iter_hdl;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
@@ -1031,7 +1151,7 @@ kv_result kv_device_internal::kv_iterator_next(kv_queue_handle que_hdl, kv_names
     info.iter_hdl = iter_hdl;
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     cmd->ioctx.result.hiter = iter_hdl;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
@@ -1074,7 +1194,7 @@ kv_result kv_device_internal::kv_list_iterators(kv_queue_handle que_hdl, kv_name
     info.iter_cnt = iter_cnt;
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     cmd->ioctx.result.hiter = 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
@@ -1133,7 +1253,7 @@ kv_result kv_device_internal::kv_delete(kv_queue_handle que_hdl, kv_namespace_ha
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
     cmd->ioctx.key = key;
     cmd->ioctx.value = NULL;
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
         cmd->ioctx.private_data = post_fn->private_data;
@@ -1178,7 +1298,7 @@ kv_result kv_device_internal::kv_delete_group(kv_queue_handle que_hdl, kv_namesp
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
     cmd->ioctx.key = NULL;
     cmd->ioctx.value = NULL;
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
         cmd->ioctx.private_data = post_fn->private_data;
@@ -1230,7 +1350,7 @@ kv_result kv_device_internal::kv_exist(kv_queue_handle que_hdl, kv_namespace_han
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
     cmd->ioctx.key = keys;
     cmd->ioctx.value = 0;
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
         cmd->ioctx.private_data = post_fn->private_data;
@@ -1290,7 +1410,7 @@ kv_result kv_device_internal::kv_retrieve(kv_queue_handle que_hdl, kv_namespace_
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
     cmd->ioctx.key = key;
     cmd->ioctx.value = value;
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
         cmd->ioctx.private_data = post_fn->private_data;
@@ -1307,7 +1427,7 @@ kv_result kv_device_internal::kv_retrieve(kv_queue_handle que_hdl, kv_namespace_
 
 
 // Async IO
-kv_result kv_device_internal::kv_store(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option, const kv_postprocess_function *post_fn) {
+kv_result kv_device_internal::kv_store(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option, uint32_t ttl_ms, const kv_postprocess_function *post_fn) {
     if (que_hdl == NULL || ns_hdl == NULL || key == NULL || value == NULL) {
         return KV_ERR_PARAM_INVALID;
     }
@@ -1344,12 +1464,13 @@ kv_result kv_device_internal::kv_store(kv_queue_handle que_hdl, kv_namespace_han
 
     op_store_struct_t info; 
     info.option = option;
+    info.ttl_ms = ttl_ms;
 
     io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
 
     cmd->ioctx.key = key;
     cmd->ioctx.value = const_cast<kv_value *>(value);
-    cmd->ioctx.timeout_usec = 0;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
     if (post_fn) {
         cmd->ioctx.post_fn = post_fn->post_fn;
         cmd->ioctx.private_data = post_fn->private_data;
@@ -1363,6 +1484,63 @@ kv_result kv_device_internal::kv_store(kv_queue_handle que_hdl, kv_namespace_han
     return dev->submit_io(que_hdl, cmd);
 }
 
+kv_result kv_device_internal::kv_write_batch(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, const kv_postprocess_function *post_fn) {
+    if (que_hdl == NULL || ns_hdl == NULL || ops == NULL || op_cnt == 0 || op_cnt > KV_MAX_BATCH_OPS) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    for (uint32_t i = 0; i < op_cnt; i++) {
+        if (ops[i].key == NULL || (ops[i].type == KV_BATCH_OP_STORE && ops[i].value == NULL)) {
+            return KV_ERR_PARAM_INVALID;
+        }
+        const kv_value *value = (ops[i].type == KV_BATCH_OP_STORE) ? ops[i].value : NULL;
+        kv_result res = validate_key_value(ops[i].key, value);
+        if (res != KV_SUCCESS) {
+            return res;
+        }
+    }
+
+    if(ks_id < SAMSUNG_MIN_KEYSPACE_ID || ks_id >= SAMSUNG_MAX_KEYSPACE_CNT){
+          return KV_ERR_KEYSPACE_INVALID;
+    }
+
+    kv_device_internal *dev = (kv_device_internal *) que_hdl->dev;
+    if (dev == NULL) {
+        return KV_ERR_DEV_NOT_EXIST;
+    }
+
+    ioqueue *queue = (ioqueue *)(que_hdl->queue);
+    if (queue == NULL) {
+        return KV_ERR_QUEUE_QID_INVALID;
+    }
+
+    kv_namespace_internal *ns = (kv_namespace_internal *) ns_hdl->ns;
+    if (ns == NULL) {
+        return KV_ERR_NS_INVALID;
+    }
+
+    op_write_batch_struct_t info;
+    info.ops = ops;
+    info.op_cnt = op_cnt;
+
+    io_cmd *cmd = new io_cmd(dev, ns, que_hdl);
+
+    cmd->ioctx.key = NULL;
+    cmd->ioctx.value = NULL;
+    cmd->ioctx.timeout_usec = post_fn ? post_fn->timeout_usec : 0;
+    if (post_fn) {
+        cmd->ioctx.post_fn = post_fn->post_fn;
+        cmd->ioctx.private_data = post_fn->private_data;
+    } else {
+        cmd->ioctx.post_fn = NULL;
+    }
+    cmd->ioctx.opcode = KV_OPC_WRITE_BATCH;
+    cmd->ioctx.command.write_batch_info = info;
+    cmd->ioctx.ks_id = ks_id;
+
+    return dev->submit_io(que_hdl, cmd);
+}
+
 // check if any IO commands are done, and call post process function associated with each command
 // this is called by host application to directly check completion queue
 // host application needs to call this repeatedly
@@ -1376,9 +1554,26 @@ kv_result kv_device_internal::kv_poll_completion(kv_queue_handle que_hdl, uint32
         return KV_ERR_QUEUE_QID_INVALID;
     }
 
+    if (m_sim) {
+        const uint32_t count = std::max(std::min(*num_events, 128u), 1u);
+        return kv_sim::poll((emul_ioqueue *)queue, count, num_events);
+    }
     return queue->poll_completion(timeout_usec, num_events);
 }
 
+kv_result kv_device_internal::kv_cancel(kv_queue_handle que_hdl, bool_t (*match)(const kv_io_context *op, void *arg), void *arg, uint32_t *canceled) {
+    if (que_hdl == NULL || match == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    ioqueue *queue = (ioqueue *)(que_hdl->queue);
+    if (queue == NULL || queue->get_type() != SUBMISSION_Q_TYPE) {
+        return KV_ERR_QUEUE_QID_INVALID;
+    }
+
+    return ((emul_ioqueue *)queue)->cancel(match, arg, canceled);
+}
+
 // set interrupt handler for the device
 // called by host application
 kv_result kv_device_internal::kv_set_interrupt_handler(kv_queue_handle que_hdl, const kv_interrupt_handler int_hdl) {
@@ -1436,6 +1631,18 @@ kv_result kv_device_internal::submit_io(kv_queue_handle que_hdl, io_cmd *cmd) {
         res = KV_ERR_QUEUE_QID_INVALID;
         goto free_io_cmd;
     }
+    if (m_sim) {
+        // runs now, completes in virtual time
+        res = m_sim->submit(eque, cmd);
+        if (res != KV_SUCCESS) {
+            goto free_io_cmd;
+        }
+        return res;
+    }
+    // the deadline counts from here, including time spent waiting for room in the queue
+    if (cmd->ioctx.timeout_usec) {
+        cmd->set_deadline(cmd->ioctx.timeout_usec);
+    }
     res = eque->enqueue(cmd, true);
     if(res != KV_SUCCESS){
         goto free_io_cmd;
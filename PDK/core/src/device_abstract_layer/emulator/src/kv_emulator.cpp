@@ -37,6 +37,7 @@
 #include <string>
 
 #include <time.h>
+#include <chrono>
 #include "io_cmd.hpp"
 #include "kv_emulator.hpp"
 
@@ -46,12 +47,31 @@ namespace kvadi {
 
 static kv_timer kv_emul_timer;
 
-kv_emulator::kv_emulator(uint64_t capacity, std::vector<double> iops_model_coefficients, bool_t use_iops_model, uint32_t nsid): stat(iops_model_coefficients), m_capacity(capacity),m_available(capacity), m_use_iops_model(use_iops_model), m_nsid(nsid) {
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+kv_emulator::kv_emulator(uint64_t capacity, std::vector<double> iops_model_coefficients, bool_t use_iops_model, uint32_t nsid, uint32_t reaper_rate, double batch_failure_rate, double batch_op_cost): stat(iops_model_coefficients), m_capacity(capacity),m_available(capacity), m_use_iops_model(use_iops_model), m_virtual_time(FALSE), m_cache(NULL), m_nsid(nsid), m_reaper_rate(reaper_rate), m_reaper_stop(false), m_batch_failure_rate(batch_failure_rate), m_batch_op_cost(batch_op_cost), m_batch_rng(std::random_device()()) {
     memset(m_iterator_list, 0, sizeof(m_iterator_list));
+    memset(&m_expiry_stat, 0, sizeof(m_expiry_stat));
+    if (m_reaper_rate > 0) {
+        m_reaper = std::thread(&kv_emulator::reaper, this);
+    }
 }
 
 // delete any remaining keys in memory
 kv_emulator::~kv_emulator() {
+    if (m_reaper.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(m_reaper_mutex);
+            m_reaper_stop = true;
+        }
+        m_reaper_cond.notify_one();
+        m_reaper.join();
+    }
+    delete m_cache;
+
     std::unique_lock<std::mutex> lock(m_map_mutex);
     emulator_map_t::iterator it_tmp;
     for(uint32_t i = 0 ; i < SAMSUNG_MAX_KEYSPACE_CNT ; i++){	
@@ -77,10 +97,152 @@ inline kv_key *new_kv_key(const kv_key *key) {
     return copied_key;
 }
 
+// TTL bookkeeping, all called with m_map_mutex held
+
+// replaces the expiry time of a key owned by m_map, ttl_ms of 0 clears it
+void kv_emulator::set_expiry(uint8_t ks_id, kv_key *key, uint32_t ttl_ms) {
+    clear_expiry(ks_id, key);
+    if (ttl_ms == 0) return;
+    auto e = m_expiry[ks_id].emplace(now_ms() + ttl_ms, key);
+    m_expiry_of[ks_id].emplace(key, e);
+}
+
+void kv_emulator::clear_expiry(uint8_t ks_id, kv_key *key) {
+    if (m_expiry_of[ks_id].empty()) return;
+    auto e = m_expiry_of[ks_id].find(key);
+    if (e == m_expiry_of[ks_id].end()) return;
+    m_expiry[ks_id].erase(e->second);
+    m_expiry_of[ks_id].erase(e);
+}
+
+// lazy expiry: drops the pair at it if its time to live has passed and
+// moves it to the next pair
+bool kv_emulator::expire_if_due(uint8_t ks_id, emulator_map_t::iterator &it) {
+    if (m_expiry_of[ks_id].empty()) return false;
+    auto e = m_expiry_of[ks_id].find(it->first);
+    if (e == m_expiry_of[ks_id].end() || e->second->first > now_ms()) return false;
+
+    m_expiry[ks_id].erase(e->second);
+    m_expiry_of[ks_id].erase(e);
+
+    kv_key *key = it->first;
+    m_available += key->length + it->second.length();
+    if (m_cache) m_cache->erase(ks_id, key);
+    it = m_map[ks_id].erase(it);
+    free(key->key);
+    delete key;
+    m_expiry_stat.expired_lazy++;
+    return true;
+}
+
+// deletes up to budget pairs that expired by now_ms, oldest first
+uint32_t kv_emulator::reap(uint64_t now_ms, uint32_t budget) {
+    uint32_t reaped = 0;
+    for (uint32_t ks_id = 0; ks_id < SAMSUNG_MAX_KEYSPACE_CNT && reaped < budget; ks_id++) {
+        auto e = m_expiry[ks_id].begin();
+        while (e != m_expiry[ks_id].end() && e->first <= now_ms && reaped < budget) {
+            kv_key *key = e->second;
+            auto it = m_map[ks_id].find(key);
+            uint32_t len = key->length + it->second.length();
+            m_available += len;
+            m_expiry_stat.reaped_bytes += len;
+            if (m_cache) m_cache->erase(ks_id, key);
+            m_map[ks_id].erase(it);
+            m_expiry_of[ks_id].erase(key);
+            e = m_expiry[ks_id].erase(e);
+            free(key->key);
+            delete key;
+            reaped++;
+        }
+    }
+    m_expiry_stat.reaped += reaped;
+    return reaped;
+}
+
+// token bucket refilled at m_reaper_rate pairs per second, holding at most
+// 100ms worth of tokens so that a backlog is worked off at the configured
+// rate instead of in one burst. The map lock is taken for small batches to
+// keep foreground commands moving.
+void kv_emulator::reaper() {
+    const uint32_t batch = 64;
+    double tokens = 0;
+    uint64_t last = now_ms();
+
+    std::unique_lock<std::mutex> lock(m_reaper_mutex);
+    while (!m_reaper_stop) {
+        m_reaper_cond.wait_for(lock, std::chrono::milliseconds(10));
+        if (m_reaper_stop) break;
+        lock.unlock();
+
+        uint64_t now = now_ms();
+        tokens = std::min(tokens + (now - last) * m_reaper_rate / 1000.0,
+                          m_reaper_rate / 10.0 + 1);
+        last = now;
+        while (tokens >= 1) {
+            uint32_t budget = std::min((uint32_t)tokens, batch);
+            auto start = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> map_lock(m_map_mutex);
+            uint32_t reaped = reap(now, budget);
+            m_expiry_stat.reaper_busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            map_lock.unlock();
+            tokens -= reaped;
+            if (reaped < budget) break;
+        }
+        lock.lock();
+    }
+}
+
+kv_result kv_emulator::get_cache_stat(kv_cache_stat *st) {
+    std::unique_lock<std::mutex> lock(m_map_mutex);
+    if (m_cache == NULL) {
+        memset(st, 0, sizeof(*st));
+    } else {
+        m_cache->get_stat(st);
+    }
+    return KV_SUCCESS;
+}
+
+kv_result kv_emulator::get_expiry_stat(kv_expiry_stat *st) {
+    std::unique_lock<std::mutex> lock(m_map_mutex);
+    *st = m_expiry_stat;
+    st->expiring = 0;
+    for (uint32_t ks_id = 0; ks_id < SAMSUNG_MAX_KEYSPACE_CNT; ks_id++) {
+        st->expiring += m_expiry_of[ks_id].size();
+    }
+    return KV_SUCCESS;
+}
+
+void kv_emulator::use_virtual_time(uint32_t seed) {
+    m_virtual_time = TRUE;
+    m_batch_rng.seed(seed);
+}
+
+void kv_emulator::use_cache(const kv_device_cache::config &cfg) {
+    std::unique_lock<std::mutex> lock(m_map_mutex);
+    delete m_cache;
+    m_cache = new kv_device_cache(cfg);
+}
+
+// the IOPS model latency scaled by what the cache charged, all of it for a
+// command that went to the media
+int64_t kv_emulator::cache_latency(double cache_cost) {
+    const int64_t latency_ns = stat.get_expected_latency_ns();
+    return cache_cost >= 0 ? (int64_t)(latency_ns * cache_cost) : latency_ns;
+}
+
+void kv_emulator::model_latency(struct timespec *begin, int64_t latency_ns, void *ioctx) {
+    if (m_virtual_time) {
+        if (ioctx) ((io_cmd *)ioctx)->charge(latency_ns);
+        return;
+    }
+    kv_emul_timer.wait_until2(begin, latency_ns - _kv_emul_queue_latency);
+}
+
 uint64_t counter = 0;
 // basic operations
 
-kv_result kv_emulator::kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t *consumed_bytes, void *ioctx) {
+kv_result kv_emulator::kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t ttl_ms, uint32_t *consumed_bytes, void *ioctx) {
     (void) ioctx;
     // track consumed spaced
     if (m_capacity <= 0 && m_available < (value->length + key->length)) {
@@ -97,12 +259,16 @@ kv_result kv_emulator::kv_store(uint8_t ks_id, const kv_key *key, const kv_value
     if (m_use_iops_model) {
         kv_emul_timer.start2(&begin);
     }
+    double cache_cost = -1;
     //const uint64_t start_tick = kv_emul_timer.start();
     {
         std::unique_lock<std::mutex> lock(m_map_mutex);
 
 
         auto it = m_map[ks_id].find((kv_key *)key);
+        if (it != m_map[ks_id].end() && expire_if_due(ks_id, it)) {
+            it = m_map[ks_id].end();
+        }
         if (it != m_map[ks_id].end()) {
             if (option == KV_STORE_OPT_IDEMPOTENT) return KV_ERR_KEY_EXIST;
 
@@ -111,6 +277,7 @@ kv_result kv_emulator::kv_store(uint8_t ks_id, const kv_key *key, const kv_value
 
             // overwrite
             it->second = valstr;
+            set_expiry(ks_id, it->first, ttl_ms);
             
             *consumed_bytes = value->length;
             if (m_use_iops_model) {
@@ -120,6 +287,7 @@ kv_result kv_emulator::kv_store(uint8_t ks_id, const kv_key *key, const kv_value
         else {
             kv_key *new_key = new_kv_key(key);
             m_map[ks_id].emplace(std::make_pair(new_key, std::move(valstr)));
+            if (ttl_ms) set_expiry(ks_id, new_key, ttl_ms);
 
             m_available -= key->length + value->length;
 
@@ -129,11 +297,12 @@ kv_result kv_emulator::kv_store(uint8_t ks_id, const kv_key *key, const kv_value
                 stat.collect(STAT_INSERT, value->length);
             }
         }
+        if (m_cache) cache_cost = m_cache->write(ks_id, key, value->length);
         counter ++;
     }
 
     if (m_use_iops_model) {
-        kv_emul_timer.wait_until2(&begin,stat.get_expected_latency_ns() - _kv_emul_queue_latency);
+        model_latency(&begin, cache_latency(cache_cost), ioctx);
     }
 //    kv_emul_timer.wait_until(start_tick, stat.get_expected_latency_ns(), _kv_emul_queue_latency);
 
@@ -154,11 +323,15 @@ kv_result kv_emulator::kv_retrieve(uint8_t ks_id, const kv_key *key, uint8_t opt
         return KV_ERR_OPTION_INVALID;
     }
 
+    double cache_cost = -1;
     //const uint64_t start_tick = kv_emul_timer.start();
     {
 
         std::unique_lock<std::mutex> lock(m_map_mutex);
         auto it = m_map[ks_id].find((kv_key*)key);
+        if (it != m_map[ks_id].end() && expire_if_due(ks_id, it)) {
+            it = m_map[ks_id].end();
+        }
         if (it != m_map[ks_id].end()) {
             uint32_t dlen = it->second.length();
             if(value->offset != 0 && (value->offset >= dlen)){
@@ -179,13 +352,14 @@ kv_result kv_emulator::kv_retrieve(uint8_t ks_id, const kv_key *key, uint8_t opt
             if (m_use_iops_model) {
                 stat.collect(STAT_READ, copylen);
             }
+            if (m_cache) cache_cost = m_cache->read(ks_id, key, dlen);
         } else {
             return KV_ERR_KEY_NOT_EXIST;
         }
     }
     if (m_use_iops_model) {
         //kv_emul_timer.wait_until(start_tick, stat.get_expected_latency_ns(), _kv_emul_queue_latency);
-        kv_emul_timer.wait_until2(&begin,stat.get_expected_latency_ns() - _kv_emul_queue_latency);
+        model_latency(&begin, cache_latency(cache_cost), ioctx);
     }
     return ret;
 }
@@ -215,7 +389,7 @@ kv_result kv_emulator::kv_exist(uint8_t ks_id, const kv_key *key, uint32_t keyco
         const int bitoffset  =  bitpos - setidx * 8;
 
         auto it = m_map[ks_id].find((kv_key*)&key[i]);
-        if (it != m_map[ks_id].end()) {
+        if (it != m_map[ks_id].end() && !expire_if_due(ks_id, it)) {
             buffers[setidx] |= (1 << bitoffset);
         }
     }
@@ -243,6 +417,9 @@ kv_result kv_emulator::kv_purge(uint8_t ks_id, kv_purge_option option, void *ioc
         it++;
         m_map[ks_id].erase(it_tmp);
     }
+    m_expiry[ks_id].clear();
+    m_expiry_of[ks_id].clear();
+    if (m_cache) m_cache->clear(ks_id);
 
     m_available = m_capacity;
     return KV_SUCCESS;
@@ -261,8 +438,13 @@ kv_result kv_emulator::kv_delete(uint8_t ks_id, const kv_key *key, uint8_t optio
 
     std::unique_lock<std::mutex> lock(m_map_mutex);
     auto it = m_map[ks_id].find((kv_key*)key);
+    if (it != m_map[ks_id].end() && expire_if_due(ks_id, it)) {
+        it = m_map[ks_id].end();
+    }
     if (it != m_map[ks_id].end()) {
         kv_key *key = it->first;
+        clear_expiry(ks_id, key);
+        if (m_cache) m_cache->erase(ks_id, key);
 
         uint32_t len = key->length + it->second.length();
         m_available += len;
@@ -282,6 +464,198 @@ kv_result kv_emulator::kv_delete(uint8_t ks_id, const kv_key *key, uint8_t optio
     return KV_SUCCESS;
 }
 
+// true if a key of the batch is in the group of an open iterator that has
+// not reached its end, called with m_map_mutex held
+bool kv_emulator::in_open_iterator_group(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt) {
+    std::unique_lock<std::mutex> lock(m_it_map_mutex);
+    for (const auto &i : m_it_map) {
+        const _kv_iterator_handle *iH = i.second;
+        if (iH->ksid != ks_id || iH->end || m_iterator_list[i.first - 1].is_eof) continue;
+
+        const uint32_t to_match = iH->it_cond.bit_pattern & iH->it_cond.bitmask;
+        for (uint32_t n = 0; n < op_cnt; n++) {
+            uint32_t prefix = 0;
+            memcpy(&prefix, ops[n].key->key, 4);
+            if ((prefix & iH->it_cond.bitmask) == to_match) return true;
+        }
+    }
+    return false;
+}
+
+// undoes a partially applied batch, newest operation first, so that every
+// record finds the key in the state its operation left it in
+void kv_emulator::rollback_batch(uint8_t ks_id, std::vector<batch_undo> &undo) {
+    for (auto u = undo.rbegin(); u != undo.rend(); ++u) {
+        if (!u->existed) {
+            m_map[ks_id].erase(u->key);
+            free(u->key->key);
+            delete u->key;
+            continue;
+        }
+
+        if (u->removed) {
+            m_map[ks_id].emplace(u->key, std::move(u->value));
+        } else {
+            m_map[ks_id].find(u->key)->second = std::move(u->value);
+            clear_expiry(ks_id, u->key);
+        }
+        if (u->expiry_ms) {
+            auto e = m_expiry[ks_id].emplace(u->expiry_ms, u->key);
+            m_expiry_of[ks_id].emplace(u->key, e);
+        }
+    }
+    undo.clear();
+}
+
+// Applies a batch in one critical section on m_map_mutex, so no other
+// command can see part of it. Every change is logged first so that a
+// failing operation, or an injected failure, rolls the whole batch back.
+kv_result kv_emulator::kv_write_batch(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, int64_t *consumed_bytes, void *ioctx) {
+    (void) ioctx;
+
+    if (ops == NULL || op_cnt == 0 || op_cnt > KV_MAX_BATCH_OPS) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    // copy the values before taking the lock, as kv_store() does
+    std::vector<std::string> values(op_cnt);
+    for (uint32_t i = 0; i < op_cnt; i++) {
+        if (ops[i].key == NULL || ops[i].key->key == NULL) {
+            return KV_ERR_KEY_INVALID;
+        }
+        if (ops[i].type == KV_BATCH_OP_STORE) {
+            if (ops[i].value == NULL) return KV_ERR_PARAM_INVALID;
+            values[i].assign((char *)ops[i].value->value, ops[i].value->length);
+        } else if (ops[i].type != KV_BATCH_OP_DELETE) {
+            return KV_ERR_OPTION_INVALID;
+        }
+    }
+
+    struct timespec begin;
+    if (m_use_iops_model) {
+        kv_emul_timer.start2(&begin);
+    }
+
+    kv_result ret = KV_SUCCESS;
+    std::vector<batch_undo> undo;
+    undo.reserve(op_cnt);
+    uint32_t media_ops = op_cnt;
+    double cache_cost = 0;
+    {
+        std::unique_lock<std::mutex> lock(m_map_mutex);
+        if (in_open_iterator_group(ks_id, ops, op_cnt)) {
+            return KV_ERR_ITERATOR_IN_PROGRESS;
+        }
+
+        uint32_t fail_at = op_cnt;
+        if (m_batch_failure_rate > 0 &&
+            std::uniform_real_distribution<double>(0, 1)(m_batch_rng) < m_batch_failure_rate) {
+            fail_at = std::uniform_int_distribution<uint32_t>(0, op_cnt - 1)(m_batch_rng);
+        }
+
+        const uint64_t available = m_available;
+        for (uint32_t i = 0; i < op_cnt; i++) {
+            if (i == fail_at) {
+                ret = KV_ERR_SYS_IO;
+                break;
+            }
+
+            const kv_batch_op &op = ops[i];
+            auto it = m_map[ks_id].find((kv_key *)op.key);
+            if (it != m_map[ks_id].end() && expire_if_due(ks_id, it)) {
+                it = m_map[ks_id].end();
+            }
+
+            if (op.type == KV_BATCH_OP_DELETE) {
+                if (it == m_map[ks_id].end()) continue;
+
+                kv_key *key = it->first;
+                batch_undo u = { key, true, true, std::move(it->second), 0 };
+                auto e = m_expiry_of[ks_id].find(key);
+                if (e != m_expiry_of[ks_id].end()) u.expiry_ms = e->second->first;
+                clear_expiry(ks_id, key);
+
+                m_available += key->length + u.value.length();
+                m_map[ks_id].erase(it);
+                undo.push_back(std::move(u));
+                continue;
+            }
+
+            if (m_capacity <= 0 && m_available < (op.value->length + op.key->length)) {
+                ret = KV_ERR_DEV_CAPACITY;
+                break;
+            }
+
+            if (it != m_map[ks_id].end()) {
+                kv_key *key = it->first;
+                batch_undo u = { key, true, false, std::move(it->second), 0 };
+                auto e = m_expiry_of[ks_id].find(key);
+                if (e != m_expiry_of[ks_id].end()) u.expiry_ms = e->second->first;
+                clear_expiry(ks_id, key);
+
+                m_available -= values[i].length() - u.value.length();
+                it->second = std::move(values[i]);
+                undo.push_back(std::move(u));
+                if (m_use_iops_model) {
+                    stat.collect(STAT_UPDATE, op.value->length);
+                }
+            } else {
+                kv_key *new_key = new_kv_key(op.key);
+                m_map[ks_id].emplace(new_key, std::move(values[i]));
+                m_available -= op.key->length + op.value->length;
+                undo.push_back(batch_undo{ new_key, false, false, std::string(), 0 });
+                if (m_use_iops_model) {
+                    stat.collect(STAT_INSERT, op.value->length);
+                }
+            }
+        }
+
+        if (ret != KV_SUCCESS) {
+            rollback_batch(ks_id, undo);
+            m_available = available;
+        } else if (consumed_bytes != NULL) {
+            *consumed_bytes = (int64_t)(available - m_available);
+        }
+
+        // the cache sees a batch only once it committed
+        if (ret == KV_SUCCESS && m_cache) {
+            for (uint32_t i = 0; i < op_cnt; i++) {
+                if (ops[i].type == KV_BATCH_OP_DELETE) {
+                    m_cache->erase(ks_id, ops[i].key);
+                    continue;
+                }
+                const double cost = m_cache->write(ks_id, ops[i].key, ops[i].value->length);
+                if (cost >= 0) {
+                    cache_cost += cost;
+                    media_ops--;
+                }
+            }
+        }
+    }
+
+    // the pairs a committed batch deleted are only freed now, the undo log
+    // owned them until then
+    for (auto &u : undo) {
+        if (u.removed) {
+            free(u.key->key);
+            delete u.key;
+        }
+    }
+
+    // one command for the whole batch: the first operation costs a full
+    // command, the others only their share of the media work. Stores the
+    // write buffer absorbed cost what the cache charged for them instead.
+    if (m_use_iops_model) {
+        double scale = cache_cost;
+        if (media_ops > 0) {
+            scale += 1 + (media_ops - 1) * m_batch_op_cost;
+        }
+        model_latency(&begin, (int64_t)(stat.get_expected_latency_ns() * scale), ioctx);
+    }
+
+    return ret;
+}
+
 // iterator
 kv_result kv_emulator::kv_open_iterator(uint8_t ks_id, const kv_iterator_option opt, const kv_group_condition *cond, bool_t keylen_fixed, kv_iterator_handle *iter_hdl, void *ioctx) {
     (void) ioctx;
@@ -386,6 +760,8 @@ kv_result kv_emulator::kv_iterator_next_set(kv_iterator_handle iter_handle_id, k
     int8_t ks_id = iter_hdl->ksid;
     auto it = m_map[ks_id].lower_bound(&key);
     while (it != m_map[ks_id].end()) {
+        if (expire_if_due(ks_id, it)) continue;
+
         const int klength = it->first->length;
         const int vlength = it->second.length();
 
@@ -440,6 +816,8 @@ kv_result kv_emulator::kv_iterator_next_set(kv_iterator_handle iter_handle_id, k
         counter++;
 
         if (delete_value) {
+            clear_expiry(ks_id, it->first);
+            if (m_cache) m_cache->erase(ks_id, it->first);
             it = m_map[ks_id].erase(it);
         } else {
             it++;
@@ -490,6 +868,7 @@ kv_result kv_emulator::kv_iterator_next(kv_iterator_handle iter_handle_id, kv_ke
     uint32_t prefix = 0;
     int8_t ks_id = iter_hdl->ksid;
     auto it = m_map[ks_id].lower_bound(&key1);
+    while (it != m_map[ks_id].end() && expire_if_due(ks_id, it));
 
     // the end
     if (it == m_map[ks_id].end()) {
@@ -543,6 +922,8 @@ kv_result kv_emulator::kv_iterator_next(kv_iterator_handle iter_handle_id, kv_ke
 
     // delete the identified key, it points to next element
     if (delete_value) {
+        clear_expiry(ks_id, it->first);
+        if (m_cache) m_cache->erase(ks_id, it->first);
         it = m_map[ks_id].erase(it);
     } else {
         it++;
@@ -636,8 +1017,8 @@ kv_result kv_emulator::kv_delete_group(uint8_t ks_id, kv_group_condition *grp_co
         memcpy(&prefix, it->first->key, 4);
 
         // validate, if it no longer match, then we are done
-        // as the map is ordered by leading 4 byte as integer
-        // in ascending order
+        // as keys sharing their leading 4 bytes are adjacent
+        // in the map (see kv_key_order.hpp)
         if (((prefix & grp_cond->bitmask) & grp_cond->bit_pattern) != to_match ) {
             return KV_SUCCESS;
         }
@@ -645,6 +1026,8 @@ kv_result kv_emulator::kv_delete_group(uint8_t ks_id, kv_group_condition *grp_co
         // update reclaimed space first
         kv_key *k = it->first;
         m_available += k->length + it->second.length();
+        clear_expiry(ks_id, k);
+        if (m_cache) m_cache->erase(ks_id, k);
 
         it_tmp = it;
         it++;
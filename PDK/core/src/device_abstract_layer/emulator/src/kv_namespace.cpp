@@ -31,6 +31,7 @@
  *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
 #include <boost/tokenizer.hpp>
 #include "kvs_adi.h"
 #include "kvs_adi_internal.h"
@@ -41,6 +42,51 @@
 
 namespace kvadi {
 
+// a size of the configuration file in bytes, with an optional KB, MB or GB
+// unit
+static uint64_t parse_size(const std::string &str, uint64_t def) {
+    if (str.empty()) return def;
+
+    std::size_t pos = 0;
+    uint64_t size = std::stoull(str, &pos, 10);
+    std::string unit = str.substr(pos);
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::tolower);
+    if (unit.find("gb") != std::string::npos) {
+        size *= 1024 * 1024 * 1024ull;
+    } else if (unit.find("mb") != std::string::npos) {
+        size *= 1024 * 1024;
+    } else if (unit.find("kb") != std::string::npos) {
+        size *= 1024;
+    }
+    return size;
+}
+
+// the device cache model, off unless cache_size is set
+static bool get_cache_config(kv_config *devconfig, kv_device_cache::config *cfg) {
+    cfg->size = parse_size(devconfig->getkv("general", "cache_size"), 0);
+    if (cfg->size == 0) return false;
+
+    cfg->policy = kv_device_cache::POLICY_LRU;
+    std::string policy = devconfig->getkv("general", "cache_policy");
+    if (!strcasecmp(policy.c_str(), "fifo")) {
+        cfg->policy = kv_device_cache::POLICY_FIFO;
+    } else if (!policy.empty() && strcasecmp(policy.c_str(), "lru")) {
+        WRITE_WARN("unknown cache_policy %s, use lru\n", policy.c_str());
+    }
+
+    cfg->max_value = parse_size(devconfig->getkv("general", "cache_max_value"), 4096);
+    cfg->write_buffer = parse_size(devconfig->getkv("general", "cache_write_buffer"), 4 * 1024 * 1024);
+
+    // relative to the IOPS model latency of a command
+    std::string str = devconfig->getkv("general", "cache_hit_cost");
+    cfg->hit_cost = str.empty() ? 0.1 : std::stod(str);
+    str = devconfig->getkv("general", "cache_write_cost");
+    cfg->write_cost = str.empty() ? 0.1 : std::stod(str);
+    str = devconfig->getkv("general", "cache_flush_cost");
+    cfg->flush_cost = str.empty() ? 0.5 : std::stod(str);
+    return true;
+}
+
 kv_device_api *kv_namespace_internal::get_kvstore() {
     return m_kvstore;
 }
@@ -90,8 +136,40 @@ kv_namespace_internal::kv_namespace_internal(kv_device_internal *dev, uint32_t n
             }
         }
 
+        // expired pairs the background reaper may delete per second,
+        // 0 leaves them to lazy expiry
+        uint32_t reaper_rate = 10000;
+        std::string reaper_str = devconfig->getkv("general", "ttl_reaper_rate");
+        if (reaper_str.size() > 0) {
+            reaper_rate = std::stoul(reaper_str);
+        }
+
+        // fraction of write batches to fail midway and roll back, for
+        // testing crash atomicity
+        double batch_failure_rate = 0;
+        std::string failure_str = devconfig->getkv("general", "batch_failure_rate");
+        if (failure_str.size() > 0) {
+            batch_failure_rate = std::stod(failure_str);
+        }
+
+        // modeled latency of each write batch operation after the first,
+        // as a fraction of the latency of a single command
+        double batch_op_cost = 0.25;
+        std::string op_cost_str = devconfig->getkv("general", "batch_op_cost");
+        if (op_cost_str.size() > 0) {
+            batch_op_cost = std::stod(op_cost_str);
+        }
+
         // allocate kvstore
-        m_emul = new kv_emulator(m_ns_stat.capacity, iops_model_parameters, use_iops_model, nsid);
+        kv_emulator *emul = new kv_emulator(m_ns_stat.capacity, iops_model_parameters, use_iops_model, nsid, reaper_rate, batch_failure_rate, batch_op_cost);
+        if (dev->is_simulated()) {
+            emul->use_virtual_time(dev->get_sim_seed());
+        }
+        kv_device_cache::config cache_cfg;
+        if (get_cache_config(devconfig, &cache_cfg)) {
+            emul->use_cache(cache_cfg);
+        }
+        m_emul = emul;
 
         m_dummy   = new kv_noop_emulator(m_ns_stat.capacity);
         m_kvstore = m_emul;
@@ -109,7 +187,8 @@ kv_namespace_internal::kv_namespace_internal(kv_device_internal *dev, uint32_t n
 }
 
 kv_namespace_internal::~kv_namespace_internal() {
-    if (m_kvstore) delete m_kvstore;
+    // m_kvstore points at one of these, depending on the bypass setting
+    if (m_emul) delete m_emul;
     if (m_dummy) delete m_dummy;
 }
 
@@ -130,6 +209,20 @@ kv_result kv_namespace_internal::kv_get_namespace_info(kv_namespace *nsinfo) {
     return KV_SUCCESS;
 }
 
+kv_result kv_namespace_internal::kv_get_expiry_stat(kv_expiry_stat *st) {
+    if (st == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+    return m_kvstore->get_expiry_stat(st);
+}
+
+kv_result kv_namespace_internal::kv_get_cache_stat(kv_cache_stat *st) {
+    if (st == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+    return m_kvstore->get_cache_stat(st);
+}
+
 kv_result kv_namespace_internal::kv_get_namespace_stat(kv_namespace_stat *ns_st) {
     if (ns_st == NULL) {
         return KV_ERR_PARAM_INVALID;
@@ -165,7 +258,7 @@ kv_result kv_namespace_internal::kv_purge(uint8_t ks_id,kv_purge_option option,
 
 
 // directly work with kvstore
-kv_result kv_namespace_internal::kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t *consumed_bytes, void *ioctx) {
+kv_result kv_namespace_internal::kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t ttl_ms, uint32_t *consumed_bytes, void *ioctx) {
     if (key == NULL || value == NULL) {
         return KV_ERR_PARAM_INVALID;
     }
@@ -174,7 +267,7 @@ kv_result kv_namespace_internal::kv_store(uint8_t ks_id, const kv_key *key, cons
         return KV_ERR_KEYSPACE_INVALID;
     }
 
-    kv_result res = m_kvstore->kv_store(ks_id, key, value, option, consumed_bytes, ioctx);
+    kv_result res = m_kvstore->kv_store(ks_id, key, value, option, ttl_ms, consumed_bytes, ioctx);
 
     if (res == KV_SUCCESS && consumed_bytes != NULL) {
         // update capacity
@@ -202,6 +295,24 @@ kv_result kv_namespace_internal::kv_delete(uint8_t ks_id, const kv_key *key, uin
     return res;
 }
 
+kv_result kv_namespace_internal::kv_write_batch(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, int64_t *consumed_bytes, void *ioctx) {
+    if (ops == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    if(ks_id <SAMSUNG_MIN_KEYSPACE_ID || ks_id >= SAMSUNG_MAX_KEYSPACE_CNT){
+        return KV_ERR_KEYSPACE_INVALID;
+    }
+
+    kv_result res = m_kvstore->kv_write_batch(ks_id, ops, op_cnt, consumed_bytes, ioctx);
+
+    if (res == KV_SUCCESS && consumed_bytes != NULL) {
+        // update capacity
+        m_ns_stat.unallocated_capacity -= *consumed_bytes;
+    }
+    return res;
+}
+
 
 kv_result kv_namespace_internal::kv_exist(uint8_t ks_id, const kv_key *key, uint32_t keycount, uint8_t *value, uint32_t &valuesize, void *ioctx) {
     if (key == NULL || value== NULL) {
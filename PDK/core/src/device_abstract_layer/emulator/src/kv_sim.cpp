@@ -0,0 +1,180 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <queue>
+
+#include "kv_sim.hpp"
+#include "io_cmd.hpp"
+#include "queue.hpp"
+
+namespace kvadi {
+
+namespace {
+
+struct sim_event {
+    uint64_t time;
+    uint64_t seq;      // submission order, breaks ties
+    kv_sim *sim;
+    io_cmd *cmd;
+
+    bool operator>(const sim_event &e) const {
+        return (time != e.time) ? time > e.time : seq > e.seq;
+    }
+};
+
+typedef std::priority_queue<sim_event, std::vector<sim_event>, std::greater<sim_event> > event_queue;
+
+// the clock and the scheduled completions of every completion queue are
+// shared by all simulated devices
+std::mutex s_mutex;
+uint64_t s_now = 0;
+uint64_t s_seq = 0;
+std::unordered_map<emul_ioqueue *, event_queue> s_events;
+
+}
+
+kv_sim::kv_sim(uint32_t units) : m_unit_free(std::max(units, 1u), 0) {
+}
+
+kv_sim::~kv_sim() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (auto &it : s_events) {
+        event_queue kept;
+        while (!it.second.empty()) {
+            const sim_event &e = it.second.top();
+            if (e.sim == this) {
+                delete e.cmd;
+            } else {
+                kept.push(e);
+            }
+            it.second.pop();
+        }
+        it.second.swap(kept);
+    }
+}
+
+uint64_t kv_sim::now_ns() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_now;
+}
+
+kv_result kv_sim::submit(emul_ioqueue *sq, io_cmd *cmd) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    kv_queue info;
+    sq->kv_get_queue_info(&info);
+    std::deque<uint64_t> &starts = m_starts[sq];
+    while (!starts.empty() && starts.front() <= s_now) {
+        starts.pop_front();
+    }
+    if (starts.size() >= info.queue_size) {
+        return KV_ERR_QUEUE_IS_FULL;
+    }
+
+    auto unit = std::min_element(m_unit_free.begin(), m_unit_free.end());
+    const uint64_t start = std::max(*unit, s_now);
+    uint64_t done = start;
+
+    const uint64_t timeout_ns = cmd->ioctx.timeout_usec * 1000ULL;
+    if (timeout_ns && start > s_now + timeout_ns) {
+        // dropped without running it, as the queue thread does
+        cmd->set_retcode(KV_ERR_DEADLINE_EXCEEDED);
+    } else {
+        cmd->execute_cmd();
+        done = start + cmd->service_ns();
+        *unit = done;
+    }
+    starts.push_back(start);
+
+    emul_ioqueue *out = sq->get_out_queue();
+    if (out == NULL) {
+        delete cmd;
+        return KV_SUCCESS;
+    }
+    s_events[out].push(sim_event{done, s_seq++, this, cmd});
+    return KV_SUCCESS;
+}
+
+kv_result kv_sim::poll(emul_ioqueue *cq, uint32_t max, uint32_t *completed) {
+    std::vector<io_cmd *> done;
+    bool more = false;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto it = s_events.find(cq);
+        if (it != s_events.end() && !it->second.empty()) {
+            event_queue &events = it->second;
+            if (events.top().time > s_now) {
+                // nothing of cq is due: the clock moves to the next
+                // completion still ahead on any queue. Queues that already
+                // hold a due completion are waiting for their host and do
+                // not hold the clock back
+                uint64_t next = events.top().time;
+                for (auto &q : s_events) {
+                    if (!q.second.empty() && q.second.top().time > s_now)
+                        next = std::min(next, q.second.top().time);
+                }
+                s_now = next;
+            }
+            while (!events.empty() && events.top().time <= s_now && done.size() < max) {
+                done.push_back(events.top().cmd);
+                events.pop();
+            }
+            more = !events.empty();
+        }
+    }
+
+    // outside the lock, post process functions submit new commands
+    for (io_cmd *cmd : done) {
+        cmd->call_post_process_func();
+        delete cmd;
+    }
+    *completed = done.size();
+    return more ? KV_WRN_MORE : KV_SUCCESS;
+}
+
+void kv_sim::drop_queue(emul_ioqueue *que) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    m_starts.erase(que);
+    auto it = s_events.find(que);
+    if (it == s_events.end()) return;
+    while (!it->second.empty()) {
+        delete it->second.top().cmd;
+        it->second.pop();
+    }
+    s_events.erase(it);
+}
+
+} // end of namespace
@@ -72,6 +72,10 @@ kv_result kv_get_device_stat(const kv_device_handle dev_hdl, kv_device_stat *dev
     return kv_device_internal::kv_get_device_stat(dev_hdl, dev_st);
 }
 
+kv_result kv_get_sim_time(const kv_device_handle dev_hdl, uint64_t *time_ns) {
+    return kv_device_internal::kv_get_sim_time(dev_hdl, time_ns);
+}
+
 kv_result kv_sanitize(kv_queue_handle que_hdl, kv_device_handle dev_hdl, kv_sanitize_option option, kv_sanitize_pattern *pattern, kv_postprocess_function *post_fn)
 {
     return kv_device_internal::kv_sanitize(que_hdl, dev_hdl, option, pattern, post_fn);
@@ -127,11 +131,23 @@ kv_result kv_get_namespace_stat(const kv_device_handle dev_hdl, const kv_namespa
     return kv_device_internal::kv_get_namespace_stat(dev_hdl, ns_hdl, ns_st);
 }
 
+kv_result kv_get_expiry_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_expiry_stat *st) {
+    return kv_device_internal::kv_get_expiry_stat(dev_hdl, ns_hdl, st);
+}
+
+kv_result kv_get_cache_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_cache_stat *st) {
+    return kv_device_internal::kv_get_cache_stat(dev_hdl, ns_hdl, st);
+}
+
 // internal API, added for an emulator
 kv_result _kv_bypass_namespace(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, bool_t bypass) {
     return kv_device_internal::_kv_bypass_namespace(dev_hdl, ns_hdl, bypass);
 }
 
+kv_result _kv_set_queue_stats(const kv_device_handle dev_hdl, const kv_queue_handle que_hdl, struct kvs_stats_queue *stats) {
+    return kv_device_internal::_kv_set_queue_stats(dev_hdl, que_hdl, stats);
+}
+
 // IO APIs
 kv_result kv_purge(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, kv_purge_option option, kv_postprocess_function *post_fn) {
 
@@ -235,7 +251,39 @@ kv_result kv_store(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl,
     }
 
     kv_device_internal *dev = (kv_device_internal *) que_hdl->dev;
-    return (dev->kv_store(que_hdl, ns_hdl, ks_id, key, value, option, post_fn));
+    return (dev->kv_store(que_hdl, ns_hdl, ks_id, key, value, option, 0, post_fn));
+}
+
+kv_result kv_store_ttl(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl,
+  uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option,
+  uint32_t ttl_ms, const kv_postprocess_function *post_fn) {
+    if (que_hdl == NULL || ns_hdl == NULL || key == NULL || value == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    kv_device_internal *dev = (kv_device_internal *) que_hdl->dev;
+    return (dev->kv_store(que_hdl, ns_hdl, ks_id, key, value, option, ttl_ms, post_fn));
+}
+
+kv_result kv_write_batch(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl,
+  uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt,
+  const kv_postprocess_function *post_fn) {
+    if (que_hdl == NULL || ns_hdl == NULL || ops == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    kv_device_internal *dev = (kv_device_internal *) que_hdl->dev;
+    return (dev->kv_write_batch(que_hdl, ns_hdl, ks_id, ops, op_cnt, post_fn));
+}
+
+kv_result kv_cancel(kv_queue_handle que_hdl, bool_t (*match)(const kv_io_context *op, void *arg),
+  void *arg, uint32_t *canceled) {
+    if (que_hdl == NULL || match == NULL) {
+        return KV_ERR_PARAM_INVALID;
+    }
+
+    kv_device_internal *dev = (kv_device_internal *) que_hdl->dev;
+    return (dev->kv_cancel(que_hdl, match, arg, canceled));
 }
 
 kv_result kv_poll_completion(kv_queue_handle que_hdl, uint32_t timeout_usec, uint32_t *num_events) {
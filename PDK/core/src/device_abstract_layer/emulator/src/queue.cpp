@@ -41,7 +41,7 @@ static void process_submitted_commands(void *que);
 static void process_interrupts(void *que);
 
 emul_ioqueue::emul_ioqueue(const kv_queue *queinfo_,  kv_device_internal *dev, emul_ioqueue *out_):
-    ioqueue(queinfo_), shutdown(false), out(out_), queue(queinfo_->queue_size)
+    ioqueue(queinfo_), shutdown(false), out(out_), queue(queinfo_->queue_size), deadlines(0), stats(0)
 {
     this->kvstore = dev->get_namespace(KV_NAMESPACE_DEFAULT)->get_kvstore();
     if ( this->queinfo.queue_type ==  SUBMISSION_Q_TYPE) {
@@ -65,18 +65,105 @@ kv_result emul_ioqueue::init_interrupt_handler(kv_device_internal *dev, const kv
 }
 
 
+// moves the commands drop() is true for to removed and keeps the order of
+// the others, called with list_mutex held
+template <typename Pred>
+void emul_ioqueue::remove_queued(Pred drop, std::vector<io_cmd*> &removed) {
+    auto keep = queue.begin();
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+        if (drop(*it)) {
+            if ((*it)->has_deadline()) deadlines--;
+            removed.push_back(*it);
+        } else {
+            *keep++ = *it;
+        }
+    }
+    if (keep != queue.end()) {
+        queue.erase_end(queue.end() - keep);
+        cond_notfull.notify_all();
+    }
+    if (stats && !removed.empty()) update_stats(0, removed.size());
+}
+
+void emul_ioqueue::update_stats(uint64_t enqueued, uint64_t dequeued) {
+    const uint64_t depth = queue.size();
+    uint32_t s = kvs_stats_write_begin(&stats->seq);
+    if (enqueued) {
+        kvs_stats_add(&stats->enqueued, enqueued);
+        // the commands already waiting
+        kvs_stats_add(&stats->depth_hist[kvs_stats_log2(depth - 1, KVS_STATS_DEPTH_BUCKETS)], 1);
+        if (depth > stats->max_depth) kvs_stats_set(&stats->max_depth, depth);
+    }
+    if (dequeued) kvs_stats_add(&stats->dequeued, dequeued);
+    kvs_stats_set(&stats->depth, depth);
+    kvs_stats_write_end(&stats->seq, s);
+}
+
+kv_result emul_ioqueue::set_stats(kvs_stats_queue *stats_) {
+    std::unique_lock<std::mutex> lock(list_mutex);
+    uint32_t s = kvs_stats_write_begin(&stats_->seq);
+    __atomic_store_n(&stats_->queue_id, (uint16_t)get_qid(), __ATOMIC_RELAXED);
+    __atomic_store_n(&stats_->queue_type, (uint16_t)get_type(), __ATOMIC_RELAXED);
+    kvs_stats_set(&stats_->depth, queue.size());
+    kvs_stats_write_end(&stats_->seq, s);
+    this->stats = stats_;
+    return KV_SUCCESS;
+}
+
+void emul_ioqueue::complete_dropped(std::vector<io_cmd*> &cmds, kv_result retcode) {
+    for (io_cmd *cmd : cmds) {
+        cmd->set_retcode(retcode);
+        if (out) {
+            out->enqueue(cmd);
+        } else {
+            delete cmd;
+        }
+    }
+}
+
 kv_result emul_ioqueue::enqueue (io_cmd *cmd, bool block ) {
     std::unique_lock<std::mutex> lock(list_mutex);
     if (shutdown) return KV_ERR_QUEUE_IN_SHUTDOWN;
     while (queue.full() && !need_shutdown()) {
+        // commands that can no longer be dispatched in time give their
+        // room back at once, and so does this one if it has expired
+        if (out && (deadlines > 0 || cmd->has_deadline())) {
+            const auto now = std::chrono::steady_clock::now();
+            std::vector<io_cmd*> expired;
+            remove_queued([now](io_cmd *c) { return c->expired(now); }, expired);
+            const bool dropped = cmd->expired(now);
+            if (dropped) expired.push_back(cmd);
+            if (!expired.empty()) {
+                lock.unlock();
+                complete_dropped(expired, KV_ERR_DEADLINE_EXCEEDED);
+                if (dropped) return KV_SUCCESS;
+                lock.lock();
+                continue;
+            }
+        }
         if  (!block) return KV_ERR_QUEUE_IS_FULL;
         cond_notfull.wait_for(lock, std::chrono::microseconds(10));
     }
+    if (out && cmd->has_deadline()) deadlines++;
     queue.push_back(cmd);
+    if (stats) update_stats(1, 0);
     cond_notempty.notify_one();
     return KV_SUCCESS;
 }
 
+kv_result emul_ioqueue::cancel(bool_t (*match)(const kv_io_context *op, void *arg), void *arg, uint32_t *canceled) {
+    std::vector<io_cmd*> removed;
+    {
+        std::unique_lock<std::mutex> lock(list_mutex);
+        remove_queued([match, arg](io_cmd *c) {
+            return match((const kv_io_context *)&c->ioctx, arg) != FALSE;
+        }, removed);
+    }
+    complete_dropped(removed, KV_ERR_CANCELED);
+    if (canceled) *canceled = removed.size();
+    return KV_SUCCESS;
+}
+
 kv_result  emul_ioqueue::dequeue(io_cmd **cmd, bool block, uint32_t timeout_usec) {
     std::unique_lock<std::mutex> lock(list_mutex);
     while (queue.empty()  && !need_shutdown()) {
@@ -95,6 +182,8 @@ kv_result  emul_ioqueue::dequeue(io_cmd **cmd, bool block, uint32_t timeout_usec
     if (need_shutdown()) return KV_ERR_QUEUE_IN_SHUTDOWN;
 
     (*cmd) = queue.front(); queue.pop_front();
+    if (out && (*cmd)->has_deadline()) deadlines--;
+    if (stats) update_stats(0, 1);
     cond_notfull.notify_one();
     return KV_SUCCESS;
 }
@@ -160,7 +249,12 @@ static void process_submitted_commands(void *que_)
         cmd->evicted_i = std::chrono::system_clock::now();
 #endif
 
-        cmd->execute_cmd();
+        if (cmd->has_deadline() && cmd->expired(std::chrono::steady_clock::now())) {
+            // dropped without running it
+            cmd->set_retcode(KV_ERR_DEADLINE_EXCEEDED);
+        } else {
+            cmd->execute_cmd();
+        }
 
         emul_ioqueue *out = que->get_out_queue();
         if (out)
@@ -139,6 +139,12 @@ typedef int32_t kv_result;
 
 //device does not support the specified keyspace
 #define KV_ERR_KEYSPACE_INVALID        0x031
+//a write batch touches a key in the group of an open iterator
+#define KV_ERR_ITERATOR_IN_PROGRESS    0x032
+//the command was not dispatched before its deadline and was dropped
+#define KV_ERR_DEADLINE_EXCEEDED       0x033
+//the command was removed from its submission queue by kv_cancel()
+#define KV_ERR_CANCELED                0x034
 
 /**
  * \mainpage A libary for Samsung Key-Value Storage ADI
@@ -173,6 +179,7 @@ typedef enum cmd_opcode_t {
     KV_OPC_LIST_ITERATOR = 11,
     KV_OPC_DELETE_GROUP = 12,
     KV_OPC_ITERATE_NEXT_SINGLE_KV  = 13,
+    KV_OPC_WRITE_BATCH = 14,
 } cmd_opcode_t;
 
 /** 
@@ -337,6 +344,19 @@ typedef enum {
   KV_STORE_OPT_APPEND = 0x04,
 } kv_store_option;
 
+/**
+ * kv_batch_op_type
+ */
+typedef enum {
+  KV_BATCH_OP_STORE  = 0x00, ///< store a key value pair, overwriting an existing value
+  KV_BATCH_OP_DELETE = 0x01, ///< delete a key value pair, a missing key is not an error
+} kv_batch_op_type;
+
+/**
+  KV_MAX_BATCH_OPS defines the maximum number of operations in a write batch (kv_write_batch()).
+ */
+#define KV_MAX_BATCH_OPS 1024
+
 /**
  * kv_device structure represents a controller and has device-wide information.
  */
@@ -464,6 +484,46 @@ typedef struct {
   uint64_t unallocated_capacity; ///< unallocated capacity in bytes.
   void *extended_info;            ///< vendor specific extended namespace information.
 } kv_namespace_stat; 
+
+/**
+  kv_expiry_stat
+  kv_expiry_stat structure reports the expiration of key-value pairs stored with a time to live (kv_store_ttl()).
+  */
+typedef struct {
+  uint64_t expiring;        ///< # of stored pairs that have a time to live
+  uint64_t expired_lazy;    ///< # of expired pairs dropped by commands that found them
+  uint64_t reaped;          ///< # of expired pairs deleted by the background reaper
+  uint64_t reaped_bytes;    ///< key and value bytes reclaimed by the background reaper
+  uint64_t reaper_busy_ns;  ///< time the background reaper held the key-value store
+} kv_expiry_stat;
+
+/**
+  kv_cache_stat
+  kv_cache_stat structure reports the modelled DRAM cache of an emulated device (cache_size in the emulator configuration file).
+  */
+typedef struct {
+  uint64_t capacity;        ///< cache size in bytes, 0 if the device has no cache model
+  uint64_t used;            ///< key and value bytes of the cached pairs
+  uint64_t dirty;           ///< bytes in the write buffer, not flushed to the media yet
+  uint64_t pairs;           ///< # of cached pairs
+  uint64_t read_hits;       ///< # of retrieves served from the cache
+  uint64_t read_misses;     ///< # of retrieves that went to the media
+  uint64_t write_absorbed;  ///< # of stores completed by the write buffer
+  uint64_t write_through;   ///< # of stores with values too large to cache
+  uint64_t flushes;         ///< # of write buffer flushes
+  uint64_t flushed_bytes;   ///< bytes written back by flushes and evictions
+  uint64_t evictions;       ///< # of pairs evicted to make room
+} kv_cache_stat;
+
+/**
+  kv_batch_op
+  kv_batch_op is one operation of a write batch, \see kv_write_batch
+  */
+typedef struct {
+  kv_batch_op_type type;  ///< store or delete
+  const kv_key *key;      ///< key
+  const kv_value *value;  ///< value to store, ignored by a delete
+} kv_batch_op;
  
 
 /**
@@ -593,6 +653,29 @@ kv_result kv_get_device_stat(const kv_device_handle dev_hdl, kv_device_stat *dev
 
 kv_result kv_get_device_waf(const kv_device_handle dev_hdl, uint32_t *waf);
 
+/**
+  kv_get_sim_time
+  \ingroup device_interfaces
+
+  This interface returns the virtual time of a device that runs in simulation mode, in nanoseconds.
+
+  [SAMSUNG]
+  Only the emulator supports simulation (simulation = true in the emulator configuration file, polling mode only). A simulated device does not wait out its latency model in real time: commands complete in the order of their modelled completion time and the virtual clock moves forward to the next completion when kv_poll_completion() finds none due. The clock is shared by all simulated devices of the process, and host work between two polls takes no virtual time.
+
+  PARAMETERS
+  IN dev_hdl	device handle
+  OUT time_ns	virtual time in nanoseconds
+
+  RETURNS
+  KV_SUCCESS
+
+  ERROR CODE
+  KV_ERR_DEV_NOT_EXIST 		no device exists for the device handle
+  KV_ERR_PARAM_INVALID 		dev_hdl or time_ns is NULL
+  KV_ERR_DD_UNSUPPORTED_CMD	the device does not run in simulation mode
+  */
+kv_result kv_get_sim_time(const kv_device_handle dev_hdl, uint64_t *time_ns);
+
 
 ////////////////////////////////////////////////
 // the following are Samsung ADI specific operation structure
@@ -604,6 +687,7 @@ typedef struct {
 
 typedef struct {
     kv_store_option option;
+    uint32_t ttl_ms;
 } op_store_struct_t;
 
 typedef struct {
@@ -651,6 +735,11 @@ typedef struct {
     kv_group_condition *grp_cond;
 } op_delete_group_struct_t;
 
+typedef struct {
+    const kv_batch_op *ops;
+    uint32_t op_cnt;
+} op_write_batch_struct_t;
+
 ////////////////////////////////
 // this part must be the same as the public portion of 
 // io_ctx_t
@@ -725,6 +814,7 @@ typedef struct {
         op_close_iterator_struct_t iterator_close_info;
         op_list_iterator_struct_t iterator_list_info;
         op_delete_group_struct_t delete_group_info;
+        op_write_batch_struct_t write_batch_info;
     } command;
 
 } io_ctx_t;
@@ -738,6 +828,7 @@ typedef struct {
 typedef struct {
   void (*post_fn)(kv_io_context *op);   ///< asynchronous notification callback (valid only for async I/O)
   void *private_data;       ///< private data address which can be used in callback (valid only for async I/O)
+  uint32_t timeout_usec;    ///< [SAMSUNG] if not 0, a command still queued this many microseconds after submission is dropped with KV_ERR_DEADLINE_EXCEEDED (emulator only)
 } kv_postprocess_function; 
  
 
@@ -1490,6 +1581,135 @@ kv_result kv_retrieve(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8
   */
 kv_result kv_store(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option, const kv_postprocess_function *post_fn);
 
+/**
+  kv_store_ttl
+
+  This interface is the same as kv_store() but the stored pair expires ttl_ms milliseconds after the store completes. An expired pair is never returned by kv_retrieve(), kv_exist() or an iterator, and its space is reclaimed either by the first command that finds it or by a rate limited background reaper. A ttl_ms of 0 stores a pair that never expires; overwriting a pair replaces its time to live.
+
+  [SAMSUNG]
+  Only the emulator supports time to live. The reaper rate is set by ttl_reaper_rate in the emulator configuration file.
+
+  PARAMETERS
+  IN que_hdl	queue handle
+  IN ns_hdl		namespace handle, or KV_NAMESPACE_DEFAULT
+  IN key		key
+  IN value		value
+  IN option		options defined in KV_STORE_OPTION
+  IN ttl_ms		time to live in milliseconds, 0 if the pair never expires
+  IN post_fn	a postprocess function which is called when the operation completes
+
+  RETURNS
+  KV_SUCCESS
+
+  ERROR CODE
+  same as kv_store()
+  KV_ERR_DD_UNSUPPORTED_CMD	the device does not support time to live
+  */
+kv_result kv_store_ttl(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option, uint32_t ttl_ms, const kv_postprocess_function *post_fn);
+
+/**
+  kv_get_expiry_stat
+
+  This interface returns the expiration statistics of pairs stored with kv_store_ttl().
+
+  PARAMETERS
+  IN dev_hdl 	device handle
+  IN ns_hdl		namespace handle, or KV_NAMESPACE_DEFAULT
+  OUT st		expiration statistics
+
+  RETURNS
+  KV_SUCCESS
+
+  ERROR CODE
+  KV_ERR_DEV_NOT_EXIST 		no device exists for the device handle
+  KV_ERR_NS_NOT_EXIST		the namespace does not exist
+  KV_ERR_PARAM_INVALID 		st cannot be NULL
+  KV_ERR_DD_UNSUPPORTED_CMD	the device does not support time to live
+  */
+kv_result kv_get_expiry_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_expiry_stat *st);
+
+/**
+  kv_get_cache_stat
+
+  This interface returns the hit rates and write buffer activity of the modelled device cache.
+
+  PARAMETERS
+  IN dev_hdl 	device handle
+  IN ns_hdl		namespace handle, or KV_NAMESPACE_DEFAULT
+  OUT st		cache statistics, all zero if the cache model is off
+
+  RETURNS
+  KV_SUCCESS
+
+  ERROR CODE
+  KV_ERR_DEV_NOT_EXIST 		no device exists for the device handle
+  KV_ERR_NS_NOT_EXIST		the namespace does not exist
+  KV_ERR_PARAM_INVALID 		st cannot be NULL
+  KV_ERR_DD_UNSUPPORTED_CMD	the device does not report its cache
+  */
+kv_result kv_get_cache_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_cache_stat *st);
+
+/**
+  kv_write_batch
+
+  This interface posts one command that applies a list of store and delete operations to a key space atomically: either all of them take effect or none does. Other commands never observe a partially applied batch; a retrieve, exist or iterator command sees the key space either before or after the whole batch. Operations are applied in order, so a later operation on the same key wins.
+
+  A batch whose keys fall into the group of an open iterator that has not reached its end fails with KV_ERR_ITERATOR_IN_PROGRESS, as a store or delete in an iterator group would (\see kv_open_iterator), because the iterator could otherwise return part of the batch.
+
+  The operations, keys and values shall stay valid until the postprocess function is called.
+
+  [SAMSUNG]
+  Only the emulator supports write batches. The emulator can fail a fraction of batches midway for testing (batch_failure_rate in the emulator configuration file); a failed batch is rolled back and leaves no trace.
+
+  PARAMETERS
+  IN que_hdl	queue handle
+  IN ns_hdl		namespace handle, or KV_NAMESPACE_DEFAULT
+  IN ks_id		key space id
+  IN ops		operations in the order they are applied
+  IN op_cnt		number of operations, 1 to KV_MAX_BATCH_OPS
+  IN post_fn	a postprocess function which is called when the operation completes
+
+  RETURNS
+  KV_SUCCESS
+
+  ERROR CODE
+  KV_ERR_DEV_CAPACITY		device does not have enough space for the batch
+  KV_ERR_ITERATOR_IN_PROGRESS	a key of the batch is in the group of an open iterator
+  KV_ERR_KEY_INVALID		a key buffer is null
+  KV_ERR_KEY_LENGTH_INVALID	a key length is out of range
+  KV_ERR_PARAM_INVALID 		ops is NULL, op_cnt is out of range, or a store has no value
+  KV_ERR_SYS_IO 			the batch failed and was rolled back
+  KV_ERR_VALUE_LENGTH_INVALID	a value length is out of range
+  KV_ERR_DD_UNSUPPORTED_CMD	the device does not support write batches
+  */
+kv_result kv_write_batch(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, const kv_postprocess_function *post_fn);
+
+/**
+  kv_cancel
+
+  This interface removes the commands of a submission queue that have not been dispatched to the device yet and for which match() returns TRUE. Every removed command completes with KV_ERR_CANCELED through its postprocess function, like any other command; commands already dispatched are not affected and complete normally.
+
+  match() is called with the I/O context of each queued command while the queue is locked, so it shall not post commands itself.
+
+  [SAMSUNG]
+  Only the emulator supports cancellation. A simulated emulator (see kv_get_sim_time()) runs commands when they are posted, so there is nothing left to cancel.
+
+  PARAMETERS
+  IN que_hdl	submission queue handle
+  IN match		returns TRUE for a command to cancel
+  IN arg		passed to match()
+  OUT canceled	number of commands canceled, may be NULL
+
+  RETURNS
+  KV_SUCCESS
+
+  ERROR CODE
+  KV_ERR_PARAM_INVALID 		que_hdl or match is NULL
+  KV_ERR_QUEUE_QID_INVALID	the queue is not a submission queue
+  KV_ERR_DD_UNSUPPORTED_CMD	the device does not support cancellation
+  */
+kv_result kv_cancel(kv_queue_handle que_hdl, bool_t (*match)(const kv_io_context *op, void *arg), void *arg, uint32_t *canceled);
+
 /**
  \ingroup Completion Interfaces
   kv_poll_completion
@@ -1568,6 +1788,10 @@ kv_result get_namespace_default(kv_device_handle dev_hdl, kv_namespace_handle *n
 // internal API, added for an emulator
 extern uint64_t _kv_emul_queue_latency;
 kv_result _kv_bypass_namespace(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, bool_t bypass);
+// internal API, the emulator counts the commands passing through a queue in
+// the statistics segment the API exports (kvs_stats_shm.h)
+struct kvs_stats_queue;
+kv_result _kv_set_queue_stats(const kv_device_handle dev_hdl, const kv_queue_handle que_hdl, struct kvs_stats_queue *stats);
 
 
 
@@ -34,6 +34,7 @@
 #ifndef _IO_CMD_INCLUDE_H_
 #define _IO_CMD_INCLUDE_H_
 
+#include <chrono>
 #include <thread>
 #include "kvs_adi.h"
 #include "kvs_adi_internal.h"
@@ -75,6 +76,22 @@ public:
 
     ioqueue *get_queue();
 
+    // the command is dropped if it has not been dispatched timeout_usec
+    // from now
+    void set_deadline(uint32_t timeout_usec) {
+        m_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_usec);
+        m_has_deadline = true;
+    }
+    bool has_deadline() const { return m_has_deadline; }
+    bool expired(std::chrono::steady_clock::time_point now) const {
+        return m_has_deadline && now >= m_deadline;
+    }
+
+    // virtual time simulation (see kv_sim): the modelled time the command
+    // keeps a unit of the device busy, charged while it runs
+    void charge(int64_t ns) { if (ns > 0) m_service_ns += ns; }
+    uint64_t service_ns() const { return m_service_ns; }
+
     // to be called by a worker thread to execute the task associated with the
     // command.
     void call_post_process_func();
@@ -132,6 +149,13 @@ private:
     // submission Q
     ioqueue *m_que;
 
+    // dispatch deadline, see set_deadline()
+    bool m_has_deadline;
+    std::chrono::steady_clock::time_point m_deadline;
+
+    // see charge()
+    uint64_t m_service_ns;
+
     // results from IO operation
     //kv_result m_res;
 };
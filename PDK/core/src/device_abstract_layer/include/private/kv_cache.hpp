@@ -0,0 +1,119 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _KV_CACHE_INCLUDE_H_
+#define _KV_CACHE_INCLUDE_H_
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "kvs_adi.h"
+
+namespace kvadi {
+
+/*
+ * Model of the DRAM cache of a KV SSD controller (cache_size in the
+ * emulator configuration file).
+ *
+ * The cache only tracks which pairs it holds, the values stay in the
+ * kv_emulator map. Pairs with a value of at most max_value bytes are cached
+ * by the retrieve that misses them and by the store that writes them.
+ * Stores are absorbed by a write buffer of write_buffer bytes; the store
+ * that fills the buffer flushes all of it to the media and is charged
+ * flush_cost for every pair it writes back. A store that evicts a pair
+ * that was not flushed yet is charged its write back the same way; a
+ * retrieve does not wait for the write backs its miss causes.
+ *
+ * Costs are relative to the IOPS model latency of the command, like
+ * batch_op_cost. Operations return the cost of the command, or -1 when it
+ * goes to the media and the IOPS model applies in full. Not thread safe,
+ * the emulator calls it with its map lock held.
+ */
+class kv_device_cache {
+public:
+    enum policy_t {
+        POLICY_LRU,     // retrieves move a pair to the head of the cache
+        POLICY_FIFO,    // pairs are evicted in the order they were cached
+    };
+
+    struct config {
+        uint64_t size;              // bytes of keys and values
+        policy_t policy;
+        uint32_t max_value;         // larger values bypass the cache
+        uint64_t write_buffer;      // dirty bytes before a flush
+        double hit_cost;            // retrieve served from the cache
+        double write_cost;          // store absorbed by the write buffer
+        double flush_cost;          // write back of one dirty pair
+    };
+
+    explicit kv_device_cache(const config &cfg);
+
+    // a hit returns hit_cost, a miss caches the pair
+    double read(uint8_t ks_id, const kv_key *key, uint32_t vlen);
+    double write(uint8_t ks_id, const kv_key *key, uint32_t vlen);
+    // the pair was deleted, a dirty pair is dropped without a flush
+    void erase(uint8_t ks_id, const kv_key *key);
+    void clear(uint8_t ks_id);
+
+    void get_stat(kv_cache_stat *st) const;
+
+private:
+    struct entry {
+        std::string id;     // key space and key
+        uint32_t size;      // key and value bytes
+        uint64_t dirty;     // flush generation that writes it back, 0 if clean
+    };
+    typedef std::list<entry> entry_list_t;
+
+    static std::string make_id(uint8_t ks_id, const kv_key *key);
+    bool is_dirty(const entry &e) const { return e.dirty == m_generation; }
+    // drops the entry at it, returns the write back cost of a dirty one
+    double remove(entry_list_t::iterator it, bool evicted);
+    // evicts from the tail until size more bytes fit
+    double make_room(uint32_t size);
+    double flush();
+
+    config m_cfg;
+    entry_list_t m_entries;     // head is the most recently cached or used
+    std::unordered_map<std::string, entry_list_t::iterator> m_index;
+
+    // a flush cleans every dirty entry at once by moving to a new generation
+    uint64_t m_generation;
+    uint64_t m_used;
+    uint64_t m_dirty_bytes;
+    uint64_t m_dirty_pairs;
+    kv_cache_stat m_stat;
+};
+
+} // end of namespace
+#endif
@@ -35,7 +35,9 @@
 #define _KV_DEVICE_INTERNAL_INCLUDE_H_
 
 #include <chrono>
+#include <mutex>
 #include <queue>
+#include <random>
 #include <set>
 #include <unordered_map>
 
@@ -44,6 +46,7 @@
 
 #include "kv_config.hpp"
 #include "kv_namespace.hpp"
+#include "kv_sim.hpp"
 #include "queue.hpp"
 #include "thread_pool.hpp"
 
@@ -66,6 +69,15 @@ public:
     // if false, bypass the model.
     bool_t use_iops_model();
 
+    // holds up the calling queue thread for the configured slow I/O time
+    // on a random slow_io_rate share of the commands, or charges the time
+    // to the command in virtual time
+    void simulate_slow_io(io_cmd *cmd);
+
+    // virtual time simulation, see kv_sim
+    bool_t is_simulated() { return m_sim ? TRUE : FALSE; }
+    uint32_t get_sim_seed() { return m_sim_seed; }
+
     bool_t insert_namespace(uint32_t nsid, kv_namespace_internal *ns);
 
     kv_config*& get_config();
@@ -119,6 +131,8 @@ public:
     static kv_result kv_get_device_waf(const kv_device_handle dev_hdl, float *waf);
     // sanitize a device
     static kv_result kv_sanitize(kv_queue_handle que_hdl, kv_device_handle dev_hdl, kv_sanitize_option option, kv_sanitize_pattern *pattern, kv_postprocess_function *post_fn);
+    // virtual time of a simulated device
+    static kv_result kv_get_sim_time(const kv_device_handle dev_hdl, uint64_t *time_ns);
 
     // get the initialized device given device id (kv_device_handle is actually
     // an uint32_t *
@@ -151,7 +165,10 @@ public:
     static kv_result kv_list_namespaces(const kv_device_handle dev_hdl, kv_namespace_handle *ns_hdls, uint32_t *ns_cnt);
     static kv_result kv_get_namespace_info(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_namespace *nsinfo);
     static kv_result kv_get_namespace_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_namespace_stat *ns_stat);
+    static kv_result kv_get_expiry_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_expiry_stat *st);
+    static kv_result kv_get_cache_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_cache_stat *st);
     static kv_result _kv_bypass_namespace(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, bool_t bypass);
+    static kv_result _kv_set_queue_stats(const kv_device_handle dev_hdl, const kv_queue_handle que_hdl, struct kvs_stats_queue *stats);
 
     // async IO APIs are below
     kv_result kv_purge(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, kv_purge_option option, kv_postprocess_function *post_fn);
@@ -174,7 +191,10 @@ public:
     kv_result kv_exist(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, uint32_t key_cnt, kv_postprocess_function *post_fn, uint32_t buffer_size, uint8_t *buffer);
 
     kv_result kv_retrieve(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, kv_retrieve_option option, const kv_postprocess_function *post_fn, kv_value *value);
-    kv_result kv_store(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option, const kv_postprocess_function *post_fn);
+    kv_result kv_store(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option, uint32_t ttl_ms, const kv_postprocess_function *post_fn);
+    kv_result kv_write_batch(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl, uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, const kv_postprocess_function *post_fn);
+    // removes matching commands that are still queued, they complete with KV_ERR_CANCELED
+    kv_result kv_cancel(kv_queue_handle que_hdl, bool_t (*match)(const kv_io_context *op, void *arg), void *arg, uint32_t *canceled);
     /*** poll and interrupt handler APIs***/
     // poll will check completion queue, and find corresponding submission
     // queue
@@ -287,6 +307,16 @@ private:
     // device capacity in byte
     uint64_t m_capacity;
 
+    // latency outliers, fraction of commands delayed and the delay
+    double m_slow_io_rate;
+    uint32_t m_slow_io_us;
+    std::mutex m_slow_io_mutex;
+    std::mt19937 m_slow_io_rng;
+
+    // virtual time scheduler, NULL unless the device is simulated
+    kv_sim *m_sim;
+    uint32_t m_sim_seed;
+
 };
 
 } // end of namespace
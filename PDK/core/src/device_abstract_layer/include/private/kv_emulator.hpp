@@ -40,9 +40,16 @@
 #include <set>
 #include <list>
 #include <bitset>
+#include <endian.h>
 #include <unordered_map>
+#include <thread>
+#include <condition_variable>
+#include <random>
+#include <vector>
 #include "kvs_adi_internal.h"
 #include "history.hpp"
+#include "kv_key_order.hpp"
+#include "kv_cache.hpp"
 
 /**
  * this is for key value store and iteration in memory
@@ -52,47 +59,18 @@
 
 namespace kvadi {
 
-struct CmpEmulPrefix {
-    bool operator()(const kv_key* a, const kv_key* b) const {
-
-        const char *strA = (const char *)a->key;
-        const char *strB = (const char *)b->key;
-
-        // using leading 4 bytes in ascending order for group and iteration
-        uint32_t intA = 0;
-        memcpy(&intA, strA, 4);
-        uint32_t intB = 0;
-        memcpy(&intB, strB, 4);
-
-        // first compare first 32 bits
-        if (intA == intB) {
-            // if equal, compare length
-            if (a->length < b->length) {
-                return true;
-            } else if (a->length > b->length) {
-                return false;
-            } else {
-                // if same length, compare content
-                // (a->length == b->length) {
-                return (memcmp(strA + 4, strB + 4, b->length - 4) < 0);
-            }
-        } else {
-            return intA < intB;
-        }
-    }
-};
-
 class kv_noop_emulator : public kv_device_api{
 public:
     kv_noop_emulator(uint64_t capacity) {}
     virtual ~kv_noop_emulator() {}
 
     // basic operations
-    kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t *consumed_bytes, void *ioctx) { return KV_SUCCESS; }
+    kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t ttl_ms, uint32_t *consumed_bytes, void *ioctx) { return KV_SUCCESS; }
     kv_result kv_retrieve(uint8_t ks_id, const kv_key *key, uint8_t option, kv_value *value, void *ioctx) { return KV_SUCCESS; }
     kv_result kv_exist(uint8_t ks_id, const kv_key *key, uint32_t keycount, uint8_t *value, uint32_t &valuesize, void *ioctx) { return KV_SUCCESS; }
     kv_result kv_purge( uint8_t ks_id, kv_purge_option option, void *ioctx) { return KV_SUCCESS; }
     kv_result kv_delete(uint8_t ks_id, const kv_key *key, uint8_t option, uint32_t *recovered_bytes, void *ioctx) { return KV_SUCCESS; }
+    kv_result kv_write_batch(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, int64_t *consumed_bytes, void *ioctx) { return KV_SUCCESS; }
     // iterator
     kv_result kv_open_iterator(uint8_t ks_id, const kv_iterator_option opt, const kv_group_condition *cond, bool_t keylen_fixed, kv_iterator_handle *iter_hdl, void *ioctx) { return KV_SUCCESS; }
     kv_result kv_close_iterator(kv_iterator_handle iter_hdl, void *ioctx) { return KV_SUCCESS; }
@@ -107,19 +85,21 @@ public:
 
     uint64_t get_total_capacity() { return -1; }
     uint64_t get_available() { return -1; }
+    kv_result get_expiry_stat(kv_expiry_stat *st) { memset(st, 0, sizeof(*st)); return KV_SUCCESS; }
 };
 
 class kv_emulator : public kv_device_api{
 public:
-    kv_emulator(uint64_t capacity, std::vector<double> iops_model_coefficients, bool_t use_iops_model, uint32_t nsid);
+    kv_emulator(uint64_t capacity, std::vector<double> iops_model_coefficients, bool_t use_iops_model, uint32_t nsid, uint32_t reaper_rate = 0, double batch_failure_rate = 0, double batch_op_cost = 0.25);
     virtual ~kv_emulator();
 
     // basic operations
-    kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t *consumed_bytes, void *ioctx);
+    kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t ttl_ms, uint32_t *consumed_bytes, void *ioctx);
     kv_result kv_retrieve(uint8_t ks_id, const kv_key *key, uint8_t option, kv_value *value, void *ioctx);
     kv_result kv_exist(uint8_t ks_id, const kv_key *key, uint32_t keycount, uint8_t *value, uint32_t &valuesize, void *ioctx);
     kv_result kv_purge( uint8_t ks_id, kv_purge_option option, void *ioctx);
     kv_result kv_delete(uint8_t ks_id, const kv_key *key, uint8_t option, uint32_t *recovered_bytes, void *ioctx);
+    kv_result kv_write_batch(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, int64_t *consumed_bytes, void *ioctx);
     // iterator
     kv_result kv_open_iterator(uint8_t ks_id, const kv_iterator_option opt, const kv_group_condition *cond, bool_t keylen_fixed, kv_iterator_handle *iter_hdl, void *ioctx);
     kv_result kv_close_iterator(kv_iterator_handle iter_hdl, void *ioctx);
@@ -130,6 +110,8 @@ public:
 
     uint64_t get_total_capacity();
     uint64_t get_available();
+    kv_result get_expiry_stat(kv_expiry_stat *st);
+    kv_result get_cache_stat(kv_cache_stat *st);
 
     // these do nothing, but to conform API, emulator have queue level operations for
     // device behavior simulation.
@@ -137,6 +119,14 @@ public:
     kv_interrupt_handler get_interrupt_handler();
     kv_result poll_completion(uint32_t timeout_usec, uint32_t *num_events);
 
+    // virtual time simulation: the IOPS model charges its latency to the
+    // command instead of waiting, and failed batches are drawn from seed
+    void use_virtual_time(uint32_t seed);
+
+    // models the DRAM cache of the device: retrieves that hit it and stores
+    // absorbed by its write buffer cost a fraction of the IOPS model latency
+    void use_cache(const kv_device_cache::config &cfg);
+
 private:
 
     kv_history stat;
@@ -147,9 +137,9 @@ private:
     // space available
     uint64_t m_available;
 
-    typedef std::map<kv_key*, std::string, CmpEmulPrefix> emulator_map_t;
+    typedef std::map<kv_key*, std::string, CmpEmulKey> emulator_map_t;
     //std::map<uint32_t, std::unordered_map<kv_key*, std::string> > m_map;
-    std::map<kv_key*, std::string, CmpEmulPrefix> m_map[SAMSUNG_MAX_KEYSPACE_CNT];
+    std::map<kv_key*, std::string, CmpEmulKey> m_map[SAMSUNG_MAX_KEYSPACE_CNT];
     std::mutex m_map_mutex;
 
     std::map<int32_t, _kv_iterator_handle *> m_it_map;
@@ -158,10 +148,59 @@ private:
 
     // use IOPS model or not
     bool_t m_use_iops_model;
+    bool_t m_virtual_time;
+
+    // waits until latency_ns after begin, or charges it to the command
+    void model_latency(struct timespec *begin, int64_t latency_ns, void *ioctx);
+
+    // NULL without a cache model, protected by m_map_mutex
+    kv_device_cache *m_cache;
+    int64_t cache_latency(double cache_cost);
 
     uint32_t m_nsid;
 
     kv_interrupt_handler m_interrupt_handler;
+
+    // time ordered index of the pairs stored with a TTL, keyed by expiry time
+    // in ms and pointing at the key owned by m_map. m_expiry_of finds the
+    // index entry of a key. Both are protected by m_map_mutex.
+    typedef std::multimap<uint64_t, kv_key*> expiry_index_t;
+    expiry_index_t m_expiry[SAMSUNG_MAX_KEYSPACE_CNT];
+    std::unordered_map<kv_key*, expiry_index_t::iterator> m_expiry_of[SAMSUNG_MAX_KEYSPACE_CNT];
+    kv_expiry_stat m_expiry_stat;
+
+    void set_expiry(uint8_t ks_id, kv_key *key, uint32_t ttl_ms);
+    void clear_expiry(uint8_t ks_id, kv_key *key);
+    bool expire_if_due(uint8_t ks_id, emulator_map_t::iterator &it);
+    uint32_t reap(uint64_t now_ms, uint32_t budget);
+
+    // background reaper, deletes up to m_reaper_rate expired pairs per second
+    void reaper();
+    uint32_t m_reaper_rate;
+    bool m_reaper_stop;
+    std::mutex m_reaper_mutex;
+    std::condition_variable m_reaper_cond;
+    std::thread m_reaper;
+
+    // write batches. An undo record keeps what an operation replaced
+    // (existed is false for a key the batch created) so that a batch that
+    // fails midway is rolled back before the map lock is dropped.
+    struct batch_undo {
+        kv_key *key;
+        bool existed;
+        bool removed;        // deleted by the batch, key is owned by the record
+        std::string value;
+        uint64_t expiry_ms;  // 0 if the pair had no time to live
+    };
+    bool in_open_iterator_group(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt);
+    void rollback_batch(uint8_t ks_id, std::vector<batch_undo> &undo);
+
+    // fraction of batches failed on purpose after a random number of
+    // operations, and the modeled latency of each operation after the first
+    // as a fraction of a single command
+    double m_batch_failure_rate;
+    double m_batch_op_cost;
+    std::mt19937 m_batch_rng;
 };
 
 
@@ -0,0 +1,66 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _KV_KEY_ORDER_HPP_
+#define _KV_KEY_ORDER_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include "kvs_adi.h"
+
+/**
+ * key ordering of the emulator index
+ *
+ * Keys are ordered like the device orders them: byte by byte as unsigned
+ * values, a key that is a prefix of another one comes first. All keys that
+ * share their leading 4 bytes are therefore adjacent, which is what group
+ * iteration and group deletion rely on.
+ */
+
+namespace kvadi {
+
+static inline int kv_key_compare(const kv_key *a, const kv_key *b) {
+    const kv_key_t len = a->length < b->length ? a->length : b->length;
+    int r = memcmp(a->key, b->key, len);
+    if (r != 0) return r;
+    return (int)a->length - (int)b->length;
+}
+
+struct CmpEmulKey {
+    bool operator()(const kv_key *a, const kv_key *b) const {
+        return kv_key_compare(a, b) < 0;
+    }
+};
+
+} // end of namespace
+#endif
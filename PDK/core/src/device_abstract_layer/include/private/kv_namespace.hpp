@@ -61,13 +61,16 @@ public:
 
     kv_result kv_get_namespace_info(kv_namespace *ns);
     kv_result kv_get_namespace_stat(kv_namespace_stat *ns_st);
+    kv_result kv_get_expiry_stat(kv_expiry_stat *st);
+    kv_result kv_get_cache_stat(kv_cache_stat *st);
 
     // all these are sync IO, directly working with kvstore
     kv_result kv_purge( uint8_t ks_id, kv_purge_option option, void *ioctx);
     kv_result kv_delete(uint8_t ks_id, const kv_key *key, uint8_t option, uint32_t *recovered_bytes, void *ioctx);
+    kv_result kv_write_batch(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, int64_t *consumed_bytes, void *ioctx);
     kv_result kv_exist(uint8_t ks_id, const kv_key *key, uint32_t keycount, uint8_t *value, uint32_t &valuesize, void *ioctx);
     kv_result kv_retrieve(uint8_t ks_id, const kv_key *key, uint8_t option, kv_value *value, void *ioctx);
-    kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t *consumed_bytes, void *ioctx);
+    kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t ttl_ms, uint32_t *consumed_bytes, void *ioctx);
     kv_result kv_open_iterator(uint8_t ks_id, const kv_iterator_option it_op, const kv_group_condition *it_cond, kv_iterator_handle *iter_hdl, void *ioctx);
     kv_result kv_close_iterator(kv_iterator_handle iter_hdl, void *ioctx);
     kv_result kv_iterator_next(kv_iterator_handle iter_hdl, kv_key *key, kv_value *value, void *ioctx);
@@ -0,0 +1,102 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _KV_SIM_INCLUDE_H_
+#define _KV_SIM_INCLUDE_H_
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "kvs_adi.h"
+
+namespace kvadi {
+
+class emul_ioqueue;
+class io_cmd;
+
+/*
+ * Virtual time simulation of an emulated device (simulation = true in the
+ * emulator configuration file).
+ *
+ * Commands do not wait out the IOPS model in real time. A submitted command
+ * runs against the kv_emulator map at once and the model charges its latency
+ * to the command (io_cmd::charge()) instead of spinning. The completion is
+ * then scheduled on a virtual clock shared by all simulated devices of the
+ * process: the command starts when the first of the device's parallel units
+ * is free, never before it was submitted, and completes the charged time
+ * later. Commands that would start after their deadline are dropped.
+ *
+ * The clock only moves when the host polls a completion queue that has
+ * nothing due: it jumps to the earliest completion still ahead of it on any
+ * queue of any device, so polling one queue never skips the clock past the
+ * next completion of another. Queues whose next completion is already due
+ * are left out, so a queue that is never polled does not stop the clock;
+ * every poll of a queue with nothing due moves it forward. Host work between
+ * polls takes no virtual time, so a run with one host thread depends on
+ * nothing but the workload and simulation_seed.
+ */
+class kv_sim {
+public:
+    explicit kv_sim(uint32_t units);
+    ~kv_sim();
+
+    // runs the command and schedules its completion on the completion
+    // queue of sq. KV_ERR_QUEUE_IS_FULL if sq already holds as many
+    // commands waiting for a unit as it has entries.
+    kv_result submit(emul_ioqueue *sq, io_cmd *cmd);
+
+    // completes up to max commands due on cq. If none is due, the clock
+    // first moves to the earliest completion still ahead on any queue,
+    // which may belong to another queue.
+    static kv_result poll(emul_ioqueue *cq, uint32_t max, uint32_t *completed);
+
+    // drops what is scheduled for a queue that is being deleted
+    void drop_queue(emul_ioqueue *que);
+
+    // virtual nanoseconds since the process started
+    static uint64_t now_ns();
+
+private:
+    kv_sim(const kv_sim&) = delete;
+    kv_sim& operator=(const kv_sim&) = delete;
+
+    // time each unit becomes free
+    std::vector<uint64_t> m_unit_free;
+
+    // start times of the commands of each submission queue, in order; the
+    // ones still in the future are the commands waiting in the queue
+    std::unordered_map<emul_ioqueue *, std::deque<uint64_t> > m_starts;
+};
+
+} // end of namespace
+#endif
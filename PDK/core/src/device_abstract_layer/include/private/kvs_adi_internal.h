@@ -48,11 +48,15 @@ class kv_device_api {
 public:
     virtual ~kv_device_api() {}
     //basic operations
-    virtual kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t *consumed_bytes, void *ioctx) =0;
+    // ttl_ms: time to live of the pair in milliseconds, 0 if it never expires
+    virtual kv_result kv_store(uint8_t ks_id, const kv_key *key, const kv_value *value, uint8_t option, uint32_t ttl_ms, uint32_t *consumed_bytes, void *ioctx) =0;
     virtual kv_result kv_retrieve(uint8_t ks_id, const kv_key *key, uint8_t option, kv_value *value, void *ioctx) =0;
     virtual kv_result kv_exist(uint8_t ks_id, const kv_key *key, uint32_t keycount, uint8_t *value, uint32_t &valuesize, void *ioctx) =0;
     virtual kv_result kv_purge(uint8_t ks_id, kv_purge_option option, void *ioctx) =0;
     virtual kv_result kv_delete(uint8_t ks_id, const kv_key *key, uint8_t option, uint32_t *recovered_bytes, void *ioctx) =0;
+    // applies all operations or none, consumed_bytes is negative when the
+    // batch frees more space than it takes
+    virtual kv_result kv_write_batch(uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt, int64_t *consumed_bytes, void *ioctx) =0;
 
     // iterator
     virtual kv_result kv_open_iterator(uint8_t ks_id, const kv_iterator_option opt, const kv_group_condition *cond, bool_t keylen_fixed, kv_iterator_handle *iter_hdl, void *ioctx) =0;
@@ -77,6 +81,12 @@ public:
     virtual uint64_t get_total_capacity() =0;
     virtual uint64_t get_available() =0;
 
+    // expiration of pairs stored with a time to live
+    virtual kv_result get_expiry_stat(kv_expiry_stat *st) =0;
+
+    // modelled device cache
+    virtual kv_result get_cache_stat(kv_cache_stat *st) { memset(st, 0, sizeof(*st)); return KV_SUCCESS; }
+
     // get initialization status
     virtual kv_result get_init_status() { return KV_SUCCESS; }
 };
@@ -45,8 +45,10 @@
 
 #include "io_cmd.hpp"
 #include "thread_pool.hpp"
+#include "kvs_stats_shm.h"
 #include <boost/circular_buffer.hpp>
 #include <list>
+#include <vector>
 
 namespace kvadi {
 
@@ -90,6 +92,8 @@ public:
 
     virtual size_t size() = 0;
     virtual kv_result poll_completion(uint32_t timeout_usec, uint32_t *num_completed) { return KV_SUCCESS; }
+    // counts the commands passing through the queue in stats
+    virtual kv_result set_stats(kvs_stats_queue *stats) { return KV_ERR_DD_UNSUPPORTED_CMD; }
     virtual void terminate() {}
 
 };
@@ -105,6 +109,20 @@ class emul_ioqueue: public ioqueue {
     kv_device_api *kvstore;
     boost::circular_buffer<io_cmd*> queue;
     thread_pool threads;
+
+    // queued commands with a deadline, counted in submission queues only
+    // (the ones with an out queue); a full queue is swept for expired
+    // commands while there are any
+    uint32_t deadlines;
+
+    // exported counters, NULL if not exported
+    kvs_stats_queue *stats;
+
+    template <typename Pred>
+    void remove_queued(Pred drop, std::vector<io_cmd*> &removed);
+    // list_mutex held
+    void update_stats(uint64_t enqueued, uint64_t dequeued);
+    void complete_dropped(std::vector<io_cmd*> &cmds, kv_result retcode);
 public:
 
     emul_ioqueue(const kv_queue *queinfo_, kv_device_internal *dev, emul_ioqueue *out_ = 0);
@@ -115,6 +133,10 @@ public:
     bool empty();
     size_t size() override;
 
+    // removes the queued commands match() returns TRUE for and completes
+    // them with KV_ERR_CANCELED
+    kv_result cancel(bool_t (*match)(const kv_io_context *op, void *arg), void *arg, uint32_t *canceled);
+
     int get_cqid() {
         if (out == 0) return 0;
         return out->get_qid();
@@ -140,6 +162,7 @@ public:
     emul_ioqueue *get_out_queue() { return out; }
     kv_result poll_completion(uint32_t timeout_usec, uint32_t *num_completed) override;
     kv_result init_interrupt_handler(kv_device_internal *dev,const kv_interrupt_handler int_hdl) override;
+    kv_result set_stats(kvs_stats_queue *stats) override;
 };
 
 class kernel_ioqueue: public ioqueue
@@ -22,6 +22,7 @@
 #include <math.h>
 #include <time.h>
 #include <vector>
+#include <algorithm>
 #include "kadi.h"
 #include "linux_nvme_ioctl.h"
 #include "kadi_debug.h"
@@ -38,6 +39,21 @@ struct epoll_event list_of_events[1];
 
 const int identify_ret_data_size = 4096;
 
+static int _sys_open(const char *path, int flags) { return ::open(path, flags); }
+static int _sys_ioctl(int fd, unsigned long request, void *arg) { return ::ioctl(fd, request, arg); }
+static int _sys_close(int fd) { return ::close(fd); }
+
+const kadi_sys_ops kadi_default_sys_ops = { _sys_open, _sys_ioctl, _sys_close };
+
+std::atomic<uint64_t> KADI::instance_count(0);
+
+static inline uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 kv_result KADI::iter_readall(uint8_t ks_id, kv_iter_context *iter_ctx, 
     nvme_kv_iter_req_option option, std::list<std::pair<void *, int>> &buflist)
 {
@@ -65,14 +81,14 @@ int KADI::open(std::string &devpath)
 
     FTRACE
     int ret = 0;
-    fd = ::open(devpath.c_str(), O_RDWR);
+    fd = sys->open(devpath.c_str(), O_RDWR);
     if (fd < 0)
     {
         std::cerr << "can't open a device : " << devpath << std::endl;
         return fd;
     }
 
-    nsid = ioctl(fd, NVME_IOCTL_ID);
+    nsid = sys->ioctl(fd, NVME_IOCTL_ID, NULL);
     if (nsid == (unsigned)-1)
     {
         std::cerr << "can't get an ID" << std::endl;
@@ -121,12 +137,30 @@ int KADI::open(std::string &devpath)
     aioctx.ctxid = 0;
     aioctx.eventfd = efd;
 
-    if (ioctl(fd, NVME_IOCTL_SET_AIOCTX, &aioctx) < 0)
+    if (sys->ioctl(fd, NVME_IOCTL_SET_AIOCTX, &aioctx) < 0)
     {
         std::cerr << "fail to set_aioctx" << std::endl;
         return KV_ERR_SYS_IO;
     }
 
+    if (batch_max > 1)
+    {
+        // an empty batch tells whether the driver knows the command
+        struct nvme_passthru_kv_multi_cmd mcmd;
+        memset(&mcmd, 0, sizeof(mcmd));
+        if (sys->ioctl(fd, NVME_IOCTL_AIO_MULTI_CMD, &mcmd) < 0)
+        {
+            std::cerr << "the driver does not support batched submission, "
+                      << "commands are submitted one by one" << std::endl;
+            batch_max = 1;
+        }
+        else
+        {
+            flusher_stop = false;
+            flusher = std::thread(&KADI::flusher_main, this);
+        }
+    }
+
     //std::cerr << "KV device is opened: fd " << fd << ", efd " << efd << ", dev " << devpath.c_str() <<std::endl;
 
     return ret;
@@ -156,18 +190,38 @@ int KADI::close()
 {
     if (fd > 0)
     {
+        if (flusher.joinable())
+        {
+            flusher_stop = true;
+            flusher.join();
+        }
+        std::vector<aio_cmd_ctx *> failed;
+        for (auto &p : batches)
+        {
+            std::lock_guard<std::mutex> lock(p.second->lock);
+            flush_locked(p.second, failed);
+        }
+        fail_cmds(failed);
+        for (auto &p : batches)
+        {
+            delete p.second;
+        }
+        batches.clear();
+        // threads may still cache the batches of this instance
+        instance_id = ++instance_count;
+
         this->cb_thread.stop();
 
         for (aio_cmd_ctx *p: free_cmdctxs) {
             free((void*)p);
         }
 
-        if(ioctl(fd, NVME_IOCTL_DEL_AIOCTX, &aioctx) < 0){
+        if(sys->ioctl(fd, NVME_IOCTL_DEL_AIOCTX, &aioctx) < 0){
             std::cerr << "KV device is closed error!" << std::endl;
             return KADI_ERR_IO;
         }
         ::close((int)aioctx.eventfd);
-        ::close(fd);
+        sys->close(fd);
         std::cerr << "KV device is closed: fd " << fd << std::endl;
         fd = -1;
 
@@ -184,6 +238,14 @@ KADI::aio_cmd_ctx *KADI::get_cmd_ctx(const kv_postprocess_function *cb)
     std::unique_lock<std::mutex> lock(cmdctx_lock);
     while (free_cmdctxs.empty())
     {
+        if (batch_max > 1)
+        {
+            // the contexts may be held by commands in this thread's batch
+            lock.unlock();
+            flush_batch();
+            lock.lock();
+            if (!free_cmdctxs.empty()) break;
+        }
         if (cmdctx_cond.wait_for(lock, std::chrono::seconds(5)) == 
           std::cv_status::timeout && print_log_flag == true) {
             std::cerr << "max queue depth has reached. wait..." << std::endl;
@@ -213,6 +275,135 @@ void KADI::release_cmd_ctx(aio_cmd_ctx *p)
     cmdctx_cond.notify_one();
 }
 
+void KADI::set_batching(int max_cmds, uint32_t delay_us)
+{
+    batch_max = std::min(std::max(max_cmds, 1), NVME_AIO_MULTI_MAX);
+    batch_delay_us = delay_us ? delay_us : 50;
+}
+
+kv_result KADI::submit_aio(aio_cmd_ctx *ioctx)
+{
+    if (batch_max <= 1)
+    {
+        submit_syscalls.fetch_add(1, std::memory_order_relaxed);
+        int ret = sys->ioctl(fd, NVME_IOCTL_AIO_CMD, (void *)&ioctx->cmd);
+        if (ret >= 0) submitted_cmds.fetch_add(1, std::memory_order_relaxed);
+        return ret;
+    }
+
+    std::vector<aio_cmd_ctx *> failed;
+    submit_batch *b = get_batch();
+    {
+        std::lock_guard<std::mutex> lock(b->lock);
+        if (b->cmds.empty()) b->first_ns = _now_ns();
+        b->cmds.push_back(*(struct nvme_passthru_kv_cmd *)&ioctx->cmd);
+        b->ctxs.push_back(ioctx);
+        if ((int)b->cmds.size() >= batch_max) flush_locked(b, failed);
+    }
+    // reported through the callback, the command was accepted
+    fail_cmds(failed);
+    return 0;
+}
+
+KADI::submit_batch *KADI::get_batch()
+{
+    // the batch of the device this thread used last
+    static thread_local uint64_t cached_id = 0;
+    static thread_local submit_batch *cached = 0;
+    if (cached_id == instance_id) return cached;
+
+    std::lock_guard<std::mutex> lock(batches_lock);
+    submit_batch *&b = batches[std::this_thread::get_id()];
+    if (b == 0)
+    {
+        b = new submit_batch;
+        b->cmds.reserve(batch_max);
+        b->ctxs.reserve(batch_max);
+        b->first_ns = 0;
+    }
+    cached_id = instance_id;
+    cached = b;
+    return b;
+}
+
+void KADI::flush_locked(submit_batch *b, std::vector<aio_cmd_ctx *> &failed)
+{
+    if (b->cmds.empty()) return;
+
+    struct nvme_passthru_kv_multi_cmd mcmd;
+    mcmd.nr = b->cmds.size();
+    mcmd.nr_submitted = 0;
+    mcmd.cmds = (__u64)b->cmds.data();
+
+    submit_syscalls.fetch_add(1, std::memory_order_relaxed);
+    int ret = sys->ioctl(fd, NVME_IOCTL_AIO_MULTI_CMD, &mcmd);
+    uint32_t done = (ret == 0) ? mcmd.nr : std::min(mcmd.nr_submitted, mcmd.nr);
+    submitted_cmds.fetch_add(done, std::memory_order_relaxed);
+    for (uint32_t i = done; i < mcmd.nr; i++)
+    {
+        failed.push_back(b->ctxs[i]);
+    }
+    b->cmds.clear();
+    b->ctxs.clear();
+}
+
+void KADI::fail_cmds(std::vector<aio_cmd_ctx *> &failed)
+{
+    for (aio_cmd_ctx *ioctx : failed)
+    {
+        kv_io_context ioresult;
+        memset(&ioresult, 0, sizeof(ioresult));
+        ioresult.opcode = ioctx->cmd.opcode;
+        ioresult.retcode = KV_ERR_SYS_IO;
+        ioresult.key = ioctx->key;
+        ioresult.value = ioctx->value;
+        ioresult.private_data = ioctx->post_data;
+        ioctx->call_post_fn(ioresult);
+        release_cmd_ctx(ioctx);
+    }
+    failed.clear();
+}
+
+void KADI::flush_batch()
+{
+    if (batch_max <= 1) return;
+
+    std::vector<aio_cmd_ctx *> failed;
+    submit_batch *b = get_batch();
+    {
+        std::lock_guard<std::mutex> lock(b->lock);
+        flush_locked(b, failed);
+    }
+    fail_cmds(failed);
+}
+
+// the latency trigger: submits batches whose oldest command waited delay_us
+void KADI::flusher_main()
+{
+    const uint64_t delay_ns = (uint64_t)batch_delay_us * 1000;
+    const std::chrono::microseconds period(std::max(batch_delay_us / 2, 10u));
+    std::vector<submit_batch *> list;
+    std::vector<aio_cmd_ctx *> failed;
+
+    while (!flusher_stop)
+    {
+        std::this_thread::sleep_for(period);
+        {
+            std::lock_guard<std::mutex> lock(batches_lock);
+            list.clear();
+            for (auto &p : batches) list.push_back(p.second);
+        }
+        uint64_t now = _now_ns();
+        for (submit_batch *b : list)
+        {
+            std::lock_guard<std::mutex> lock(b->lock);
+            if (!b->cmds.empty() && now - b->first_ns >= delay_ns)
+                flush_locked(b, failed);
+        }
+        fail_cmds(failed);
+    }
+}
+
 kv_result KADI::iter_open(uint8_t ks_id, kv_iter_context *iter_handle,
   nvme_kv_iter_req_option option)
 {
@@ -228,7 +419,7 @@ kv_result KADI::iter_open(uint8_t ks_id, kv_iter_context *iter_handle,
 #ifdef DUMP_ISSUE_CMD
     dump_cmd(&cmd);
 #endif
-    int ret = ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd);
+    int ret = sys->ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd);
     if (ret < 0)
     {
         return KV_ERR_SYS_IO;
@@ -252,7 +443,7 @@ kv_result KADI::iter_close(kv_iter_context *iter_handle)
 #ifdef DUMP_ISSUE_CMD
     dump_cmd(&cmd);
 #endif
-    if (ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd) < 0)
+    if (sys->ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd) < 0)
     {
         return KV_ERR_SYS_IO;
     }
@@ -277,7 +468,7 @@ kv_result KADI::iter_read_async(kv_iter_context *iter_handle, const kv_postproce
 #ifdef DUMP_ISSUE_CMD
     dump_cmd(&cmd);
 #endif
-    int ret = ioctl(fd, NVME_IOCTL_AIO_CMD, &ioctx->cmd);
+    int ret = submit_aio(ioctx);
     if (ret < 0)
     {
         release_cmd_ctx(ioctx);
@@ -301,7 +492,7 @@ kv_result KADI::iter_read(kv_iter_context *iter_handle)
 #ifdef DUMP_ISSUE_CMD
     dump_cmd(&cmd);
 #endif
-    int ret = ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd);
+    int ret = sys->ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd);
     if (ret < 0)
     {
         return KV_ERR_SYS_IO;
@@ -349,7 +540,7 @@ kv_result KADI::iter_list(kv_iterator *iter_list, uint32_t *count)
     cmd.nsid = nsid;
     cmd.cdw10 = (__u32)(((buffer_size >> 2) - 1) << 16) | ((__u32)log_page_id & 0x000000ff);
 
-    int ret = ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
+    int ret = sys->ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
     if (ret != 0) { return KV_ERR_SYS_IO; }
 
     // start parsing 
@@ -446,7 +637,7 @@ uint32_t KADI::get_dev_waf()
 
     cmd.cdw10 = (__u32)(((buffer_size >> 2) - 1) << 16) | ((__u32)log_page_id & 0x000000ff);
 
-    int ret = ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
+    int ret = sys->ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
     if (ret != 0) {
         return KV_ERR_SYS_IO;
     }
@@ -496,7 +687,7 @@ kv_result KADI::kv_store(uint8_t ks_id, kv_key *key, kv_value *value,
 #endif
 
     int ret;
-    if ((ret = ioctl(fd, NVME_IOCTL_AIO_CMD, &ioctx->cmd)) < 0)
+    if ((ret = submit_aio(ioctx)) < 0)
     {
         release_cmd_ctx(ioctx);
         return KV_ERR_SYS_IO;
@@ -540,7 +731,7 @@ kv_result KADI::kv_retrieve(uint8_t ks_id, kv_key *key, kv_value *value, const k
     dump_retrieve_cmd(&ioctx->cmd);
     std::cerr << "IO:kv_retrieve: key = " << print_key((const char *)key->key, key->length) << ", len = " << (int)key->length << std::endl;
 #endif
-    int ret = ioctl(fd, NVME_IOCTL_AIO_CMD, &ioctx->cmd);
+    int ret = submit_aio(ioctx);
     if (ret < 0)
     {
         //std::cerr << "kv_retrieve I/O failed: cmd = " << (unsigned int)NVME_IOCTL_AIO_CMD << ", fd = " << fd << ", cmd = " << (unsigned int)ioctx->cmd.opcode << ", ret = " << ret <<std::endl;
@@ -582,7 +773,7 @@ kv_result KADI::kv_retrieve_sync(uint8_t ks_id, kv_key *key, kv_value *value)
     std::cerr << "IO:kv_retrieve sync: key = " << print_key((const char *)key->key, key->length) << ", len = " << (int)key->length << std::endl;
 #endif
 
-    int ret = ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd);
+    int ret = sys->ioctl(fd, NVME_IOCTL_IO_KV_CMD, &cmd);
     if (ret == 0)
     {
         value->actual_value_size = cmd.result;
@@ -622,7 +813,7 @@ kv_result KADI::get_freespace(uint64_t &bytesused, uint64_t &capacity, double &u
     cmd.data_len = identify_ret_data_size;
     cmd.cdw10 = 0;
 
-    if (ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd) < 0)
+    if (sys->ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd) < 0)
     {
         if (data){
             free(data);
@@ -667,11 +858,11 @@ bool KADI::exist(uint8_t ks_id, void *key, int length, const kv_postprocess_func
     dump_cmd(&cmd);
 #endif
     if (cb == 0) {
-        ret = ioctl(fd, NVME_IOCTL_IO_KV_CMD, &ioctx->cmd);
+        ret = sys->ioctl(fd, NVME_IOCTL_IO_KV_CMD, (void *)&ioctx->cmd);
         release_cmd_ctx(ioctx);
     } else {
         // async 
-        ret = ioctl(fd, NVME_IOCTL_AIO_CMD, &ioctx->cmd);
+        ret = submit_aio(ioctx);
         if (ret < 0)
         {
             release_cmd_ctx(ioctx);
@@ -720,7 +911,7 @@ kv_result KADI::kv_delete(uint8_t ks_id, kv_key *key,
     std::cerr << "IO:kv_delete: key = " << print_key((const char *)key->key, key->length) << ", len = " << (int)key->length << std::endl;
 #endif
 
-    if (ioctl(fd, NVME_IOCTL_AIO_CMD, &ioctx->cmd) < 0)
+    if (submit_aio(ioctx) < 0)
     {
         release_cmd_ctx(ioctx);
         return KV_ERR_SYS_IO;
@@ -731,6 +922,8 @@ kv_result KADI::kv_delete(uint8_t ks_id, kv_key *key,
 
 kv_result KADI::poll_completion(uint32_t &num_events, uint32_t timeout_us)
 {
+    // a thread polling for its own commands should not wait for the timer
+    flush_batch();
 
     FD_ZERO(&rfds);
 
@@ -788,7 +981,7 @@ kv_result KADI::poll_completion(uint32_t &num_events, uint32_t timeout_us)
         aioevents.ctxid = aioctx.ctxid;
         num_events += check_nr;
 
-        if (ioctl(fd, NVME_IOCTL_GET_AIOEVENT, &aioevents) < 0)
+        if (sys->ioctl(fd, NVME_IOCTL_GET_AIOEVENT, &aioevents) < 0)
         {
             std::cerr << "NVME_IOCTL_GET_AIOEVENT failed" << std::endl;
             return KADI_ERR_IO;
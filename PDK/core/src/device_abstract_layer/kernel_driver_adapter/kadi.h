@@ -13,6 +13,7 @@
 #include <atomic>
 #include <stdbool.h>
 #include <condition_variable>
+#include <thread>
 #include <sys/eventfd.h>
 #include <sys/select.h>
 #include <sys/time.h>
@@ -116,6 +117,15 @@ typedef struct {
 class KvsStore;
 class KADI;
 
+// system calls KADI makes on the device file, replaced by a mock in tests
+typedef struct {
+    int (*open)(const char *path, int flags);
+    int (*ioctl)(int fd, unsigned long request, void *arg);
+    int (*close)(int fd);
+} kadi_sys_ops;
+
+extern const kadi_sys_ops kadi_default_sys_ops;
+
 
 class KDThread {
   pthread_t thread_id;
@@ -213,13 +223,34 @@ public:
         }
     } aio_cmd_ctx;
 
+    // aio commands of one thread waiting for a NVME_IOCTL_AIO_MULTI_CMD
+    typedef struct {
+        std::mutex lock;
+        std::vector<struct nvme_passthru_kv_cmd> cmds;
+        std::vector<aio_cmd_ctx *> ctxs;
+        uint64_t first_ns;    // when the oldest command was queued
+    } submit_batch;
+
     interrupt_handler_t int_handler;
     KDThread cb_thread;
-    KADI(int queuedepth_): capacity(0),cb_thread(this), qdepth(queuedepth_) { int_handler.handler = 0; }
+    const kadi_sys_ops *sys;
+    KADI(int queuedepth_): capacity(0),cb_thread(this), sys(&kadi_default_sys_ops),
+        submit_syscalls(0), submitted_cmds(0), qdepth(queuedepth_), batch_max(1), batch_delay_us(0),
+        instance_id(++instance_count), flusher_stop(false) { int_handler.handler = 0; }
     ~KADI() { close(); }
 
     int start_cbthread();
 
+    // up to max_cmds aio commands per system call, each waits at most delay_us
+    // for the batch to fill; max_cmds <= 1 submits every command on its own.
+    // call before open()
+    void set_batching(int max_cmds, uint32_t delay_us);
+    // submits the commands the calling thread has queued
+    void flush_batch();
+
+    std::atomic<uint64_t> submit_syscalls;
+    std::atomic<uint64_t> submitted_cmds;
+
 private:
 
     int fd = -1;
@@ -250,6 +281,21 @@ private:
 
     void release_cmd_ctx(aio_cmd_ctx *p);
 
+    int batch_max;
+    uint32_t batch_delay_us;
+    uint64_t instance_id;
+    static std::atomic<uint64_t> instance_count;
+    std::mutex batches_lock;
+    std::map<std::thread::id, submit_batch *> batches;
+    std::thread flusher;
+    std::atomic_bool flusher_stop;
+
+    kv_result submit_aio(aio_cmd_ctx *ioctx);
+    submit_batch *get_batch();
+    void flush_locked(submit_batch *b, std::vector<aio_cmd_ctx *> &failed);
+    void fail_cmds(std::vector<aio_cmd_ctx *> &failed);
+    void flusher_main();
+
 public:
 
     uint32_t  get_dev_waf();
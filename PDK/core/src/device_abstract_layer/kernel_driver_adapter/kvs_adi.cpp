@@ -118,6 +118,12 @@ kv_result kv_initialize_device(void *dev_init, kv_device_handle *dev_hdl) {
     if(dev == NULL){
         return KV_ERR_DEV_NOT_EXIST;
     }
+    // commands per submission system call and how long one waits for the batch
+    const char *env_str = getenv("KVSSD_KDD_BATCH");
+    if (env_str) {
+        const char *delay_str = getenv("KVSSD_KDD_BATCH_US");
+        dev->set_batching(atoi(env_str), delay_str ? atoi(delay_str) : 0);
+    }
     int ret = dev->open(devpath);
     if (ret == 0) {
         dev->update_capacity();
@@ -186,6 +192,11 @@ kv_result kv_get_device_waf(const kv_device_handle dev_hdl, uint32_t *waf) {
 
 }
 
+kv_result kv_get_sim_time(const kv_device_handle dev_hdl, uint64_t *time_ns) {
+    FTRACE
+    return KV_ERR_DD_UNSUPPORTED_CMD;
+}
+
 kv_result kv_get_device_stat(const kv_device_handle dev_hdl, kv_device_stat *dev_st) {
     FTRACE
     if (dev_st == NULL) {
@@ -353,12 +364,27 @@ kv_result get_namespace_default(kv_device_handle dev_hdl, kv_namespace_handle *n
     return KV_SUCCESS;
 }
 
+kv_result kv_get_expiry_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_expiry_stat *st) {
+    FTRACE
+    return KV_ERR_DD_UNSUPPORTED_CMD;
+}
+
+kv_result kv_get_cache_stat(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, kv_cache_stat *st) {
+    FTRACE
+    return KV_ERR_DD_UNSUPPORTED_CMD;
+}
+
 // internal API, added for an emulator
 kv_result _kv_bypass_namespace(const kv_device_handle dev_hdl, const kv_namespace_handle ns_hdl, bool_t bypass) {
     FTRACE
     return KV_ERR_DD_UNSUPPORTED_CMD;
 }
 
+kv_result _kv_set_queue_stats(const kv_device_handle dev_hdl, const kv_queue_handle que_hdl, struct kvs_stats_queue *stats) {
+    FTRACE
+    return KV_ERR_DD_UNSUPPORTED_CMD;
+}
+
 // IO APIs
 kv_result kv_purge(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl,
     uint8_t ks_id, kv_purge_option option, kv_postprocess_function *post_fn) {
@@ -588,6 +614,31 @@ kv_result kv_store(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl,
     return dev->kv_store(ks_id, (kv_key*)key, (kv_value*)value, dev_option, post_fn);
 }
 
+// time to live is only emulated
+kv_result kv_store_ttl(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl,
+  uint8_t ks_id, const kv_key *key, const kv_value *value, kv_store_option option,
+  uint32_t ttl_ms, const kv_postprocess_function *post_fn) {
+    FTRACE
+    if (ttl_ms == 0) {
+        return kv_store(que_hdl, ns_hdl, ks_id, key, value, option, post_fn);
+    }
+    return KV_ERR_DD_UNSUPPORTED_CMD;
+}
+
+// the kernel driver has no atomic multi-key command
+kv_result kv_write_batch(kv_queue_handle que_hdl, kv_namespace_handle ns_hdl,
+  uint8_t ks_id, const kv_batch_op *ops, uint32_t op_cnt,
+  const kv_postprocess_function *post_fn) {
+    FTRACE
+    return KV_ERR_DD_UNSUPPORTED_CMD;
+}
+
+kv_result kv_cancel(kv_queue_handle que_hdl, bool_t (*match)(const kv_io_context *op, void *arg),
+  void *arg, uint32_t *canceled) {
+    FTRACE
+    return KV_ERR_DD_UNSUPPORTED_CMD;
+}
+
 kv_result kv_poll_completion(kv_queue_handle que_hdl, uint32_t timeout_usec, uint32_t *num_events) {
     FTRACE
     if (que_hdl == NULL || num_events == NULL) {
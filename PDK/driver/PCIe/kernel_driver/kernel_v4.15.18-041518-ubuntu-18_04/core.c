@@ -1625,6 +1625,38 @@ exit:
 	return status;
 
 }
+
+/*
+ * Queues an array of aio commands with one system call. The commands are
+ * submitted in order and completed through the aio context like the ones of
+ * NVME_IOCTL_AIO_CMD; the first one that cannot be queued stops the batch.
+ */
+static int nvme_user_kv_multi_cmd(struct nvme_ctrl *ctrl,
+			struct nvme_ns *ns,
+			struct nvme_passthru_kv_multi_cmd __user *ucmd)
+{
+	struct nvme_passthru_kv_multi_cmd mcmd;
+	struct nvme_passthru_kv_cmd __user *cmds;
+	int status = 0;
+	__u32 i;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EACCES;
+	if (copy_from_user(&mcmd, ucmd, sizeof(mcmd)))
+		return -EFAULT;
+	if (mcmd.nr > NVME_AIO_MULTI_MAX)
+		return -EINVAL;
+
+	cmds = (struct nvme_passthru_kv_cmd __user *)(uintptr_t)mcmd.cmds;
+	for (i = 0; i < mcmd.nr; i++) {
+		status = nvme_user_kv_cmd(ctrl, ns, &cmds[i], true);
+		if (status)
+			break;
+	}
+	if (put_user(i, &ucmd->nr_submitted))
+		return -EFAULT;
+	return status;
+}
 #endif
 
 
@@ -2223,6 +2255,8 @@ static int nvme_ns_ioctl(struct nvme_ns *ns, unsigned cmd, unsigned long arg)
 		return nvme_user_kv_cmd(ns->ctrl, ns, (void __user *)arg, false);
 	case NVME_IOCTL_AIO_CMD:
 		return nvme_user_kv_cmd(ns->ctrl, ns, (void __user *)arg, true);
+	case NVME_IOCTL_AIO_MULTI_CMD:
+		return nvme_user_kv_multi_cmd(ns->ctrl, ns, (void __user *)arg);
 	case NVME_IOCTL_SET_AIOCTX:
 		return nvme_set_aioctx((void __user*)arg);
 	case NVME_IOCTL_DEL_AIOCTX:
@@ -136,6 +136,14 @@ struct nvme_aioevents {
 };
 
 
+/* up to NVME_AIO_MULTI_MAX aio commands submitted by one system call */
+#define NVME_AIO_MULTI_MAX	64
+struct nvme_passthru_kv_multi_cmd {
+	__u32	nr;		/* commands in cmds */
+	__u32	nr_submitted;	/* out: commands queued before the first error */
+	__u64	cmds;		/* user address of struct nvme_passthru_kv_cmd[nr] */
+};
+
 #define nvme_admin_cmd nvme_passthru_cmd
 
 #define NVME_IOCTL_ID		_IO('N', 0x40)
@@ -151,4 +159,5 @@ struct nvme_aioevents {
 #define NVME_IOCTL_DEL_AIOCTX	_IOWR('N', 0x49, struct nvme_aioctx)
 #define NVME_IOCTL_GET_AIOEVENT	_IOWR('N', 0x50, struct nvme_aioevents)
 #define NVME_IOCTL_IO_KV_CMD	_IOWR('N', 0x51, struct nvme_passthru_kv_cmd)
+#define NVME_IOCTL_AIO_MULTI_CMD	_IOWR('N', 0x52, struct nvme_passthru_kv_multi_cmd)
 #endif /* _UAPI_LINUX_NVME_IOCTL_H */
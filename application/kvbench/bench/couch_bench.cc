@@ -31,6 +31,9 @@
 #include "keyloader.h"
 #include "memory.h"
 #include "memleak.h"
+#include "memstat.h"
+#include "phases.h"
+#include "topology.h"
 
 #if defined __BLOBFS_ROCKS_BENCH
 #include "rocksdb/env.h"
@@ -102,6 +105,8 @@ struct bench_info {
     uint64_t vp_alignment;
     instance_info_t *instances;
     cpu_info *cpuinfo;
+    uint8_t placement_auto;
+    int *device_nodes;   // [system] device_nodes, -1 where not set
   
     //kv bench
     char *device_path;
@@ -122,6 +127,12 @@ struct bench_info {
     // KV and aerospike
     uint8_t kv_write_mode;
     uint8_t allow_sleep;
+    uint8_t long_keys;
+    uint32_t hot_keys;
+    uint32_t hot_keys_sample;
+    uint32_t read_ahead;            // depth, 0 for off
+    uint32_t read_ahead_streams;
+    uint32_t read_ahead_value_size;
 
     // aerospike
     uint16_t as_port;
@@ -149,6 +160,12 @@ struct bench_info {
     uint32_t latency_rate; // sampling rate for latency monitoring
     uint32_t latency_max; // max samples for latency monitoring
 
+    // memory monitoring
+    uint8_t memstat_enable;
+    uint32_t memstat_period_ms;
+    uint32_t memstat_sample_kb; // 0: no per-callsite sampling
+    uint32_t memstat_topn;
+
     // # docs, # files, DB module name, filename
     //size_t ndocs;
     uint64_t ndocs;
@@ -195,6 +212,7 @@ struct bench_info {
     size_t nops;
     size_t warmup_secs;
     size_t bench_secs;
+    phase_schedule_t phases; // nphases == 0: one stationary workload
     struct rndinfo batch_dist;
     struct rndinfo rbatchsize;
     struct rndinfo ibatchsize;
@@ -213,6 +231,10 @@ struct bench_info {
     // synchronous write
     uint8_t sync_write;
     uint8_t key_existing;
+
+    // 0: keys of batch_distribution, 1: sequential, 2: strided
+    uint8_t key_access;
+    uint64_t key_stride;
 };
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
@@ -222,12 +244,15 @@ static uint32_t rnd_seed;
 static int print_term_ms = 100;
 static int filesize_chk_term = 4;
 static std::atomic<std::uint64_t> max_key_id;
+// start of the phase schedule on the stopwatch clock, 0 while warming up
+static std::atomic<std::uint64_t> phase_start_us;
 
 FILE *log_fp = NULL;
 FILE *insert_latency_fp = NULL;
 FILE *insert_ops_fp = NULL;
 FILE *run_latency_fp = NULL;
 FILE *run_ops_fp = NULL;
+FILE *mem_fp = NULL;
 
 #if defined(__KV_BENCH)
 extern int couch_kv_min_key_len;
@@ -804,6 +829,7 @@ void *pop_thread(void *voidargs){
   if(args->valuepool)
     destroy(binfo->allocatortype, args->valuepool);
 
+  return NULL;
 }
 
 
@@ -905,7 +931,7 @@ void population(Db **db, struct bench_info *binfo)
     double iops = 0, latency_ms = 0;
     
     int keylen = (binfo->keylen.type == RND_FIXED)? binfo->keylen.a : 0;
-    gettimeofday(&t1, NULL);
+    stopwatch_gettime(&t1);
 
     stopwatch_init(&sw);
     stopwatch_start(&sw);
@@ -1029,7 +1055,7 @@ void population(Db **db, struct bench_info *binfo)
     _wait_leveldb_compaction(binfo, db);
 #endif  // __ROCKS_BENCH
 
-    gettimeofday(&t3, NULL);
+    stopwatch_gettime(&t3);
     totalmicrosecs = (t3.tv_sec - t1.tv_sec) * 1000000;
     totalmicrosecs += (t3.tv_usec - t1.tv_usec);
     latency_ms = (long double)totalmicrosecs / ((long double) binfo->ndocs * (long double) binfo->nfiles);
@@ -1217,6 +1243,22 @@ void _bench_result_free(struct bench_result *result)
 #define OP_CLOSE (0x01)
 #define OP_CLOSE_OK (0x02)
 #define OP_REOPEN (0x04)
+// op counters and latency cursors of a thread when it entered a phase
+struct phase_mark {
+    uint8_t reached;
+    uint64_t ops[3];    // read, write, delete
+    uint64_t cursor[3];
+};
+
+// where a thread is in the phase schedule and when its next op is due
+struct phase_state {
+    phase_pos_t pos;
+    size_t ratio[4];
+    double next_us;
+    double interval_us; // 0: not paced
+    double prev_reached; // ops/s of all threads in the previous phase, 0: unknown
+};
+
 struct bench_thread_args {
     int tid;
     int id;
@@ -1248,6 +1290,8 @@ struct bench_thread_args {
 #endif
     uint8_t terminate_signal;
     uint8_t op_signal;
+    int cur_phase;
+    struct phase_mark *phase_marks; // one per phase
 #if defined(__BLOBFS_ROCKS_BENCH)
   //rocksdb::Env *blobfs_env;
 #endif
@@ -1476,6 +1520,72 @@ couchstore_error_t couchstore_iterator_next(Db *db);
 bool couchstore_iterator_check_status(Db *db);
 int couchstore_iterator_get_numentries(Db *db);
 int couchstore_iterator_has_finish(Db *db);
+static void _phase_mark(struct bench_thread_args *args, int phase)
+{
+  struct phase_mark *m = &args->phase_marks[phase];
+  m->ops[0] = args->op_read.load();
+  m->ops[1] = args->op_write.load();
+  m->ops[2] = args->op_delete.load();
+  m->cursor[0] = args->l_read->cursor;
+  m->cursor[1] = args->l_write->cursor;
+  m->cursor[2] = args->l_delete->cursor;
+  m->reached = 1;
+}
+
+// moves the thread along the phase schedule and returns how many us are left
+// until its next op is due, 0 if it may issue one now
+static uint64_t _phase_step(struct bench_thread_args *args, struct phase_state *ps)
+{
+  struct bench_info *binfo = args->binfo;
+  struct timeval tv;
+  uint64_t now, start;
+  size_t nthreads;
+  double rate;
+  int i;
+
+  stopwatch_gettime(&tv);
+  now = _timeval_to_us(tv);
+  start = phase_start_us.load(std::memory_order_acquire);
+  nthreads = (binfo->nreaders + binfo->niterators + binfo->nwriters +
+	      binfo->ndeleters) * binfo->nfiles;
+  phases_locate(&binfo->phases, (start && now > start) ? now - start : 0, &ps->pos);
+  if (start) {
+    for (i = args->cur_phase + 1; i <= ps->pos.cur; ++i)
+      _phase_mark(args, i);
+    if (ps->pos.cur > args->cur_phase) {
+      // this thread's share of the rate the previous phase reached
+      struct phase_mark *m = args->phase_marks;
+      int p = ps->pos.cur - 1;
+      ps->prev_reached = 0;
+      if (m[p].reached && binfo->phases.phases[p].duration_us) {
+        uint64_t ops = (m[p + 1].ops[0] + m[p + 1].ops[1] + m[p + 1].ops[2]) -
+                       (m[p].ops[0] + m[p].ops[1] + m[p].ops[2]);
+        ps->prev_reached = 1000000.0 * ops * nthreads /
+                           binfo->phases.phases[p].duration_us;
+      }
+      args->cur_phase = ps->pos.cur;
+    }
+  }
+  phases_ratio(&binfo->phases, &ps->pos, ps->ratio);
+
+  // a virtual clock only moves while the device works, nobody could wait for it
+  rate = stopwatch_clock_is_set() ? 0 :
+         phases_rate(&binfo->phases, &ps->pos, ps->prev_reached);
+  if (rate <= 0) {
+    ps->interval_us = 0;
+    return 0;
+  }
+  ps->interval_us = 1000000.0 * nthreads / rate;
+  // do not make up for more than a second of backlog
+  if (ps->next_us == 0 || now > ps->next_us + 1000000) ps->next_us = now;
+  return (now < ps->next_us) ? (uint64_t)(ps->next_us - now) : 0;
+}
+
+static inline void _phase_issued(struct phase_state *ps)
+{
+  if (ps->interval_us > 0) ps->next_us += ps->interval_us;
+}
+
 void * bench_thread(void *voidargs)
 {
   struct bench_thread_args *args = (struct bench_thread_args *)voidargs;
@@ -1512,8 +1622,14 @@ void * bench_thread(void *voidargs)
   uint64_t max_key_index = 0;
   int singledb_thread_num = binfo->nreaders + binfo->niterators + binfo->nwriters + binfo->ndeleters;
   uint64_t key_offset = 0;
+  struct phase_state ps;
+  size_t *ratio = binfo->ratio;
+  uint64_t phase_wait = 0;
+  uint64_t key_cursor = 0;
 
   prctl(PR_SET_NAME, THREAD_NAME[args->mode], NULL, NULL, NULL);
+  memset(&ps, 0, sizeof(ps));
+  if (binfo->phases.nphases) ratio = ps.ratio;
 
   if (binfo->key_existing) {
     if (args->mode == 0) {
@@ -1526,6 +1642,10 @@ void * bench_thread(void *voidargs)
       key_offset = args->id % singledb_thread_num;
     }
   }
+  // key_existing gives every thread keys of its own, else threads scan
+  // different ranges
+  if (binfo->key_access && !binfo->key_existing)
+    key_cursor = args->id % singledb_thread_num * (binfo->ndocs / singledb_thread_num);
 #if defined(__BLOBFS_ROCKS_BENCH)
   // Set up SPDK-specific stuff for this thread
   rocksdb::SpdkInitializeThread();
@@ -1646,8 +1766,19 @@ void * bench_thread(void *voidargs)
       cur_op_idx++;
     }
     */
+    if (binfo->phases.nphases) {
+      phase_wait = _phase_step(args, &ps);
+      if (phase_wait && (binfo->kv_write_mode == 1 || args->cur_qdepth == 0)) {
+        usleep(MIN(phase_wait, 100000));
+        continue;
+      }
+    }
+
     // ramdomly set document distribution for batch
-    if (binfo->batch_dist.type == RND_UNIFORM) {
+    if (binfo->phases.nphases) {
+      BDR_RNG_NEXTPAIR;
+      op_med = phases_key(&binfo->phases, &ps.pos, rngz, rngz2);
+    } else if (binfo->batch_dist.type == RND_UNIFORM) {
       // uniform distribution
       BDR_RNG_NEXTPAIR;
       op_med = get_random(&binfo->batch_dist, rngz, rngz2);
@@ -1657,6 +1788,12 @@ void * bench_thread(void *voidargs)
       op_med = zipf_rnd_get(zipf);
       op_med = op_med * binfo->batch_dist.b + (rngz % binfo->batch_dist.b);
     }
+    if (binfo->key_access && binfo->ndocs) {
+      // scans the populated keys instead
+      op_med = key_cursor;
+      key_cursor = (key_cursor + (binfo->key_access == 1 ? 1 : binfo->key_stride)) %
+                   binfo->ndocs;
+    }
     r = op_med;
 
     if (binfo->kv_write_mode == 1) { // sync mode
@@ -1664,11 +1801,11 @@ void * bench_thread(void *voidargs)
       if(args->mode > 0){
 	      write_mode = args->mode;
       } else {
-      	if(cur_op_idx % 100 < binfo->ratio[1] + binfo->ratio[2]){
+      	if(cur_op_idx % 100 < ratio[1] + ratio[2]){
       	  write_mode = 1; // write: update/insert
-            if (binfo->key_existing && cur_op_idx % 100 < binfo->ratio[1])
+            if (binfo->key_existing && cur_op_idx % 100 < ratio[1])
               write_mode = 5; // update
-      	} else if(cur_op_idx % 100 < binfo->ratio[0] + binfo->ratio[1] + binfo->ratio[2]){
+      	} else if(cur_op_idx % 100 < ratio[0] + ratio[1] + ratio[2]){
       	  write_mode = 2; // read
       	} else {
       	  write_mode = 4; // delete
@@ -1953,6 +2090,7 @@ void * bench_thread(void *voidargs)
       	l_stat->samples[cur_sample] = _timeval_to_us(gap);
       }
 
+      _phase_issued(&ps);
       if(write_mode == 1) {
       	args->op_write.fetch_add(1, std::memory_order_release);
       } else if(write_mode == 2){
@@ -2003,7 +2141,7 @@ void * bench_thread(void *voidargs)
       	}
       }
 #endif
-      if(args->cur_qdepth < binfo->queue_depth) {
+      if(args->cur_qdepth < binfo->queue_depth && phase_wait == 0) {
 	      if(args->terminate_signal) break;
 #if defined __KV_BENCH
       	if(binfo->with_iterator == 1  && args->tid == 0 && iterator_send == 0 && args->cur_qdepth < binfo->queue_depth - 1) {
@@ -2024,11 +2162,11 @@ void * bench_thread(void *voidargs)
       	if(args->mode > 0){
       	  write_mode = args->mode;
       	} else {
-      	  if(cur_op_idx % 100 < binfo->ratio[1] + binfo->ratio[2]){
+      	  if(cur_op_idx % 100 < ratio[1] + ratio[2]){
       	    write_mode = 1; // write: update/insert
-      	    if (binfo->key_existing && cur_op_idx % 100 < binfo->ratio[1])
+      	    if (binfo->key_existing && cur_op_idx % 100 < ratio[1])
                 write_mode = 5;
-      	  } else if(cur_op_idx % 100 < binfo->ratio[0] + binfo->ratio[1] + binfo->ratio[2]){
+      	  } else if(cur_op_idx % 100 < ratio[0] + ratio[1] + ratio[2]){
       	    write_mode = 2; // read
       	  } else {
       	    write_mode = 4; // delete
@@ -2165,6 +2303,7 @@ void * bench_thread(void *voidargs)
 #endif
       	}
       	args->cur_qdepth++;
+      	_phase_issued(&ps);
       	if(write_mode == 1) {
       	  args->op_write.fetch_add(1, std::memory_order_release);
       	} else if(write_mode == 2){
@@ -2349,6 +2488,10 @@ couchstore_error_t couchstore_kvs_set_aiothreads(int aio_threads);
 couchstore_error_t couchstore_kvs_set_coremask(char *core_ids);
 couchstore_error_t couchstore_kvs_get_aiocompletion(int32_t *count);
 couchstore_error_t couchstore_kvs_set_max_sample(uint32_t sample_num);
+couchstore_error_t couchstore_kvs_set_long_keys(int enable);
+couchstore_error_t couchstore_kvs_set_hot_keys(uint32_t top_k, uint32_t sample_rate);
+couchstore_error_t couchstore_kvs_set_read_ahead(uint32_t depth, uint32_t streams,
+                                                 uint32_t value_size);
 
 static int _does_file_exist(char *filename) {
     struct stat st;
@@ -2531,6 +2674,107 @@ void _print_percentile(struct bench_info *binfo,
     }
 }
 
+// starts the phase schedule, the op counters and latency cursors of all
+// threads must have been reset
+static void _phases_begin(struct bench_thread_args *b_args, int nthreads)
+{
+  struct timeval tv;
+  int i;
+
+  for (i = 0; i < nthreads; i++) {
+    memset(&b_args[i].phase_marks[0], 0, sizeof(struct phase_mark));
+    b_args[i].phase_marks[0].reached = 1;
+  }
+  stopwatch_gettime(&tv);
+  phase_start_us.store(_timeval_to_us(tv), std::memory_order_release);
+}
+
+// prints p50 / p99 of the latency samples all threads recorded in a phase.
+// A thread that records more than latency_max samples in one phase wraps its
+// ring and loses them.
+static void _print_phase_latency(struct bench_info *binfo,
+				 struct bench_thread_args *b_args,
+				 int nthreads, int phase, int kind)
+{
+  uint64_t max = binfo->latency_max;
+  uint64_t n = 0, begin, end, k;
+  uint32_t *samples;
+  struct latency_stat *l_stat;
+  struct phase_mark *m;
+  char buf[32];
+  int i;
+
+  samples = (uint32_t*)malloc(sizeof(uint32_t) * max * nthreads);
+  for (i = 0; i < nthreads; i++) {
+    m = b_args[i].phase_marks;
+    if (!m[phase].reached) continue;
+    l_stat = (kind == 0) ? b_args[i].l_read : b_args[i].l_write;
+    begin = m[phase].cursor[kind] % max;
+    if (phase + 1 < binfo->phases.nphases && m[phase + 1].reached) {
+      end = m[phase + 1].cursor[kind] % max;
+    } else {
+      end = l_stat->cursor % max;
+    }
+    for (k = begin; k != end; k = (k + 1) % max) {
+      samples[n++] = l_stat->samples[k];
+    }
+  }
+  if (n < 100) {
+    strcpy(buf, "-");
+  } else {
+    qsort(samples, n, sizeof(uint32_t), _cmp_uint32_t);
+    sprintf(buf, "%d / %d", (int)samples[n * 50 / 100], (int)samples[n * 99 / 100]);
+  }
+  lprintf(" %17s", buf);
+  free(samples);
+}
+
+void _print_phase_summary(struct bench_info *binfo,
+			  struct bench_thread_args *b_args,
+			  int nthreads, double elapsed)
+{
+  phase_schedule_t *s = &binfo->phases;
+  uint64_t ops[3], end;
+  double start = 0, secs;
+  int p, last = 0, i, k;
+
+  for (i = 0; i < nthreads; i++) {
+    for (p = 0; p < s->nphases; p++) {
+      if (b_args[i].phase_marks[p].reached && p > last) last = p;
+    }
+  }
+
+  lprintf("\nphase summary\n");
+  lprintf("%-20s %8s %10s %10s %10s %12s %17s %17s\n", "phase", "secs",
+	  "reads", "writes", "deletes", "ops/s", "read p50/p99 us", "write p50/p99 us");
+  for (p = 0; p <= last; p++) {
+    secs = (p == last) ? elapsed - start : s->phases[p].duration_us / 1000000.0;
+    ops[0] = ops[1] = ops[2] = 0;
+    for (i = 0; i < nthreads; i++) {
+      struct phase_mark *m = b_args[i].phase_marks;
+      if (!m[p].reached) continue;
+      for (k = 0; k < 3; k++) {
+	if (p + 1 < s->nphases && m[p + 1].reached) {
+	  end = m[p + 1].ops[k];
+	} else {
+	  end = (k == 0) ? b_args[i].op_read.load() :
+	    (k == 1) ? b_args[i].op_write.load() : b_args[i].op_delete.load();
+	}
+	ops[k] += end - m[p].ops[k];
+      }
+    }
+    lprintf("%-20s %8.2f %10" _F64 " %10" _F64 " %10" _F64 " %12.2f",
+	    s->phases[p].name, secs, ops[0], ops[1], ops[2],
+	    secs > 0 ? (ops[0] + ops[1] + ops[2]) / secs : 0);
+    if (binfo->latency_rate) {
+      _print_phase_latency(binfo, b_args, nthreads, p, 0);
+      _print_phase_latency(binfo, b_args, nthreads, p, 1);
+    }
+    lprintf("\n");
+    start += s->phases[p].duration_us / 1000000.0;
+  }
+}
+
 void db_env_setup(struct bench_info *binfo){
 
 #if !defined(__COUCH_BENCH) && !defined(__KV_BENCH) && !defined(__KVROCKS_BENCH) && !defined(__AS_BENCH)
@@ -2589,6 +2833,58 @@ void db_env_setup(struct bench_info *binfo){
 
 }
 
+static void _print_memory_footprint(struct bench_info *binfo, uint64_t nkeys,
+                                    memstat_snapshot_t *pop_start,
+                                    memstat_snapshot_t *pop_end, int pop_phase,
+                                    memstat_snapshot_t *bench_start,
+                                    memstat_snapshot_t *bench_end, int bench_phase,
+                                    uint64_t inflight)
+{
+  char buf1[128], buf2[128], buf3[128];
+  memstat_phase_stat_t pst, bst;
+  memstat_snapshot_t now;
+
+  memstat_get(&now);
+  memstat_get_phase(pop_phase, &pst);
+  memstat_get_phase(bench_phase, &bst);
+
+  lprintf("\nmemory footprint\n");
+  lprintf("rss %s (peak %s), heap in use %s, %" _F64 " allocations\n",
+          print_filesize_approx(now.rss, buf1),
+          print_filesize_approx(now.rss_peak, buf2),
+          print_filesize_approx(now.heap_live > 0 ? now.heap_live : 0, buf3),
+          now.nallocs);
+  lprintf("anon huge pages %s, hugetlb %s, system hugepages in use %s\n",
+          print_filesize_approx(MAX(pst.anon_huge_peak, bst.anon_huge_peak), buf1),
+          print_filesize_approx(now.hugetlb, buf2),
+          print_filesize_approx(MAX(pst.huge_peak, bst.huge_peak), buf3));
+
+  if (nkeys && pop_phase >= 0) {
+    int64_t dheap = pop_end->heap_live - pop_start->heap_live;
+    int64_t drss = (int64_t)pop_end->rss - (int64_t)pop_start->rss;
+    lprintf("population: %" _F64 " keys, %.1f heap bytes/key, %.1f rss bytes/key "
+            "(peak heap %s, peak rss %s)\n",
+            nkeys, (double)dheap / nkeys, (double)drss / nkeys,
+            print_filesize_approx(pst.heap_peak > 0 ? pst.heap_peak : 0, buf1),
+            print_filesize_approx(pst.rss_peak, buf2));
+  }
+  if (inflight && bench_phase >= 0 && bst.nsamples) {
+    // in-flight requests and worker buffers are gone once the workers are
+    // joined, so the mean above that level is what the outstanding ops cost
+    double dheap = bst.heap_mean - bench_end->heap_live;
+    lprintf("benchmark: %" _F64 " ops in flight, %.1f heap bytes/op "
+            "(%" _F64 " samples, heap %+.1f MB over the run, peak rss %s)\n",
+            inflight, dheap / inflight, bst.nsamples,
+            (double)(bench_end->heap_live - bench_start->heap_live) / (1024 * 1024),
+            print_filesize_approx(bst.rss_peak, buf1));
+  }
+
+  if (binfo->memstat_topn) {
+    memstat_print_sites(stdout, binfo->memstat_topn);
+    if (log_fp) memstat_print_sites(log_fp, binfo->memstat_topn);
+  }
+}
+
 void do_bench(struct bench_info *binfo)
 {
   BDR_RNG_VARS;
@@ -2642,6 +2938,11 @@ void do_bench(struct bench_info *binfo)
   struct bench_shared_stat b_stat;
   struct bench_thread_args *b_args;
   //struct latency_stat l_read, l_write, l_delete;
+  memstat_snapshot_t mem_pop_start, mem_pop_end, mem_bench_start, mem_bench_end;
+  int mem_pop_phase = -1, mem_bench_phase = -1;
+  uint64_t mem_nkeys = 0;
+  memset(&mem_pop_start, 0, sizeof(mem_pop_start));
+  memset(&mem_pop_end, 0, sizeof(mem_pop_end));
 #if defined(__FDB_BENCH) || defined(__COUCH_BENCH)
   struct compactor_args c_args;
 #endif
@@ -2772,9 +3073,13 @@ void do_bench(struct bench_info *binfo)
       }
 #endif
 
+      memstat_get(&mem_pop_start);
+      mem_pop_phase = memstat_phase("population");
       stopwatch_start(&sw);
       if(binfo->pop_nthreads != 0 && binfo->nfiles != 0 && binfo->ndocs != 0)
         population(db, binfo);
+      memstat_get(&mem_pop_end);
+      mem_nkeys = binfo->ndocs * binfo->nfiles;
 
 #if  defined(__PRINT_IOSTAT) && \
   (defined(__LEVEL_BENCH) || defined(__ROCKS_BENCH)  || defined(__BLOBFS_ROCKS_BENCH) || defined(__KVDB_BENCH))
@@ -2890,6 +3195,11 @@ void do_bench(struct bench_info *binfo)
 		    binfo->batch_dist.a/100.0, 1024*1024);
     }
   }
+  if (binfo->phases.nphases) {
+    phases_init(&binfo->phases);
+    if (stopwatch_clock_is_set())
+      printf("WARN: phase rates are not applied on a simulated device clock\n");
+  }
 
   // set signal handler
   old_handler = signal(SIGINT, signal_handler);
@@ -2963,6 +3273,9 @@ void do_bench(struct bench_info *binfo)
     b_args[i].zipf = &zipf;
     b_args[i].terminate_signal = 0;
     b_args[i].op_signal = 0;
+    b_args[i].cur_phase = 0;
+    b_args[i].phase_marks = (struct phase_mark *)
+      calloc(binfo->phases.nphases + 1, sizeof(struct phase_mark));
     b_args[i].binfo = binfo;
 
     b_args[i].keypool = (mempool_t *)malloc(sizeof(mempool_t));
@@ -3076,6 +3389,8 @@ void do_bench(struct bench_info *binfo)
 
   bench_worker_ret = alca(void*, bench_threads);
 
+  memstat_get(&mem_bench_start);
+  mem_bench_phase = memstat_phase("benchmark");
   for(i = 0; i < bench_threads; ++i){
     b_args[i].tid = i;
     pthread_create(&bench_worker[i], &attr[i], bench_thread, (void*)&b_args[i]);
@@ -3089,6 +3404,8 @@ void do_bench(struct bench_info *binfo)
   // timer for total elapsed time
   stopwatch_init(&sw);
   stopwatch_start(&sw);
+  if (!binfo->warmup_secs && binfo->phases.nphases)
+    _phases_begin(b_args, bench_threads);
 
   // timer for periodic stdout print
   stopwatch_init(&progress);
@@ -3200,6 +3517,11 @@ void do_bench(struct bench_info *binfo)
 				  (prev_op_count_read + prev_op_count_write +
 				   prev_op_count_delete)) /
 			 (_gap.tv_sec + (double)_gap.tv_usec / 1000000.0));
+		  if (binfo->phases.nphases && !warmingup) {
+		    phase_pos_t pos;
+		    phases_locate(&binfo->phases, _timeval_to_us(gap), &pos);
+		    printf(" [%s]", binfo->phases.phases[pos.cur].name);
+		  }
 
 #if defined (__KV_BENCH) || defined(__KVROCKS_BENCH) || defined (__AS_BENCH)
 		  // TBD: get KVS bytes written
@@ -3333,6 +3655,8 @@ void do_bench(struct bench_info *binfo)
       			b_args[j].l_read->cursor = b_args[j].l_write->cursor
       			  = b_args[j].l_delete->cursor = 0;
 		      }
+		      if (binfo->phases.nphases)
+		        _phases_begin(b_args, bench_threads);
 		      warmingup = false;
 		      lprintf("\nevaluation\n");
 		      lprintf("time,ops_avg,ops_i,read_cnt,write_cnt,bytes_written\n");
@@ -3347,8 +3671,8 @@ void do_bench(struct bench_info *binfo)
 
 		  stopwatch_start(&progress);
     } else {
-      // sleep 0.1 sec
-      stopwatch_start(&progress);
+      // sleep 0.1 sec; the period still counts from the last report, a
+      // simulated device clock may move slower than the wall clock
       usleep(print_term_ms * 1000);
     }
 
@@ -3374,6 +3698,8 @@ void do_bench(struct bench_info *binfo)
   for (i=0;i<bench_threads;++i){
     thread_join(bench_worker[i], &bench_worker_ret[i]);
   }
+  memstat_get(&mem_bench_end);
+  memstat_phase("shutdown");
   
 #if defined (__KV_BENCH) || defined (__AS_BENCH)
 
@@ -3424,6 +3750,16 @@ void do_bench(struct bench_info *binfo)
     lprintf("average latency %f\n", gap_double * 1000000 /
 	    ( op_count_read + op_count_write + op_count_delete));
   }
+  if (memstat_enabled()) {
+    uint64_t inflight = bench_threads;
+#if defined __KV_BENCH || defined __AS_BENCH
+    if (binfo->kv_write_mode == 0) inflight *= binfo->queue_depth;
+#endif
+    _print_memory_footprint(binfo, mem_nkeys, &mem_pop_start, &mem_pop_end,
+                            mem_pop_phase, &mem_bench_start, &mem_bench_end,
+                            mem_bench_phase, inflight);
+  }
+
 #if defined(__FDB_BENCH) || defined(__COUCH_BENCH)
   if (!binfo->auto_compaction) {
     // manual compaction
@@ -3459,6 +3795,10 @@ void do_bench(struct bench_info *binfo)
   }
 #endif
 
+  if (binfo->phases.nphases) {
+    _print_phase_summary(binfo, b_args, bench_threads, gap_double);
+  }
+
   // TODO: update latency rate
   if(binfo->latency_rate && binfo->with_iterator != 2) {
     struct latency_stat w_stat;
@@ -3516,6 +3856,12 @@ void do_bench(struct bench_info *binfo)
   if (binfo->batch_dist.type == RND_ZIPFIAN) {
     zipf_rnd_free(&zipf);
   }
+  if (binfo->phases.nphases) {
+    phases_free(&binfo->phases);
+  }
+  for (i = 0; i < bench_threads; i++) {
+    free(b_args[i].phase_marks);
+  }
 
 #ifdef __FDB_BENCH
   // print ForestDB's own block cache info (internal function call)
@@ -3650,6 +3996,9 @@ void _print_benchinfo(struct bench_info *binfo)
         lprintf("enabled disjoint write among %d writers over %d files\n",
                 (int)binfo->nwriters, (int)binfo->nfiles);
     }
+    if (binfo->placement_auto) {
+        lprintf("thread placement: auto\n");
+    }
 
     lprintf("# auto-compaction threads: %d\n", binfo->auto_compaction_threads);
 
@@ -3734,7 +4083,11 @@ void _print_benchinfo(struct bench_info *binfo)
 	      (int)binfo->bodylen.a, (int)binfo->bodylen.b);
     }
     lprintf("batch distribution: ");
-    if (binfo->batch_dist.type == RND_UNIFORM) {
+    if (binfo->key_access == 1) {
+        lprintf("Sequential\n");
+    } else if (binfo->key_access == 2) {
+        lprintf("Strided (stride: %lu)\n", (unsigned long)binfo->key_stride);
+    } else if (binfo->batch_dist.type == RND_UNIFORM) {
         lprintf("Uniform\n");
     }else{
         lprintf("Zipfian (s=%.2f, group: %d documents)\n",
@@ -3753,6 +4106,33 @@ void _print_benchinfo(struct bench_info *binfo)
         lprintf("benchmark duration: %lu seconds\n",
                 (unsigned long)binfo->bench_secs);
     }
+    if (binfo->phases.nphases) {
+        phase_schedule_t *s = &binfo->phases;
+        lprintf("phases: %d, %s transitions", s->nphases,
+                s->smooth ? "smooth" : "abrupt");
+        if (s->smooth) {
+            lprintf(" (%.1f seconds)", s->transition_us / 1000000.0);
+        }
+        lprintf("\n");
+        for (int i = 0; i < s->nphases; ++i) {
+            phase_t *ph = &s->phases[i];
+            lprintf("  %s: %.1f s, %d:%d:%d:%d, ", ph->name,
+                    ph->duration_us / 1000000.0, (int)ph->ratio[0],
+                    (int)ph->ratio[1], (int)ph->ratio[2], (int)ph->ratio[3]);
+            if (ph->dist.type == RND_UNIFORM) {
+                lprintf("Uniform");
+            } else {
+                lprintf("Zipfian (s=%.2f, group: %d documents)",
+                        (double)ph->dist.a/100.0, (int)ph->dist.b);
+            }
+            lprintf(", hot set at %.2f + %.4f/s", ph->hot_offset, ph->hot_drift);
+            if (ph->rate > 0) {
+                lprintf(", %.0f ops/s\n", ph->rate);
+            } else {
+                lprintf(", unlimited\n");
+            }
+        }
+    }
 
     lprintf("read batch size: point %s(%d,%d), range %s(%d,%d)\n",
             (binfo->rbatchsize.type == RND_NORMAL)?"Norm":"Uniform",
@@ -3775,6 +4155,14 @@ void _print_benchinfo(struct bench_info *binfo)
     }
     lprintf(" (%s)\n", ((binfo->sync_write)?("synchronous"):("asynchronous")));
     lprintf("insertion order: %s\n", ((binfo->seq_fill)?("sequential fill"):("random fill")));
+    if (binfo->memstat_enable) {
+        lprintf("memory monitor: every %d ms, ", (int)binfo->memstat_period_ms);
+        if (binfo->memstat_sample_kb) {
+            lprintf("1 allocation sampled per %d KB\n", (int)binfo->memstat_sample_kb);
+        } else {
+            lprintf("no allocation sampling\n");
+        }
+    }
 
 #if defined(__FDB_BENCH)
     lprintf("compaction threshold: %d %% "
@@ -3857,6 +4245,30 @@ void _set_keyloader(struct bench_info *binfo)
 }
 
 
+static void _print_cpu_aff(struct bench_info *binfo){
+  int i, j;
+  int total_bench_threads = binfo->nreaders + binfo->niterators + binfo->nwriters + binfo->ndeleters;
+
+  for(i=0;i<binfo->cpuinfo->num_numanodes;i++){
+    printf("node %d: ", i);
+    for(j=0;j< binfo->cpuinfo->num_cores_per_numanodes; j++)
+      printf("%d ", binfo->cpuinfo->cpulist[i][j]);
+    printf("\n");
+  }
+  for(i = 0;i < binfo->nfiles; i++){
+    printf("pop -- dev %s, numaid %d, core: ", binfo->device_name[i], binfo->instances[i].nodeid_load);
+    for(j = 0; j < binfo->pop_nthreads; j++)
+      printf("%d ", binfo->instances[i].coreids_pop[j]);
+    printf("\n");
+  }
+  for(i = 0;i < binfo->nfiles; i++){
+    printf("bench --- dev %s, numaid %d, core: ", binfo->device_name[i], binfo->instances[i].nodeid_perf);
+    for(j = 0; j < total_bench_threads; j++)
+      printf("%d ", binfo->instances[i].coreids_bench[j]);
+    printf("\n");
+  }
+}
+
 void init_cpu_aff(struct bench_info *binfo){
   int i, j, line_num = 0, core_count = 0;
   int nodeid = 0, coreid = 0, insid_load = 0,insid_perf = 0;
@@ -3934,13 +4346,6 @@ void init_cpu_aff(struct bench_info *binfo){
     line_num++;
   }
 
-  for(i=0;i<binfo->cpuinfo->num_numanodes;i++){
-    printf("node %d: ", i);
-    for(j=0;j< binfo->cpuinfo->num_cores_per_numanodes; j++)
-      printf("%d ", binfo->cpuinfo->cpulist[i][j]);
-    printf("\n");
-  }
-
   for(i = 0; i < binfo->nfiles; i++) {
     get_nvme_numa_node(binfo->device_name[i], &binfo->instances[i]);
     while (cur_load < binfo->pop_nthreads){
@@ -3953,22 +4358,182 @@ void init_cpu_aff(struct bench_info *binfo){
     }
   }
 
-  for(i = 0;i < binfo->nfiles; i++){
-    printf("pop -- dev %s, numaid %d, core: ", binfo->device_name[i], binfo->instances[i].nodeid_load);
-    for(j = 0; j < binfo->pop_nthreads; j++)
-      printf("%d ", binfo->instances[i].coreids_pop[j]);
-    printf("\n");
-  }
-  for(i = 0;i < binfo->nfiles; i++){
-    printf("bench --- dev %s, numaid %d, core: ", binfo->device_name[i], binfo->instances[i].nodeid_perf);
-    for(j = 0; j < total_bench_threads; j++)
-      printf("%d ", binfo->instances[i].coreids_bench[j]);
-    printf("\n");
-  }
+  _print_cpu_aff(binfo);
   
   if(fp) fclose(fp);
 }
 
+// [system] placement = auto: the plan of utils/topology.cc instead of cpu.txt
+void init_cpu_aff_auto(struct bench_info *binfo){
+  int i, j, n;
+  int total_bench_threads = binfo->nreaders + binfo->niterators + binfo->nwriters + binfo->ndeleters;
+  int polling = 0;
+  int *nodes = (int *)malloc(sizeof(int) * binfo->nfiles);
+  placement_t *plan = (placement_t *)calloc(binfo->nfiles, sizeof(placement_t));
+  topology_t topo;
+
+  if (topology_read(&topo) < 0) {
+    fprintf(stderr, "ERROR: cannot read the CPU topology, use placement = manual\n");
+    exit(1);
+  }
+#if defined(__KV_BENCH) && !defined(__KVADI_BENCH)
+  // the user space driver polls for completions
+  polling = binfo->kv_device_path[0] != '/';
+#endif
+  for (i = 0; i < binfo->nfiles; i++) {
+    nodes[i] = binfo->device_nodes[i];
+    if (nodes[i] < 0) nodes[i] = topology_device_node(binfo->device_name[i]);
+  }
+  // pools on the node of their device, the user space driver needs its own memory
+  if (!polling && binfo->allocatortype == NO_POOL) {
+    binfo->allocate_mem = &allocate_mem_numa;
+    binfo->free_mem = &free_mem_numa;
+    binfo->allocatortype = NUMA_ALLOCATOR;
+  }
+  // the user space driver submits from one core per device, see core_ids
+  placement_plan(&topo, binfo->nfiles, nodes, polling,
+                 polling ? 1 : binfo->pop_nthreads, polling ? 1 : total_bench_threads, plan);
+
+  binfo->instances = (instance_info_t *)malloc(sizeof(instance_info_t) * binfo->nfiles);
+  for (i = 0; i < binfo->nfiles; i++) {
+    instance_info_t *ins = &binfo->instances[i];
+    ins->nodeid_load = ins->nodeid_perf = plan[i].node;
+    ins->coreids_pop = (int*)malloc(sizeof(int) * binfo->pop_nthreads);
+    for (j = 0; j < binfo->pop_nthreads; j++)
+      ins->coreids_pop[j] = plan[i].pop_cpus[polling ? 0 : j];
+    ins->coreids_bench = (int*)malloc(sizeof(int) * total_bench_threads);
+    for (j = 0; j < total_bench_threads; j++)
+      ins->coreids_bench[j] = plan[i].bench_cpus[polling ? 0 : j];
+  }
+
+  if (polling) {
+    char *core = binfo->core_ids, *cq = binfo->cq_thread_ids;
+    core[0] = cq[0] = '\0';
+    for (i = 0; i < binfo->nfiles; i++) {
+      n = strlen(core);
+      snprintf(core + n, 256 - n, "%s%d", i ? "," : "", plan[i].bench_cpus[0]);
+      n = strlen(cq);
+      snprintf(cq + n, 256 - n, "%s%d", i ? "," : "", plan[i].cq_cpu);
+    }
+    printf("core_ids = %s, cq_thread_ids = %s\n", core, cq);
+  }
+
+  // node CPU lists for threads that are not pinned to one CPU
+  binfo->cpuinfo->cpulist = (int **)calloc(1, sizeof(int *) * binfo->cpuinfo->num_numanodes);
+  for (i = 0; i < binfo->cpuinfo->num_numanodes; i++) {
+    int count = 0;
+    binfo->cpuinfo->cpulist[i] = (int*)calloc(1, sizeof(int) * binfo->cpuinfo->num_cores_per_numanodes);
+    for (j = 0; j < topo.ncpus; j++) {
+      if (topo.cpus[j].node == i && count < binfo->cpuinfo->num_cores_per_numanodes)
+        binfo->cpuinfo->cpulist[i][count++] = topo.cpus[j].id;
+    }
+    // nodes with fewer CPUs repeat them
+    for (j = count; count && j < binfo->cpuinfo->num_cores_per_numanodes; j++)
+      binfo->cpuinfo->cpulist[i][j] = binfo->cpuinfo->cpulist[i][j % count];
+  }
+
+  _print_cpu_aff(binfo);
+
+  placement_free(plan, binfo->nfiles);
+  free(plan);
+  free(nodes);
+  topology_free(&topo);
+}
+
+// reads [phases] and [phase1] .. [phaseN], settings a phase leaves out are
+// taken from [operation]
+static int _get_phases(dictionary *cfg, struct bench_info *binfo)
+{
+    phase_schedule_t *s = &binfo->phases;
+    char key[64], buff[256], *str, *pt;
+    size_t max_insert = 0;
+    int i, j, total;
+
+    str = iniparser_getstring(cfg, (char*)"phases:transition", (char*)"abrupt");
+    s->smooth = (str[0] == 's');
+    s->transition_us = iniparser_getdouble(cfg, (char*)"phases:transition_secs", 5) * 1000000;
+    s->phases = (phase_t *)calloc(s->nphases, sizeof(phase_t));
+
+    for (i = 0; i < s->nphases; ++i) {
+        phase_t *p = &s->phases[i];
+
+        sprintf(key, "phase%d:name", i + 1);
+        sprintf(buff, "phase%d", i + 1);
+        snprintf(p->name, PHASE_NAME_LEN, "%s", iniparser_getstring(cfg, key, buff));
+
+        sprintf(key, "phase%d:duration", i + 1);
+        p->duration_us = iniparser_getdouble(cfg, key, 10) * 1000000;
+        if (p->duration_us == 0) {
+            fprintf(stdout, "WARN: %s: duration must be positive\n", p->name);
+            return -1;
+        }
+
+        sprintf(key, "phase%d:read_write_insert_delete", i + 1);
+        str = iniparser_getstring(cfg, key, NULL);
+        if (str) {
+            strncpy(buff, str, sizeof(buff) - 1);
+            buff[sizeof(buff) - 1] = 0;
+            j = 0;
+            pt = strtok(buff, ":");
+            while (pt != NULL && j < 4) {
+                p->ratio[j++] = atoi(pt);
+                pt = strtok(NULL, ":");
+            }
+        } else {
+            memcpy(p->ratio, binfo->ratio, sizeof(p->ratio));
+        }
+        total = p->ratio[0] + p->ratio[1] + p->ratio[2] + p->ratio[3];
+        if (total != 100) {
+            fprintf(stdout, "WARN: %s: total operation ratio should equal to 100\n",
+                    p->name);
+            return -1;
+        }
+        if (p->ratio[2] > max_insert) max_insert = p->ratio[2];
+
+        sprintf(key, "phase%d:batch_distribution", i + 1);
+        str = iniparser_getstring(cfg, key, (char*)
+                                  ((binfo->batch_dist.type == RND_ZIPFIAN) ?
+                                   "zipfian" : "uniform"));
+        if (str[0] == 'u') {
+            p->dist.type = RND_UNIFORM;
+        } else {
+            p->dist.type = RND_ZIPFIAN;
+            sprintf(key, "phase%d:batch_parameter1", i + 1);
+            p->dist.a = (int64_t)(iniparser_getdouble(cfg, key,
+                        (binfo->batch_dist.type == RND_ZIPFIAN) ?
+                        binfo->batch_dist.a / 100.0 : 1) * 100);
+            sprintf(key, "phase%d:batch_parameter2", i + 1);
+            p->dist.b = iniparser_getint(cfg, key,
+                        (binfo->batch_dist.type == RND_ZIPFIAN) ?
+                        binfo->batch_dist.b : 64);
+            if (p->dist.b <= 0) {
+                fprintf(stdout, "WARN: %s: batch_parameter2 must be positive\n", p->name);
+                return -1;
+            }
+        }
+
+        sprintf(key, "phase%d:hot_offset", i + 1);
+        p->hot_offset = iniparser_getdouble(cfg, key, 0);
+        sprintf(key, "phase%d:hot_drift", i + 1);
+        p->hot_drift = iniparser_getdouble(cfg, key, 0);
+        sprintf(key, "phase%d:rate", i + 1);
+        p->rate = iniparser_getdouble(cfg, key, 0);
+    }
+
+    // same key range as the uniform distribution of [operation]
+    if (binfo->nops > 0) {
+        s->key_range = binfo->ndocs + binfo->nops * max_insert * 2;
+    } else {
+        s->key_range = binfo->ndocs * binfo->amp_factor;
+    }
+    if (s->key_range == 0) s->key_range = 1;
+
+    // the mix is set per phase, so all threads run mixed workloads
+    memcpy(binfo->ratio, s->phases[0].ratio, sizeof(binfo->ratio));
+    binfo->bench_secs = (phases_total_us(s) + 999999) / 1000000;
+    return 0;
+}
+
 struct bench_info get_benchinfo(char* bench_config_filename, int config_only)
 {
     int i, j;
@@ -4034,6 +4599,9 @@ struct bench_info get_benchinfo(char* bench_config_filename, int config_only)
 #elif __WT_BENCH
     sprintf(dbname, "WiredTiger");
     sprintf(dbname_postfix, "wt");
+#elif __KVADI_BENCH
+    sprintf(dbname, "KVS-ADI");
+    sprintf(dbname_postfix, "kvadi");
 #elif __KV_BENCH
     sprintf(dbname, "KVS");
     sprintf(dbname_postfix, "kvs");
@@ -4126,6 +4694,48 @@ struct bench_info get_benchinfo(char* bench_config_filename, int config_only)
     str = iniparser_getstring(cfg, (char*)"kvs:allow_sleep", (char*)"true");
     binfo.allow_sleep = (str[0]=='t')?(1):(0);
 
+    str = iniparser_getstring(cfg, (char*)"kvs:long_keys", (char*)"false");
+    binfo.long_keys = (str[0]=='t')?(1):(0);
+#if defined(__KV_BENCH)
+    // raises the key length limit checked below
+    if (couchstore_kvs_set_long_keys(binfo.long_keys) != COUCHSTORE_SUCCESS) {
+      iniparser_free(cfg);
+      exit(1);
+    }
+#endif
+
+    binfo.hot_keys = iniparser_getint(cfg, (char*)"kvs:hot_keys", 0);
+    binfo.hot_keys_sample = iniparser_getint(cfg, (char*)"kvs:hot_keys_sample", 16);
+    if (binfo.hot_keys > 256) {
+      fprintf(stderr, "ERROR: kvs:hot_keys must be at most 256\n");
+      exit(1);
+    }
+#if defined(__KV_BENCH)
+    if (couchstore_kvs_set_hot_keys(binfo.hot_keys, binfo.hot_keys_sample) !=
+        COUCHSTORE_SUCCESS) {
+      iniparser_free(cfg);
+      exit(1);
+    }
+#endif
+
+    binfo.read_ahead = iniparser_getint(cfg, (char*)"kvs:read_ahead", 0);
+    binfo.read_ahead_streams = iniparser_getint(cfg, (char*)"kvs:read_ahead_streams", 16);
+    binfo.read_ahead_value_size =
+        iniparser_getint(cfg, (char*)"kvs:read_ahead_value_size", 4096);
+    if (binfo.read_ahead > 64 || binfo.read_ahead_streams > 64 ||
+        binfo.read_ahead_value_size % 4) {
+      fprintf(stderr, "ERROR: kvs:read_ahead and kvs:read_ahead_streams must be at most 64, "
+              "kvs:read_ahead_value_size a multiple of 4\n");
+      exit(1);
+    }
+#if defined(__KV_BENCH)
+    if (couchstore_kvs_set_read_ahead(binfo.read_ahead, binfo.read_ahead_streams,
+                                      binfo.read_ahead_value_size) != COUCHSTORE_SUCCESS) {
+      iniparser_free(cfg);
+      exit(1);
+    }
+#endif
+
     char *devname_ret;
     str = iniparser_getstring(cfg, (char*)"system:device_path", (char*)"");
     strcpy(binfo.device_path, str);
@@ -4502,7 +5112,18 @@ struct bench_info get_benchinfo(char* bench_config_filename, int config_only)
     binfo.nreaders = binfo.ndeleters = binfo.niterators = 0;
     binfo.nwriters = 1;
 #endif
-    init_cpu_aff(&binfo);
+    str = iniparser_getstring(cfg, (char*)"system:placement", (char*)"manual");
+    binfo.placement_auto = (str[0] == 'a' || str[0] == 'A');
+    binfo.device_nodes = (int *)malloc(sizeof(int) * binfo.nfiles);
+    for (i = 0; i < binfo.nfiles; i++) binfo.device_nodes[i] = -1;
+    str = iniparser_getstring(cfg, (char*)"system:device_nodes", (char*)"");
+    i = 0;
+    for (pt = strtok(str, ","); pt && i < binfo.nfiles; pt = strtok(NULL, ","))
+      binfo.device_nodes[i++] = atoi(pt);
+    if (binfo.placement_auto)
+      init_cpu_aff_auto(&binfo);
+    else
+      init_cpu_aff(&binfo);
     
     // create keygen structure
     _set_keygen(&binfo);
@@ -4767,11 +5388,33 @@ struct bench_info get_benchinfo(char* bench_config_filename, int config_only)
 		    iniparser_getint(cfg, (char*)"operation:batch_parameter2", 64);
     }
 
+    binfo.phases.nphases = iniparser_getint(cfg, (char*)"phases:count", 0);
+    if (binfo.phases.nphases > 0 && _get_phases(cfg, &binfo) < 0) {
+      iniparser_free(cfg);
+      exit(1);
+    }
+    if (binfo.phases.nphases < 0) binfo.phases.nphases = 0;
+
     str = iniparser_getstring(cfg, (char*)"operation:write_type",
                                    (char*)"sync");
     binfo.sync_write = (str[0]=='s')?(1):(0);
     binfo.key_existing = iniparser_getboolean(cfg, (char*)"operation:key_existing", false);
 
+    str = iniparser_getstring(cfg, (char*)"operation:key_access", (char*)"random");
+    if (!strcmp(str, "sequential")) {
+      binfo.key_access = 1;
+    } else if (!strcmp(str, "strided")) {
+      binfo.key_access = 2;
+    } else if (!strcmp(str, "random")) {
+      binfo.key_access = 0;
+    } else {
+      fprintf(stderr, "ERROR: operation:key_access must be random, sequential or strided\n");
+      iniparser_free(cfg);
+      exit(1);
+    }
+    binfo.key_stride = iniparser_getint(cfg, (char*)"operation:key_stride", 4);
+    if (binfo.key_stride == 0) binfo.key_stride = 1;
+
     binfo.compact_thres =
         iniparser_getint(cfg, (char*)"compaction:threshold", 30);
     binfo.compact_period =
@@ -4815,6 +5458,21 @@ struct bench_info get_benchinfo(char* bench_config_filename, int config_only)
     }
     if (binfo.bench_secs != 0 && print_term_ms > binfo.bench_secs * 1000)
       print_term_ms = binfo.bench_secs * 1000;
+
+    // memory monitoring
+    binfo.memstat_enable =
+        iniparser_getboolean(cfg, (char*)"memory_monitor:enable", true);
+    binfo.memstat_period_ms =
+        iniparser_getint(cfg, (char*)"memory_monitor:period_ms", 1000);
+    if (!binfo.memstat_period_ms) {
+      printf("WARN: memory_monitor period_ms cannot be 0\n");
+      iniparser_free(cfg);
+      exit(0);
+    }
+    binfo.memstat_sample_kb =
+        iniparser_getint(cfg, (char*)"memory_monitor:sample_kb", 512);
+    binfo.memstat_topn =
+        iniparser_getint(cfg, (char*)"memory_monitor:top_sites", 10);
     iniparser_free(cfg);
     return binfo;
 }
@@ -4827,6 +5485,7 @@ int main(int argc, char **argv){
     const char *short_opt = "hecf:";
     char filename[256], timelog_filename[256];
     char insert_latency_filename[256], insert_ops_filename[256];
+    char mem_filename[256];
     char run_latency_filename[256], run_ops_filename[256];
     struct bench_info binfo;
     struct timeval gap;
@@ -4929,14 +5588,25 @@ int main(int argc, char **argv){
       	  run_latency_fp = fopen(run_latency_filename, "w");
       	  run_ops_fp = fopen(run_ops_filename, "w");
       	}
+      	if(binfo.memstat_enable) {
+      	  sprintf(mem_filename, "%s/%s-mem.csv", str, binfo.dbname);
+      	  mem_fp = fopen(mem_filename, "w");
+      	}
     }
 
     binfo.initialize = initialize;
 
     _print_benchinfo(&binfo);
 
+    if (binfo.memstat_enable) {
+      memstat_start(binfo.memstat_period_ms,
+                    (uint64_t)binfo.memstat_sample_kb * 1024, mem_fp);
+    }
+
     do_bench(&binfo);
 
+    memstat_stop();
+
     if (log_fp) {
         fclose(log_fp);
     }
@@ -4948,6 +5618,8 @@ int main(int argc, char **argv){
       fclose(run_latency_fp);
     if(run_ops_fp)
       fclose(run_ops_fp);
+    if(mem_fp)
+      fclose(mem_fp);
     if(binfo.cpuinfo){
       if(binfo.cpuinfo->cpulist)
 	      free(binfo.cpuinfo->cpulist);
@@ -4984,6 +5656,8 @@ int main(int argc, char **argv){
       free(binfo.spdk_conf_file);
     //if(binfo.spdk_bdev)
     // free(binfo.spdk_bdev);
+    if(binfo.device_nodes)
+      free(binfo.device_nodes);
     if(binfo.core_ids)
       free(binfo.core_ids);
     if(binfo.cq_thread_ids)
@@ -0,0 +1,787 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * kv_export: parallel key space dump and archive verifier for KVS devices
+ *
+ * Export splits the key space into 2^bits key groups using the leading
+ * bits of the 4-byte group prefix. Threads take groups from a shared
+ * counter, walk each group with its own iterator handle (so at most
+ * KVS_MAX_ITERATE_HANDLE threads) and fetch the values with pipelined
+ * kvs_retrieve_kvp_async() calls, up to queue_depth per thread.
+ *
+ * Archive layout (all integers little endian)
+ *   file header  : "KVSARCH1"
+ *   block        : [magic][nrecords][raw_len][comp_len][raw_crc][comp_crc]
+ *                  followed by comp_len bytes of zlib data
+ *   footer       : [magic][total_records:8][total_blocks:8][crc]
+ * The decompressed payload of a block is a run of
+ * [uint16 key_len][uint32 value_len][key][value] records, the same format
+ * kv_import -f bin reads. Blocks are written by whichever thread fills
+ * them first, so record order in the archive is not defined.
+ *
+ * Verify (-V) reads the blocks back in parallel, checks both checksums,
+ * retrieves every archived key and compares the values, then counts the
+ * keys in the live key space to report keys missing from the archive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <zlib.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "kvs_api.h"
+#include "crc32.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define ARCHIVE_FILE_MAGIC "KVSARCH1"
+#define ARCHIVE_BLOCK_MAGIC 0x4b4c4256   // "VBLK"
+#define ARCHIVE_FOOTER_MAGIC 0x444e4556  // "VEND"
+#define BLOCK_HEADER_SIZE 24
+#define FOOTER_SIZE 24
+#define RECORD_HEADER_SIZE (sizeof(uint16_t) + sizeof(uint32_t))
+
+#define DEFAULT_KEYSPACE_NAME "keyspace_test"
+#define DEFAULT_BLOCK_SIZE (1024 * 1024)
+#define DEFAULT_VALUE_BUFFER (64 * 1024)
+
+struct exp_worker;
+
+struct exp_slot {
+  kvs_key key;
+  kvs_value value;
+  char *keybuf;
+  char *valbuf;
+  uint32_t buflen;
+  kvs_result result;
+  const char *expected;    // verify: archived value
+  uint32_t expected_len;
+  exp_worker *worker;
+};
+
+struct exp_worker {
+  int id;
+  int qdepth;
+  exp_slot *slots;
+  std::vector<exp_slot*> free_slots;
+  std::vector<exp_slot*> done_slots;
+  std::mutex lock;         // protects done_slots
+  int inflight;
+  char *block;             // raw block being filled (export) or read (verify)
+  uint32_t block_cap;
+  uint32_t block_len;
+  uint32_t block_records;
+  char *zbuf;              // compressed block
+  uLong zbuf_len;
+  std::atomic<uint64_t> records;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> errors;
+  std::atomic<uint64_t> missing;
+  std::atomic<uint64_t> mismatched;
+  kvs_key_space_handle ks_hd;
+  pthread_t tid;
+};
+
+static FILE *g_archive = NULL;
+static std::mutex g_archive_lock;
+static uint64_t g_blocks = 0;
+static std::atomic<uint64_t> g_archive_bytes(0);
+static std::atomic<uint32_t> g_next_group(0);
+static uint32_t g_ngroups = 1;
+static int g_prefix_bits = 8;
+static uint32_t g_block_size = DEFAULT_BLOCK_SIZE;
+static uint32_t g_value_buffer = DEFAULT_VALUE_BUFFER;
+static int g_zlevel = 1;
+static int g_verify = 0;
+static bool g_archive_end = false;
+static uint64_t g_footer_records = 0;
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s -d device_path -f archive [-V] [-s keyspace] [-t threads] [-q queue_depth] [-b prefix_bits] [-B block_size] [-m value_buffer] [-z level]\n", program);
+  printf("-d      device_path   :  kvssd device path. e.g. emul: /dev/kvemul; kdd: /dev/nvme0n1; udd: 0000:06:00.0\n");
+  printf("-f      archive       :  archive file to write (export) or read (verify)\n");
+  printf("-V                    :  verify the archive against the key space instead of exporting\n");
+  printf("-s      keyspace      :  key space name (default: %s)\n", DEFAULT_KEYSPACE_NAME);
+  printf("-t      threads       :  number of threads, at most %d (default: 4)\n", KVS_MAX_ITERATE_HANDLE);
+  printf("-q      queue_depth   :  async retrieves in flight per thread (default: 64)\n");
+  printf("-b      prefix_bits   :  split the key space into 2^prefix_bits key groups, 0-16 (default: 8)\n");
+  printf("-B      block_size    :  uncompressed archive block size in bytes (default: %d)\n", DEFAULT_BLOCK_SIZE);
+  printf("-m      value_buffer  :  initial retrieve buffer per request in bytes (default: %d)\n", DEFAULT_VALUE_BUFFER);
+  printf("-z      level         :  zlib compression level 0-9 (default: 1)\n");
+  printf("==============\n");
+}
+
+double _calc_time_span(struct timespec start_time) {
+  struct timespec curr_time;
+  clock_gettime(CLOCK_MONOTONIC, &curr_time);
+  unsigned long long start, end;
+  start = start_time.tv_sec * 1000000000L + start_time.tv_nsec;
+  end = curr_time.tv_sec * 1000000000L + curr_time.tv_nsec;
+  return (double)(end - start) / 1000000000L;
+}
+
+static void _put_le16(char *p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+static void _put_le32(char *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static void _put_le64(char *p, uint64_t v) {
+  for (int i = 0; i < 8; i++) p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static uint16_t _get_le16(const char *p) {
+  const uint8_t *b = (const uint8_t *)p;
+  return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+static uint32_t _get_le32(const char *p) {
+  const uint8_t *b = (const uint8_t *)p;
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) |
+         ((uint32_t)b[3] << 24);
+}
+
+static uint64_t _get_le64(const char *p) {
+  return (uint64_t)_get_le32(p) | ((uint64_t)_get_le32(p + 4) << 32);
+}
+
+static uint32_t _align4(uint32_t len) {
+  return (len + 3) & ~3u;
+}
+
+static uint32_t _checksum(const char *buf, size_t len) {
+  return crc32_8((void *)buf, len, 0);
+}
+
+/* compress and append the current block of w to the archive */
+int _flush_block(exp_worker *w) {
+  if (w->block_records == 0) return SUCCESS;
+
+  uLongf comp_len = w->zbuf_len;
+  if (compress2((Bytef *)w->zbuf, &comp_len, (const Bytef *)w->block,
+                w->block_len, g_zlevel) != Z_OK) {
+    fprintf(stderr, "thread %d: failed to compress archive block\n", w->id);
+    return FAILED;
+  }
+
+  char header[BLOCK_HEADER_SIZE];
+  _put_le32(header, ARCHIVE_BLOCK_MAGIC);
+  _put_le32(header + 4, w->block_records);
+  _put_le32(header + 8, w->block_len);
+  _put_le32(header + 12, comp_len);
+  _put_le32(header + 16, _checksum(w->block, w->block_len));
+  _put_le32(header + 20, _checksum(w->zbuf, comp_len));
+
+  {
+    std::unique_lock<std::mutex> lock(g_archive_lock);
+    if (fwrite(header, BLOCK_HEADER_SIZE, 1, g_archive) != 1 ||
+        fwrite(w->zbuf, comp_len, 1, g_archive) != 1) {
+      fprintf(stderr, "failed to write archive: %s\n", strerror(errno));
+      return FAILED;
+    }
+    g_blocks++;
+  }
+  g_archive_bytes += BLOCK_HEADER_SIZE + comp_len;
+  w->block_len = 0;
+  w->block_records = 0;
+  return SUCCESS;
+}
+
+int _append_record(exp_worker *w, exp_slot *slot) {
+  uint32_t len = RECORD_HEADER_SIZE + slot->key.length + slot->value.length;
+  if (w->block_len + len > g_block_size && _flush_block(w) != SUCCESS)
+    return FAILED;
+  if (len > w->block_cap) {
+    // single record larger than a block, give it a block of its own
+    free(w->block);
+    free(w->zbuf);
+    w->block_cap = len;
+    w->block = (char *)malloc(len);
+    w->zbuf_len = compressBound(len);
+    w->zbuf = (char *)malloc(w->zbuf_len);
+    if (w->block == NULL || w->zbuf == NULL) return FAILED;
+  }
+
+  char *p = w->block + w->block_len;
+  _put_le16(p, slot->key.length);
+  _put_le32(p + sizeof(uint16_t), slot->value.length);
+  memcpy(p + RECORD_HEADER_SIZE, slot->keybuf, slot->key.length);
+  memcpy(p + RECORD_HEADER_SIZE + slot->key.length, slot->valbuf,
+         slot->value.length);
+  w->block_len += len;
+  w->block_records++;
+  return SUCCESS;
+}
+
+void _retrieve_complete_handle(kvs_postprocess_context *ioctx) {
+  exp_slot *slot = (exp_slot *)ioctx->private2;
+  exp_worker *w = slot->worker;
+  slot->result = ioctx->result;
+
+  std::unique_lock<std::mutex> lock(w->lock);
+  w->done_slots.push_back(slot);
+}
+
+int _submit_retrieve(exp_worker *w, exp_slot *slot) {
+  kvs_option_retrieve option = {false};
+  slot->value.length = slot->buflen;
+  slot->value.actual_value_size = slot->value.offset = 0;
+  kvs_result ret = kvs_retrieve_kvp_async(w->ks_hd, &slot->key, &option, w,
+                                          slot, &slot->value,
+                                          _retrieve_complete_handle);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "retrieve failed with err 0x%x\n", ret);
+    w->errors++;
+    w->free_slots.push_back(slot);
+    return FAILED;
+  }
+  w->inflight++;
+  return SUCCESS;
+}
+
+/* grow the value buffer of slot to hold at least len bytes */
+int _grow_slot(exp_slot *slot, uint32_t len) {
+  len = _align4(len);
+  char *buf = (char *)kvs_malloc(len, 4096);
+  if (buf == NULL) return FAILED;
+  kvs_free(slot->valbuf);
+  slot->valbuf = buf;
+  slot->value.value = buf;
+  slot->buflen = len;
+  return SUCCESS;
+}
+
+void _export_done(exp_worker *w, exp_slot *slot) {
+  if (slot->result == KVS_ERR_BUFFER_SMALL &&
+      _grow_slot(slot, slot->value.actual_value_size) == SUCCESS) {
+    _submit_retrieve(w, slot);
+    return;
+  }
+  if (slot->result == KVS_SUCCESS) {
+    if (_append_record(w, slot) == SUCCESS) {
+      w->records++;
+      w->bytes += slot->key.length + slot->value.length;
+    } else {
+      w->errors++;
+    }
+  } else if (slot->result == KVS_ERR_KEY_NOT_EXIST) {
+    // deleted between iteration and retrieve
+    w->missing++;
+  } else {
+    fprintf(stderr, "retrieve failed with err 0x%x\n", slot->result);
+    w->errors++;
+  }
+  w->free_slots.push_back(slot);
+}
+
+void _verify_done(exp_worker *w, exp_slot *slot) {
+  if (slot->result == KVS_SUCCESS) {
+    if (slot->value.length == slot->expected_len &&
+        memcmp(slot->valbuf, slot->expected, slot->expected_len) == 0) {
+      w->records++;
+      w->bytes += slot->key.length + slot->value.length;
+    } else {
+      w->mismatched++;
+    }
+  } else if (slot->result == KVS_ERR_BUFFER_SMALL) {
+    // live value is longer than the archived one
+    w->mismatched++;
+  } else if (slot->result == KVS_ERR_KEY_NOT_EXIST) {
+    w->missing++;
+  } else {
+    fprintf(stderr, "retrieve failed with err 0x%x\n", slot->result);
+    w->errors++;
+  }
+  w->free_slots.push_back(slot);
+}
+
+/* handle completed retrieves of w */
+void _reap(exp_worker *w) {
+  std::vector<exp_slot*> done;
+  {
+    std::unique_lock<std::mutex> lock(w->lock);
+    done.swap(w->done_slots);
+  }
+  for (exp_slot *slot : done) {
+    w->inflight--;
+    if (g_verify) _verify_done(w, slot);
+    else _export_done(w, slot);
+  }
+}
+
+exp_slot *_get_slot(exp_worker *w) {
+  while (true) {
+    _reap(w);
+    if (!w->free_slots.empty()) {
+      exp_slot *slot = w->free_slots.back();
+      w->free_slots.pop_back();
+      return slot;
+    }
+    usleep(1);
+  }
+}
+
+void _drain(exp_worker *w) {
+  while (w->inflight > 0) {
+    _reap(w);
+    if (w->inflight > 0) usleep(1);
+  }
+}
+
+void _group_filter(uint32_t group, kvs_key_group_filter *fltr) {
+  uint32_t bitmask = g_prefix_bits ? ~0u << (32 - g_prefix_bits) : 0;
+  uint32_t pattern = g_prefix_bits ? group << (32 - g_prefix_bits) : 0;
+  for (int i = 0; i < 4; i++) {
+    fltr->bitmask[i] = (bitmask >> (24 - 8 * i)) & 0xff;
+    fltr->bit_pattern[i] = (pattern >> (24 - 8 * i)) & 0xff;
+  }
+}
+
+/* iterate one key group; calls fn for every key found */
+template <typename F>
+int _for_each_key(kvs_key_space_handle ks_hd, uint32_t group,
+                  kvs_iterator_list *iter_list, F fn) {
+  kvs_option_iterator iter_op = {KVS_ITERATOR_KEY};
+  kvs_key_group_filter iter_fltr;
+  kvs_iterator_handle iter_hd;
+  _group_filter(group, &iter_fltr);
+
+  kvs_result ret = kvs_create_iterator(ks_hd, &iter_op, &iter_fltr, &iter_hd);
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "open iterator for group %u failed with err 0x%x\n", group, ret);
+    return FAILED;
+  }
+
+  do {
+    iter_list->size = KVS_ITERATOR_BUFFER_SIZE;
+    iter_list->num_entries = 0;
+    iter_list->end = false;
+    ret = kvs_iterate_next(ks_hd, iter_hd, iter_list);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "iterator next for group %u failed with err 0x%x\n", group, ret);
+      break;
+    }
+
+    // variable key length iterator output: [u32 key_len][key]
+    uint8_t *it_buffer = iter_list->it_list;
+    for (uint32_t i = 0; i < iter_list->num_entries; i++) {
+      uint32_t key_size = *((uint32_t *)it_buffer);
+      it_buffer += sizeof(uint32_t);
+      fn((const char *)it_buffer, key_size);
+      it_buffer += key_size;
+    }
+  } while (!iter_list->end);
+
+  kvs_delete_iterator(ks_hd, iter_hd);
+  return (ret == KVS_SUCCESS) ? SUCCESS : FAILED;
+}
+
+void *export_thread(void *args) {
+  exp_worker *w = (exp_worker *)args;
+  kvs_iterator_list iter_list;
+  iter_list.it_list = (uint8_t *)kvs_malloc(KVS_ITERATOR_BUFFER_SIZE, 4096);
+
+  uint32_t group;
+  while ((group = g_next_group++) < g_ngroups) {
+    int ret = _for_each_key(w->ks_hd, group, &iter_list,
+      [w](const char *key, uint32_t klen) {
+        exp_slot *slot = _get_slot(w);
+        memcpy(slot->keybuf, key, klen);
+        slot->key.length = klen;
+        _submit_retrieve(w, slot);
+      });
+    if (ret != SUCCESS) w->errors++;
+  }
+  _drain(w);
+  if (_flush_block(w) != SUCCESS) w->errors++;
+
+  kvs_free(iter_list.it_list);
+  return NULL;
+}
+
+/* read and decompress the next archive block; returns 0 at the footer */
+int _read_block(exp_worker *w, uint32_t *nrecords) {
+  char header[BLOCK_HEADER_SIZE];
+  uint32_t raw_len, comp_len;
+  {
+    std::unique_lock<std::mutex> lock(g_archive_lock);
+    if (g_archive_end) return 0;
+    if (fread(header, 4, 1, g_archive) != 1) {
+      fprintf(stderr, "archive is truncated, footer missing\n");
+      g_archive_end = true;
+      return -1;
+    }
+    if (_get_le32(header) == ARCHIVE_FOOTER_MAGIC) {
+      char footer[FOOTER_SIZE];
+      memcpy(footer, header, 4);
+      g_archive_end = true;
+      if (fread(footer + 4, FOOTER_SIZE - 4, 1, g_archive) != 1 ||
+          _checksum(footer, FOOTER_SIZE - 4) != _get_le32(footer + 20)) {
+        fprintf(stderr, "archive footer is corrupt\n");
+        return -1;
+      }
+      g_footer_records = _get_le64(footer + 4);
+      if (_get_le64(footer + 12) != g_blocks) {
+        fprintf(stderr, "archive footer expects %lu blocks, found %lu\n",
+                _get_le64(footer + 12), g_blocks);
+        return -1;
+      }
+      return 0;
+    }
+    if (_get_le32(header) != ARCHIVE_BLOCK_MAGIC ||
+        fread(header + 4, BLOCK_HEADER_SIZE - 4, 1, g_archive) != 1) {
+      fprintf(stderr, "archive block %lu is corrupt\n", g_blocks);
+      g_archive_end = true;
+      return -1;
+    }
+    raw_len = _get_le32(header + 8);
+    comp_len = _get_le32(header + 12);
+    if (raw_len > w->block_cap) {
+      free(w->block);
+      w->block_cap = raw_len;
+      w->block = (char *)malloc(raw_len);
+    }
+    if (comp_len > w->zbuf_len) {
+      free(w->zbuf);
+      w->zbuf_len = comp_len;
+      w->zbuf = (char *)malloc(comp_len);
+    }
+    if (w->block == NULL || w->zbuf == NULL ||
+        fread(w->zbuf, comp_len, 1, g_archive) != 1) {
+      fprintf(stderr, "archive block %lu is truncated\n", g_blocks);
+      g_archive_end = true;
+      return -1;
+    }
+    g_blocks++;
+  }
+  g_archive_bytes += BLOCK_HEADER_SIZE + comp_len;
+
+  uLongf dest_len = raw_len;
+  if (_checksum(w->zbuf, comp_len) != _get_le32(header + 20) ||
+      uncompress((Bytef *)w->block, &dest_len, (const Bytef *)w->zbuf,
+                 comp_len) != Z_OK || dest_len != raw_len ||
+      _checksum(w->block, raw_len) != _get_le32(header + 16)) {
+    fprintf(stderr, "archive block checksum mismatch\n");
+    return -1;
+  }
+  w->block_len = raw_len;
+  *nrecords = _get_le32(header + 4);
+  return 1;
+}
+
+void *verify_thread(void *args) {
+  exp_worker *w = (exp_worker *)args;
+  uint32_t nrecords;
+  int ret;
+
+  while ((ret = _read_block(w, &nrecords)) != 0) {
+    if (ret < 0) {
+      w->errors++;
+      if (g_archive_end) break;
+      continue;
+    }
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < nrecords; i++) {
+      if (pos + RECORD_HEADER_SIZE > w->block_len) {
+        w->errors++;
+        break;
+      }
+      uint16_t klen = _get_le16(w->block + pos);
+      uint32_t vlen = _get_le32(w->block + pos + sizeof(uint16_t));
+      if (klen > KVS_MAX_KEY_LENGTH ||
+          pos + RECORD_HEADER_SIZE + klen + vlen > w->block_len) {
+        w->errors++;
+        break;
+      }
+      exp_slot *slot = _get_slot(w);
+      // one extra word to tell a longer live value from an equal one
+      if (slot->buflen < _align4(vlen) + 4 &&
+          _grow_slot(slot, _align4(vlen) + 4) != SUCCESS) {
+        w->errors++;
+        w->free_slots.push_back(slot);
+        break;
+      }
+      memcpy(slot->keybuf, w->block + pos + RECORD_HEADER_SIZE, klen);
+      slot->key.length = klen;
+      slot->expected = w->block + pos + RECORD_HEADER_SIZE + klen;
+      slot->expected_len = vlen;
+      _submit_retrieve(w, slot);
+      pos += RECORD_HEADER_SIZE + klen + vlen;
+    }
+    // the block buffer is reused for the next block
+    _drain(w);
+  }
+  return NULL;
+}
+
+int _alloc_worker(exp_worker *w, int id, int qdepth, kvs_key_space_handle ks_hd) {
+  w->id = id;
+  w->qdepth = qdepth;
+  w->inflight = 0;
+  w->ks_hd = ks_hd;
+  w->records = w->bytes = w->errors = w->missing = w->mismatched = 0;
+  w->block_len = w->block_records = 0;
+  w->block_cap = g_block_size;
+  w->block = (char *)malloc(g_block_size);
+  w->zbuf_len = compressBound(g_block_size);
+  w->zbuf = (char *)malloc(w->zbuf_len);
+  w->slots = (exp_slot *)calloc(qdepth, sizeof(exp_slot));
+  if (w->block == NULL || w->zbuf == NULL || w->slots == NULL) return FAILED;
+  for (int i = 0; i < qdepth; i++) {
+    exp_slot *slot = &w->slots[i];
+    slot->keybuf = (char *)kvs_malloc(KVS_MAX_KEY_LENGTH + 1, 4096);
+    slot->valbuf = (char *)kvs_malloc(g_value_buffer, 4096);
+    if (slot->keybuf == NULL || slot->valbuf == NULL) {
+      fprintf(stderr, "failed to allocate io buffers\n");
+      return FAILED;
+    }
+    slot->buflen = g_value_buffer;
+    slot->key.key = slot->keybuf;
+    slot->value.value = slot->valbuf;
+    slot->worker = w;
+    w->free_slots.push_back(slot);
+  }
+  return SUCCESS;
+}
+
+void _free_worker(exp_worker *w) {
+  if (w->slots) {
+    for (int i = 0; i < w->qdepth; i++) {
+      if (w->slots[i].keybuf) kvs_free(w->slots[i].keybuf);
+      if (w->slots[i].valbuf) kvs_free(w->slots[i].valbuf);
+    }
+    free(w->slots);
+  }
+  free(w->block);
+  free(w->zbuf);
+}
+
+int _write_footer(uint64_t total_records) {
+  char footer[FOOTER_SIZE];
+  _put_le32(footer, ARCHIVE_FOOTER_MAGIC);
+  _put_le64(footer + 4, total_records);
+  _put_le64(footer + 12, g_blocks);
+  _put_le32(footer + 20, _checksum(footer, FOOTER_SIZE - 4));
+  if (fwrite(footer, FOOTER_SIZE, 1, g_archive) != 1) return FAILED;
+  g_archive_bytes += FOOTER_SIZE;
+  return SUCCESS;
+}
+
+/* number of keys in the key space, counted with a single iterator */
+uint64_t _count_keys(kvs_key_space_handle ks_hd) {
+  uint64_t count = 0;
+  kvs_iterator_list iter_list;
+  iter_list.it_list = (uint8_t *)kvs_malloc(KVS_ITERATOR_BUFFER_SIZE, 4096);
+  int bits = g_prefix_bits;
+  g_prefix_bits = 0;
+  _for_each_key(ks_hd, 0, &iter_list,
+                [&count](const char *key, uint32_t klen) { count++; });
+  g_prefix_bits = bits;
+  kvs_free(iter_list.it_list);
+  return count;
+}
+
+int main(int argc, char *argv[]) {
+  char *dev_path = NULL;
+  char *archive_path = NULL;
+  char *keyspace_name = (char *)DEFAULT_KEYSPACE_NAME;
+  int nthreads = 4;
+  int qdepth = 64;
+  int c;
+  int ret = SUCCESS;
+
+  while ((c = getopt(argc, argv, "d:f:Vs:t:q:b:B:m:z:h")) != -1) {
+    switch (c) {
+      case 'd':
+        dev_path = optarg;
+        break;
+      case 'f':
+        archive_path = optarg;
+        break;
+      case 'V':
+        g_verify = 1;
+        break;
+      case 's':
+        keyspace_name = optarg;
+        break;
+      case 't':
+        nthreads = atoi(optarg);
+        break;
+      case 'q':
+        qdepth = atoi(optarg);
+        break;
+      case 'b':
+        g_prefix_bits = atoi(optarg);
+        break;
+      case 'B':
+        g_block_size = atoi(optarg);
+        break;
+      case 'm':
+        g_value_buffer = _align4(atoi(optarg));
+        break;
+      case 'z':
+        g_zlevel = atoi(optarg);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return SUCCESS;
+      default:
+        usage(argv[0]);
+        return FAILED;
+    }
+  }
+
+  if (dev_path == NULL || archive_path == NULL || nthreads <= 0 ||
+      nthreads > KVS_MAX_ITERATE_HANDLE || qdepth <= 0 ||
+      g_prefix_bits < 0 || g_prefix_bits > 16 || g_block_size == 0 ||
+      g_value_buffer == 0 || g_zlevel < 0 || g_zlevel > 9) {
+    usage(argv[0]);
+    return FAILED;
+  }
+  g_ngroups = 1u << g_prefix_bits;
+  g_next_group = 0;
+  g_blocks = 0;
+  g_archive_end = false;
+
+  g_archive = fopen(archive_path, g_verify ? "r" : "w");
+  if (g_archive == NULL) {
+    fprintf(stderr, "failed to open %s: %s\n", archive_path, strerror(errno));
+    return FAILED;
+  }
+  char magic[8];
+  if (g_verify) {
+    if (fread(magic, sizeof(magic), 1, g_archive) != 1 ||
+        memcmp(magic, ARCHIVE_FILE_MAGIC, sizeof(magic))) {
+      fprintf(stderr, "%s is not a kv_export archive\n", archive_path);
+      fclose(g_archive);
+      return FAILED;
+    }
+  } else {
+    fwrite(ARCHIVE_FILE_MAGIC, sizeof(magic), 1, g_archive);
+  }
+  g_archive_bytes = sizeof(magic);
+
+  kvs_device_handle dev = NULL;
+  kvs_key_space_handle ks_hd = NULL;
+  exp_worker *workers = new exp_worker[nthreads];
+  for (int i = 0; i < nthreads; i++) {
+    workers[i].slots = NULL;
+    workers[i].block = workers[i].zbuf = NULL;
+  }
+  struct timespec start_time;
+  uint64_t records = 0, bytes = 0, errors = 0, missing = 0, mismatched = 0;
+  uint64_t live_keys = 0;
+  double elapsed;
+
+  if (kvs_open_device(dev_path, &dev) != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed\n");
+    ret = FAILED;
+    goto free_workers;
+  }
+  if (kvs_open_key_space(dev, keyspace_name, &ks_hd) != KVS_SUCCESS) {
+    fprintf(stderr, "Open keyspace %s failed\n", keyspace_name);
+    ret = FAILED;
+    goto close_device;
+  }
+
+  for (int i = 0; i < nthreads; i++) {
+    if (_alloc_worker(&workers[i], i, qdepth, ks_hd) != SUCCESS) {
+      ret = FAILED;
+      goto close_keyspace;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (int i = 0; i < nthreads; i++) {
+    pthread_create(&workers[i].tid, NULL,
+                   g_verify ? verify_thread : export_thread, &workers[i]);
+  }
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(workers[i].tid, NULL);
+    records += workers[i].records;
+    bytes += workers[i].bytes;
+    errors += workers[i].errors;
+    missing += workers[i].missing;
+    mismatched += workers[i].mismatched;
+  }
+  elapsed = _calc_time_span(start_time);
+
+  if (g_verify) {
+    live_keys = _count_keys(ks_hd);
+    fprintf(stdout, "Verified %lu records in %lu blocks: %lu missing, %lu mismatched, %lu errors\n",
+            records + missing + mismatched, g_blocks, missing, mismatched, errors);
+    fprintf(stdout, "Key space holds %lu keys, %lu not in the archive\n", live_keys,
+            live_keys > records + mismatched ? live_keys - records - mismatched : 0);
+    if (g_footer_records != records + missing + mismatched) {
+      fprintf(stdout, "Archive footer lists %lu records\n", g_footer_records);
+      ret = FAILED;
+    }
+    if (missing || mismatched || errors || live_keys != records + mismatched)
+      ret = FAILED;
+  } else {
+    if (_write_footer(records) != SUCCESS) errors++;
+    fprintf(stdout, "Exported %lu records (%lu vanished, %lu errors) in %lu blocks\n",
+            records, missing, errors, g_blocks);
+    if (errors) ret = FAILED;
+  }
+  fprintf(stdout, "%lu bytes of key/value data, %lu archive bytes (%.2fx) in %.2f sec\n",
+          bytes, g_archive_bytes.load(),
+          g_archive_bytes ? (double)bytes / g_archive_bytes : 0, elapsed);
+  fprintf(stdout, "Throughput %.2f MB/s; %.2f ops/sec\n",
+          elapsed > 0 ? (double)bytes / 1024 / 1024 / elapsed : 0,
+          elapsed > 0 ? (double)records / elapsed : 0);
+
+close_keyspace:
+  kvs_close_key_space(ks_hd);
+close_device:
+  kvs_close_device(dev);
+free_workers:
+  for (int i = 0; i < nthreads; i++) _free_worker(&workers[i]);
+  delete[] workers;
+  if (fclose(g_archive) != 0) ret = FAILED;
+  return ret;
+}
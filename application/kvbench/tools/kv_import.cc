@@ -0,0 +1,772 @@
+/**
+ *   BSD LICENSE
+ *
+ *   Copyright (c) 2018 Samsung Electronics Co., Ltd.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Samsung Electronics Co., Ltd. nor the names of
+ *       its contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * kv_import: parallel bulk loader for KVS devices
+ *
+ * Input formats
+ *   line : one record per line, "key<TAB>value"
+ *   csv  : one record per line, "key,value"; fields may be double-quoted
+ *          and a doubled quote inside a quoted field stands for one quote
+ *   bin  : back-to-back records of
+ *          [uint16 key_len][uint32 value_len][key bytes][value bytes]
+ *          with both lengths in little endian
+ *
+ * Input files are mmap'd. Text inputs are indexed with keyloader, binary
+ * inputs are indexed by walking the length prefixes. The record index is
+ * split into one contiguous range per thread and every thread keeps up to
+ * queue_depth kvs_store_kvp_async() requests in flight.
+ *
+ * Checkpoints record, per thread, the lowest record index that is not yet
+ * acknowledged by the device. A record the device failed to store is never
+ * acknowledged, so it holds its thread's mark until the end of the run. With
+ * -r the import restarts from the mark: records that were in flight at the
+ * time of a crash, and every record from the first failed one on, are
+ * written again. Malformed records cannot succeed on a retry; they are
+ * copied to the reject file, in the input format, and do not hold the mark.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "kvs_api.h"
+#include "keyloader.h"
+
+#define SUCCESS 0
+#define FAILED 1
+
+#define FORMAT_LINE 0
+#define FORMAT_CSV  1
+#define FORMAT_BIN  2
+
+#define BIN_HEADER_SIZE (sizeof(uint16_t) + sizeof(uint32_t))
+#define DEFAULT_KEYSPACE_NAME "keyspace_test"
+#define INVALID_INDEX ((uint64_t)-1)
+
+static const char *format_names[] = {"line", "csv", "bin"};
+
+struct import_slot;
+
+struct import_worker {
+  int id;
+  uint64_t begin;          // first record index of this thread
+  uint64_t end;            // one past the last record index
+  uint64_t next;           // next record index to submit
+  uint64_t first_failed;   // lowest record index that failed, INVALID_INDEX if none
+  int qdepth;
+  import_slot *slots;
+  std::vector<import_slot*> free_slots;
+  std::mutex lock;         // protects free_slots, slot->idx, next and first_failed
+  std::atomic<uint64_t> completed;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> failed;
+  std::atomic<uint64_t> rejected;
+  kvs_key_space_handle ks_hd;
+  pthread_t tid;
+};
+
+struct import_slot {
+  kvs_key key;
+  kvs_value value;
+  char *keybuf;
+  char *valbuf;
+  uint64_t idx;            // record index in flight, INVALID_INDEX if free
+  import_worker *worker;
+};
+
+struct import_input {
+  int format;
+  char *path;
+  int fd;
+  char *map;
+  uint64_t filesize;
+  uint64_t nrecords;
+  uint32_t max_record_len;
+  struct keyloader loader;  // text formats
+  struct keyloader_array *arr; // record offsets (points into loader for text)
+  char real_path[PATH_MAX];    // recorded in checkpoints
+};
+
+static import_input g_input;
+static char *g_checkpoint_path = NULL;
+static FILE *g_reject_fp = NULL;
+static std::mutex g_reject_lock;
+
+void usage(char *program) {
+  printf("==============\n");
+  printf("usage: %s -d device_path -i input_file [-f format] [-s keyspace] [-t threads] [-q queue_depth] [-c checkpoint_file] [-r] [-j reject_file] [-p interval]\n", program);
+  printf("-d      device_path     :  kvssd device path. e.g. emul: /dev/kvemul; kdd: /dev/nvme0n1; udd: 0000:06:00.0\n");
+  printf("-i      input_file      :  input file to import\n");
+  printf("-f      format          :  line: key<TAB>value per line (default); csv: key,value per line;\n"
+         "                           bin: [u16 klen][u32 vlen][key][value] records\n");
+  printf("-s      keyspace        :  key space name, created if it does not exist (default: %s)\n", DEFAULT_KEYSPACE_NAME);
+  printf("-t      threads         :  number of import threads (default: 1)\n");
+  printf("-q      queue_depth     :  async queue depth per thread (default: 64)\n");
+  printf("-c      checkpoint_file :  file to record import progress in\n");
+  printf("-r                      :  resume from checkpoint_file\n");
+  printf("-j      reject_file     :  file to copy malformed records to (default: checkpoint_file.rej with -c)\n");
+  printf("-p      interval        :  progress report and checkpoint interval in seconds (default: 1)\n");
+  printf("==============\n");
+}
+
+double _calc_time_span(struct timespec start_time) {
+  struct timespec curr_time;
+  clock_gettime(CLOCK_MONOTONIC, &curr_time);
+  unsigned long long start, end;
+  start = start_time.tv_sec * 1000000000L + start_time.tv_nsec;
+  end = curr_time.tv_sec * 1000000000L + curr_time.tv_nsec;
+  return (double)(end - start) / 1000000000L;
+}
+
+static uint16_t _read_le16(const char *p) {
+  const uint8_t *b = (const uint8_t *)p;
+  return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+static uint32_t _read_le32(const char *p) {
+  const uint8_t *b = (const uint8_t *)p;
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) |
+         ((uint32_t)b[3] << 24);
+}
+
+/* index length-prefixed records; stops at the first truncated record */
+int _index_binary(import_input *in) {
+  struct stat st;
+  in->fd = open(in->path, O_RDONLY);
+  if (in->fd < 0) {
+    fprintf(stderr, "failed to open %s: %s\n", in->path, strerror(errno));
+    return FAILED;
+  }
+  if (fstat(in->fd, &st) < 0) {
+    close(in->fd);
+    return FAILED;
+  }
+  in->filesize = st.st_size;
+  in->map = NULL;
+  if (in->filesize) {
+    in->map = (char *)mmap(0, in->filesize, PROT_READ, MAP_SHARED, in->fd, 0);
+    if (in->map == MAP_FAILED) {
+      close(in->fd);
+      return FAILED;
+    }
+    madvise(in->map, in->filesize, MADV_SEQUENTIAL);
+  }
+
+  uint64_t cap = 256, pos = 0;
+  in->arr = (struct keyloader_array *)malloc(sizeof(struct keyloader_array) * cap);
+  in->nrecords = 0;
+  in->max_record_len = 0;
+  while (pos + BIN_HEADER_SIZE <= in->filesize) {
+    uint32_t klen = _read_le16(in->map + pos);
+    uint32_t vlen = _read_le32(in->map + pos + sizeof(uint16_t));
+    uint64_t len = BIN_HEADER_SIZE + klen + (uint64_t)vlen;
+    if (klen > KVS_MAX_KEY_LENGTH || vlen > KVS_MAX_VALUE_LENGTH) {
+      fprintf(stderr, "corrupt record header at offset %lu, ignoring the rest of %s\n",
+              pos, in->path);
+      break;
+    }
+    if (pos + len > in->filesize) {
+      fprintf(stderr, "truncated record at offset %lu, ignoring the rest of %s\n",
+              pos, in->path);
+      break;
+    }
+    if (in->nrecords == cap) {
+      struct keyloader_array *arr = (struct keyloader_array *)realloc(in->arr,
+                  sizeof(struct keyloader_array) * cap * 2);
+      if (arr == NULL) {
+        fprintf(stderr, "failed to index %s: out of memory\n", in->path);
+        free(in->arr);
+        if (in->map) munmap(in->map, in->filesize);
+        close(in->fd);
+        return FAILED;
+      }
+      in->arr = arr;
+      cap *= 2;
+    }
+    in->arr[in->nrecords].offset = pos;
+    in->arr[in->nrecords].len = (uint32_t)len;
+    if (len > in->max_record_len) in->max_record_len = (uint32_t)len;
+    in->nrecords++;
+    pos += len;
+  }
+  return SUCCESS;
+}
+
+int _index_text(import_input *in) {
+  struct keyloader_option option;
+  option.max_nkeys = 0;
+  if (keyloader_init(&in->loader, in->path, &option) < 0) {
+    fprintf(stderr, "failed to load %s: %s\n", in->path, strerror(errno));
+    return FAILED;
+  }
+  in->fd = in->loader.fd;
+  in->map = in->loader.map;
+  in->filesize = in->loader.filesize;
+  in->nrecords = keyloader_get_nkeys(&in->loader);
+  in->arr = in->loader.arr;
+  in->max_record_len = 0;
+  for (uint64_t i = 0; i < in->nrecords; i++) {
+    if (in->arr[i].len > in->max_record_len)
+      in->max_record_len = in->arr[i].len;
+  }
+  return SUCCESS;
+}
+
+int _open_input(import_input *in) {
+  int ret = (in->format == FORMAT_BIN) ? _index_binary(in) : _index_text(in);
+  // a value never exceeds its record, nor the device limit
+  if (in->max_record_len > KVS_MAX_VALUE_LENGTH)
+    in->max_record_len = KVS_MAX_VALUE_LENGTH;
+  if (in->max_record_len == 0) in->max_record_len = 1;
+  return ret;
+}
+
+void _close_input(import_input *in) {
+  if (in->format == FORMAT_BIN) {
+    if (in->map) munmap(in->map, in->filesize);
+    free(in->arr);
+    close(in->fd);
+  } else {
+    keyloader_free(&in->loader);
+  }
+}
+
+/* copy one csv field of at most max bytes starting at p into out; returns
+ * the position after the field delimiter, or NULL if the field is malformed */
+static const char *_csv_field(const char *p, const char *end, char *out,
+                              uint32_t max, uint32_t *len) {
+  uint32_t n = 0;
+  if (p < end && *p == '"') {
+    p++;
+    while (p < end) {
+      if (*p == '"') {
+        if (p + 1 < end && p[1] == '"') {
+          if (n == max) return NULL;
+          out[n++] = '"';
+          p += 2;
+          continue;
+        }
+        p++;
+        break;
+      }
+      if (n == max) return NULL;
+      out[n++] = *p++;
+    }
+    if (p < end && *p != ',') return NULL;
+  } else {
+    while (p < end && *p != ',') {
+      if (n == max) return NULL;
+      out[n++] = *p++;
+    }
+  }
+  *len = n;
+  return (p < end) ? p + 1 : p;
+}
+
+/* decode record idx into the slot buffers; returns 0 on success */
+int _decode_record(import_input *in, uint64_t idx, import_slot *slot) {
+  const char *rec = in->map + in->arr[idx].offset;
+  const char *end = rec + in->arr[idx].len;
+  uint32_t klen = 0, vlen = 0;
+
+  switch (in->format) {
+    case FORMAT_BIN:
+      klen = _read_le16(rec);
+      vlen = _read_le32(rec + sizeof(uint16_t));
+      if (klen > KVS_MAX_KEY_LENGTH || vlen > KVS_MAX_VALUE_LENGTH)
+        return FAILED;
+      rec += BIN_HEADER_SIZE;
+      memcpy(slot->keybuf, rec, klen);
+      memcpy(slot->valbuf, rec + klen, vlen);
+      break;
+    case FORMAT_CSV: {
+      const char *p = _csv_field(rec, end, slot->keybuf, KVS_MAX_KEY_LENGTH, &klen);
+      if (p == NULL ||
+          _csv_field(p, end, slot->valbuf, KVS_MAX_VALUE_LENGTH, &vlen) == NULL)
+        return FAILED;
+      break;
+    }
+    default: {
+      const char *tab = (const char *)memchr(rec, '\t', end - rec);
+      klen = (tab == NULL) ? end - rec : tab - rec;
+      vlen = (tab == NULL) ? 0 : end - tab - 1;
+      if (klen > KVS_MAX_KEY_LENGTH || vlen > KVS_MAX_VALUE_LENGTH)
+        return FAILED;
+      memcpy(slot->keybuf, rec, klen);
+      if (vlen) memcpy(slot->valbuf, tab + 1, vlen);
+      break;
+    }
+  }
+
+  if (klen < KVS_MIN_KEY_LENGTH)
+    return FAILED;
+  slot->key.length = (uint16_t)klen;
+  slot->value.length = vlen;
+  slot->value.actual_value_size = slot->value.offset = 0;
+  return SUCCESS;
+}
+
+/* lowest record index of this thread that is not acknowledged yet */
+uint64_t _worker_watermark(import_worker *w) {
+  std::unique_lock<std::mutex> lock(w->lock);
+  uint64_t mark = w->next;
+  if (w->first_failed < mark) mark = w->first_failed;
+  for (int i = 0; i < w->qdepth; i++) {
+    if (w->slots[i].idx != INVALID_INDEX && w->slots[i].idx < mark)
+      mark = w->slots[i].idx;
+  }
+  return mark;
+}
+
+int _write_checkpoint(import_worker *workers, int nthreads) {
+  if (g_checkpoint_path == NULL) return SUCCESS;
+
+  char tmp_path[PATH_MAX];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", g_checkpoint_path);
+  FILE *fp = fopen(tmp_path, "w");
+  if (fp == NULL) {
+    fprintf(stderr, "failed to write checkpoint %s: %s\n", tmp_path, strerror(errno));
+    return FAILED;
+  }
+  // records behind the marks were rejected before the marks were taken and
+  // must be on disk before the checkpoint passes them
+  std::vector<uint64_t> marks(nthreads);
+  for (int i = 0; i < nthreads; i++) marks[i] = _worker_watermark(&workers[i]);
+  if (g_reject_fp) {
+    std::unique_lock<std::mutex> lock(g_reject_lock);
+    fflush(g_reject_fp);
+    fsync(fileno(g_reject_fp));
+  }
+
+  fprintf(fp, "input %s %lu %s %d\n", g_input.real_path, g_input.filesize,
+          format_names[g_input.format], nthreads);
+  for (int i = 0; i < nthreads; i++) {
+    fprintf(fp, "thread %d %lu %lu %lu\n", i, workers[i].begin, workers[i].end,
+            marks[i]);
+  }
+  fflush(fp);
+  fsync(fileno(fp));
+  fclose(fp);
+  if (rename(tmp_path, g_checkpoint_path) < 0) {
+    fprintf(stderr, "failed to rename checkpoint: %s\n", strerror(errno));
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+/* set each worker's start position from the checkpoint file */
+int _load_checkpoint(import_worker *workers, int nthreads) {
+  FILE *fp = fopen(g_checkpoint_path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "failed to open checkpoint %s: %s\n", g_checkpoint_path,
+            strerror(errno));
+    return FAILED;
+  }
+
+  char path[PATH_MAX], fmt[16];
+  uint64_t filesize;
+  int threads, ret = FAILED;
+  if (fscanf(fp, "input %4095s %lu %15s %d\n", path, &filesize, fmt, &threads) != 4) {
+    fprintf(stderr, "malformed checkpoint %s\n", g_checkpoint_path);
+    goto exit;
+  }
+  if (strcmp(path, g_input.real_path) || filesize != g_input.filesize || threads != nthreads ||
+      strcmp(fmt, format_names[g_input.format])) {
+    fprintf(stderr, "checkpoint was taken with %s (%lu bytes, %s, %d threads), "
+            "does not match this run\n", path, filesize, fmt, threads);
+    goto exit;
+  }
+  for (int i = 0; i < nthreads; i++) {
+    int id;
+    uint64_t begin, end, mark;
+    if (fscanf(fp, "thread %d %lu %lu %lu\n", &id, &begin, &end, &mark) != 4 ||
+        id != i || begin != workers[i].begin || end != workers[i].end ||
+        mark < begin || mark > end) {
+      fprintf(stderr, "malformed checkpoint entry for thread %d\n", i);
+      goto exit;
+    }
+    workers[i].next = mark;
+  }
+  ret = SUCCESS;
+
+exit:
+  fclose(fp);
+  return ret;
+}
+
+/* copy a malformed record to the reject file */
+void _reject_record(import_input *in, uint64_t idx) {
+  if (g_reject_fp == NULL) return;
+  std::unique_lock<std::mutex> lock(g_reject_lock);
+  fwrite(in->map + in->arr[idx].offset, 1, in->arr[idx].len, g_reject_fp);
+  if (in->format != FORMAT_BIN) fputc('\n', g_reject_fp);
+}
+
+/* return a slot whose record is done; a failed record stays below the mark */
+void _release_slot(import_worker *w, import_slot *slot, bool failed) {
+  if (failed) w->failed++;
+  std::unique_lock<std::mutex> lock(w->lock);
+  if (failed && slot->idx < w->first_failed) w->first_failed = slot->idx;
+  slot->idx = INVALID_INDEX;
+  w->free_slots.push_back(slot);
+  w->completed++;
+}
+
+void _store_complete_handle(kvs_postprocess_context *ioctx) {
+  import_worker *w = (import_worker *)ioctx->private1;
+  import_slot *slot = (import_slot *)ioctx->private2;
+
+  if (ioctx->result != KVS_SUCCESS) {
+    fprintf(stderr, "store of record %lu failed with err 0x%x\n", slot->idx,
+            ioctx->result);
+  } else {
+    w->bytes += slot->key.length + slot->value.length;
+  }
+  _release_slot(w, slot, ioctx->result != KVS_SUCCESS);
+}
+
+void *import_thread(void *args) {
+  import_worker *w = (import_worker *)args;
+  kvs_option_store option = {KVS_STORE_POST, NULL};
+
+  while (true) {
+    import_slot *slot = NULL;
+    uint64_t idx;
+    {
+      std::unique_lock<std::mutex> lock(w->lock);
+      if (w->next >= w->end) break;
+      if (!w->free_slots.empty()) {
+        slot = w->free_slots.back();
+        w->free_slots.pop_back();
+        idx = w->next++;
+        slot->idx = idx;
+      }
+    }
+    if (slot == NULL) {
+      usleep(1);
+      continue;
+    }
+
+    if (_decode_record(&g_input, idx, slot) != SUCCESS) {
+      fprintf(stderr, "skipping malformed record %lu\n", idx);
+      _reject_record(&g_input, idx);
+      w->rejected++;
+      _release_slot(w, slot, false);
+      continue;
+    }
+
+    kvs_result ret = kvs_store_kvp_async(w->ks_hd, &slot->key, &slot->value,
+                                         &option, w, slot, _store_complete_handle);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "store of record %lu failed with err 0x%x\n", idx, ret);
+      _release_slot(w, slot, true);
+    }
+  }
+
+  // wait until all submitted commands finish
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(w->lock);
+      if ((int)w->free_slots.size() == w->qdepth) break;
+    }
+    usleep(1);
+  }
+  return NULL;
+}
+
+int _alloc_worker(import_worker *w, int id, int qdepth, uint32_t buflen) {
+  w->id = id;
+  w->qdepth = qdepth;
+  w->completed = 0;
+  w->bytes = 0;
+  w->failed = 0;
+  w->rejected = 0;
+  w->slots = (import_slot *)calloc(qdepth, sizeof(import_slot));
+  if (w->slots == NULL) return FAILED;
+  for (int i = 0; i < qdepth; i++) {
+    import_slot *slot = &w->slots[i];
+    slot->keybuf = (char *)kvs_malloc(KVS_MAX_KEY_LENGTH + 1, 4096);
+    slot->valbuf = (char *)kvs_malloc(buflen, 4096);
+    if (slot->keybuf == NULL || slot->valbuf == NULL) {
+      fprintf(stderr, "failed to allocate io buffers\n");
+      return FAILED;
+    }
+    slot->key.key = slot->keybuf;
+    slot->value.value = slot->valbuf;
+    slot->idx = INVALID_INDEX;
+    slot->worker = w;
+    w->free_slots.push_back(slot);
+  }
+  return SUCCESS;
+}
+
+void _free_worker(import_worker *w) {
+  if (w->slots == NULL) return;
+  for (int i = 0; i < w->qdepth; i++) {
+    if (w->slots[i].keybuf) kvs_free(w->slots[i].keybuf);
+    if (w->slots[i].valbuf) kvs_free(w->slots[i].valbuf);
+  }
+  free(w->slots);
+  w->slots = NULL;
+}
+
+int _open_keyspace(kvs_device_handle dev, char *name, kvs_key_space_handle *ks_hd) {
+  kvs_result ret = kvs_open_key_space(dev, name, ks_hd);
+  if (ret == KVS_ERR_KS_NOT_EXIST) {
+    kvs_key_space_name ks_name;
+    kvs_option_key_space option = { KVS_KEY_ORDER_NONE };
+    ks_name.name = name;
+    ks_name.name_len = strlen(name);
+    ret = kvs_create_key_space(dev, &ks_name, 0, option);
+    if (ret != KVS_SUCCESS) {
+      fprintf(stderr, "Create keyspace %s failed. error:0x%x.\n", name, ret);
+      return FAILED;
+    }
+    ret = kvs_open_key_space(dev, name, ks_hd);
+  }
+  if (ret != KVS_SUCCESS) {
+    fprintf(stderr, "Open keyspace %s failed. error:0x%x.\n", name, ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+  char *dev_path = NULL;
+  char *reject_path = NULL;
+  char default_reject_path[PATH_MAX];
+  char *keyspace_name = (char *)DEFAULT_KEYSPACE_NAME;
+  int nthreads = 1;
+  int qdepth = 64;
+  int resume = 0;
+  int interval = 1;
+  int c;
+  int ret = SUCCESS;
+
+  memset(&g_input, 0, sizeof(g_input));
+  g_input.format = FORMAT_LINE;
+
+  while ((c = getopt(argc, argv, "d:i:f:s:t:q:c:rj:p:h")) != -1) {
+    switch (c) {
+      case 'd':
+        dev_path = optarg;
+        break;
+      case 'i':
+        g_input.path = optarg;
+        break;
+      case 'f':
+        if (!strcmp(optarg, "line")) g_input.format = FORMAT_LINE;
+        else if (!strcmp(optarg, "csv")) g_input.format = FORMAT_CSV;
+        else if (!strcmp(optarg, "bin")) g_input.format = FORMAT_BIN;
+        else {
+          usage(argv[0]);
+          return FAILED;
+        }
+        break;
+      case 's':
+        keyspace_name = optarg;
+        break;
+      case 't':
+        nthreads = atoi(optarg);
+        break;
+      case 'q':
+        qdepth = atoi(optarg);
+        break;
+      case 'c':
+        g_checkpoint_path = optarg;
+        break;
+      case 'r':
+        resume = 1;
+        break;
+      case 'j':
+        reject_path = optarg;
+        break;
+      case 'p':
+        interval = atoi(optarg);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return SUCCESS;
+      default:
+        usage(argv[0]);
+        return FAILED;
+    }
+  }
+
+  if (dev_path == NULL || g_input.path == NULL || nthreads <= 0 ||
+      qdepth <= 0 || interval <= 0 || (resume && g_checkpoint_path == NULL)) {
+    usage(argv[0]);
+    return FAILED;
+  }
+
+  if (_open_input(&g_input) != SUCCESS) return FAILED;
+  if (realpath(g_input.path, g_input.real_path) == NULL)
+    snprintf(g_input.real_path, sizeof(g_input.real_path), "%s", g_input.path);
+  fprintf(stdout, "%s: %lu records, %lu bytes, format %s\n", g_input.path,
+          g_input.nrecords, g_input.filesize, format_names[g_input.format]);
+
+  import_worker *workers = new import_worker[nthreads];
+  uint64_t per_thread = g_input.nrecords / nthreads;
+  uint64_t remainder = g_input.nrecords % nthreads;
+  uint64_t pos = 0;
+  for (int i = 0; i < nthreads; i++) {
+    workers[i].slots = NULL;
+    workers[i].begin = pos;
+    pos += per_thread + ((uint64_t)i < remainder ? 1 : 0);
+    workers[i].end = pos;
+    workers[i].next = workers[i].begin;
+    workers[i].first_failed = INVALID_INDEX;
+  }
+
+  uint64_t skipped = 0;
+  kvs_device_handle dev = NULL;
+  kvs_key_space_handle ks_hd = NULL;
+  struct timespec start_time;
+  uint64_t total_records = 0, total_bytes = 0, total_failed = 0, total_rejected = 0;
+  double elapsed = 0;
+
+  if (resume) {
+    if (_load_checkpoint(workers, nthreads) != SUCCESS) {
+      ret = FAILED;
+      goto free_workers;
+    }
+    for (int i = 0; i < nthreads; i++)
+      skipped += workers[i].next - workers[i].begin;
+    fprintf(stdout, "resuming from %s, %lu records already imported\n",
+            g_checkpoint_path, skipped);
+  }
+
+  if (reject_path == NULL && g_checkpoint_path) {
+    snprintf(default_reject_path, sizeof(default_reject_path), "%s.rej",
+             g_checkpoint_path);
+    reject_path = default_reject_path;
+  }
+  if (reject_path) {
+    // a resume keeps the records rejected before the checkpoint
+    g_reject_fp = fopen(reject_path, resume ? "a" : "w");
+    if (g_reject_fp == NULL) {
+      fprintf(stderr, "failed to open reject file %s: %s\n", reject_path,
+              strerror(errno));
+      ret = FAILED;
+      goto free_workers;
+    }
+  }
+
+  for (int i = 0; i < nthreads; i++) {
+    if (_alloc_worker(&workers[i], i, qdepth, g_input.max_record_len) != SUCCESS) {
+      ret = FAILED;
+      goto free_workers;
+    }
+  }
+
+  if (kvs_open_device(dev_path, &dev) != KVS_SUCCESS) {
+    fprintf(stderr, "Device open failed\n");
+    ret = FAILED;
+    goto free_workers;
+  }
+  if (_open_keyspace(dev, keyspace_name, &ks_hd) != SUCCESS) {
+    ret = FAILED;
+    goto close_device;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (int i = 0; i < nthreads; i++) {
+    workers[i].ks_hd = ks_hd;
+    pthread_create(&workers[i].tid, NULL, import_thread, &workers[i]);
+  }
+
+  {
+    uint64_t last_bytes = 0, last_records = 0;
+    double last_time = 0;
+    uint64_t target = g_input.nrecords - skipped;
+    while (total_records < target) {
+      for (int s = 0; s < interval * 1000 && total_records < target; s += 10) {
+        usleep(10000);
+        total_records = 0;
+        for (int i = 0; i < nthreads; i++) total_records += workers[i].completed;
+      }
+      total_bytes = 0;
+      for (int i = 0; i < nthreads; i++) total_bytes += workers[i].bytes;
+      elapsed = _calc_time_span(start_time);
+      fprintf(stdout, "[%.1f s] %lu/%lu records, %.2f MB/s, %.0f ops/sec\n",
+              elapsed, total_records + skipped, g_input.nrecords,
+              (double)(total_bytes - last_bytes) / 1024 / 1024 / (elapsed - last_time),
+              (double)(total_records - last_records) / (elapsed - last_time));
+      last_bytes = total_bytes;
+      last_records = total_records;
+      last_time = elapsed;
+      _write_checkpoint(workers, nthreads);
+    }
+  }
+
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(workers[i].tid, NULL);
+    total_failed += workers[i].failed;
+    total_rejected += workers[i].rejected;
+  }
+  elapsed = _calc_time_span(start_time);
+  _write_checkpoint(workers, nthreads);
+
+  fprintf(stdout, "Imported %lu records (%lu failed, %lu rejected), %lu bytes in %.2f sec\n",
+          total_records - total_failed - total_rejected, total_failed, total_rejected,
+          total_bytes, elapsed);
+  if (total_rejected && reject_path)
+    fprintf(stdout, "Malformed records were copied to %s\n", reject_path);
+  fprintf(stdout, "Sustained bandwidth %.2f MB/s; Throughput %.2f ops/sec\n",
+          elapsed > 0 ? (double)total_bytes / 1024 / 1024 / elapsed : 0,
+          elapsed > 0 ? (double)total_records / elapsed : 0);
+  if (total_failed || total_rejected) ret = FAILED;
+
+  kvs_close_key_space(ks_hd);
+close_device:
+  kvs_close_device(dev);
+free_workers:
+  for (int i = 0; i < nthreads; i++) _free_worker(&workers[i]);
+  delete[] workers;
+  if (g_reject_fp) fclose(g_reject_fp);
+  _close_input(&g_input);
+  return ret;
+}
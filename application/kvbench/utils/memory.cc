@@ -117,7 +117,10 @@ void destroy(int allocatortype, mempool_t *pool) {
     free_mem_posix(pool->base);
   }
 #else
-  free_mem_spdk(pool->base);
+  if (allocatortype == NUMA_ALLOCATOR)
+    free_mem_numa(pool->base);
+  else
+    free_mem_spdk(pool->base);
 #endif
   
   pool->base = NULL;
@@ -203,6 +206,10 @@ void pool_setup(pool_info_t *info, mempool_t *pool, int nodeid)
       exit(0);
     }
 #else
+    // kernel driver and emulator buffers may live anywhere
+    if (info->allocatortype == NUMA_ALLOCATOR)
+      memory = allocate_mem_numa(info->alignment, size, nodeid);
+    else
       memory = allocate_mem_spdk(info->alignment, size, nodeid);
 #endif
 
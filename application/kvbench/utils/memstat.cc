@@ -0,0 +1,539 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <cxxabi.h>
+#include <new>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "memstat.h"
+
+#define MEMSTAT_SHARDS 64
+#define MEMSTAT_SITES 4096
+#define MEMSTAT_TRACKED (1 << 16)
+#define MEMSTAT_PROBES 32
+#define MEMSTAT_BOOTSTRAP (64 * 1024)
+#define MEMSTAT_TOMBSTONE ((uintptr_t)1)
+#define MEMSTAT_BUSY ((uintptr_t)2)
+
+typedef void *(*malloc_fn)(size_t);
+typedef void (*free_fn)(void *);
+typedef void *(*calloc_fn)(size_t, size_t);
+typedef void *(*realloc_fn)(void *, size_t);
+typedef int (*posix_memalign_fn)(void **, size_t, size_t);
+typedef void *(*memalign_fn)(size_t, size_t);
+typedef size_t (*usable_size_fn)(void *);
+
+static malloc_fn real_malloc;
+static free_fn real_free;
+static calloc_fn real_calloc;
+static realloc_fn real_realloc;
+static posix_memalign_fn real_posix_memalign;
+static memalign_fn real_memalign;
+static memalign_fn real_aligned_alloc;
+static usable_size_fn real_usable_size;
+
+// dlsym() may allocate before the real allocator is known
+static char bootstrap_buf[MEMSTAT_BOOTSTRAP] __attribute__((aligned(64)));
+static size_t bootstrap_used = 0;
+static int resolving = 0;
+
+struct alignas(64) memstat_shard {
+  std::atomic<int64_t> live;
+  std::atomic<uint64_t> nallocs;
+};
+
+struct memstat_site {
+  std::atomic<uintptr_t> pc;
+  std::atomic<uint64_t> samples;
+  std::atomic<uint64_t> est_count;
+  std::atomic<uint64_t> est_bytes;
+  std::atomic<int64_t> live_bytes;
+};
+
+struct memstat_tracked {
+  std::atomic<uintptr_t> ptr;
+  uint32_t site;
+  uint64_t weight;
+};
+
+static std::atomic<bool> g_enabled(false);
+static uint64_t g_sample_bytes = 0;
+static memstat_shard g_shards[MEMSTAT_SHARDS];
+static memstat_site g_sites[MEMSTAT_SITES];
+static memstat_tracked g_tracked[MEMSTAT_TRACKED];
+static std::atomic<int64_t> g_ntracked(0);
+static std::atomic<int> g_next_shard(0);
+
+static __thread int t_shard = -1;
+static __thread int64_t t_until_sample = 0;
+static __thread uint64_t t_rnd = 0;
+static __thread int t_in_hook = 0;
+
+static void resolve_allocator() {
+  if (real_malloc) return;
+  resolving = 1;
+  real_free = (free_fn)dlsym(RTLD_NEXT, "free");
+  real_calloc = (calloc_fn)dlsym(RTLD_NEXT, "calloc");
+  real_realloc = (realloc_fn)dlsym(RTLD_NEXT, "realloc");
+  real_posix_memalign = (posix_memalign_fn)dlsym(RTLD_NEXT, "posix_memalign");
+  real_memalign = (memalign_fn)dlsym(RTLD_NEXT, "memalign");
+  real_aligned_alloc = (memalign_fn)dlsym(RTLD_NEXT, "aligned_alloc");
+  real_usable_size = (usable_size_fn)dlsym(RTLD_NEXT, "malloc_usable_size");
+  real_malloc = (malloc_fn)dlsym(RTLD_NEXT, "malloc");
+  resolving = 0;
+  if (real_malloc == NULL || real_free == NULL) {
+    fprintf(stderr, "memstat: can not find the system allocator\n");
+    abort();
+  }
+}
+
+static void *bootstrap_alloc(size_t size) {
+  size = (size + 63) & ~(size_t)63;
+  if (bootstrap_used + size > sizeof(bootstrap_buf)) return NULL;
+  void *p = bootstrap_buf + bootstrap_used;
+  bootstrap_used += size;
+  return p;
+}
+
+static inline bool is_bootstrap(void *p) {
+  return (char*)p >= bootstrap_buf && (char*)p < bootstrap_buf + sizeof(bootstrap_buf);
+}
+
+static inline memstat_shard *my_shard() {
+  if (t_shard < 0)
+    t_shard = g_next_shard.fetch_add(1, std::memory_order_relaxed) % MEMSTAT_SHARDS;
+  return &g_shards[t_shard];
+}
+
+static inline uint64_t next_rnd() {
+  if (t_rnd == 0) t_rnd = (uintptr_t)&t_rnd ^ 0x9E3779B97F4A7C15ULL;
+  t_rnd ^= t_rnd << 13;
+  t_rnd ^= t_rnd >> 7;
+  t_rnd ^= t_rnd << 17;
+  return t_rnd;
+}
+
+// uniform in [interval/2, 3*interval/2) so periodic allocation patterns do not alias
+static inline int64_t next_sample_gap() {
+  return (int64_t)(g_sample_bytes / 2 + next_rnd() % (g_sample_bytes + 1));
+}
+
+static inline uint32_t hash_ptr(uintptr_t v) {
+  v ^= v >> 33;
+  v *= 0xff51afd7ed558ccdULL;
+  v ^= v >> 33;
+  return (uint32_t)v;
+}
+
+static int find_site(uintptr_t pc) {
+  uint32_t h = hash_ptr(pc) % MEMSTAT_SITES;
+  for (int i = 0; i < MEMSTAT_SITES; i++) {
+    memstat_site *s = &g_sites[(h + i) % MEMSTAT_SITES];
+    uintptr_t cur = s->pc.load(std::memory_order_acquire);
+    if (cur == pc) return (h + i) % MEMSTAT_SITES;
+    if (cur == 0) {
+      if (s->pc.compare_exchange_strong(cur, pc) || cur == pc)
+        return (h + i) % MEMSTAT_SITES;
+    }
+  }
+  return -1;
+}
+
+static void sample_alloc(void *p, size_t size, uintptr_t pc) {
+  uint64_t weight = size >= g_sample_bytes ? size : g_sample_bytes;
+  int site = find_site(pc);
+  if (site < 0) return;
+
+  memstat_site *s = &g_sites[site];
+  s->samples.fetch_add(1, std::memory_order_relaxed);
+  s->est_count.fetch_add(size ? weight / size : 1, std::memory_order_relaxed);
+  s->est_bytes.fetch_add(weight, std::memory_order_relaxed);
+
+  uint32_t h = hash_ptr((uintptr_t)p) % MEMSTAT_TRACKED;
+  for (int i = 0; i < MEMSTAT_PROBES; i++) {
+    memstat_tracked *t = &g_tracked[(h + i) % MEMSTAT_TRACKED];
+    uintptr_t cur = t->ptr.load(std::memory_order_relaxed);
+    if (cur != 0 && cur != MEMSTAT_TOMBSTONE) continue;
+    if (t->ptr.compare_exchange_strong(cur, MEMSTAT_BUSY)) {
+      t->site = site;
+      t->weight = weight;
+      s->live_bytes.fetch_add(weight, std::memory_order_relaxed);
+      g_ntracked.fetch_add(1, std::memory_order_relaxed);
+      t->ptr.store((uintptr_t)p, std::memory_order_release);
+      return;
+    }
+  }
+  // tracking table is crowded: count the sample but not its lifetime
+}
+
+static void untrack(void *p) {
+  uint32_t h = hash_ptr((uintptr_t)p) % MEMSTAT_TRACKED;
+  for (int i = 0; i < MEMSTAT_PROBES; i++) {
+    memstat_tracked *t = &g_tracked[(h + i) % MEMSTAT_TRACKED];
+    uintptr_t cur = t->ptr.load(std::memory_order_acquire);
+    if (cur == 0) return;
+    if (cur != (uintptr_t)p) continue;
+    if (t->ptr.compare_exchange_strong(cur, MEMSTAT_TOMBSTONE)) {
+      g_sites[t->site].live_bytes.fetch_sub(t->weight, std::memory_order_relaxed);
+      g_ntracked.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return;
+  }
+}
+
+static inline void account_alloc(void *p, size_t size, uintptr_t pc) {
+  if (p == NULL || !g_enabled.load(std::memory_order_relaxed) || t_in_hook) return;
+  t_in_hook = 1;
+  size_t usable = real_usable_size ? real_usable_size(p) : size;
+  memstat_shard *sh = my_shard();
+  sh->live.fetch_add(usable, std::memory_order_relaxed);
+  sh->nallocs.fetch_add(1, std::memory_order_relaxed);
+  if (g_sample_bytes) {
+    t_until_sample -= size;
+    if (t_until_sample < 0) {
+      t_until_sample = next_sample_gap();
+      sample_alloc(p, size, pc);
+    }
+  }
+  t_in_hook = 0;
+}
+
+static inline void account_free(void *p) {
+  if (!g_enabled.load(std::memory_order_relaxed) || t_in_hook) return;
+  t_in_hook = 1;
+  if (g_ntracked.load(std::memory_order_relaxed) > 0) untrack(p);
+  size_t usable = real_usable_size ? real_usable_size(p) : 0;
+  my_shard()->live.fetch_sub(usable, std::memory_order_relaxed);
+  t_in_hook = 0;
+}
+
+static void *memstat_malloc(size_t size, uintptr_t pc) {
+  if (real_malloc == NULL) {
+    if (resolving) return bootstrap_alloc(size);
+    resolve_allocator();
+  }
+  void *p = real_malloc(size);
+  account_alloc(p, size, pc);
+  return p;
+}
+
+static void memstat_free(void *p) {
+  if (p == NULL || is_bootstrap(p)) return;
+  if (real_free == NULL) resolve_allocator();
+  account_free(p);
+  real_free(p);
+}
+
+extern "C" {
+
+void *malloc(size_t size) {
+  return memstat_malloc(size, (uintptr_t)__builtin_return_address(0));
+}
+
+void free(void *p) {
+  memstat_free(p);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  if (real_calloc == NULL) {
+    if (resolving) {
+      void *p = bootstrap_alloc(nmemb * size);
+      if (p) memset(p, 0, nmemb * size);
+      return p;
+    }
+    resolve_allocator();
+  }
+  void *p = real_calloc(nmemb, size);
+  account_alloc(p, nmemb * size, (uintptr_t)__builtin_return_address(0));
+  return p;
+}
+
+void *realloc(void *old, size_t size) {
+  if (real_realloc == NULL) resolve_allocator();
+  if (old == NULL) return memstat_malloc(size, (uintptr_t)__builtin_return_address(0));
+  if (is_bootstrap(old)) {
+    void *p = memstat_malloc(size, (uintptr_t)__builtin_return_address(0));
+    if (p) memcpy(p, old, std::min(size, (size_t)(bootstrap_buf + sizeof(bootstrap_buf) - (char*)old)));
+    return p;
+  }
+  account_free(old);
+  void *p = real_realloc(old, size);
+  // on failure the old block is still alive
+  account_alloc(p ? p : (size ? old : NULL), p ? size : 0,
+                (uintptr_t)__builtin_return_address(0));
+  return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (real_posix_memalign == NULL) resolve_allocator();
+  int ret = real_posix_memalign(memptr, alignment, size);
+  if (ret == 0) account_alloc(*memptr, size, (uintptr_t)__builtin_return_address(0));
+  return ret;
+}
+
+void *memalign(size_t alignment, size_t size) {
+  if (real_memalign == NULL) resolve_allocator();
+  void *p = real_memalign(alignment, size);
+  account_alloc(p, size, (uintptr_t)__builtin_return_address(0));
+  return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  if (real_aligned_alloc == NULL) resolve_allocator();
+  void *p = real_aligned_alloc(alignment, size);
+  account_alloc(p, size, (uintptr_t)__builtin_return_address(0));
+  return p;
+}
+
+}  // extern "C"
+
+void *operator new(size_t size) {
+  void *p = memstat_malloc(size, (uintptr_t)__builtin_return_address(0));
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) {
+  void *p = memstat_malloc(size, (uintptr_t)__builtin_return_address(0));
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept {
+  return memstat_malloc(size, (uintptr_t)__builtin_return_address(0));
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return memstat_malloc(size, (uintptr_t)__builtin_return_address(0));
+}
+
+void operator delete(void *p) noexcept { memstat_free(p); }
+void operator delete[](void *p) noexcept { memstat_free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { memstat_free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { memstat_free(p); }
+
+// ---- RSS and hugepage sampler ----
+
+struct memstat_phase_acc {
+  std::string name;
+  memstat_phase_stat_t stat;
+  double heap_sum;
+  double rss_sum;
+};
+
+static pthread_t g_sampler;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+static volatile int g_stop = 0;
+static int g_running = 0;
+static int g_period_ms = 1000;
+static FILE *g_csv_fp = NULL;
+static struct timespec g_start;
+static std::vector<memstat_phase_acc> *g_phases = NULL;
+
+static uint64_t read_kb_field(const char *path, const char *field) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) return 0;
+  char line[256];
+  size_t flen = strlen(field);
+  uint64_t val = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    if (strncmp(line, field, flen) == 0 && line[flen] == ':') {
+      val = strtoull(line + flen + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(fp);
+  return val;
+}
+
+void memstat_get(memstat_snapshot_t *snap) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  memset(snap, 0, sizeof(*snap));
+  snap->time_ms = (now.tv_sec - g_start.tv_sec) * 1000 +
+                  (now.tv_nsec - g_start.tv_nsec) / 1000000;
+
+  for (int i = 0; i < MEMSTAT_SHARDS; i++) {
+    snap->heap_live += g_shards[i].live.load(std::memory_order_relaxed);
+    snap->nallocs += g_shards[i].nallocs.load(std::memory_order_relaxed);
+  }
+
+  snap->rss = read_kb_field("/proc/self/status", "VmRSS") * 1024;
+  snap->rss_peak = read_kb_field("/proc/self/status", "VmHWM") * 1024;
+  snap->rss_anon = read_kb_field("/proc/self/status", "RssAnon") * 1024;
+  snap->rss_file = read_kb_field("/proc/self/status", "RssFile") * 1024;
+  snap->hugetlb = read_kb_field("/proc/self/status", "HugetlbPages") * 1024;
+  snap->anon_huge = read_kb_field("/proc/self/smaps_rollup", "AnonHugePages") * 1024;
+
+  uint64_t total = read_kb_field("/proc/meminfo", "HugePages_Total");
+  uint64_t freep = read_kb_field("/proc/meminfo", "HugePages_Free");
+  uint64_t hpsize = read_kb_field("/proc/meminfo", "Hugepagesize") * 1024;
+  snap->sys_huge_used = (total - freep) * hpsize;
+}
+
+// caller holds g_lock
+static void add_sample(const memstat_snapshot_t *snap) {
+  memstat_phase_acc &acc = g_phases->back();
+  memstat_phase_stat_t *st = &acc.stat;
+  uint64_t huge = std::max(snap->hugetlb, snap->sys_huge_used);
+
+  st->nsamples++;
+  acc.heap_sum += snap->heap_live;
+  acc.rss_sum += snap->rss;
+  st->heap_mean = acc.heap_sum / st->nsamples;
+  st->rss_mean = acc.rss_sum / st->nsamples;
+  if (st->nsamples == 1 || snap->heap_live > st->heap_peak) st->heap_peak = snap->heap_live;
+  if (snap->rss > st->rss_peak) st->rss_peak = snap->rss;
+  if (snap->anon_huge > st->anon_huge_peak) st->anon_huge_peak = snap->anon_huge;
+  if (huge > st->huge_peak) st->huge_peak = huge;
+
+  if (g_csv_fp) {
+    fprintf(g_csv_fp, "%lu,%s,%ld,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+            (unsigned long)snap->time_ms, acc.name.c_str(), (long)snap->heap_live,
+            (unsigned long)snap->nallocs, (unsigned long)snap->rss,
+            (unsigned long)snap->rss_anon, (unsigned long)snap->rss_file,
+            (unsigned long)snap->anon_huge, (unsigned long)snap->hugetlb,
+            (unsigned long)snap->sys_huge_used);
+    fflush(g_csv_fp);
+  }
+}
+
+static void *sampler_thread(void *arg) {
+  memstat_snapshot_t snap;
+  pthread_mutex_lock(&g_lock);
+  while (!g_stop) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += g_period_ms / 1000;
+    ts.tv_nsec += (g_period_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&g_cond, &g_lock, &ts);
+    if (g_stop) break;
+    memstat_get(&snap);
+    add_sample(&snap);
+  }
+  pthread_mutex_unlock(&g_lock);
+  return NULL;
+}
+
+void memstat_start(int period_ms, uint64_t sample_bytes, FILE *csv_fp) {
+  if (g_running) return;
+  resolve_allocator();
+  clock_gettime(CLOCK_MONOTONIC, &g_start);
+  g_period_ms = period_ms > 0 ? period_ms : 1000;
+  g_sample_bytes = sample_bytes;
+  g_csv_fp = csv_fp;
+  g_phases = new std::vector<memstat_phase_acc>;
+  g_phases->push_back(memstat_phase_acc());
+  g_phases->back().name = "init";
+  memset(&g_phases->back().stat, 0, sizeof(memstat_phase_stat_t));
+  g_phases->back().heap_sum = g_phases->back().rss_sum = 0;
+  if (g_csv_fp)
+    fprintf(g_csv_fp, "time_ms,phase,heap_live,nallocs,rss,rss_anon,rss_file,"
+            "anon_huge,hugetlb,sys_huge_used\n");
+
+  g_enabled.store(true);
+  g_stop = 0;
+  if (pthread_create(&g_sampler, NULL, sampler_thread, NULL) == 0)
+    g_running = 1;
+}
+
+void memstat_stop() {
+  if (!g_running) return;
+  pthread_mutex_lock(&g_lock);
+  g_stop = 1;
+  pthread_cond_signal(&g_cond);
+  pthread_mutex_unlock(&g_lock);
+  pthread_join(g_sampler, NULL);
+  g_running = 0;
+  g_enabled.store(false);
+}
+
+int memstat_enabled() {
+  return g_running;
+}
+
+int memstat_phase(const char *name) {
+  if (!g_running) return -1;
+  memstat_snapshot_t snap;
+  memstat_get(&snap);
+
+  pthread_mutex_lock(&g_lock);
+  add_sample(&snap);  // closes the previous phase
+  g_phases->push_back(memstat_phase_acc());
+  memstat_phase_acc &acc = g_phases->back();
+  acc.name = name;
+  memset(&acc.stat, 0, sizeof(memstat_phase_stat_t));
+  acc.heap_sum = acc.rss_sum = 0;
+  add_sample(&snap);
+  int idx = (int)g_phases->size() - 1;
+  pthread_mutex_unlock(&g_lock);
+  return idx;
+}
+
+void memstat_get_phase(int phase, memstat_phase_stat_t *stat) {
+  memset(stat, 0, sizeof(*stat));
+  if (g_phases == NULL || phase < 0) return;
+  pthread_mutex_lock(&g_lock);
+  if (phase < (int)g_phases->size())
+    *stat = (*g_phases)[phase].stat;
+  pthread_mutex_unlock(&g_lock);
+}
+
+static void site_name(uintptr_t pc, char *buf, size_t len) {
+  Dl_info info;
+  if (dladdr((void*)pc, &info) == 0) {
+    snprintf(buf, len, "0x%lx", (unsigned long)pc);
+    return;
+  }
+  const char *lib = info.dli_fname ? strrchr(info.dli_fname, '/') : NULL;
+  lib = lib ? lib + 1 : (info.dli_fname ? info.dli_fname : "?");
+  if (info.dli_sname) {
+    int status = -1;
+    char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    snprintf(buf, len, "%s+0x%lx (%s)", status == 0 ? demangled : info.dli_sname,
+             (unsigned long)(pc - (uintptr_t)info.dli_saddr), lib);
+    if (demangled) free(demangled);
+    if (strlen(buf) > 120) strcpy(buf + 116, "...");
+  } else {
+    snprintf(buf, len, "%s+0x%lx", lib, (unsigned long)(pc - (uintptr_t)info.dli_fbase));
+  }
+}
+
+void memstat_print_sites(FILE *fp, int topn) {
+  if (!g_running || g_sample_bytes == 0 || topn <= 0) return;
+
+  std::vector<int> idx;
+  for (int i = 0; i < MEMSTAT_SITES; i++)
+    if (g_sites[i].pc.load() != 0 && g_sites[i].samples.load() > 0) idx.push_back(i);
+  std::sort(idx.begin(), idx.end(), [](int a, int b) {
+      int64_t la = g_sites[a].live_bytes.load(), lb = g_sites[b].live_bytes.load();
+      if (la != lb) return la > lb;
+      return g_sites[a].est_bytes.load() > g_sites[b].est_bytes.load();
+    });
+
+  fprintf(fp, "top allocation sites (1 sample per %lu KB allocated)\n",
+          (unsigned long)(g_sample_bytes / 1024));
+  fprintf(fp, "%10s %12s %12s  %s\n", "live MB", "alloc MB", "allocs", "site");
+  char name[512];
+  for (int i = 0; i < (int)idx.size() && i < topn; i++) {
+    memstat_site *s = &g_sites[idx[i]];
+    site_name(s->pc.load(), name, sizeof(name));
+    fprintf(fp, "%10.2f %12.2f %12lu  %s\n",
+            (double)s->live_bytes.load() / (1024 * 1024),
+            (double)s->est_bytes.load() / (1024 * 1024),
+            (unsigned long)s->est_count.load(), name);
+  }
+}
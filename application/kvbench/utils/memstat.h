@@ -0,0 +1,60 @@
+#ifndef __MEMSTAT_H
+#define __MEMSTAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Low overhead host memory accounting for the benchmarks.
+ *
+ * malloc/free and operator new/delete are interposed for the whole process,
+ * so allocations made inside the KVS library, the emulator and the wrappers
+ * are all counted. Every call updates a sharded live byte counter; roughly
+ * one allocation per sample_bytes allocated is recorded against its call
+ * site. A background thread samples RSS and hugepage usage every period.
+ */
+
+typedef struct memstat_snapshot {
+  uint64_t time_ms;        // since memstat_start()
+  int64_t  heap_live;      // bytes allocated and not yet freed
+  uint64_t nallocs;
+  uint64_t rss;            // resident set, bytes
+  uint64_t rss_peak;
+  uint64_t rss_anon;
+  uint64_t rss_file;
+  uint64_t anon_huge;      // transparent huge pages mapped by this process
+  uint64_t hugetlb;        // hugetlbfs pages mapped by this process
+  uint64_t sys_huge_used;  // system wide HugePages_Total - HugePages_Free
+} memstat_snapshot_t;
+
+typedef struct memstat_phase_stat {
+  uint64_t nsamples;
+  double   heap_mean;
+  int64_t  heap_peak;
+  double   rss_mean;
+  uint64_t rss_peak;
+  uint64_t anon_huge_peak;
+  uint64_t huge_peak;      // hugetlb or system hugepages in use, whichever is larger
+} memstat_phase_stat_t;
+
+// period_ms: RSS sampling period, sample_bytes: 0 disables call site sampling
+void memstat_start(int period_ms, uint64_t sample_bytes, FILE *csv_fp);
+void memstat_stop();
+int memstat_enabled();
+
+// ends the current phase and starts a new one, returns its index
+int memstat_phase(const char *name);
+void memstat_get_phase(int phase, memstat_phase_stat_t *stat);
+void memstat_get(memstat_snapshot_t *snap);
+
+void memstat_print_sites(FILE *fp, int topn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
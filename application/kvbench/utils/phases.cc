@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "phases.h"
+
+void phases_init(phase_schedule_t *s)
+{
+  int i;
+  for (i = 0; i < s->nphases; ++i) {
+    phase_t *p = &s->phases[i];
+    p->ngroups = 0;
+    if (p->dist.type != RND_ZIPFIAN) continue;
+    p->ngroups = s->key_range / p->dist.b;
+    if (p->ngroups == 0) p->ngroups = 1;
+    zipf_rnd_init(&p->zipf, p->ngroups, p->dist.a / 100.0, 1024 * 1024);
+  }
+}
+
+void phases_free(phase_schedule_t *s)
+{
+  int i;
+  for (i = 0; i < s->nphases; ++i) {
+    if (s->phases[i].dist.type == RND_ZIPFIAN) zipf_rnd_free(&s->phases[i].zipf);
+  }
+  free(s->phases);
+  s->phases = NULL;
+  s->nphases = 0;
+}
+
+uint64_t phases_total_us(phase_schedule_t *s)
+{
+  uint64_t total = 0;
+  int i;
+  for (i = 0; i < s->nphases; ++i) total += s->phases[i].duration_us;
+  return total;
+}
+
+void phases_locate(phase_schedule_t *s, uint64_t elapsed_us, phase_pos_t *pos)
+{
+  int i = 0;
+  while (i + 1 < s->nphases && elapsed_us >= s->phases[i].duration_us) {
+    elapsed_us -= s->phases[i].duration_us;
+    ++i;
+  }
+  pos->cur = i;
+  pos->t_us = elapsed_us;
+  pos->prev = -1;
+  pos->weight = 1;
+  if (s->smooth && i > 0 && elapsed_us < s->transition_us) {
+    pos->prev = i - 1;
+    pos->weight = (double)elapsed_us / s->transition_us;
+  }
+}
+
+void phases_ratio(phase_schedule_t *s, phase_pos_t *pos, size_t ratio[4])
+{
+  phase_t *cur = &s->phases[pos->cur];
+  size_t sum = 0;
+  int i;
+
+  if (pos->prev < 0) {
+    memcpy(ratio, cur->ratio, sizeof(cur->ratio));
+    return;
+  }
+  for (i = 0; i < 3; ++i) {
+    double r = s->phases[pos->prev].ratio[i] * (1 - pos->weight) +
+               cur->ratio[i] * pos->weight;
+    ratio[i] = (size_t)(r + 0.5);
+    if (sum + ratio[i] > 100) ratio[i] = 100 - sum;
+    sum += ratio[i];
+  }
+  ratio[3] = 100 - sum;
+}
+
+double phases_rate(phase_schedule_t *s, phase_pos_t *pos, double prev_reached)
+{
+  double rate = s->phases[pos->cur].rate;
+  double prev;
+
+  if (pos->prev < 0) return rate;
+  prev = s->phases[pos->prev].rate;
+  // an unlimited phase hands over the rate it reached
+  if (prev == 0) prev = prev_reached;
+  if (prev > 0 && rate > 0) return prev * (1 - pos->weight) + rate * pos->weight;
+
+  // towards or from unlimited, blend the interval between ops instead,
+  // which is 0 on the unlimited side
+  if (rate > 0) return (pos->weight > 0) ? rate / pos->weight : 0;
+  if (prev > 0) return prev / (1 - pos->weight);
+  return 0;
+}
+
+// fraction of the key range the popularity is rotated by
+static double _hot_shift(phase_t *p, uint64_t t_us)
+{
+  double shift = p->hot_offset + p->hot_drift * (t_us / 1000000.0);
+  shift -= floor(shift);
+  return shift;
+}
+
+uint64_t phases_key(phase_schedule_t *s, phase_pos_t *pos,
+                    uint64_t rv1, uint64_t rv2)
+{
+  phase_t *p = &s->phases[pos->cur];
+  uint64_t t_us = pos->t_us;
+  uint64_t key;
+
+  if (pos->prev >= 0 && (double)rv2 / UINT64_MAX >= pos->weight) {
+    p = &s->phases[pos->prev];
+    t_us += p->duration_us;
+  }
+
+  if (p->dist.type == RND_ZIPFIAN) {
+    uint64_t group = zipf_rnd_get(&p->zipf);
+    group = (group + (uint64_t)(_hot_shift(p, t_us) * p->ngroups)) % p->ngroups;
+    key = group * p->dist.b + rv1 % p->dist.b;
+  } else {
+    struct rndinfo ri;
+    ri.type = RND_UNIFORM;
+    ri.a = 0;
+    ri.b = s->key_range;
+    key = get_random(&ri, rv1, rv2);
+    key += (uint64_t)(_hot_shift(p, t_us) * s->key_range);
+  }
+  return key % s->key_range;
+}
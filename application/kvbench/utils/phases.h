@@ -0,0 +1,81 @@
+#ifndef __PHASES_H
+#define __PHASES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "adv_random.h"
+#include "zipfian_random.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Time-varying workload schedule for the benchmark threads.
+ *
+ * The evaluation runs an ordered list of phases, each with its own operation
+ * mix, key distribution, hot set position and target rate. Threads look up
+ * where they are in the schedule before every operation. With smooth
+ * transitions, the first transition_us of a phase blends in the previous
+ * phase: the mix and the rate move linearly from one to the other, and keys
+ * are drawn from the previous phase with the remaining probability. An
+ * unlimited previous phase starts the rate from what it reached; towards an
+ * unlimited phase, or from one that reached nothing, the interval between
+ * ops moves linearly to or from 0 instead.
+ *
+ * The zipfian table is shuffled, so the hot set is spread over the key range.
+ * hot_offset and hot_drift rotate the popularity of the key groups, i.e. they
+ * change which keys are hot, the way zipf_rnd_shift() does.
+ */
+
+#define PHASE_NAME_LEN 32
+
+typedef struct phase {
+  char name[PHASE_NAME_LEN];
+  uint64_t duration_us;
+  size_t ratio[4];        // read:update:insert:delete, percent
+  struct rndinfo dist;    // RND_UNIFORM, or RND_ZIPFIAN with a = s * 100, b = group size
+  struct zipf_rnd zipf;
+  uint64_t ngroups;       // zipfian key groups
+  double hot_offset;      // fraction of the key range
+  double hot_drift;       // fraction of the key range per second
+  double rate;            // ops/s over all threads, 0: unlimited
+} phase_t;
+
+typedef struct phase_schedule {
+  int nphases;
+  phase_t *phases;
+  int smooth;
+  uint64_t transition_us;
+  uint64_t key_range;
+} phase_schedule_t;
+
+// position in the schedule
+typedef struct phase_pos {
+  int cur;
+  int prev;       // phase blended in, -1 outside transitions
+  double weight;  // share of cur
+  uint64_t t_us;  // since cur started
+} phase_pos_t;
+
+// builds the zipfian tables once the phases and the key range are set
+void phases_init(phase_schedule_t *s);
+void phases_free(phase_schedule_t *s);
+uint64_t phases_total_us(phase_schedule_t *s);
+
+// the last phase runs until the benchmark ends
+void phases_locate(phase_schedule_t *s, uint64_t elapsed_us, phase_pos_t *pos);
+// operation mix at pos, always adds up to 100
+void phases_ratio(phase_schedule_t *s, phase_pos_t *pos, size_t ratio[4]);
+// prev_reached: ops/s the previous phase reached over all threads, 0 if unknown
+double phases_rate(phase_schedule_t *s, phase_pos_t *pos, double prev_reached);
+// key index in [0, key_range), rv1 and rv2 are random numbers
+uint64_t phases_key(phase_schedule_t *s, phase_pos_t *pos,
+                    uint64_t rv1, uint64_t rv2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -37,6 +37,27 @@ uint64_t _timeval_to_us(struct timeval tv)
     return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
+static void (*_clock)(struct timeval *tv) = NULL;
+
+void stopwatch_set_clock(void (*clock)(struct timeval *tv))
+{
+    _clock = clock;
+}
+
+void stopwatch_gettime(struct timeval *tv)
+{
+    if (_clock) {
+        _clock(tv);
+    } else {
+        gettimeofday(tv, NULL);
+    }
+}
+
+int stopwatch_clock_is_set(void)
+{
+    return _clock != NULL;
+}
+
 void stopwatch_init(struct stopwatch *sw)
 {
     sw->elapsed.tv_sec = 0;
@@ -45,7 +66,7 @@ void stopwatch_init(struct stopwatch *sw)
 
 void stopwatch_start(struct stopwatch *sw)
 {
-    gettimeofday(&sw->start, NULL);
+    stopwatch_gettime(&sw->start);
 }
 
 void stopwatch_init_start(struct stopwatch *sw)
@@ -57,7 +78,7 @@ void stopwatch_init_start(struct stopwatch *sw)
 int stopwatch_check_ms(struct stopwatch *sw, size_t ms)
 {
     struct timeval cur, gap;
-    gettimeofday(&cur, NULL);
+    stopwatch_gettime(&cur);
     gap = _utime_gap(sw->start, cur);
     if ((uint64_t)gap.tv_sec * 1000 + (uint64_t)gap.tv_usec / 1000 >= ms) {
         return 1;
@@ -68,7 +89,7 @@ int stopwatch_check_ms(struct stopwatch *sw, size_t ms)
 int stopwatch_check_us(struct stopwatch *sw, size_t us)
 {
     struct timeval cur, gap;
-    gettimeofday(&cur, NULL);
+    stopwatch_gettime(&cur);
     gap = _utime_gap(sw->start, cur);
     if ((uint64_t)gap.tv_sec * 1000000 + (uint64_t)gap.tv_usec >= us) {
         return 1;
@@ -79,7 +100,7 @@ int stopwatch_check_us(struct stopwatch *sw, size_t us)
 struct timeval stopwatch_get_curtime(struct stopwatch *sw)
 {
     struct timeval end, gap;
-    gettimeofday(&end, NULL);
+    stopwatch_gettime(&end);
     gap = _utime_gap(sw->start, end);
     return gap;
 }
@@ -92,7 +113,7 @@ struct timeval stopwatch_get_elapsed(struct stopwatch *sw)
 struct timeval stopwatch_stop(struct stopwatch *sw)
 {
     struct timeval end, gap;
-    gettimeofday(&end, NULL);
+    stopwatch_gettime(&end);
     gap = _utime_gap(sw->start, end);
     sw->elapsed.tv_sec += gap.tv_sec;
     sw->elapsed.tv_usec += gap.tv_usec;
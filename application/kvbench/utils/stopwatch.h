@@ -31,6 +31,11 @@ struct stopwatch {
 };
 
 uint64_t _timeval_to_us(struct timeval tv);
+/* the clock all stopwatches read, gettimeofday() unless a backend sets
+ * another one, e.g. the virtual clock of a simulated device */
+void stopwatch_set_clock(void (*clock)(struct timeval *tv));
+void stopwatch_gettime(struct timeval *tv);
+int stopwatch_clock_is_set(void);
 void stopwatch_init(struct stopwatch *sw);
 void stopwatch_start(struct stopwatch *sw);
 void stopwatch_init_start(struct stopwatch *sw);
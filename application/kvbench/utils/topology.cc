@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <numa.h>
+
+#include "topology.h"
+
+static int _read_int(const char *path, int *val)
+{
+  FILE *fp = fopen(path, "r");
+  int ret;
+  if (fp == NULL) return -1;
+  ret = fscanf(fp, "%d", val);
+  fclose(fp);
+  return ret == 1 ? 0 : -1;
+}
+
+// parses a CPU list like "0-3,8,10-11" into online[]
+static int _read_cpulist(const char *path, char *online, int max)
+{
+  FILE *fp = fopen(path, "r");
+  char buf[4096];
+  char *pt, *save = NULL;
+  int count = 0;
+  if (fp == NULL) return -1;
+  if (fgets(buf, sizeof(buf), fp) == NULL) {
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+
+  for (pt = strtok_r(buf, ",\n", &save); pt; pt = strtok_r(NULL, ",\n", &save)) {
+    int first, last, i;
+    if (sscanf(pt, "%d-%d", &first, &last) != 2) {
+      if (sscanf(pt, "%d", &first) != 1) continue;
+      last = first;
+    }
+    for (i = first; i <= last && i < max; ++i) {
+      if (i >= 0 && !online[i]) {
+        online[i] = 1;
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+int topology_read(topology_t *t)
+{
+  const int max = 4096;
+  char *online = (char *)calloc(max, 1);
+  int *pkg_core = (int *)malloc(sizeof(int) * max * 2);
+  int i, j, n = 0, ncores = 0;
+
+  memset(t, 0, sizeof(*t));
+  if (_read_cpulist("/sys/devices/system/cpu/online", online, max) <= 0) {
+    free(online);
+    free(pkg_core);
+    return -1;
+  }
+  t->nnodes = numa_available() < 0 ? 1 : numa_max_node() + 1;
+  t->cpus = (topo_cpu_t *)calloc(max, sizeof(topo_cpu_t));
+
+  for (i = 0; i < max; ++i) {
+    char path[256];
+    int pkg = 0, core = i;
+    topo_cpu_t *c;
+    if (!online[i]) continue;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
+    _read_int(path, &pkg);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", i);
+    _read_int(path, &core);
+
+    c = &t->cpus[n++];
+    c->id = i;
+    c->node = numa_available() < 0 ? 0 : numa_node_of_cpu(i);
+    if (c->node < 0 || c->node >= t->nnodes) c->node = 0;
+    c->sibling = 0;
+    // core ids repeat across packages
+    for (j = 0; j < ncores; ++j) {
+      if (pkg_core[j * 2] == pkg && pkg_core[j * 2 + 1] == core) break;
+    }
+    if (j == ncores) {
+      pkg_core[j * 2] = pkg;
+      pkg_core[j * 2 + 1] = core;
+      ncores++;
+    }
+    c->core = j;
+  }
+  t->ncpus = n;
+
+  // CPUs are in id order, so the lowest id of a core is its first thread
+  for (i = 0; i < n; ++i) {
+    for (j = 0; j < i; ++j) {
+      if (t->cpus[j].core == t->cpus[i].core) t->cpus[i].sibling++;
+    }
+  }
+
+  free(online);
+  free(pkg_core);
+  return n > 0 ? 0 : -1;
+}
+
+void topology_free(topology_t *t)
+{
+  free(t->cpus);
+  t->cpus = NULL;
+  t->ncpus = 0;
+}
+
+int topology_device_node(const char *devname)
+{
+  char path[512];
+  int node = -1;
+
+  // kernel driver: /dev/nvme0n1 -> controller -> PCI function
+  snprintf(path, sizeof(path), "/sys/block/%s/device/device/numa_node", devname);
+  if (_read_int(path, &node) == 0) return node < 0 ? -1 : node;
+  // user space driver: PCI address
+  snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/numa_node", devname);
+  if (_read_int(path, &node) == 0) return node < 0 ? -1 : node;
+  return -1;
+}
+
+static int _cmp_spread(const void *a, const void *b)
+{
+  const topo_cpu_t *x = *(const topo_cpu_t **)a;
+  const topo_cpu_t *y = *(const topo_cpu_t **)b;
+  if (x->sibling != y->sibling) return x->sibling - y->sibling;
+  return x->id - y->id;
+}
+
+// CPUs of node for benchmark threads, first threads of all cores first
+static int _node_cpus(topology_t *t, int node, const char *reserved,
+                      topo_cpu_t **out)
+{
+  int i, n = 0;
+  for (i = 0; i < t->ncpus; ++i) {
+    if (t->cpus[i].node == node && !reserved[t->cpus[i].core]) out[n++] = &t->cpus[i];
+  }
+  // every CPU of the node polls: share them rather than leave the node
+  if (n == 0) {
+    for (i = 0; i < t->ncpus; ++i) {
+      if (t->cpus[i].node == node) out[n++] = &t->cpus[i];
+    }
+  }
+  // a node with memory only
+  if (n == 0) {
+    for (i = 0; i < t->ncpus; ++i) out[n++] = &t->cpus[i];
+  }
+  qsort(out, n, sizeof(*out), _cmp_spread);
+  return n;
+}
+
+// one CPU per thread for each device, devices of a node take turns
+static void _spread(topology_t *t, int ndevs, placement_t *plan, int nthreads,
+                    const char *reserved, int bench)
+{
+  topo_cpu_t **cpus = (topo_cpu_t **)malloc(sizeof(topo_cpu_t *) * t->ncpus);
+  int *next = (int *)calloc(t->nnodes, sizeof(int));
+  int node, d, k;
+
+  for (node = 0; node < t->nnodes; ++node) {
+    int n = _node_cpus(t, node, reserved, cpus);
+    for (k = 0; k < nthreads; ++k) {
+      for (d = 0; d < ndevs; ++d) {
+        int *dst = bench ? plan[d].bench_cpus : plan[d].pop_cpus;
+        if (plan[d].node != node) continue;
+        dst[k] = cpus[next[node]++ % n]->id;
+      }
+    }
+  }
+  free(next);
+  free(cpus);
+}
+
+int placement_plan(topology_t *t, int ndevs, const int *nodes, int polling,
+                   int pop_threads, int bench_threads, placement_t *plan)
+{
+  char *reserved;
+  int i, d;
+
+  if (t->ncpus == 0) return -1;
+  reserved = (char *)calloc(t->ncpus, 1);   // by core, cores <= CPUs
+
+  for (d = 0; d < ndevs; ++d) {
+    plan[d].node = nodes[d] >= 0 && nodes[d] < t->nnodes ? nodes[d] : d % t->nnodes;
+    plan[d].cq_cpu = -1;
+    plan[d].pop_cpus = (int *)malloc(sizeof(int) * (pop_threads > 0 ? pop_threads : 1));
+    plan[d].bench_cpus = (int *)malloc(sizeof(int) * (bench_threads > 0 ? bench_threads : 1));
+    if (!polling) continue;
+
+    // a whole core of the node, else any core of the node
+    for (i = 0; i < t->ncpus; ++i) {
+      topo_cpu_t *c = &t->cpus[i];
+      if (c->node == plan[d].node && c->sibling == 0 && !reserved[c->core]) break;
+    }
+    if (i == t->ncpus) {
+      for (i = 0; i < t->ncpus; ++i) {
+        if (t->cpus[i].node == plan[d].node) break;
+      }
+    }
+    if (i == t->ncpus) i = d % t->ncpus;
+    plan[d].cq_cpu = t->cpus[i].id;
+    reserved[t->cpus[i].core] = 1;
+  }
+
+  _spread(t, ndevs, plan, pop_threads, reserved, 0);
+  _spread(t, ndevs, plan, bench_threads, reserved, 1);
+  free(reserved);
+  return 0;
+}
+
+void placement_free(placement_t *plan, int ndevs)
+{
+  int d;
+  for (d = 0; d < ndevs; ++d) {
+    free(plan[d].pop_cpus);
+    free(plan[d].bench_cpus);
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef __TOPOLOGY_H
+#define __TOPOLOGY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CPU, NUMA and device topology, and the automatic placement of benchmark
+ * threads built on it ([system] placement = auto).
+ *
+ * Every device is placed on its NUMA node. Polling completion threads get a
+ * physical core of their own: the other hardware threads of that core are
+ * left idle, so a spinning thread does not share its core's pipeline with a
+ * benchmark thread. Benchmark threads of the devices on a node are spread
+ * over the remaining CPUs of the node, one hardware thread per physical core
+ * first, then the siblings. Population and benchmark threads do not run at
+ * the same time and are placed independently.
+ */
+
+typedef struct topo_cpu {
+  int id;        // logical CPU
+  int node;
+  int core;      // physical core, unique over all packages
+  int sibling;   // index among the hardware threads of the core
+} topo_cpu_t;
+
+typedef struct topology {
+  int ncpus;
+  topo_cpu_t *cpus;   // online CPUs in id order
+  int nnodes;
+} topology_t;
+
+typedef struct placement {
+  int node;           // of the device
+  int cq_cpu;         // polling completion thread, -1 without one
+  int *pop_cpus;      // one per population thread
+  int *bench_cpus;    // one per benchmark thread
+} placement_t;
+
+// reads the online CPUs from sysfs, returns -1 if none were found
+int topology_read(topology_t *t);
+void topology_free(topology_t *t);
+// NUMA node of a block device name (nvme0n1) or PCI address (0000:06:00.0),
+// -1 if unknown, e.g. for the emulator
+int topology_device_node(const char *devname);
+
+// plans ndevs devices, nodes[i] < 0 places device i round robin;
+// returns -1 if the topology has no CPUs
+int placement_plan(topology_t *t, int ndevs, const int *nodes, int polling,
+                   int pop_threads, int bench_threads, placement_t *plan);
+void placement_free(placement_t *plan, int ndevs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,6 +8,9 @@
 #include <unistd.h>
 #include <mutex>
 #include <queue>
+#include <string>
+#include <vector>
+#include <algorithm>
 
 #include "kvs_api.h"
 #include "libcouchstore/couch_db.h"
@@ -24,6 +27,12 @@
 static uint32_t max_sample = 1000000;
 static int use_udd = 0;
 static int kdd_is_polling = 1;
+static int long_keys = 0;
+static uint32_t hot_keys_top = 0;
+static uint32_t hot_keys_sample = 16;
+static uint32_t read_ahead_depth = 0;
+static uint32_t read_ahead_streams = 16;
+static uint32_t read_ahead_value_size = 4096;
 #define GB_SIZE (1024*1024*1024)
 
 int couch_kv_min_key_len = KVS_MIN_KEY_LENGTH;
@@ -489,15 +498,102 @@ couchstore_error_t couchstore_open_db_kvs(const char *dev_path,
   kvs_option_key_space option = {KVS_KEY_ORDER_NONE};
   kvs_create_key_space(ppdb->dev, &ks_name, 0, option);
   kvs_open_key_space(ppdb->dev, (char *)g_container_name, &ppdb->cont_hd);
+  if (long_keys)
+    kvs_set_long_keys(ppdb->cont_hd, true);
+  if (hot_keys_top) {
+    kvs_option_hot_keys hk_opt;
+    memset(&hk_opt, 0, sizeof(hk_opt));
+    hk_opt.top_k = hot_keys_top;
+    hk_opt.sample_rate = hot_keys_sample;
+    kvs_set_hot_keys(ppdb->cont_hd, &hk_opt);
+  }
+  if (read_ahead_depth) {
+    kvs_option_read_ahead ra_opt;
+    memset(&ra_opt, 0, sizeof(ra_opt));
+    ra_opt.depth = read_ahead_depth;
+    ra_opt.streams = read_ahead_streams;
+    ra_opt.value_size = read_ahead_value_size;
+    kvs_set_read_ahead(ppdb->cont_hd, &ra_opt);
+  }
 
   fprintf(stdout, "device open %s\n", dev_path);
 
   return COUCHSTORE_SUCCESS;
 }
 
+static void _print_hot_keys(Db *db, kvs_hot_keys_order order, const char *name)
+{
+  std::vector<kvs_hot_key> keys(hot_keys_top);
+  uint32_t count = hot_keys_top;
+  if (kvs_get_hot_keys(db->cont_hd, order, keys.data(), &count) != KVS_SUCCESS)
+    return;
+
+  fprintf(stdout, "hot keys of device %d by %s (estimated, 1 of %u requests sampled)\n",
+          db->id, name, hot_keys_sample);
+  fprintf(stdout, "%4s %12s %12s %14s  %s\n", "rank", "reads", "writes", "bytes", "key");
+  for (uint32_t i = 0; i < count; i++) {
+    const kvs_hot_key &k = keys[i];
+    std::string str;
+    uint32_t len = std::min<uint32_t>(k.key_len, KVS_MAX_KEY_LENGTH);
+    for (uint32_t j = 0; j < len; j++) {
+      char buf[8];
+      if (k.key[j] >= 0x20 && k.key[j] < 0x7f && k.key[j] != '\\')
+        snprintf(buf, sizeof(buf), "%c", k.key[j]);
+      else
+        snprintf(buf, sizeof(buf), "\\x%02x", k.key[j]);
+      str += buf;
+    }
+    if (len < k.key_len) str += "...";
+    fprintf(stdout, "%4u %12lu %12lu %14lu  %s\n", i + 1, k.reads, k.writes,
+            k.bytes, str.c_str());
+  }
+}
+
+static void _print_read_ahead_stats(Db *db)
+{
+  kvs_read_ahead_stats st;
+  if (kvs_get_read_ahead_stats(db->cont_hd, &st) != KVS_SUCCESS)
+    return;
+
+  fprintf(stdout, "read-ahead of device %d: %.2f%% of %lu retrieves hit (%lu waited), "
+          "%lu speculative retrieves, %.2f%% wasted (%lu invalidated, %lu canceled), "
+          "%lu throttled\n", db->id,
+          st.retrieves ? 100.0 * (st.hits + st.late_hits) / st.retrieves : 0,
+          st.retrieves, st.late_hits, st.issued,
+          st.issued ? 100.0 * st.wasted / st.issued : 0, st.invalidated, st.canceled,
+          st.throttled);
+}
+
+// hit rates of the emulator's device cache model, if configured
+static void _print_cache_stats(Db *db)
+{
+  kvs_cache_stats st;
+  if (kvs_get_cache_stats(db->dev, &st) != KVS_SUCCESS || st.capacity == 0)
+    return;
+
+  uint64_t reads = st.read_hits + st.read_misses;
+  uint64_t writes = st.write_absorbed + st.write_through;
+  fprintf(stdout, "device cache of device %d: read hit rate %.2f%% (%lu of %lu), "
+          "writes absorbed %.2f%% (%lu of %lu), %lu flushes, %lu MB written back, "
+          "%lu evictions\n", db->id,
+          reads ? 100.0 * st.read_hits / reads : 0, st.read_hits, reads,
+          writes ? 100.0 * st.write_absorbed / writes : 0, st.write_absorbed, writes,
+          st.flushes, st.flushed_bytes >> 20, st.evictions);
+}
+
 LIBCOUCHSTORE_API
 couchstore_error_t couchstore_close_db(Db *db)
 {
+  _print_cache_stats(db);
+
+  if (hot_keys_top) {
+    _print_hot_keys(db, KVS_HOT_KEYS_READS, "reads");
+    _print_hot_keys(db, KVS_HOT_KEYS_WRITES, "writes");
+    _print_hot_keys(db, KVS_HOT_KEYS_BYTES, "bytes");
+  }
+  if (read_ahead_depth)
+    _print_read_ahead_stats(db);
+
   if(use_udd || kdd_is_polling == 0) {
     IoContext *tmp;
 
@@ -905,6 +1001,29 @@ couchstore_error_t couchstore_kvs_set_max_sample(uint32_t sample_num)
   return COUCHSTORE_SUCCESS;
 }
 
+couchstore_error_t couchstore_kvs_set_long_keys(int enable)
+{
+  long_keys = enable;
+  couch_kv_max_key_len = enable ? KVS_MAX_LONG_KEY_LENGTH : KVS_MAX_KEY_LENGTH;
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_hot_keys(uint32_t top_k, uint32_t sample_rate)
+{
+  hot_keys_top = top_k;
+  hot_keys_sample = sample_rate ? sample_rate : 1;
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_read_ahead(uint32_t depth, uint32_t streams,
+                                                 uint32_t value_size)
+{
+  read_ahead_depth = depth;
+  read_ahead_streams = streams;
+  read_ahead_value_size = value_size;
+  return COUCHSTORE_SUCCESS;
+}
+
 couchstore_error_t couchstore_close_device(int32_t dev_id)
 {
 
@@ -0,0 +1,678 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <algorithm>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "kvs_api.h"
+#include "kvs_adi.h"
+#include "libcouchstore/couch_db.h"
+#include "stopwatch.h"
+#include "arch.h"
+#include "memory.h"
+#include "workload.h"
+
+/*
+ * kvbench backend that talks to the device abstraction interface (kvs_adi.h)
+ * directly, bypassing cfrontend and the KvsDriver adapters. It links against
+ * the same libkvapi as kv_bench, so it drives the emulator or the kernel
+ * driver adapter depending on how the library was built.
+ *
+ * Completions are reaped with kv_poll_completion from the bench threads
+ * themselves, so no callback thread is involved on either adapter.
+ *
+ * On an emulator in simulation mode (simulation = true in the emulator
+ * configuration file) the stopwatches and latencies of the bench follow the
+ * virtual clock of the device (kv_get_sim_time) instead of the wall clock.
+ */
+
+#define LATENCY_CHECK  // only for async IO completion latency
+static uint32_t max_sample = 1000000;
+
+int couch_kv_min_key_len = KVS_MIN_KEY_LENGTH;
+int couch_kv_max_key_len = KVS_MAX_KEY_LENGTH;
+
+// first keyspace id used for user data, see USER_DATA_KEYSPACE_START_ID
+static const uint8_t g_keyspace_id = 1;
+static const int g_pool_size = 36000;
+
+struct adi_request;
+
+struct _db {
+  int id;
+  kv_device_handle devH;
+  kv_namespace_handle nsH;
+  kv_queue_handle sqH;
+  kv_queue_handle cqH;
+
+  std::queue<IoContext*> *iocontexts;
+  std::queue<IoContext*> *iodone;
+  std::queue<adi_request*> *requests;
+  latency_stat *l_read;
+  latency_stat *l_write;
+  latency_stat *l_delete;
+  std::mutex lock_k;
+  std::mutex lock_poll;
+  // simulation mode: virtual and wall time when the device was opened
+  bool simulated;
+  uint64_t sim_start_ns;
+  unsigned long long wall_start_us;
+};
+
+struct adi_request {
+  Db *db;
+  int tid;
+  int opcode;
+  int syncio;
+  volatile int done;
+  kv_result result;
+  kv_key key;
+  kv_value value;
+  unsigned long long start;
+};
+
+static int kv_write_mode = 0;
+static int queue_depth = 8;
+static int32_t aio_count = 0;
+static char kv_emul_config[1024];
+
+static adi_request *get_request(Db *db) {
+  std::unique_lock<std::mutex> lock(db->lock_k);
+  if (db->requests->empty()) {
+    fprintf(stdout, "No elem in the request pool\n");
+    exit(0);
+  }
+  adi_request *req = db->requests->front();
+  db->requests->pop();
+  return req;
+}
+
+static void put_request(Db *db, adi_request *req) {
+  std::unique_lock<std::mutex> lock(db->lock_k);
+  db->requests->push(req);
+}
+
+static unsigned long long wall_usec() {
+  struct timespec t11;
+  clock_gettime(CLOCK_REALTIME, &t11);
+  return (t11.tv_sec * 1000000000L + t11.tv_nsec) / 1000L;
+}
+
+// the virtual clock is shared by all simulated devices, any open one can be
+// read; the last time read stays after they are all closed
+static std::mutex sim_lock;
+static std::vector<kv_device_handle> sim_devices;
+static uint64_t sim_last_ns = 0;
+
+static void sim_clock(struct timeval *tv) {
+  std::unique_lock<std::mutex> lock(sim_lock);
+  uint64_t ns;
+  if (!sim_devices.empty() && kv_get_sim_time(sim_devices.front(), &ns) == KV_SUCCESS)
+    sim_last_ns = ns;
+  tv->tv_sec = sim_last_ns / 1000000000ULL;
+  tv->tv_usec = (sim_last_ns % 1000000000ULL) / 1000;
+}
+
+static unsigned long long now_usec() {
+  struct timeval tv;
+  stopwatch_gettime(&tv);
+  return _timeval_to_us(tv);
+}
+
+static void record_latency(latency_stat *l_stat, unsigned long long start) {
+  if (l_stat == NULL || start == 0) return;
+  unsigned long long end = now_usec();
+  uint64_t cur_sample;
+
+  if (l_stat->cursor >= max_sample) {
+    l_stat->cursor = l_stat->cursor % max_sample;
+    l_stat->nsamples = max_sample;
+  } else {
+    l_stat->nsamples = l_stat->cursor + 1;
+  }
+  cur_sample = l_stat->cursor;
+  l_stat->cursor++;
+  l_stat->samples[cur_sample] = end - start;
+}
+
+void on_adi_complete(kv_io_context *context) {
+  adi_request *req = (adi_request*)context->private_data;
+  Db *owner = req->db;
+  kv_result ret = context->retcode;
+
+  if (ret != KV_SUCCESS && ret != KV_ERR_KEY_NOT_EXIST &&
+      !(req->opcode == KV_OPC_GET && ret == KV_ERR_BUFFER_SMALL)) {
+    fprintf(stdout, "io error: op = %d, key = %s, result = %x\n",
+            req->opcode, (char*)req->key.key, ret);
+    exit(1);
+  }
+
+  if (req->syncio) {
+    req->result = ret;
+    req->done = 1;
+    return;
+  }
+
+  latency_stat *l_stat = NULL;
+  std::unique_lock<std::mutex> lock(owner->lock_k);
+  IoContext *ctx = owner->iocontexts->front();
+  owner->iocontexts->pop();
+  lock.unlock();
+  if (ctx == NULL) {
+    fprintf(stderr, "Not enough context, outstanding %d\n",
+            (int)owner->iodone->size());
+    exit(1);
+  }
+  ctx->tid = req->tid;
+  ctx->key = req->key.key;
+  switch (req->opcode) {
+  case KV_OPC_STORE:
+    ctx->value = req->value.value;
+    l_stat = owner->l_write;
+    break;
+  case KV_OPC_GET:
+    ctx->value = req->value.value;
+    l_stat = owner->l_read;
+    break;
+  case KV_OPC_DELETE:
+    ctx->value = NULL;
+    l_stat = owner->l_delete;
+    break;
+  }
+
+#if defined LATENCY_CHECK
+  record_latency(l_stat, req->start);
+#endif
+
+  put_request(owner, req);
+  lock.lock();
+  owner->iodone->push(ctx);
+}
+
+// only one thread reaps a queue at a time, the others pick up what it reaped
+static void poll_completions(Db *db) {
+  std::unique_lock<std::mutex> lock(db->lock_poll, std::try_to_lock);
+  if (!lock.owns_lock()) return;
+
+  uint32_t processed = 0;
+  kv_result ret = kv_poll_completion(db->cqH, 0, &processed);
+  if (ret != KV_SUCCESS && ret != KV_WRN_MORE) {
+    fprintf(stderr, "KVBENCH: poll completion failed 0x%x\n", ret);
+    exit(1);
+  }
+}
+
+static void wait_request(Db *db, adi_request *req) {
+  poll_completions(db);
+  while (!req->done) {
+    sched_yield();
+    poll_completions(db);
+  }
+}
+
+int getevents(Db *db, int min, int max, IoContext_t **context, int tid)
+{
+  int i = 0;
+  poll_completions(db);
+
+  std::unique_lock<std::mutex> lock(db->lock_k);
+  int queue_size = db->iodone->size();
+  while (queue_size > 0 && i < max) {
+    context[i] = db->iodone->front();
+    db->iodone->pop();
+    if (context[i]->tid != tid) {
+      db->iodone->push(context[i]);
+    } else {
+      i++;
+    }
+    queue_size--;
+  }
+  lock.unlock();
+  return i;
+}
+
+couchstore_error_t couchstore_setup_device(const char *dev_path,
+					   char **dev_names,
+					   char *config_file,
+					   int num_devices, int write_mode,
+					   int is_polling)
+{
+  if (dev_path[1] != 'd') {
+    fprintf(stderr, "KVBENCH: the ADI backend supports emulator and kernel driver devices only\n");
+    exit(1);
+  }
+
+  snprintf(kv_emul_config, sizeof(kv_emul_config), "%s", config_file ? config_file : "");
+  kv_write_mode = write_mode;
+
+  fprintf(stdout, "device init done\n");
+  return COUCHSTORE_SUCCESS;
+}
+
+static int create_queue(Db *db, uint16_t qid, uint16_t qtype, uint16_t cqid,
+                        kv_queue_handle *handle)
+{
+  kv_queue qinfo;
+  qinfo.queue_id = qid;
+  qinfo.queue_size = queue_depth;
+  qinfo.completion_queue_id = cqid;
+  qinfo.queue_type = qtype;
+  qinfo.extended_info = NULL;
+
+  kv_result ret = kv_create_queue(db->devH, &qinfo, handle);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "kv_create_queue failed 0x%x\n", ret);
+    return -1;
+  }
+  return 0;
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_open_db_kvs(const char *dev_path,
+					  Db **pDb, int id)
+{
+  kv_result ret;
+  Db *ppdb = new Db();
+  *pDb = ppdb;
+  ppdb->id = id;
+
+  // polling mode: completions are reaped by kv_poll_completion in getevents
+  kv_device_init_t dev_init;
+  memset(&dev_init, 0, sizeof(dev_init));
+  dev_init.devpath = dev_path;
+  dev_init.configfile = kv_emul_config[0] ? kv_emul_config : NULL;
+  dev_init.need_persistency = FALSE;
+  dev_init.is_polling = TRUE;
+  dev_init.queuedepth = queue_depth;
+
+  ret = kv_initialize_device(&dev_init, &ppdb->devH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "Device open failed 0x%x\n", ret);
+    exit(1);
+  }
+  uint64_t sim_ns;
+  ppdb->simulated = (kv_get_sim_time(ppdb->devH, &sim_ns) == KV_SUCCESS);
+  if (ppdb->simulated) {
+    std::unique_lock<std::mutex> lock(sim_lock);
+    sim_devices.push_back(ppdb->devH);
+    ppdb->sim_start_ns = sim_ns;
+    ppdb->wall_start_us = wall_usec();
+    stopwatch_set_clock(sim_clock);
+  }
+
+  ret = get_namespace_default(ppdb->devH, &ppdb->nsH);
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "get_namespace_default failed 0x%x\n", ret);
+    exit(1);
+  }
+  if (create_queue(ppdb, 0, COMPLETION_Q_TYPE, 0, &ppdb->cqH) ||
+      create_queue(ppdb, 1, SUBMISSION_Q_TYPE, 0, &ppdb->sqH)) {
+    exit(1);
+  }
+
+  ppdb->iocontexts = new std::queue<IoContext*>;
+  ppdb->iodone = new std::queue<IoContext*>;
+  ppdb->requests = new std::queue<adi_request*>;
+  for (int i = 0; i < g_pool_size; i++) {
+    IoContext *context = (IoContext *)malloc(sizeof(IoContext));
+    adi_request *req = (adi_request *)malloc(sizeof(adi_request));
+    if (context == NULL || req == NULL) {
+      fprintf(stderr, "Can not allocate db context\n");
+      exit(0);
+    }
+    memset(context, 0, sizeof(IoContext));
+    memset(req, 0, sizeof(adi_request));
+    ppdb->iocontexts->push(context);
+    ppdb->requests->push(req);
+  }
+
+  fprintf(stdout, "device open %s (ADI%s)\n", dev_path,
+          ppdb->simulated ? ", simulation" : "");
+  return COUCHSTORE_SUCCESS;
+}
+
+// hit rates of the emulator's device cache model, if configured
+static void print_cache_stats(Db *db) {
+  kv_cache_stat st;
+  if (kv_get_cache_stat(db->devH, db->nsH, &st) != KV_SUCCESS || st.capacity == 0)
+    return;
+
+  uint64_t reads = st.read_hits + st.read_misses;
+  uint64_t writes = st.write_absorbed + st.write_through;
+  fprintf(stdout, "device cache of device %d: read hit rate %.2f%% (%lu of %lu), "
+          "writes absorbed %.2f%% (%lu of %lu), %lu flushes, %lu MB written back, "
+          "%lu evictions\n", db->id,
+          reads ? 100.0 * st.read_hits / reads : 0, st.read_hits, reads,
+          writes ? 100.0 * st.write_absorbed / writes : 0, st.write_absorbed, writes,
+          st.flushes, st.flushed_bytes >> 20, st.evictions);
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_close_db(Db *db)
+{
+  print_cache_stats(db);
+
+  std::unique_lock<std::mutex> lock(db->lock_k);
+  while (!db->iocontexts->empty()) {
+    free(db->iocontexts->front());
+    db->iocontexts->pop();
+  }
+  while (!db->requests->empty()) {
+    free(db->requests->front());
+    db->requests->pop();
+  }
+  delete db->iocontexts;
+  delete db->iodone;
+  delete db->requests;
+  lock.unlock();
+
+  kv_delete_queue(db->devH, db->sqH);
+  kv_delete_queue(db->devH, db->cqH);
+  kv_delete_namespace(db->devH, db->nsH);
+
+  if (db->simulated) {
+    uint64_t sim_ns = db->sim_start_ns;
+    kv_get_sim_time(db->devH, &sim_ns);
+    double sim_sec = (sim_ns - db->sim_start_ns) / 1e9;
+    double wall_sec = (wall_usec() - db->wall_start_us) / 1e6;
+    fprintf(stdout, "device %d simulated %.3f sec in %.3f sec wall time (%.1fx)\n",
+            db->id, sim_sec, wall_sec, wall_sec > 0 ? sim_sec / wall_sec : 0);
+
+    std::unique_lock<std::mutex> lock(sim_lock);
+    sim_last_ns = std::max(sim_last_ns, sim_ns);
+    sim_devices.erase(std::find(sim_devices.begin(), sim_devices.end(), db->devH));
+  }
+  kv_cleanup_device(db->devH);
+
+  delete db;
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_exit_env(){
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_iterator_open(Db *db, int iterator_mode) {
+  fprintf(stdout, "\nWARN: Iterator is not supported by the ADI backend\n");
+  exit(0);
+}
+
+couchstore_error_t couchstore_iterator_close(Db *db) {
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_iterator_next(Db *db) {
+  return COUCHSTORE_SUCCESS;
+}
+
+bool couchstore_iterator_check_status(Db *db) {
+  return true;
+}
+
+int couchstore_iterator_get_numentries(Db *db) {
+  return 0;
+}
+
+int couchstore_iterator_has_finish(Db *db) {
+  return 1;
+}
+
+static adi_request *prep_request(Db *db, int opcode, int tid, void *key, int klen,
+                                 void *value, uint32_t vlen, int syncio,
+                                 couchstore_open_options options)
+{
+  adi_request *req = get_request(db);
+  req->db = db;
+  req->tid = tid;
+  req->opcode = opcode;
+  req->syncio = syncio;
+  req->done = 0;
+  req->result = KV_SUCCESS;
+  req->key.key = key;
+  req->key.length = (kv_key_t)klen;
+  req->value.value = value;
+  req->value.length = vlen;
+  req->value.actual_value_size = 0;
+  req->value.offset = 0;
+  req->start = 0;
+#if defined LATENCY_CHECK
+  if (!syncio && options == 1)
+    req->start = now_usec();
+#endif
+  return req;
+}
+
+static couchstore_error_t submit(Db *db, adi_request *req)
+{
+  kv_result ret = KV_SUCCESS;
+  kv_postprocess_function f = {on_adi_complete, (void*)req};
+
+retry:
+  switch (req->opcode) {
+  case KV_OPC_STORE:
+    ret = kv_store(db->sqH, db->nsH, g_keyspace_id, &req->key, &req->value,
+                   KV_STORE_OPT_DEFAULT, &f);
+    break;
+  case KV_OPC_GET:
+    ret = kv_retrieve(db->sqH, db->nsH, g_keyspace_id, &req->key,
+                      KV_RETRIEVE_OPT_DEFAULT, &req->value, &f);
+    break;
+  case KV_OPC_DELETE:
+    ret = kv_delete(db->sqH, db->nsH, g_keyspace_id, &req->key,
+                    KV_DELETE_OPT_DEFAULT, &f);
+    break;
+  }
+
+  if (ret == KV_ERR_QUEUE_IS_FULL) {
+    // the submission queue is shallower than the bench depth, drain and retry
+    poll_completions(db);
+    goto retry;
+  }
+  if (ret != KV_SUCCESS) {
+    fprintf(stderr, "KVBENCH: ADI op %d failed for %s, err 0x%x\n",
+            req->opcode, (char*)req->key.key, ret);
+    exit(1);
+  }
+
+  if (req->syncio) {
+    wait_request(db, req);
+    put_request(db, req);
+  }
+  return COUCHSTORE_SUCCESS;
+}
+
+void pass_lstat_to_db(Db *db, latency_stat *l_read, latency_stat *l_write, latency_stat *l_delete)
+{
+  db->l_read = l_read;
+  db->l_write = l_write;
+  db->l_delete = l_delete;
+}
+
+int release_context(Db *db, IoContext **contexts, int nr){
+  for (int i = 0; i < nr; i++) {
+    if (contexts[i]) {
+      std::unique_lock<std::mutex> lock(db->lock_k);
+      db->iocontexts->push(contexts[i]);
+    }
+  }
+  return 0;
+}
+
+couchstore_error_t couchstore_kvs_set_aio_option(int kvs_queue_depth, char *core_masks, char *cq_thread_masks, uint32_t mem_size_mb)
+{
+  queue_depth = kvs_queue_depth;
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_aiothreads(int kvs_aio_threads)
+{
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_coremask(char *kvs_core_ids)
+{
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_get_aiocompletion(int32_t *count)
+{
+  *count = aio_count;
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_reset_aiocompletion(){
+  aio_count = 0;
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_max_sample(uint32_t sample_num)
+{
+  max_sample = sample_num;
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_long_keys(int enable)
+{
+  //long keys are a key space feature of the SNIA API, ADI has none
+  if (enable) {
+    fprintf(stderr, "long keys are not supported by kvadi_bench\n");
+    return COUCHSTORE_ERROR_INVALID_ARGUMENTS;
+  }
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_hot_keys(uint32_t top_k, uint32_t sample_rate)
+{
+  //hot key tracking is part of the SNIA API key spaces
+  if (top_k) {
+    fprintf(stderr, "hot keys are not supported by kvadi_bench\n");
+    return COUCHSTORE_ERROR_INVALID_ARGUMENTS;
+  }
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_set_read_ahead(uint32_t depth, uint32_t streams,
+                                                 uint32_t value_size)
+{
+  //read-ahead is part of the SNIA API key spaces
+  if (depth) {
+    fprintf(stderr, "read-ahead is not supported by kvadi_bench\n");
+    return COUCHSTORE_ERROR_INVALID_ARGUMENTS;
+  }
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_close_device(int32_t dev_id)
+{
+  return COUCHSTORE_SUCCESS;
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_db_info(Db *db, DbInfo* info)
+{
+  return COUCHSTORE_SUCCESS;
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_save_documents(Db *db, Doc* const docs[], DocInfo *infos[],
+		   unsigned numdocs, couchstore_save_options options)
+{
+  for (unsigned i = 0; i < numdocs; i++) {
+    adi_request *req = prep_request(db, KV_OPC_STORE, docs[i]->tid, docs[i]->id.buf,
+                                    docs[i]->id.size, docs[i]->data.buf,
+                                    (uint32_t)docs[i]->data.size, kv_write_mode == 1,
+                                    (couchstore_open_options)options);
+    submit(db, req);
+  }
+  return COUCHSTORE_SUCCESS;
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_save_document(Db *db, const Doc *doc, DocInfo *info,
+        couchstore_save_options options)
+{
+  return couchstore_save_documents(db, (Doc**)&doc, (DocInfo**)&info, 1, options);
+}
+
+couchstore_error_t couchstore_open_document_kv (Db *db,
+						sized_buf *key,
+						sized_buf *value,
+						couchstore_open_options options)
+{
+  adi_request *req = prep_request(db, KV_OPC_GET, key->tid, key->buf, key->size,
+                                  value->buf, (uint32_t)value->size,
+                                  kv_write_mode == 1, options);
+  return submit(db, req);
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_open_document(Db *db,
+                                            const void *id,
+                                            size_t idlen,
+                                            Doc **pDoc,
+                                            couchstore_open_options options)
+{
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_delete_document_kv(Db *db,
+						 sized_buf *key,
+						 couchstore_open_options options)
+{
+  adi_request *req = prep_request(db, KV_OPC_DELETE, key->tid, key->buf, key->size,
+                                  NULL, 0, kv_write_mode == 1, options);
+  return submit(db, req);
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_delete_document(Db *db,
+					      const void *id,
+					      size_t idlen,
+					      couchstore_open_options options)
+{
+  return COUCHSTORE_SUCCESS;
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_walk_id_tree(Db *db,
+                                           const sized_buf* startDocID,
+                                           couchstore_docinfos_options options,
+                                           couchstore_walk_tree_callback_fn callback,
+                                           void *ctx)
+{
+  return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t couchstore_kvs_malloc(size_t size_bytes, void **buf){
+  *buf = kvs_malloc(size_bytes, 4096);
+  return COUCHSTORE_SUCCESS;
+}
+
+LIBCOUCHSTORE_API
+void couchstore_free_document(Doc *doc)
+{
+  if (doc->id.buf) kvs_free(doc->id.buf);
+  if (doc->data.buf) kvs_free(doc->data.buf);
+  free(doc);
+}
+
+LIBCOUCHSTORE_API
+void couchstore_free_docinfo(DocInfo *docinfo)
+{
+  free(docinfo);
+}
+
+LIBCOUCHSTORE_API
+couchstore_error_t couchstore_commit(Db *db)
+{
+  // do nothing for KVS
+  return COUCHSTORE_SUCCESS;
+}